@@ -227,6 +227,23 @@ size_t xPortGetFreeHeapSize( void )
     return sp - brk_val + mi.fordblks;
 }
 
+#if !USE_CUSTOM_HEAP
+/* The free chunks inside the heap are not reachable through mallinfo, so
+   this is the room above the heap: the top chunk (keepcost) and what sbrk
+   has not given yet. The largest block is at least that big.
+*/
+size_t xPortGetLargestFreeBlockSize( void )
+{
+    struct mallinfo mi = mallinfo();
+    uint32_t brk_val = (uint32_t) sbrk(0);
+
+    intptr_t sp = (intptr_t)xPortSupervisorStackPointer;
+    if(sp == 0) /* scheduler not started */
+        SP(sp);
+    return sp - brk_val + mi.keepcost;
+}
+#endif
+
 void vPortEndScheduler( void )
 {
     /* No-op, nothing to return to */
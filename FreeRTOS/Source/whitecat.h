@@ -227,6 +227,8 @@
 #define initTaskStack  configMINIMAL_STACK_SIZE * 10
 #define netTaskStack   configMINIMAL_STACK_SIZE * 10
 #define mqttStack      configMINIMAL_STACK_SIZE * 10
+#define acqStack       configMINIMAL_STACK_SIZE * 4
+#define pidStack       configMINIMAL_STACK_SIZE * 4
 #define ppinTaskStack  configMINIMAL_STACK_SIZE * 10
 #define loraTaskStack  configMINIMAL_STACK_SIZE * 10
 
@@ -1,7 +1,9 @@
 #ifndef LUA_RTOS_LUARTOS_H_
 #define LUA_RTOS_LUARTOS_H_
 
+#if !LUA_CROSS_COMPILER
 #include "FreeRTOS.h"
+#endif
 //#include "esp_task.h"
 //#include "sdkconfig.h"
 
@@ -22,15 +22,23 @@
 
 #if LUA_USE_ROTABLE
 
+// The host links the entries in a read only segment (platform/host/host.ld),
+// a volatile const would make their section writable
+#ifdef PLATFORM_HOST
+#define LIB_ENTRY static const
+#else
+#define LIB_ENTRY volatile static const
+#endif
+
 #define MODULE_REGISTER_UNMAPPED(fname, lname, func) \
 extern void LIB_INIT_DUMMY_FOO(fname)(lua_State *L){ \
-volatile static const PUT_IN_SECTION(LIB_TOSTRING(LIB_SECTION(fname,.lua_libs))) luaL_Reg LIB_CONCAT(lua_libs,LIB_CONCAT(_,LIB_CONCAT(lname,LIB_USED(fname)))) = {LIB_TOSTRING(lname), func}; \
+LIB_ENTRY PUT_IN_SECTION(LIB_TOSTRING(LIB_SECTION(fname,.lua_libs))) luaL_Reg LIB_CONCAT(lua_libs,LIB_CONCAT(_,LIB_CONCAT(lname,LIB_USED(fname)))) = {LIB_TOSTRING(lname), func}; \
 } 
 
 #define MODULE_REGISTER_MAPPED(fname, lname, map, func) \
 extern void LIB_INIT_DUMMY_FOO(fname)(lua_State *L){ \
-volatile static const PUT_IN_SECTION(LIB_TOSTRING(LIB_SECTION(fname,.lua_libs))) luaL_Reg LIB_CONCAT(lua_libs,LIB_CONCAT(_,LIB_CONCAT(lname,LIB_USED(fname)))) = {LIB_TOSTRING(lname), func}; \
-volatile static const PUT_IN_SECTION(LIB_TOSTRING(LIB_SECTION(fname,.lua_rotable))) luaR_entry LIB_CONCAT(lua_rotable,LIB_CONCAT(_,LIB_CONCAT(lname,LIB_USED(fname)))) = {LSTRKEY(LIB_TOSTRING(lname)), LROVAL(map)}; \
+LIB_ENTRY PUT_IN_SECTION(LIB_TOSTRING(LIB_SECTION(fname,.lua_libs))) luaL_Reg LIB_CONCAT(lua_libs,LIB_CONCAT(_,LIB_CONCAT(lname,LIB_USED(fname)))) = {LIB_TOSTRING(lname), func}; \
+LIB_ENTRY PUT_IN_SECTION(LIB_TOSTRING(LIB_SECTION(fname,.lua_rotable))) luaR_entry LIB_CONCAT(lua_rotable,LIB_CONCAT(_,LIB_CONCAT(lname,LIB_USED(fname)))) = {LSTRKEY(LIB_TOSTRING(lname)), LROVAL(map)}; \
 } 
 
 #define USE_LIB(fname) void LIB_INIT_DUMMY_FOO(fname)(lua_State *L); \
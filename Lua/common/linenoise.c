@@ -505,6 +505,10 @@ static int linenoiseEdit(int stdin_fd, int stdout_fd, char *buf, size_t buflen,
         char seq[3];
 
         nread = read(l.ifd,&c,1);
+#ifdef PLATFORM_HOST
+        /* End of a piped input, there is no UART to wait on */
+        if (nread == 0 && l.len == 0) exit(0);
+#endif
         if (nread <= 0) return l.len;
 
         switch(c) {
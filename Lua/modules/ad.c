@@ -32,6 +32,13 @@
 
 #include <pcf8591/pcf8591.h>
 
+#include "espressif/esp_common.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "sys/drivers/acq.h"
+
 
 #define ADDR PCF8591_DEFAULT_ADDRESS
 
@@ -41,9 +48,29 @@
 
 #define PWM_FREQ 500
 
+// Number of the ADC of the ESP8266 in this module
+#define ADC_INT -3
+
+// Blocks taken out of an acquisition ring at once
+#define ADC_ACQ_READ 32
+
 
 unsigned char dac = 0;
 
+
+// The last sample of the acquisition when it runs, else a read
+int adc_read_int(void){
+	int v = acq_last(ACQ_INT);
+
+	return (v >= 0) ? v : sdk_system_adc_read();
+}
+
+int adc_read_exp(int ch){
+	int v = acq_last(ch);
+
+	return (v >= 0) ? v : pcf8591_read(ADDR, (unsigned char)ch);
+}
+
 static int leadc_setup(lua_State* L) {
     return 0;
 }
@@ -56,7 +83,7 @@ static int leadc_adc( lua_State* L ) {
 
     if(ch < 0 || ch >3) return 0;
 
-    res = pcf8591_read(ADDR, ch); // &a0, &a1, &a2, &a3);
+    res = adc_read_exp(ch); // &a0, &a1, &a2, &a3);
     
     lua_pushinteger(L, res);
     return 1; 
@@ -94,12 +121,12 @@ static int leadc_get_val_meta( lua_State* L ) {
 	int ch = get_adc_num(L);
 	if(ch == -2) 
 		lua_pushnumber(L, ( 100.0*(float)dac )/255.0 );
-	else if(ch == -3) 
-		lua_pushnumber(L, ( 100.0*(float)sdk_system_adc_read() )/1023.0 );
+	else if(ch == ADC_INT) 
+		lua_pushnumber(L, ( 100.0*(float)adc_read_int() )/1023.0 );
 	else if(ch < 0 || ch > 3) 
 		lua_pushnil(L);
 	else
-		lua_pushnumber(L, ( 100.0*(float)pcf8591_read(ADDR, (unsigned char)ch) )/255.0 );
+		lua_pushnumber(L, ( 100.0*(float)adc_read_exp(ch) )/255.0 );
 	return 1;
 }
 
@@ -121,6 +148,160 @@ static int leadc_set_val_meta( lua_State* L ) {
 }
 
 
+/*
+ * Background acquisition, see sys/drivers/acq.c
+ *
+ *   adc.acq.start{channels = {0, 1, adc.acq.INT}, rate = 500, [decim = 10],
+ *                 [mode = adc.acq.AVERAGE], [ring = 64]}
+ *   v, min, max, seq = adc.acq.read(ch, [max])
+ *   st = adc.acq.stats([ch], [reset])
+ *   adc.acq.stop()
+ *
+ * The values are in the units of the converter, 0..255 or 0..1023 for the
+ * ADC of the ESP8266 (adc.acq.INT, -3 as for adc.Int). Block n is the one
+ * of samples n * decim to (n + 1) * decim - 1, at rate per second.
+ */
+static int acq_ch(lua_State* L, int ch){
+	if(ch == ADC_INT) return ACQ_INT;
+	if(ch < 0 || ch >= ACQ_INT)
+		return luaL_error(L, "invalid channel %d", ch);
+
+	return ch;
+}
+
+// Lua: adc.acq.start{...}
+static int leadc_acq_start( lua_State* L ) {
+	acq_config_t cfg;
+	int i, n;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+	memset(&cfg, 0, sizeof(cfg));
+
+	lua_getfield(L, 1, "channels");
+	luaL_checktype(L, -1, LUA_TTABLE);
+	n = luaL_len(L, -1);
+	for(i = 1; i <= n; i++){
+		lua_rawgeti(L, -1, i);
+		cfg.channels |= 1 << acq_ch(L, luaL_checkinteger(L, -1));
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+
+	lua_getfield(L, 1, "rate");
+	cfg.rate = luaL_checkinteger(L, -1);
+	lua_getfield(L, 1, "decim");
+	cfg.decim = luaL_optinteger(L, -1, 1);
+	lua_getfield(L, 1, "mode");
+	cfg.mode = luaL_optinteger(L, -1, ACQ_LAST);
+	lua_getfield(L, 1, "ring");
+	cfg.ring = luaL_optinteger(L, -1, 0);
+	lua_pop(L, 4);
+
+	switch(acq_start(&cfg)){
+		case 0:
+			return 0;
+		case EINVAL:
+			return luaL_error(L, "invalid channels, rate, decim, mode or ring");
+		case ENOMEM:
+			return luaL_error(L, "not enough memory");
+		default:
+			return luaL_error(L, "can't start the sampler");
+	}
+}
+
+// Lua: adc.acq.stop()
+static int leadc_acq_stop( lua_State* L ) {
+	acq_stop();
+	return 0;
+}
+
+// Lua: v, min, max, seq = adc.acq.read(ch, [max])
+// The blocks follow each other, a read stops at a gap of overruns
+static int leadc_acq_read( lua_State* L ) {
+	int ch = acq_ch(L, luaL_checkinteger(L, 1));
+	int max = luaL_optinteger(L, 2, ACQ_RING_MAX);
+	acq_block_t b[ADC_ACQ_READ];
+	uint32_t seq = 0, first = 0;
+	int i, n, total = 0;
+
+	if(!(acq_channels() & (1 << ch)))
+		return luaL_error(L, "the channel is not sampled");
+
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_newtable(L);
+
+	while(total < max){
+		n = acq_read(ch, b, (max - total < ADC_ACQ_READ) ? max - total : ADC_ACQ_READ, &seq, total > 0);
+		if(n <= 0) break;
+
+		if(total == 0) first = seq;
+
+		for(i = 0; i < n; i++){
+			total++;
+			lua_pushinteger(L, b[i].value);
+			lua_rawseti(L, -4, total);
+			lua_pushinteger(L, b[i].min);
+			lua_rawseti(L, -3, total);
+			lua_pushinteger(L, b[i].max);
+			lua_rawseti(L, -2, total);
+		}
+	}
+
+	if(total == 0) first = seq;
+	lua_pushinteger(L, first);
+
+	return 4;
+}
+
+// Lua: st = adc.acq.stats([ch], [reset])
+// Of the sampler, or of a channel
+static int leadc_acq_stats( lua_State* L ) {
+	acq_chan_stats_t cs;
+	acq_stats_t st;
+	int ch;
+
+	if(lua_isnoneornil(L, 1)){
+		acq_get_stats(&st, lua_toboolean(L, 2));
+
+		lua_createtable(L, 0, 7);
+		lua_pushboolean(L, st.running);
+		lua_setfield(L, -2, "running");
+		lua_pushinteger(L, st.rate);
+		lua_setfield(L, -2, "rate");
+		lua_pushinteger(L, st.decim);
+		lua_setfield(L, -2, "decim");
+		lua_pushinteger(L, st.samples);
+		lua_setfield(L, -2, "samples");
+		lua_pushinteger(L, st.missed);
+		lua_setfield(L, -2, "missed");
+		lua_pushinteger(L, st.sample_us);
+		lua_setfield(L, -2, "sample_us");
+		lua_pushinteger(L, st.sample_max);
+		lua_setfield(L, -2, "sample_max");
+		return 1;
+	}
+
+	ch = acq_ch(L, luaL_checkinteger(L, 1));
+	if(acq_chan_stats(ch, &cs) < 0)
+		return luaL_error(L, "the channel is not sampled");
+
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, cs.blocks);
+	lua_setfield(L, -2, "blocks");
+	lua_pushinteger(L, cs.overruns);
+	lua_setfield(L, -2, "overruns");
+	lua_pushinteger(L, cs.pending);
+	lua_setfield(L, -2, "pending");
+	lua_pushinteger(L, cs.seq);
+	lua_setfield(L, -2, "seq");
+	lua_pushinteger(L, cs.last);
+	lua_setfield(L, -2, "last");
+	lua_pushinteger(L, cs.full);
+	lua_setfield(L, -2, "full");
+	return 1;
+}
+
 
 
 #include "modules.h"
@@ -137,11 +318,26 @@ const LUA_REG_TYPE eadc_metatab[] =
 };
 
 
+const LUA_REG_TYPE eadc_acq_tab[] =
+{
+  { LSTRKEY( "start" ),		LFUNCVAL( leadc_acq_start ) },
+  { LSTRKEY( "stop" ),		LFUNCVAL( leadc_acq_stop ) },
+  { LSTRKEY( "read" ),		LFUNCVAL( leadc_acq_read ) },
+  { LSTRKEY( "stats" ),		LFUNCVAL( leadc_acq_stats ) },
+
+  { LSTRKEY( "LAST" ),			LINTVAL( ACQ_LAST ) },
+  { LSTRKEY( "AVERAGE" ),		LINTVAL( ACQ_AVERAGE ) },
+  { LSTRKEY( "INT" ),			LINTVAL( ADC_INT ) },
+  { LNILKEY, LNILVAL }
+};
+
+
 const LUA_REG_TYPE eadc_tab[] =
 {
 //  { LSTRKEY( "init" ),		LFUNCVAL( ladc_setup ) },
   { LSTRKEY( "adc" ),		LFUNCVAL( leadc_adc ) },
   { LSTRKEY( "dac" ),		LFUNCVAL( leadc_dac ) },
+  { LSTRKEY( "acq" ),		LROVAL( eadc_acq_tab ) },
   
   { LSTRKEY( "__metatable" ), LROVAL( eadc_metatab ) },
   { LNILKEY, LNILVAL }
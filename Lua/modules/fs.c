@@ -0,0 +1,94 @@
+/*
+ * bhgv, file system statistics and tuning module
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "modules.h"
+
+#include <esp_spiffs.h>
+
+
+static int fs_stats( lua_State* L ) {
+	esp_spiffs_stats_t st;
+
+	spiffs_get_stats(&st);
+
+	lua_createtable(L, 0, 8);
+
+	lua_pushinteger(L, st.cache_hits);
+	lua_setfield(L, -2, "cache_hits");
+
+	lua_pushinteger(L, st.cache_misses);
+	lua_setfield(L, -2, "cache_misses");
+
+	lua_pushinteger(L, st.ra_hits);
+	lua_setfield(L, -2, "ra_hits");
+
+	lua_pushinteger(L, st.ra_misses);
+	lua_setfield(L, -2, "ra_misses");
+
+	lua_pushinteger(L, st.ra_bytes);
+	lua_setfield(L, -2, "ra_bytes");
+
+	lua_pushinteger(L, st.cache_pages);
+	lua_setfield(L, -2, "cache_pages");
+
+	lua_pushinteger(L, st.max_fds);
+	lua_setfield(L, -2, "fds");
+
+	lua_pushinteger(L, st.ra_size);
+	lua_setfield(L, -2, "readahead");
+
+	return 1;
+}
+
+static int fs_resetstats( lua_State* L ) {
+	spiffs_reset_stats();
+
+	return 0;
+}
+
+// fs.config(readahead)
+// readahead applies to files opened from now on, 0 disables it. The cache
+// pages and the fds are set in config.mk, fs.stats() shows them.
+static int fs_config( lua_State* L ) {
+	lua_Integer ra_size = luaL_checkinteger(L, 1);
+
+	luaL_argcheck(L, ra_size >= 0, 1, "negative size");
+	if (ra_size > SPIFFS_READ_AHEAD_MAX) {
+		ra_size = SPIFFS_READ_AHEAD_MAX;
+	}
+
+	spiffs_set_readahead(ra_size);
+
+	return 0;
+}
+
+
+static const LUA_REG_TYPE fs_map[] = {
+  { LSTRKEY( "stats" ),         LFUNCVAL( fs_stats ) },
+  { LSTRKEY( "resetstats" ),    LFUNCVAL( fs_resetstats ) },
+  { LSTRKEY( "config" ),        LFUNCVAL( fs_config ) },
+  { LNILKEY, LNILVAL }
+};
+
+
+int luaopen_fs( lua_State *L ) {
+#if !LUA_USE_ROTABLE
+  luaL_newlib(L, fs_map);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+
+MODULE_REGISTER_MAPPED(FS, fs, fs_map, luaopen_fs);
+
@@ -3,8 +3,17 @@
 #include <task.h>
 #include <queue.h>
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <sys/mutex.h>
 
+#include <drivers/gpio.h>
+#include <drivers/i2c-platform.h>
+
+#include <sys/drivers/clock.h>
+
 
 #include "lua.h"
 #include "lauxlib.h"
@@ -42,6 +51,94 @@
 #define _rpg 1<<14
 #define _ekey 1<<15
 
+#define GUI_KEYS (_ok | _lft | _rgt | _up | _dwn | _lpg | _rpg | _ekey)
+
+// The INT line of the PCF8575 of the keys, low from a change of the inputs
+// until the port is read. Without it (< 0) the port is polled. None by
+// default: GPIO15 of the LuOS9p board is a boot strap pin and the CS0 of
+// HSPI. A board that wires INT to a free pin sets it in config/config.mk.
+#ifndef GUI_KEY_INT_PIN
+#define GUI_KEY_INT_PIN -1
+#endif
+
+#define KEY_TICKS(ms) (((ms) + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS)
+
+#define KEY_DEBOUNCE	KEY_TICKS(30)	// the inputs are stable that long
+#define KEY_LONG	KEY_TICKS(800)
+#define KEY_REPEAT_DELAY KEY_TICKS(400)
+#define KEY_REPEAT	KEY_TICKS(120)
+#define KEY_POLL	16		// ticks between the reads of a polled port
+
+// Keys that repeat when held
+#define KEY_REPEATS (_lft | _rgt | _up | _dwn | _lpg | _rpg)
+
+// Key events
+#define KEY_PRESS	0
+#define KEY_REPEATED	1
+#define KEY_LONGPRESS	2
+#define KEY_RELEASE	3
+
+#define KEY_EVENTS	8
+
+// guiqueue values: tloop sends a tick, the INT line a GUI_EV_KEYS
+#define GUI_EV_TICK	1
+#define GUI_EV_KEYS	2
+
+#define GUI_QUEUE_LEN	2
+
+
+// What a redraw draws again
+#define REDRAW_IND	1	// the rows with an ind_t, their values changed
+#define REDRAW_CURSOR	2	// the rows of the former and the new cursor
+#define REDRAW_FULL	4	// the whole screen, a new menu or a scroll
+
+// The functions of act of a row, act.long is called by a long press
+#define ACT_OK		0
+#define ACT_LFT		1
+#define ACT_RGT		2
+#define ACT_LPG		3
+#define ACT_RPG		4
+#define ACT_EKEY	5
+#define ACT_LONG	6
+#define ACT_N		7
+
+static const char * const act_names[ACT_N] = {
+	"ok", "lft", "rgt", "lpg", "rpg", "ekey", "long"
+};
+
+// A row of the menu, read once from its table when the menu file is run
+typedef struct {
+	const char *name;	// label, in gui_menu_t.text, NULL if none
+	const char *menu;	// file of the sub menu, NULL if none
+	int act[ACT_N];		// refs of the functions of act, LUA_NOREF if none
+	int par;		// ref of par, LUA_REFNIL if nil
+	int ind_t;		// ref of ind_t, LUA_NOREF if none
+	uint8_t has_act;
+	int8_t y;		// top of its band on the screen, -1 if not shown
+	uint8_t h;		// height of the band
+	uint8_t ul;		// row of the underline of the cursor, from y
+} gui_row_t;
+
+typedef struct {
+	gui_row_t *rows;
+	char *text;		// the labels and the file names of the rows
+	int n;
+	int cb;			// ref of the cb of the menu, LUA_NOREF if none
+	int top;		// first row on the screen, 0 before the first draw
+	int shown;		// last row on the screen
+	int cursor;		// row of the cursor on the screen
+} gui_menu_t;
+
+// Time of the redraws, [0] of the whole screen, [1] of some rows
+typedef struct {
+	uint32_t n;
+	uint32_t rows;		// drawn
+	uint32_t pages;		// sent to the display
+	uint32_t ticks;
+	uint32_t us_max;
+	uint64_t us;
+} gui_draw_stat_t;
+
 
 extern uint8_t ssd1306_buffer[]; 
 extern font_info_t *font;
@@ -52,8 +149,9 @@ extern font_face_t font_face;
 static char menu;
 static char m_cur_pos = 1;
 
-static char menu_cur=-1;
-static char menu_cur_len = 0;
+static gui_menu_t mc = {NULL, NULL, 0, LUA_NOREF, 0, 0, 0};
+
+static gui_draw_stat_t draw_stats[2];
 
 static int no_sleep = 0;
 
@@ -62,150 +160,381 @@ static char msg=NO_MSG;
 static char gui_fnt=0;
 #define GUI_FNT gui_fnt
 
+int is_need_redraw = 0;
+
 
 QueueHandle_t guiqueue=NULL;
 //int cb_to = 0;
 
 
-static void draw_menu( lua_State *L, int menu_cur){
-	font_info_t *fnt_bk=font;
-	font = font_builtin_fonts[GUI_FNT];
-//printf("draw_menu fnt %x\n", font);
-    int m_str_step = (font->height + 4);
-//#define m_scr_lns (int)(64/m_str_step)
-    int i, yc;
-    int y = 0; 
-    int bg = 1;
-	int udy = -1;
-//	menu_cur_len = lua_rawlen(L, menu_cur);
-	char* s;
-	int n = lua_gettop( L);
+static void menu_free( lua_State *L){
+	int i, k;
+
+	for(i = 0; i < mc.n; i++){
+		gui_row_t *r = &mc.rows[i];
+
+		for(k = 0; k < ACT_N; k++){
+			luaL_unref(L, LUA_REGISTRYINDEX, r->act[k]);
+		}
+		luaL_unref(L, LUA_REGISTRYINDEX, r->par);
+		luaL_unref(L, LUA_REGISTRYINDEX, r->ind_t);
+	}
+	luaL_unref(L, LUA_REGISTRYINDEX, mc.cb);
+
+	free(mc.rows);
+	free(mc.text);
+	mc.rows = NULL;
+	mc.text = NULL;
+	mc.n = 0;
+	mc.cb = LUA_NOREF;
+}
+
+// Ref of t[k] if it is a function, else LUA_NOREF
+static int ref_func( lua_State *L, int t, const char *k){
+	lua_pushstring(L, k);
+	lua_rawget(L, t);
+	if(lua_isfunction(L, -1)){
+		return luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	lua_pop(L, 1);
+	return LUA_NOREF;
+}
+
+// Length of t[k] with its 0 if it is a string, else 0
+static size_t str_len( lua_State *L, int t, const char *k){
+	size_t l = 0;
+
+	lua_pushstring(L, k);
+	lua_rawget(L, t);
+	if(lua_isstring(L, -1)){
+		lua_tolstring(L, -1, &l);
+		l++;
+	}
+	lua_pop(L, 1);
+	return l;
+}
+
+// Copies t[k] to *text if it is a string
+static const char *str_copy( lua_State *L, int t, const char *k, char **text){
+	const char *s = NULL;
+	size_t l;
+
+	lua_pushstring(L, k);
+	lua_rawget(L, t);
+	if(lua_isstring(L, -1)){
+		s = lua_tolstring(L, -1, &l);
+		memcpy(*text, s, l + 1);
+		s = *text;
+		*text += l + 1;
+	}
+	lua_pop(L, 1);
+	return s;
+}
 
 /*
-    if(menu_cur_len > 6 && m_cur_pos >= 6/2){
-		if( m_cur_pos >menu_cur_len - 6/2 ){
-		    bg = menu_cur_len - 6 + 1;
-		}else{
-		    bg = m_cur_pos - 6/2 + 1;
+ * Reads the menu table at t into mc: the labels are copied, the functions
+ * and the par of the rows are kept as refs. A key or a redraw then costs
+ * no table access, and the table itself is collected.
+ */
+static int menu_compile( lua_State *L, int t){
+	size_t len = 0;
+	char *text;
+	int i, k, n, ln;
+
+	menu_free(L);
+
+	if(!lua_istable(L, t)){
+		return -1;
+	}
+
+	n = lua_rawlen(L, t);
+	for(i = 1; i <= n; i++){
+		if(lua_rawgeti(L, t, i) == LUA_TTABLE){
+			len += str_len(L, lua_gettop(L), "name") + str_len(L, lua_gettop(L), "menu");
 		}
-    }
-*/
-    if(menu_cur_len*m_str_step > 64-m_str_step && m_cur_pos*m_str_step >= (64/2)/*-m_str_step*/){
-		if( m_cur_pos*m_str_step >menu_cur_len*m_str_step - 64/2 ){
-		    bg = (int)((menu_cur_len*m_str_step - 64)/m_str_step) +1;
+		lua_pop(L, 1);
+	}
+
+	mc.rows = calloc(n > 0 ? n : 1, sizeof(gui_row_t));
+	mc.text = malloc(len > 0 ? len : 1);
+	if((mc.rows == NULL) || (mc.text == NULL)){
+		menu_free(L);
+		return -1;
+	}
+
+	text = mc.text;
+	for(i = 0; i < n; i++){
+		gui_row_t *r = &mc.rows[i];
+
+		for(k = 0; k < ACT_N; k++){
+			r->act[k] = LUA_NOREF;
+		}
+		r->par = LUA_REFNIL;
+		r->ind_t = LUA_NOREF;
+		r->y = -1;
+		mc.n = i + 1;
+
+		if(lua_rawgeti(L, t, i + 1) != LUA_TTABLE){
+			lua_pop(L, 1);
+			continue;
+		}
+		ln = lua_gettop(L);
+
+		r->name = str_copy(L, ln, "name", &text);
+		r->menu = str_copy(L, ln, "menu", &text);
+		r->ind_t = ref_func(L, ln, "ind_t");
+
+		lua_pushliteral(L, "par");
+		lua_rawget(L, ln);
+		r->par = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		lua_pushliteral(L, "act");
+		lua_rawget(L, ln);
+		if(lua_istable(L, -1)){
+			r->has_act = 1;
+			for(k = 0; k < ACT_N; k++){
+				r->act[k] = ref_func(L, ln + 1, act_names[k]);
+			}
+		}
+		lua_pop(L, 2);
+	}
+
+	mc.n = n;
+	mc.cb = ref_func(L, t, "cb");
+	return 0;
+}
+
+// Clears the rows y0..y1 - 1 of the screen, the framebuffer is upside down
+static void fb_clear_rows(int y0, int y1){
+	int r0 = DISPLAY_HEIGHT - y1, r1 = DISPLAY_HEIGHT - y0;
+	int p, x;
+
+	for(p = r0 >> 3; p <= (r1 - 1) >> 3; p++){
+		uint8_t *b = &ssd1306_buffer[p * DISPLAY_WIDTH];
+		uint8_t m = 0xff;
+
+		if(r0 > (p << 3)){
+			m &= 0xff << (r0 - (p << 3));
+		}
+		if(r1 < (p << 3) + 8){
+			m &= 0xff >> ((p << 3) + 8 - r1);
+		}
+		for(x = 0; x < DISPLAY_WIDTH; x++){
+			b[x] &= ~m;
+		}
+	}
+}
+
+// Draws the label and the ind_t of the row at y, returns the height of its band
+static int draw_row( lua_State *L, gui_row_t *r, int y, int step){
+	int udy = -1;
+
+	if(r->name){
+		ssd1306_draw_string(ADDR, ssd1306_buffer, font, 11, y+1, (char *)r->name, 1, 0 );
+	}
+
+	if(r->ind_t != LUA_NOREF){
+		lua_rawgeti(L, LUA_REGISTRYINDEX, r->ind_t);
+		lua_pushinteger(L, y);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, r->par);
+		lua_call(L, 2, 1);
+		if(!lua_isnil(L, -1)){
+			udy = lua_tonumber(L, -1);
+		}
+		lua_pop(L, 1);
+	}
+
+	r->y = y;
+	r->ul = udy > 0 ? udy : step;
+	r->h = udy > 0 ? udy + 2 : step;
+	return r->h;
+}
+
+/*
+ * Draws what changed in the screen buffer and sends the pages it touched.
+ * A new menu or a scroll draws the whole screen, as before; a move of the
+ * cursor draws its former and new rows, a change of the values the rows
+ * with an ind_t. A row whose ind_t returns another height moves the rows
+ * under it, the whole screen is drawn then.
+ */
+static void redraw( lua_State *L, int what){
+	font_info_t *fnt_bk=font;
+	gui_draw_stat_t *st;
+	uint64_t t0 = clock_monotonic_us();
+	TickType_t k0 = xTaskGetTickCount();
+	int n = lua_gettop( L);
+	int y0 = DISPLAY_HEIGHT, y1 = 0;	// the rows of the screen drawn
+	int rows = 0, calls = 0;
+	int i, y, ul, bg = 1;
+	uint32_t us;
+
+	font = (font_info_t *)font_get(GUI_FNT);
+	if(font == NULL)
+		font = (font_info_t *)font_get(FONT_FACE_GLCD5x7);
+	int m_str_step = (font->height + 4);
+
+	if(mc.n*m_str_step > 64-m_str_step && m_cur_pos*m_str_step >= (64/2)/*-m_str_step*/){
+		if( m_cur_pos*m_str_step >mc.n*m_str_step - 64/2 ){
+		    bg = (int)((mc.n*m_str_step - 64)/m_str_step) +1;
 		}else{
 		    bg =(int)(( m_cur_pos*m_str_step - 64/2)/m_str_step) + 1;
 		}
-    }
-    for( i = bg; i<=menu_cur_len; i++ ){
-		lua_rawgeti(L, menu_cur, i);
-//		if( i == m_cur_pos ){
-//			ssd1306_draw_hline(ADDR, ssd1306_buffer, 5, y+m_str_step, 128-10, 1);
-//			ssd1306_fill_rectangle(ADDR, ssd1306_buffer, 2, y+3, 4, 4, 1 );
-//		}
-		lua_pushliteral(L,"name");
-		lua_rawget( L, -2);
-		if( lua_isstring(L, -1) ){
-			s = lua_tostring(L, -1);
-			ssd1306_draw_string(ADDR, ssd1306_buffer, font, 11, y+1, s, 1, 0 );
+	}
+	if(bg != mc.top){
+		what |= REDRAW_FULL;
+	}
+
+	if(!(what & REDRAW_FULL)){
+		// the underline of the former cursor may be in the band of the next row
+		ul = -1;
+		if((what & REDRAW_CURSOR) && mc.cursor >= mc.top && mc.cursor <= mc.shown){
+			gui_row_t *r = &mc.rows[mc.cursor - 1];
+
+			ul = r->y + r->ul;
+			if(ul < DISPLAY_HEIGHT){
+				fb_clear_rows(ul, ul + 1);
+				y0 = ul;
+				y1 = ul + 1;
+			}
 		}
-		lua_pop(L, 1);
-		
-		lua_pushliteral(L,"ind_t");
-		lua_rawget( L, -2);
-		udy = -1;
-		if( lua_isfunction(L, -1) ){
-			//usleep(50);
-			lua_pushinteger( L, y);
-			lua_pushliteral(L,"par");
-			lua_rawget( L, -4);
-			lua_call(L, 2, 1);
-			if(!lua_isnil(L, -1)){
-				udy = lua_tonumber(L, -1);
+
+		for(i = mc.top; i <= mc.shown; i++){
+			gui_row_t *r = &mc.rows[i - 1];
+			int h = r->h;
+
+			if(!((what & REDRAW_IND) && r->ind_t != LUA_NOREF) &&
+			   !((what & REDRAW_CURSOR) && (i == mc.cursor || i == m_cur_pos ||
+			                                (ul >= r->y && ul < r->y + h)))){
+				continue;
+			}
+
+			y = r->y;
+			fb_clear_rows(y, y + h < DISPLAY_HEIGHT ? y + h : DISPLAY_HEIGHT);
+			if(y < y0) y0 = y;
+			if(y + h > y1) y1 = y + h;
+
+			rows++;
+			calls += r->ind_t != LUA_NOREF;
+			if(draw_row(L, r, y, m_str_step) != h){
+				what |= REDRAW_FULL;
+				break;
 			}
-			lua_pop(L, 1);
-		} else{
-			lua_pop(L, 1);
 		}
-		luaC_fullgc(L, 1);
-		//usleep(50);
-		if( i == m_cur_pos ){
-			ssd1306_draw_hline(ADDR, ssd1306_buffer, 
-				5, y+(udy > 0 ? udy : m_str_step), 
-				128-10, 1);
-			ssd1306_fill_rectangle(ADDR, ssd1306_buffer, 2, y+3, 4, 4, 1 );
+	}
+
+	if(what & REDRAW_FULL){
+		memset(ssd1306_buffer, 0, DISPLAY_WIDTH * DISPLAY_HEIGHT / 8);
+		for(i = 0; i < mc.n; i++){
+			mc.rows[i].y = -1;
 		}
-		y = y + (udy > 0 ? udy + 2 : m_str_step);
-		if( y >= 64 /*-m_str_step*/)
-			break;
-    }
+
+		y = 0;
+		for(i = bg; i <= mc.n && y < 64; i++){
+			rows++;
+			calls += mc.rows[i - 1].ind_t != LUA_NOREF;
+			y += draw_row(L, &mc.rows[i - 1], y, m_str_step);
+		}
+		mc.top = bg;
+		mc.shown = i - 1;
+		y0 = 0;
+		y1 = DISPLAY_HEIGHT;
+	}
+
+	mc.cursor = m_cur_pos;
+	if(m_cur_pos >= mc.top && m_cur_pos <= mc.shown){
+		gui_row_t *r = &mc.rows[m_cur_pos - 1];
+
+		ssd1306_draw_hline(ADDR, ssd1306_buffer, 5, r->y + r->ul, 128-10, 1);
+		ssd1306_fill_rectangle(ADDR, ssd1306_buffer, 2, r->y+3, 4, 4, 1 );
+		if(r->y < y0) y0 = r->y;
+		if(r->y + r->ul + 1 > y1) y1 = r->y + r->ul + 1;
+	}
 
 	font=fnt_bk;
 	lua_settop( L, n);
-	luaC_fullgc(L, 1);
+	if(calls > 0){
+		luaC_fullgc(L, 1);
+	}
+
+	if(y1 > DISPLAY_HEIGHT){
+		y1 = DISPLAY_HEIGHT;
+	}
+	if(what & REDRAW_FULL){
+		ssd1306_load_frame_buffer(ADDR, ssd1306_buffer);
+	}else if(y0 < y1){
+		ssd1306_load_pages(ADDR, ssd1306_buffer,
+			(DISPLAY_HEIGHT - y1) >> 3, (DISPLAY_HEIGHT - 1 - y0) >> 3);
+	}
+
+	st = &draw_stats[(what & REDRAW_FULL) ? 0 : 1];
+	us = clock_monotonic_us() - t0;
+	st->n++;
+	st->rows += rows;
+	st->pages += (what & REDRAW_FULL) ? DISPLAY_HEIGHT / 8 :
+		(y0 < y1 ? ((DISPLAY_HEIGHT - 1 - y0) >> 3) - ((DISPLAY_HEIGHT - y1) >> 3) + 1 : 0);
+	st->ticks += xTaskGetTickCount() - k0;
+	st->us += us;
+	if(us > st->us_max){
+		st->us_max = us;
+	}
 }
 
 
 static int run_gui_cb( lua_State *L){
-	int n = lua_gettop( L);
-	int r = 0;
-	
-	lua_pushstring(L,"cb");
-	lua_rawget( L, menu_cur);
-	if(lua_isfunction(L, -1)){
-		//lua_pushnil(L);
-		lua_call(L, 0, 1);
-		r = lua_toboolean(L, -1);
-//	}else{
-//		lua_pop(L, 1);
+	int r;
+
+	if(mc.cb == LUA_NOREF){
+		return 0;
 	}
 
-	lua_settop( L, n);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, mc.cb);
+	lua_call(L, 0, 1);
+	r = lua_toboolean(L, -1);
+	lua_pop(L, 1);
 	luaC_fullgc(L, 1);
 	
-	return r;
+	return r ? REDRAW_IND : 0;
 }
 
-	
-static void draw( lua_State *L){
-	int i;
-	for(i=0; i<(DISPLAY_WIDTH * DISPLAY_HEIGHT/8); i++)
-		ssd1306_buffer[i] = 0;
-	draw_menu(L, menu_cur);
-//	lua_gc(L, LUA_GCCOLLECT, 0);
-	ssd1306_load_frame_buffer(ADDR, ssd1306_buffer);
-}
+// Runs the menu file and compiles its table, the screen is drawn by the next redraw
+static int load_menu( lua_State *L, const char *file){
+	int n = lua_gettop(L);
+	int r = -1;
 
-static int new_cur_m( lua_State *L, int m ){
-	luaL_dofile(L, lua_tostring(L, m) );
-	menu_cur_len = lua_rawlen(L, -1);
+	if(luaL_dofile(L, file) == LUA_OK){
+		r = menu_compile(L, n + 1);
+	}else{
+		printf("gui: %s\n", lua_tostring(L, -1));
+		menu_free(L);
+	}
+	lua_settop(L, n);
 	luaC_fullgc(L, 1);
-	return lua_gettop(L);
+
+	m_cur_pos = 1;
+	mc.top = 0;
+	is_need_redraw |= REDRAW_FULL;
+	return r;
 }
 
-static int new_menu( lua_State *L, int m ){
+static void new_menu( lua_State *L, int m ){
 	lua_settop( L, m);
-	luaC_fullgc(L, 1);
 	menu=m; 
-	menu_cur=new_cur_m(L, m);
-	m_cur_pos=1;
-	draw(L);
+	if(load_menu(L, lua_tostring(L, m)) < 0){
+		msg=MSG_EXIT;
+	}
 }
 
-static int sub_menu( lua_State *L, int m ){
-    int i;
-	lua_replace(L,menu_cur);
-//	luaC_fullgc(L, 1);
-
-	lua_settop(L, menu_cur);
-	luaC_fullgc(L, 1);
-
-	i=new_cur_m(L, menu_cur); //m);
-	lua_replace(L,menu_cur);
-	luaC_fullgc(L, 1);
+static void sub_menu( lua_State *L, const char *file ){
+	int n = lua_gettop(L);
+	int r;
 
-	m_cur_pos = 1;
-	draw(L);
+	// file is in mc.text, freed by the load
+	lua_pushstring(L, file);
+	r = load_menu(L, lua_tostring(L, -1));
+	lua_settop(L, n);
+	if(r < 0){
+		new_menu(L, menu);
+	}
 }
 
 static int top_menu( lua_State *L){
@@ -225,36 +554,46 @@ static int set_gui_fnt( lua_State *L){
 	return 0;
 }
 
-static int menu_up( lua_State *L){
-	m_cur_pos=m_cur_pos-1;
-	if( m_cur_pos<1 ){
-	    m_cur_pos=1; 
-	}else{
-	    draw(L);
+static void menu_up( lua_State *L){
+	if( m_cur_pos>1 ){
+	    m_cur_pos=m_cur_pos-1;
+	    is_need_redraw |= REDRAW_CURSOR;
 	}
-	return m_cur_pos;
 }
 
-static int menu_down( lua_State *L){
-	m_cur_pos=m_cur_pos+1;
-	if( m_cur_pos>menu_cur_len ){
-	    m_cur_pos=menu_cur_len; 
-	}else{
-	    draw(L);
+static void menu_down( lua_State *L){
+	if( m_cur_pos<mc.n ){
+	    m_cur_pos=m_cur_pos+1;
+	    is_need_redraw |= REDRAW_CURSOR;
 	}
-	return m_cur_pos;
 }
 
-/*
-local menu_pos=function(pos)
-	local old = m_cur_pos;
-	if pos then
-	    m_cur_pos = pos;
-	    draw(draw_menu);
-	end
-	return old;
-end
-*/
+// Lua: stats = gui.drawstats(), of the redraws of the whole screen and of some rows
+static int gui_drawstats( lua_State *L){
+	static const char * const kinds[2] = {"full", "rows"};
+	int i;
+
+	lua_createtable(L, 0, 2);
+	for(i = 0; i < 2; i++){
+		gui_draw_stat_t *st = &draw_stats[i];
+
+		lua_createtable(L, 0, 6);
+		lua_pushinteger(L, st->n);
+		lua_setfield(L, -2, "n");
+		lua_pushinteger(L, st->n ? st->us / st->n : 0);
+		lua_setfield(L, -2, "us");
+		lua_pushinteger(L, st->us_max);
+		lua_setfield(L, -2, "us_max");
+		lua_pushnumber(L, st->n ? (lua_Number)st->ticks / st->n : 0);
+		lua_setfield(L, -2, "ticks");
+		lua_pushnumber(L, st->n ? (lua_Number)st->rows / st->n : 0);
+		lua_setfield(L, -2, "rows");
+		lua_pushnumber(L, st->n ? (lua_Number)st->pages / st->n : 0);
+		lua_setfield(L, -2, "pages");
+		lua_setfield(L, -2, kinds[i]);
+	}
+	return 1;
+}
 
 static void gui_screen_lightup( lua_State *L){
 	if(no_sleep <= 0){
@@ -268,181 +607,287 @@ static void gui_screen_lightup( lua_State *L){
 
 
 
-int is_need_redraw = 0;
+typedef struct {
+	uint16_t key;
+	uint8_t kind;
+} key_event_t;
+
+typedef struct {
+	uint16_t stable;	// debounced port, a key is 0 when pressed
+	uint16_t sample;	// read when debounce was set
+	uint16_t held;		// the last key pressed and still held
+	uint8_t debounce;	// sample waits for KEY_DEBOUNCE ticks of quiet
+	uint8_t long_sent;
+	TickType_t since;	// of sample
+	TickType_t held_since;
+	TickType_t next_repeat;
+	TickType_t last_poll;
+	TickType_t start;
+
+	key_event_t ev[KEY_EVENTS];
+	uint8_t ev_head;
+	uint8_t ev_tail;
+
+	uint32_t reads;		// of the port
+	uint32_t ints;		// of the INT line
+	uint32_t bounces;
+	uint32_t events;
+	uint32_t lost;		// events, the queue was full
+} gui_keys_t;
+
+static gui_keys_t keys;
+static volatile uint8_t keys_int = 0;
+
+static void keys_event(uint16_t key, uint8_t kind){
+	uint8_t next = (keys.ev_head + 1) % KEY_EVENTS;
+
+	if(next == keys.ev_tail){
+		keys.lost++;
+		return;
+	}
+	keys.ev[keys.ev_head].key = key;
+	keys.ev[keys.ev_head].kind = kind;
+	keys.ev_head = next;
+	keys.events++;
+}
 
-static void gui_controller( lua_State *L){
-	int n = lua_gettop( L);
+static uint16_t keys_read(){
+	keys.reads++;
+	return pcf8575_port_read(PCF8575_DEFAULT_ADDRESS) | ~GUI_KEYS;
+}
 
-	int b = pcf8575_port_read(PCF8575_DEFAULT_ADDRESS);
-	int i=m_cur_pos;
-	int cur_ln; //=menu_cur[i];
-	int m=0; //cur_ln.menu
-	int act=0; //cur_ln.act
-	int par=0; //cur_ln.par
+// The debounced port changed
+static void keys_accept(uint16_t b, TickType_t now){
+	uint16_t changed = (keys.stable ^ b) & GUI_KEYS;
+	uint16_t bit;
 
+	keys.stable = b;
 
-	lua_rawgeti( L, menu_cur, i);
-	cur_ln = lua_gettop(L);
+	while(changed){
+		bit = changed & -changed;
+		changed &= ~bit;
 
-	lua_pushliteral(L,"menu");
-	lua_rawget( L, cur_ln);
-	if(!lua_isnoneornil(L, -1)){
- 		m = lua_gettop(L);
-	}else{
-		lua_pop(L, 1);
+		if((b & bit) == 0){
+			keys_event(bit, KEY_PRESS);
+			keys.held = bit;
+			keys.held_since = now;
+			keys.next_repeat = now + KEY_REPEAT_DELAY;
+			keys.long_sent = 0;
+		}else{
+			if(bit == keys.held){
+				keys.held = 0;
+			}
+			if(bit == _ekey){
+				keys_event(bit, KEY_RELEASE);
+			}
+		}
 	}
+}
 
-	lua_pushliteral(L,"act");
-	lua_rawget( L, cur_ln);
-	if(!lua_isnoneornil(L, -1)){
-	 	act = lua_gettop(L);
-	}else{
-		lua_pop(L, 1);
+static void keys_sample(TickType_t now){
+	uint16_t b;
+
+	keys_int = 0;
+	b = keys_read();
+
+	if(keys.debounce){
+		if(b == keys.sample){
+			return;
+		}
+		keys.bounces++;
+	}else if(b == keys.stable){
+		return;
 	}
 
-	lua_pushliteral(L,"par");
-	lua_rawget( L, cur_ln);
-	if(!lua_isnoneornil(L, -1)){
-	 	par = lua_gettop(L);
-	}else{
-		lua_pop(L, 1);
+	keys.sample = b;
+	keys.since = now;
+	keys.debounce = 1;
+}
+
+/*
+ * Called for every value of guiqueue. The port is read on an edge of the
+ * INT line, then once more KEY_DEBOUNCE ticks after the last change; the
+ * edges of the bounces in between cost no read. The repeats and the long
+ * presses come from the tick count, the port does not change while a key
+ * is held.
+ */
+static void keys_update(){
+	TickType_t now = xTaskGetTickCount();
+
+	if(keys.debounce){
+		if(now - keys.since >= KEY_DEBOUNCE){
+			uint16_t b;
+
+			keys_int = 0;
+			b = keys_read();
+			if(b == keys.sample){
+				keys.debounce = 0;
+				keys_accept(b, now);
+			}else{
+				keys.bounces++;
+				keys.sample = b;
+				keys.since = now;
+			}
+		}
+	}else if(keys_int || (GUI_KEY_INT_PIN < 0 && now - keys.last_poll >= KEY_POLL)){
+		keys.last_poll = now;
+		keys_sample(now);
 	}
 
-  if((b & _ok) == 0 ){
-  	gui_screen_lightup(L);
-    if( i == menu_cur_len ){
-//		lua_settop( L, menu);
-//		luaC_fullgc(L, 1);
-		new_menu(L, menu);
-    }else if( m != 0 ){
-		lua_settop( L, m);
-		sub_menu(L, m);
-    }else if( act != 0 /*and act.ok ~= nil*/ ){
-//	    act.ok(par);
-		lua_pushliteral(L,"ok");
-		lua_rawget( L, act);
-		if(lua_isfunction(L, -1)){
-			//usleep(50);
-			lua_pushvalue(L, par);
-			lua_call(L, 1, 0);
-		}else{
-			lua_pop(L, 1);
+	if(keys.held && !keys.debounce){
+		if(!keys.long_sent && now - keys.held_since >= KEY_LONG){
+			keys.long_sent = 1;
+			keys_event(keys.held, KEY_LONGPRESS);
 		}
-		luaC_fullgc(L, 1);
-		//usleep(50);
-		is_need_redraw = 1; //draw(L);
-    }
-  }
-  else if((b & _lft) == 0 ){
-  	gui_screen_lightup(L);
-    if( act != 0 /*and act.lft ~= nil*/ ){
-//	  act.lft(par);
-	  lua_pushliteral(L,"lft");
-	  lua_rawget( L, act);
-	  if(lua_isfunction(L, -1)){
-	  	//usleep(50);
-		lua_pushvalue(L, par);
-		lua_call(L, 1, 0);
-	  }else{
-		lua_pop(L, 1);
-	  }
-	  luaC_fullgc(L, 1);
-	  //usleep(50);
-	  is_need_redraw = 1; //draw(L);
-    }else if( m != 0 ){
-	  sub_menu(L, m);
-    }
-  }
-  else if((b & _rgt) == 0 ){
-  	gui_screen_lightup(L);
-    if( act != 0 /*and act.rgt ~= nil*/ ){
-//	  act.rgt(par);
-	  lua_pushliteral(L,"rgt");
-	  lua_rawget( L, act);
-	  if(lua_isfunction(L, -1)){
-	  	//usleep(50);
-		lua_pushvalue(L, par);
-		lua_call(L, 1, 0);
-	  }else{
-		lua_pop(L, 1);
-	  }
-	  luaC_fullgc(L, 1);
-	  //usleep(50);
-	  is_need_redraw = 1; //draw(L);
-    }else if( m != 0 ){
-	  sub_menu(L, m);
-    }
-  }
-  else if((b & _up) == 0 ){
-  	gui_screen_lightup(L);
-    menu_up(L);
-  }
-  else if((b & _dwn) == 0 ){
-  	gui_screen_lightup(L);
-    menu_down(L);
-  }
-  else if((b & _lpg) == 0 ){
-  	gui_screen_lightup(L);
-    if( act != 0 /*and act.lpg != 0*/ ){
-//	  act.lpg(par);
-	  lua_pushliteral(L,"lpg");
-	  lua_rawget( L, act);
-	  if(lua_isfunction(L, -1)){
-	  	//usleep(50);
-		lua_pushvalue(L, par);
-		lua_call(L, 1, 0);
-	  }else{
-		lua_pop(L, 1);
-	  }
-	  luaC_fullgc(L, 1);
-	  //usleep(50);
-	  is_need_redraw = 1; //draw(L);
-    }else if( m != 0 ){
-	  sub_menu(L, m);
-    }
-  }
-  else if((b & _rpg) == 0 ){
-  	gui_screen_lightup(L);
-    if( act != 0 /*and act.rpg != 0*/ ){
-//	  act.rpg(par);
-	  lua_pushliteral(L,"rpg");
-	  lua_rawget( L, act);
-	  if(lua_isfunction(L, -1)){
-	  	//usleep(50);
-		lua_pushvalue(L, par);
-		lua_call(L, 1, 0);
-	  }else{
-		lua_pop(L, 1);
-	  }
-	  luaC_fullgc(L, 1);
-	  //usleep(50);
-	  is_need_redraw = 1; //draw(L);
-    }else if( m != 0 ){
-	  sub_menu(L, m);
-    }
-  }
-  else /*if((b & _ekey) == 0 )*/{
-	if( act != 0 /*and act.rpg != 0*/ ){
-//	act.rpg(par);
-		lua_pushliteral(L,"ekey");
-		lua_rawget( L, act);
-		if(lua_isfunction(L, -1)){
-			//usleep(50);
-			lua_pushvalue(L, par);
-			lua_pushboolean(L, (b & _ekey) == 0 );
+		if((keys.held & KEY_REPEATS) && (int32_t)(now - keys.next_repeat) >= 0){
+			keys.next_repeat += KEY_REPEAT;
+			keys_event(keys.held, KEY_REPEATED);
+		}
+	}
+}
+
+#if GUI_KEY_INT_PIN >= 0
+static uint32_t IRAM keys_isr(uint32_t status){
+	BaseType_t woken = pdFALSE;
+	uint32_t v = GUI_EV_KEYS;
+
+	keys_int = 1;
+	keys.ints++;
+	if(guiqueue != NULL){
+		xQueueSendFromISR(guiqueue, &v, &woken);
+	}
+	portEND_SWITCHING_ISR(woken);
+
+	return status & ~BIT(GUI_KEY_INT_PIN);
+}
+#endif
+
+static void keys_init(){
+	memset(&keys, 0, sizeof(keys));
+	keys.start = keys.last_poll = xTaskGetTickCount();
+	keys.stable = keys_read();
+	keys_int = 0;
+
+#if GUI_KEY_INT_PIN >= 0
+	gpio_pin_input(GUI_KEY_INT_PIN);
+	gpio_pin_pullup(GUI_KEY_INT_PIN);
+	platform_gpio_register_intr_hook(BIT(GUI_KEY_INT_PIN), keys_isr);
+	platform_gpio_intr_init(GUI_KEY_INT_PIN, GPIO_INTTYPE_EDGE_NEG);
+#endif
+}
+
+static void keys_done(){
+#if GUI_KEY_INT_PIN >= 0
+	platform_gpio_intr_init(GUI_KEY_INT_PIN, GPIO_INTTYPE_NONE);
+	platform_gpio_unregister_intr_hook(keys_isr);
+#endif
+}
+
+// Lua: stats = gui.keystats()
+static int gui_keystats( lua_State *L){
+	uint32_t polls = (xTaskGetTickCount() - keys.start) / KEY_POLL;
+
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, keys.reads);
+	lua_setfield(L, -2, "reads");
+	lua_pushinteger(L, polls > keys.reads ? polls - keys.reads : 0);
+	lua_setfield(L, -2, "saved");
+	lua_pushinteger(L, keys.ints);
+	lua_setfield(L, -2, "ints");
+	lua_pushinteger(L, keys.bounces);
+	lua_setfield(L, -2, "bounces");
+	lua_pushinteger(L, keys.events);
+	lua_setfield(L, -2, "events");
+	lua_pushinteger(L, keys.lost);
+	lua_setfield(L, -2, "lost");
+	return 1;
+}
+
+static const char *key_name( uint16_t key){
+	switch(key){
+		case _ok: return "ok";
+		case _lft: return "lft";
+		case _rgt: return "rgt";
+		case _up: return "up";
+		case _dwn: return "dwn";
+		case _lpg: return "lpg";
+		case _rpg: return "rpg";
+		default: return "ekey";
+	}
+}
+
+// Pushes act[k] of the row and its par, 0 if it has none
+static int push_act( lua_State *L, gui_row_t *r, int k){
+	if(r->act[k] == LUA_NOREF){
+		return 0;
+	}
+	lua_rawgeti(L, LUA_REGISTRYINDEX, r->act[k]);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, r->par);
+	return 1;
+}
+
+static void gui_controller( lua_State *L, uint16_t key, int kind){
+	gui_row_t *r;
+	int k;
+
+	if( m_cur_pos<1 || m_cur_pos>mc.n ){
+		return;
+	}
+	r = &mc.rows[m_cur_pos - 1];
+
+	if(kind == KEY_LONGPRESS){
+		// act.long(par, key), instead of the action of the key
+		if(push_act(L, r, ACT_LONG)){
+			lua_pushstring(L, key_name(key));
 			lua_call(L, 2, 0);
-		}else{
-			lua_pop(L, 1);
+			is_need_redraw |= REDRAW_IND;
 		}
-		luaC_fullgc(L, 1);
-		//usleep(50);
-		is_need_redraw = 1; //draw(L);
+		return;
 	}
-  }
-  
-  lua_settop( L, n);
 
-  usleep(50);
+	switch(key){
+		case _ok:
+			gui_screen_lightup(L);
+			if( m_cur_pos == mc.n ){
+				new_menu(L, menu);
+				return;
+			}
+			if( r->menu != NULL ){
+				sub_menu(L, r->menu);
+				return;
+			}
+			k = ACT_OK;
+			break;
+		case _lft: gui_screen_lightup(L); k = ACT_LFT; break;
+		case _rgt: gui_screen_lightup(L); k = ACT_RGT; break;
+		case _lpg: gui_screen_lightup(L); k = ACT_LPG; break;
+		case _rpg: gui_screen_lightup(L); k = ACT_RPG; break;
+		case _up:
+			gui_screen_lightup(L);
+			menu_up(L);
+			return;
+		case _dwn:
+			gui_screen_lightup(L);
+			menu_down(L);
+			return;
+		case _ekey: k = ACT_EKEY; break;
+		default: return;
+	}
+
+	if( r->has_act ){
+		if(push_act(L, r, k)){
+			if(k == ACT_EKEY){
+				lua_pushboolean(L, kind != KEY_RELEASE );
+				lua_call(L, 2, 0);
+			}else{
+				lua_call(L, 1, 0);
+			}
+			luaC_fullgc(L, 1);
+		}
+		is_need_redraw |= REDRAW_IND;
+	}else if( r->menu != NULL && k != ACT_EKEY ){
+		sub_menu(L, r->menu);
+	}
 }
 
 
@@ -460,8 +905,12 @@ static void _cb_task (lua_State *L ) {
 		if(!portIN_ISR()){
 			if(xQueueReceive(guiqueue, &v, 1024)) {
 				if(v > 0) { 					
-					if((dly&0xf) == 0){
-						gui_controller(L);
+					keys_update();
+					while(keys.ev_tail != keys.ev_head){
+						key_event_t e = keys.ev[keys.ev_tail];
+
+						keys.ev_tail = (keys.ev_tail + 1) % KEY_EVENTS;
+						gui_controller(L, e.key, e.kind);
 					}
 					
 					switch(msg){
@@ -476,16 +925,24 @@ static void _cb_task (lua_State *L ) {
 					}
 					//luaC_fullgc(L, 1);
 
+					if(v != GUI_EV_TICK){
+						if(is_need_redraw != 0){
+							redraw(L, is_need_redraw);
+							is_need_redraw = 0;
+						}
+						continue;
+					}
+
 					if((dly&0x1f) == 0){
 						//if( run_gui_cb(L) != 0 ){
 						//	is_need_redraw = 1; //draw(L);
 						//}
-						is_need_redraw = run_gui_cb(L);
+						is_need_redraw |= run_gui_cb(L);
 						//printf("is_need_redraw = %d\n", is_need_redraw);
 					}
 					
 					if(is_need_redraw != 0 && 0x90+no_sleep > 0) {
-						draw(L);
+						redraw(L, is_need_redraw);
 						is_need_redraw = 0;
 					}
 
@@ -536,12 +993,18 @@ static void _cb_task (lua_State *L ) {
 static int main_loop( lua_State *L ){
 	if(lua_isstring(L,1)){
 		gui_screen_lightup(L);
+		is_need_redraw = 0;
 		new_menu(L, 1);
+		redraw(L, is_need_redraw);
+		is_need_redraw = 0;
 	
-		guiqueue = xQueueCreate(1, sizeof(uint32_t));
+		keys_init();
+		guiqueue = xQueueCreate(GUI_QUEUE_LEN, sizeof(uint32_t));
 		
 		_cb_task(L);
 		
+		keys_done();
+		menu_free(L);
 		QueueHandle_t tq = guiqueue;
 		if(tq != NULL){
 			guiqueue = NULL;
@@ -565,6 +1028,8 @@ static const LUA_REG_TYPE lgui_map[] = {
   { LSTRKEY( "setFont" ), 	LFUNCVAL( set_gui_fnt) },
   { LSTRKEY( "gotop" ),		LFUNCVAL( top_menu) },
   { LSTRKEY( "exit" ), 		LFUNCVAL(exit_menu) },
+  { LSTRKEY( "keystats" ), 	LFUNCVAL(gui_keystats) },
+  { LSTRKEY( "drawstats" ), 	LFUNCVAL(gui_drawstats) },
   { LNILKEY, LNILVAL }
 };
 
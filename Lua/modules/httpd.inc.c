@@ -133,6 +133,7 @@ void nc_free(struct netconn **nc, char* msg){
 	if(*nc != NULL){
 		if(msg != NULL) 
 			printf(msg);
+		nc_tls_free(*nc);
 		netconn_close(*nc);
 		netconn_delete(*nc);
 		*nc = NULL;
@@ -241,7 +242,7 @@ int do_404(char **uri, int uri_len, char *hdr, char* hdr_sz, nc_node *node ){
 		
 		DBG("pre hdr_net_wrt %x %d\n", hdr, strlen(hdr) );
 		if( check_conn(__func__, __LINE__) ){
-			err = netconn_write(node->clnt, hdr, strlen(hdr)+1, NETCONN_NOCOPY);
+			err = nc_write(node->clnt, hdr, strlen(hdr)+1, NETCONN_NOCOPY);
 			print_err(err, __func__, __LINE__);
 		}
 		if(is_httpd_run == 4) 
@@ -254,7 +255,7 @@ int do_404(char **uri, int uri_len, char *hdr, char* hdr_sz, nc_node *node ){
 			//char *hb = malloc(sizeof(hdr_sz)+10);
 			//snprintf(hb, sizeof(hdr_siz)+10-1, hdr_sz, strlen(buf));
 			//err = netconn_write(client, hb, strlen(hb), NETCONN_NOCOPY);
-			err = netconn_write(node->clnt, hdr_sz, strlen(hdr_sz), NETCONN_NOCOPY);
+			err = nc_write(node->clnt, hdr_sz, strlen(hdr_sz), NETCONN_NOCOPY);
 			//free(hb);
 			
 			print_err(err, __func__, __LINE__);
@@ -267,7 +268,7 @@ int do_404(char **uri, int uri_len, char *hdr, char* hdr_sz, nc_node *node ){
 		
 		DBG("pre net out %x %d\n%s\n", buf, buf_len, buf);
 		if( check_conn(__func__, __LINE__) ){
-			err = netconn_write(node->clnt, buf, out_len, NETCONN_NOCOPY);
+			err = nc_write(node->clnt, buf, out_len, NETCONN_NOCOPY);
 			print_err(err, __func__, __LINE__);
 		}
 		free(buf);
@@ -360,7 +361,7 @@ int httpd_task(lua_State* L) {
 	//nc->pcb.tcp->so_options |= SOF_REUSEADDR;
 
 	if( check_conn(__func__, __LINE__) ){
-		err = netconn_bind(nc, IP_ADDR_ANY, 80);
+		err = netconn_bind(nc, IP_ADDR_ANY, httpd_port());
 		print_err(err, __func__, __LINE__);
 	}
 
@@ -399,34 +400,34 @@ int httpd_task(lua_State* L) {
 			ip_set_option(clnt->pcb.tcp, SOF_REUSEADDR);
 			//client->pcb.tcp->so_options |= SOF_REUSEADDR;
 			
-			int nd_idx = nc_sock_add(clnt);
-			if( nd_idx < 0){
+			int nd_idx = -1;
+			if( !nc_tls_accept(clnt) ){
+				nc_free(&clnt, "client closed. TLS handshake failed\n" );
+			}else if( (nd_idx = nc_sock_add(clnt)) < 0){
 				nc_free(&clnt, "client closed. too many connections\n" );
+			}
+			if( nd_idx < 0){
 				clnt = NULL;
 				node = NULL;
 			}else{
 				node = nc_clients[ nd_idx ];
 			}
 			
+            void *data;
+            u16_t len;
+
 			if( 
 				nd_idx >= 0 &&
 				node != NULL &&
 				check_conn(__func__, __LINE__) &&
-				(err = print_err( netconn_recv(node->clnt, &nb), __func__, __LINE__ ) ) == ERR_OK
+				(err = print_err( nc_recv(node->clnt, &nb, &data, &len), __func__, __LINE__ ) ) == ERR_OK
 			) {
-                void *data;
-                u16_t len;
-			
 				if( !(is_httpd_run == 1 || is_httpd_run == 2) ){
 					nb_free(&nb);
 					node->state = NC_CLOSE;
 					break;
 				}
 
-				if( check_conn(__func__, __LINE__) ){
-	                err = netbuf_data(nb, &data, &len);
-					print_err(err, __func__, __LINE__);
-				}
 				if(is_httpd_run == 4) {
 					nb_free(&nb);
 					node->state = NC_CLOSE;
@@ -599,6 +600,11 @@ const LUA_REG_TYPE httpd_map[] = {
 		
 		{ LSTRKEY( "recv_timeout" ),	LFUNCVAL( httpd_recv_timeout ) },
 		{ LSTRKEY( "send_timeout" ),	LFUNCVAL( httpd_send_timeout ) },
+
+#if USE_TLS
+		{ LSTRKEY( "tls" ),			LFUNCVAL( httpd_tls ) },
+		{ LSTRKEY( "tls_stats" ),		LFUNCVAL( httpd_tls_stats ) },
+#endif
 		
 		{ LNILKEY, LNILVAL }
 };
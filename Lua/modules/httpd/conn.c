@@ -0,0 +1,253 @@
+/*
+ * Copyright bhgv 2017
+ */
+
+/*
+ * Connection I/O of httpd. The clients of the TLS listener (httpd.tls)
+ * have a TLS session over their netconn, found by the netconn, so a
+ * client moved to the websockets keeps it. The others are written and
+ * read directly.
+ */
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/api.h"
+
+#include "httpd/httpd.h"
+
+#if USE_TLS
+#include "ltls.h"
+#endif
+
+
+#define HTTP_PORT	80
+#define HTTPS_PORT	443
+
+
+#if USE_TLS
+
+typedef struct {
+	struct netconn *clnt;
+	tls_conn_t *tls;
+
+	// received, not yet decrypted
+	struct netbuf *nb;
+	u16_t off;
+
+	// decrypted, returned by nc_recv
+	char *in;
+} tls_node;
+
+static tls_server_t *tls_srv = NULL;
+static int tls_port = HTTPS_PORT;
+
+static tls_node tls_nodes[ TLS_MAX ];
+
+
+static tls_node* tls_node_find(struct netconn *nc){
+	int i;
+
+	if(nc == NULL) return NULL;
+
+	for(i = 0; i < TLS_MAX; i++){
+		if(tls_nodes[i].clnt == nc)
+			return &tls_nodes[i];
+	}
+	return NULL;
+}
+
+
+static void tls_node_free(tls_node *t){
+	if(t->tls != NULL)
+		tls_close(t->tls);
+
+	nb_free(&t->nb);
+
+	if(t->in != NULL)
+		free(t->in);
+
+	memset(t, 0, sizeof(tls_node));
+}
+
+
+static int tls_node_send(void *ctx, const unsigned char *buf, size_t len){
+	tls_node *t = ctx;
+	err_t err;
+
+	err = netconn_write(t->clnt, buf, len, NETCONN_COPY);
+
+	return err == ERR_OK ? (int)len : TLS_ERROR;
+}
+
+
+static int tls_node_recv(void *ctx, unsigned char *buf, size_t len, uint32_t timeout){
+	tls_node *t = ctx;
+	void *data;
+	u16_t dlen;
+	size_t n;
+
+	if(t->nb == NULL){
+		int tmo = t->clnt->recv_timeout;
+		err_t err;
+
+		t->clnt->recv_timeout = timeout;
+		err = netconn_recv(t->clnt, &t->nb);
+		t->clnt->recv_timeout = tmo;
+
+		if(err == ERR_TIMEOUT) return TLS_TIMEOUT;
+		if(err == ERR_CLSD) return 0;
+		if(err != ERR_OK) return TLS_ERROR;
+
+		t->off = 0;
+	}
+
+	netbuf_data(t->nb, &data, &dlen);
+
+	n = dlen - t->off;
+	if(n > len) n = len;
+
+	memcpy(buf, (char*)data + t->off, n);
+	t->off += n;
+
+	// the rest of the netbuf is in its next pieces
+	if(t->off >= dlen){
+		t->off = 0;
+		if(netbuf_next(t->nb) < 0)
+			nb_free(&t->nb);
+	}
+
+	return n;
+}
+
+#endif
+
+
+int nc_tls_accept(struct netconn *clnt){
+#if USE_TLS
+	tls_node *t = NULL;
+	int i;
+
+	if(tls_srv == NULL) return 1;
+
+	for(i = 0; i < TLS_MAX; i++){
+		if(tls_nodes[i].clnt == NULL){
+			t = &tls_nodes[i];
+			break;
+		}
+	}
+	if(t == NULL) return 0;
+
+	t->in = malloc(IN_BUF_LEN);
+	if(t->in == NULL) return 0;
+
+	t->clnt = clnt;
+	t->tls = tls_accept(tls_srv, t, tls_node_send, tls_node_recv);
+	if(t->tls == NULL){
+		tls_node_free(t);
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+
+void nc_tls_free(struct netconn *nc){
+#if USE_TLS
+	tls_node *t = tls_node_find(nc);
+
+	if(t != NULL)
+		tls_node_free(t);
+#endif
+}
+
+
+err_t nc_write(struct netconn *nc, const void *data, size_t len, u8_t flags){
+#if USE_TLS
+	tls_node *t = tls_node_find(nc);
+
+	if(t != NULL)
+		return tls_write(t->tls, data, len) < 0 ? ERR_CONN : ERR_OK;
+#endif
+	return netconn_write(nc, data, len, flags);
+}
+
+
+/*
+ * Data received on nc. It is in *nb, to free with nb_free, or in the
+ * buffer of the TLS session until the next nc_recv.
+ */
+err_t nc_recv(struct netconn *nc, struct netbuf **nb, void **data, u16_t *len){
+	err_t err;
+
+	*nb = NULL;
+
+#if USE_TLS
+	tls_node *t = tls_node_find(nc);
+
+	if(t != NULL){
+		int r = tls_read(t->tls, t->in, IN_BUF_LEN, nc->recv_timeout);
+
+		if(r > 0){
+			*data = t->in;
+			*len = r;
+			return ERR_OK;
+		}
+		if(r == TLS_TIMEOUT) return ERR_TIMEOUT;
+		if(r == TLS_CLOSED) return ERR_CLSD;
+		return ERR_CONN;
+	}
+#endif
+
+	err = netconn_recv(nc, nb);
+	if(err == ERR_OK)
+		err = netbuf_data(*nb, data, len);
+
+	return err;
+}
+
+
+int httpd_port(){
+#if USE_TLS
+	if(tls_srv != NULL) return tls_port;
+#endif
+	return HTTP_PORT;
+}
+
+
+#if USE_TLS
+
+// httpd.tls{ identity = "id", psk = "key", ... } or httpd.tls() for plain http
+int httpd_tls(lua_State* L){
+	tls_server_t *srv = NULL;
+	int port = HTTPS_PORT;
+
+	if(is_httpd_run)
+		return luaL_error(L, "httpd is running");
+
+	if(!lua_isnoneornil(L, 1))
+		srv = ltls_new(L, 1, &port);
+
+	tls_server_free(tls_srv);
+	tls_srv = srv;
+	tls_port = port;
+
+	return 0;
+}
+
+
+int httpd_tls_stats(lua_State* L){
+	if(tls_srv == NULL){
+		lua_pushnil(L);
+	}else{
+		ltls_push_stats(L, tls_srv);
+	}
+	return 1;
+}
+
+#endif
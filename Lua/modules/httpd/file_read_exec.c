@@ -162,7 +162,7 @@ int do_file_pas(nc_node *node){
 
 			tlen = do_text_strip(buf, tlen);
 		
-			err = netconn_write(node->clnt, buf, tlen, NETCONN_NOCOPY);
+			err = nc_write(node->clnt, buf, tlen, NETCONN_NOCOPY);
 			DBG("post netconn_write %d, err=%d\n", node->cur_f, err );
 			print_err(err, __func__, __LINE__);
 		}
@@ -231,7 +231,7 @@ int do_file_begin(char **uri, int uri_len, char *hdr, char* hdr_sz, nc_node *nod
 		
 		DBG("pre hdr_net_wrt %x %d f=%d\n", hdr, strlen(hdr), node->cur_f );
 		if( check_conn(__func__, __LINE__) ){
-			err = netconn_write(node->clnt, hdr, strlen(hdr), NETCONN_NOCOPY);
+			err = nc_write(node->clnt, hdr, strlen(hdr), NETCONN_NOCOPY);
 			print_err(err, __func__, __LINE__);
 		}
 		if(is_httpd_run == 4) {
@@ -246,7 +246,7 @@ int do_file_begin(char **uri, int uri_len, char *hdr, char* hdr_sz, nc_node *nod
 			char *hb = malloc(strlen(hdr_sz)+20);
 			snprintf(hb, strlen(hdr_sz)+20-1, hdr_sz, flen);
 			DBG("%s\n", hb );
-			err = netconn_write(node->clnt, hb, strlen(hb), NETCONN_NOCOPY);
+			err = nc_write(node->clnt, hb, strlen(hb), NETCONN_NOCOPY);
 			free(hb);
 
 			print_err(err, __func__, __LINE__);
@@ -26,6 +26,9 @@
 
 #define WS_MAX						4
 
+// clients of the TLS listener at once, each has ~9k of record buffers
+#define TLS_MAX						2
+
 #define WS_TIMEOUT_NO_RECONNECT		10
 #define WS_TIMEOUT_UNCONNECT		1000
 
@@ -103,6 +106,17 @@ char* strstr(const char* buffer, const char* token);
 void nc_free(struct netconn **nc, char* msg);
 void nb_free();
 
+struct netbuf;
+
+int nc_tls_accept(struct netconn *clnt);
+void nc_tls_free(struct netconn *nc);
+err_t nc_write(struct netconn *nc, const void *data, size_t len, u8_t flags);
+err_t nc_recv(struct netconn *nc, struct netbuf **nb, void **data, u16_t *len);
+
+int httpd_port();
+int httpd_tls(lua_State* L);
+int httpd_tls_stats(lua_State* L);
+
 
 
 int check_conn(char* fn, int ln);
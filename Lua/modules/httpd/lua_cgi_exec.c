@@ -54,7 +54,7 @@ extern get_par* get_root;
 
 int do_lua_pas(lua_State* L, char** outstr, nc_node *node ){
 	err_t err;
-	int outlen = 0; 
+	size_t outlen = 0; 
 	int n_c = lua_gettop(L);
 	int r;
 	
@@ -79,7 +79,7 @@ int do_lua_pas(lua_State* L, char** outstr, nc_node *node ){
 					}else{
 						DBG("pre netconn_write lua %x %d\n", *outstr, outlen);
 						if( check_conn(__func__, __LINE__) ){
-							err = netconn_write(node->clnt, *outstr, outlen, NETCONN_NOCOPY);
+							err = nc_write(node->clnt, *outstr, outlen, NETCONN_NOCOPY);
 
 							print_err(err, __func__, __LINE__);
 						}
@@ -176,7 +176,7 @@ int do_lua_begin(char **uri, int uri_len, char *hdr, char* hdr_sz, lua_State* L,
 
 				//DBG("pre hdr_lua_wrt %x %d\n", lua_hdr, strlen(lua_hdr) );
 				if( check_conn(__func__, __LINE__) ){
-					err = netconn_write(node->clnt, hdr, strlen(hdr), NETCONN_NOCOPY);
+					err = nc_write(node->clnt, hdr, strlen(hdr), NETCONN_NOCOPY);
 					print_err(err, __func__, __LINE__);
 				}
 				if(is_httpd_run == 4) 
@@ -184,7 +184,7 @@ int do_lua_begin(char **uri, int uri_len, char *hdr, char* hdr_sz, lua_State* L,
 				
 				//DBG("pre hdr_lua_tail_wrt %x %d\n", hdr_nosiz, strlen(hdr_nosiz) );
 				if( check_conn(__func__, __LINE__) ){
-					err = netconn_write(node->clnt, hdr_sz, strlen(hdr_sz), NETCONN_NOCOPY);
+					err = nc_write(node->clnt, hdr_sz, strlen(hdr_sz), NETCONN_NOCOPY);
 					print_err(err, __func__, __LINE__);
 				}
 				if(is_httpd_run == 4) 
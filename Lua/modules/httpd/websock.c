@@ -70,7 +70,7 @@ void websocket_write(struct netconn *nc, const uint8_t *data, uint16_t len, uint
     memcpy(&buf[2], data, len);
     len += 2;
 	usleep(10);
-	netconn_write(nc, buf, len, NETCONN_NOCOPY);
+	nc_write(nc, buf, len, NETCONN_NOCOPY);
 	free(buf);
 }
 
@@ -110,7 +110,7 @@ static err_t websocket_close(struct netconn *nc)
     const char buf[] = {0x88, 0x02, 0x03, 0xe8};
     u16_t len = sizeof(buf);
 
-	return netconn_write(nc, buf, len, NETCONN_COPY);
+	return nc_write(nc, buf, len, NETCONN_COPY);
 }
 
 
@@ -141,7 +141,7 @@ static int websocket_connect(struct netconn *nc, char* data, int data_len/*, cha
 	                unsigned char sha1sum[20];
 	                mbedtls_sha1((unsigned char *) key, sizeof(WS_GUID) + len - 1, sha1sum);
 	                /* Base64 encode */
-	                unsigned int olen;
+	                size_t olen;
 	                mbedtls_base64_encode(NULL, 0, &olen, sha1sum, 20); //get length
 	                int ok = mbedtls_base64_encode(encoded_key, sizeof(encoded_key), &olen, sha1sum, 20);
 	                if (ok == 0) {
@@ -154,7 +154,7 @@ static int websocket_connect(struct netconn *nc, char* data, int data_len/*, cha
 	                    u16_t len = snprintf(buf, buf_len, WS_RSP, encoded_key);
 						err_t err = ERR_OK;
 						if( check_conn(__func__, __LINE__) ){
-	                    	err = netconn_write(nc, buf, len, NETCONN_NOCOPY);
+	                    	err = nc_write(nc, buf, len, NETCONN_NOCOPY);
 							print_err(err, __func__, __LINE__);
 						}
 						free(buf);
@@ -222,6 +222,10 @@ static float dev_pwm(int ch, float v){
 #include <pcf8591/pcf8591.h>
 extern unsigned char dac;
 
+// See ad.c, the last sample when the acquisition runs
+int adc_read_int(void);
+int adc_read_exp(int ch);
+
 static float dev_adc(int ch, float v){
 	float ov = -1.0;
 
@@ -230,11 +234,9 @@ static float dev_adc(int ch, float v){
 	if(ch == -2) 
 		ov = ( 100.0*(float)dac )/255.0;
 	else if(ch == -3) 
-		ov = ( 100.0*(float)sdk_system_adc_read() )/1023.0;
+		ov = ( 100.0*(float)adc_read_int() )/1023.0;
 	else if(ch >= 0 && ch <= 3)
-		ov = ( 100.0*
-			(float)pcf8591_read(PCF8591_DEFAULT_ADDRESS, (unsigned char)ch) 
-			)/255.0;
+		ov = ( 100.0*(float)adc_read_exp(ch) )/255.0;
 	else return -1.0;
 
 	
@@ -415,21 +417,18 @@ void ws_sub_task(lua_State *L, int idx){
 
 	if(is_httpd_run == 1 || is_httpd_run == 2) {
 		struct netbuf *nb=NULL;
+		unsigned char *data;
+		u16_t len;
 
 		if (
 			el->clnt != NULL && 
 			check_conn(__func__, __LINE__) &&
-			(err = print_err( netconn_recv(el->clnt, &nb), __func__, __LINE__ ) ) == ERR_OK
+			(err = print_err( nc_recv(el->clnt, &nb, (void**)&data, &len), __func__, __LINE__ ) ) == ERR_OK
 		) {
-			unsigned char *data;
-			u16_t len;
-		
-			if( check_conn(__func__, __LINE__) ){
-				err = netbuf_data(nb, &data, &len);
-				print_err(err, __func__, __LINE__);
-			}
-			if(is_httpd_run == 4) 
+			if(is_httpd_run == 4) {
+				nb_free(&nb);
 				return;
+			}
 			
 			if( websocket_parse(el->clnt, data, len) == ERR_OK){
 				unsigned char* ws_data = &data[6];
@@ -483,7 +482,7 @@ void ws_sub_task(lua_State *L, int idx){
 						}
 					}else{
 						const char* s;
-						int l;
+						size_t l;
 						int n = lua_gettop(L);
 
 //						get_root = el->get_root;
@@ -0,0 +1,99 @@
+/*
+ * bhgv, Lua side of the TLS listeners (httpd.tls, styx.tls)
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#if USE_TLS
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include <string.h>
+
+#include "ltls.h"
+
+static int opt_field(lua_State *L, int idx, const char *name, int def) {
+	int v = def;
+
+	lua_getfield(L, idx, name);
+	if (!lua_isnil(L, -1)) {
+		v = luaL_checkinteger(L, -1);
+	}
+	lua_pop(L, 1);
+
+	return v;
+}
+
+tls_server_t *ltls_new(lua_State *L, int idx, int *port) {
+	tls_server_t *srv;
+	tls_opts_t opts;
+	char msg[64];
+	int res;
+
+	luaL_checktype(L, idx, LUA_TTABLE);
+
+	memset(&opts, 0, sizeof(opts));
+
+	*port = opt_field(L, idx, "port", *port);
+
+	// The strings stay in the table, the listener copies them
+	lua_getfield(L, idx, "identity");
+	luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, idx, "identity expected");
+	opts.identity = lua_tostring(L, -1);
+	lua_pop(L, 1);
+
+	lua_getfield(L, idx, "psk");
+	luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, idx, "psk expected");
+	opts.psk = (const unsigned char *)lua_tolstring(L, -1, &opts.psk_len);
+	luaL_argcheck(L, opts.psk_len > 0 && opts.psk_len <= TLS_PSK_MAX_LEN, idx, "bad psk length");
+	lua_pop(L, 1);
+
+	opts.max_frag = opt_field(L, idx, "max_frag", 0);
+	opts.cache_max = opt_field(L, idx, "cache", TLS_DEF_CACHE_MAX);
+	opts.cache_timeout = opt_field(L, idx, "cache_timeout", TLS_DEF_CACHE_TIMEOUT);
+	opts.timeout = opt_field(L, idx, "timeout", TLS_DEF_TIMEOUT);
+
+	lua_getfield(L, idx, "tickets");
+	if (lua_isboolean(L, -1)) {
+		opts.ticket_lifetime = lua_toboolean(L, -1) ? TLS_DEF_TICKET_LIFETIME : 0;
+	} else if (lua_isnil(L, -1)) {
+		opts.ticket_lifetime = TLS_DEF_TICKET_LIFETIME;
+	} else {
+		opts.ticket_lifetime = luaL_checkinteger(L, -1);
+	}
+	lua_pop(L, 1);
+
+	res = tls_server_new(&srv, &opts);
+	if (res) {
+		tls_strerror(res, msg, sizeof(msg));
+		luaL_error(L, "tls: %s", msg);
+	}
+
+	return srv;
+}
+
+static void set_field(lua_State *L, const char *name, lua_Integer v) {
+	lua_pushinteger(L, v);
+	lua_setfield(L, -2, name);
+}
+
+void ltls_push_stats(lua_State *L, tls_server_t *srv) {
+	const tls_stats_t *st = tls_server_stats(srv);
+
+	lua_createtable(L, 0, 7);
+
+	set_field(L, "handshakes", st->handshakes);
+	set_field(L, "resumed", st->resumed);
+	set_field(L, "failed", st->failed);
+	set_field(L, "handshake_us", st->handshake_us);
+	set_field(L, "resume_us", st->resume_us);
+	set_field(L, "handshake_avg_us", st->handshakes ? st->handshake_total_us / st->handshakes : 0);
+	set_field(L, "resume_avg_us", st->resumed ? st->resume_total_us / st->resumed : 0);
+}
+
+#endif
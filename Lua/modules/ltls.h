@@ -0,0 +1,37 @@
+/*
+ * bhgv, Lua side of the TLS listeners (httpd.tls, styx.tls)
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _LTLS_H_
+#define _LTLS_H_
+
+#include "lua.h"
+
+#include "tls_server.h"
+
+/*
+ * Listener of the options table at idx:
+ *
+ *   port          listening port, *port is the default
+ *   identity      PSK identity
+ *   psk           key, 1 to TLS_PSK_MAX_LEN bytes
+ *   max_frag      largest record sent (512, 1024, 2048, 4096)
+ *   cache         sessions kept by id, 0 for none
+ *   cache_timeout seconds a session is kept
+ *   tickets       ticket lifetime in seconds, or false for none
+ *   timeout       ms the handshake waits for the client
+ *
+ * Raises an error if it can't be set up.
+ */
+tls_server_t *ltls_new(lua_State *L, int idx, int *port);
+
+// Pushes a table with the handshake counters and times of srv
+void ltls_push_stats(lua_State *L, tls_server_t *srv);
+
+#endif
@@ -0,0 +1,1334 @@
+/*
+ * bhgv, MQTT client
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * An MQTT 3.1.1 client on lwIP sockets. The Lua thread only queues the
+ * packets: a task of the client writes the queue, reads the broker and
+ * sends the keepalive pings, so a script that is busy or sleeps keeps its
+ * connection.
+ *
+ *   c = mqtt.client(id, [keepalive s], [user], [password], [clean])
+ *   c:lwt(topic, message, [qos], [retain])     before connect
+ *   err, code = c:connect(host | ip, [port], [timeout ms])
+ *   id, err = c:publish(topic, payload, [qos], [retain])
+ *   id, err = c:subscribe(topic, [qos])
+ *   id, err = c:unsubscribe(topic)
+ *   topic, payload, err = c:recv([timeout ms])
+ *   done = c:flush([timeout ms])
+ *   stats = c:stats()
+ *   c:close()
+ *
+ * The task writes what was queued during the last MQTT_FLUSH_MS in one
+ * send(), so a burst of publishes shares the TCP segments. The queue holds
+ * MQTT_QUEUE_SIZE bytes, and up to MQTT_INFLIGHT QoS 1 publishes wait for
+ * their PUBACK at once; a publish over either limit returns nil and
+ * ERR_OVERFLOW. The QoS 1 publishes not acknowledged are sent again, with
+ * DUP, by the next connect. QoS 2 is not supported.
+ *
+ * Received messages wait for recv() in a queue of MQTT_INBOX, the oldest is
+ * dropped when it's full, and those longer than MQTT_RX_SIZE are dropped.
+ * recv() returns ERR_CLOSED once the connection is lost, ERR_TIMEDOUT when
+ * nothing came in time. Without a timeout recv() and flush() wait forever,
+ * green threads by yielding.
+ *
+ * The latency of stats() is from publish() to the PUBACK of the QoS 1
+ * publishes, the delay is the longest a batch waited in the queue.
+ */
+
+#include "whitecat.h"
+
+#if LUA_USE_MQTT
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#include "pthread.h"
+
+#include "lwip/sockets.h"
+#ifdef PLATFORM_HOST
+#include <netdb.h>
+#else
+#include "lwip/netdb.h"
+#endif
+
+#include <sys/drivers/clock.h>
+
+#include "sock.h"
+#include "thread.h"
+
+#define MQTT_USERDATA "mqtt.client"
+
+// Bytes of packets the Lua thread can queue for the task
+#ifndef MQTT_QUEUE_SIZE
+#define MQTT_QUEUE_SIZE          1024
+#endif
+
+// QoS 1 publishes waiting for their PUBACK
+#ifndef MQTT_INFLIGHT
+#define MQTT_INFLIGHT            8
+#endif
+
+// Received messages waiting for recv()
+#ifndef MQTT_INBOX
+#define MQTT_INBOX               8
+#endif
+
+// Longest packet received
+#ifndef MQTT_RX_SIZE
+#define MQTT_RX_SIZE             1024
+#endif
+
+// Period the task writes the queue at, in ms
+#ifndef MQTT_FLUSH_MS
+#define MQTT_FLUSH_MS            20
+#endif
+
+// Period flush() checks the queue at, in ms
+#ifndef MQTT_POLL_MS
+#define MQTT_POLL_MS             10
+#endif
+
+#define MQTT_DEFAULT_PORT        1883
+#define MQTT_DEFAULT_KEEPALIVE   60
+#define MQTT_CONNECT_TIMEOUT     5000
+
+// Room of the queue kept for the PUBACKs and pings of the task
+#define MQTT_RESERVE             16
+
+// Packet types, in the high nibble of the first byte
+#define MQTT_CONNECT             1
+#define MQTT_CONNACK             2
+#define MQTT_PUBLISH             3
+#define MQTT_PUBACK              4
+#define MQTT_SUBSCRIBE           8
+#define MQTT_SUBACK              9
+#define MQTT_UNSUBSCRIBE         10
+#define MQTT_UNSUBACK            11
+#define MQTT_PINGREQ             12
+#define MQTT_PINGRESP            13
+#define MQTT_DISCONNECT          14
+
+#define MQTT_DUP                 0x08
+
+// States of a client
+#define MQTT_STATE_CLOSED        0
+#define MQTT_STATE_CONNECTED     1
+#define MQTT_STATE_LOST          2
+
+typedef struct {
+    uint16_t id;        // 0 when the slot is free
+    uint16_t len;
+    uint64_t t;         // Time of publish(), in us
+    uint8_t *pkt;       // Sent again after a reconnection
+} mqtt_inflight;
+
+// A received message, the topic then the payload
+typedef struct {
+    uint16_t tlen;
+    uint16_t len;
+    char data[];
+} mqtt_msg;
+
+typedef struct {
+    uint32_t published;
+    uint32_t acked;
+    uint32_t refused;       // Publishes over the queue or in-flight limits
+    uint32_t sent;          // Packets written
+    uint32_t writes;        // send() calls
+    uint32_t bytes;
+    uint32_t received;
+    uint32_t dropped;
+    uint32_t pings;
+    uint32_t max_depth;     // Most packets queued at once
+    uint32_t max_inflight;
+    uint64_t lat_sum;
+    uint32_t lat_max;
+    uint32_t delay_max;
+} mqtt_stats;
+
+typedef struct {
+    SemaphoreHandle_t mtx;  // Everything below but the receive buffer
+    QueueHandle_t inbox;    // mqtt_msg *, NULL when the connection is lost
+
+    int fd;
+    int state;
+    int task;               // The task runs
+    int quit;               // The task sends DISCONNECT and ends
+    int collected;          // The userdata is gone, the task frees it all
+
+    char *id;
+    char *user;
+    char *pass;
+    char *will_topic;
+    char *will_msg;
+    size_t will_len;
+    uint8_t will_qos;
+    uint8_t will_retain;
+    uint8_t clean;
+    uint16_t keepalive;
+
+    uint16_t next_id;
+
+    // Filled by the Lua thread, swapped with tx and written by the task
+    uint8_t *out;
+    size_t out_len;
+    uint32_t out_pkts;
+    uint64_t out_t;         // Time of the first packet queued
+
+    uint8_t *tx;
+    size_t tx_len;
+    size_t tx_off;
+    uint32_t tx_pkts;
+
+    mqtt_inflight inflight[MQTT_INFLIGHT];
+    int n_inflight;
+
+    uint64_t last_tx;
+    uint64_t ping_t;        // Time of the PINGREQ without a PINGRESP
+
+    // Used by the task only
+    uint8_t *rx;
+    size_t rx_len;
+    size_t rx_skip;         // Rest of a packet too long, being dropped
+
+    mqtt_stats st;
+} mqtt_client;
+
+typedef struct {
+    mqtt_client *c;
+} mqtt_userdata;
+
+#define mqtt_lock(c)   xSemaphoreTake((c)->mtx, portMAX_DELAY)
+#define mqtt_unlock(c) xSemaphoreGive((c)->mtx)
+
+/*
+ * Packets
+ */
+
+static size_t mqtt_varlen_size(size_t n) {
+    return (n < 128) ? 1 : (n < 16384) ? 2 : (n < 2097152) ? 3 : 4;
+}
+
+static uint8_t *mqtt_put_varlen(uint8_t *p, size_t n) {
+    do {
+        uint8_t b = n & 0x7f;
+
+        n >>= 7;
+        *p++ = n ? (b | 0x80) : b;
+    } while (n);
+
+    return p;
+}
+
+static uint8_t *mqtt_put_u16(uint8_t *p, uint16_t v) {
+    *p++ = v >> 8;
+    *p++ = v & 0xff;
+    return p;
+}
+
+static uint8_t *mqtt_put_str(uint8_t *p, const char *s, size_t len) {
+    p = mqtt_put_u16(p, len);
+    memcpy(p, s, len);
+    return p + len;
+}
+
+// Size of a whole packet with rem bytes after the fixed header
+static size_t mqtt_packet_size(size_t rem) {
+    return 1 + mqtt_varlen_size(rem) + rem;
+}
+
+static uint16_t mqtt_new_id(mqtt_client *c) {
+    if (++c->next_id == 0) {
+        c->next_id = 1;
+    }
+    return c->next_id;
+}
+
+// Room for size bytes at the end of the queue, or NULL. The Lua thread
+// leaves MQTT_RESERVE bytes to the task. Called locked.
+static uint8_t *mqtt_queue(mqtt_client *c, size_t size, size_t reserve) {
+    uint8_t *p;
+
+    if (!c->out || (c->out_len + size + reserve > MQTT_QUEUE_SIZE)) {
+        return NULL;
+    }
+
+    if (c->out_len == 0) {
+        c->out_t = clock_monotonic_us();
+    }
+
+    p = c->out + c->out_len;
+    c->out_len += size;
+    c->out_pkts++;
+
+    if (c->out_pkts + c->tx_pkts > c->st.max_depth) {
+        c->st.max_depth = c->out_pkts + c->tx_pkts;
+    }
+
+    return p;
+}
+
+// Queues a packet of the task, with only an id or nothing after the
+// fixed header. Returns 0 when the queue is full. Called locked.
+static int mqtt_queue_ack(mqtt_client *c, uint8_t type, int id) {
+    uint8_t *p = mqtt_queue(c, (id >= 0) ? 4 : 2, 0);
+
+    if (!p) {
+        return 0;
+    }
+
+    *p++ = type << 4;
+    if (id >= 0) {
+        *p++ = 2;
+        mqtt_put_u16(p, id);
+    } else {
+        *p = 0;
+    }
+    return 1;
+}
+
+static size_t mqtt_connect_packet(mqtt_client *c, uint8_t *buf) {
+    size_t rem = 10 + 2 + strlen(c->id);
+    uint8_t flags = c->clean ? 0x02 : 0;
+    uint8_t *p = buf;
+
+    if (c->will_topic) {
+        rem += 2 + strlen(c->will_topic) + 2 + c->will_len;
+        flags |= 0x04 | (c->will_qos << 3) | (c->will_retain ? 0x20 : 0);
+    }
+    if (c->user) {
+        rem += 2 + strlen(c->user);
+        flags |= 0x80;
+    }
+    if (c->pass) {
+        rem += 2 + strlen(c->pass);
+        flags |= 0x40;
+    }
+
+    if (!buf) {
+        return mqtt_packet_size(rem);
+    }
+
+    *p++ = MQTT_CONNECT << 4;
+    p = mqtt_put_varlen(p, rem);
+    p = mqtt_put_str(p, "MQTT", 4);
+    *p++ = 4;
+    *p++ = flags;
+    p = mqtt_put_u16(p, c->keepalive);
+    p = mqtt_put_str(p, c->id, strlen(c->id));
+
+    if (c->will_topic) {
+        p = mqtt_put_str(p, c->will_topic, strlen(c->will_topic));
+        p = mqtt_put_str(p, c->will_msg, c->will_len);
+    }
+    if (c->user) {
+        p = mqtt_put_str(p, c->user, strlen(c->user));
+    }
+    if (c->pass) {
+        p = mqtt_put_str(p, c->pass, strlen(c->pass));
+    }
+
+    return p - buf;
+}
+
+/*
+ * Task
+ */
+
+static void mqtt_free(mqtt_client *c) {
+    mqtt_msg *m;
+    int i;
+
+    if (c->fd >= 0) {
+        lwip_close(c->fd);
+    }
+
+    while (xQueueReceive(c->inbox, &m, 0) == pdTRUE) {
+        free(m);
+    }
+
+    for (i = 0; i < MQTT_INFLIGHT; i++) {
+        free(c->inflight[i].pkt);
+    }
+
+    vQueueDelete(c->inbox);
+    vSemaphoreDelete(c->mtx);
+
+    free(c->out);
+    free(c->tx);
+    free(c->rx);
+    free(c->id);
+    free(c->user);
+    free(c->pass);
+    free(c->will_topic);
+    free(c->will_msg);
+    free(c);
+}
+
+// Puts m in the inbox, in place of the oldest message when it's full
+static void mqtt_deliver(mqtt_client *c, mqtt_msg *m) {
+    mqtt_msg *old;
+
+    while (xQueueSend(c->inbox, &m, 0) != pdTRUE) {
+        if (xQueueReceive(c->inbox, &old, 0) == pdTRUE) {
+            free(old);
+            c->st.dropped++;
+        }
+    }
+}
+
+static void mqtt_publish_in(mqtt_client *c, uint8_t flags, const uint8_t *p, size_t len) {
+    int qos = (flags >> 1) & 3;
+    size_t tlen, skip;
+    mqtt_msg *m;
+    int id = -1;
+
+    if (len < 2) {
+        return;
+    }
+
+    tlen = (p[0] << 8) | p[1];
+    skip = 2 + tlen + (qos ? 2 : 0);
+    if (skip > len) {
+        return;
+    }
+
+    if (qos) {
+        id = (p[2 + tlen] << 8) | p[3 + tlen];
+    }
+
+    m = malloc(sizeof(mqtt_msg) + tlen + len - skip);
+
+    mqtt_lock(c);
+    if (id >= 0) {
+        mqtt_queue_ack(c, MQTT_PUBACK, id);
+    }
+
+    if (m) {
+        m->tlen = tlen;
+        m->len = len - skip;
+        memcpy(m->data, p + 2, tlen);
+        memcpy(m->data + tlen, p + skip, m->len);
+
+        mqtt_deliver(c, m);
+        c->st.received++;
+    } else {
+        c->st.dropped++;
+    }
+    mqtt_unlock(c);
+}
+
+static void mqtt_puback(mqtt_client *c, uint16_t id) {
+    mqtt_inflight *f;
+    uint32_t lat;
+    int i;
+
+    mqtt_lock(c);
+    for (i = 0; i < MQTT_INFLIGHT; i++) {
+        f = &c->inflight[i];
+        if (f->id == id) {
+            lat = clock_monotonic_us() - f->t;
+            c->st.lat_sum += lat;
+            if (lat > c->st.lat_max) {
+                c->st.lat_max = lat;
+            }
+            c->st.acked++;
+
+            free(f->pkt);
+            memset(f, 0, sizeof(mqtt_inflight));
+            c->n_inflight--;
+            break;
+        }
+    }
+    mqtt_unlock(c);
+}
+
+static void mqtt_packet_in(mqtt_client *c, uint8_t hdr, const uint8_t *p, size_t len) {
+    switch (hdr >> 4) {
+        case MQTT_PUBLISH:
+            mqtt_publish_in(c, hdr & 0x0f, p, len);
+            break;
+
+        case MQTT_PUBACK:
+            if (len >= 2) {
+                mqtt_puback(c, (p[0] << 8) | p[1]);
+            }
+            break;
+
+        case MQTT_PINGRESP:
+            mqtt_lock(c);
+            c->ping_t = 0;
+            mqtt_unlock(c);
+            break;
+    }
+}
+
+// Reads what the broker sent and handles the whole packets. Returns 0 when
+// the connection is closed or fails.
+static int mqtt_read(mqtt_client *c) {
+    size_t n, rem, hlen, total;
+    int r, shift;
+
+    r = lwip_recv(c->fd, c->rx + c->rx_len, MQTT_RX_SIZE - c->rx_len, 0);
+    if (r <= 0) {
+        return 0;
+    }
+    c->rx_len += r;
+
+    for (;;) {
+        // The rest of a packet too long for the buffer
+        if (c->rx_skip) {
+            n = (c->rx_skip < c->rx_len) ? c->rx_skip : c->rx_len;
+            memmove(c->rx, c->rx + n, c->rx_len - n);
+            c->rx_len -= n;
+            c->rx_skip -= n;
+            if (c->rx_skip) {
+                break;
+            }
+        }
+
+        // Fixed header, the type and the remaining length
+        rem = 0;
+        shift = 0;
+        for (hlen = 1; ; hlen++) {
+            if ((hlen >= c->rx_len) || (hlen > 4)) {
+                break;
+            }
+            rem |= (size_t)(c->rx[hlen] & 0x7f) << shift;
+            shift += 7;
+            if (!(c->rx[hlen] & 0x80)) {
+                break;
+            }
+        }
+
+        if (hlen > 4) {
+            return 0;
+        }
+        if (hlen >= c->rx_len) {
+            break;
+        }
+
+        hlen++;
+        total = hlen + rem;
+
+        if (total > MQTT_RX_SIZE) {
+            c->rx_skip = total;
+            mqtt_lock(c);
+            c->st.dropped++;
+            mqtt_unlock(c);
+            continue;
+        }
+
+        if (c->rx_len < total) {
+            break;
+        }
+
+        mqtt_packet_in(c, c->rx[0], c->rx + hlen, rem);
+
+        memmove(c->rx, c->rx + total, c->rx_len - total);
+        c->rx_len -= total;
+    }
+
+    return 1;
+}
+
+static int mqtt_readable(int fd, int timeout) {
+    struct timeval tv = {timeout / 1000, (timeout % 1000) * 1000};
+    fd_set rfds;
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+
+    return lwip_select(fd + 1, &rfds, NULL, NULL, &tv) > 0;
+}
+
+// Pings the broker when nothing was written for the keepalive period. A
+// ping without answer for as long loses the connection. Called locked.
+static int mqtt_keepalive(mqtt_client *c, uint64_t now) {
+    uint64_t period = (uint64_t)c->keepalive * 1000000;
+
+    if (!period) {
+        return 1;
+    }
+
+    if (c->ping_t) {
+        return (now - c->ping_t) < period;
+    }
+
+    if ((now - c->last_tx >= period) && !c->out_len && (c->tx_off == c->tx_len) &&
+        mqtt_queue_ack(c, MQTT_PINGREQ, -1)) {
+        c->ping_t = now;
+        c->st.pings++;
+    }
+
+    return 1;
+}
+
+static void *mqtt_task(void *arg) {
+    mqtt_client *c = (mqtt_client *)arg;
+    int alive = 1, done = 0, collected;
+    uint8_t *buf;
+    uint64_t now;
+    uint32_t delay;
+    int n;
+
+    while (alive && !done) {
+        if (mqtt_readable(c->fd, MQTT_FLUSH_MS) && !mqtt_read(c)) {
+            alive = 0;
+            break;
+        }
+
+        mqtt_lock(c);
+        now = clock_monotonic_us();
+
+        // DISCONNECT is the last packet, the will is not published
+        if ((c->quit == 1) && mqtt_queue_ack(c, MQTT_DISCONNECT, -1)) {
+            c->quit = 2;
+        }
+
+        alive = mqtt_keepalive(c, now);
+
+        // What was queued meanwhile goes in one write
+        if ((c->tx_off == c->tx_len) && c->out_len) {
+            delay = now - c->out_t;
+            if (delay > c->st.delay_max) {
+                c->st.delay_max = delay;
+            }
+
+            buf = c->tx;
+            c->tx = c->out;
+            c->tx_len = c->out_len;
+            c->tx_off = 0;
+            c->tx_pkts = c->out_pkts;
+
+            c->out = buf;
+            c->out_len = 0;
+            c->out_pkts = 0;
+        }
+
+        done = (c->quit == 2) && !c->out_len && (c->tx_off == c->tx_len);
+        mqtt_unlock(c);
+
+        if (alive && (c->tx_off < c->tx_len)) {
+            n = lwip_send(c->fd, c->tx + c->tx_off, c->tx_len - c->tx_off, 0);
+
+            mqtt_lock(c);
+            if (n > 0) {
+                c->tx_off += n;
+                c->last_tx = now;
+                c->st.writes++;
+                c->st.bytes += n;
+
+                if (c->tx_off == c->tx_len) {
+                    c->st.sent += c->tx_pkts;
+                    c->tx_pkts = 0;
+                }
+            } else {
+                alive = 0;
+            }
+            mqtt_unlock(c);
+        }
+    }
+
+    lwip_close(c->fd);
+
+    mqtt_lock(c);
+    c->fd = -1;
+    c->task = 0;
+    c->state = c->quit ? MQTT_STATE_CLOSED : MQTT_STATE_LOST;
+    c->tx_len = c->tx_off = 0;
+    c->tx_pkts = 0;
+    collected = c->collected;
+
+    // Wakes up recv()
+    if (!c->quit) {
+        mqtt_deliver(c, NULL);
+    }
+    mqtt_unlock(c);
+
+    if (collected) {
+        mqtt_free(c);
+    }
+
+    return NULL;
+}
+
+/*
+ * Lua
+ */
+
+static mqtt_client *mqtt_check(lua_State *L, int index) {
+    mqtt_userdata *u = (mqtt_userdata *)luaL_checkudata(L, index, MQTT_USERDATA);
+
+    luaL_argcheck(L, u->c, index, "client is closed");
+    return u->c;
+}
+
+static char *mqtt_strdup(lua_State *L, int index, size_t *len) {
+    size_t l;
+    const char *s;
+    char *d;
+
+    if (lua_isnoneornil(L, index)) {
+        return NULL;
+    }
+
+    s = luaL_checklstring(L, index, &l);
+    if (!(d = malloc(l + 1))) {
+        luaL_error(L, "not enough memory");
+    }
+
+    memcpy(d, s, l + 1);
+    if (len) {
+        *len = l;
+    }
+    return d;
+}
+
+// Lua: c = mqtt.client(id, [keepalive s], [user], [password], [clean])
+static int mqtt_client_new(lua_State *L) {
+    size_t idl;
+    const char *id = luaL_checklstring(L, 1, &idl);
+    int keepalive = luaL_optinteger(L, 2, MQTT_DEFAULT_KEEPALIVE);
+    mqtt_userdata *u;
+    mqtt_client *c;
+
+    luaL_argcheck(L, (keepalive >= 0) && (keepalive <= 65535), 2, "invalid keepalive");
+    lua_settop(L, 5);
+
+    u = (mqtt_userdata *)lua_newuserdata(L, sizeof(mqtt_userdata));
+    u->c = NULL;
+
+    luaL_getmetatable(L, MQTT_USERDATA);
+    lua_setmetatable(L, -2);
+
+    if (!(c = calloc(1, sizeof(mqtt_client)))) {
+        return luaL_error(L, "not enough memory");
+    }
+
+    c->fd = -1;
+    c->mtx = xSemaphoreCreateMutex();
+    c->inbox = xQueueCreate(MQTT_INBOX, sizeof(mqtt_msg *));
+    if (!c->mtx || !c->inbox) {
+        if (c->mtx) vSemaphoreDelete(c->mtx);
+        if (c->inbox) vQueueDelete(c->inbox);
+        free(c);
+        return luaL_error(L, "not enough memory");
+    }
+
+    u->c = c;
+
+    c->id = mqtt_strdup(L, 1, NULL);
+    c->user = mqtt_strdup(L, 3, NULL);
+    c->pass = mqtt_strdup(L, 4, NULL);
+    c->keepalive = keepalive;
+    c->clean = lua_isnoneornil(L, 5) ? 1 : lua_toboolean(L, 5);
+
+    return 1;
+}
+
+// Lua: c:lwt(topic, message, [qos], [retain])
+static int mqtt_lwt(lua_State *L) {
+    mqtt_client *c = mqtt_check(L, 1);
+    int qos = luaL_optinteger(L, 4, 0);
+
+    luaL_checkstring(L, 2);
+    luaL_checkstring(L, 3);
+    luaL_argcheck(L, (qos >= 0) && (qos <= 1), 4, "invalid qos");
+
+    free(c->will_topic);
+    free(c->will_msg);
+    c->will_topic = mqtt_strdup(L, 2, NULL);
+    c->will_msg = mqtt_strdup(L, 3, &c->will_len);
+    c->will_qos = qos;
+    c->will_retain = lua_toboolean(L, 5);
+
+    return 0;
+}
+
+static int mqtt_resolve(lua_State *L, int index, struct in_addr *addr) {
+    struct addrinfo *res = NULL;
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+
+    if (lua_isinteger(L, index)) {
+        addr->s_addr = (uint32_t)lua_tointeger(L, index);
+        return 1;
+    }
+
+    if (getaddrinfo(luaL_checkstring(L, index), NULL, &hints, &res) || !res) {
+        return 0;
+    }
+
+    *addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+    return 1;
+}
+
+// Reads n bytes in timeout ms
+static int mqtt_recv_all(int fd, uint8_t *buf, size_t n, int timeout) {
+    size_t got = 0;
+    int r;
+
+    while (got < n) {
+        if (!mqtt_readable(fd, timeout)) {
+            return NET_ERR_TIMEDOUT;
+        }
+        if ((r = lwip_recv(fd, buf + got, n - got, 0)) <= 0) {
+            return NET_ERR_CLOSED;
+        }
+        got += r;
+    }
+
+    return NET_ERR_OK;
+}
+
+// Opens the connection and waits for the CONNACK. Returns an error, and
+// the return code of a refused CONNACK in code.
+static int mqtt_open(mqtt_client *c, struct sockaddr_in *addr, int timeout, int *code) {
+    uint8_t ack[4], *pkt;
+    size_t len;
+    int one = 1, err;
+
+    *code = 0;
+
+    if ((c->fd = lwip_socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        return NET_ERR_OTHER;
+    }
+
+    // The batches are written whole, they don't wait for the ACKs
+    lwip_setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (lwip_connect(c->fd, (struct sockaddr *)addr, sizeof(struct sockaddr_in)) < 0) {
+        return (errno == ETIMEDOUT) ? NET_ERR_TIMEDOUT : NET_ERR_CLOSED;
+    }
+
+    len = mqtt_connect_packet(c, NULL);
+    if (!(pkt = malloc(len))) {
+        return NET_ERR_OTHER;
+    }
+
+    mqtt_connect_packet(c, pkt);
+    err = (lwip_send(c->fd, pkt, len, 0) == len) ? NET_ERR_OK : NET_ERR_CLOSED;
+    free(pkt);
+
+    if ((err != NET_ERR_OK) || ((err = mqtt_recv_all(c->fd, ack, 4, timeout)) != NET_ERR_OK)) {
+        return err;
+    }
+
+    if ((ack[0] >> 4) != MQTT_CONNACK) {
+        return NET_ERR_OTHER;
+    }
+
+    if (ack[3]) {
+        *code = ack[3];
+        return NET_ERR_ABORTED;
+    }
+
+    return NET_ERR_OK;
+}
+
+// Sends again the QoS 1 publishes not acknowledged. Called locked.
+static void mqtt_requeue(mqtt_client *c) {
+    mqtt_inflight *f;
+    uint8_t *p;
+    int i;
+
+    for (i = 0; i < MQTT_INFLIGHT; i++) {
+        f = &c->inflight[i];
+        if (f->id && (p = mqtt_queue(c, f->len, 0))) {
+            f->pkt[0] |= MQTT_DUP;
+            memcpy(p, f->pkt, f->len);
+        }
+    }
+}
+
+// Drops the NULL a lost connection left in the inbox, keeps the messages.
+// Called locked.
+static void mqtt_inbox_clear(mqtt_client *c) {
+    UBaseType_t n = uxQueueMessagesWaiting(c->inbox);
+    mqtt_msg *m;
+
+    while (n-- && (xQueueReceive(c->inbox, &m, 0) == pdTRUE)) {
+        if (m) {
+            xQueueSend(c->inbox, &m, 0);
+        }
+    }
+}
+
+// Lua: err, code = c:connect(host | ip, [port], [timeout ms])
+static int mqtt_connect(lua_State *L) {
+    mqtt_client *c = mqtt_check(L, 1);
+    int port = luaL_optinteger(L, 3, MQTT_DEFAULT_PORT);
+    int timeout = luaL_optinteger(L, 4, MQTT_CONNECT_TIMEOUT);
+    struct sockaddr_in addr;
+    pthread_attr_t attr;
+    pthread_t id;
+    int err, code;
+
+    mqtt_lock(c);
+    err = c->task;
+    mqtt_unlock(c);
+
+    if (err) {
+        return luaL_error(L, "already connected");
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    if (!mqtt_resolve(L, 2, &addr.sin_addr)) {
+        lua_pushinteger(L, NET_ERR_OTHER);
+        return 1;
+    }
+
+    if (!c->out) {
+        c->out = malloc(MQTT_QUEUE_SIZE);
+        c->tx = malloc(MQTT_QUEUE_SIZE);
+        c->rx = malloc(MQTT_RX_SIZE);
+        if (!c->out || !c->tx || !c->rx) {
+            return luaL_error(L, "not enough memory");
+        }
+    }
+
+    err = mqtt_open(c, &addr, timeout, &code);
+    if (err != NET_ERR_OK) {
+        if (c->fd >= 0) {
+            lwip_close(c->fd);
+            c->fd = -1;
+        }
+
+        lua_pushinteger(L, err);
+        lua_pushinteger(L, code);
+        return 2;
+    }
+
+    mqtt_lock(c);
+    mqtt_inbox_clear(c);
+    c->out_len = c->tx_len = c->tx_off = 0;
+    c->out_pkts = c->tx_pkts = 0;
+    c->rx_len = c->rx_skip = 0;
+    c->ping_t = 0;
+    c->last_tx = clock_monotonic_us();
+    c->quit = 0;
+    mqtt_requeue(c);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, mqttStack);
+    pthread_attr_setinitialstate(&attr, PTHREAD_INITIAL_STATE_RUN);
+
+    if (pthread_create(&id, &attr, mqtt_task, c)) {
+        mqtt_unlock(c);
+        lwip_close(c->fd);
+        c->fd = -1;
+        return luaL_error(L, "can't start the mqtt task");
+    }
+
+    c->task = 1;
+    c->state = MQTT_STATE_CONNECTED;
+    mqtt_unlock(c);
+
+    lua_pushinteger(L, NET_ERR_OK);
+    lua_pushinteger(L, 0);
+    return 2;
+}
+
+// Lua: id, err = c:publish(topic, payload, [qos], [retain])
+static int mqtt_publish(lua_State *L) {
+    mqtt_client *c = mqtt_check(L, 1);
+    size_t tlen, plen, rem;
+    const char *topic = luaL_checklstring(L, 2, &tlen);
+    const char *payload = luaL_checklstring(L, 3, &plen);
+    int qos = luaL_optinteger(L, 4, 0);
+    int retain = lua_toboolean(L, 5);
+    mqtt_inflight *f = NULL;
+    uint8_t *p, *start;
+    uint16_t id = 0;
+    int i, err = NET_ERR_OK;
+
+    luaL_argcheck(L, (qos >= 0) && (qos <= 1), 4, "invalid qos");
+
+    rem = 2 + tlen + (qos ? 2 : 0) + plen;
+
+    mqtt_lock(c);
+
+    if (c->state != MQTT_STATE_CONNECTED) {
+        err = NET_ERR_CLOSED;
+        goto out;
+    }
+
+    if (qos) {
+        for (i = 0; i < MQTT_INFLIGHT; i++) {
+            if (!c->inflight[i].id) {
+                f = &c->inflight[i];
+                break;
+            }
+        }
+
+        if (!f || !(f->pkt = malloc(mqtt_packet_size(rem)))) {
+            c->st.refused++;
+            err = NET_ERR_OVERFLOW;
+            goto out;
+        }
+    }
+
+    if (!(start = p = mqtt_queue(c, mqtt_packet_size(rem), MQTT_RESERVE))) {
+        if (f) {
+            free(f->pkt);
+            f->pkt = NULL;
+        }
+        c->st.refused++;
+        err = NET_ERR_OVERFLOW;
+        goto out;
+    }
+
+    *p++ = (MQTT_PUBLISH << 4) | (qos << 1) | (retain ? 1 : 0);
+    p = mqtt_put_varlen(p, rem);
+    p = mqtt_put_str(p, topic, tlen);
+    if (qos) {
+        id = mqtt_new_id(c);
+        p = mqtt_put_u16(p, id);
+    }
+    memcpy(p, payload, plen);
+
+    if (f) {
+        f->id = id;
+        f->len = mqtt_packet_size(rem);
+        f->t = clock_monotonic_us();
+        memcpy(f->pkt, start, f->len);
+
+        if (++c->n_inflight > c->st.max_inflight) {
+            c->st.max_inflight = c->n_inflight;
+        }
+    }
+
+    c->st.published++;
+
+out:
+    mqtt_unlock(c);
+
+    if (err != NET_ERR_OK) {
+        lua_pushnil(L);
+    } else {
+        lua_pushinteger(L, id);
+    }
+    lua_pushinteger(L, err);
+    return 2;
+}
+
+static int mqtt_subscription(lua_State *L, uint8_t type) {
+    mqtt_client *c = mqtt_check(L, 1);
+    size_t tlen;
+    const char *topic = luaL_checklstring(L, 2, &tlen);
+    int qos = luaL_optinteger(L, 3, 0);
+    size_t rem = 2 + 2 + tlen + ((type == MQTT_SUBSCRIBE) ? 1 : 0);
+    int err = NET_ERR_OK;
+    uint16_t id = 0;
+    uint8_t *p;
+
+    luaL_argcheck(L, (qos >= 0) && (qos <= 1), 3, "invalid qos");
+
+    mqtt_lock(c);
+    if (c->state != MQTT_STATE_CONNECTED) {
+        err = NET_ERR_CLOSED;
+    } else if (!(p = mqtt_queue(c, mqtt_packet_size(rem), MQTT_RESERVE))) {
+        err = NET_ERR_OVERFLOW;
+    } else {
+        id = mqtt_new_id(c);
+
+        *p++ = (type << 4) | 0x02;
+        p = mqtt_put_varlen(p, rem);
+        p = mqtt_put_u16(p, id);
+        p = mqtt_put_str(p, topic, tlen);
+        if (type == MQTT_SUBSCRIBE) {
+            *p = qos;
+        }
+    }
+    mqtt_unlock(c);
+
+    if (err != NET_ERR_OK) {
+        lua_pushnil(L);
+    } else {
+        lua_pushinteger(L, id);
+    }
+    lua_pushinteger(L, err);
+    return 2;
+}
+
+// Lua: id, err = c:subscribe(topic, [qos])
+static int mqtt_subscribe(lua_State *L) {
+    return mqtt_subscription(L, MQTT_SUBSCRIBE);
+}
+
+// Lua: id, err = c:unsubscribe(topic)
+static int mqtt_unsubscribe(lua_State *L) {
+    lua_settop(L, 2);
+    return mqtt_subscription(L, MQTT_UNSUBSCRIBE);
+}
+
+// Pushes the message m, got from the inbox, or the reason there's none
+static int mqtt_recv_result(lua_State *L, mqtt_client *c, mqtt_msg *m, int got) {
+    int state;
+
+    if (got && m) {
+        lua_pushlstring(L, m->data, m->tlen);
+        lua_pushlstring(L, m->data + m->tlen, m->len);
+        lua_pushinteger(L, NET_ERR_OK);
+        free(m);
+        return 3;
+    }
+
+    if (got) {
+        state = MQTT_STATE_LOST;
+    } else {
+        mqtt_lock(c);
+        state = c->state;
+        mqtt_unlock(c);
+    }
+
+    lua_pushnil(L);
+    lua_pushnil(L);
+    lua_pushinteger(L, (state == MQTT_STATE_CONNECTED) ? NET_ERR_TIMEDOUT : NET_ERR_CLOSED);
+    return 3;
+}
+
+static int mqtt_recv_k(lua_State *L, int status, lua_KContext ctx) {
+    mqtt_client *c = mqtt_check(L, 1);
+    mqtt_msg *m = NULL;
+    int got = xQueueReceive(c->inbox, &m, 0) == pdTRUE;
+
+    return mqtt_recv_result(L, c, m, got);
+}
+
+// Lua: topic, payload, err = c:recv([timeout ms])
+static int mqtt_recv(lua_State *L) {
+    mqtt_client *c = mqtt_check(L, 1);
+    int timeout = luaL_optinteger(L, 2, -1);
+    mqtt_msg *m = NULL;
+    int state, got;
+
+    mqtt_lock(c);
+    state = c->state;
+    mqtt_unlock(c);
+
+    // Nothing comes when not connected, but what is already there
+    if ((state != MQTT_STATE_CONNECTED) || (timeout == 0) || uxQueueMessagesWaiting(c->inbox)) {
+        return mqtt_recv_k(L, LUA_OK, 0);
+    }
+
+    if (thread_is_green(L)) {
+        return thread_yield_wait(L, THREAD_WAIT_QUEUE, c->inbox, (timeout > 0) ? (uint64_t)timeout * 1000 : 0, 0, mqtt_recv_k);
+    }
+
+    got = xQueueReceive(c->inbox, &m, (timeout > 0) ? timeout / portTICK_PERIOD_MS : portMAX_DELAY) == pdTRUE;
+
+    return mqtt_recv_result(L, c, m, got);
+}
+
+// Returns 1 when all is written and acknowledged, or the connection is
+// gone
+static int mqtt_flushed(mqtt_client *c) {
+    int done;
+
+    mqtt_lock(c);
+    done = (c->state != MQTT_STATE_CONNECTED) ||
+           (!c->out_len && (c->tx_off == c->tx_len) && !c->n_inflight);
+    mqtt_unlock(c);
+
+    return done;
+}
+
+static int mqtt_flush_k(lua_State *L, int status, lua_KContext ctx) {
+    mqtt_client *c = mqtt_check(L, 1);
+    int timeout = luaL_optinteger(L, 2, -1);
+    int32_t left = (int32_t)((uint32_t)ctx - (uint32_t)(clock_monotonic_us() / 1000));
+
+    if (!mqtt_flushed(c) && ((timeout < 0) || (left > 0))) {
+        if ((timeout < 0) || (left > MQTT_POLL_MS)) {
+            left = MQTT_POLL_MS;
+        }
+        return thread_yield_wait(L, THREAD_WAIT_SLEEP, NULL, (uint64_t)left * 1000, ctx, mqtt_flush_k);
+    }
+
+    lua_pushboolean(L, mqtt_flushed(c));
+    return 1;
+}
+
+// Lua: done = c:flush([timeout ms])
+static int mqtt_flush(lua_State *L) {
+    mqtt_client *c = mqtt_check(L, 1);
+    int timeout = luaL_optinteger(L, 2, -1);
+    uint64_t end = clock_monotonic_us() / 1000 + timeout;
+
+    if (thread_is_green(L)) {
+        return mqtt_flush_k(L, LUA_OK, (lua_KContext)(uint32_t)end);
+    }
+
+    while (!mqtt_flushed(c) && ((timeout < 0) || (clock_monotonic_us() / 1000 < end))) {
+        vTaskDelay(MQTT_POLL_MS / portTICK_PERIOD_MS);
+    }
+
+    lua_pushboolean(L, mqtt_flushed(c));
+    return 1;
+}
+
+#define mqtt_field(L, name, v) \
+    lua_pushinteger(L, v); \
+    lua_setfield(L, -2, name)
+
+// Lua: stats = c:stats()
+static int mqtt_stats_get(lua_State *L) {
+    mqtt_client *c = mqtt_check(L, 1);
+    mqtt_stats st;
+    int state, inflight;
+    uint32_t depth, queued;
+
+    mqtt_lock(c);
+    st = c->st;
+    state = c->state;
+    inflight = c->n_inflight;
+    depth = c->out_pkts + c->tx_pkts;
+    queued = c->out_len + c->tx_len - c->tx_off;
+    mqtt_unlock(c);
+
+    lua_createtable(L, 0, 20);
+
+    lua_pushboolean(L, state == MQTT_STATE_CONNECTED);
+    lua_setfield(L, -2, "connected");
+
+    mqtt_field(L, "depth", depth);
+    mqtt_field(L, "queued", queued);
+    mqtt_field(L, "inflight", inflight);
+    mqtt_field(L, "inbox", uxQueueMessagesWaiting(c->inbox));
+    mqtt_field(L, "max_depth", st.max_depth);
+    mqtt_field(L, "max_inflight", st.max_inflight);
+    mqtt_field(L, "published", st.published);
+    mqtt_field(L, "acked", st.acked);
+    mqtt_field(L, "refused", st.refused);
+    mqtt_field(L, "sent", st.sent);
+    mqtt_field(L, "writes", st.writes);
+    mqtt_field(L, "bytes", st.bytes);
+    mqtt_field(L, "received", st.received);
+    mqtt_field(L, "dropped", st.dropped);
+    mqtt_field(L, "pings", st.pings);
+    mqtt_field(L, "latency", st.acked ? (lua_Integer)(st.lat_sum / st.acked) : 0);
+    mqtt_field(L, "latency_max", st.lat_max);
+    mqtt_field(L, "delay_max", st.delay_max);
+
+    return 1;
+}
+
+// Lua: c:close()
+static int mqtt_close(lua_State *L) {
+    mqtt_client *c = mqtt_check(L, 1);
+
+    mqtt_lock(c);
+    if (c->task && !c->quit) {
+        c->quit = 1;
+    }
+    if (!c->task) {
+        c->state = MQTT_STATE_CLOSED;
+    }
+    mqtt_unlock(c);
+
+    return 0;
+}
+
+static int mqtt_gc(lua_State *L) {
+    mqtt_userdata *u = (mqtt_userdata *)luaL_checkudata(L, 1, MQTT_USERDATA);
+    mqtt_client *c = u->c;
+    int task;
+
+    if (!c) {
+        return 0;
+    }
+    u->c = NULL;
+
+    // A running task frees the client when it ends
+    mqtt_lock(c);
+    task = c->task;
+    if (task) {
+        c->collected = 1;
+        if (!c->quit) {
+            c->quit = 1;
+        }
+    }
+    mqtt_unlock(c);
+
+    if (!task) {
+        mqtt_free(c);
+    }
+
+    return 0;
+}
+
+static int mqtt_tostring(lua_State *L) {
+    mqtt_userdata *u = (mqtt_userdata *)luaL_checkudata(L, 1, MQTT_USERDATA);
+
+    if (u->c) {
+        lua_pushfstring(L, "mqtt client (%s)", u->c->id);
+    } else {
+        lua_pushliteral(L, "mqtt client (closed)");
+    }
+    return 1;
+}
+
+
+#include "modules.h"
+
+static const LUA_REG_TYPE mqtt_client_map[] = {
+    { LSTRKEY( "lwt" ),			LFUNCVAL( mqtt_lwt )},
+    { LSTRKEY( "connect" ),		LFUNCVAL( mqtt_connect )},
+    { LSTRKEY( "publish" ),		LFUNCVAL( mqtt_publish )},
+    { LSTRKEY( "subscribe" ),	LFUNCVAL( mqtt_subscribe )},
+    { LSTRKEY( "unsubscribe" ),	LFUNCVAL( mqtt_unsubscribe )},
+    { LSTRKEY( "recv" ),		LFUNCVAL( mqtt_recv )},
+    { LSTRKEY( "flush" ),		LFUNCVAL( mqtt_flush )},
+    { LSTRKEY( "stats" ),		LFUNCVAL( mqtt_stats_get )},
+    { LSTRKEY( "close" ),		LFUNCVAL( mqtt_close )},
+    { LSTRKEY( "__index" ),		LROVAL( mqtt_client_map )},
+    { LSTRKEY( "__gc" ),		LFUNCVAL( mqtt_gc )},
+    { LSTRKEY( "__tostring" ),	LFUNCVAL( mqtt_tostring )},
+    { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE mqtt_map[] = {
+    { LSTRKEY( "client" ),			LFUNCVAL( mqtt_client_new )},
+    { LSTRKEY( "ERR_OK" ),			LINTVAL( NET_ERR_OK )},
+    { LSTRKEY( "ERR_TIMEDOUT" ),	LINTVAL( NET_ERR_TIMEDOUT )},
+    { LSTRKEY( "ERR_CLOSED" ),		LINTVAL( NET_ERR_CLOSED )},
+    { LSTRKEY( "ERR_REFUSED" ),		LINTVAL( NET_ERR_ABORTED )},
+    { LSTRKEY( "ERR_OVERFLOW" ),	LINTVAL( NET_ERR_OVERFLOW )},
+    { LSTRKEY( "ERR_OTHER" ),		LINTVAL( NET_ERR_OTHER )},
+    { LNILKEY, LNILVAL }
+};
+
+int luaopen_mqtt( lua_State *L ) {
+    luaL_newmetarotable(L, MQTT_USERDATA, (void *)mqtt_client_map);
+    lua_pop(L, 1);
+    return 0;
+}
+
+MODULE_REGISTER_MAPPED(MQTT, mqtt, mqtt_map, luaopen_mqtt);
+
+#endif
@@ -62,6 +62,8 @@
 
 #include <httpd/httpd.h>
 
+#include "sock.h"
+
 
 typedef uint32_t u32;
 typedef uint16_t u16;
@@ -77,212 +79,15 @@ int platform_net_start(const char *interface);
 int platform_net_stop(const char *interface);
 int platform_net_sntp_start();
 
-typedef s16 net_size;
-
-enum {
-  NET_ERR_OK = 0,
-  NET_ERR_TIMEDOUT,
-  NET_ERR_CLOSED,
-  NET_ERR_ABORTED,
-  NET_ERR_OVERFLOW,
-  NET_ERR_OTHER,
-};
-
 typedef union {
   u32     ipaddr;
   u8      ipbytes[ 4 ];
   u16     ipwords[ 2 ];
 } net_ip;
 
-#define NET_SOCK_STREAM          0
-#define NET_SOCK_DGRAM           1
 #define NET_DHCP                 2
 #define NET_STATIC               3
 
-static int errno_to_err() {
-    switch (errno) {
-        case 0: return NET_ERR_OK;
-        case EWOULDBLOCK: return NET_ERR_TIMEDOUT;
-        case ECONNABORTED: return NET_ERR_ABORTED;
-        case ENOTCONN: return NET_ERR_CLOSED;
-        default:
-            return NET_ERR_OTHER;
-    }
-}
-
-static int net_accept( lua_State *L ) {
-    int newsockfd;
-    int ret = NET_ERR_OK;
-    int clilen;
-    
-    struct sockaddr_in serv_addr, cli_addr;
-
-    u16 sock = ( u16 )luaL_checkinteger( L, 1 );
-    u16 port = ( u16 )luaL_checkinteger( L, 2 );
-    u16 timeout = ( u16 )luaL_checkinteger( L, 3 );
-    
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-   
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(port);
-   
-     // Get socket type
-    int type;
-    int length = sizeof( int );
-    
-    if ((ret = getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &length)) < 0) {
-        ret = errno_to_err();
-        goto exit;
-    }
-    
-    if (bind(sock, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
-         ret = errno_to_err();
-         goto exit;
-    }
-      
-    if (type == SOCK_STREAM) {
-        listen(sock,5);
-        clilen = sizeof(cli_addr);
-    }
-    
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof(timeout));
-
-    if (type == SOCK_STREAM) {
-        newsockfd = accept(sock, (struct sockaddr *)&cli_addr, &clilen);
-        if (newsockfd < 0) {
-             ret = errno_to_err();
-             goto exit;
-        }
-    }
-exit:
-    lua_pushinteger( L, newsockfd );
-    lua_pushinteger( L, cli_addr.sin_addr.s_addr );
-    lua_pushinteger( L, ret );
-
-    return 3;
-}
-
-// Lua: sock = socket( type )
-static int net_socket( lua_State *L ) {
-    int type = ( int )luaL_checkinteger( L, 1 );
-
-    int socket_fd = 0;
-
-    switch (type) {
-        case NET_SOCK_DGRAM:
-            socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
-            break;
-
-        case NET_SOCK_STREAM:
-            socket_fd = socket(AF_INET, SOCK_STREAM, 0);
-            break;
-    }
-
-    lua_pushinteger( L, socket_fd );
-    return 1;
-}
-
-// Lua: res = close( socket )
-static int net_close(lua_State* L) {
-  int sock = ( int )luaL_checkinteger( L, 1 );
-  int ret = NET_ERR_OK;
-  
-  if (closesocket(sock) < 0) {
-      ret = errno_to_err();
-  }
-  
-  lua_pushinteger( L, ret );
-  return 1;
-}
-
-// Lua: res, err = send( sock, str )
-static int net_send(lua_State* L) {
-    int sock = ( int )luaL_checkinteger( L, 1 );
-    const char *buf;
-    size_t siz,sended = 0;
-    int ret = NET_ERR_OK;
-
-    if (lua_type( L, 2) == LUA_TSTRING) {
-        buf = luaL_checklstring( L, 2, &siz );
-    } else {
-        return luaL_error( L, "Unsupported data type for send" );    
-    }
-    
-    // Get socket type
-    int type;
-    int length = sizeof( int );
-    
-    if ((ret = getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &length)) < 0) {
-        ret = errno_to_err();
-    } else {
-        if (type == SOCK_STREAM) {
-            // TPC
-            if ((sended = send(sock, buf, siz, 0)) < 0) {
-                ret = errno_to_err();
-                sended = 0;
-            }       
-        } else {
-            // UDP
-            struct sockaddr addr;
-            size_t len;
-            
-            // GET ip of client
-            len = sizeof(struct sockaddr);
-            getpeername(sock, &addr, &len);
-
-            // Send
-            if ((sended = sendto(sock, buf, siz, 0, &addr, len)) < 0) {
-                ret = errno_to_err();
-                sended = 0;
-            }       
-        }
-    }
-    
-    lua_pushinteger( L, sended );
-    lua_pushinteger( L, ret );
-    
-    return 2;  
-}
-
-// Lua: err = connect( sock, iptype, port )
-// "iptype" is actually an int returned by "net.packip"
-static int net_connect( lua_State *L ) { 
-    unsigned int ip;
-    int rc = 0;
-    struct sockaddr_in address;
-    int ret = NET_ERR_OK;
-  
-    int sock = ( int )luaL_checkinteger( L, 1 );
-    u16 port = ( int )luaL_checkinteger( L, 3 );
-    ip = ( u32 )luaL_checkinteger( L, 2 );
- 
-    address.sin_port = htons(port);
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = ip;
-        
-    // Get socket type
-    int type;
-    int length = sizeof( int );
-    
-    if ((ret = getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &length)) < 0) {
-        ret = errno_to_err();
-    } else {
-        if (type == SOCK_STREAM) {
-            rc = connect(sock, (struct sockaddr*)&address, sizeof(address));
-            if (rc < 0) {
-                ret = errno_to_err();
-            }            
-        } else {
-            ret = NET_ERR_OK;
-        }
-    }   
- 
-    lua_pushinteger( L, ret );
-    
-    return 1;  
-}
-
 // Lua: data = packip( ip0, ip1, ip2, ip3 ), or
 // Lua: data = packip( "ip" )
 // Returns an internal representation for the given IP address
@@ -343,69 +148,6 @@ static int net_unpackip( lua_State *L )
     return luaL_error( L, "invalid format" );                                      
 }
 
-// Lua: res, err = recv( sock, maxsize, [timer_id, timeout] ) or
-//      res, err = recv( sock, "*l", [timer_id, timeout] )
-static int net_recv( lua_State *L ) {
-    int sock = ( int )luaL_checkinteger( L, 1 );
-    int maxsize;
-    int ret = NET_ERR_OK;
-    luaL_Buffer net_recv_buff;
-    int received = 0;
-    int string = 0;
-    int n;
-    char c;
-    
-    if( lua_isnumber( L, 2 ) ) {
-        maxsize = ( net_size )luaL_checkinteger( L, 2 );
-    } else {
-        if( strcmp( luaL_checkstring( L, 2 ), "*l" ) )
-            return luaL_error( L, "invalid second argument to recv" );
-      
-        string = 1;
-        maxsize = BUFSIZ;
-    }
-    
-    luaL_buffinit( L, &net_recv_buff );
-
-    // Get socket type
-    int type;
-    int length = sizeof( int );
-    
-    if ((ret = getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &length)) < 0) {
-        ret = errno_to_err();
-    } else {
-        if (type == SOCK_STREAM) {
-            // TPC
-            if (string){
-                received = 0;
-                while (((n = recv(sock, &c, 1, 0)) > 0) && (received < maxsize)) {
-                    *((char *)net_recv_buff.b) = c;
-                    net_recv_buff.b++;
-                    net_recv_buff.n++;
-                    received++;
-                    
-                    if (c == '\n') break;
-                }
-                
-                net_recv_buff.b = &net_recv_buff.initb[0];
-            } else {
-                if ((received = recv(sock, net_recv_buff.b, maxsize, 0)) < 0) {
-                    ret = errno_to_err();
-                    received = 0;
-                }                       
-            }
-        } else {
-            // UDP
-        }
-    }
-    
-    luaL_pushresult( &net_recv_buff );
-    lua_pushinteger( L, ret );
-
-    return 2;
-}
-
-
 // Lua: iptype = lookup( "host name" )
 static int net_lookup(lua_State* L) {
   const char* name = luaL_checkstring( L, 1 );
@@ -908,24 +650,6 @@ static int net_scan_aps (lua_State* L) {
 
 #include "modules.h"
 
-const LUA_REG_TYPE sock_map[] = {
-//	{ LSTRKEY( "setup" ),		LFUNCVAL( net_setup ) },
-//    { LSTRKEY( "sntp" ),		LFUNCVAL( net_sntp )},
-//    { LSTRKEY( "start" ),		LFUNCVAL( net_start )},
-//    { LSTRKEY( "stop" ),		LFUNCVAL( net_stop )},
-//    { LSTRKEY( "stat" ),		LFUNCVAL( net_stat )},
-    { LSTRKEY( "accept" ),		LFUNCVAL( net_accept )},
-//    { LSTRKEY( "packip" ),		LFUNCVAL( net_packip )},
-//    { LSTRKEY( "unpackip" ),	LFUNCVAL( net_unpackip )},
-    { LSTRKEY( "connect" ),		LFUNCVAL( net_connect )},
-    { LSTRKEY( "socket" ),		LFUNCVAL( net_socket )},
-    { LSTRKEY( "close" ),		LFUNCVAL( net_close )},
-    { LSTRKEY( "send" ),		LFUNCVAL( net_send )},
-    { LSTRKEY( "recv" ),		LFUNCVAL( net_recv )},
-//    { LSTRKEY( "lookup" ),		LFUNCVAL( net_lookup )},
-	{ LNILKEY, LNILVAL }
-};
-
 const LUA_REG_TYPE net_map[] = {
 	    { LSTRKEY( "ap" ),		LFUNCVAL( net_ap )},
 		{ LSTRKEY( "sta" ),		LFUNCVAL( net_setup ) },
@@ -937,6 +661,15 @@ const LUA_REG_TYPE net_map[] = {
 		{ LSTRKEY( "packip" ),		LFUNCVAL( net_packip )},
 		{ LSTRKEY( "unpackip" ),	LFUNCVAL( net_unpackip )},
 		{ LSTRKEY( "localip" ),		LFUNCVAL( net_get_local_ip )},
+		{ LSTRKEY( "poll" ),		LFUNCVAL( sock_poll )},
+
+		// The socket functions, also in the sock module
+		{ LSTRKEY( "socket" ),		LFUNCVAL( sock_socket )},
+		{ LSTRKEY( "accept" ),		LFUNCVAL( sock_accept )},
+		{ LSTRKEY( "connect" ),		LFUNCVAL( sock_connect )},
+		{ LSTRKEY( "send" ),		LFUNCVAL( sock_send )},
+		{ LSTRKEY( "recv" ),		LFUNCVAL( sock_recv )},
+		{ LSTRKEY( "close" ),		LFUNCVAL( sock_close )},
 
 		{ LSTRKEY( "SOCK_STREAM" ),	LINTVAL( NET_SOCK_STREAM )},
 		{ LSTRKEY( "SOCK_DGRAM" ),	LINTVAL( NET_SOCK_DGRAM )},
@@ -1006,7 +739,6 @@ int luaopen_net( lua_State *L ) {
 
 
 
-MODULE_REGISTER_MAPPED(SOCK, sock, sock_map, luaopen_net);
 MODULE_REGISTER_MAPPED(NET, net, net_map, luaopen_net);
 
 #endif
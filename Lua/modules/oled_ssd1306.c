@@ -4,13 +4,17 @@
 #include "lauxlib.h"
 #include "lmem.h"
 
+#include <string.h>
+
 #include "ssd1306_2/ssd1306.h"
+#include "ssd1306_2/sprite.h"
 
 #include <drivers/i2c-platform.h>
 
 #include <wdt_regs.h>
 
 #include <fonts/fonts.h>
+#include <fonts/font_file.h>
 
 
 typedef uint8_t u8g_uint_t;
@@ -26,6 +30,8 @@ typedef int8_t u8g_int_t;
 font_info_t *font = NULL; // current font
 font_face_t font_face = 0;
 
+static font_info_t *path_font = NULL; // loaded by oled.setFont( path )
+
 static ssd1306_color_t foreground = OLED_COLOR_WHITE;
 static ssd1306_color_t background = OLED_COLOR_BLACK;
 
@@ -83,12 +89,33 @@ int ldisp_cls( lua_State *L )
     return 1;
 }
 
-// Lua: oled.setFont( font_num )
+// Lua: oled.setFont( font_num ) or oled.setFont( path [, cache_bytes] )
 static int ldisp_setFont( lua_State *L )
 {
+	if(lua_type( L, 1) == LUA_TSTRING){
+		font_info_t *f;
+		int err;
+
+		f = font_file_open(lua_tostring( L, 1), luaL_optinteger( L, 2, 0), &err);
+		if(f == NULL){
+			lua_pushnil(L);
+			lua_pushstring(L, strerror(err));
+			return 2;
+		}
+		font_file_close(path_font);
+		path_font = font = f;
+		font_face = font_builtin_fonts_count;
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
 	int i = luaL_checkinteger( L, 1);
-	if(i >= 0 && i < font_builtin_fonts_count){
-		font = font_builtin_fonts[i];
+	const font_info_t *f = NULL;
+
+	if(i >= 0)
+		f = font_get(i);
+	if(f){
+		font = (font_info_t *)f;
 		font_face = i;
 		lua_pushinteger(L, i);
 	}else{
@@ -100,28 +127,38 @@ static int ldisp_setFont( lua_State *L )
 
 static int ldisp_getFontInfo( lua_State *L )
 {
-/*
-	int i = luaL_checkinteger( L, 1);
-	if(i >= 0 && i < font_builtin_fonts_count){
-		font = font_builtin_fonts[i];
-		font_face = i;
-		lua_pushinteger(L, i);
-	}else{
-		lua_pushinteger(L, font_builtin_fonts_count);
-	}
-*/
 	if(lua_gettop( L)==0){
 		lua_pushinteger(L, font_face);
-		lua_pushinteger(L, font->height);
+		lua_pushinteger(L, font ? font->height : 0);
 	}else{
 		int i = luaL_checkinteger( L, 1);
+		const font_info_t *f = i >= 0 ? font_get(i) : NULL;
+
 		lua_pushinteger(L, i);
-		lua_pushinteger(L, font_builtin_fonts[i]->height);
+		lua_pushinteger(L, f ? f->height : 0);
 	}
 
     return 2;
 }
 
+// Lua: hits, misses, evictions, bytes_read, slots, cache_bytes = oled.fontStats( [reset] )
+static int ldisp_fontStats( lua_State *L )
+{
+	font_file_stats_t st;
+
+	if(font == NULL || font->file == NULL)
+		return 0;
+
+	font_file_get_stats(font, &st, lua_toboolean( L, 1));
+	lua_pushinteger(L, st.hits);
+	lua_pushinteger(L, st.misses);
+	lua_pushinteger(L, st.evictions);
+	lua_pushinteger(L, st.read);
+	lua_pushinteger(L, st.slots);
+	lua_pushinteger(L, st.cache);
+    return 6;
+}
+
 
 // Lua: u8g.setDefaultBackgroundColor( self )
 static int ldisp_setDefaultBackgroundColor( lua_State *L )
@@ -490,6 +527,49 @@ static int ldisp_drawBitmap( lua_State *L )
     return 1;
 }
 
+// Lua: w, h = oled.sprite( x, y, atlas_file, n [, fg_color [, bg_color]] )
+// draws sprite n of an atlas (see ssd1306_2/sprite.h) into the screen buffer, shown by the next oled.draw()
+static int ldisp_drawSprite( lua_State *L )
+{
+    int args[2];
+    ldisp_get_int_args( L, 1, 2, args );
+
+    const char *name = luaL_checkstring( L, 1+2 );
+    int n = luaL_checkinteger( L, 1+3 );
+
+    sprite_atlas_t *a = sprite_atlas(name);
+    if (a == NULL)
+        return 0;
+
+    const sprite_t *s = sprite_get(a, n - 1);
+    luaL_argcheck( L, s != NULL, 1+3, "no such sprite" );
+
+    sprite_draw(a, n - 1, ssd1306_buffer, args[0], args[1],
+                luaL_optinteger( L, 5, foreground),
+                luaL_optinteger( L, 6, OLED_COLOR_TRANSPARENT)
+                );
+
+    lua_pushinteger(L, s->w);
+    lua_pushinteger(L, s->h);
+    return 2;
+}
+
+// Lua: count = oled.sprites( atlas_file ) loads an atlas, oled.sprites() forgets them all
+static int ldisp_sprites( lua_State *L )
+{
+    if (lua_isnoneornil( L, 1 )) {
+        sprite_flush();
+        return 0;
+    }
+
+    sprite_atlas_t *a = sprite_atlas( luaL_checkstring( L, 1 ) );
+    if (a == NULL)
+        return 0;
+
+    lua_pushinteger(L, sprite_count(a));
+    return 1;
+}
+
 //
 //
 //
@@ -581,6 +661,8 @@ static const LUA_REG_TYPE ldisplay_map[] = {
   { LSTRKEY( "triangle" ),                 LFUNCVAL( ldisp_drawTriangle ) },
   { LSTRKEY( "vline" ),                    LFUNCVAL( ldisp_drawVLine ) },
   { LSTRKEY( "PBM" ),						LFUNCVAL( ldisp_drawPBM ) },
+  { LSTRKEY( "sprite" ),					LFUNCVAL( ldisp_drawSprite ) },
+  { LSTRKEY( "sprites" ),					LFUNCVAL( ldisp_sprites ) },
 
   { LSTRKEY( "setContrast" ),				LFUNCVAL( ldisp_setContrast ) },
   { LSTRKEY( "setColorIndex" ),				LFUNCVAL( ldisp_setColorIndex ) },
@@ -588,6 +670,7 @@ static const LUA_REG_TYPE ldisplay_map[] = {
   { LSTRKEY( "setDefFgClr" ),				LFUNCVAL( ldisp_setDefaultForegroundColor ) },
   { LSTRKEY( "setFont" ),					LFUNCVAL( ldisp_setFont ) },
   { LSTRKEY( "getFontInfo" ), 				LFUNCVAL( ldisp_getFontInfo ) },
+  { LSTRKEY( "fontStats" ), 				LFUNCVAL( ldisp_fontStats ) },
 //  { LSTRKEY( "__gc" ),                         LFUNCVAL( lu8g_close_display ) },
   { LSTRKEY( "__index" ),                      LROVAL( ldisplay_map ) },
   { LNILKEY, LNILVAL }
@@ -598,7 +681,9 @@ int luaopen_disp( lua_State *L ) {
   ssd1306_init(ADDR);
   
   ssd1306_set_whole_display_lighting(ADDR, true);
-  font = font_builtin_fonts[font_face];
+  font = (font_info_t *)font_get(font_face);
+  if(font == NULL)
+	  font = (font_info_t *)font_get(FONT_FACE_GLCD5x7);
 
   int i;
   for(i=0; i<(DISPLAY_WIDTH * DISPLAY_HEIGHT/8); i++)
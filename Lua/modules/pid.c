@@ -0,0 +1,273 @@
+/*
+ * bhgv, pid Lua module
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Loops stepped in fixed point by a timer, see modules/pid/pidq.c. Lua
+ * only tunes them and reads their state, a loop reads its input from the
+ * acquisition (adc.acq.start first) and writes its output to a PCA9685
+ * channel by itself.
+ *
+ *   id = pid.add{kp = 2, ki = 0.5, [kd = 0], [tf = 0], [min = 0], [max = 4095],
+ *                [setpoint = 0], [period = 100], [input = 0], [pwm = 0],
+ *                [reverse = false], [antiwindup = true]}
+ *   pid.tune(id, {setpoint = 120, ...})   the fields given change
+ *   pid.enable(id, [on])                  added disabled
+ *   pid.input(id, v)                      without input channel
+ *   pid.output(id, v)                     when disabled
+ *   st = pid.state(id)
+ *   st = pid.stats([reset])
+ *   pid.remove(id)
+ *
+ * ki is in 1/s, kd and tf in s, period in ms. input is a channel of adc.acq
+ * (0..3, adc.Int), pwm a channel of the PCA9685 (0..15), the output is
+ * rounded to 0..4095 for it. The values must stay within +-32767.
+ */
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "modules.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "sys/drivers/acq.h"
+
+#include <pid/pidq.h>
+
+#define PID_ADC_INT -3
+
+// The field name of the table at index, or v
+static float get_number(lua_State *L, int index, const char *name, float v) {
+	lua_getfield(L, index, name);
+	v = luaL_optnumber(L, -1, v);
+	lua_pop(L, 1);
+	return v;
+}
+
+static int get_boolean(lua_State *L, int index, const char *name, int v) {
+	lua_getfield(L, index, name);
+	if (!lua_isnil(L, -1)) {
+		v = lua_toboolean(L, -1);
+	}
+	lua_pop(L, 1);
+	return v;
+}
+
+// The fields of the table at index over cfg
+static void get_config(lua_State *L, int index, pidq_config_t *cfg) {
+	int ch, v;
+
+	luaL_checktype(L, index, LUA_TTABLE);
+
+	cfg->kp = get_number(L, index, "kp", cfg->kp);
+	cfg->ki = get_number(L, index, "ki", cfg->ki);
+	cfg->kd = get_number(L, index, "kd", cfg->kd);
+	cfg->tf = get_number(L, index, "tf", cfg->tf);
+	cfg->min = get_number(L, index, "min", cfg->min);
+	cfg->max = get_number(L, index, "max", cfg->max);
+	cfg->setpoint = get_number(L, index, "setpoint", cfg->setpoint);
+
+	lua_getfield(L, index, "period");
+	v = luaL_optinteger(L, -1, cfg->period_ms);
+	luaL_argcheck(L, (v > 0) && (v <= 0xffff), index, "invalid period");
+	cfg->period_ms = v;
+	lua_getfield(L, index, "pwm");
+	v = luaL_optinteger(L, -1, cfg->pwm);
+	luaL_argcheck(L, (v >= PIDQ_NO_PWM) && (v <= 15), index, "invalid pwm");
+	cfg->pwm = v;
+	lua_pop(L, 2);
+
+	cfg->reverse = get_boolean(L, index, "reverse", cfg->reverse);
+	cfg->antiwindup = get_boolean(L, index, "antiwindup", cfg->antiwindup);
+
+	lua_getfield(L, index, "input");
+	if (!lua_isnil(L, -1)) {
+		ch = luaL_checkinteger(L, -1);
+		if (ch == PID_ADC_INT) {
+			ch = ACQ_INT;
+		} else if ((ch < 0) || (ch >= ACQ_INT)) {
+			luaL_error(L, "invalid input %d", ch);
+		}
+		cfg->input = ch;
+	}
+	lua_pop(L, 1);
+}
+
+static q16_t check_value(lua_State *L, int index) {
+	float v = luaL_checknumber(L, index);
+
+	luaL_argcheck(L, (v >= -32767) && (v <= 32767), index, "out of +-32767");
+	return Q16(v);
+}
+
+static int check_id(lua_State *L, int index) {
+	pidq_config_t cfg;
+	int id = luaL_checkinteger(L, index);
+
+	if (pidq_get_config(id, &cfg)) {
+		return luaL_error(L, "invalid loop %d", id);
+	}
+
+	return id;
+}
+
+// Lua: id = pid.add{...}
+static int lpid_add(lua_State *L) {
+	pidq_config_t cfg;
+	int id;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.max = 4095;
+	cfg.period_ms = 100;
+	cfg.input = PIDQ_NO_INPUT;
+	cfg.pwm = PIDQ_NO_PWM;
+	cfg.antiwindup = 1;
+
+	get_config(L, 1, &cfg);
+
+	switch (pidq_add(&cfg, &id)) {
+		case 0:
+			break;
+		case EINVAL:
+			return luaL_error(L, "invalid gains, limits, period, input or pwm");
+		case EBUSY:
+			return luaL_error(L, "%d loops at most", PIDQ_LOOPS);
+		default:
+			return luaL_error(L, "can't start the scheduler");
+	}
+
+	lua_pushinteger(L, id);
+	return 1;
+}
+
+// Lua: pid.tune(id, {...})
+static int lpid_tune(lua_State *L) {
+	int id = check_id(L, 1);
+	pidq_config_t cfg;
+
+	pidq_get_config(id, &cfg);
+	get_config(L, 2, &cfg);
+
+	if (pidq_tune(id, &cfg)) {
+		return luaL_error(L, "invalid gains, limits, period, input or pwm");
+	}
+
+	return 0;
+}
+
+// Lua: pid.enable(id, [on])
+static int lpid_enable(lua_State *L) {
+	int id = check_id(L, 1);
+
+	pidq_enable(id, lua_isnoneornil(L, 2) || lua_toboolean(L, 2));
+	return 0;
+}
+
+// Lua: pid.input(id, v)
+static int lpid_input(lua_State *L) {
+	int id = check_id(L, 1);
+
+	if (pidq_input(id, check_value(L, 2))) {
+		return luaL_error(L, "the loop has an input channel");
+	}
+
+	return 0;
+}
+
+// Lua: pid.output(id, v)
+static int lpid_output(lua_State *L) {
+	int id = check_id(L, 1);
+
+	if (pidq_output(id, check_value(L, 2))) {
+		return luaL_error(L, "the loop is enabled");
+	}
+
+	return 0;
+}
+
+// Lua: st = pid.state(id)
+static int lpid_state(lua_State *L) {
+	int id = check_id(L, 1);
+	pidq_state_t st;
+
+	pidq_get_state(id, &st);
+
+	lua_createtable(L, 0, 8);
+	lua_pushnumber(L, Q16_TO_F(st.input));
+	lua_setfield(L, -2, "input");
+	lua_pushnumber(L, Q16_TO_F(st.output));
+	lua_setfield(L, -2, "output");
+	lua_pushnumber(L, Q16_TO_F(st.setpoint));
+	lua_setfield(L, -2, "setpoint");
+	lua_pushnumber(L, Q16_TO_F(st.iterm));
+	lua_setfield(L, -2, "iterm");
+	lua_pushnumber(L, Q16_TO_F(st.dterm));
+	lua_setfield(L, -2, "dterm");
+	lua_pushinteger(L, st.runs);
+	lua_setfield(L, -2, "runs");
+	lua_pushinteger(L, st.saturated);
+	lua_setfield(L, -2, "saturated");
+	lua_pushboolean(L, st.enabled);
+	lua_setfield(L, -2, "enabled");
+
+	return 1;
+}
+
+// Lua: st = pid.stats([reset])
+static int lpid_stats(lua_State *L) {
+	pidq_stats_t st;
+
+	pidq_get_stats(&st, lua_toboolean(L, 1));
+
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, st.loops);
+	lua_setfield(L, -2, "loops");
+	lua_pushinteger(L, st.ticks);
+	lua_setfield(L, -2, "ticks");
+	lua_pushinteger(L, st.runs);
+	lua_setfield(L, -2, "runs");
+	lua_pushinteger(L, st.step_us);
+	lua_setfield(L, -2, "step_us");
+	lua_pushinteger(L, st.step_max);
+	lua_setfield(L, -2, "step_max");
+	lua_pushinteger(L, st.pwm_writes);
+	lua_setfield(L, -2, "pwm_writes");
+
+	return 1;
+}
+
+// Lua: pid.remove(id)
+static int lpid_remove(lua_State *L) {
+	pidq_remove(check_id(L, 1));
+	return 0;
+}
+
+static const LUA_REG_TYPE pid_map[] = {
+	{ LSTRKEY( "add"    ),		LFUNCVAL( lpid_add    ) },
+	{ LSTRKEY( "tune"   ),		LFUNCVAL( lpid_tune   ) },
+	{ LSTRKEY( "enable" ),		LFUNCVAL( lpid_enable ) },
+	{ LSTRKEY( "input"  ),		LFUNCVAL( lpid_input  ) },
+	{ LSTRKEY( "output" ),		LFUNCVAL( lpid_output ) },
+	{ LSTRKEY( "state"  ),		LFUNCVAL( lpid_state  ) },
+	{ LSTRKEY( "stats"  ),		LFUNCVAL( lpid_stats  ) },
+	{ LSTRKEY( "remove" ),		LFUNCVAL( lpid_remove ) },
+	{ LNILKEY, LNILVAL }
+};
+
+LUALIB_API int luaopen_pid(lua_State *L) {
+#if !LUA_USE_ROTABLE
+	luaL_newlib(L, pid_map);
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+MODULE_REGISTER_MAPPED(PID, pid, pid_map, luaopen_pid);
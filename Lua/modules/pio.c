@@ -14,6 +14,9 @@
 
 #include "sys/drivers/cpu.h"
 #include "sys/drivers/gpio.h"
+#include "sys/drivers/capture.h"
+
+#include <errno.h>
 
 // PIO public constants
 #define PIO_DIR_OUTPUT      0
@@ -23,6 +26,9 @@
 #define PIO_PORT_OP         0
 #define PIO_PIN_OP          1
 
+// Edges taken out of a capture ring at once
+#define PIO_CAPTURE_READ    32
+
 // Helper functions
 static pio_type pio_op(unsigned port, pio_type pinmask, int op) {
 	switch (op) {
@@ -346,6 +352,122 @@ static int pio_decode(lua_State *L) {
 	return 2;
 }
 
+// Capture of the edges of a pin, see sys/drivers/capture.c
+static int pio_capture_pin(lua_State *L) {
+	int v = luaL_checkinteger(L, 1);
+
+	if (!cpu_has_gpio(cpu_port_number(v), cpu_pin_number(v))) {
+		return luaL_error(L, "invalid pin");
+	}
+
+	return cpu_pin_number(v);
+}
+
+// Lua: pio.capture.start(pin, [edges], [size])
+static int pio_capture_start(lua_State *L) {
+	int pin = pio_capture_pin(L);
+	int edges = luaL_optinteger(L, 2, CAPTURE_RISING);
+	int size = luaL_optinteger(L, 3, 0);
+
+	switch (capture_start(pin, edges, size)) {
+		case 0:
+			return 0;
+		case EINVAL:
+			return luaL_error(L, "invalid edges or size");
+		case EBUSY:
+			return luaL_error(L, "no free capture channel or the pin is in use");
+		default:
+			return luaL_error(L, "not enough memory");
+	}
+}
+
+// Lua: pio.capture.stop(pin)
+static int pio_capture_stop(lua_State *L) {
+	capture_stop(pio_capture_pin(L));
+	return 0;
+}
+
+// Lua: dt, levels = pio.capture.read(pin, [max])
+// dt[i] is the time in us since the edge before, levels[i] the level after
+static int pio_capture_read(lua_State *L) {
+	int pin = pio_capture_pin(L);
+	int max = luaL_optinteger(L, 2, CAPTURE_RING_MAX);
+	uint32_t dt[PIO_CAPTURE_READ];
+	uint8_t lv[PIO_CAPTURE_READ];
+	int i, n, total = 0;
+
+	if (capture_channel(pin) == NULL) {
+		return luaL_error(L, "the pin is not captured");
+	}
+
+	lua_newtable(L);
+	lua_newtable(L);
+
+	while (total < max) {
+		n = capture_read(pin, dt, lv, (max - total < PIO_CAPTURE_READ) ? max - total : PIO_CAPTURE_READ);
+		if (n <= 0) {
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			total++;
+			lua_pushinteger(L, dt[i] / (CPU_HZ / 1000000));
+			lua_rawseti(L, -3, total);
+			lua_pushinteger(L, lv[i]);
+			lua_rawseti(L, -2, total);
+		}
+	}
+
+	return 2;
+}
+
+// Lua: stats = pio.capture.stats(pin, [reset])
+static int pio_capture_stats(lua_State *L) {
+	int pin = pio_capture_pin(L);
+	capture_stats_t st;
+
+	if (capture_stats(pin, &st, lua_toboolean(L, 2)) < 0) {
+		return luaL_error(L, "the pin is not captured");
+	}
+
+	lua_createtable(L, 0, 9);
+	lua_pushinteger(L, st.count);
+	lua_setfield(L, -2, "count");
+	lua_pushinteger(L, st.lost);
+	lua_setfield(L, -2, "lost");
+	lua_pushinteger(L, st.pending);
+	lua_setfield(L, -2, "pending");
+	lua_pushinteger(L, st.periods);
+	lua_setfield(L, -2, "periods");
+	lua_pushinteger(L, st.period);
+	lua_setfield(L, -2, "period");
+	lua_pushinteger(L, st.period_min);
+	lua_setfield(L, -2, "period_min");
+	lua_pushinteger(L, st.period_max);
+	lua_setfield(L, -2, "period_max");
+	lua_pushnumber(L, st.freq_mhz / 1000.0);
+	lua_setfield(L, -2, "freq");
+	if (st.duty >= 0) {
+		lua_pushnumber(L, st.duty / 1000.0);
+		lua_setfield(L, -2, "duty");
+	}
+
+	return 1;
+}
+
+// Lua: n = pio.capture.count(pin, [reset])
+static int pio_capture_count(lua_State *L) {
+	int pin = pio_capture_pin(L);
+	uint32_t count;
+
+	if (capture_count(pin, &count, lua_toboolean(L, 2)) < 0) {
+		return luaL_error(L, "the pin is not captured");
+	}
+
+	lua_pushinteger(L, count);
+	return 1;
+}
+
 #include "modules.h"
 
 static const LUA_REG_TYPE pio_pin_map[] = {
@@ -373,6 +495,20 @@ static const LUA_REG_TYPE pio_port_map[] = {
     { LNILKEY, LNILVAL }
 };
 
+static const LUA_REG_TYPE pio_capture_map[] = {
+    { LSTRKEY( "start"   ),			LFUNCVAL( pio_capture_start ) },
+    { LSTRKEY( "stop"    ),			LFUNCVAL( pio_capture_stop  ) },
+    { LSTRKEY( "read"    ),			LFUNCVAL( pio_capture_read  ) },
+    { LSTRKEY( "stats"   ),			LFUNCVAL( pio_capture_stats ) },
+    { LSTRKEY( "count"   ),			LFUNCVAL( pio_capture_count ) },
+#if LUA_USE_ROTABLE
+    { LSTRKEY( "RISING"  ),			LINTVAL ( CAPTURE_RISING    ) },
+    { LSTRKEY( "FALLING" ),			LINTVAL ( CAPTURE_FALLING   ) },
+    { LSTRKEY( "BOTH"    ),			LINTVAL ( CAPTURE_BOTH      ) },
+#endif
+    { LNILKEY, LNILVAL }
+};
+
 #if !LUA_USE_ROTABLE
 static const LUA_REG_TYPE pio_map[] = {
     { LSTRKEY( "decode"   ),		LFUNCVAL( pio_decode       ) },
@@ -383,6 +519,7 @@ static const LUA_REG_TYPE pio_map[] = {
     { LSTRKEY( "decode"   ),		LFUNCVAL( pio_decode               ) },
 	{ LSTRKEY( "pin"      ), 	   	LROVAL  ( pio_pin_map              ) },
 	{ LSTRKEY( "port"     ), 	   	LROVAL  ( pio_port_map             ) },
+	{ LSTRKEY( "capture"  ), 	   	LROVAL  ( pio_capture_map          ) },
 
     { LSTRKEY( "INPUT"    ),		LINTVAL ( PIO_DIR_INPUT            ) },
     { LSTRKEY( "OUTPUT"   ),		LINTVAL ( PIO_DIR_OUTPUT           ) },
@@ -469,6 +606,16 @@ LUALIB_API int luaopen_pio(lua_State *L) {
     luaL_register(L, NULL, pio_port_map);
     lua_setfield(L, -2, "port");
 
+    lua_newtable(L);
+    luaL_register(L, NULL, pio_capture_map);
+    lua_pushinteger(L, CAPTURE_RISING);
+    lua_setfield(L, -2, "RISING");
+    lua_pushinteger(L, CAPTURE_FALLING);
+    lua_setfield(L, -2, "FALLING");
+    lua_pushinteger(L, CAPTURE_BOTH);
+    lua_setfield(L, -2, "BOTH");
+    lua_setfield(L, -2, "capture");
+
     return 1;
 #else
 	return 0;
@@ -0,0 +1,1179 @@
+/*
+ * bhgv, streaming JSON encoder and decoder
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The sjson module of NodeMCU, with a decoder of its own instead of jsonsl.
+ *
+ *   e = sjson.encoder(obj, [opts])
+ *   chunk = e:read([size])            nil at the end
+ *   str = sjson.encode(obj, [opts])
+ *   bytes, err = sjson.encode(obj, sink, [opts])
+ *
+ *   d = sjson.decoder([opts])
+ *   obj = d:write(str)                nil until the value is complete
+ *   obj = d:result()
+ *   obj = sjson.decode(str, [opts])
+ *
+ * The encoder walks the tables as it's read, and writes at most size bytes
+ * per read, a long string is cut between reads. So a CGI page returns the
+ * chunks of e:read() one by one, and the JSON is never all in memory.
+ *
+ * With a sink, encode() writes chunks of opts.chunk bytes (SJSON_CHUNK) to
+ * it: a function is called as sink(chunk), a socket as sink:send(chunk).
+ * The encoding stops when the sink returns false, or a second result that
+ * is not 0, like the err of s:send(); encode() returns the bytes given to
+ * the sink and that result.
+ *
+ * The decoder takes the text in pieces of any size, like the frames of a
+ * websocket, a token cut between two writes is kept for the next one. A
+ * number at the top level ends with the text, on result().
+ *
+ * The options are depth, the levels of nested tables (DEFAULT_DEPTH), null,
+ * the value of a JSON null (sjson.NULL by default, nil drops the member),
+ * and for the decoder, metatable, set on the tables it makes.
+ */
+
+#define LUA_LIB
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "modules.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define LUA_SJSONLIBNAME "sjson"
+
+#define DEFAULT_DEPTH   20
+
+// Bytes of e:read() without a size, and of the chunks given to a sink
+#define SJSON_READ      1024
+#define SJSON_CHUNK     512
+
+#define SJSON_TOKEN     32
+
+static int sjson_get_depth(lua_State *L, int argno) {
+  int nlevels = DEFAULT_DEPTH;
+
+  if (lua_type(L, argno) == LUA_TTABLE) {
+    lua_getfield(L, argno, "depth");
+    nlevels = lua_tointeger(L, -1);
+    if (nlevels == 0) {
+      nlevels = DEFAULT_DEPTH;
+    }
+    if (nlevels < 4) {
+      nlevels = 4;
+    }
+    if (nlevels > 1000) {
+      nlevels = 1000;
+    }
+    lua_pop(L, 1);
+  }
+
+  return nlevels;
+}
+
+// The null option, sjson.NULL when there is none
+static int sjson_get_null(lua_State *L, int argno) {
+  if (lua_type(L, argno) == LUA_TTABLE) {
+    lua_getfield(L, argno, "null");
+  } else {
+    lua_pushlightuserdata(L, 0);
+  }
+
+  return luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+/*
+ * Decoder
+ */
+
+enum {
+  JSN_VALUE,            // a value
+  JSN_VALUE_OR_END,     // a value or ], after [
+  JSN_KEY,              // a key, after ,
+  JSN_KEY_OR_END,       // a key or }, after {
+  JSN_COLON,            // :, after a key
+  JSN_NEXT,             // , or the end of the container, after a value
+  JSN_STRING,
+  JSN_ESCAPE,           // after \ in a string
+  JSN_UNICODE,          // the digits of \u
+  JSN_NUMBER,
+  JSN_LITERAL,          // true, false or null
+  JSN_DONE
+};
+
+typedef struct {
+  int work_ref;         // [0] the result, [i] the table of level i, [-i] its key
+  int null_ref;
+  int metatable;
+  int nlevels;
+  int depth;
+  int *count;           // next index of the arrays, 0 for the objects
+  uint8_t state;
+  uint8_t key;          // the string is a key
+  uint8_t complete;
+  uint8_t digits;
+  uint32_t code;        // of \u
+  uint32_t high;        // high surrogate waiting for the low one
+  char *tok;            // string, number or literal cut between writes
+  size_t tok_len;
+  size_t tok_size;
+  size_t pos;
+  const char *error;
+} JSN_DATA;
+
+static JSN_DATA *sjson_decoder_check(lua_State *L, int argno) {
+  return (JSN_DATA *) luaL_checkudata(L, argno, "sjson.decoder");
+}
+
+static void jsn_error(lua_State *L, JSN_DATA *data, const char *msg) {
+  data->error = msg;
+  luaL_error(L, "JSON parse error at %d: %s", (int) data->pos, msg);
+}
+
+static void jsn_add(lua_State *L, JSN_DATA *data, const char *s, size_t len) {
+  if (data->tok_len + len + 1 > data->tok_size) {
+    size_t size = data->tok_size ? data->tok_size : SJSON_TOKEN;
+    char *tok;
+
+    while (data->tok_len + len + 1 > size) {
+      size <<= 1;
+    }
+    tok = realloc(data->tok, size);
+    if (!tok) {
+      jsn_error(L, data, "not enough memory");
+    }
+    data->tok = tok;
+    data->tok_size = size;
+  }
+
+  memcpy(data->tok + data->tok_len, s, len);
+  data->tok_len += len;
+}
+
+static void jsn_add_char(lua_State *L, JSN_DATA *data, char c) {
+  jsn_add(L, data, &c, 1);
+}
+
+static void jsn_add_utf8(lua_State *L, JSN_DATA *data, uint32_t c) {
+  char buf[4];
+  int n;
+
+  if (c < 0x80) {
+    buf[0] = c;
+    n = 1;
+  } else if (c < 0x800) {
+    buf[0] = 0xc0 | (c >> 6);
+    buf[1] = 0x80 | (c & 0x3f);
+    n = 2;
+  } else if (c < 0x10000) {
+    buf[0] = 0xe0 | (c >> 12);
+    buf[1] = 0x80 | ((c >> 6) & 0x3f);
+    buf[2] = 0x80 | (c & 0x3f);
+    n = 3;
+  } else {
+    buf[0] = 0xf0 | (c >> 18);
+    buf[1] = 0x80 | ((c >> 12) & 0x3f);
+    buf[2] = 0x80 | ((c >> 6) & 0x3f);
+    buf[3] = 0x80 | (c & 0x3f);
+    n = 4;
+  }
+
+  jsn_add(L, data, buf, n);
+}
+
+// A high surrogate without its low one is kept as it is
+static void jsn_flush_high(lua_State *L, JSN_DATA *data) {
+  if (data->high) {
+    jsn_add_utf8(L, data, data->high);
+    data->high = 0;
+  }
+}
+
+// Stores the value on the top of the stack in its container, work at wi
+static void jsn_value(lua_State *L, JSN_DATA *data, int wi) {
+  if (data->depth == 0) {
+    lua_rawseti(L, wi, 0);
+    data->complete = 1;
+    data->state = JSN_DONE;
+    return;
+  }
+
+  lua_rawgeti(L, wi, data->depth);
+  if (data->count[data->depth]) {
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, data->count[data->depth]++);
+  } else {
+    lua_rawgeti(L, wi, -data->depth);
+    lua_pushvalue(L, -3);
+    lua_rawset(L, -3);
+    lua_remove(L, -2);
+  }
+  lua_pop(L, 1);
+
+  data->state = JSN_NEXT;
+}
+
+static void jsn_open(lua_State *L, JSN_DATA *data, int wi, int array) {
+  if (data->depth >= data->nlevels) {
+    jsn_error(L, data, "too many levels");
+  }
+
+  lua_newtable(L);
+  if (data->metatable != LUA_NOREF) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, data->metatable);
+    lua_setmetatable(L, -2);
+  }
+  lua_rawseti(L, wi, ++data->depth);
+
+  data->count[data->depth] = array;
+  data->state = array ? JSN_VALUE_OR_END : JSN_KEY_OR_END;
+}
+
+static void jsn_close(lua_State *L, JSN_DATA *data, int wi, char c) {
+  if ((c == ']') != (data->count[data->depth] != 0)) {
+    jsn_error(L, data, "mismatched bracket");
+  }
+
+  lua_rawgeti(L, wi, data->depth);
+  lua_pushnil(L);
+  lua_rawseti(L, wi, data->depth);
+  lua_pushnil(L);
+  lua_rawseti(L, wi, -data->depth);
+  data->depth--;
+
+  jsn_value(L, data, wi);
+}
+
+static void jsn_string(lua_State *L, JSN_DATA *data, int wi) {
+  jsn_flush_high(L, data);
+  lua_pushlstring(L, data->tok, data->tok_len);
+
+  if (data->key) {
+    lua_rawseti(L, wi, -data->depth);
+    data->state = JSN_COLON;
+  } else {
+    jsn_value(L, data, wi);
+  }
+}
+
+static void jsn_number(lua_State *L, JSN_DATA *data, int wi) {
+  jsn_add_char(L, data, 0);
+  if (lua_stringtonumber(L, data->tok) == 0) {
+    jsn_error(L, data, "bad number");
+  }
+
+  jsn_value(L, data, wi);
+}
+
+static void jsn_literal(lua_State *L, JSN_DATA *data, int wi) {
+  jsn_add_char(L, data, 0);
+  if (!strcmp(data->tok, "true")) {
+    lua_pushboolean(L, 1);
+  } else if (!strcmp(data->tok, "false")) {
+    lua_pushboolean(L, 0);
+  } else if (!strcmp(data->tok, "null")) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, data->null_ref);
+  } else {
+    jsn_error(L, data, "bad literal");
+  }
+
+  jsn_value(L, data, wi);
+}
+
+static void jsn_token(JSN_DATA *data, int state) {
+  data->tok_len = 0;
+  data->state = state;
+}
+
+static void jsn_parse(lua_State *L, JSN_DATA *data, int wi, const char *p, size_t len) {
+  const char *e = p + len;
+  const char *q;
+  char c;
+
+  while (p < e) {
+    c = *p;
+
+    switch (data->state) {
+      case JSN_STRING:
+        q = p;
+        while ((q < e) && (*q != '"') && (*q != '\\') && ((*q & 0xff) >= 0x20)) {
+          q++;
+        }
+        if (q > p) {
+          jsn_flush_high(L, data);
+          jsn_add(L, data, p, q - p);
+          data->pos += q - p;
+          p = q;
+          continue;
+        }
+        if (c == '"') {
+          jsn_string(L, data, wi);
+        } else if (c == '\\') {
+          data->state = JSN_ESCAPE;
+        } else {
+          jsn_error(L, data, "control character in string");
+        }
+        break;
+
+      case JSN_ESCAPE:
+        data->state = JSN_STRING;
+        if (c == 'u') {
+          data->state = JSN_UNICODE;
+          data->code = 0;
+          data->digits = 0;
+          break;
+        }
+        jsn_flush_high(L, data);
+        switch (c) {
+          case '"':
+          case '\\':
+          case '/':
+            break;
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          default:
+            jsn_error(L, data, "bad escape");
+        }
+        jsn_add_char(L, data, c);
+        break;
+
+      case JSN_UNICODE:
+        if ((c >= '0') && (c <= '9')) {
+          data->code = (data->code << 4) | (c - '0');
+        } else if (((c | 0x20) >= 'a') && ((c | 0x20) <= 'f')) {
+          data->code = (data->code << 4) | ((c | 0x20) - 'a' + 10);
+        } else {
+          jsn_error(L, data, "bad \\u escape");
+        }
+        if (++data->digits < 4) {
+          break;
+        }
+        data->state = JSN_STRING;
+        if (data->high && (data->code >= 0xdc00) && (data->code < 0xe000)) {
+          jsn_add_utf8(L, data, 0x10000 + ((data->high - 0xd800) << 10) + (data->code - 0xdc00));
+          data->high = 0;
+          break;
+        }
+        jsn_flush_high(L, data);
+        if ((data->code >= 0xd800) && (data->code < 0xdc00)) {
+          data->high = data->code;
+        } else {
+          jsn_add_utf8(L, data, data->code);
+        }
+        break;
+
+      case JSN_NUMBER:
+        if (((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') || (c == '.') || (c == 'e') || (c == 'E')) {
+          jsn_add_char(L, data, c);
+          break;
+        }
+        jsn_number(L, data, wi);
+        continue;
+
+      case JSN_LITERAL:
+        if ((c >= 'a') && (c <= 'z')) {
+          jsn_add_char(L, data, c);
+          break;
+        }
+        jsn_literal(L, data, wi);
+        continue;
+
+      case JSN_DONE:
+        return;
+
+      default:
+        if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')) {
+          break;
+        }
+
+        switch (data->state) {
+          case JSN_VALUE_OR_END:
+            if (c == ']') {
+              jsn_close(L, data, wi, c);
+              break;
+            }
+            // Fall through
+          case JSN_VALUE:
+            if (c == '{') {
+              jsn_open(L, data, wi, 0);
+            } else if (c == '[') {
+              jsn_open(L, data, wi, 1);
+            } else if (c == '"') {
+              data->key = 0;
+              jsn_token(data, JSN_STRING);
+            } else if ((c == '-') || ((c >= '0') && (c <= '9'))) {
+              jsn_token(data, JSN_NUMBER);
+              jsn_add_char(L, data, c);
+            } else if ((c == 't') || (c == 'f') || (c == 'n')) {
+              jsn_token(data, JSN_LITERAL);
+              jsn_add_char(L, data, c);
+            } else {
+              jsn_error(L, data, "unexpected character");
+            }
+            break;
+
+          case JSN_KEY_OR_END:
+            if (c == '}') {
+              jsn_close(L, data, wi, c);
+              break;
+            }
+            // Fall through
+          case JSN_KEY:
+            if (c != '"') {
+              jsn_error(L, data, "expected a key");
+            }
+            data->key = 1;
+            jsn_token(data, JSN_STRING);
+            break;
+
+          case JSN_COLON:
+            if (c != ':') {
+              jsn_error(L, data, "expected ':'");
+            }
+            data->state = JSN_VALUE;
+            break;
+
+          case JSN_NEXT:
+            if (c == ',') {
+              data->state = data->count[data->depth] ? JSN_VALUE : JSN_KEY;
+            } else if ((c == ']') || (c == '}')) {
+              jsn_close(L, data, wi, c);
+            } else {
+              jsn_error(L, data, "expected ',' or the end of the container");
+            }
+            break;
+        }
+        break;
+    }
+
+    p++;
+    data->pos++;
+  }
+}
+
+static int sjson_decoder_int(lua_State *L, int argno) {
+  int nlevels = sjson_get_depth(L, argno);
+
+  JSN_DATA *data = (JSN_DATA *) lua_newuserdata(L, sizeof(JSN_DATA) + (nlevels + 1) * sizeof(int));
+  memset(data, 0, sizeof(JSN_DATA));
+  data->count = (int *) (data + 1);
+  data->nlevels = nlevels;
+  data->state = JSN_VALUE;
+  data->work_ref = LUA_NOREF;
+  data->null_ref = LUA_NOREF;
+  data->metatable = LUA_NOREF;
+
+  // Associate its metatable
+  luaL_getmetatable(L, "sjson.decoder");
+  lua_setmetatable(L, -2);
+
+  lua_newtable(L);
+  data->work_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  data->null_ref = sjson_get_null(L, argno);
+
+  if (lua_type(L, argno) == LUA_TTABLE) {
+    lua_getfield(L, argno, "metatable");
+    if (lua_type(L, -1) != LUA_TNIL) {
+      data->metatable = luaL_ref(L, LUA_REGISTRYINDEX);
+    } else {
+      lua_pop(L, 1);
+    }
+  }
+
+  return 1;
+}
+
+static int sjson_decoder(lua_State *L) {
+  return sjson_decoder_int(L, 1);
+}
+
+// Ends a number or literal at the top level, cut by the end of the text
+static void sjson_decoder_finish(lua_State *L, JSN_DATA *data) {
+  if (data->complete || data->error || (data->depth > 0)) {
+    return;
+  }
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, data->work_ref);
+  if (data->state == JSN_NUMBER) {
+    jsn_number(L, data, lua_gettop(L));
+  } else if (data->state == JSN_LITERAL) {
+    jsn_literal(L, data, lua_gettop(L));
+  }
+  lua_pop(L, 1);
+}
+
+static int sjson_decoder_result_int(lua_State *L, JSN_DATA *data) {
+  sjson_decoder_finish(L, data);
+
+  if (!data->complete) {
+    luaL_error(L, "decode not complete");
+  }
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, data->work_ref);
+  lua_rawgeti(L, -1, 0);
+  lua_remove(L, -2);
+
+  return 1;
+}
+
+static int sjson_decoder_result(lua_State *L) {
+  JSN_DATA *data = sjson_decoder_check(L, 1);
+
+  return sjson_decoder_result_int(L, data);
+}
+
+static int sjson_decoder_write_int(lua_State *L, int udata_pos, int string_pos) {
+  JSN_DATA *data = sjson_decoder_check(L, udata_pos);
+  size_t len;
+  const char *str = luaL_checklstring(L, string_pos, &len);
+
+  if (data->error) {
+    luaL_error(L, "JSON parse error: previous call");
+  }
+
+  if (!data->complete) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, data->work_ref);
+    jsn_parse(L, data, lua_gettop(L), str, len);
+    lua_pop(L, 1);
+  }
+
+  if (data->complete) {
+    return sjson_decoder_result_int(L, data);
+  }
+
+  return 0;
+}
+
+static int sjson_decoder_write(lua_State *L) {
+  return sjson_decoder_write_int(L, 1, 2);
+}
+
+static int sjson_decode(lua_State *L) {
+  lua_settop(L, 2);
+  sjson_decoder_int(L, 2);
+
+  if (sjson_decoder_write_int(L, 3, 1) == 0) {
+    // A number alone, or an incomplete object
+    sjson_decoder_result_int(L, sjson_decoder_check(L, 3));
+  }
+
+  return 1;
+}
+
+static int sjson_decoder_destructor(lua_State *L) {
+  JSN_DATA *data = (JSN_DATA *)lua_touserdata(L, 1);
+
+  luaL_unref(L, LUA_REGISTRYINDEX, data->work_ref);
+  data->work_ref = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->null_ref);
+  data->null_ref = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->metatable);
+  data->metatable = LUA_NOREF;
+
+  free(data->tok);
+  data->tok = NULL;
+  data->tok_size = 0;
+
+  return 0;
+}
+
+/*
+ * Encoder
+ */
+
+typedef struct {
+  int lua_object_ref;
+  int lua_key_ref;      // of lua_next
+  int size;             // -1 for an object, else the length of the array
+  int offset;           // members written
+  uint8_t value;        // the key of the member is written, its value is next
+} ENC_DATA_STATE;
+
+typedef struct {
+  ENC_DATA_STATE *stack;
+  int nlevels;
+  int level;
+  int null_ref;
+  int str_ref;          // the string being written
+  const char *str;
+  size_t str_len;
+  size_t str_off;
+  uint8_t str_key;      // ends with ":
+  uint8_t pend_len;
+  uint8_t pend_off;
+  char pend[64];        // punctuation, numbers, short strings and escapes
+  char *chunk;          // of read() and the sinks
+  size_t chunk_size;
+} ENC_DATA;
+
+static ENC_DATA *sjson_encoder_check(lua_State *L, int argno) {
+  return (ENC_DATA *) luaL_checkudata(L, argno, "sjson.encoder");
+}
+
+// -1 for an object, else the highest index of the array
+static int sjson_encoder_get_table_size(lua_State *L, int argno) {
+  // Returns -1 for object, otherwise the maximum integer key value found.
+  lua_pushvalue(L, argno);
+  // stack now contains: -1 => table
+  lua_pushnil(L);
+  // stack now contains: -1 => nil; -2 => table
+  //
+  int maxkey = 0;
+
+  while (lua_next(L, -2)) {
+    lua_pop(L, 1);
+    // stack now contains: -1 => key; -2 => table
+    if (lua_type(L, -1) == LUA_TNUMBER && lua_isinteger(L, -1)) {
+      int val = lua_tointeger(L, -1);
+      if (val > maxkey) {
+        maxkey = val;
+      } else if (val <= 0) {
+        maxkey = -1;
+        lua_pop(L, 1);
+        break;
+      }
+    } else {
+      maxkey = -1;
+      lua_pop(L, 1);
+      break;
+    }
+  }
+
+  lua_pop(L, 1);
+
+  return maxkey;
+}
+
+static void enc_pop_stack(lua_State *L, ENC_DATA *data) {
+  if (data->level < 0) {
+    luaL_error(L, "encoder stack underflow");
+  }
+  ENC_DATA_STATE *state = &data->stack[data->level];
+  luaL_unref(L, LUA_REGISTRYINDEX, state->lua_object_ref);
+  state->lua_object_ref = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, state->lua_key_ref);
+  state->lua_key_ref = LUA_REFNIL;
+  data->level--;
+}
+
+static void enc_push_stack(lua_State *L, ENC_DATA *data, int argno) {
+  if (data->level + 1 >= data->nlevels) {
+    luaL_error(L, "encoder stack overflow");
+  }
+  ENC_DATA_STATE *state = &data->stack[++data->level];
+  state->size = sjson_encoder_get_table_size(L, argno);
+  state->offset = 0;
+  state->value = 0;
+  lua_pushvalue(L, argno);
+  state->lua_object_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  state->lua_key_ref = LUA_REFNIL;
+}
+
+static void enc_pend(ENC_DATA *data, const char *s) {
+  size_t len = strlen(s);
+
+  memcpy(data->pend + data->pend_len, s, len);
+  data->pend_len += len;
+}
+
+static void enc_pend_number(lua_State *L, ENC_DATA *data, int argno) {
+  char *buf = data->pend + data->pend_len;
+  size_t size = sizeof(data->pend) - data->pend_len;
+  int len;
+
+  if (lua_isinteger(L, argno)) {
+    len = lua_integer2str(buf, size, lua_tointeger(L, argno));
+  } else {
+    lua_Number n = lua_tonumber(L, argno);
+
+    if (isnan(n) || isinf(n)) {
+      enc_pend(data, "null");
+      return;
+    }
+
+    // Like tostring(), a float stays a float
+    len = lua_number2str(buf, size, n);
+    if (buf[strspn(buf, "-0123456789")] == '\0') {
+      buf[len++] = '.';
+      buf[len++] = '0';
+    }
+  }
+
+  data->pend_len += len;
+}
+
+static void enc_start_string(lua_State *L, ENC_DATA *data, int argno, int key) {
+  size_t len, i;
+  const char *str = lua_tolstring(L, argno, &len);
+
+  // A short string without escapes goes with the punctuation
+  if (len + 3 <= sizeof(data->pend) - data->pend_len) {
+    for (i = 0; i < len; i++) {
+      if (((str[i] & 0xff) < 0x20) || (str[i] == '"') || (str[i] == '\\')) {
+        break;
+      }
+    }
+    if (i == len) {
+      data->pend[data->pend_len++] = '"';
+      memcpy(data->pend + data->pend_len, str, len);
+      data->pend_len += len;
+      enc_pend(data, key ? "\":" : "\"");
+      return;
+    }
+  }
+
+  lua_pushvalue(L, argno);
+  data->str = lua_tolstring(L, -1, &data->str_len);
+  data->str_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  data->str_off = 0;
+  data->str_key = key;
+  enc_pend(data, "\"");
+}
+
+// Writes the value on the top of the stack after prefix, pops it
+static void enc_value(lua_State *L, ENC_DATA *data, const char *prefix) {
+  int count = 10;
+
+  while ((lua_type(L, -1) == LUA_TFUNCTION
+#ifdef LUA_TLIGHTFUNCTION
+    || lua_type(L, -1) == LUA_TLIGHTFUNCTION
+#endif
+    ) && count-- > 0) {
+    // call it and use the return value
+    lua_call(L, 0, 1);          // Expecting replacement value
+  }
+
+  enc_pend(data, prefix);
+
+  int type = lua_type(L, -1);
+
+  if (data->null_ref != LUA_REFNIL) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, data->null_ref);
+    if (lua_rawequal(L, -1, -2)) {
+      type = LUA_TNIL;
+    }
+    lua_pop(L, 1);
+  }
+
+  switch (type) {
+    default:
+      luaL_error(L, "Cannot encode type %d", type);
+      break;
+
+    case LUA_TLIGHTUSERDATA:
+    case LUA_TNIL:
+      enc_pend(data, "null");
+      break;
+
+    case LUA_TBOOLEAN:
+      enc_pend(data, lua_toboolean(L, -1) ? "true" : "false");
+      break;
+
+    case LUA_TNUMBER:
+      enc_pend_number(L, data, -1);
+      break;
+
+    case LUA_TSTRING:
+      enc_start_string(L, data, -1, 0);
+      break;
+
+    case LUA_TTABLE:
+      enc_push_stack(L, data, -1);
+      break;
+  }
+
+  lua_pop(L, 1);
+}
+
+// Makes the next token, or ends a table
+static void enc_next(lua_State *L, ENC_DATA *data) {
+  ENC_DATA_STATE *state = &data->stack[data->level];
+
+  data->pend_len = 0;
+  data->pend_off = 0;
+
+  if (state->size >= 0) {
+    if (state->offset == 0) {
+      enc_pend(data, "[");
+    }
+    if (state->offset == state->size) {
+      enc_pend(data, "]");
+      enc_pop_stack(L, data);
+      return;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, state->lua_object_ref);
+    lua_rawgeti(L, -1, ++state->offset);
+    lua_remove(L, -2);
+    enc_value(L, data, (state->offset > 1) ? "," : "");
+    return;
+  }
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, state->lua_object_ref);
+  // stack now contains: -1 => table
+  lua_rawgeti(L, LUA_REGISTRYINDEX, state->lua_key_ref);
+  // stack now contains: -1 => nil or key; -2 => table
+
+  if (state->value) {
+    // The key is written, now its value
+    state->value = 0;
+    lua_rawget(L, -2);
+    lua_remove(L, -2);
+    enc_value(L, data, "");
+    return;
+  }
+
+  if (!lua_next(L, -2)) {
+    lua_pop(L, 1);
+    // We have got to the end
+    enc_pend(data, state->offset ? "}" : "{}");
+    enc_pop_stack(L, data);
+    return;
+  }
+
+  // stack now contains: -1 => value; -2 => key; -3 => table
+  lua_pop(L, 1);
+  luaL_unref(L, LUA_REGISTRYINDEX, state->lua_key_ref);
+  lua_pushvalue(L, -1);
+  state->lua_key_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  enc_pend(data, state->offset++ ? "," : "{");
+
+  // copy the key so that lua_tostring does not modify the original
+  lua_pushvalue(L, -1);
+  if (!lua_tostring(L, -1)) {
+    luaL_error(L, "Cannot encode key of type %d", lua_type(L, -2));
+  }
+  enc_start_string(L, data, -1, 1);
+  lua_pop(L, 3);
+
+  state->value = 1;
+}
+
+static void enc_escape(ENC_DATA *data, char c) {
+  char *d = data->pend;
+
+  data->pend_off = 0;
+
+  *d++ = '\\';
+  switch (c) {
+    case '"':
+    case '\\':
+      *d++ = c;
+      break;
+    case '\f':
+      *d++ = 'f';
+      break;
+    case '\n':
+      *d++ = 'n';
+      break;
+    case '\t':
+      *d++ = 't';
+      break;
+    case '\r':
+      *d++ = 'r';
+      break;
+    case '\b':
+      *d++ = 'b';
+      break;
+
+    default:
+      *d++ = 'u';
+      *d++ = '0';
+      *d++ = '0';
+      *d++ = "0123456789abcdef"[(c >> 4) & 0xf];
+      *d++ = "0123456789abcdef"[(c     ) & 0xf];
+      break;
+  }
+
+  data->pend_len = d - data->pend;
+}
+
+// Writes up to size bytes of the JSON to buf, returns how many
+static size_t enc_fill(lua_State *L, ENC_DATA *data, char *buf, size_t size) {
+  size_t len = 0;
+  size_t n;
+
+  while (len < size) {
+    if (data->pend_off < data->pend_len) {
+      n = data->pend_len - data->pend_off;
+      if (n > size - len) {
+        n = size - len;
+      }
+      memcpy(buf + len, data->pend + data->pend_off, n);
+      data->pend_off += n;
+      len += n;
+      continue;
+    }
+
+    if (data->str_ref != LUA_NOREF) {
+      if (data->str_off == data->str_len) {
+        luaL_unref(L, LUA_REGISTRYINDEX, data->str_ref);
+        data->str_ref = LUA_NOREF;
+        data->pend_len = data->pend_off = 0;
+        enc_pend(data, data->str_key ? "\":" : "\"");
+        continue;
+      }
+
+      while ((len < size) && (data->str_off < data->str_len)) {
+        char c = data->str[data->str_off++];
+
+        if (((c & 0xff) < 0x20) || (c == '"') || (c == '\\')) {
+          enc_escape(data, c);
+          break;
+        }
+        buf[len++] = c;
+      }
+      continue;
+    }
+
+    if (data->level < 0) {
+      break;
+    }
+
+    enc_next(L, data);
+  }
+
+  return len;
+}
+
+static char *enc_chunk(lua_State *L, ENC_DATA *data, size_t size) {
+  if (size > data->chunk_size) {
+    char *chunk = realloc(data->chunk, size);
+
+    if (!chunk) {
+      luaL_error(L, "not enough memory");
+    }
+    data->chunk = chunk;
+    data->chunk_size = size;
+  }
+
+  return data->chunk;
+}
+
+static int sjson_encoder(lua_State *L) {
+  int nlevels = sjson_get_depth(L, 2);
+
+  // Validate first arg is a table
+  luaL_checktype(L, 1, LUA_TTABLE);
+
+  ENC_DATA *data = (ENC_DATA *) lua_newuserdata(L, sizeof(ENC_DATA) + nlevels * sizeof(ENC_DATA_STATE));
+  memset(data, 0, sizeof(ENC_DATA));
+
+  // Associate its metatable
+  luaL_getmetatable(L, "sjson.encoder");
+  lua_setmetatable(L, -2);
+
+  data->nlevels = nlevels;
+  data->level = -1;
+  data->stack = (ENC_DATA_STATE *) (data + 1);
+  data->str_ref = LUA_NOREF;
+  data->null_ref = LUA_REFNIL;
+  int i;
+  for (i = 0; i < nlevels; i++) {
+    data->stack[i].lua_object_ref = LUA_NOREF;
+    data->stack[i].lua_key_ref = LUA_REFNIL;
+  }
+  enc_push_stack(L, data, 1);
+
+  if (lua_type(L, 2) == LUA_TTABLE) {
+    lua_getfield(L, 2, "null");
+    data->null_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  return 1;
+}
+
+static int sjson_encoder_read(lua_State *L) {
+  ENC_DATA *data = sjson_encoder_check(L, 1);
+
+  int readsize = luaL_optinteger(L, 2, SJSON_READ);
+  if (readsize < 1) {
+    readsize = 1;
+  }
+
+  char *chunk = enc_chunk(L, data, readsize);
+  size_t len = enc_fill(L, data, chunk, readsize);
+
+  if (len == 0) {
+    return 0;
+  }
+
+  lua_pushlstring(L, chunk, len);
+  return 1;
+}
+
+// Lua: bytes, err = encode(obj, sink, [opts]), the encoder is at top
+static int sjson_encode_sink(lua_State *L, ENC_DATA *data) {
+  int size = SJSON_CHUNK;
+  lua_Integer total = 0;
+  size_t len;
+  char *chunk;
+
+  if (lua_type(L, 3) == LUA_TTABLE) {
+    lua_getfield(L, 3, "chunk");
+    size = luaL_optinteger(L, -1, SJSON_CHUNK);
+    lua_pop(L, 1);
+    if (size < 16) {
+      size = 16;
+    }
+  }
+
+  chunk = enc_chunk(L, data, size);
+
+  while ((len = enc_fill(L, data, chunk, size)) > 0) {
+    if (lua_type(L, 2) == LUA_TFUNCTION) {
+      lua_pushvalue(L, 2);
+      lua_pushlstring(L, chunk, len);
+      lua_call(L, 1, 2);
+    } else {
+      lua_getfield(L, 2, "send");
+      lua_pushvalue(L, 2);
+      lua_pushlstring(L, chunk, len);
+      lua_call(L, 2, 2);
+    }
+    total += len;
+
+    // false, or an error like the one of s:send()
+    if ((lua_type(L, -2) == LUA_TBOOLEAN) && !lua_toboolean(L, -2)) {
+      lua_pop(L, 1);
+      lua_pushinteger(L, total);
+      lua_insert(L, -2);
+      return 2;
+    }
+    if ((lua_type(L, -1) == LUA_TNUMBER) && (lua_tointeger(L, -1) != 0)) {
+      lua_remove(L, -2);
+      lua_pushinteger(L, total);
+      lua_insert(L, -2);
+      return 2;
+    }
+    lua_pop(L, 2);
+  }
+
+  lua_pushinteger(L, total);
+  return 1;
+}
+
+static int sjson_encode(lua_State *L) {
+  int type = lua_type(L, 2);
+
+  if ((type == LUA_TFUNCTION) || (type == LUA_TUSERDATA)) {
+    lua_settop(L, 3);
+    // The options of the encoder are the third argument
+    lua_pushcfunction(L, sjson_encoder);
+    lua_pushvalue(L, 1);
+    lua_pushvalue(L, 3);
+    lua_call(L, 2, 1);
+
+    return sjson_encode_sink(L, sjson_encoder_check(L, 4));
+  }
+
+  lua_settop(L, 2);
+  sjson_encoder(L);
+
+  ENC_DATA *data = sjson_encoder_check(L, -1);
+  char *chunk = enc_chunk(L, data, SJSON_READ);
+  size_t len;
+  luaL_Buffer b;
+
+  luaL_buffinit(L, &b);
+  while ((len = enc_fill(L, data, chunk, SJSON_READ)) > 0) {
+    luaL_addlstring(&b, chunk, len);
+  }
+  luaL_pushresult(&b);
+
+  return 1;
+}
+
+static int sjson_encoder_destructor(lua_State *L) {
+  ENC_DATA *data = (ENC_DATA *)lua_touserdata(L, 1);
+
+  while (data->level >= 0) {
+    enc_pop_stack(L, data);
+  }
+
+  luaL_unref(L, LUA_REGISTRYINDEX, data->null_ref);
+  data->null_ref = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->str_ref);
+  data->str_ref = LUA_NOREF;
+
+  free(data->chunk);
+  data->chunk = NULL;
+  data->chunk_size = 0;
+
+  return 0;
+}
+
+static const LUA_REG_TYPE sjson_encoder_map[] = {
+  { LSTRKEY( "read" ),                    LFUNCVAL( sjson_encoder_read ) },
+  { LSTRKEY( "__gc" ),                    LFUNCVAL( sjson_encoder_destructor ) },
+#if LUA_USE_ROTABLE
+  { LSTRKEY( "__index" ),                 LROVAL( sjson_encoder_map ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE sjson_decoder_map[] = {
+  { LSTRKEY( "write" ),                   LFUNCVAL( sjson_decoder_write ) },
+  { LSTRKEY( "result" ),                  LFUNCVAL( sjson_decoder_result ) },
+  { LSTRKEY( "__gc" ),                    LFUNCVAL( sjson_decoder_destructor ) },
+#if LUA_USE_ROTABLE
+  { LSTRKEY( "__index" ),                 LROVAL( sjson_decoder_map ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
+static const LUA_REG_TYPE sjson_map[] = {
+  { LSTRKEY( "encode" ),                  LFUNCVAL( sjson_encode ) },
+  { LSTRKEY( "decode" ),                  LFUNCVAL( sjson_decode ) },
+  { LSTRKEY( "encoder" ),                 LFUNCVAL( sjson_encoder ) },
+  { LSTRKEY( "decoder" ),                 LFUNCVAL( sjson_decoder ) },
+#if LUA_USE_ROTABLE
+  { LSTRKEY( "NULL" ),                    LUDATA( 0 ) },
+#endif
+  { LNILKEY, LNILVAL }
+};
+
+LUALIB_API int luaopen_sjson (lua_State *L) {
+#if LUA_USE_ROTABLE
+  luaL_newmetarotable(L, "sjson.decoder", (void *)sjson_decoder_map);
+  luaL_newmetarotable(L, "sjson.encoder", (void *)sjson_encoder_map);
+  lua_pop(L, 2);
+  return 0;
+#else
+  luaL_newmetatable(L, "sjson.decoder");
+  luaL_setfuncs(L, sjson_decoder_map, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+  luaL_newmetatable(L, "sjson.encoder");
+  luaL_setfuncs(L, sjson_encoder_map, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);
+
+  lua_newtable(L);
+  luaL_setfuncs(L, sjson_map, 0);
+  lua_pushlightuserdata(L, 0);
+  lua_setfield(L, -2, "NULL");
+  return 1;
+#endif
+}
+
+MODULE_REGISTER_MAPPED(SJSON, sjson, sjson_map, luaopen_sjson);
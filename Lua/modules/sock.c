@@ -0,0 +1,814 @@
+/*
+ * bhgv, Lua socket objects
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * A socket is an object with a receive buffer. Lines, delimited and
+ * length prefixed records are cut from the buffer, which one recv() fills
+ * with all that arrived, instead of a recv() per byte. The buffer is
+ * allocated on the first buffered read, and grows up to NET_RBUF_MAX for
+ * a record that does not fit.
+ *
+ *   s = sock.socket(net.SOCK_STREAM | net.SOCK_DGRAM)
+ *   err = s:connect(ip, port)
+ *   err = s:bind(port)
+ *   c, ip, err = s:accept(port, [timeout ms])
+ *   sent, err = s:send(data)
+ *   sent, err = s:sendto(data, ip, port)
+ *   data, err = s:recv(n)               up to n bytes
+ *   data, err = s:recv("*l")            a line, with its "\n"
+ *   data, err = s:recv("*d", delim)     up to delim, with it
+ *   data, err = s:recv("*p", [width])   a record after its length, big
+ *                                       endian in width bytes (1, 2, 4)
+ *   data, ip, port, err = s:recvfrom([n])
+ *   err = s:setblocking(flag)
+ *   err = s:close()
+ *   ready = net.poll({s, ...}, [timeout ms])
+ *
+ * The functions are also called as sock.recv(s, ...) or net.recv(s, ...),
+ * like when sockets were integers, and take the descriptor of s:fd() in
+ * place of s while s is alive. A record that is not all there when a non blocking read
+ * stops stays in the buffer, the read returns "" and ERR_TIMEDOUT. At the
+ * end of the stream the rest of the buffer is returned with ERR_CLOSED,
+ * a line or delimited record longer than NET_RBUF_MAX with ERR_OVERFLOW.
+ *
+ * Green threads wait for data by yielding, not by blocking the scheduler.
+ */
+
+#include "whitecat.h"
+
+#if LUA_USE_NET
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/sockets.h"
+
+#include <sys/drivers/clock.h>
+
+#include "sock.h"
+#include "thread.h"
+
+#define SOCK_USERDATA "sock"
+
+// Registry table of the socket objects by descriptor, with weak values
+#define SOCK_FDS "sock.fds"
+
+typedef struct {
+    int fd;
+    int type;           // NET_SOCK_STREAM or NET_SOCK_DGRAM
+    int nonblock;
+    int listening;
+    char *buf;          // Receive buffer, the data is buf[head .. tail)
+    size_t size;
+    size_t head;
+    size_t tail;
+} sock_userdata;
+
+#define sock_buffered(s) ((s)->tail - (s)->head)
+
+// Reads of recv()
+#define SOCK_READ_SOME   0   // What arrived, up to n bytes
+#define SOCK_READ_DELIM  1   // Up to and with a delimiter
+#define SOCK_READ_PREFIX 2   // A record after its length of n bytes
+
+typedef struct {
+    int mode;
+    size_t n;
+    const char *delim;
+    size_t dlen;
+} sock_read;
+
+static int errno_to_err() {
+    switch (errno) {
+        case 0: return NET_ERR_OK;
+#if EAGAIN != EWOULDBLOCK
+        case EAGAIN:
+#endif
+        case EWOULDBLOCK: return NET_ERR_TIMEDOUT;
+        case ECONNABORTED: return NET_ERR_ABORTED;
+        case ENOTCONN: return NET_ERR_CLOSED;
+        default:
+            return NET_ERR_OTHER;
+    }
+}
+
+// Pushes the table of the socket objects by descriptor
+static void sock_fds(lua_State *L) {
+    if (luaL_getsubtable(L, LUA_REGISTRYINDEX, SOCK_FDS)) {
+        return;
+    }
+
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+}
+
+static sock_userdata *sock_push(lua_State *L, int fd, int type) {
+    sock_userdata *s = (sock_userdata *)lua_newuserdata(L, sizeof(sock_userdata));
+
+    memset(s, 0, sizeof(sock_userdata));
+    s->fd = fd;
+    s->type = type;
+
+    luaL_getmetatable(L, SOCK_USERDATA);
+    lua_setmetatable(L, -2);
+
+    sock_fds(L);
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, -2, fd);
+    lua_pop(L, 1);
+
+    return s;
+}
+
+// The socket object at index, or the one of the descriptor at index, or
+// NULL
+static sock_userdata *sock_test(lua_State *L, int index) {
+    sock_userdata *s;
+
+    index = lua_absindex(L, index);
+    if (!lua_isinteger(L, index)) {
+        return (sock_userdata *)luaL_testudata(L, index, SOCK_USERDATA);
+    }
+
+    sock_fds(L);
+    lua_rawgeti(L, -1, lua_tointeger(L, index));
+    s = (sock_userdata *)lua_touserdata(L, -1);
+    lua_pop(L, 2);
+
+    return s;
+}
+
+static sock_userdata *sock_check(lua_State *L, int index) {
+    sock_userdata *s = sock_test(L, index);
+
+    if (!s) {
+        luaL_argerror(L, index, lua_isinteger(L, index) ? "no socket of this descriptor" : "socket expected");
+    }
+
+    luaL_argcheck(L, s->fd >= 0, index, "socket is closed");
+    return s;
+}
+
+int sock_getfd(lua_State *L, int index, int *pending) {
+    sock_userdata *s;
+
+    *pending = 0;
+    if (lua_isinteger(L, index) && !(s = sock_test(L, index))) {
+        return lua_tointeger(L, index);
+    }
+
+    s = sock_check(L, index);
+    *pending = sock_buffered(s);
+    return s->fd;
+}
+
+// Returns 1 if the socket is readable (or has an error to report) within
+// timeout ms, 0 to not wait, < 0 to wait forever
+static int sock_ready(int fd, int timeout) {
+    struct timeval tv;
+    fd_set rfds;
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    return lwip_select(fd + 1, &rfds, NULL, NULL, (timeout >= 0) ? &tv : NULL) != 0;
+}
+
+static void sock_settimeout(int fd, int timeout) {
+#ifdef PLATFORM_HOST
+    struct timeval tv = {timeout / 1000, (timeout % 1000) * 1000};
+
+    lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+#else
+    lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+}
+
+static void sock_free(sock_userdata *s) {
+    free(s->buf);
+    s->buf = NULL;
+    s->size = s->head = s->tail = 0;
+}
+
+// Receives once into the buffer, with room for want bytes at least.
+// Returns the bytes received, 0 at the end of the stream or -1 on error.
+static int sock_fill(sock_userdata *s, size_t want) {
+    size_t len = sock_buffered(s);
+    int n;
+
+    // What is left is the start of a record, moved to the front
+    if (s->head > 0) {
+        memmove(s->buf, s->buf + s->head, len);
+        s->head = 0;
+        s->tail = len;
+    }
+
+    if (want < NET_RBUF_SIZE) {
+        want = NET_RBUF_SIZE;
+    }
+
+    if (want > s->size) {
+        char *buf = realloc(s->buf, want);
+
+        if (!buf) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        s->buf = buf;
+        s->size = want;
+    }
+
+    n = lwip_recv(s->fd, s->buf + s->tail, s->size - s->tail, 0);
+    if (n > 0) {
+        s->tail += n;
+    }
+
+    return n;
+}
+
+// Finds the record of r at the head of the buffer. Returns 1 and its
+// place when it's all there, or 0 and the size of the buffer it needs.
+static int sock_record(sock_userdata *s, const sock_read *r, size_t *skip, size_t *len, size_t *need) {
+    const char *data = s->buf + s->head;
+    size_t avail = sock_buffered(s);
+
+    *skip = 0;
+
+    if (r->mode == SOCK_READ_PREFIX) {
+        size_t i, n = 0;
+
+        if (avail < r->n) {
+            *need = r->n;
+            return 0;
+        }
+
+        for (i = 0; i < r->n; i++) {
+            n = (n << 8) | (unsigned char)data[i];
+        }
+
+        if (avail < r->n + n) {
+            *need = r->n + n;
+            return 0;
+        }
+
+        *skip = r->n;
+        *len = n;
+        return 1;
+    }
+
+    // SOCK_READ_DELIM
+    if (avail >= r->dlen) {
+        const char *p = data, *end = data + avail - r->dlen + 1;
+
+        while ((p = memchr(p, r->delim[0], end - p))) {
+            if (!memcmp(p, r->delim, r->dlen)) {
+                *len = p - data + r->dlen;
+                return 1;
+            }
+            p++;
+        }
+    }
+
+    // A full buffer grows
+    *need = (s->head == 0 && s->tail == s->size) ? s->size * 2 : s->size;
+    return 0;
+}
+
+static int sock_result(lua_State *L, sock_userdata *s, size_t skip, size_t len, int err) {
+    lua_pushlstring(L, s->buf + s->head + skip, len);
+    lua_pushinteger(L, err);
+
+    s->head += skip + len;
+    if (s->head == s->tail) {
+        s->head = s->tail = 0;
+    }
+
+    return 2;
+}
+
+static void sock_read_args(lua_State *L, sock_read *r) {
+    const char *mode;
+
+    r->delim = "\n";
+    r->dlen = 1;
+
+    if (lua_isnumber(L, 2)) {
+        r->mode = SOCK_READ_SOME;
+        r->n = luaL_checkinteger(L, 2);
+        luaL_argcheck(L, r->n > 0, 2, "size must be positive");
+        return;
+    }
+
+    mode = luaL_checkstring(L, 2);
+    if (!strcmp(mode, "*l")) {
+        r->mode = SOCK_READ_DELIM;
+    } else if (!strcmp(mode, "*d")) {
+        r->mode = SOCK_READ_DELIM;
+        r->delim = luaL_checklstring(L, 3, &r->dlen);
+        luaL_argcheck(L, r->dlen > 0, 3, "empty delimiter");
+    } else if (!strcmp(mode, "*p")) {
+        r->mode = SOCK_READ_PREFIX;
+        r->n = luaL_optinteger(L, 3, 2);
+        luaL_argcheck(L, r->n == 1 || r->n == 2 || r->n == 4, 3, "width must be 1, 2 or 4");
+    } else {
+        luaL_argerror(L, 2, "invalid read mode");
+    }
+}
+
+// Lua: sock = socket( type )
+int sock_socket( lua_State *L ) {
+    int type = ( int )luaL_checkinteger( L, 1 );
+    int fd;
+
+    switch (type) {
+        case NET_SOCK_DGRAM:
+            fd = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+            break;
+
+        case NET_SOCK_STREAM:
+            fd = lwip_socket(AF_INET, SOCK_STREAM, 0);
+            break;
+
+        default:
+            return luaL_argerror(L, 1, "invalid socket type");
+    }
+
+    if (fd < 0) {
+        lua_pushnil(L);
+        lua_pushinteger(L, errno_to_err());
+        return 2;
+    }
+
+    sock_push(L, fd, type);
+    return 1;
+}
+
+// Lua: res = close( sock )
+int sock_close(lua_State* L) {
+    sock_userdata *s = sock_check(L, 1);
+    int ret = NET_ERR_OK;
+
+    if (lwip_close(s->fd) < 0) {
+        ret = errno_to_err();
+    }
+
+    sock_fds(L);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, s->fd);
+    lua_pop(L, 1);
+
+    s->fd = -1;
+    sock_free(s);
+
+    lua_pushinteger( L, ret );
+    return 1;
+}
+
+static int sock_gc(lua_State* L) {
+    sock_userdata *s = (sock_userdata *)luaL_checkudata(L, 1, SOCK_USERDATA);
+
+    if (s->fd >= 0) {
+        lwip_close(s->fd);
+        s->fd = -1;
+    }
+    sock_free(s);
+
+    return 0;
+}
+
+static int sock_tostring(lua_State* L) {
+    sock_userdata *s = (sock_userdata *)luaL_checkudata(L, 1, SOCK_USERDATA);
+
+    lua_pushfstring(L, "sock (%d)", s->fd);
+    return 1;
+}
+
+// Lua: fd = fd( sock )
+static int sock_fd(lua_State* L) {
+    lua_pushinteger(L, sock_check(L, 1)->fd);
+    return 1;
+}
+
+static int sock_bind_port(sock_userdata *s, int port) {
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (lwip_bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        return errno_to_err();
+    }
+
+    return NET_ERR_OK;
+}
+
+// Lua: err = bind( sock, port )
+static int sock_bind(lua_State* L) {
+    sock_userdata *s = sock_check(L, 1);
+    int port = luaL_checkinteger(L, 2);
+
+    lua_pushinteger(L, sock_bind_port(s, port));
+    return 1;
+}
+
+// Lua: sock, ip, err = accept( sock, port, [timeout] )
+// Binds and listens on the first call. A datagram socket is only bound.
+int sock_accept( lua_State *L ) {
+    sock_userdata *s = sock_check(L, 1);
+    int port = luaL_checkinteger( L, 2 );
+    int timeout = luaL_optinteger( L, 3, 0 );
+    struct sockaddr_in cli_addr;
+    socklen_t clilen = sizeof(cli_addr);
+    int ret = NET_ERR_OK;
+    int fd;
+
+    memset(&cli_addr, 0, sizeof(cli_addr));
+
+    if (!s->listening) {
+        if ((ret = sock_bind_port(s, port)) != NET_ERR_OK) {
+            goto exit;
+        }
+
+        if (s->type == NET_SOCK_STREAM) {
+            lwip_listen(s->fd, 5);
+        }
+
+        s->listening = 1;
+    }
+
+    sock_settimeout(s->fd, timeout);
+
+    if (s->type == NET_SOCK_STREAM) {
+        fd = lwip_accept(s->fd, (struct sockaddr *)&cli_addr, &clilen);
+        if (fd < 0) {
+            ret = errno_to_err();
+            goto exit;
+        }
+
+        sock_push(L, fd, NET_SOCK_STREAM);
+        lua_pushinteger( L, cli_addr.sin_addr.s_addr );
+        lua_pushinteger( L, ret );
+        return 3;
+    }
+
+exit:
+    lua_pushnil( L );
+    lua_pushinteger( L, cli_addr.sin_addr.s_addr );
+    lua_pushinteger( L, ret );
+    return 3;
+}
+
+// Lua: err = connect( sock, iptype, port )
+// "iptype" is actually an int returned by "net.packip". A datagram socket
+// gets its default peer.
+int sock_connect( lua_State *L ) {
+    sock_userdata *s = sock_check(L, 1);
+    struct sockaddr_in address;
+    int ret = NET_ERR_OK;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ( uint32_t )luaL_checkinteger( L, 2 );
+    address.sin_port = htons(( uint16_t )luaL_checkinteger( L, 3 ));
+
+    if (lwip_connect(s->fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        ret = errno_to_err();
+    }
+
+    lua_pushinteger( L, ret );
+    return 1;
+}
+
+// Lua: sent, err = send( sock, str )
+int sock_send(lua_State* L) {
+    sock_userdata *s = sock_check(L, 1);
+    size_t siz;
+    const char *buf = luaL_checklstring( L, 2, &siz );
+    int sent, ret = NET_ERR_OK;
+
+    if ((sent = lwip_send(s->fd, buf, siz, 0)) < 0) {
+        ret = errno_to_err();
+        sent = 0;
+    }
+
+    lua_pushinteger( L, sent );
+    lua_pushinteger( L, ret );
+    return 2;
+}
+
+// Lua: sent, err = sendto( sock, str, iptype, port )
+static int sock_sendto(lua_State* L) {
+    sock_userdata *s = sock_check(L, 1);
+    size_t siz;
+    const char *buf = luaL_checklstring( L, 2, &siz );
+    struct sockaddr_in address;
+    int sent, ret = NET_ERR_OK;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ( uint32_t )luaL_checkinteger( L, 3 );
+    address.sin_port = htons(( uint16_t )luaL_checkinteger( L, 4 ));
+
+    if ((sent = lwip_sendto(s->fd, buf, siz, 0, (struct sockaddr *)&address, sizeof(address))) < 0) {
+        ret = errno_to_err();
+        sent = 0;
+    }
+
+    lua_pushinteger( L, sent );
+    lua_pushinteger( L, ret );
+    return 2;
+}
+
+// Lua: err = setblocking( sock, flag )
+static int sock_setblocking(lua_State* L) {
+    sock_userdata *s = sock_check(L, 1);
+    int nonblock = !lua_toboolean(L, 2);
+    int ret = NET_ERR_OK;
+
+    if (lwip_fcntl(s->fd, F_SETFL, nonblock ? O_NONBLOCK : 0) < 0) {
+        ret = errno_to_err();
+    } else {
+        s->nonblock = nonblock;
+    }
+
+    lua_pushinteger( L, ret );
+    return 1;
+}
+
+// A green thread yields until the socket is readable, before a recv()
+// that would block the scheduler
+#define sock_wait(L, s, k) \
+    if (!(s)->nonblock && thread_is_green(L) && !sock_ready((s)->fd, 0)) { \
+        return thread_yield_wait(L, THREAD_WAIT_FD, (void *)(intptr_t)(s)->fd, 0, 0, k); \
+    }
+
+// Lua: data, err = recv( sock, maxsize ), or
+//      data, err = recv( sock, "*l" ), or
+//      data, err = recv( sock, "*d", delim ), or
+//      data, err = recv( sock, "*p", [width] )
+static int sock_recv_k( lua_State *L, int status, lua_KContext ctx ) {
+    sock_userdata *s = sock_check(L, 1);
+    size_t skip, len, need;
+    luaL_Buffer b;
+    sock_read r;
+    char *p;
+    int n;
+
+    sock_read_args(L, &r);
+
+    if (r.mode == SOCK_READ_SOME) {
+        if (sock_buffered(s) > 0) {
+            len = sock_buffered(s);
+            return sock_result(L, s, 0, (len < r.n) ? len : r.n, NET_ERR_OK);
+        }
+
+        // Nothing buffered, straight into the string
+        sock_wait(L, s, sock_recv_k);
+
+        p = luaL_buffinitsize(L, &b, r.n);
+        if ((n = lwip_recv(s->fd, p, r.n, 0)) <= 0) {
+            luaL_pushresultsize(&b, 0);
+            lua_pushinteger(L, (n == 0) ? NET_ERR_CLOSED : errno_to_err());
+            return 2;
+        }
+
+        luaL_pushresultsize(&b, n);
+        lua_pushinteger(L, NET_ERR_OK);
+        return 2;
+    }
+
+    while (!sock_record(s, &r, &skip, &len, &need)) {
+        if (need > NET_RBUF_MAX) {
+            // Too long, a line is returned in pieces
+            if (r.mode == SOCK_READ_DELIM) {
+                return sock_result(L, s, 0, sock_buffered(s), NET_ERR_OVERFLOW);
+            }
+
+            lua_pushliteral(L, "");
+            lua_pushinteger(L, NET_ERR_OVERFLOW);
+            return 2;
+        }
+
+        sock_wait(L, s, sock_recv_k);
+
+        if ((n = sock_fill(s, need)) == 0) {
+            // The end of the stream, the rest of the buffer
+            return sock_result(L, s, 0, sock_buffered(s), NET_ERR_CLOSED);
+        }
+
+        if (n < 0) {
+            // The record stays in the buffer for the next read
+            lua_pushliteral(L, "");
+            lua_pushinteger(L, errno_to_err());
+            return 2;
+        }
+    }
+
+    return sock_result(L, s, skip, len, NET_ERR_OK);
+}
+
+int sock_recv( lua_State *L ) {
+    return sock_recv_k(L, LUA_OK, 0);
+}
+
+// Lua: data, ip, port, err = recvfrom( sock, [maxsize] )
+static int sock_recvfrom_k( lua_State *L, int status, lua_KContext ctx ) {
+    sock_userdata *s = sock_check(L, 1);
+    size_t maxsize = luaL_optinteger(L, 2, NET_DGRAM_MAX);
+    struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    luaL_Buffer b;
+    int n, ret = NET_ERR_OK;
+    char *p;
+
+    luaL_argcheck(L, maxsize > 0, 2, "size must be positive");
+
+    sock_wait(L, s, sock_recvfrom_k);
+
+    memset(&from, 0, sizeof(from));
+
+    p = luaL_buffinitsize(L, &b, maxsize);
+    if ((n = lwip_recvfrom(s->fd, p, maxsize, 0, (struct sockaddr *)&from, &fromlen)) < 0) {
+        ret = errno_to_err();
+        n = 0;
+    }
+
+    luaL_pushresultsize(&b, n);
+    lua_pushinteger(L, from.sin_addr.s_addr);
+    lua_pushinteger(L, ntohs(from.sin_port));
+    lua_pushinteger(L, ret);
+    return 4;
+}
+
+static int sock_recvfrom( lua_State *L ) {
+    return sock_recvfrom_k(L, LUA_OK, 0);
+}
+
+// Puts the sockets of the table at index 1 in rfds, returns the highest
+// descriptor, and in pending the sockets with buffered data
+static int sock_poll_set(lua_State *L, fd_set *rfds, int *pending) {
+    sock_userdata *s;
+    int i, n, maxfd = -1;
+
+    FD_ZERO(rfds);
+    *pending = 0;
+
+    n = lua_rawlen(L, 1);
+    for (i = 1; i <= n; i++) {
+        lua_rawgeti(L, 1, i);
+        s = sock_test(L, -1);
+        if (!s || s->fd < 0) {
+            luaL_error(L, "socket expected at %d", i);
+        }
+        lua_pop(L, 1);
+
+        if (sock_buffered(s)) {
+            (*pending)++;
+        }
+
+        FD_SET(s->fd, rfds);
+        if (s->fd > maxfd) {
+            maxfd = s->fd;
+        }
+    }
+
+    return maxfd;
+}
+
+// Pushes the table of the ready sockets, with buffered data or in rfds
+static void sock_poll_result(lua_State *L, fd_set *rfds) {
+    sock_userdata *s;
+    int i, n, j = 0;
+
+    lua_newtable(L);
+
+    n = lua_rawlen(L, 1);
+    for (i = 1; i <= n; i++) {
+        lua_rawgeti(L, 1, i);
+        s = sock_test(L, -1);
+        if (sock_buffered(s) || FD_ISSET(s->fd, rfds)) {
+            lua_rawseti(L, -2, ++j);
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+}
+
+// Green threads poll every NET_POLL_MS, ctx is the deadline in ms
+static int sock_poll_k(lua_State *L, int status, lua_KContext ctx) {
+    int timeout = luaL_optinteger(L, 2, -1);
+    int32_t left = (int32_t)((uint32_t)ctx - (uint32_t)(clock_monotonic_us() / 1000));
+    struct timeval tv = {0, 0};
+    int maxfd, pending, n;
+    fd_set rfds;
+
+    maxfd = sock_poll_set(L, &rfds, &pending);
+    n = lwip_select(maxfd + 1, &rfds, NULL, NULL, &tv);
+    if (n < 0) {
+        FD_ZERO(&rfds);
+    }
+
+    if ((n == 0) && !pending && ((timeout < 0) || (left > 0))) {
+        if ((timeout < 0) || (left > NET_POLL_MS)) {
+            left = NET_POLL_MS;
+        }
+        return thread_yield_wait(L, THREAD_WAIT_SLEEP, NULL, (uint64_t)left * 1000, ctx, sock_poll_k);
+    }
+
+    sock_poll_result(L, &rfds);
+    return 1;
+}
+
+// Lua: ready = poll( {sock1, sock2, ...}, [timeout] )
+// The sockets of the list that are readable, have buffered data, or an
+// error to report, in timeout ms at most (no timeout if not given)
+int sock_poll(lua_State *L) {
+    int timeout = luaL_optinteger(L, 2, -1);
+    struct timeval tv;
+    int maxfd, pending;
+    fd_set rfds;
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_settop(L, 2);
+
+    if (thread_is_green(L)) {
+        return sock_poll_k(L, LUA_OK, (lua_KContext)(uint32_t)(clock_monotonic_us() / 1000 + timeout));
+    }
+
+    maxfd = sock_poll_set(L, &rfds, &pending);
+    if (pending) {
+        timeout = 0;
+    }
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    if (lwip_select(maxfd + 1, &rfds, NULL, NULL, (timeout >= 0) ? &tv : NULL) < 0) {
+        FD_ZERO(&rfds);
+    }
+
+    sock_poll_result(L, &rfds);
+    return 1;
+}
+
+
+#include "modules.h"
+
+const LUA_REG_TYPE sock_map[] = {
+    { LSTRKEY( "socket" ),		LFUNCVAL( sock_socket )},
+    { LSTRKEY( "accept" ),		LFUNCVAL( sock_accept )},
+    { LSTRKEY( "bind" ),		LFUNCVAL( sock_bind )},
+    { LSTRKEY( "connect" ),		LFUNCVAL( sock_connect )},
+    { LSTRKEY( "close" ),		LFUNCVAL( sock_close )},
+    { LSTRKEY( "send" ),		LFUNCVAL( sock_send )},
+    { LSTRKEY( "sendto" ),		LFUNCVAL( sock_sendto )},
+    { LSTRKEY( "recv" ),		LFUNCVAL( sock_recv )},
+    { LSTRKEY( "recvfrom" ),	LFUNCVAL( sock_recvfrom )},
+    { LSTRKEY( "setblocking" ),	LFUNCVAL( sock_setblocking )},
+    { LSTRKEY( "fd" ),			LFUNCVAL( sock_fd )},
+    { LSTRKEY( "poll" ),		LFUNCVAL( sock_poll )},
+#if LUA_USE_ROTABLE
+    { LSTRKEY( "__index" ),		LROVAL( sock_map )},
+#endif
+    { LSTRKEY( "__gc" ),		LFUNCVAL( sock_gc )},
+    { LSTRKEY( "__tostring" ),	LFUNCVAL( sock_tostring )},
+	{ LNILKEY, LNILVAL }
+};
+
+int luaopen_sock( lua_State *L ) {
+#if LUA_USE_ROTABLE
+    luaL_newmetarotable(L, SOCK_USERDATA, (void *)sock_map);
+    lua_pop(L, 1);
+    return 0;
+#else
+    luaL_newmetatable(L, SOCK_USERDATA);
+    luaL_setfuncs(L, sock_map, 0);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -2, "__index");
+    return 1;
+#endif
+}
+
+MODULE_REGISTER_MAPPED(SOCK, sock, sock_map, luaopen_sock);
+
+#endif
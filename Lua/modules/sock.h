@@ -0,0 +1,67 @@
+/*
+ * bhgv, Lua socket objects
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef SOCK_H
+#define	SOCK_H
+
+#include "lua.h"
+
+// Socket types of sock.socket()
+#define NET_SOCK_STREAM          0
+#define NET_SOCK_DGRAM           1
+
+// Errors returned by the socket functions
+enum {
+  NET_ERR_OK = 0,
+  NET_ERR_TIMEDOUT,
+  NET_ERR_CLOSED,
+  NET_ERR_ABORTED,
+  NET_ERR_OVERFLOW,
+  NET_ERR_OTHER,
+};
+
+// Initial size of the receive buffer of a socket, allocated on its first
+// buffered read
+#ifndef NET_RBUF_SIZE
+#define NET_RBUF_SIZE            256
+#endif
+
+// The buffer grows up to this size for a record that does not fit
+#ifndef NET_RBUF_MAX
+#define NET_RBUF_MAX             4096
+#endif
+
+// Default size of a datagram read by recvfrom
+#ifndef NET_DGRAM_MAX
+#define NET_DGRAM_MAX            1472
+#endif
+
+// Period a green thread polls its sockets at in net.poll(), in ms
+#ifndef NET_POLL_MS
+#define NET_POLL_MS              10
+#endif
+
+// The functions net keeps for the scripts written when sockets were
+// integers
+int sock_socket(lua_State *L);
+int sock_accept(lua_State *L);
+int sock_connect(lua_State *L);
+int sock_send(lua_State *L);
+int sock_recv(lua_State *L);
+int sock_close(lua_State *L);
+
+// Lua: ready = net.poll({s1, s2, ...}, [timeout ms])
+int sock_poll(lua_State *L);
+
+// Socket descriptor of the socket object, or of the integer, at index.
+// pending gets the bytes already in its receive buffer.
+int sock_getfd(lua_State *L, int index, int *pending);
+
+#endif	/* SOCK_H */
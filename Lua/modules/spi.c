@@ -1,5 +1,7 @@
 // Module for interfacing with the SPI interface
 
+#include <string.h>
+
 #include "c_types.h"
 #include "etstimer.h"
 
@@ -14,6 +16,8 @@
 //#include "drivers/esp8266/spi.h"
 #include "esp/spi.h"
 
+#include "data.h"
+
 #define SPI_HALFDUPLEX 0
 #define SPI_FULLDUPLEX 1
 
@@ -25,6 +29,16 @@
 
 #define lua_objlen(L,i)		lua_rawlen(L, (i))
 
+// Size of the hardware buffer, the most moved by one transfer
+#define SPI_BUF_SIZE 64
+
+// Words of a table, gathered to be transferred a buffer at a time
+typedef union {
+  uint8_t  u8[SPI_BUF_SIZE];
+  uint16_t u16[SPI_BUF_SIZE / 2];
+  uint32_t u32[SPI_BUF_SIZE / 4];
+} spi_words_t;
+
 
 #if 0
 // Lua: = spi.setup( id, mode, cpol, cpha, databits, clock_div, [duplex_mode] )
@@ -98,18 +112,72 @@ static uint32_t _aux_spi_send_recv(int id, uint32_t data, char bits)
 	return r;
 }
 
+static void _aux_spi_set_word(spi_words_t *w, size_t i, uint32_t data, char bits)
+{
+	switch(bits){
+		case SPI_16BIT: w->u16[i] = data; break;
+		case SPI_32BIT: w->u32[i] = data; break;
+		default:        w->u8[i] = data;  break;
+	};
+}
+
+static uint32_t _aux_spi_get_word(spi_words_t *w, size_t i, char bits)
+{
+	switch(bits){
+		case SPI_16BIT: return w->u16[i];
+		case SPI_32BIT: return w->u32[i];
+		default:        return w->u8[i];
+	};
+}
+
+// Data of a string or a luadata object, and its length in words. Returns
+// NULL for other types, raises an error if the length is not whole words.
+static const char *_aux_spi_buffer(lua_State *L, int idx, char bits, size_t *words, char **in)
+{
+	const char *p = NULL;
+	data_t *data;
+	size_t len = 0;
+
+	*in = NULL;
+
+	if (lua_type(L, idx) == LUA_TSTRING) {
+		p = lua_tolstring(L, idx, &len);
+	} else if ((data = data_test(L, idx)) != NULL) {
+		if (data->raw->ptr == NULL) {
+			luaL_argerror(L, idx, "released data");
+		}
+
+		// A data object receives in place
+		*in = data_get_ptr(data);
+		p = *in;
+		len = data->length;
+	} else {
+		return NULL;
+	}
+
+	if (len % bits) {
+		luaL_argerror(L, idx, "length is not a multiple of the word size");
+	}
+
+	*words = len / bits;
+
+	return p;
+}
+
 
 // Half-duplex mode:
 // Lua: wrote  = spi.send( id, data1, [data2], ..., [datan] )
 // Full-duplex mode:
 // Lua: wrote, [data1], ..., [datan]  = spi.send_recv( id, data1, [data2], ..., [datan] )
-// data can be either a string, a table or an 8-bit number
+// data can be either a string, a table, a luadata object or a number
 static int spi_send_recv( lua_State *L )
 {
   unsigned id = 1; 
   char bits = luaL_optinteger( L, 1, SPI_8BIT );
   const char *pdata;
-  size_t datalen, i;
+  char *pin;
+  size_t datalen, i, j, chunk;
+  spi_words_t words;
   u32 numdata;
   u32 wrote = 0;
   int pushed = 1;
@@ -159,25 +227,45 @@ static int spi_send_recv( lua_State *L )
         pushed ++;
       }
 
-      for( i = 0; i < datalen; i ++ )
+      // A hardware buffer of words at a time
+      for( i = 0; i < datalen; i += chunk )
       {
-        lua_rawgeti( L, argn, i + 1 );
-        numdata = luaL_checkinteger( L, -1 );
-        lua_pop( L, 1 );
-//        if (recv > 0) 
-		{
-//          lua_pushinteger( L, platform_spi_send_recv( id, spi_databits[id], numdata ) );
-          lua_pushinteger( L, _aux_spi_send_recv(id, numdata, bits) );
-          lua_rawseti( L, -2, i + 1 );
+        chunk = datalen - i;
+        if( chunk > SPI_BUF_SIZE / bits )
+          chunk = SPI_BUF_SIZE / bits;
+
+        for( j = 0; j < chunk; j ++ )
+        {
+          lua_rawgeti( L, argn, i + j + 1 );
+          numdata = luaL_checkinteger( L, -1 );
+          lua_pop( L, 1 );
+          _aux_spi_set_word( &words, j, numdata, bits );
+        }
+
+        spi_transfer( id, words.u8, words.u8, chunk, bits );
+
+        for( j = 0; j < chunk; j ++ )
+        {
+          lua_pushinteger( L, _aux_spi_get_word( &words, j, bits ) );
+          lua_rawseti( L, -2, i + j + 1 );
         }
-//        else
-//        {
-//          platform_spi_send( id, spi_databits[id], numdata );
-//        }
       }
-      wrote += i;
-      if( i < datalen )
-        break;
+      wrote += datalen;
+    }
+
+    // *** Send a luadata object, received data replaces its contents ***
+    else if( lua_type( L, argn ) == LUA_TUSERDATA )
+    {
+      pdata = _aux_spi_buffer( L, argn, bits, &datalen, &pin );
+      if( pdata == NULL )
+        return luaL_argerror( L, argn, "number, table, string or data expected" );
+
+      if( datalen > 0 )
+        spi_transfer( id, pdata, pin, datalen, bits );
+
+      lua_pushvalue( L, argn );
+      pushed ++;
+      wrote += datalen;
     }
 
     // *** Send characters of a string and return received data items as string ***
@@ -186,29 +274,17 @@ static int spi_send_recv( lua_State *L )
       luaL_Buffer b;
 
       pdata = luaL_checklstring( L, argn, &datalen );
-      if (recv > 0) {
-        luaL_buffinit( L, &b );
-      }
 
-      for( i = 0; i < datalen; i ++ )
-      {
-//        if (recv > 0)
-        {
-//          luaL_addchar( &b, (char)platform_spi_send_recv( id, spi_databits[id], pdata[ i ] ) );
-          luaL_addchar( &b, (char)_aux_spi_send_recv(id, pdata[ i ], /*bits*/SPI_8BIT) );
-        }
-//        else
-//        {
-//          platform_spi_send( id, spi_databits[id], pdata[ i ] );
-//        }
-      }
+      // The whole string in one transfer, received into the result buffer
       if (recv > 0 && datalen > 0) {
+        luaL_buffinit( L, &b );
+        pin = luaL_prepbuffsize( &b, datalen );
+        spi_transfer( id, pdata, pin, datalen, SPI_8BIT );
+        luaL_addsize( &b, datalen );
         luaL_pushresult( &b );
         pushed ++;
       }
-      wrote += i;
-      if( i < datalen )
-        break;
+      wrote += datalen;
     }
   }
 
@@ -236,7 +312,21 @@ static int spi_recv( lua_State *L )
   }
 
   luaL_buffinit( L, &b );
-  for (i=0; i<size; i++)
+  if (bits == SPI_8BIT)
+  {
+    // Bytes are received straight into the result, a buffer at a time
+    uint8_t out[SPI_BUF_SIZE];
+    int chunk;
+
+    memset( out, def, sizeof(out) );
+    for (i=0; i<size; i+=chunk)
+    {
+      chunk = (size - i > SPI_BUF_SIZE) ? SPI_BUF_SIZE : size - i;
+      spi_transfer( id, out, luaL_prepbuffsize( &b, chunk ), chunk, SPI_8BIT );
+      luaL_addsize( &b, chunk );
+    }
+  }
+  else for (i=0; i<size; i++)
   {
 //    luaL_addchar( &b, ( char )platform_spi_send_recv( id, spi_databits[id], def ) );
     luaL_addchar( &b, ( char )_aux_spi_send_recv(id, def, bits) );
@@ -246,6 +336,70 @@ static int spi_recv( lua_State *L )
   return 1;
 }
 
+// Lua: words = spi.transfer( bits, out, [in] )
+// out is a string or a luadata object, sent in one go. The received words
+// go to the luadata object in, or are dropped, so nothing is allocated.
+static int spi_transfer_buf( lua_State *L )
+{
+  unsigned id = 1;
+  char bits = luaL_optinteger( L, 1, SPI_8BIT );
+  const char *out;
+  char *in;
+  size_t words, in_words;
+
+  if(bits != SPI_8BIT && bits != SPI_16BIT && bits != SPI_32BIT) return 0;
+
+  MOD_CHECK_ID( spi, id );
+
+  out = _aux_spi_buffer( L, 2, bits, &words, &in );
+  luaL_argcheck( L, out != NULL, 2, "string or data expected" );
+
+  if (lua_isnoneornil( L, 3 )) {
+    in = NULL;
+  } else {
+    luaL_argcheck( L, data_test( L, 3 ) != NULL, 3, "data expected" );
+    _aux_spi_buffer( L, 3, bits, &in_words, &in );
+    luaL_argcheck( L, in_words >= words, 3, "smaller than out" );
+  }
+
+  lua_pushinteger( L, words ? spi_transfer( id, out, in, words, bits ) : 0 );
+  return 1;
+}
+
+// Lua: frames = spi.frames( bits, out, frame_len, [in] )
+// Queues out as back to back frames of frame_len words, the bus is set up
+// once for all of them. A frame is at most 64 bytes, out holds whole frames.
+static int spi_frames( lua_State *L )
+{
+  unsigned id = 1;
+  char bits = luaL_optinteger( L, 1, SPI_8BIT );
+  size_t frame_len = luaL_checkinteger( L, 3 );
+  const char *out;
+  char *in;
+  size_t words, in_words;
+
+  if(bits != SPI_8BIT && bits != SPI_16BIT && bits != SPI_32BIT) return 0;
+
+  MOD_CHECK_ID( spi, id );
+
+  luaL_argcheck( L, frame_len > 0 && frame_len * bits <= SPI_BUF_SIZE, 3, "out of range" );
+
+  out = _aux_spi_buffer( L, 2, bits, &words, &in );
+  luaL_argcheck( L, out != NULL, 2, "string or data expected" );
+  luaL_argcheck( L, words % frame_len == 0, 2, "not whole frames" );
+
+  if (lua_isnoneornil( L, 4 )) {
+    in = NULL;
+  } else {
+    luaL_argcheck( L, data_test( L, 4 ) != NULL, 4, "data expected" );
+    _aux_spi_buffer( L, 4, bits, &in_words, &in );
+    luaL_argcheck( L, in_words >= words, 4, "smaller than out" );
+  }
+
+  lua_pushinteger( L, words ? spi_transfer_frames( id, out, in, frame_len, words / frame_len, bits ) : 0 );
+  return 1;
+}
+
 #if 0
 // Lua: spi.set_mosi( id, offset, bitlen, data1, [data2], ..., [datan] )
 // Lua: spi.set_mosi( id, string )
@@ -372,6 +526,8 @@ static const LUA_REG_TYPE spi_map[] = {
 //  { LSTRKEY( "setup" ),       LFUNCVAL( spi_setup ) },
   { LSTRKEY( "send" ),        LFUNCVAL( spi_send_recv ) },
   { LSTRKEY( "recv" ),        LFUNCVAL( spi_recv ) },
+  { LSTRKEY( "transfer" ),    LFUNCVAL( spi_transfer_buf ) },
+  { LSTRKEY( "frames" ),      LFUNCVAL( spi_frames ) },
 //  { LSTRKEY( "set_mosi" ),    LFUNCVAL( spi_set_mosi ) },
 //  { LSTRKEY( "get_miso" ),    LFUNCVAL( spi_get_miso ) },
 //  { LSTRKEY( "transaction" ), LFUNCVAL( spi_transaction ) },
@@ -1,234 +1,271 @@
 /*
- * Whitecat, stepper Lua module
+ * bhgv, stepper Lua module
  *
- * Copyright (C) 2015 - 2016
- * IBEROXARXA SERVICIOS INTEGRALES, S.L. & CSS IBÉRICA, S.L.
- * 
- * Author: Jaume Olivé (jolive@iberoxarxa.com / jolive@whitecatboard.org)
- * 
- * All rights reserved.  
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
  *
- * Permission to use, copy, modify, and distribute this software
- * and its documentation for any purpose and without fee is hereby
- * granted, provided that the above copyright notice appear in all
- * copies and that both that the copyright notice and this
- * permission notice and warranty disclaimer appear in supporting
- * documentation, and that the name of the author not be used in
- * advertising or publicity pertaining to distribution of the
- * software without specific, written prior permission.
+ * All rights reserved.
  *
- * The author disclaim all warranties with regard to this
- * software, including all implied warranties of merchantability
- * and fitness.  In no event shall the author be liable for any
- * special, indirect or consequential damages or any damages
- * whatsoever resulting from loss of use, data or profits, whether
- * in an action of contract, negligence or other tortious action,
- * arising out of or in connection with the use or performance of
- * this software.
  */
 
-#include "whitecat.h"
+/*
+ * Lines queued to the motion planner, see sys/drivers/motion.c
+ *
+ *   stepper.setup{step = {4, 5, 12}, dir = {13, 14, 15},
+ *                 steps_per_mm = {80, 80, 400}, rate = {100, 100, 10},
+ *                 accel = {500, 500, 100}, [junction = 0.02], [pulse = 2]}
+ *   stepper.move(x, [y], [z], [feed])   mm and mm/s, nil keeps the axis
+ *   stepper.start()                     the queue starts when full else
+ *   stepper.wait()                      starts and waits for the end
+ *   stepper.stop()                      at once, the queue is flushed
+ *   busy = stepper.busy()
+ *   x, y, z = stepper.position([x, y, z])
+ *   stats = stepper.stats()
+ *
+ * move() waits while the queue is full, so a loop of moves (the lines of a
+ * G-code file) keeps the queue full and the planner sees MOTION_QUEUE lines
+ * ahead.
+ */
 
-#if LUA_USE_STEPPER
+#include "FreeRTOS.h"
+#include "task.h"
 
 #include "lua.h"
 #include "lauxlib.h"
+#include "modules.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "sys/drivers/motion.h"
+
+#define STEPPER_JUNCTION 0.02
+#define STEPPER_PULSE_US 2
+
+// The last target and feed of move()
+static float target[MOTION_AXES];
+static float feed = 0;
+static int axes = 0;
+
+// The n values of the array field name, or 0
+static int get_array(lua_State *L, const char *name, float *v, int need) {
+	int i, n;
+
+	lua_getfield(L, 1, name);
+	if (lua_isnil(L, -1)) {
+		lua_pop(L, 1);
+		if (need) {
+			return luaL_error(L, "%s expected", name);
+		}
+		return 0;
+	}
+
+	luaL_checktype(L, -1, LUA_TTABLE);
+	n = luaL_len(L, -1);
+	if (n > MOTION_AXES) {
+		return luaL_error(L, "%s: %d axes at most", name, MOTION_AXES);
+	}
+
+	for (i = 0; i < n; i++) {
+		lua_rawgeti(L, -1, i + 1);
+		v[i] = luaL_checknumber(L, -1);
+		lua_pop(L, 1);
+	}
+
+	lua_pop(L, 1);
+	return n;
+}
+
+// Lua: stepper.setup{...}
+static int lstepper_setup(lua_State *L) {
+	motion_config_t cfg;
+	float v[MOTION_AXES];
+	int i, n, d;
+
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	memset(&cfg, 0, sizeof(cfg));
+
+	n = get_array(L, "step", v, 1);
+	for (i = 0; i < n; i++) {
+		cfg.step_pin[i] = v[i];
+		cfg.dir_pin[i] = MOTION_NO_PIN;
+	}
+	cfg.axes = n;
+
+	if ((d = get_array(L, "dir", v, 0)) > n) {
+		return luaL_error(L, "more dir than step pins");
+	}
+	for (i = 0; i < d; i++) {
+		cfg.dir_pin[i] = v[i];
+	}
+
+	if ((get_array(L, "steps_per_mm", cfg.steps_per_mm, 1) != n) ||
+		(get_array(L, "rate", cfg.rate, 1) != n) ||
+		(get_array(L, "accel", cfg.accel, 1) != n)) {
+		return luaL_error(L, "a value of steps_per_mm, rate and accel per step pin expected");
+	}
+
+	lua_getfield(L, 1, "junction");
+	cfg.junction = luaL_optnumber(L, -1, STEPPER_JUNCTION);
+	lua_getfield(L, 1, "pulse");
+	cfg.pulse_us = luaL_optinteger(L, -1, STEPPER_PULSE_US);
+	lua_pop(L, 2);
+
+	if (motion_setup(&cfg)) {
+		return luaL_error(L, "invalid setup");
+	}
+
+	axes = n;
+	memset(target, 0, sizeof(target));
+	feed = cfg.rate[0];
+	for (i = 1; i < n; i++) {
+		if (cfg.rate[i] < feed) {
+			feed = cfg.rate[i];
+		}
+	}
+
+	return 0;
+}
 
-#include <drivers/gpio/gpio.h>
-#include <drivers/cpu/error.h>
-#include <drivers/stepper/stepper.h>
+// Lua: stepper.move(x, [y], [z], [feed])
+static int lstepper_move(lua_State *L) {
+	float to[MOTION_AXES];
+	int i, res;
 
-static int setup = 0;
-static int lstepper_id = 0;
+	if (!axes) {
+		return luaL_error(L, "stepper is not setup");
+	}
 
-typedef struct {
-    int unit;
-} stepper_userdata;
+	memcpy(to, target, sizeof(to));
+	for (i = 0; i < axes; i++) {
+		if (!lua_isnoneornil(L, i + 1)) {
+			to[i] = luaL_checknumber(L, i + 1);
+		}
+	}
 
-struct lstepp {
-    int setup;
-    int done;
-};
+	if (!lua_isnoneornil(L, MOTION_AXES + 1)) {
+		feed = luaL_checknumber(L, MOTION_AXES + 1);
+		luaL_argcheck(L, feed > 0, MOTION_AXES + 1, "feed must be > 0");
+	}
 
-struct lstepp lstepp[NSTEP];
-
-static void lstepper_end(void *arg1, uint32_t mask) {
-    int unit;
-    struct stepper *p = (struct stepper *)arg1;
-    
-    for(unit=0;unit < NSTEP; unit++, mask = (mask >> 1)) {
-        if (mask & 0b1) {
-            lstepp[unit].done = 1;            
-        }
-    }    
-}
+	while ((res = motion_line(to, feed)) == EAGAIN) {
+		vTaskDelay(1);
+	}
 
-static int lstepper_unit() {
-    return lstepper_id++;
-}
+	if (res) {
+		return luaL_error(L, "invalid move");
+	}
 
-static int lstepper_setup( lua_State* L ) {
-    tdriver_error *error;
-    int pulse_width = luaL_checkinteger(L, 1); 
-    
-    if (pulse_width <= 0) {
-      return luaL_error(L, "invalid step pulse width");        
-    }
-
-    if ((error = steppers_setup(pulse_width, lstepper_end))) {
-        return luaL_driver_error(L, "steppers can't setup", error);
-    }
-    
-    setup = 1;
-    
-    return 0;
-}
+	memcpy(target, to, sizeof(target));
 
-static int lstepper_new( lua_State* L ){
-    tdriver_error *error;
-    stepper_userdata *lstepper;
-    int port, pin;
-    int unit;
-    
-    int step_pin = luaL_checkinteger(L, 1); 
-    int dir_pin = luaL_checkinteger(L, 2); 
-
-    if (!setup) {
-      return luaL_error(L, "stepper module is not setup. Setup first.");        
-    }
-    
-    port = PORB(step_pin);
-    pin = PINB(step_pin);
-    
-    if(!platform_pio_has_port(port + 1) || !platform_pio_has_pin(port + 1, pin))
-      return luaL_error(L, "invalid step pin");
-    
-    port = PORB(dir_pin);
-    pin = PINB(dir_pin);
-    
-    if(!platform_pio_has_port(port + 1) || !platform_pio_has_pin(port + 1, pin))
-      return luaL_error(L, "invalid dir pin");
-
-    unit = lstepper_unit();
-    
-    if ((error = stepper_setup(unit + 1, step_pin, dir_pin))) {
-        return luaL_driver_error(L, "stepper can't setup", error);
-    }
-
-    lstepp[unit].setup = 1;
-    lstepp[unit].done = 1;
-    
-    // Allocate stepper structure and initialize
-    lstepper = (stepper_userdata *)lua_newuserdata(L, sizeof(stepper_userdata));
-    lstepper->unit = unit;
-        
-    luaL_getmetatable(L, "stepper");
-    lua_setmetatable(L, -2);
-
-    return 1;
+	return 0;
 }
 
-static int lstepper_move( lua_State* L ){
-    stepper_userdata *lstepper = NULL;
-
-    lstepper = (stepper_userdata *)luaL_checkudata(L, 1, "stepper");
-    luaL_argcheck(L, lstepper, 1, "stepper expected");
-
-    if (!setup) {
-      return luaL_error(L, "stepper module is not setup. Setup first.");        
-    }
-
-    int dir =  luaL_checkinteger(L, 2);
-    int steps = luaL_checkinteger(L, 3);
-    int ramp = luaL_checkinteger(L, 4);
-    double ifreq = luaL_checknumber(L, 5);
-    double efreq = luaL_checknumber(L, 6);
-        
-    stepper_move(lstepper->unit + 1, dir, steps, ramp, ifreq, efreq);
-    
-    return 0;
+// Lua: stepper.start()
+static int lstepper_start(lua_State *L) {
+	motion_start();
+	return 0;
 }
 
-static int lstepper_start( lua_State* L ){
-    stepper_userdata *lstepper = NULL;
-
-    int total = lua_gettop(L);
-    int mask = 0;
-    int i;
-
-    if (!setup) {
-      return luaL_error(L, "stepper module is not setup. Setup first.");        
-    }
-    
-    for (i=1; i <= total; i++) {
-        if (!lua_isnil(L, i)) {
-            lstepper = (stepper_userdata *)luaL_checkudata(L, i, "stepper");
-            luaL_argcheck(L, lstepper, i, "stepper expected");
-        
-            mask |= (1 << (lstepper->unit));
-
-            lstepp[lstepper->unit].done = 0;
-        }
-    }
-    
-    stepper_start(mask);
-    
-    return 0;
+// Lua: stepper.wait()
+static int lstepper_wait(lua_State *L) {
+	motion_start();
+	while (motion_busy()) {
+		vTaskDelay(1);
+	}
+	return 0;
 }
 
-static int lstepper_done( lua_State* L ){
-    stepper_userdata *lstepper = NULL;
-
-    if (!setup) {
-      return luaL_error(L, "stepper module is not setup. Setup first.");        
-    }
+// Lua: stepper.stop()
+static int lstepper_stop(lua_State *L) {
+	motion_stop();
+	motion_position(target);
+	return 0;
+}
 
-    lstepper = (stepper_userdata *)luaL_checkudata(L, 1, "stepper");
-    luaL_argcheck(L, lstepper, 1, "stepper expected");
-    
-    lua_pushboolean(L, lstepp[lstepper->unit].done);    
+// Lua: busy = stepper.busy()
+static int lstepper_busy(lua_State *L) {
+	lua_pushboolean(L, motion_busy());
+	return 1;
+}
 
-    return 1;
+// Lua: x, y, z = stepper.position([x, y, z])
+static int lstepper_position(lua_State *L) {
+	float at[MOTION_AXES];
+	int i;
+
+	if (!axes) {
+		return luaL_error(L, "stepper is not setup");
+	}
+
+	if (!lua_isnoneornil(L, 1)) {
+		motion_position(at);
+		for (i = 0; i < axes; i++) {
+			at[i] = luaL_optnumber(L, i + 1, at[i]);
+		}
+		if (motion_set_position(at)) {
+			return luaL_error(L, "stepper is busy");
+		}
+		memcpy(target, at, sizeof(target));
+	}
+
+	motion_position(at);
+	for (i = 0; i < axes; i++) {
+		lua_pushnumber(L, at[i]);
+	}
+
+	return axes;
 }
 
-const luaL_Reg stepper_map[] = {
-  { "setup", lstepper_setup },
-  { "new", lstepper_new },
-  { "move", lstepper_move },
-  { "start", lstepper_start },
-  { "done", lstepper_done },
-  { NULL, NULL }
-};
+// Lua: stats = stepper.stats()
+static int lstepper_stats(lua_State *L) {
+	motion_stats_t st;
+
+	motion_get_stats(&st);
+
+	lua_createtable(L, 0, 9);
+	lua_pushinteger(L, st.queued);
+	lua_setfield(L, -2, "queued");
+	lua_pushinteger(L, st.blocks);
+	lua_setfield(L, -2, "lines");
+	lua_pushinteger(L, st.stops);
+	lua_setfield(L, -2, "stops");
+	lua_pushinteger(L, st.steps);
+	lua_setfield(L, -2, "steps");
+	lua_pushinteger(L, st.pending);
+	lua_setfield(L, -2, "pending");
+	lua_pushinteger(L, st.rate_max);
+	lua_setfield(L, -2, "rate_max");
+	lua_pushinteger(L, st.late_max);
+	lua_setfield(L, -2, "late_max");
+	lua_pushinteger(L, st.plan_us);
+	lua_setfield(L, -2, "plan_us");
+	lua_pushboolean(L, st.running);
+	lua_setfield(L, -2, "running");
+
+	return 1;
+}
 
-static const luaL_Reg lstepper[] = {
-    {NULL, NULL}
+static const LUA_REG_TYPE stepper_map[] = {
+	{ LSTRKEY( "setup"    ),		LFUNCVAL( lstepper_setup    ) },
+	{ LSTRKEY( "move"     ),		LFUNCVAL( lstepper_move     ) },
+	{ LSTRKEY( "start"    ),		LFUNCVAL( lstepper_start    ) },
+	{ LSTRKEY( "wait"     ),		LFUNCVAL( lstepper_wait     ) },
+	{ LSTRKEY( "stop"     ),		LFUNCVAL( lstepper_stop     ) },
+	{ LSTRKEY( "busy"     ),		LFUNCVAL( lstepper_busy     ) },
+	{ LSTRKEY( "position" ),		LFUNCVAL( lstepper_position ) },
+	{ LSTRKEY( "stats"    ),		LFUNCVAL( lstepper_stats    ) },
+	{ LNILKEY, LNILVAL }
 };
 
-int luaopen_stepper(lua_State* L)
-{
-    luaL_newlib(L, lstepper);
-
-    // Set it as its own metatable
-    lua_pushvalue( L, -1 );
-    lua_setmetatable( L, -2 );
-
-    // create metatable
-    luaL_newmetatable(L, "stepper");
-
-    lua_pushinteger(L, 0);
-    lua_setfield(L, -2, "cw");
-
-    lua_pushinteger(L, 1);
-    lua_setfield(L, -2, "ccw");
-
-    lua_pushliteral(L, "__index");
-    lua_pushvalue(L,-2);
-    lua_rawset(L,-3);
-
-    // Setup the methods inside metatable
-    luaL_register( L, NULL, stepper_map );
-
-    return 1;
+LUALIB_API int luaopen_stepper(lua_State *L) {
+#if !LUA_USE_ROTABLE
+	luaL_newlib(L, stepper_map);
+	return 1;
+#else
+	return 0;
+#endif
 }
 
-#endif
\ No newline at end of file
+MODULE_REGISTER_MAPPED(STEPPER, stepper, stepper_map, luaopen_stepper);
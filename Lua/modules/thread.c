@@ -39,6 +39,7 @@
 #include "ldo.h"
 #include "thread.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <signal.h>
@@ -46,9 +47,24 @@
 
 #include "pthread.h"
 
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "queue.h"
+
+#include <sys/drivers/clock.h>
+#include <sys/mutex.h>
+
+#if LUA_USE_NET
+#include "lwip/sockets.h"
+#include "sock.h"
+#endif
+
 #define LTHREAD_STATUS_RUNNING   1
 #define LTHREAD_STATUS_SUSPENDED 2
 
+#define THREAD_MODE_PTHREAD      0
+#define THREAD_MODE_GREEN        1
+
 #if 0
 #define DBG(...) printf(__VA_ARGS__)
 #else
@@ -58,6 +74,26 @@
 // List of threads
 static struct list lthread_list;
 
+// Mode of the threads created by thread.start / thread.create
+static int thread_mode = THREAD_MODE_PTHREAD;
+
+// Green threads are Lua coroutines, all run by one scheduler pthread. They
+// give up the CPU by yielding when they sleep or wait for an event source,
+// so they don't need a stack or a FreeRTOS task each.
+static SemaphoreHandle_t green_sem = NULL;   // Wakes up the scheduler
+static struct lthread green_sched;           // The scheduler pthread
+static struct lthread *green_current = NULL; // Running green thread
+
+// Green threads are only freed by the scheduler, with green_mtx taken. Other
+// pthreads take it to use a green thread they got from the list, and stop it
+// by setting its stop flag.
+static struct mtx green_mtx;
+
+// Statistics
+static uint32_t green_switches = 0;          // Switches between green threads
+static uint64_t green_switch_us = 0;         // Time spent switching
+static int spawn_mem[2] = {0, 0};            // Heap used by the last thread created, per mode
+
 lua_State* thread_get_lua_State() {
 //	int idx;
 	int res;
@@ -135,6 +171,215 @@ void *thread_start_task(void *arg) {
     return NULL;
 }
 
+int thread_is_green(lua_State *L) {
+    return green_current && (green_current->L == L) && lua_isyieldable(L);
+}
+
+int thread_yield_wait(lua_State *L, int type, void *src, uint64_t timeout_us, lua_KContext ctx, lua_KFunction k) {
+    struct lthread *thread = green_current;
+
+    thread->wait = type;
+    thread->wait_src = src;
+    thread->wake = timeout_us ? clock_monotonic_us() + timeout_us : 0;
+    thread->wait_result = 0;
+
+    return lua_yieldk(L, 0, ctx, k);
+}
+
+int thread_wait_result(lua_State *L) {
+    if (green_current && (green_current->L == L)) {
+        return green_current->wait_result;
+    }
+
+    return 0;
+}
+
+static void green_wakeup() {
+    if (green_sem) {
+        xSemaphoreGive(green_sem);
+    }
+}
+
+// Called by the scheduler with green_mtx taken, list_remove frees thread
+static void green_free(struct lthread *thread) {
+    luaL_unref(thread->PL, LUA_REGISTRYINDEX, thread->function_ref);
+    luaL_unref(thread->PL, LUA_REGISTRYINDEX, thread->thread_ref);
+
+    list_remove(&lthread_list, thread->thid);
+}
+
+// Check if the event source a green thread waits for is ready, or the wait
+// timed out
+static int green_ready(struct lthread *thread, uint64_t now) {
+    switch (thread->wait) {
+        case THREAD_WAIT_NONE:
+            return 1;
+
+#if LUA_USE_NET
+        case THREAD_WAIT_FD: {
+            int fd = (int)(intptr_t)thread->wait_src;
+            struct timeval tv = {0, 0};
+            fd_set rfds;
+
+            FD_ZERO(&rfds);
+            FD_SET(fd, &rfds);
+
+            // Errors also wake up the thread, so the read reports them
+            if (select(fd + 1, &rfds, NULL, NULL, &tv) != 0) {
+                thread->wait_result = 1;
+                return 1;
+            }
+            break;
+        }
+#endif
+
+        case THREAD_WAIT_QUEUE:
+            if (uxQueueMessagesWaiting((QueueHandle_t)thread->wait_src)) {
+                thread->wait_result = 1;
+                return 1;
+            }
+            break;
+    }
+
+    if (thread->wake && (now >= thread->wake)) {
+        thread->wait_result = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void green_resume(struct lthread *thread) {
+    int status;
+
+    thread->wait = THREAD_WAIT_NONE;
+    thread->wake = 0;
+
+    green_current = thread;
+    status = lua_resume(thread->L, NULL, 0);
+    green_current = NULL;
+
+    if (status == LUA_YIELD) {
+        // Drop whatever was yielded, a plain coroutine.yield() just gives
+        // the other threads a chance to run
+        lua_settop(thread->L, 0);
+        if (!thread->stop) {
+            return;
+        }
+    } else if (status != LUA_OK) {
+        const char *msg = lua_tostring(thread->L, -1);
+        lua_writestringerror("%s\n", msg ? msg : "(error object is not a string)");
+    }
+
+    mtx_lock(&green_mtx);
+    green_free(thread);
+    mtx_unlock(&green_mtx);
+}
+
+static void *green_task(void *arg) {
+    struct lthread *thread;
+    uint64_t now, next, last = 0;
+    TickType_t wait;
+    int idx, ran, poll;
+
+    for(;;) {
+        ran = 0;
+        poll = 0;
+        next = 0;
+
+        idx = list_first(&lthread_list);
+        while (idx >= 0) {
+            mtx_lock(&green_mtx);
+            if (list_get(&lthread_list, idx, (void **)&thread) || !thread->green) {
+                thread = NULL;
+            } else if (thread->stop) {
+                // Stopped by thread.stop, while not running
+                green_free(thread);
+                thread = NULL;
+            }
+            mtx_unlock(&green_mtx);
+
+            // Only this pthread frees green threads, thread stays valid
+            if (thread && (thread->status == LTHREAD_STATUS_RUNNING)) {
+                now = clock_monotonic_us();
+                if (green_ready(thread, now)) {
+                    if (last) {
+                        green_switches++;
+                        green_switch_us += now - last;
+                    }
+
+                    green_resume(thread);
+                    last = clock_monotonic_us();
+                    ran = 1;
+                } else {
+                    if ((thread->wait == THREAD_WAIT_FD) || (thread->wait == THREAD_WAIT_QUEUE)) {
+                        poll = 1;
+                    }
+                    if (thread->wake && (!next || (thread->wake < next))) {
+                        next = thread->wake;
+                    }
+                }
+            }
+
+            idx = list_next(&lthread_list, idx);
+        }
+
+        // Nobody ran, sleep until the first timeout, a new / resumed thread,
+        // or the next tick if event sources have to be polled
+        if (ran) {
+            wait = 0;
+        } else if (poll) {
+            wait = 1;
+        } else if (next) {
+            now = clock_monotonic_us();
+            wait = (next > now) ? (next - now + portTICK_PERIOD_US - 1) / portTICK_PERIOD_US : 0;
+        } else {
+            wait = portMAX_DELAY;
+        }
+
+        if (wait) {
+            last = 0;
+        }
+
+        xSemaphoreTake(green_sem, wait);
+    }
+
+    return NULL;
+}
+
+static int green_start(lua_State *L) {
+    pthread_attr_t attr;
+    pthread_t id;
+    int res;
+
+    if (green_sem) {
+        return 0;
+    }
+
+    green_sem = xSemaphoreCreateBinary();
+    if (!green_sem) {
+        return ENOMEM;
+    }
+
+    green_sched.PL = L;
+    green_sched.L = L;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, defaultThreadStack);
+    pthread_attr_setinitialstate(&attr, PTHREAD_INITIAL_STATE_RUN);
+
+    res = pthread_create(&id, &attr, green_task, &green_sched);
+    if (res) {
+        vSemaphoreDelete(green_sem);
+        green_sem = NULL;
+        return res;
+    }
+
+    green_sched.thread = id;
+
+    return 0;
+}
+
 static int thread_suspend_pthreads(lua_State *L, int thid) {
     struct lthread *thread;
     int res, idx;
@@ -146,8 +391,10 @@ static int thread_suspend_pthreads(lua_State *L, int thid) {
     }
     
     while (idx >= 0) {
+        mtx_lock(&green_mtx);
         res = list_get(&lthread_list, idx, (void **)&thread);
         if (res) {
+            mtx_unlock(&green_mtx);
             return luaL_error(L, "can't suspend thread %d", idx);
         }
 
@@ -157,7 +404,10 @@ static int thread_suspend_pthreads(lua_State *L, int thid) {
 
             // Update thread status
             thread->status = LTHREAD_STATUS_SUSPENDED;
+        } else if (thread->green) {
+            thread->status = LTHREAD_STATUS_SUSPENDED;
         }
+        mtx_unlock(&green_mtx);
 
         if (!thid) {
             idx = list_next(&lthread_list, idx);
@@ -180,8 +430,10 @@ static int thread_resume_pthreads(lua_State *L, int thid) {
     }
     
     while (idx >= 0) {
+        mtx_lock(&green_mtx);
         res = list_get(&lthread_list, idx, (void **)&thread);
         if (res) {
+            mtx_unlock(&green_mtx);
             return luaL_error(L, "can't resume thread %d", idx);
         }
 
@@ -191,7 +443,11 @@ static int thread_resume_pthreads(lua_State *L, int thid) {
 
             // Update thread status
             thread->status = LTHREAD_STATUS_RUNNING;
+        } else if (thread->green) {
+            thread->status = LTHREAD_STATUS_RUNNING;
+            green_wakeup();
         }
+        mtx_unlock(&green_mtx);
 
         if (!thid) {
             idx = list_next(&lthread_list, idx);
@@ -219,8 +475,10 @@ static int thread_stop_pthreads(lua_State *L, int thid) {
     }
     
     while (idx >= 0) {
+        mtx_lock(&green_mtx);
         res = list_get(&lthread_list, idx, (void **)&thread);
         if (res) {
+            mtx_unlock(&green_mtx);
             return luaL_error(L, "can't stop thread %d", idx);
         }
 
@@ -237,8 +495,12 @@ static int thread_stop_pthreads(lua_State *L, int thid) {
             //luaL_unref(L, LUA_REGISTRYINDEX, thread->L);
 
             list_remove(&lthread_list, idx);
+        } else if (thread->green) {
+            // The scheduler frees it, when it yields if it's running
+            thread->stop = 1;
+            green_wakeup();
         }
-		free(thread);
+        mtx_unlock(&green_mtx);
 
         if (!thid) {
             idx = list_next(&lthread_list, idx);
@@ -305,8 +567,11 @@ static int thread_list(lua_State *L) {
                     strcpy(status,"----");
 
             }
+            if (thread->green && (thread->status == LTHREAD_STATUS_RUNNING) && (thread->wait != THREAD_WAIT_NONE)) {
+                strcpy(status,"wait");
+            }
 
-            printf("%d\t%s\t\t%s\t%d\n", idx, "", status, 0);
+            printf("%d\t%s\t\t%s\t%d\n", idx, thread->green ? "green" : "", status, 0);
 
             idx = list_next(&lthread_list, idx);
         }        
@@ -321,6 +586,7 @@ int new_thread(lua_State* L, int run) {
     int res, idx;
     pthread_t id;
     int retries;
+    int mem = xPortGetFreeHeapSize();
 
 	//luaC_fullgc(L, 1);
 
@@ -331,6 +597,7 @@ int new_thread(lua_State* L, int run) {
     if (!thread) {
         return luaL_error(L, "not enough memory");
     }
+    memset(thread, 0, sizeof(struct lthread));
     
     // Check for argument is a function, and store it's reference
     luaL_checktype(L, 1, LUA_TFUNCTION);
@@ -354,6 +621,30 @@ int new_thread(lua_State* L, int run) {
     }
 	DBG("nth 4 Free mem: %d\n",xPortGetFreeHeapSize());        
 
+    thread->thid = idx;
+
+    if (thread_mode == THREAD_MODE_GREEN) {
+        // Nothing more than the coroutine, the scheduler runs it
+        res = green_start(L);
+        if (res) {
+            luaL_unref(L, LUA_REGISTRYINDEX, thread->function_ref);
+            luaL_unref(L, LUA_REGISTRYINDEX, thread->thread_ref);
+            list_remove(&lthread_list, idx);
+
+            return luaL_error(L, "can't start green thread scheduler (%s)", strerror(res));
+        }
+
+        thread->green = 1;
+        thread->status = run ? LTHREAD_STATUS_RUNNING : LTHREAD_STATUS_SUSPENDED;
+
+        spawn_mem[THREAD_MODE_GREEN] = mem - xPortGetFreeHeapSize();
+
+        green_wakeup();
+
+        lua_pushinteger(L, idx);
+        return 1;
+    }
+
     // Create pthread
     pthread_attr_init(&attr);
     pthread_attr_setstacksize(&attr, defaultThreadStack);
@@ -364,8 +655,6 @@ int new_thread(lua_State* L, int run) {
         pthread_attr_setinitialstate(&attr, PTHREAD_INITIAL_STATE_SUSPEND);        
     }
     
-    thread->thid = idx;
-    
     retries = 0;
     
 retry:  
@@ -391,6 +680,8 @@ retry:
     // Store pthread id
     thread->thread = id;            
 
+    spawn_mem[THREAD_MODE_PTHREAD] = mem - xPortGetFreeHeapSize();
+
 	luaC_fullgc(L, 1);
 	
     // Return lthread id
@@ -409,11 +700,20 @@ static int thread_create(lua_State* L) {
     return new_thread(L, 0);
 }    
 
+// Green threads sleep by yielding to the scheduler
+static int thread_green_sleep(lua_State* L, uint64_t useconds) {
+    return thread_yield_wait(L, useconds ? THREAD_WAIT_SLEEP : THREAD_WAIT_NONE, NULL, useconds, 0, NULL);
+}
+
 static int thread_sleep(lua_State* L) {
     int seconds;
     
     // Check argument (seconds)
     seconds = luaL_checkinteger(L, 1);
+
+    if (thread_is_green(L)) {
+        return thread_green_sleep(L, (uint64_t)seconds * 1000000);
+    }
     
     //sleep(seconds);
     vTaskDelay( (seconds * 1000) / portTICK_PERIOD_MS );
@@ -426,6 +726,10 @@ static int thread_sleepms(lua_State* L) {
     
     // Check argument (seconds)
     milliseconds = luaL_checkinteger(L, 1);
+
+    if (thread_is_green(L)) {
+        return thread_green_sleep(L, (uint64_t)milliseconds * 1000);
+    }
     
     //usleep(milliseconds * 1000);
     vTaskDelay( (milliseconds) / portTICK_PERIOD_MS );
@@ -438,6 +742,10 @@ static int thread_sleepus(lua_State* L) {
     
     // Check argument (seconds)
     useconds = luaL_checkinteger(L, 1);
+
+    if (thread_is_green(L)) {
+        return thread_green_sleep(L, useconds);
+    }
     
     //usleep(useconds);
     vTaskDelay( (useconds) / portTICK_PERIOD_US );
@@ -445,6 +753,107 @@ static int thread_sleepus(lua_State* L) {
     return 0;
 }
 
+// Give other threads a chance to run
+static int thread_yield(lua_State* L) {
+    if (thread_is_green(L)) {
+        return thread_green_sleep(L, 0);
+    }
+
+    taskYIELD();
+
+    return 0;
+}
+
+#if LUA_USE_NET
+static int thread_wait_k(lua_State* L, int status, lua_KContext ctx) {
+    lua_pushboolean(L, thread_wait_result(L));
+    return 1;
+}
+
+// Lua: ready = thread.wait(socket, [timeout ms])
+// Wait until a socket is readable. Green threads yield meanwhile.
+static int thread_wait(lua_State* L) {
+    int pending;
+    int fd = sock_getfd(L, 1, &pending);
+    int timeout = luaL_optinteger(L, 2, -1);
+    struct timeval tv;
+    fd_set rfds;
+
+    // Data in the receive buffer of the socket is read without waiting
+    if (pending) {
+        lua_pushboolean(L, 1);
+        return 1;
+    }
+
+    if (thread_is_green(L)) {
+        return thread_yield_wait(L, THREAD_WAIT_FD, (void *)(intptr_t)fd, (timeout >= 0) ? (uint64_t)timeout * 1000 + 1 : 0, 0, thread_wait_k);
+    }
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    lua_pushboolean(L, select(fd + 1, &rfds, NULL, NULL, (timeout >= 0) ? &tv : NULL) > 0);
+    return 1;
+}
+#endif
+
+// Lua: mode = thread.mode([mode])
+// Get / set the mode ("pthread" or "green") of the threads created from now on
+static int thread_set_mode(lua_State* L) {
+    static const char *const modes[] = {"pthread", "green", NULL};
+
+    lua_pushstring(L, modes[thread_mode]);
+
+    if (!lua_isnoneornil(L, 1)) {
+        thread_mode = luaL_checkoption(L, 1, NULL, modes);
+    }
+
+    return 1;
+}
+
+static int thread_stats(lua_State* L) {
+    struct lthread *thread;
+    int green = 0, pthreads = 0;
+    int idx;
+
+    idx = list_first(&lthread_list);
+    while (idx >= 0) {
+        if (!list_get(&lthread_list, idx, (void **)&thread)) {
+            if (thread->green) {
+                green++;
+            } else {
+                pthreads++;
+            }
+        }
+        idx = list_next(&lthread_list, idx);
+    }
+
+    lua_createtable(L, 0, 6);
+
+    lua_pushinteger(L, green);
+    lua_setfield(L, -2, "green");
+
+    lua_pushinteger(L, pthreads);
+    lua_setfield(L, -2, "pthreads");
+
+    lua_pushinteger(L, green_switches);
+    lua_setfield(L, -2, "switches");
+
+    lua_pushinteger(L, green_switches ? green_switch_us / green_switches : 0);
+    lua_setfield(L, -2, "switch_us");
+
+    lua_pushinteger(L, spawn_mem[THREAD_MODE_GREEN]);
+    lua_setfield(L, -2, "green_mem");
+
+    lua_pushinteger(L, spawn_mem[THREAD_MODE_PTHREAD]);
+    lua_setfield(L, -2, "pthread_mem");
+
+    return 1;
+}
+
 // Suspend all threads, or a specific thread
 static int thread_suspend(lua_State* L) {
     return thread_suspend_pthreads(L, luaL_optinteger(L, 1, 0));    
@@ -495,11 +904,18 @@ static const LUA_REG_TYPE thread[] = {
     { LSTRKEY( "sleepms" ),			LFUNCVAL( thread_sleepms ) },
     { LSTRKEY( "sleepus" ),			LFUNCVAL( thread_sleepus ) },
     { LSTRKEY( "usleep" ),			LFUNCVAL( thread_sleepus ) },
+    { LSTRKEY( "yield" ),			LFUNCVAL( thread_yield ) },
+#if LUA_USE_NET
+    { LSTRKEY( "wait" ),			LFUNCVAL( thread_wait ) },
+#endif
+    { LSTRKEY( "mode" ),			LFUNCVAL( thread_set_mode ) },
+    { LSTRKEY( "stats" ),			LFUNCVAL( thread_stats ) },
     { LNILKEY, LNILVAL }
 };
 
 int luaopen_thread(lua_State* L) {
 	list_init(&lthread_list, 1);
+	mtx_init(&green_mtx, NULL, NULL, 0);
 	
 #if !LUA_USE_ROTABLE
     luaL_newlib(L, thread);
@@ -32,6 +32,8 @@
 
 #include "lstate.h"
 
+#include <stdint.h>
+
 #include <pthread.h>
 
 struct lthread {
@@ -42,7 +44,32 @@ struct lthread {
     int status;
     int thid;
     pthread_t thread;
+
+    // Green threads (coroutines run by the green thread scheduler)
+    int green;
+    int stop;           // Stopped while running, free when it yields
+    int wait;           // THREAD_WAIT_xxx it's blocked on
+    void *wait_src;     // Event source of the wait
+    uint64_t wake;      // Wait timeout, in clock_monotonic_us() time
+    int wait_result;    // 1 if the event source got ready, 0 on timeout
 };
 
+// Event sources a green thread can wait for
+#define THREAD_WAIT_NONE   0
+#define THREAD_WAIT_SLEEP  1
+#define THREAD_WAIT_FD     2   // Socket readable, src is the socket
+#define THREAD_WAIT_QUEUE  3   // FreeRTOS queue not empty, src is the queue
+
+// Returns 1 if L is the running green thread and can yield
+int thread_is_green(lua_State *L);
+
+// Block the green thread L until the event source is ready or timeout_us
+// microseconds elapse (0 for no timeout), by yielding to the scheduler. On
+// resume k is called, and thread_wait_result() tells how the wait ended.
+// Must be returned from the C function, like lua_yieldk.
+int thread_yield_wait(lua_State *L, int type, void *src, uint64_t timeout_us, lua_KContext ctx, lua_KFunction k);
+
+int thread_wait_result(lua_State *L);
+
 #endif	/* LTHREAD_H */
 
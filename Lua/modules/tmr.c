@@ -29,12 +29,48 @@
 
 #if LUA_USE_TMR
 
+#include "FreeRTOS.h"
+#include "queue.h"
+
 #include "lua.h"
 #include "lauxlib.h"
 #include "modules.h"
 
 #include <unistd.h>
 #include <sys/delay.h>
+#include <sys/drivers/clock.h>
+#include <sys/drivers/hrtimer.h>
+
+#include "thread.h"
+
+// Number of high resolution timers usable from Lua
+#define TMR_LUA_TIMERS 8
+
+// Lua callbacks of high resolution timers can't run in the timer interrupt,
+// the interrupt queues the timer and the callback is run later by
+// tmr.dispatch() / tmr.loop(), in the Lua thread that calls them.
+typedef struct {
+    hrtimer_t timer;
+    int ref;                // callback, LUA_NOREF if the slot is free
+    uint8_t gen;            // of the callback, changed by each tmr.attach
+    volatile uint8_t queued;
+    uint32_t missed;        // expirations coalesced while queued
+} tmr_lua_timer_t;
+
+// What the interrupt queues. An expiration queued before a tmr.detach can
+// still be in the queue when the slot is attached again, its gen tells it
+// from those of the new callback.
+typedef struct {
+    uint8_t id;
+    uint8_t gen;
+} tmr_lua_event_t;
+
+// Each timer has at most one expiration of its callback queued, the other
+// half is for those of detached callbacks
+#define TMR_LUA_QUEUE (2 * TMR_LUA_TIMERS)
+
+static tmr_lua_timer_t lua_timers[TMR_LUA_TIMERS];
+static QueueHandle_t lua_timers_q = NULL;
 
 static int tmr_delay( lua_State* L ) {
     unsigned long long period;
@@ -90,6 +126,248 @@ static int tmr_sleep_us( lua_State* L ) {
     return 0;
 }
 
+// Microseconds since boot. Lua integers are 32 bits, so the value wraps
+// around every ~71 minutes, but differences between two readings (done
+// with integer arithmetic) are right for intervals up to that.
+static int tmr_now_us( lua_State* L ) {
+    lua_pushinteger(L, (lua_Integer)(uint32_t)clock_monotonic_us());
+
+    return 1;
+}
+
+static void tmr_lua_isr_cb(void *arg) {
+    tmr_lua_timer_t *lt = (tmr_lua_timer_t *)arg;
+    portBASE_TYPE woken = pdFALSE;
+    tmr_lua_event_t ev;
+
+    if (lt->queued) {
+        lt->missed++;
+        return;
+    }
+
+    ev.id = lt - lua_timers;
+    ev.gen = lt->gen;
+    if (xQueueSendFromISR(lua_timers_q, &ev, &woken) == pdTRUE) {
+        lt->queued = 1;
+    } else {
+        lt->missed++;
+    }
+
+    portEND_SWITCHING_ISR(woken);
+}
+
+static tmr_lua_timer_t *tmr_get_lua_timer( lua_State* L, int idx ) {
+    int id = luaL_checkinteger( L, idx );
+
+    if (!lua_timers_q || (id < 1) || (id > TMR_LUA_TIMERS) || (lua_timers[id - 1].ref == LUA_NOREF)) {
+        luaL_error(L, "invalid timer %d", id);
+    }
+
+    return &lua_timers[id - 1];
+}
+
+// tmr.attach(us, fn [, period_us]), returns a timer id. fn receives the
+// timer id. One-shot timers are released after running their callback,
+// periodic ones with tmr.detach(id).
+static int tmr_attach( lua_State* L ) {
+    uint32_t us = luaL_checkinteger( L, 1 );
+    uint32_t period = luaL_optinteger( L, 3, 0 );
+    int i, res;
+
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    if (!lua_timers_q) {
+        for(i = 0; i < TMR_LUA_TIMERS; i++) {
+            lua_timers[i].ref = LUA_NOREF;
+        }
+
+        lua_timers_q = xQueueCreate(TMR_LUA_QUEUE, sizeof(tmr_lua_event_t));
+        if (!lua_timers_q) {
+            return luaL_error(L, "not enough memory");
+        }
+    }
+
+    // A free slot without an expiration of its last callback queued, or
+    // else any free slot
+    for(i = 0; i < TMR_LUA_TIMERS; i++) {
+        if ((lua_timers[i].ref == LUA_NOREF) && !lua_timers[i].queued) {
+            break;
+        }
+    }
+
+    if (i == TMR_LUA_TIMERS) {
+        for(i = 0; i < TMR_LUA_TIMERS; i++) {
+            if (lua_timers[i].ref == LUA_NOREF) {
+                break;
+            }
+        }
+    }
+
+    if (i == TMR_LUA_TIMERS) {
+        return luaL_error(L, "no free timers");
+    }
+
+    // The timer is stopped, the interrupt doesn't use the slot
+    lua_pushvalue(L, 2);
+    lua_timers[i].ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_timers[i].gen++;
+    lua_timers[i].queued = 0;
+    lua_timers[i].missed = 0;
+
+    hrtimer_init(&lua_timers[i].timer, tmr_lua_isr_cb, &lua_timers[i]);
+
+    res = hrtimer_start(&lua_timers[i].timer, us, period);
+    if (res) {
+        luaL_unref(L, LUA_REGISTRYINDEX, lua_timers[i].ref);
+        lua_timers[i].ref = LUA_NOREF;
+
+        return luaL_error(L, "can't start timer (%d)", res);
+    }
+
+    lua_pushinteger(L, i + 1);
+
+    return 1;
+}
+
+static int tmr_detach( lua_State* L ) {
+    tmr_lua_timer_t *lt = tmr_get_lua_timer(L, 1);
+
+    hrtimer_stop(&lt->timer);
+
+    // An expiration still queued is dropped by tmr_run_lua_timers, queued
+    // stays set until then
+    luaL_unref(L, LUA_REGISTRYINDEX, lt->ref);
+    lt->ref = LUA_NOREF;
+
+    return 0;
+}
+
+// Run the Lua callbacks of expired timers. Waits up to timeout ms (0 by
+// default) for the first one. Returns the number of callbacks run.
+static int tmr_run_lua_timers( lua_State* L, TickType_t wait ) {
+    tmr_lua_timer_t *lt;
+    tmr_lua_event_t ev;
+    int n = 0;
+
+    if (!lua_timers_q) {
+        return 0;
+    }
+
+    while (xQueueReceive(lua_timers_q, &ev, wait) == pdTRUE) {
+        wait = 0;
+
+        lt = &lua_timers[ev.id];
+
+        // Of a callback detached before the slot was attached again
+        if (ev.gen != lt->gen) {
+            continue;
+        }
+
+        lt->queued = 0;
+
+        // Detached meanwhile
+        if (lt->ref == LUA_NOREF) {
+            continue;
+        }
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, lt->ref);
+        lua_pushinteger(L, ev.id + 1);
+        lua_call(L, 1, 0);
+
+        // One-shot timers are released once run
+        if (!hrtimer_pending(&lt->timer) && (lt->ref != LUA_NOREF) && !lt->timer.period) {
+            luaL_unref(L, LUA_REGISTRYINDEX, lt->ref);
+            lt->ref = LUA_NOREF;
+        }
+
+        n++;
+    }
+
+    return n;
+}
+
+static int tmr_dispatch_k( lua_State* L, int status, lua_KContext ctx ) {
+    lua_pushinteger(L, tmr_run_lua_timers(L, 0));
+
+    return 1;
+}
+
+static int tmr_dispatch( lua_State* L ) {
+    uint32_t timeout = luaL_optinteger( L, 1, 0 );
+
+    // Green threads wait for the queue by yielding to the scheduler
+    if (timeout && lua_timers_q && thread_is_green(L)) {
+        return thread_yield_wait(L, THREAD_WAIT_QUEUE, lua_timers_q, (uint64_t)timeout * 1000, 0, tmr_dispatch_k);
+    }
+
+    lua_pushinteger(L, tmr_run_lua_timers(L, timeout / portTICK_PERIOD_MS));
+
+    return 1;
+}
+
+static int tmr_loop_k( lua_State* L, int status, lua_KContext ctx ) {
+    for(;;) {
+        if (lua_timers_q && thread_is_green(L)) {
+            tmr_run_lua_timers(L, 0);
+            return thread_yield_wait(L, THREAD_WAIT_QUEUE, lua_timers_q, 0, 0, tmr_loop_k);
+        }
+
+        tmr_run_lua_timers(L, portMAX_DELAY);
+    }
+
+    return 0;
+}
+
+// Run Lua callbacks forever, to be used as a thread body
+static int tmr_loop( lua_State* L ) {
+    return tmr_loop_k(L, LUA_OK, 0);
+}
+
+static int tmr_stats( lua_State* L ) {
+    hrtimer_stats_t st;
+
+    if (lua_gettop(L) >= 1) {
+        tmr_lua_timer_t *lt = tmr_get_lua_timer(L, 1);
+
+        lua_createtable(L, 0, 4);
+
+        lua_pushinteger(L, lt->timer.runs);
+        lua_setfield(L, -2, "runs");
+
+        lua_pushinteger(L, lt->timer.late_max);
+        lua_setfield(L, -2, "late_max");
+
+        lua_pushinteger(L, lt->timer.runs ? lt->timer.late_sum / lt->timer.runs : 0);
+        lua_setfield(L, -2, "late_avg");
+
+        lua_pushinteger(L, lt->missed);
+        lua_setfield(L, -2, "missed");
+
+        return 1;
+    }
+
+    hrtimer_get_stats(&st);
+
+    lua_createtable(L, 0, 5);
+
+    lua_pushinteger(L, st.timers);
+    lua_setfield(L, -2, "timers");
+
+    lua_pushinteger(L, st.irqs);
+    lua_setfield(L, -2, "irqs");
+
+    lua_pushinteger(L, st.runs);
+    lua_setfield(L, -2, "runs");
+
+    lua_pushinteger(L, st.late_max);
+    lua_setfield(L, -2, "late_max");
+
+    lua_pushinteger(L, st.late_avg);
+    lua_setfield(L, -2, "late_avg");
+
+    return 1;
+}
+
 static const LUA_REG_TYPE tmr_map[] = {
     { LSTRKEY( "delay" ),			LFUNCVAL( tmr_delay ) },
     { LSTRKEY( "delayms" ),			LFUNCVAL( tmr_delay_ms ) },
@@ -97,6 +375,12 @@ static const LUA_REG_TYPE tmr_map[] = {
     { LSTRKEY( "sleep" ),			LFUNCVAL( tmr_sleep ) },
     { LSTRKEY( "sleepms" ),			LFUNCVAL( tmr_sleep_ms ) },
     { LSTRKEY( "sleepus" ),			LFUNCVAL( tmr_sleep_us ) },
+    { LSTRKEY( "now_us" ),			LFUNCVAL( tmr_now_us ) },
+    { LSTRKEY( "attach" ),			LFUNCVAL( tmr_attach ) },
+    { LSTRKEY( "detach" ),			LFUNCVAL( tmr_detach ) },
+    { LSTRKEY( "dispatch" ),		LFUNCVAL( tmr_dispatch ) },
+    { LSTRKEY( "loop" ),			LFUNCVAL( tmr_loop ) },
+    { LSTRKEY( "stats" ),			LFUNCVAL( tmr_stats ) },
     { LNILKEY, LNILVAL }
 };
 
@@ -30,7 +30,9 @@
 #include "lvm.h"
 
 // WHITECAT BEGIN
+#if !LUA_CROSS_COMPILER
 #include <sys/drivers/uart.h>
+#endif
 // WHITECAT END
 
 #if LUA_USE_ROTABLE
@@ -909,6 +911,10 @@ LUA_API int lua_setmetatable (lua_State *L, int objindex) {
     case LUA_TUSERDATA: {
       uvalue(obj)->metatable = mt;
       if (mt) {
+#if LUA_USE_ROTABLE
+        /* a rotable is not collectable, but its __gc still counts */
+        if (!isrometa)
+#endif
         luaC_objbarrier(L, uvalue(obj), mt);
         luaC_checkfinalizer(L, gcvalue(obj), mt);
       }
@@ -1157,7 +1163,9 @@ LUA_API int lua_error (lua_State *L) {
   lua_lock(L);
   
   // WHITECAT BEGIN
+#if !LUA_CROSS_COMPILER
   uart0_default();
+#endif
   // WHITECAT END
   
   api_checknelems(L, 1);
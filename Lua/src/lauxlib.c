@@ -30,6 +30,8 @@
 #include "lrotable.h"
 #endif
 
+#include "lpool.h"
+
 /*
 ** {======================================================
 ** Traceback
@@ -1028,6 +1030,9 @@ LUALIB_API const char *luaL_gsub (lua_State *L, const char *s, const char *p,
 
 
 static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+#if LUA_USE_POOL
+  return luaP_alloc(ud, ptr, osize, nsize);  /* small objects in pools */
+#else
   (void)ud; (void)osize;  /* not used */
   if (nsize == 0) {
     free(ptr);
@@ -1035,6 +1040,7 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
   }
   else
     return realloc(ptr, nsize);
+#endif
 }
 
 
@@ -384,8 +384,12 @@ static int dofilecont (lua_State *L, int d1, lua_KContext d2) {
 static int luaB_dofile (lua_State *L) {
   const char *fname = luaL_optstring(L, 1, NULL);
   lua_settop(L, 1);
-  if (luaL_loadfile(L, fname) != LUA_OK)
+  // LUA RTOS BEGIN
+  /* files packed in the module store under their path run from there */
+  if ((fname == NULL || !lua_loadstore(L, fname)) &&
+      luaL_loadfile(L, fname) != LUA_OK)
     return lua_error(L);
+  // LUA RTOS END
   lua_callk(L, 0, LUA_MULTRET, 0, dofilecont);
   return dofilecont(L, 0, 0);
 }
@@ -25,6 +25,10 @@
 #include "ltable.h"
 #include "ltm.h"
 
+#if LUA_USE_ROTABLE
+#include "lrotable.h"
+#endif
+
 
 /*
 ** internal state for collector while inside the atomic phase. The
@@ -91,6 +95,17 @@
 */
 #define markobjectN(g,t)	{ if (t) markobject(g,t); }
 
+/*
+** mark a metatable that can be NULL. A rotable metatable lives in flash
+** and is not a collectable object, its bytes must not be marked.
+*/
+#if LUA_USE_ROTABLE
+#define markmetatable(g,t)  \
+  { if ((t) && !luaR_isrotable((const void *)(t))) markobject(g,t); }
+#else
+#define markmetatable(g,t)	markobjectN(g,t)
+#endif
+
 static void reallymarkobject (global_State *g, GCObject *o);
 
 
@@ -193,6 +208,8 @@ void luaC_upvalbarrier_ (lua_State *L, UpVal *uv) {
 
 void luaC_fix (lua_State *L, GCObject *o) {
   global_State *g = G(L);
+  if (isreadonly(o))  /* already fixed in the store image? */
+    return;
   lua_assert(g->allgc == o);  /* object must be 1st in 'allgc' list! */
   white2gray(o);  /* they will be gray forever */
   g->allgc = o->next;  /* remove object from 'allgc' list */
@@ -248,7 +265,7 @@ static void reallymarkobject (global_State *g, GCObject *o) {
     }
     case LUA_TUSERDATA: {
       TValue uvalue;
-      markobjectN(g, gco2u(o)->metatable);  /* mark its metatable */
+      markmetatable(g, gco2u(o)->metatable);  /* mark its metatable */
       gray2black(o);
       g->GCmemtrav += sizeudata(gco2u(o));
       getuservalue(g->mainthread, gco2u(o), &uvalue);
@@ -289,7 +306,7 @@ static void reallymarkobject (global_State *g, GCObject *o) {
 static void markmt (global_State *g) {
   int i;
   for (i=0; i < LUA_NUMTAGS; i++)
-    markobjectN(g, g->mt[i]);
+    markmetatable(g, g->mt[i]);
 }
 
 
@@ -451,7 +468,7 @@ static void traversestrongtable (global_State *g, Table *h) {
 static lu_mem traversetable (global_State *g, Table *h) {
   const char *weakkey, *weakvalue;
   const TValue *mode = gfasttm(g, h->metatable, TM_MODE);
-  markobjectN(g, h->metatable);
+  markmetatable(g, h->metatable);
   if (mode && ttisstring(mode) &&  /* is there a weak mode? */
       ((weakkey = strchr(svalue(mode), 'k')),
        (weakvalue = strchr(svalue(mode), 'v')),
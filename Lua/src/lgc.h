@@ -79,6 +79,7 @@
 #define WHITE1BIT	1  /* object is white (type 1) */
 #define BLACKBIT	2  /* object is black */
 #define FINALIZEDBIT	3  /* object has been marked for finalization */
+#define READONLYBIT	6  /* object lives in a read-only store image */
 /* bit 7 is currently used by tests (luaL_checkmemory) */
 
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
@@ -91,6 +92,13 @@
 
 #define tofinalize(x)	testbit((x)->marked, FINALIZEDBIT)
 
+/*
+** Read-only objects are black forever, so the collector never marks,
+** traverses or sweeps them (they are not in any of its lists either)
+*/
+#define isreadonly(x)	testbit((x)->marked, READONLYBIT)
+#define READONLYMARK	bit2mask(BLACKBIT, READONLYBIT)
+
 #define otherwhite(g)	((g)->currentwhite ^ WHITEBITS)
 #define isdeadm(ow,m)	(!(((m) ^ WHITEBITS) & (ow)))
 #define isdead(g,v)	isdeadm(otherwhite(g), (v)->marked)
@@ -569,6 +569,23 @@ static int searcher_preload (lua_State *L) {
 }
 
 
+// LUA RTOS BEGIN
+/*
+** Modules precompiled in the read-only store are used in place, without
+** reading and parsing their source
+*/
+static int searcher_store (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  if (!lua_loadstore(L, name)) {
+    lua_pushfstring(L, "\n\tno module '%s' in the store", name);
+    return 1;
+  }
+  lua_pushliteral(L, ":store:");  /* will be 2nd argument to module */
+  return 2;
+}
+// LUA RTOS END
+
+
 static void findloader (lua_State *L, const char *name) {
   int i;
   luaL_Buffer msg;  /* to build error message */
@@ -745,7 +762,8 @@ static const luaL_Reg ll_funcs[] = {
 
 static void createsearcherstable (lua_State *L) {
   static const lua_CFunction searchers[] =
-    {searcher_preload, searcher_Lua, searcher_C, searcher_Croot, NULL};
+    {searcher_preload, searcher_store, searcher_Lua, searcher_C, searcher_Croot,
+     NULL};
   int i;
   /* create 'searchers' table */
   lua_createtable(L, sizeof(searchers)/sizeof(searchers[0]) - 1, 0);
@@ -0,0 +1,266 @@
+/*
+** Size-class pools for the small Lua objects
+** See Copyright Notice in lua.h
+*/
+
+#define lpool_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lpool.h"
+
+
+#if LUA_USE_POOL
+
+/*
+** System heap of the pages and of the big blocks. Its allocation may run
+** an emergency collection (see the malloc wrappers of the platforms),
+** which frees blocks into the pools, while compilers take it for granted
+** that realloc leaves the other variables alone: it is called through a
+** volatile pointer, so the pools are read again after it.
+*/
+#if !defined(l_sysrealloc)
+static void *(*volatile sysrealloc_f) (void *, size_t) = realloc;
+#define l_sysrealloc(b,s)	((*sysrealloc_f)(b,s))
+#define l_sysfree(b)		free(b)
+#endif
+
+
+/*
+** A page holds the blocks of a single class. Lua gives the size of a
+** block when it resizes or frees it, so the blocks have no header: the
+** class comes from the size and the page from the address.
+*/
+typedef struct Page {
+  struct Page *prev, *next;
+  void *free;  /* list of the released blocks */
+  unsigned short top;  /* blocks never handed out start at this one */
+  unsigned short used;
+} Page;
+
+#define PAGEHDR		((sizeof(Page) + 7) & ~(size_t)7)
+
+typedef struct Class {
+  Page *partial;  /* pages with free blocks */
+  Page *full;
+  Page *hit;  /* page of the last block looked up */
+  size_t pages;
+  size_t used;
+} Class;
+
+
+static Class pools[LUAI_POOLCLASSES];
+
+#define classof(s)	((int)(((s) - 1) / LUAI_POOLSTEP))
+#define blocksize(c)	((size_t)((c) + 1) * LUAI_POOLSTEP)
+#define blocks(c)	((LUAI_POOLPAGE - PAGEHDR) / blocksize(c))
+
+#define inpage(p,b)	((char *)(b) >= (char *)(p) + PAGEHDR && \
+			 (char *)(b) < (char *)(p) + LUAI_POOLPAGE)
+#define isfull(p,c)	((p)->free == NULL && (p)->top == blocks(c))
+
+
+static void unlinkpage (Page **list, Page *p) {
+  if (p->prev) p->prev->next = p->next;
+  else *list = p->next;
+  if (p->next) p->next->prev = p->prev;
+}
+
+
+static void pushpage (Page **list, Page *p) {
+  p->prev = NULL;
+  p->next = *list;
+  if (*list) (*list)->prev = p;
+  *list = p;
+}
+
+
+static void freepage (Class *cl, Page *p) {
+  unlinkpage(&cl->partial, p);
+  if (cl->hit == p) cl->hit = NULL;
+  cl->pages--;
+  l_sysfree(p);
+}
+
+
+/*
+** Resizes a block of the system heap. A failure gives back the empty
+** pages and tries again.
+*/
+static void *sysrealloc (void *b, size_t size) {
+  void *nb = l_sysrealloc(b, size);
+  if (nb == NULL && luaP_trim() > 0)
+    nb = l_sysrealloc(b, size);
+  return nb;
+}
+
+
+static void *getblock (int c) {
+  Class *cl = &pools[c];
+  Page *p = cl->partial;
+  void *b;
+  if (p == NULL) {
+    /* the system heap may run an emergency collection, which frees
+       blocks into the pools, so nothing is held across the call */
+    p = (Page *)l_sysrealloc(NULL, LUAI_POOLPAGE);
+    if (p == NULL) return NULL;
+    p->free = NULL;
+    p->top = 0;
+    p->used = 0;
+    pushpage(&cl->partial, p);
+    cl->pages++;
+  }
+  if (p->free != NULL) {
+    b = p->free;
+    p->free = *(void **)b;
+  }
+  else
+    b = (char *)p + PAGEHDR + p->top++ * blocksize(c);
+  p->used++;
+  cl->used++;
+  if (isfull(p, c)) {
+    unlinkpage(&cl->partial, p);
+    pushpage(&cl->full, p);
+  }
+  return b;
+}
+
+
+static void putblock (int c, Page *p, void *b) {
+  Class *cl = &pools[c];
+  if (isfull(p, c)) {
+    unlinkpage(&cl->full, p);
+    pushpage(&cl->partial, p);
+  }
+  *(void **)b = p->free;
+  p->free = b;
+  p->used--;
+  cl->used--;
+  if (p->used == 0) {
+    if (p->prev == NULL && p->next == NULL) {
+      /* the only page with free blocks is kept, blocks start over */
+      p->free = NULL;
+      p->top = 0;
+    }
+    else
+      freepage(cl, p);
+  }
+}
+
+
+static Page *findin (Page *p, void *b) {
+  for (; p != NULL; p = p->next) {
+    if (inpage(p, b)) return p;
+  }
+  return NULL;
+}
+
+
+static Page *findpage (int c, void *b) {
+  Class *cl = &pools[c];
+  Page *p = cl->hit;
+  if (p != NULL && inpage(p, b)) return p;
+  p = findin(cl->partial, b);
+  if (p == NULL) p = findin(cl->full, b);
+  if (p != NULL) cl->hit = p;
+  return p;
+}
+
+
+/*
+** Class of the page holding block 'b' of 'osize' bytes, -1 if it is a
+** block of the system heap. A block kept in place by a shrink has a
+** bigger class than its size.
+*/
+static int owner (void *b, size_t osize, Page **p) {
+  int c;
+  if (osize == 0 || osize > LUAI_POOLMAX) return -1;
+  for (c = classof(osize); c < LUAI_POOLCLASSES; c++) {
+    if ((*p = findpage(c, b)) != NULL) return c;
+  }
+  return -1;
+}
+
+
+static void *newblock (size_t size) {
+  void *b;
+  if (size <= LUAI_POOLMAX && (b = getblock(classof(size))) != NULL)
+    return b;
+  /* a big block, or a small one in a hole of the system heap when
+     there is no room for a page */
+  return sysrealloc(NULL, size);
+}
+
+
+void *luaP_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Page *p;
+  void *b;
+  int c;
+  (void)ud;
+  if (ptr == NULL)  /* 'osize' is the type of the object */
+    return (nsize == 0) ? NULL : newblock(nsize);
+  c = owner(ptr, osize, &p);
+  if (nsize == 0) {
+    if (c >= 0) putblock(c, p, ptr);
+    else l_sysfree(ptr);
+    return NULL;
+  }
+  if (c >= 0) {
+    if (nsize <= LUAI_POOLMAX && classof(nsize) == c)
+      return ptr;
+    b = newblock(nsize);
+    if (b == NULL)  /* a shrink cannot fail, the block stays */
+      return (nsize < osize) ? ptr : NULL;
+    memcpy(b, ptr, (nsize < osize) ? nsize : osize);
+    putblock(c, p, ptr);
+    return b;
+  }
+  if (nsize <= LUAI_POOLMAX && nsize < osize) {
+    /* a block shrunk to a pool size leaves its hole in the heap */
+    b = getblock(classof(nsize));
+    if (b != NULL) {
+      memcpy(b, ptr, nsize);
+      l_sysfree(ptr);
+      return b;
+    }
+  }
+  return sysrealloc(ptr, nsize);
+}
+
+
+int luaP_class (int c, luaP_Class *cl) {
+  if (c < 0 || c >= LUAI_POOLCLASSES) return 0;
+  cl->size = blocksize(c);
+  cl->pages = pools[c].pages;
+  cl->used = pools[c].used;
+  cl->slots = pools[c].pages * blocks(c);
+  return 1;
+}
+
+
+size_t luaP_trim (void) {
+  size_t n = 0;
+  int c;
+  for (c = 0; c < LUAI_POOLCLASSES; c++) {
+    Class *cl = &pools[c];
+    Page *p = cl->partial;
+    while (p != NULL) {
+      Page *next = p->next;
+      if (p->used == 0) {
+        freepage(cl, p);
+        n += LUAI_POOLPAGE;
+      }
+      p = next;
+    }
+  }
+  return n;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+** Size-class pools for the small Lua objects
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lpool_h
+#define lpool_h
+
+#include <stddef.h>
+
+#include "luaconf.h"
+
+
+/*
+** Blocks up to LUAI_POOLMAX bytes (strings, tables, closures, upvalues,
+** userdata headers) are cut from pages of LUAI_POOLPAGE bytes, one size
+** class every LUAI_POOLSTEP bytes, instead of being separate blocks of
+** the system heap. Bigger blocks are left to the system heap.
+*/
+#if !defined(LUA_USE_POOL)
+#define LUA_USE_POOL		0
+#endif
+
+#if !defined(LUAI_POOLMAX)
+#define LUAI_POOLMAX		64
+#endif
+
+#if !defined(LUAI_POOLSTEP)
+#define LUAI_POOLSTEP		8
+#endif
+
+#if !defined(LUAI_POOLPAGE)
+#define LUAI_POOLPAGE		512
+#endif
+
+#define LUAI_POOLCLASSES	(LUAI_POOLMAX / LUAI_POOLSTEP)
+
+
+/* usage of a size class */
+typedef struct luaP_Class {
+  size_t size;		/* size of the blocks */
+  size_t pages;		/* pages of the class */
+  size_t used;		/* blocks in use */
+  size_t slots;		/* blocks the pages hold */
+} luaP_Class;
+
+
+/* lua_Alloc over the pools and the system heap */
+LUAI_FUNC void *luaP_alloc (void *ud, void *ptr, size_t osize, size_t nsize);
+
+/* usage of class 'c' (0 .. LUAI_POOLCLASSES - 1), 0 if there is none */
+LUAI_FUNC int luaP_class (int c, luaP_Class *cl);
+
+/* returns the empty pages to the system heap, the bytes released */
+LUAI_FUNC size_t luaP_trim (void);
+
+#endif
@@ -23,11 +23,12 @@
 #include "llex.h"
 #include "lmem.h"
 #include "lstate.h"
+#include "lstore.h"
 #include "lstring.h"
 #include "ltable.h"
 #include "ltm.h"
 
-#if 1
+#if !LUA_CROSS_COMPILER
 #define DBG(...) printf(__VA_ARGS__)
 #else
 #define DBG(...)
@@ -316,7 +317,10 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->frealloc = f;
   g->ud = ud;
   g->mainthread = L;
-  g->seed = makeseed(L);
+  g->store = luaN_mount();
+  /* read-only strings were hashed with a fixed seed */
+  g->seed = (g->store != NULL || LUA_USE_ROSTRINGS) ? LUA_STORESEED
+                                                  : makeseed(L);
   g->gcrunning = 0;  /* no GC while building state */
   g->GCestimate = 0;
   g->strt.size = g->strt.nuse = 0;
@@ -0,0 +1,151 @@
+/*
+** Read-only store of precompiled Lua modules
+** See Copyright Notice in lua.h
+*/
+
+#define lstore_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include <string.h>
+
+#include "lua.h"
+
+#include "ldo.h"
+#include "lfunc.h"
+#include "lgc.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lstore.h"
+#include "lstring.h"
+#include "ltable.h"
+
+
+#if LUA_USE_ROSTRINGS
+/*
+** Read-only copy of a built-in name, 's' must be a string literal.
+** The strings are members of a single const struct, so the compiler
+** lays them out, and lrostr.inc only provides the hashes and chains.
+*/
+#define ROSTR(s,h,e,n)	{ .tsv = { .next = NULL, .tt = LUA_TSHRSTR, \
+  .marked = READONLYMARK, .extra = (e), .shrlen = sizeof(s) - 1, .hash = (h), \
+  .u.hnext = (n) } }, s
+
+#include LUA_ROSTRINC
+#endif
+
+
+/*
+** Image mounted by the states created from now on. On the board the
+** image is flashed at a fixed offset, and LUA_STORE_ADDR is the address
+** where the flash cache maps it.
+*/
+#if defined(LUA_STORE_ADDR) && LUA_STORE_ADDR
+static const void *store_image = cast(const void *, LUA_STORE_ADDR);
+#else
+static const void *store_image = NULL;
+#endif
+
+
+const StoreHeader *luaN_check (const void *image) {
+  const StoreHeader *s = cast(const StoreHeader *, image);
+  if (s == NULL ||
+      s->magic != LUA_STOREMAGIC ||
+      s->format != LUA_STOREFORMAT ||
+      s->version != LUA_VERSION_NUM ||
+      s->layout != LUA_STORELAYOUT ||
+      s->seed != LUA_STORESEED ||
+      s->base != cast(const char *, image))  /* built for another address? */
+    return NULL;
+  return s;
+}
+
+
+const StoreHeader *luaN_mount (void) {
+  return luaN_check(store_image);
+}
+
+
+static TString *findstr (TString *const *strt, unsigned int nstrt,
+                         const char *str, size_t l, unsigned int h) {
+  TString *ts;
+  for (ts = strt[lmod(h, nstrt)]; ts != NULL; ts = ts->u.hnext) {
+    if (ts->hash == h && l == ts->shrlen &&
+        memcmp(str, getstr(ts), l * sizeof(char)) == 0)
+      return ts;
+  }
+  return NULL;
+}
+
+
+/*
+** Look for a short string in the read-only strings: first in the store
+** image, which was built without knowing the built-in names, then in
+** the built-in names. The order is the same for the whole life of the
+** state, so every string still has a single copy.
+*/
+TString *luaN_findstr (global_State *g, const char *str, size_t l,
+                       unsigned int h) {
+  TString *ts;
+  if (g->store != NULL &&
+      (ts = findstr(g->store->strt, g->store->nstrt, str, l, h)) != NULL)
+    return ts;
+#if LUA_USE_ROSTRINGS
+  return findstr(rostrt, ROSTR_NSTRT, str, l, h);
+#else
+  return NULL;
+#endif
+}
+
+
+/*
+** Set the image used by the states created after this call (NULL to
+** use none). Returns 0 if 'image' is not a valid store for this build.
+*/
+LUA_API int lua_setstore (const void *image) {
+  if (image != NULL && luaN_check(image) == NULL)
+    return 0;
+  store_image = image;
+  return 1;
+}
+
+
+/*
+** Push a closure of the module 'name' of the store, like 'lua_load'
+** does with a chunk. The prototypes are used in place, only the
+** closure and its upvalues are allocated. Returns 0 if there is no
+** such module.
+*/
+LUA_API int lua_loadstore (lua_State *L, const char *name) {
+  const StoreHeader *s = G(L)->store;
+  TString *ts;
+  unsigned int i;
+  if (s == NULL)
+    return 0;
+  lua_lock(L);
+  /* module names are interned in the image, so compare pointers */
+  ts = luaS_new(L, name);
+  for (i = 0; isreadonly(ts) && i < s->nmodules; i++) {
+    if (s->modules[i].name == ts) {
+      Proto *p = s->modules[i].p;
+      LClosure *cl = luaF_newLclosure(L, p->sizeupvalues);
+      cl->p = p;
+      setclLvalue(L, L->top, cl);  /* anchor it */
+      luaD_inctop(L);
+      luaF_initupvals(L, cl);
+      if (cl->nupvalues >= 1) {  /* does it have an upvalue? */
+        /* set global table as 1st upvalue (may be LUA_ENV) */
+        Table *reg = hvalue(&G(L)->l_registry);
+        const TValue *gt = luaH_getint(reg, LUA_RIDX_GLOBALS);
+        setobj(L, cl->upvals[0]->v, gt);
+        luaC_upvalbarrier(L, cl->upvals[0]);
+      }
+      lua_unlock(L);
+      return 1;
+    }
+  }
+  lua_unlock(L);
+  return 0;
+}
@@ -0,0 +1,84 @@
+/*
+** Read-only store of precompiled Lua modules
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lstore_h
+#define lstore_h
+
+#include "lobject.h"
+#include "lstate.h"
+
+
+#define LUA_STOREMAGIC		0x5453554c	/* "LUST" */
+#define LUA_STOREFORMAT		1
+
+/* default name of the image written by luacstore */
+#define LUA_STOREIMAGE		"lua_store.img"
+
+/*
+** Built-in names (rotable keys, module, metamethod and reserved names)
+** are interned from a read-only table generated by "luacstore -c" into
+** lrostr.inc, instead of being copied to the heap
+*/
+#if !defined(LUA_USE_ROSTRINGS)
+#define LUA_USE_ROSTRINGS	0
+#endif
+
+/* file generated by "luacstore -c" */
+#define LUA_ROSTRINC		"lrostr.inc"
+
+/*
+** Seed used to hash the read-only strings. A state that has any uses
+** it as its own seed, so the hashes stored with them are valid for its
+** tables.
+*/
+#define LUA_STORESEED		0x2f8c1d5bu
+
+/*
+** Sizes of the structures the image was built with; the builder must
+** use the same ABI as the firmware (see luacstore.c)
+*/
+#define LUA_STORELAYOUT \
+  (cast(unsigned int, sizeof(void *)) | \
+   (cast(unsigned int, sizeof(TValue)) << 8) | \
+   (cast(unsigned int, sizeof(Proto)) << 16) | \
+   (cast(unsigned int, sizeof(UTString)) << 24))
+
+
+typedef struct StoreModule {
+  TString *name;
+  Proto *p;  /* main function of the module */
+} StoreModule;
+
+
+/*
+** The image starts with this header, followed by the objects. All
+** pointers in the image are absolute addresses computed for 'base',
+** so it must be mapped at that address to be used. Every object is
+** marked READONLYMARK, and short strings are chained in 'strt' with
+** 'u.hnext', like in the string table of a state. Only 32-bit fields
+** are read from the header, as byte loads from the mapped flash are
+** slow.
+*/
+typedef struct StoreHeader {
+  unsigned int magic;
+  unsigned int format;
+  unsigned int version;  /* LUA_VERSION_NUM */
+  unsigned int layout;  /* LUA_STORELAYOUT */
+  unsigned int seed;
+  unsigned int size;  /* size of the image, in bytes */
+  unsigned int nstrt;  /* size of 'strt' (a power of 2) */
+  unsigned int nmodules;
+  const char *base;  /* address the image was built for */
+  TString **strt;
+  StoreModule *modules;
+} StoreHeader;
+
+
+LUAI_FUNC const StoreHeader *luaN_check (const void *image);
+LUAI_FUNC const StoreHeader *luaN_mount (void);
+LUAI_FUNC TString *luaN_findstr (global_State *g, const char *str, size_t l,
+                                 unsigned int h);
+
+#endif
@@ -19,6 +19,7 @@
 #include "lmem.h"
 #include "lobject.h"
 #include "lstate.h"
+#include "lstore.h"
 #include "lstring.h"
 
 
@@ -168,8 +169,12 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   TString *ts;
   global_State *g = G(L);
   unsigned int h = luaS_hash(str, l, g->seed);
-  TString **list = &g->strt.hash[lmod(h, g->strt.size)];
+  TString **list;
   lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
+  ts = luaN_findstr(g, str, l, h);  /* read-only copy? */
+  if (ts != NULL)
+    return ts;
+  list = &g->strt.hash[lmod(h, g->strt.size)];
   for (ts = *list; ts != NULL; ts = ts->u.hnext) {
     if (l == ts->shrlen &&
         (memcmp(str, getstr(ts), l * sizeof(char)) == 0)) {
@@ -45,8 +45,17 @@ typedef enum {
 
 
 
+#if LUA_USE_ROTABLE
+/* a rotable metatable has no flags caching the absent tag methods */
+int luaR_isrotable (const void *p);
+
+#define gfasttm(g,et,e) ((et) == NULL ? NULL : \
+  (!luaR_isrotable(et) && ((et)->flags & (1u<<(e)))) ? NULL : \
+  luaT_gettm(et, e, (g)->tmname[e]))
+#else
 #define gfasttm(g,et,e) ((et) == NULL ? NULL : \
   ((et)->flags & (1u<<(e))) ? NULL : luaT_gettm(et, e, (g)->tmname[e]))
+#endif
 
 #define fasttm(l,et,e)	gfasttm(G(l), et, e)
 
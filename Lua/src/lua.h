@@ -337,6 +337,14 @@ LUA_API size_t   (lua_stringtonumber) (lua_State *L, const char *s);
 LUA_API lua_Alloc (lua_getallocf) (lua_State *L, void **ud);
 LUA_API void      (lua_setallocf) (lua_State *L, lua_Alloc f, void *ud);
 
+// LUA RTOS BEGIN
+/*
+** read-only store of precompiled modules (see lstore.c)
+*/
+LUA_API int (lua_setstore) (const void *image);
+LUA_API int (lua_loadstore) (lua_State *L, const char *name);
+// LUA RTOS END
+
 
 
 /*
@@ -0,0 +1,639 @@
+/*
+** Lua module store builder (packs precompiled modules into a read-only
+** image that the firmware uses in place, see lstore.c)
+** See Copyright Notice in lua.h
+**
+** This is a host tool, built with LUA_CROSS_COMPILER (see common.mk).
+** The image holds the structures of the builder's own ABI, so for the
+** board it must be built as a 32-bit program with the same Lua number
+** configuration as the firmware.
+*/
+
+#define luacstore_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+#if LUA_CROSS_COMPILER
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "lgc.h"
+#include "lobject.h"
+#include "lstate.h"
+#include "lstore.h"
+#include "lstring.h"
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP	1
+#endif
+
+#define PROGNAME	"luacstore"	/* default program name */
+#define OUTPUT		LUA_STOREIMAGE	/* default output file */
+#define BASE		0x10000000	/* default address of the image */
+#define LOOPS		100		/* loads per module when measuring */
+
+static int stripping=0;			/* strip debug information? */
+static int measuring=0;			/* compare source and store loads? */
+static const char* names=NULL;		/* built-in names output file */
+static size_t base=BASE;		/* address the image is built for */
+static const char* output=OUTPUT;	/* actual output file name */
+static const char* progname=PROGNAME;	/* actual program name */
+
+static void fatal(const char* message)
+{
+ fprintf(stderr,"%s: %s\n",progname,message);
+ exit(EXIT_FAILURE);
+}
+
+static void cannot(const char* what, const char* name)
+{
+ fprintf(stderr,"%s: cannot %s %s: %s\n",progname,what,name,strerror(errno));
+ exit(EXIT_FAILURE);
+}
+
+static void usage(const char* message)
+{
+ if (*message=='-')
+  fprintf(stderr,"%s: unrecognized option '%s'\n",progname,message);
+ else
+  fprintf(stderr,"%s: %s\n",progname,message);
+ fprintf(stderr,
+  "usage: %s [options] [name=]filename ...\n"
+  "       %s -c name < names\n"
+  "Available options are:\n"
+  "  -a addr  address the image is mapped at (default 0x%x)\n"
+  "  -c name  write the read-only table of the names in stdin to C file 'name'\n"
+  "  -m       map the image and compare loads from source and store\n"
+  "  -o name  output to file 'name' (default is \"%s\")\n"
+  "  -s       strip debug information\n"
+  "  --       stop handling options\n"
+  "The module name defaults to the file name without directory and '.lua';\n"
+  "dofile also finds a module named after the exact path it is given.\n"
+  ,progname,progname,BASE,OUTPUT);
+ exit(EXIT_FAILURE);
+}
+
+#define IS(s)	(strcmp(argv[i],s)==0)
+
+static int doargs(int argc, char* argv[])
+{
+ int i;
+ if (argv[0]!=NULL && *argv[0]!=0) progname=argv[0];
+ for (i=1; i<argc; i++)
+ {
+  if (*argv[i]!='-')			/* end of options; keep it */
+   break;
+  else if (IS("--"))			/* end of options; skip it */
+  {
+   ++i;
+   break;
+  }
+  else if (IS("-a"))			/* image address */
+  {
+   char* end;
+   if (argv[++i]==NULL) usage("'-a' needs argument");
+   base=(size_t)strtoull(argv[i],&end,0);
+   if (*end!=0 || base==0 || base%sizeof(L_Umaxalign)!=0)
+    usage("'-a' needs an aligned address");
+  }
+  else if (IS("-c"))			/* built-in names */
+  {
+   names=argv[++i];
+   if (names==NULL || *names==0) usage("'-c' needs argument");
+  }
+  else if (IS("-m"))			/* measure */
+   measuring=1;
+  else if (IS("-o"))			/* output file */
+  {
+   output=argv[++i];
+   if (output==NULL || *output==0) usage("'-o' needs argument");
+  }
+  else if (IS("-s"))			/* strip debug information */
+   stripping=1;
+  else					/* unknown option */
+   usage(argv[i]);
+ }
+ return i;
+}
+
+/*
+** module name and file name of an argument
+*/
+static const char* modname(lua_State* L, const char* arg, const char** filename)
+{
+ const char* eq=strchr(arg,'=');
+ const char* b;
+ size_t l;
+ if (eq!=NULL)
+ {
+  *filename=eq+1;
+  return lua_pushlstring(L,arg,eq-arg);
+ }
+ *filename=arg;
+ b=strrchr(arg,'/');
+ b=(b==NULL) ? arg : b+1;
+ l=strlen(b);
+ if (l>4 && strcmp(b+l-4,".lua")==0) l-=4;
+ return lua_pushlstring(L,b,l);
+}
+
+/*
+** {======================================================
+** Image writer
+** =======================================================
+*/
+
+#define ALIGN		sizeof(L_Umaxalign)
+#define NOFFSET		((size_t)0)	/* offset of NULL pointers */
+
+typedef struct Image {
+ char* buf;
+ size_t size;
+ size_t alloc;
+ TString** skey;			/* strings already written ... */
+ size_t* soff;				/* ... and their offsets */
+ size_t ssize;
+ size_t nstr;
+ size_t* shrt;				/* offsets of short strings */
+ size_t nshrt;
+ size_t sshrt;
+} Image;
+
+#define at(im,o,t)	((t*)((im)->buf+(o)))
+#define ptr(o,t)	((o)==NOFFSET ? NULL : (t*)(base+(o)))
+
+static size_t emit(Image* im, size_t n)
+{
+ size_t o=(im->size+ALIGN-1)&~(ALIGN-1);
+ if (o+n>im->alloc)
+ {
+  size_t a=(im->alloc==0) ? 4096 : im->alloc;
+  while (o+n>a) a*=2;
+  im->buf=realloc(im->buf,a);
+  if (im->buf==NULL) fatal("not enough memory");
+  memset(im->buf+im->alloc,0,a-im->alloc);
+  im->alloc=a;
+ }
+ im->size=o+n;
+ return o;
+}
+
+static size_t emitcopy(Image* im, const void* p, size_t n)
+{
+ size_t o;
+ if (n==0) return NOFFSET;
+ o=emit(im,n);
+ memcpy(im->buf+o,p,n);
+ return o;
+}
+
+#define hashptr(p,n)	((size_t)(p)/sizeof(void*)&((n)-1))
+
+static void growstrings(Image* im)
+{
+ size_t i,n=(im->ssize==0) ? 256 : im->ssize*2;
+ TString** k=calloc(n,sizeof(TString*));
+ size_t* o=calloc(n,sizeof(size_t));
+ if (k==NULL || o==NULL) fatal("not enough memory");
+ for (i=0; i<im->ssize; i++)
+ {
+  size_t h;
+  if (im->skey[i]==NULL) continue;
+  for (h=hashptr(im->skey[i],n); k[h]!=NULL; h=(h+1)&(n-1)) ;
+  k[h]=im->skey[i];
+  o[h]=im->soff[i];
+ }
+ free(im->skey); free(im->soff);
+ im->skey=k; im->soff=o; im->ssize=n;
+}
+
+static size_t writestring(Image* im, TString* ts)
+{
+ size_t h,o,l;
+ TString* d;
+ if (ts==NULL) return NOFFSET;
+ if (im->nstr*2>=im->ssize) growstrings(im);
+ for (h=hashptr(ts,im->ssize); im->skey[h]!=NULL; h=(h+1)&(im->ssize-1))
+  if (im->skey[h]==ts) return im->soff[h];
+ l=tsslen(ts);
+ o=emit(im,sizeof(UTString)+l+1);
+ memcpy(im->buf+o+sizeof(UTString),getstr(ts),l);
+ d=at(im,o,TString);
+ d->next=NULL;
+ d->tt=ts->tt;
+ d->marked=READONLYMARK;
+ d->hash=luaS_hash(getstr(ts),l,LUA_STORESEED);
+ if (ts->tt==LUA_TSHRSTR)
+ {
+  d->extra=ts->extra;			/* keep reserved word marks */
+  d->shrlen=ts->shrlen;
+  d->u.hnext=NULL;			/* set by writestrt */
+  if (im->nshrt==im->sshrt)
+  {
+   im->sshrt=(im->sshrt==0) ? 256 : im->sshrt*2;
+   im->shrt=realloc(im->shrt,im->sshrt*sizeof(size_t));
+   if (im->shrt==NULL) fatal("not enough memory");
+  }
+  im->shrt[im->nshrt++]=o;
+ }
+ else
+ {
+  d->extra=1;				/* hash is already computed */
+  d->u.lnglen=l;
+ }
+ im->skey[h]=ts;
+ im->soff[h]=o;
+ im->nstr++;
+ return o;
+}
+
+static size_t writeproto(Image* im, const Proto* f)
+{
+ size_t o,ok,op,ol,ou,i;
+ Proto p=*f;
+ o=emit(im,sizeof(Proto));
+ p.code=ptr(emitcopy(im,f->code,f->sizecode*sizeof(Instruction)),Instruction);
+ ok=(f->sizek==0) ? NOFFSET : emitcopy(im,f->k,f->sizek*sizeof(TValue));
+ for (i=0; i<(size_t)f->sizek; i++)
+ {
+  if (ttisstring(&f->k[i]))
+  {
+   size_t s=writestring(im,tsvalue(&f->k[i]));
+   at(im,ok,TValue)[i].value_.gc=ptr(s,GCObject);
+  }
+ }
+ p.k=ptr(ok,TValue);
+ op=(f->sizep==0) ? NOFFSET : emit(im,f->sizep*sizeof(Proto*));
+ for (i=0; i<(size_t)f->sizep; i++)
+ {
+  size_t s=writeproto(im,f->p[i]);
+  at(im,op,Proto*)[i]=ptr(s,Proto);
+ }
+ p.p=ptr(op,Proto*);
+ ou=emitcopy(im,f->upvalues,f->sizeupvalues*sizeof(Upvaldesc));
+ for (i=0; i<(size_t)f->sizeupvalues; i++)
+ {
+  size_t s=stripping ? NOFFSET : writestring(im,f->upvalues[i].name);
+  at(im,ou,Upvaldesc)[i].name=ptr(s,TString);
+ }
+ p.upvalues=ptr(ou,Upvaldesc);
+ if (stripping)
+ {
+  p.sizelineinfo=0;
+  p.lineinfo=NULL;
+  p.sizelocvars=0;
+  p.locvars=NULL;
+  p.source=NULL;
+ }
+ else
+ {
+  p.lineinfo=ptr(emitcopy(im,f->lineinfo,f->sizelineinfo*sizeof(int)),int);
+  ol=emitcopy(im,f->locvars,f->sizelocvars*sizeof(LocVar));
+  for (i=0; i<(size_t)f->sizelocvars; i++)
+  {
+   size_t s=writestring(im,f->locvars[i].varname);
+   at(im,ol,LocVar)[i].varname=ptr(s,TString);
+  }
+  p.locvars=ptr(ol,LocVar);
+  p.source=ptr(writestring(im,f->source),TString);
+ }
+ p.next=NULL;
+ p.marked=READONLYMARK;
+ p.cache=NULL;
+ p.gclist=NULL;
+ *at(im,o,Proto)=p;
+ return o;
+}
+
+/*
+** chain the short strings in the hash table of the image
+*/
+static size_t writestrt(Image* im, unsigned int* n)
+{
+ size_t o,i;
+ unsigned int size=1;
+ while (size<im->nshrt) size*=2;
+ o=emit(im,size*sizeof(TString*));
+ for (i=0; i<im->nshrt; i++)
+ {
+  TString* ts=at(im,im->shrt[i],TString);
+  TString** list=at(im,o,TString*)+lmod(ts->hash,size);
+  ts->u.hnext=*list;
+  *list=ptr(im->shrt[i],TString);
+ }
+ *n=size;
+ return o;
+}
+
+static void writeimage(lua_State* L, int argc, char* argv[], Image* im)
+{
+ size_t oh,om,os;
+ int i;
+ StoreHeader h;
+ memset(&h,0,sizeof(h));
+ oh=emit(im,sizeof(StoreHeader));
+ om=emit(im,argc*sizeof(StoreModule));
+ for (i=0; i<argc; i++)
+ {
+  const char* filename;
+  const char* name=modname(L,argv[i],&filename);
+  StoreModule m;
+  int j;
+  for (j=0; j<i; j++)
+   if (at(im,om,StoreModule)[j].name==ptr(writestring(im,luaS_new(L,name)),TString))
+    fatal(lua_pushfstring(L,"duplicated module '%s'",name));
+  if (luaL_loadfile(L,filename)!=LUA_OK) fatal(lua_tostring(L,-1));
+  m.name=ptr(writestring(im,luaS_new(L,name)),TString);
+  m.p=ptr(writeproto(im,getproto(L->top-1)),Proto);
+  at(im,om,StoreModule)[i]=m;
+  lua_pop(L,2);
+ }
+ os=writestrt(im,&h.nstrt);
+ h.magic=LUA_STOREMAGIC;
+ h.format=LUA_STOREFORMAT;
+ h.version=LUA_VERSION_NUM;
+ h.layout=LUA_STORELAYOUT;
+ h.seed=LUA_STORESEED;
+ h.size=(unsigned int)im->size;
+ h.nmodules=argc;
+ h.base=(const char*)base;
+ h.strt=ptr(os,TString*);
+ h.modules=ptr(om,StoreModule);
+ *at(im,oh,StoreHeader)=h;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Measurements (loads from source against the mapped image)
+** =======================================================
+*/
+
+#if HAVE_MMAP
+
+static size_t inuse=0;
+
+static void* l_alloc(void* ud, void* p, size_t osize, size_t nsize)
+{
+ (void)ud;
+ if (p!=NULL) inuse-=osize;
+ if (nsize==0)
+ {
+  free(p);
+  return NULL;
+ }
+ p=realloc(p,nsize);
+ if (p!=NULL) inuse+=nsize;
+ return p;
+}
+
+static double now_us(void)
+{
+ struct timespec t;
+ clock_gettime(CLOCK_MONOTONIC,&t);
+ return t.tv_sec*1e6+t.tv_nsec/1e3;
+}
+
+/*
+** heap used by one load of the module (kept on the stack) and average
+** time of a load, in microseconds
+*/
+static void load(const char* name, const char* filename, int store,
+		 size_t* heap, double* us)
+{
+ lua_State* L=lua_newstate(l_alloc,NULL);
+ size_t before;
+ double t;
+ int i,ok;
+ if (L==NULL) fatal("cannot create state: not enough memory");
+ lua_gc(L,LUA_GCCOLLECT,0);
+ before=inuse;
+ ok=store ? lua_loadstore(L,name) : (luaL_loadfile(L,filename)==LUA_OK);
+ if (!ok) fatal(store ? "module not in the store" : lua_tostring(L,-1));
+ *heap=inuse-before;
+ t=now_us();
+ for (i=0; i<LOOPS; i++)
+ {
+  if (store) lua_loadstore(L,name); else luaL_loadfile(L,filename);
+  lua_pop(L,1);
+ }
+ *us=(now_us()-t)/LOOPS;
+ lua_close(L);
+}
+
+static void measure(int argc, char* argv[])
+{
+ lua_State* L;
+ struct stat st;
+ void* image;
+ size_t total[2]={0,0};
+ int fd,i;
+ fd=open(output,O_RDONLY);
+ if (fd<0 || fstat(fd,&st)<0) cannot("open",output);
+ image=mmap((void*)base,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+ close(fd);
+ if (image==MAP_FAILED) cannot("map",output);
+ if (image!=(void*)base) fatal("cannot map the image at its address");
+ L=luaL_newstate();			/* for the module names only */
+ if (L==NULL) fatal("cannot create state: not enough memory");
+ printf("%-20s %10s %10s %10s %10s\n","module","src heap","store heap",
+  "src us","store us");
+ for (i=0; i<argc; i++)
+ {
+  const char* filename;
+  const char* name=modname(L,argv[i],&filename);
+  size_t heap[2];
+  double us[2];
+  lua_setstore(NULL);
+  load(name,filename,0,&heap[0],&us[0]);
+  if (!lua_setstore(image)) fatal("invalid image");
+  load(name,filename,1,&heap[1],&us[1]);
+  printf("%-20s %10lu %10lu %10.1f %10.1f\n",name,
+   (unsigned long)heap[0],(unsigned long)heap[1],us[0],us[1]);
+  total[0]+=heap[0];
+  total[1]+=heap[1];
+  lua_pop(L,1);
+ }
+ printf("%-20s %10lu %10lu\n","total",
+  (unsigned long)total[0],(unsigned long)total[1]);
+ lua_setstore(NULL);
+ lua_close(L);
+ munmap(image,st.st_size);
+}
+
+#else
+
+static void measure(int argc, char* argv[])
+{
+ (void)argc; (void)argv;
+ fatal("'-m' needs mmap");
+}
+
+#endif
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Read-only table of built-in names (lrostr.inc)
+** =======================================================
+*/
+
+static int cmpname(const void* a, const void* b)
+{
+ return strcmp(getstr(*(TString* const*)a),getstr(*(TString* const*)b));
+}
+
+static void writeliteral(FILE* D, const TString* ts)
+{
+ const char* s=getstr(ts);
+ size_t i;
+ fputc('"',D);
+ for (i=0; i<ts->shrlen; i++)
+ {
+  unsigned char c=(unsigned char)s[i];
+  if (c=='"' || c=='\\')
+   fprintf(D,"\\%c",c);
+  else if (c<' ' || c>'~')
+   fprintf(D,"\\%03o",c);
+  else
+   fputc(c,D);
+ }
+ fputc('"',D);
+}
+
+/*
+** Intern the names of stdin in a fresh state, which already has the
+** reserved words, metamethod names and so on, and write all its short
+** strings as a table of read-only TStrings for lstore.c
+*/
+static void writenames(lua_State* L)
+{
+ global_State* g=G(L);
+ char line[256];
+ TString** s;
+ TString* ts;
+ int* next;
+ int* head;
+ size_t heap=0;
+ int i,n=0,size=1;
+ FILE* D;
+ lua_gc(L,LUA_GCSTOP,0);		/* names are not anchored */
+ while (fgets(line,sizeof(line),stdin)!=NULL)
+ {
+  size_t l=strcspn(line,"\r\n");
+  if (l>0 && l<=LUAI_MAXSHORTLEN) luaS_newlstr(L,line,l);
+ }
+ s=malloc(g->strt.nuse*sizeof(TString*));
+ if (s==NULL) fatal("not enough memory");
+ for (i=0; i<g->strt.size; i++)
+  for (ts=g->strt.hash[i]; ts!=NULL; ts=ts->u.hnext)
+   s[n++]=ts;
+ qsort(s,n,sizeof(TString*),cmpname);
+ while (size<n) size*=2;
+ next=malloc(n*sizeof(int));
+ head=malloc(size*sizeof(int));
+ if (next==NULL || head==NULL) fatal("not enough memory");
+ for (i=0; i<size; i++) head[i]=-1;
+ for (i=n-1; i>=0; i--)
+ {
+  int b=lmod(luaS_hash(getstr(s[i]),s[i]->shrlen,LUA_STORESEED),size);
+  next[i]=head[b];
+  head[b]=i;
+ }
+ D=fopen(names,"w");
+ if (D==NULL) cannot("open",names);
+ fprintf(D,"/*\n** Read-only strings of the built-in names, see lstore.c\n"
+  "** Generated by \"%s -c\" (make rostrings), do not edit\n*/\n\n",PROGNAME);
+ fprintf(D,"static const struct {\n");
+ for (i=0; i<n; i++)
+ {
+  fprintf(D,"  UTString s%d; char c%d[sizeof(",i,i);
+  writeliteral(D,s[i]);
+  fprintf(D,")];\n");
+  heap+=sizeof(UTString)+s[i]->shrlen+1;
+ }
+ fprintf(D,"} rostr = {\n");
+ for (i=0; i<n; i++)
+ {
+  fprintf(D,"  ROSTR(");
+  writeliteral(D,s[i]);
+  fprintf(D,", 0x%08x, %d, ",luaS_hash(getstr(s[i]),s[i]->shrlen,LUA_STORESEED),
+   s[i]->extra);
+  if (next[i]<0)
+   fprintf(D,"NULL),\n");
+  else
+   fprintf(D,"(TString *)&rostr.s%d.tsv),\n",next[i]);
+ }
+ fprintf(D,"};\n\n#define ROSTR_NSTRT\t%d\n\n",size);
+ fprintf(D,"static TString *const rostrt[ROSTR_NSTRT] = {\n");
+ for (i=0; i<size; i++)
+  if (head[i]>=0) fprintf(D,"  [%d] = (TString *)&rostr.s%d.tsv,\n",i,head[i]);
+ fprintf(D,"};\n");
+ if (fclose(D)) cannot("close",names);
+ fprintf(stderr,"%s: %d names, %lu bytes of strings out of the heap\n",
+  progname,n,(unsigned long)heap);
+ free(s); free(next); free(head);
+}
+
+/* }====================================================== */
+
+
+static int pmain(lua_State* L)
+{
+ int argc=(int)lua_tointeger(L,1);
+ char** argv=(char**)lua_touserdata(L,2);
+ Image im;
+ FILE* D;
+ memset(&im,0,sizeof(im));
+ writeimage(L,argc,argv,&im);
+ D=fopen(output,"wb");
+ if (D==NULL) cannot("open",output);
+ if (fwrite(im.buf,im.size,1,D)!=1) cannot("write",output);
+ if (fclose(D)) cannot("close",output);
+ fprintf(stderr,"%s: %d modules, %lu strings, %lu bytes at 0x%lx\n",progname,
+  argc,(unsigned long)im.nstr,(unsigned long)im.size,(unsigned long)base);
+ free(im.buf); free(im.skey); free(im.soff); free(im.shrt);
+ return 0;
+}
+
+int main(int argc, char* argv[])
+{
+ lua_State* L;
+ int i=doargs(argc,argv);
+ argc-=i; argv+=i;
+ if (argc<=0 && names==NULL) usage("no input files given");
+ lua_setstore(NULL);			/* build with plain heap strings */
+ L=luaL_newstate();
+ if (L==NULL) fatal("cannot create state: not enough memory");
+ if (names!=NULL)
+ {
+  writenames(L);
+  lua_close(L);
+  return EXIT_SUCCESS;
+ }
+ lua_pushcfunction(L,&pmain);
+ lua_pushinteger(L,argc);
+ lua_pushlightuserdata(L,argv);
+ if (lua_pcall(L,2,0,0)!=LUA_OK) fatal(lua_tostring(L,-1));
+ lua_close(L);
+ if (measuring) measure(argc,argv);
+ return EXIT_SUCCESS;
+}
+
+#endif
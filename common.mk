@@ -70,7 +70,7 @@ Q := @
 vecho := @echo
 endif
 
-.PHONY: all clean flash erase_flash test size rebuild
+.PHONY: all clean flash flashstore rostrings erase_flash test size rebuild
 
 all: $(PROGRAM_OUT) $(FW_FILE_1) $(FW_FILE_2) $(FW_FILE)
 
@@ -224,6 +224,41 @@ flashall: all
                 0x0 $(RBOOT_BIN) 0x1000 $(RBOOT_CONF) 0x2000 $(FW_FILE) $(SPIFFS_ESPTOOL_ARGS)
 	picocom --baud $(ESPBAUD) $(UARTPORT)
 
+# Host tool that packs Lua modules into the read-only module store image.
+# It's a 32-bit program, so the image has the same layout as the firmware.
+LUACSTORE = $(BUILD_DIR)luacstore
+LUACSTORE_SRC = $(addprefix $(ROOT)Lua/src/, lapi.c lcode.c lctype.c ldebug.c \
+	ldo.c ldump.c lfunc.c lgc.c llex.c lmem.c lobject.c lopcodes.c lparser.c \
+	lstate.c lstore.c lstring.c ltable.c ltm.c lundump.c lvm.c lzio.c \
+	lauxlib.c luacstore.c)
+
+$(LUACSTORE): $(LUACSTORE_SRC) | $(BUILD_DIR)
+	$(vecho) "HOSTCC $@"
+	$(Q) gcc -m32 -O2 -DLUA_CROSS_COMPILER=1 -DLUA_32BITS -DLUA_USE_ROTABLE=0 \
+		-I$(ROOT)Lua/src -I$(ROOT)Lua/adds -idirafter $(ROOT) $(LUACSTORE_SRC) -lm -o $@
+
+$(BUILD_DIR)lua_store.img: $(LUACSTORE) $(foreach m,$(LUA_STORE_MODULES),$(lastword $(subst =, ,$(m))))
+	$(vecho) "STORE $@"
+	$(Q) $(LUACSTORE) -s -a $(LUA_STORE_ADDR) -o $@ $(LUA_STORE_MODULES)
+
+flashstore: $(BUILD_DIR)lua_store.img
+	$(ESPTOOL) -p $(UARTPORT) --baud $(ESPBAUD) write_flash $(LUA_STORE_OFFSET) $<
+
+# Read-only table of the built-in names (LUA_USE_ROSTRINGS): rotable keys,
+# module names and a few common identifiers. Run "make rostrings" after
+# adding modules or functions, names missing from it just use the heap.
+ROSTR_EXTRA = _G _VERSION self n __name __tostring __pairs __metatable \
+	loaded preload path cpath searchers config
+
+rostrings: $(LUACSTORE)
+	$(vecho) "ROSTR $(ROOT)Lua/src/lrostr.inc"
+	$(Q) ( grep -rhoE 'LSTRKEY\( *"[^"]+"' --exclude-dir=unused \
+		--include='*.c' --include='*.h' --include='*.inc' $(ROOT)Lua $(ROOT)modules | \
+		sed -E 's/.*"(.*)"/\1/'; \
+	  grep -rhoE 'MODULE_REGISTER_[A-Z]+\( *[A-Za-z0-9_]+, *[a-z0-9_]+' --exclude-dir=unused \
+		--include='*.c' $(ROOT)Lua $(ROOT)modules | sed -E 's/.*, *//'; \
+	  printf '%s\n' $(ROSTR_EXTRA) ) | $(LUACSTORE) -c $(ROOT)Lua/src/lrostr.inc
+
 erase_flash:
 	$(ESPTOOL) -p $(UARTPORT) --baud $(ESPBAUD) erase_flash
 
@@ -8,6 +8,7 @@ CFLAGS += -DCPU_HZ=80000000L                 # CPU frequency in hertz
 CFLAGS += -DCORE_TIMER_HZ=CPU_HZ             # CPU core timer frequency
 CFLAGS += -D_CLOCKS_PER_SEC_=100             # Number of interrupt ticks for reach 1 second
 CFLAGS += -DUSE_NETWORKING=1                 # Networking is used (1 = yes, 0 = not)
+CFLAGS += -DUSE_TLS=0                        # TLS listeners for httpd and styx (httpd.tls, styx.tls), not built nor tested yet
 CFLAGS += -DMTX_USE_EVENTS=0                 # Use event groups in mtx implementation (experimental)
 
 CFLAGS += -DluaTaskStack=192*6-50 #85 #97 #+7 #8 #8 #5               # Stck size assigned to lua thread
@@ -28,9 +29,22 @@ CFLAGS += -DSPIFFS_LOG_PAGE_SIZE=256   # SPI FLASH page size (see your flah's da
 CFLAGS += -DSPIFFS_LOG_BLOCK_SIZE=4096 # Logical block size, must be a miltiple of the page size
 CFLAGS += -DSPIFFS_BASE_ADDR=0x100000  # SPI FLASH start adress for SPIFFS
 CFLAGS += -DSPIFFS_SIZE=0x80000        # SPIFFS size
+CFLAGS += -DSPIFFS_CACHE_PAGES=5       # Pages in the SPIFFS cache
+CFLAGS += -DSPIFFS_MAX_FDS=5           # SPIFFS file descriptors
+CFLAGS += -DSPIFFS_READ_AHEAD=1024     # Read-ahead buffer per read only file (0 = disabled)
 
 SPIFFS_ESPTOOL_ARGS = 0x100000 $(BUILD_DIR)spiffs_image.img
 
+#
+# Precompiled Lua module store (make flashstore), used in place from flash.
+# The program ends before it, see irom0_0_seg in config/ld/program.ld
+#
+LUA_STORE_OFFSET = 0xE0000             # SPI FLASH adress of the store image
+LUA_STORE_ADDR = 0x402E0000            # Address where the flash cache maps it
+LUA_STORE_MODULES = menu/main.lua=$(ROOT)spiffs_image/menu/main.lua \
+                    gstuff/menu.lua=$(ROOT)spiffs_image/gstuff/menu.lua
+CFLAGS += -DLUA_STORE_ADDR=$(LUA_STORE_ADDR)
+
 #
 # Console configuration
 #
@@ -54,6 +68,8 @@ CFLAGS += -DLORA_RST_PIN=14			   # RN2483 hardware reset pin
 CFLAGS += -DDEBUG_FREE_MEM=1           # Enable LUA free mem debug utility (only for debug purposes)
 CFLAGS += -DLUA_USE_LUA_LOCK=0		   # Enable if Lua must use real lua_lock / lua_unlock implementation
 CFLAGS += -DLUA_USE_SAFE_SIGNAL=1      # Enable use of LuaOS safe signal (experimental)
+CFLAGS += -DLUA_USE_ROSTRINGS=1        # Intern built-in names from a read-only table (see make rostrings)
+CFLAGS += -DLUA_USE_POOL=1             # Small Lua objects in size-class pools (see Lua/src/lpool.h)
 CFLAGS += -DSTRCACHE_N=1
 CFLAGS += -DSTRCACHE_M=1
 CFLAGS += -DMINSTRTABSIZE=32
@@ -81,6 +97,11 @@ CFLAGS += -DLUA_USE_THREAD=1			# thread
 CFLAGS += -DLUA_USE_EDITOR=1		       # editor
 CFLAGS += -DLUA_USE_I2C=1		       # editor
 
+#
+# GUI configuration
+#
+CFLAGS += -DGUI_KEY_INT_PIN=-1          # GPIO of the INT line of the keys PCF8575 (-1 = not wired, the port is polled)
+
 CFLAGS += -DPATH_MAX=63 -DMAXPATHLEN=63 
 
 CFLAGS += -D_NO_GETPWENT=1
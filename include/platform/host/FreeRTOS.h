@@ -0,0 +1,81 @@
+/*
+ * bhgv, FreeRTOS API for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The firmware code only uses a small part of the FreeRTOS API: delays,
+ * ticks, queues, semaphores and the heap functions. On the host they are
+ * implemented over pthreads (see platform/host/freertos.c), with the same
+ * tick rate as the board so tick based timeouts behave the same.
+ *
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common_macros.h"
+
+// Types of the lwIP / SDK headers used all over the firmware
+typedef uint8_t  u8_t;
+typedef int8_t   s8_t;
+typedef uint16_t u16_t;
+typedef int16_t  s16_t;
+typedef uint32_t u32_t;
+typedef int32_t  s32_t;
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define portBASE_TYPE           long
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+
+#define configTICK_RATE_HZ      ((TickType_t)100)
+#define configMINIMAL_STACK_SIZE 192
+#define configMAX_PRIORITIES    15
+#define configUSE_16_BIT_TICKS  0
+
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portTICK_PERIOD_US      ((TickType_t)1000000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS        portTICK_PERIOD_MS
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define errQUEUE_EMPTY          ((BaseType_t)0)
+#define errQUEUE_FULL           ((BaseType_t)0)
+
+// There are no interrupts, FromISR functions run in the hrtimer thread
+extern __thread int host_in_isr;
+
+#define portIN_ISR()             (host_in_isr)
+#define portEND_SWITCHING_ISR(x) (void)(x)
+#define portYIELD_FROM_ISR(x)    (void)(x)
+
+// Critical sections are a single process wide recursive lock
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+
+#define portENTER_CRITICAL()    vPortEnterCritical()
+#define portEXIT_CRITICAL()     vPortExitCritical()
+#define taskENTER_CRITICAL()    vPortEnterCritical()
+#define taskEXIT_CRITICAL()     vPortExitCritical()
+#define enter_critical_section() vPortEnterCritical()
+#define exit_critical_section()  vPortExitCritical()
+
+// Heap, see platform/host/heap.c
+void *pvPortMalloc(size_t xWantedSize);
+void vPortFree(void *pv);
+size_t xPortGetFreeHeapSize(void);
+size_t xPortGetMinimumEverFreeHeapSize(void);
+size_t xPortGetLargestFreeBlockSize(void);
+
+#endif /* INC_FREERTOS_H */
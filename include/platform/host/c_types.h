@@ -0,0 +1,45 @@
+/*
+ * bhgv, ESP8266 SDK types for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common_macros.h"
+
+typedef uint8_t   uint8;
+typedef int8_t    sint8;
+typedef int8_t    int8;
+typedef uint16_t  uint16;
+typedef int16_t   sint16;
+typedef int16_t   int16;
+typedef uint32_t  uint32;
+typedef int32_t   sint32;
+typedef int32_t   int32;
+typedef uint64_t  uint64;
+typedef int64_t   sint64;
+typedef double    real64;
+
+#define LOCAL static
+
+#ifndef ICACHE_FLASH_ATTR
+#define ICACHE_FLASH_ATTR
+#endif
+#ifndef ICACHE_RODATA_ATTR
+#define ICACHE_RODATA_ATTR
+#endif
+#ifndef STORE_ATTR
+#define STORE_ATTR __attribute__((aligned(4)))
+#endif
+
+#endif /* _C_TYPES_H_ */
@@ -0,0 +1,37 @@
+/*
+ * bhgv, common macros of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * Code and data placement attributes are meaningless on the host.
+ *
+ */
+
+#ifndef _COMMON_MACROS_H
+#define _COMMON_MACROS_H
+
+#ifndef IRAM
+#define IRAM
+#endif
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+#ifndef IRAM_DATA
+#define IRAM_DATA
+#endif
+#ifndef RAM_DATA
+#define RAM_DATA
+#endif
+
+#ifndef UNUSED
+#define UNUSED __attribute((unused))
+#endif
+
+#ifndef BIT
+#define BIT(X) (1<<(X))
+#endif
+
+#endif /* _COMMON_MACROS_H */
@@ -0,0 +1,27 @@
+/*
+ * bhgv, directories of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The directories the firmware reads are in SPIFFS, so it gets the struct
+ * dirent of the firmware instead of the system one. opendir, readdir and
+ * closedir are wrapped by platform/host/vfs.c.
+ *
+ */
+
+#ifndef HOST_DIRENT_H
+#define HOST_DIRENT_H
+
+#include <sys/types.h>
+#include <sys/sys/dirent.h>
+
+typedef struct host_dir DIR;
+
+DIR *opendir(const char *name);
+struct dirent *readdir(DIR *pdir);
+int closedir(DIR *pdir);
+
+#endif /* HOST_DIRENT_H */
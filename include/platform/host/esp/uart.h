@@ -0,0 +1,16 @@
+/*
+ * bhgv, UART of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The console is the process stdin / stdout, there are no other UARTs.
+ *
+ */
+
+#ifndef _ESP_UART_H
+#define _ESP_UART_H
+
+#endif /* _ESP_UART_H */
@@ -0,0 +1,39 @@
+/*
+ * bhgv, ESP8266 SDK functions for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The host is always connected, has no watchdog and an ADC that reads 0
+ * (see platform/host/stubs.c).
+ *
+ */
+
+#ifndef __ESP_COMMON_H__
+#define __ESP_COMMON_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "spi_flash.h"
+
+enum {
+    STATION_IDLE = 0,
+    STATION_CONNECTING,
+    STATION_WRONG_PASSWORD,
+    STATION_NO_AP_FOUND,
+    STATION_CONNECT_FAIL,
+    STATION_GOT_IP
+};
+
+uint8_t sdk_wifi_station_get_connect_status(void);
+uint32_t sdk_system_get_time(void);
+uint16_t sdk_system_adc_read(void);
+void sdk_wdt_feed(void);
+
+#endif /* __ESP_COMMON_H__ */
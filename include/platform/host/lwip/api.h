@@ -0,0 +1,80 @@
+/*
+ * bhgv, lwIP netconn API for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The subset of the netconn API used by httpd, on POSIX TCP sockets (see
+ * platform/host/netconn.c). Timeouts are in milliseconds, like in lwIP, and
+ * a received netbuf holds what a single recv() returned, at most
+ * recv_bufsize bytes.
+ *
+ */
+
+#ifndef __LWIP_API_H__
+#define __LWIP_API_H__
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/tcp.h"
+
+#define NETCONN_NOCOPY    0x00
+#define NETCONN_COPY      0x01
+#define NETCONN_MORE      0x02
+
+#define NETCONN_FLAG_NON_BLOCKING 0x02
+
+enum netconn_type {
+    NETCONN_INVALID = 0,
+    NETCONN_TCP     = 0x10,
+};
+
+struct netconn {
+    enum netconn_type type;
+    int fd;
+    u8_t flags;
+    struct tcp_pcb tcp;
+    union {
+        struct tcp_pcb *tcp;
+    } pcb;
+    s32_t send_timeout;
+    int recv_timeout;
+    int recv_bufsize;
+};
+
+struct netbuf {
+    void *data;
+    u16_t len;
+};
+
+struct netconn *netconn_new(enum netconn_type t);
+err_t netconn_delete(struct netconn *conn);
+err_t netconn_bind(struct netconn *conn, ip_addr_t *addr, u16_t port);
+err_t netconn_listen(struct netconn *conn);
+err_t netconn_accept(struct netconn *conn, struct netconn **new_conn);
+err_t netconn_recv(struct netconn *conn, struct netbuf **new_buf);
+err_t netconn_write(struct netconn *conn, const void *dataptr, size_t size, u8_t apiflags);
+err_t netconn_close(struct netconn *conn);
+
+#define netconn_set_nonblocking(conn, val)  do { if (val) { \
+  (conn)->flags |= NETCONN_FLAG_NON_BLOCKING; \
+} else { \
+  (conn)->flags &= ~ NETCONN_FLAG_NON_BLOCKING; }} while(0)
+#define netconn_is_nonblocking(conn)        (((conn)->flags & NETCONN_FLAG_NON_BLOCKING) != 0)
+
+#define netconn_set_sendtimeout(conn, timeout)      ((conn)->send_timeout = (timeout))
+#define netconn_get_sendtimeout(conn)               ((conn)->send_timeout)
+#define netconn_set_recvtimeout(conn, timeout)      ((conn)->recv_timeout = (timeout))
+#define netconn_get_recvtimeout(conn)               ((conn)->recv_timeout)
+#define netconn_set_recvbufsize(conn, recvbufsize)  ((conn)->recv_bufsize = (recvbufsize))
+#define netconn_get_recvbufsize(conn)               ((conn)->recv_bufsize)
+
+err_t netbuf_data(struct netbuf *buf, void **dataptr, u16_t *len);
+void netbuf_delete(struct netbuf *buf);
+
+// A netbuf is a single piece, there is no next one
+#define netbuf_next(buf)  ((void)(buf), -1)
+
+#endif /* __LWIP_API_H__ */
@@ -0,0 +1,18 @@
+/*
+ * bhgv, lwIP arch definitions for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * Only the byte order, used by luadata.
+ *
+ */
+
+#ifndef __LWIP_ARCH_H__
+#define __LWIP_ARCH_H__
+
+#include <endian.h>
+
+#endif /* __LWIP_ARCH_H__ */
@@ -0,0 +1,30 @@
+/*
+ * bhgv, lwIP addresses for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef __LWIP_IP_ADDR_H__
+#define __LWIP_IP_ADDR_H__
+
+#include "FreeRTOS.h"
+
+// In network byte order, like in lwIP
+typedef struct ip_addr {
+    u32_t addr;
+} ip_addr_t;
+
+extern const ip_addr_t ip_addr_any;
+
+#define IP_ADDR_ANY         ((ip_addr_t *)&ip_addr_any)
+
+#define ip4_addr1(ipaddr) (((u8_t*)(ipaddr))[0])
+#define ip4_addr2(ipaddr) (((u8_t*)(ipaddr))[1])
+#define ip4_addr3(ipaddr) (((u8_t*)(ipaddr))[2])
+#define ip4_addr4(ipaddr) (((u8_t*)(ipaddr))[3])
+
+#endif /* __LWIP_IP_ADDR_H__ */
@@ -0,0 +1,58 @@
+/*
+ * bhgv, lwIP socket API for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * lwIP sockets are BSD sockets, so they map to the host ones. Only bind
+ * is wrapped, to move the listening ports by the offset given on the
+ * command line (see platform/host/netconn.c).
+ *
+ */
+
+#ifndef __LWIP_SOCKETS_H__
+#define __LWIP_SOCKETS_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "lwip/err.h"
+
+int host_bind(int s, const struct sockaddr *name, socklen_t namelen);
+
+#define lwip_accept       accept
+#define lwip_bind         host_bind
+#define lwip_shutdown     shutdown
+#define lwip_getpeername  getpeername
+#define lwip_getsockname  getsockname
+#define lwip_setsockopt   setsockopt
+#define lwip_getsockopt   getsockopt
+#define lwip_close        close
+#define lwip_connect      connect
+#define lwip_listen       listen
+#define lwip_recv         recv
+#define lwip_read         read
+#define lwip_recvfrom     recvfrom
+#define lwip_send         send
+#define lwip_sendto       sendto
+#define lwip_socket       socket
+#define lwip_write        write
+#define lwip_select       select
+#define lwip_ioctl        ioctl
+#define lwip_fcntl        fcntl
+
+#define lwip_htons        htons
+#define lwip_ntohs        ntohs
+#define lwip_htonl        htonl
+#define lwip_ntohl        ntohl
+
+#endif /* __LWIP_SOCKETS_H__ */
@@ -0,0 +1,34 @@
+/*
+ * bhgv, lwIP TCP control block for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * Only the fields the firmware reads from the pcb of a netconn.
+ *
+ */
+
+#ifndef __LWIP_TCP_H__
+#define __LWIP_TCP_H__
+
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+#define SOF_REUSEADDR     0x04U  /* allow local address reuse */
+#define SOF_KEEPALIVE     0x08U  /* keep connections alive */
+
+#define ip_set_option(pcb, opt)   ((pcb)->so_options |= (opt))
+#define ip_reset_option(pcb, opt) ((pcb)->so_options &= ~(opt))
+#define ip_get_option(pcb, opt)   ((pcb)->so_options & (opt))
+
+struct tcp_pcb {
+    ip_addr_t local_ip;
+    ip_addr_t remote_ip;
+    u8_t so_options;
+    u16_t local_port;
+    u16_t remote_port;
+};
+
+#endif /* __LWIP_TCP_H__ */
@@ -0,0 +1,21 @@
+/*
+ * bhgv, SHA-1 for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The only mbedtls functions used by the firmware modules built for the
+ * host (the websocket handshake), see platform/host/mbedtls.c.
+ *
+ */
+
+#ifndef MBEDTLS_SHA1_H
+#define MBEDTLS_SHA1_H
+
+#include <stddef.h>
+
+void mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20]);
+
+#endif /* MBEDTLS_SHA1_H */
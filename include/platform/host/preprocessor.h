@@ -0,0 +1,13 @@
+/*
+ * bhgv, preprocessor macros for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * Same macros as the board, they are not platform specific.
+ *
+ */
+
+#include "../esp8266/preprocessor.h"
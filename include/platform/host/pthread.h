@@ -0,0 +1,68 @@
+/*
+ * bhgv, pthread extensions of the firmware for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The host threads are real pthreads, the firmware additions (initial
+ * state, suspend, resume and stop) are implemented in platform/host/pthread.c
+ * on top of them. The thread attributes carry the initial state, so they
+ * replace the system ones.
+ *
+ */
+
+#ifndef HOST_PTHREAD_H
+#define HOST_PTHREAD_H
+
+#include_next <pthread.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#include <sys/list/list.h>
+#include <signal.h>
+
+#define PTHREAD_INITIAL_STATE_RUN     1
+#define PTHREAD_INITIAL_STATE_SUSPEND 2
+
+typedef struct {
+    pthread_attr_t attr;
+    int initial_state;
+} host_pthread_attr_t;
+
+int host_pthread_attr_init(host_pthread_attr_t *attr);
+int host_pthread_attr_destroy(host_pthread_attr_t *attr);
+int host_pthread_attr_setstacksize(host_pthread_attr_t *attr, size_t stacksize);
+int host_pthread_attr_setdetachstate(host_pthread_attr_t *attr, int detachstate);
+int host_pthread_attr_setinitialstate(host_pthread_attr_t *attr, int initial_state);
+int host_pthread_create(pthread_t *thread, const host_pthread_attr_t *attr,
+                        void *(*start_routine) (void *), void *args);
+
+// The firmware pthread_cleanup_push is a function, without a matching pop
+void host_pthread_cleanup_push(void (*routine)(void *), void *arg);
+
+// The platform code defines HOST_PTHREAD_NATIVE to use the system ones
+#ifndef HOST_PTHREAD_NATIVE
+#define pthread_attr_t                 host_pthread_attr_t
+#define pthread_attr_init              host_pthread_attr_init
+#define pthread_attr_destroy           host_pthread_attr_destroy
+#define pthread_attr_setstacksize      host_pthread_attr_setstacksize
+#define pthread_attr_setdetachstate    host_pthread_attr_setdetachstate
+#define pthread_attr_setinitialstate   host_pthread_attr_setinitialstate
+#define pthread_create                 host_pthread_create
+
+#undef pthread_cleanup_push
+#define pthread_cleanup_push           host_pthread_cleanup_push
+#endif
+
+
+int _pthread_stop(pthread_t id);
+int _pthread_suspend(pthread_t id);
+int _pthread_resume(pthread_t id);
+int _pthread_free(pthread_t id);
+
+#endif /* HOST_PTHREAD_H */
@@ -0,0 +1,34 @@
+/*
+ * bhgv, FreeRTOS semaphore API for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * Like in FreeRTOS, a semaphore is a queue of items without data.
+ *
+ */
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef SemaphoreHandle_t xSemaphoreHandle;
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xTicksToWait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex);
+
+#define xSemaphoreCreateBinary()              xSemaphoreCreateCounting(1, 0)
+#define xSemaphoreCreateMutex()               xSemaphoreCreateCounting(1, 1)
+#define xSemaphoreTake(s, t)                  xQueueReceive(s, NULL, t)
+#define xSemaphoreGive(s)                     xQueueSend(s, NULL, 0)
+#define xSemaphoreGiveFromISR(s, w)           xQueueSendFromISR(s, NULL, w)
+#define xSemaphoreTakeFromISR(s, w)           ((void)(w), xQueueReceive(s, NULL, 0))
+#define vSemaphoreDelete(s)                   vQueueDelete(s)
+
+#endif /* SEMAPHORE_H */
@@ -0,0 +1,34 @@
+/*
+ * bhgv, SPI flash of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The flash is a file mapped in memory (see platform/host/flash.c), with
+ * the same sector size and write rules as the board's flash: an erase sets
+ * the bytes of a sector to 0xff and a write can only clear bits.
+ *
+ */
+
+#ifndef __SPI_FLASH_H__
+#define __SPI_FLASH_H__
+
+#include <stdint.h>
+
+#include "common_macros.h"
+
+typedef enum {
+    SPI_FLASH_RESULT_OK,
+    SPI_FLASH_RESULT_ERR,
+    SPI_FLASH_RESULT_TIMEOUT
+} sdk_SpiFlashOpResult;
+
+#define SPI_FLASH_SEC_SIZE      4096
+
+sdk_SpiFlashOpResult sdk_spi_flash_erase_sector(uint16_t sec);
+sdk_SpiFlashOpResult sdk_spi_flash_write(uint32_t des_addr, uint32_t *src, uint32_t size);
+sdk_SpiFlashOpResult sdk_spi_flash_read(uint32_t src_addr, uint32_t *des, uint32_t size);
+
+#endif /* __SPI_FLASH_H__ */
@@ -0,0 +1,41 @@
+/*
+ * bhgv, FreeRTOS task API for the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+// A task is a pthread
+typedef struct host_task *TaskHandle_t;
+typedef TaskHandle_t xTaskHandle;
+typedef void (*TaskFunction_t)(void *);
+
+#define tskIDLE_PRIORITY 0
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char *pcName,
+                       uint16_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask);
+void vTaskDelete(TaskHandle_t xTask);
+void vTaskDelay(TickType_t xTicksToDelay);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+#define taskYIELD() vTaskYield()
+void vTaskYield(void);
+
+// WHITECAT BEGIN
+struct lua_State;
+
+void uxSetLuaState(struct lua_State *L);
+struct lua_State *pvGetLuaState();
+// WHITECAT END
+
+#endif /* INC_TASK_H */
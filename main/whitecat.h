@@ -58,7 +58,7 @@
 #define USE_DISPLAY          0
 #define USE_CAN              0
 #define USE_STEPPER          0
-#define USE_MQTT             0
+#define USE_MQTT             1
 #define USE_CONSOLE          1
 
 // ---------------------------------------------------------------------------
@@ -229,6 +229,8 @@
 #define initTaskStack  configMINIMAL_STACK_SIZE * 10
 #define netTaskStack   configMINIMAL_STACK_SIZE * 10
 #define mqttStack      configMINIMAL_STACK_SIZE * 10
+#define acqStack       configMINIMAL_STACK_SIZE * 4
+#define pidStack       configMINIMAL_STACK_SIZE * 4
 #define ppinTaskStack  configMINIMAL_STACK_SIZE * 10
 #define loraTaskStack  configMINIMAL_STACK_SIZE * 10
 
@@ -244,3 +244,41 @@ size_t spi_transfer(uint8_t bus, const void *out_data, void *in_data, size_t len
 
     return len;
 }
+
+size_t spi_transfer_frames(uint8_t bus, const void *out_data, void *in_data,
+    size_t frame_len, size_t count, spi_word_size_t word_size)
+{
+    size_t bytes = frame_len * (uint8_t)word_size;
+    if (!out_data || !frame_len || !count || bytes > _SPI_BUF_SIZE) return 0;
+
+    spi_endianness_t e = spi_get_endianness(bus);
+    const uint8_t *out = (const uint8_t *)out_data;
+    uint8_t *in = (uint8_t *)in_data;
+
+    // Same size for every frame, so the bus is set up once
+    _wait(bus);
+    _set_size(bus, bytes);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        _wait(bus);
+        if (in && i)
+        {
+            // Frame received by the previous transfer
+            _spi_buf_prepare(bus, frame_len, e, word_size);
+            memcpy(in + (i - 1) * bytes, (void *)SPI(bus).W, bytes);
+        }
+        memcpy((void *)SPI(bus).W, out + i * bytes, bytes);
+        _spi_buf_prepare(bus, frame_len, e, word_size);
+        _start(bus);
+    }
+
+    _wait(bus);
+    if (in)
+    {
+        _spi_buf_prepare(bus, frame_len, e, word_size);
+        memcpy(in + (count - 1) * bytes, (void *)SPI(bus).W, bytes);
+    }
+
+    return count;
+}
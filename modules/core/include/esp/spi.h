@@ -264,6 +264,26 @@ uint32_t spi_transfer_32(uint8_t bus, uint32_t data);
  * \return Transmitted/received words count
  */
 size_t spi_transfer(uint8_t bus, const void *out_data, void *in_data, size_t len, spi_word_size_t word_size);
+/**
+ * \brief Transfer a sequence of fixed-size frames over SPI
+ * The frames are transferred back to back, the transfer size is set once
+ * and the next frame is loaded as soon as the previous one is received.
+ * A frame must fit the 64 byte hardware buffer.
+ * Example:
+ *
+ *    uint8_t out_buf[10 * 4], in_buf[10 * 4];
+ *    spi_transfer_frames(1, out_buf, in_buf, 4, 10, SPI_8BIT); // 10 frames of 4 bytes
+ *
+ * \param bus Bus ID: 0 - system, 1 - user
+ * \param out_data Frames to send, count * frame_len words.
+ * \param in_data Receive buffer of the same size. If NULL, received data will be lost.
+ * \param frame_len Frame size in words
+ * \param count Number of frames
+ * \param word_size Size of the word
+ * \return Transmitted/received frames count, 0 if a frame is over 64 bytes
+ */
+size_t spi_transfer_frames(uint8_t bus, const void *out_data, void *in_data,
+    size_t frame_len, size_t count, spi_word_size_t word_size);
 
 #ifdef __cplusplus
 }
@@ -39,6 +39,16 @@
  */
 #define VERIFY_BUF_SIZE 64
 
+/* Initial number of slots of the in-RAM key index (must be a power of 2).  The
+ * index doubles in size whenever it gets 3/4 full.
+ */
+#define INDEX_MIN_SIZE 16
+
+/* The size of the buffer (in words) used to hash keys read back from flash
+ * while building the key index.  This space is taken from the stack.
+ */
+#define HASH_BUFFER_SIZE 8 // words
+
 /* Size of region/entry headers.  These should not normally need tweaking (and
  * will probably require some code changes if they are tweaked).
  */
@@ -106,6 +116,14 @@ struct sysparam_context {
     uint16_t max_key_id;
 };
 
+/* A slot of the in-RAM key index.  Slots with a zero key_addr are empty. */
+struct index_slot {
+    uint32_t key_addr;
+    uint32_t value_addr;  // 0 if the key has no current value
+    uint16_t key_id;
+    uint16_t hash;
+};
+
 /*************************** Global variables/data ***************************/
 
 static struct {
@@ -117,6 +135,17 @@ static struct {
     xSemaphoreHandle sem;
 } _sysparam_info;
 
+/* Open-addressed hash table mapping key names to the flash addresses of their
+ * key and value entries, so lookups don't have to walk the whole region.  If
+ * it could not be allocated (slots is NULL) we fall back to scanning flash.
+ */
+static struct {
+    struct index_slot *slots;
+    uint16_t size;
+    uint16_t count;
+    uint16_t max_key_id;
+} _sysparam_index;
+
 /***************************** Internal routines *****************************/
 
 static inline IRAM sysparam_status_t _do_write(uint32_t addr, const void *data, size_t data_size) {
@@ -403,6 +432,226 @@ static inline sysparam_status_t _delete_entry(uint32_t addr) {
     return SYSPARAM_OK;
 }
 
+/** FNV-1a hash of a key, folded to 16 bits */
+static inline uint32_t _hash_update(uint32_t hash, const uint8_t *data, size_t len) {
+    while (len--) {
+        hash = (hash ^ *data++) * 16777619;
+    }
+    return hash;
+}
+
+static inline uint16_t _hash_fold(uint32_t hash) {
+    return (hash >> 16) ^ (hash & 0xffff);
+}
+
+static inline uint16_t _key_hash(const char *key, uint16_t key_len) {
+    return _hash_fold(_hash_update(2166136261, (const uint8_t *)key, key_len));
+}
+
+/** Hash the payload of the key entry pointed to by `ctx` */
+static sysparam_status_t _key_hash_flash(struct sysparam_context *ctx, uint16_t *hash) {
+    uint32_t buffer[HASH_BUFFER_SIZE];
+    uint32_t h = 2166136261;
+    uint32_t addr = ctx->addr + ENTRY_HEADER_SIZE;
+    size_t remain = ctx->entry.len;
+    size_t count;
+
+    while (remain) {
+        count = min(remain, sizeof(buffer));
+        CHECK_FLASH_OP(sdk_spi_flash_read(addr, buffer, ROUND_TO_WORD_BOUNDARY(count)));
+        h = _hash_update(h, (uint8_t *)buffer, count);
+        addr += count;
+        remain -= count;
+    }
+    *hash = _hash_fold(h);
+    return SYSPARAM_OK;
+}
+
+static void _index_free(void) {
+    free(_sysparam_index.slots);
+    memset(&_sysparam_index, 0, sizeof(_sysparam_index));
+}
+
+static struct index_slot *_index_slot_for(struct index_slot *slots, uint16_t size, uint16_t hash) {
+    uint16_t mask = size - 1;
+    uint16_t i = hash & mask;
+
+    while (slots[i].key_addr) {
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+/** Add a key to the index, growing it if needed */
+static sysparam_status_t _index_insert(uint16_t hash, uint16_t key_id, uint32_t key_addr, struct index_slot **slotp) {
+    struct index_slot *slots;
+    struct index_slot *slot;
+    uint16_t size = _sysparam_index.size;
+    int i;
+
+    if ((_sysparam_index.count + 1) * 4 > size * 3) {
+        size = size ? size * 2 : INDEX_MIN_SIZE;
+        slots = calloc(size, sizeof(struct index_slot));
+        if (!slots) return SYSPARAM_ERR_NOMEM;
+        for (i = 0; i < _sysparam_index.size; i++) {
+            if (_sysparam_index.slots[i].key_addr) {
+                slot = _index_slot_for(slots, size, _sysparam_index.slots[i].hash);
+                *slot = _sysparam_index.slots[i];
+            }
+        }
+        free(_sysparam_index.slots);
+        _sysparam_index.slots = slots;
+        _sysparam_index.size = size;
+    }
+
+    slot = _index_slot_for(_sysparam_index.slots, _sysparam_index.size, hash);
+    slot->key_addr = key_addr;
+    slot->value_addr = 0;
+    slot->key_id = key_id;
+    slot->hash = hash;
+    _sysparam_index.count++;
+    _sysparam_index.max_key_id = max(_sysparam_index.max_key_id, key_id);
+    if (slotp) *slotp = slot;
+
+    return SYSPARAM_OK;
+}
+
+/** (Re)build the key index from the contents of the active region.
+ *
+ *  If there isn't enough memory for it, the index is left disabled and all
+ *  lookups will scan the flash instead.
+ */
+static sysparam_status_t _index_build(void) {
+    struct sysparam_context ctx;
+    sysparam_status_t status;
+    uint16_t *id_map;
+    uint16_t hash;
+    uint16_t id;
+    int i;
+
+    _index_free();
+
+    // First pass: all the live keys
+    _init_context(&ctx);
+    while ((status = _find_entry(&ctx, ENTRY_ID_ANY, false)) == SYSPARAM_OK) {
+        status = _key_hash_flash(&ctx, &hash);
+        if (status < 0) break;
+        status = _index_insert(hash, ctx.entry.idflags & ENTRY_MASK_ID, ctx.addr, NULL);
+        if (status < 0) break;
+    }
+    if (status == SYSPARAM_NOTFOUND && !_sysparam_index.slots) {
+        // Empty region.  Allocate the initial table anyway, so that we know
+        // the index is in use.
+        _sysparam_index.slots = calloc(INDEX_MIN_SIZE, sizeof(struct index_slot));
+        _sysparam_index.size = INDEX_MIN_SIZE;
+        status = _sysparam_index.slots ? SYSPARAM_NOTFOUND : SYSPARAM_ERR_NOMEM;
+    }
+    if (status != SYSPARAM_NOTFOUND) {
+        _index_free();
+        return status;
+    }
+
+    // Second pass: attach the values to their keys (using a temporary id to
+    // slot map, so this doesn't turn quadratic)
+    id_map = malloc((_sysparam_index.max_key_id + 1) * sizeof(uint16_t));
+    if (!id_map) {
+        _index_free();
+        return SYSPARAM_ERR_NOMEM;
+    }
+    memset(id_map, 0xff, (_sysparam_index.max_key_id + 1) * sizeof(uint16_t));
+    for (i = 0; i < _sysparam_index.size; i++) {
+        if (_sysparam_index.slots[i].key_addr) {
+            id_map[_sysparam_index.slots[i].key_id] = i;
+        }
+    }
+
+    _init_context(&ctx);
+    while ((status = _find_entry(&ctx, ENTRY_ID_ANY, true)) == SYSPARAM_OK) {
+        id = ctx.entry.idflags & ENTRY_MASK_ID;
+        if (id > _sysparam_index.max_key_id || id_map[id] == 0xffff) continue;
+        // Like _find_value, the first live value after the key wins
+        if (!_sysparam_index.slots[id_map[id]].value_addr) {
+            _sysparam_index.slots[id_map[id]].value_addr = ctx.addr;
+        }
+    }
+    free(id_map);
+    if (status != SYSPARAM_NOTFOUND) {
+        _index_free();
+        return status;
+    }
+
+    debug(2, "indexed %d keys (%d slots)", _sysparam_index.count, _sysparam_index.size);
+    return SYSPARAM_OK;
+}
+
+/** Find the index slot of the specified key name */
+static sysparam_status_t _index_find_key(const char *key, uint16_t key_len, uint8_t *buffer, struct index_slot **slotp) {
+    uint16_t hash = _key_hash(key, key_len);
+    uint16_t mask = _sysparam_index.size - 1;
+    struct index_slot *slot;
+    struct entry_header entry;
+    uint16_t i;
+
+    debug(3, "find key (indexed): %s", key);
+    for (i = hash & mask; _sysparam_index.slots[i].key_addr; i = (i + 1) & mask) {
+        slot = &_sysparam_index.slots[i];
+        if (slot->hash != hash) continue;
+        CHECK_FLASH_OP(sdk_spi_flash_read(slot->key_addr, (void*) &entry, ENTRY_HEADER_SIZE));
+        if (entry.len != key_len) continue;
+        CHECK_FLASH_OP(sdk_spi_flash_read(slot->key_addr + ENTRY_HEADER_SIZE, (void*) buffer, key_len));
+        if (!memcmp(key, buffer, key_len)) {
+            debug(3, "key match @ 0x%08x (value @ 0x%08x)", slot->key_addr, slot->value_addr);
+            *slotp = slot;
+            return SYSPARAM_OK;
+        }
+    }
+    return SYSPARAM_NOTFOUND;
+}
+
+/** Point `ctx` to the value entry of an index slot */
+static sysparam_status_t _index_load_value(struct sysparam_context *ctx, struct index_slot *slot) {
+    if (!slot->value_addr) {
+        ctx->entry.len = 0;
+        ctx->entry.idflags = 0;
+        return SYSPARAM_NOTFOUND;
+    }
+    ctx->addr = slot->value_addr;
+    debug(3, "read entry header @ 0x%08x", ctx->addr);
+    CHECK_FLASH_OP(sdk_spi_flash_read(ctx->addr, (void*) &ctx->entry, ENTRY_HEADER_SIZE));
+    return SYSPARAM_OK;
+}
+
+/** Set the key id/unused key counts of `ctx` from the index (as if
+ *  `_find_entry` had scanned the whole region) */
+static void _index_fill_context(struct sysparam_context *ctx) {
+    int i;
+
+    ctx->max_key_id = _sysparam_index.max_key_id;
+    ctx->unused_keys = 0;
+    for (i = 0; i < _sysparam_index.size; i++) {
+        if (_sysparam_index.slots[i].key_addr && !_sysparam_index.slots[i].value_addr) {
+            ctx->unused_keys++;
+        }
+    }
+}
+
+/** Find the value entry of the specified key name, through the index if
+ *  there's one */
+static sysparam_status_t _lookup_value(struct sysparam_context *ctx, const char *key, uint16_t key_len, uint8_t *buffer) {
+    struct index_slot *slot;
+    sysparam_status_t status;
+
+    _init_context(ctx);
+    if (_sysparam_index.slots) {
+        status = _index_find_key(key, key_len, buffer, &slot);
+        if (status != SYSPARAM_OK) return status;
+        return _index_load_value(ctx, slot);
+    }
+    status = _find_key(ctx, key, key_len, buffer);
+    if (status != SYSPARAM_OK) return status;
+    return _find_value(ctx, ctx->entry.idflags);
+}
+
 /** Compact the current region, removing all deleted/unused entries, and write
  *  the result to the alternate region, then make the new alternate region the
  *  active one.
@@ -413,13 +662,15 @@ static inline sysparam_status_t _delete_entry(uint32_t addr) {
  *  the output (because it is assumed it will be overwritten as the next step
  *  in `sysparam_set_data` anyway).  When compacting, this routine will
  *  automatically update *key_id to contain the ID of this key in the new
- *  compacted result as well.
+ *  compacted result as well.  If the key had no value (and thus was dropped
+ *  from the compacted result), *key_id is set to -1.
  */
 static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_id) {
     uint32_t new_base = _sysparam_info.alt_base;
     sysparam_status_t status;
     uint32_t addr = new_base + REGION_HEADER_SIZE;
     uint16_t current_key_id = 0;
+    bool key_found = false;
     sysparam_iter_t iter;
     uint16_t binary_flag;
     uint16_t num_sectors = _sysparam_info.region_size / sdk_flashchip.sector_size;
@@ -445,6 +696,7 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
         if ((iter.ctx->entry.idflags & ENTRY_MASK_ID) == *key_id) {
             // Update key_id to have the correct id for the compacted result
             *key_id = current_key_id;
+            key_found = true;
             // Don't copy the old value, since we'll just be deleting it
             // and writing a new one as soon as we return.
             continue;
@@ -471,6 +723,11 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
     status = _write_region_header(_sysparam_info.cur_base, new_base, false);
     if (status < 0) return status;
 
+    if (!key_found) {
+        // The key is gone, so the caller has to write a new one.
+        *key_id = -1;
+    }
+
     _sysparam_info.alt_base = _sysparam_info.cur_base;
     _sysparam_info.cur_base = new_base;
     _sysparam_info.end_addr = addr;
@@ -483,6 +740,10 @@ static sysparam_status_t _compact_params(struct sysparam_context *ctx, int *key_
 
     debug(1, "done compacting (current size %d)", _sysparam_info.end_addr - _sysparam_info.cur_base);
 
+    // Everything moved, so re-index the new region.  The index is only an
+    // optimization, so failing to build it is not an error.
+    _index_build();
+
     return SYSPARAM_OK;
 }
 
@@ -574,6 +835,8 @@ sysparam_status_t sysparam_init(uint32_t base_addr, uint32_t top_addr) {
         _sysparam_info.end_addr = ctx.addr;
     }
 
+    _index_build();
+
     _sysparam_info.sem = xSemaphoreCreateMutex();
 
     return SYSPARAM_OK;
@@ -613,6 +876,7 @@ sysparam_status_t sysparam_create_area(uint32_t base_addr, uint16_t num_sectors,
         // De-initialize everything to force the caller to do a clean
         // `sysparam_init()` afterwards.
         memset(&_sysparam_info, 0, sizeof(_sysparam_info));
+        _index_free();
     }
     status = _format_region(base_addr, num_sectors);
     if (status < 0) return status;
@@ -645,13 +909,10 @@ sysparam_status_t sysparam_get_data(const char *key, uint8_t **destptr, size_t *
 
     buffer = malloc(key_len + 2);
     if (!buffer) return SYSPARAM_ERR_NOMEM;
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
     do {
-        _init_context(&ctx);
-        status = _find_key(&ctx, key, key_len, buffer);
-        if (status != SYSPARAM_OK) break;
-
-        // Find the associated value
-        status = _find_value(&ctx, ctx.entry.idflags);
+        // Find the key and its associated value
+        status = _lookup_value(&ctx, key, key_len, buffer);
         if (status != SYSPARAM_OK) break;
 
         newbuf = realloc(buffer, ctx.entry.len + 1);
@@ -668,12 +929,14 @@ sysparam_status_t sysparam_get_data(const char *key, uint8_t **destptr, size_t *
         // interpret the result as a string).
         buffer[ctx.entry.len] = 0;
 
+        xSemaphoreGive(_sysparam_info.sem);
         *destptr = buffer;
         if (actual_length) *actual_length = ctx.entry.len;
         if (is_binary) *is_binary = (bool)(ctx.entry.idflags & ENTRY_FLAG_BINARY);
         return SYSPARAM_OK;
     } while (false);
 
+    xSemaphoreGive(_sysparam_info.sem);
     free(buffer);
     if (actual_length) *actual_length = 0;
     return status;
@@ -692,12 +955,12 @@ sysparam_status_t sysparam_get_data_static(const char *key, uint8_t *buffer, siz
 
     if (actual_length) *actual_length = 0;
 
-    _init_context(&ctx);
-    status = _find_key(&ctx, key, key_len, buffer);
-    if (status != SYSPARAM_OK) return status;
-    status = _find_value(&ctx, ctx.entry.idflags);
-    if (status != SYSPARAM_OK) return status;
-    status = _read_payload(&ctx, buffer, buffer_size);
+    xSemaphoreTake(_sysparam_info.sem, portMAX_DELAY);
+    status = _lookup_value(&ctx, key, key_len, buffer);
+    if (status == SYSPARAM_OK) {
+        status = _read_payload(&ctx, buffer, buffer_size);
+    }
+    xSemaphoreGive(_sysparam_info.sem);
     if (status != SYSPARAM_OK) return status;
 
     if (actual_length) *actual_length = ctx.entry.len;
@@ -786,7 +1049,10 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
     bool free_value = false;
     int key_id = -1;
     uint32_t old_value_addr = 0;
+    size_t old_value_size = 0;
     uint16_t binary_flag;
+    struct index_slot *slot = NULL;
+    bool indexed = false;
    
     if (!_sysparam_info.cur_base) return SYSPARAM_ERR_NOINIT;
     if (!key_len) return SYSPARAM_ERR_BADVALUE;
@@ -820,13 +1086,27 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
 
     do {
         _init_context(&ctx);
-        status = _find_key(&ctx, key, key_len, buffer);
-        if (status == SYSPARAM_OK) {
-            // Key already exists, see if there's a current value.
-            key_id = ctx.entry.idflags & ENTRY_MASK_ID;
-            status = _find_value(&ctx, key_id);
+        indexed = (_sysparam_index.slots != NULL);
+        if (indexed) {
+            status = _index_find_key(key, key_len, buffer, &slot);
             if (status == SYSPARAM_OK) {
-                old_value_addr = ctx.addr;
+                key_id = slot->key_id;
+                status = _index_load_value(&ctx, slot);
+                if (status == SYSPARAM_OK) {
+                    old_value_addr = ctx.addr;
+                }
+            } else if (status == SYSPARAM_NOTFOUND) {
+                _index_fill_context(&ctx);
+            }
+        } else {
+            status = _find_key(&ctx, key, key_len, buffer);
+            if (status == SYSPARAM_OK) {
+                // Key already exists, see if there's a current value.
+                key_id = ctx.entry.idflags & ENTRY_MASK_ID;
+                status = _find_value(&ctx, key_id);
+                if (status == SYSPARAM_OK) {
+                    old_value_addr = ctx.addr;
+                }
             }
         }
         if (status < 0) break;
@@ -858,7 +1138,8 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // Since we will be deleting the old value (if any) make sure
                 // that the compactable count includes the space taken up by
                 // that entry too (even though it's not actually deleted yet)
-                ctx.compactable += ENTRY_SIZE(ctx.entry.len);
+                old_value_size = ENTRY_SIZE(ctx.entry.len);
+                ctx.compactable += old_value_size;
             }
 
             // Append new value to the end, but first make sure we have enough
@@ -874,7 +1155,13 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
             if (needed_space > free_space) {
                 // Can we compact things?
                 // First, scan all remaining entries up to the end so we can
-                // get a reasonably accurate "compactable" reading.
+                // get a reasonably accurate "compactable" reading.  An
+                // indexed lookup didn't scan anything, so start over from the
+                // beginning in that case.
+                if (indexed) {
+                    _init_context(&ctx);
+                    ctx.compactable = old_value_size;
+                }
                 _find_entry(&ctx, ENTRY_ID_END, false);
                 if (needed_space <= free_space + ctx.compactable) {
                     // We should be able to get enough space by compacting.
@@ -904,9 +1191,9 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
             if (key_id < 0) {
                 // We need to write a key entry for a new key.
                 // If we didn't find the key, then we already know _find_entry
-                // has gone through the entire contents, and thus
-                // ctx.max_key_id has the largest key_id found in the whole
-                // region.
+                // has gone through the entire contents (or the index filled
+                // it in), and thus ctx.max_key_id has the largest key_id
+                // found in the whole region.
                 if (ctx.max_key_id >= MAX_KEY_ID) {
                     if (ctx.unused_keys > 0) {
                         status = _compact_params(&ctx, &key_id);
@@ -926,6 +1213,7 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 // writing anything new, so do that.
                 status = _compact_params(&ctx, &key_id);
                 if (status < 0) break;
+                old_value_addr = 0;
             }
 
             init_write_context(&write_ctx);
@@ -935,14 +1223,31 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
                 key_id = ctx.max_key_id + 1;
                 status = _write_entry(write_ctx.addr, key_id, (uint8_t *)key, key_len);
                 if (status < 0) break;
+                if (_sysparam_index.slots && _index_insert(_key_hash(key, key_len), key_id, write_ctx.addr, &slot) < 0) {
+                    // Out of memory, go back to scanning the flash
+                    _index_free();
+                }
                 write_ctx.addr += ENTRY_SIZE(key_len);
+            } else if (_sysparam_index.slots) {
+                // Compacting above rebuilds the index, so the slot we found
+                // may be stale.  Look it up again.
+                slot = NULL;
+                status = _index_find_key(key, key_len, buffer, &slot);
+                if (status < 0) break;
             }
 
             // Write new value
             status = _write_entry(write_ctx.addr, key_id | ENTRY_FLAG_VALUE | binary_flag, value, value_len);
             if (status < 0) break;
+            if (_sysparam_index.slots && slot) {
+                slot->value_addr = write_ctx.addr;
+            }
             write_ctx.addr += ENTRY_SIZE(value_len);
             _sysparam_info.end_addr = write_ctx.addr;
+        } else if (slot) {
+            // Deleting the value, the key stays around (unused) until the
+            // next compaction
+            slot->value_addr = 0;
         }
 
         // Delete old value (if present) by clearing its "alive" flag
@@ -957,6 +1262,12 @@ sysparam_status_t sysparam_set_data(const char *key, const uint8_t *value, size_
     if (free_value) free((void *)value);
     free(buffer);
 
+    if (status < 0 && _sysparam_index.slots) {
+        // Something went wrong half way, so the index may not match what
+        // actually made it to the flash anymore.
+        _index_build();
+    }
+
  done:
     xSemaphoreGive(_sysparam_info.sem);
 
@@ -40,3 +40,44 @@ fonts_CFLAGS = $(CFLAGS) \
 	-DFONTS_TERMINUS_BOLD_16X32_KOI8_R=$(FONTS_TERMINUS_BOLD_16X32_KOI8_R)
 	
 $(eval $(call component_compile_rules,fonts))
+
+# font files of the SPIFFS image, for the fonts set to 2
+FONTS_NAMES = GLCD_5X7:glcd_5x7 \
+	ROBOTO_8PT:roboto_8pt \
+	ROBOTO_10PT:roboto_10pt \
+	BITOCRA_4X7:bitocra_4x7_ascii \
+	BITOCRA_6X11:bitocra_6x11_iso8859_1 \
+	BITOCRA_7X13:bitocra_7x13_iso8859_1 \
+	TERMINUS_6X12_ISO8859_1:terminus_6x12_iso8859_1 \
+	TERMINUS_8X14_ISO8859_1:terminus_8x14_iso8859_1 \
+	TERMINUS_BOLD_8X14_ISO8859_1:terminus_bold_8x14_iso8859_1 \
+	TERMINUS_10X18_ISO8859_1:terminus_10x18_iso8859_1 \
+	TERMINUS_BOLD_10X18_ISO8859_1:terminus_bold_10x18_iso8859_1 \
+	TERMINUS_11X22_ISO8859_1:terminus_11x22_iso8859_1 \
+	TERMINUS_BOLD_11X22_ISO8859_1:terminus_bold_11x22_iso8859_1 \
+	TERMINUS_12X24_ISO8859_1:terminus_12x24_iso8859_1 \
+	TERMINUS_BOLD_12X24_ISO8859_1:terminus_bold_12x24_iso8859_1 \
+	TERMINUS_14X28_ISO8859_1:terminus_14x28_iso8859_1 \
+	TERMINUS_BOLD_14X28_ISO8859_1:terminus_bold_14x28_iso8859_1 \
+	TERMINUS_16X32_ISO8859_1:terminus_16x32_iso8859_1 \
+	TERMINUS_BOLD_16X32_ISO8859_1:terminus_bold_16x32_iso8859_1 \
+	TERMINUS_6X12_KOI8_R:terminus_6x12_koi8_r \
+	TERMINUS_8X14_KOI8_R:terminus_8x14_koi8_r \
+	TERMINUS_BOLD_8X14_KOI8_R:terminus_bold_8x14_koi8_r \
+	TERMINUS_14X28_KOI8_R:terminus_14x28_koi8_r \
+	TERMINUS_BOLD_14X28_KOI8_R:terminus_bold_14x28_koi8_r \
+	TERMINUS_16X32_KOI8_R:terminus_16x32_koi8_r \
+	TERMINUS_BOLD_16X32_KOI8_R:terminus_bold_16x32_koi8_r
+
+FONTS_SPIFFS_DIR = $(ROOT)spiffs_image/fonts/
+FONTS_FILES = $(foreach f,$(FONTS_NAMES),$(if $(filter 2,$(FONTS_$(firstword $(subst :, ,$(f))))),\
+	$(FONTS_SPIFFS_DIR)$(lastword $(subst :, ,$(f))).fnt))
+
+$(FONTS_SPIFFS_DIR)%.fnt: $(FONTS_DIR)data/font_%.h $(FONTS_DIR)tools/mkfont.py
+	@mkdir -p $(dir $@)
+	python3 $(FONTS_DIR)tools/mkfont.py $< -o $@
+
+.PHONY: fonts
+fonts: $(FONTS_FILES)
+
+flashall: fonts
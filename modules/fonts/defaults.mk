@@ -1,39 +1,42 @@
 #########################################
-# Default built-in fonts
+# Default fonts
 #########################################
 
-# FIXME
+# 1: built in the firmware
+# 2: a file of the SPIFFS image, fonts/<name>.fnt, made by tools/mkfont.py
+#    and loaded on its first use (oled.setFont)
+# 0: none, unless a font file of that name is uploaded
 
 FONTS_GLCD_5X7 ?= 1
 
-FONTS_ROBOTO_8PT ?= 0
-FONTS_ROBOTO_10PT ?= 0
+FONTS_ROBOTO_8PT ?= 2
+FONTS_ROBOTO_10PT ?= 2
 
 # BitOCRA
-FONTS_BITOCRA_4X7 ?= 0
-FONTS_BITOCRA_6X11 ?= 0
-FONTS_BITOCRA_7X13 ?= 0
+FONTS_BITOCRA_4X7 ?= 1
+FONTS_BITOCRA_6X11 ?= 2
+FONTS_BITOCRA_7X13 ?= 2
 
 # Terminus, ISO8859-1 (Latin-1)
-FONTS_TERMINUS_6X12_ISO8859_1 ?= 0
-FONTS_TERMINUS_8X14_ISO8859_1 ?= 0
-FONTS_TERMINUS_BOLD_8X14_ISO8859_1 ?= 0
-FONTS_TERMINUS_10X18_ISO8859_1 ?= 0
-FONTS_TERMINUS_BOLD_10X18_ISO8859_1 ?= 0
-FONTS_TERMINUS_11X22_ISO8859_1 ?= 0
-FONTS_TERMINUS_BOLD_11X22_ISO8859_1 ?= 0
-FONTS_TERMINUS_12X24_ISO8859_1 ?= 0
-FONTS_TERMINUS_BOLD_12X24_ISO8859_1 ?= 0
-FONTS_TERMINUS_14X28_ISO8859_1 ?= 0
-FONTS_TERMINUS_BOLD_14X28_ISO8859_1 ?= 0
-FONTS_TERMINUS_16X32_ISO8859_1 ?= 0
-FONTS_TERMINUS_BOLD_16X32_ISO8859_1 ?= 0
+FONTS_TERMINUS_6X12_ISO8859_1 ?= 1
+FONTS_TERMINUS_8X14_ISO8859_1 ?= 2
+FONTS_TERMINUS_BOLD_8X14_ISO8859_1 ?= 2
+FONTS_TERMINUS_10X18_ISO8859_1 ?= 2
+FONTS_TERMINUS_BOLD_10X18_ISO8859_1 ?= 2
+FONTS_TERMINUS_11X22_ISO8859_1 ?= 2
+FONTS_TERMINUS_BOLD_11X22_ISO8859_1 ?= 2
+FONTS_TERMINUS_12X24_ISO8859_1 ?= 2
+FONTS_TERMINUS_BOLD_12X24_ISO8859_1 ?= 2
+FONTS_TERMINUS_14X28_ISO8859_1 ?= 2
+FONTS_TERMINUS_BOLD_14X28_ISO8859_1 ?= 2
+FONTS_TERMINUS_16X32_ISO8859_1 ?= 2
+FONTS_TERMINUS_BOLD_16X32_ISO8859_1 ?= 2
 
 # Terminus, KOI8-R
-FONTS_TERMINUS_6X12_KOI8_R ?= 0
-FONTS_TERMINUS_8X14_KOI8_R ?= 0
-FONTS_TERMINUS_BOLD_8X14_KOI8_R ?= 0
-FONTS_TERMINUS_14X28_KOI8_R ?= 0
-FONTS_TERMINUS_BOLD_14X28_KOI8_R ?= 0
-FONTS_TERMINUS_16X32_KOI8_R ?= 0
-FONTS_TERMINUS_BOLD_16X32_KOI8_R ?= 0
+FONTS_TERMINUS_6X12_KOI8_R ?= 2
+FONTS_TERMINUS_8X14_KOI8_R ?= 2
+FONTS_TERMINUS_BOLD_8X14_KOI8_R ?= 2
+FONTS_TERMINUS_14X28_KOI8_R ?= 2
+FONTS_TERMINUS_BOLD_14X28_KOI8_R ?= 2
+FONTS_TERMINUS_16X32_KOI8_R ?= 2
+FONTS_TERMINUS_BOLD_16X32_KOI8_R ?= 2
@@ -0,0 +1,379 @@
+/*
+ * bhgv, fonts loaded from files
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * A font file keeps its ranges of code points and the widths of its
+ * glyphs in RAM, a byte per glyph, and a cache of glyphs unpacked in the
+ * page layout of the SSD1306, so that a string is drawn a column of bytes
+ * at a time. A glyph not in the cache is read from the file (its entry,
+ * then its data) into the least recently used slot.
+ *
+ * The fonts are used by one task at a time (the drawing of Lua).
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "font_file.h"
+
+#define HEADER_SIZE 16
+#define RANGE_SIZE  8
+#define GLYPH_SIZE  4
+
+#define GLYPH_PACKED 0x80
+#define GLYPH_WIDTH  0x7f
+
+static uint16_t get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static int read_at(font_file_t *ff, uint32_t offset, void *buf, size_t n)
+{
+    if (fseek(ff->f, offset, SEEK_SET) || fread(buf, 1, n, ff->f) != n)
+        return -1;
+
+    ff->stats.read += n;
+    return 0;
+}
+
+// PackBits, the size of out exactly
+static int unpack(const uint8_t *in, int n, uint8_t *out, int size)
+{
+    int i = 0, o = 0, k, h;
+
+    while (i < n && o < size)
+    {
+        h = in[i++];
+        if (h < 128)
+        {
+            k = h + 1;
+            if (i + k > n || o + k > size)
+                return -1;
+            memcpy(out + o, in + i, k);
+            i += k;
+        }
+        else if (h > 128)
+        {
+            k = 257 - h;
+            if (i >= n || o + k > size)
+                return -1;
+            memset(out + o, in[i++], k);
+        }
+        else
+            continue;
+        o += k;
+    }
+
+    return o == size ? 0 : -1;
+}
+
+static int find_glyph(const font_file_t *ff, uint32_t cp)
+{
+    int lo = 0, hi = ff->nranges - 1, m;
+    const font_range_t *r;
+
+    while (lo <= hi)
+    {
+        m = (lo + hi) / 2;
+        r = &ff->ranges[m];
+        if (cp < r->first)
+            hi = m - 1;
+        else if (cp >= r->first + r->count)
+            lo = m + 1;
+        else
+            return r->glyph + (cp - r->first);
+    }
+
+    return -1;
+}
+
+static void lru_unlink(font_file_t *ff, uint8_t s)
+{
+    font_slot_t *e = &ff->slot[s];
+
+    if (e->prev != FONT_NO_SLOT)
+        ff->slot[e->prev].next = e->next;
+    else
+        ff->head = e->next;
+
+    if (e->next != FONT_NO_SLOT)
+        ff->slot[e->next].prev = e->prev;
+    else
+        ff->tail = e->prev;
+}
+
+static void lru_push(font_file_t *ff, uint8_t s)
+{
+    font_slot_t *e = &ff->slot[s];
+
+    e->prev = FONT_NO_SLOT;
+    e->next = ff->head;
+    if (ff->head != FONT_NO_SLOT)
+        ff->slot[ff->head].prev = s;
+    else
+        ff->tail = s;
+    ff->head = s;
+}
+
+// Reads glyph g into slot s
+static int load_glyph(font_file_t *ff, int g, uint8_t s)
+{
+    uint8_t e[GLYPH_SIZE], buf[FONT_WIDTH_MAX * FONT_HEIGHT_MAX / 8];
+    uint8_t *out = ff->pool + s * ff->width_max * ff->pages;
+    int size = (ff->widths[g] & GLYPH_WIDTH) * ff->pages;
+    int n;
+
+    if (read_at(ff, ff->table + g * GLYPH_SIZE, e, GLYPH_SIZE))
+        return -1;
+
+    n = e[2];
+    if ((e[3] & GLYPH_WIDTH) != (ff->widths[g] & GLYPH_WIDTH) || n > sizeof(buf) ||
+        (!(e[3] & GLYPH_PACKED) && n != size))
+        return -1;
+
+    if (read_at(ff, ff->data + get16(e), (e[3] & GLYPH_PACKED) ? buf : out, n))
+        return -1;
+
+    if (e[3] & GLYPH_PACKED)
+        return unpack(buf, n, out, size);
+
+    return 0;
+}
+
+font_info_t *font_file_open(const char *path, size_t cache, int *err)
+{
+    uint8_t h[HEADER_SIZE], e[RANGE_SIZE];
+    font_file_t *ff = NULL;
+    font_range_t *ranges;
+    size_t size, glyph;
+    FILE *f;
+    int i, nranges, nglyphs, slots, width_max, pages;
+
+    if ((f = fopen(path, "rb")) == NULL)
+    {
+        *err = ENOENT;
+        return NULL;
+    }
+
+    *err = EINVAL;
+    if (fread(h, 1, HEADER_SIZE, f) != HEADER_SIZE || memcmp(h, FONT_FILE_MAGIC, 4) ||
+        h[4] != FONT_FILE_VERSION)
+        goto fail;
+
+    nranges = get16(h + 8);
+    nglyphs = get16(h + 10);
+    width_max = h[12];
+    pages = (h[5] + 7) / 8;
+    if (!h[5] || h[5] > FONT_HEIGHT_MAX || !width_max || width_max > FONT_WIDTH_MAX ||
+        !nranges || !nglyphs)
+        goto fail;
+
+    // The slots, at least 4 and no more than the glyphs
+    glyph = width_max * pages;
+    slots = (cache ? cache : FONT_CACHE_SIZE) / glyph;
+    if (slots < 4)
+        slots = 4;
+    if (slots > nglyphs)
+        slots = nglyphs;
+    if (slots >= FONT_NO_SLOT)
+        slots = FONT_NO_SLOT - 1;
+
+    size = sizeof(font_file_t) + nranges * sizeof(font_range_t) + slots * sizeof(font_slot_t) +
+           2 * nglyphs + slots * glyph;
+    if ((ff = calloc(1, size)) == NULL)
+    {
+        *err = ENOMEM;
+        goto fail;
+    }
+
+    ranges = (font_range_t *)(ff + 1);
+    ff->slot = (font_slot_t *)(ranges + nranges);
+    ff->widths = (uint8_t *)(ff->slot + slots);
+    ff->slot_of = ff->widths + nglyphs;
+    ff->pool = ff->slot_of + nglyphs;
+
+    ff->f = f;
+    ff->ranges = ranges;
+    ff->nranges = nranges;
+    ff->nglyphs = nglyphs;
+    ff->width_max = width_max;
+    ff->pages = pages;
+    ff->table = HEADER_SIZE + nranges * RANGE_SIZE;
+    ff->data = ff->table + nglyphs * GLYPH_SIZE;
+
+    for (i = 0; i < nranges; i++)
+    {
+        if (fread(e, 1, RANGE_SIZE, f) != RANGE_SIZE)
+            goto fail;
+        ranges[i].first = get32(e);
+        ranges[i].count = get16(e + 4);
+        ranges[i].glyph = get16(e + 6);
+        if (ranges[i].glyph + ranges[i].count > nglyphs ||
+            (i && ranges[i].first < ranges[i - 1].first + ranges[i - 1].count))
+            goto fail;
+    }
+
+    for (i = 0; i < nglyphs; i++)
+    {
+        if (fread(e, 1, GLYPH_SIZE, f) != GLYPH_SIZE || (e[3] & GLYPH_WIDTH) > width_max)
+            goto fail;
+        ff->widths[i] = e[3];
+    }
+    ff->stats.read = ff->data;
+
+    memset(ff->slot_of, FONT_NO_SLOT, nglyphs);
+    ff->slots = slots;
+    ff->head = ff->tail = FONT_NO_SLOT;
+    for (i = 0; i < slots; i++)
+    {
+        ff->slot[i].glyph = 0xffff;
+        lru_push(ff, i);
+    }
+
+    ff->stats.glyphs = nglyphs;
+    ff->stats.ranges = nranges;
+    ff->stats.slots = slots;
+    ff->stats.cache = slots * glyph;
+
+    ff->info.height = h[5];
+    ff->info.c = h[6];
+    ff->info.char_start = 1;
+    ff->info.char_end = 0;
+    ff->info.file = ff;
+
+    *err = 0;
+    return &ff->info;
+
+fail:
+    free(ff);
+    fclose(f);
+    return NULL;
+}
+
+void font_file_close(font_info_t *fnt)
+{
+    font_file_t *ff;
+
+    if (fnt == NULL || (ff = fnt->file) == NULL)
+        return;
+
+    fclose(ff->f);
+    free(ff);
+}
+
+const uint8_t *font_file_glyph(const font_info_t *fnt, uint32_t cp, uint8_t *width)
+{
+    font_file_t *ff = fnt->file;
+    int g = find_glyph(ff, cp);
+    uint8_t s;
+
+    if (g < 0)
+        return NULL;
+
+    s = ff->slot_of[g];
+    if (s != FONT_NO_SLOT)
+    {
+        ff->stats.hits++;
+    }
+    else
+    {
+        // The least recently used one
+        s = ff->tail;
+        if (ff->slot[s].glyph != 0xffff)
+        {
+            ff->slot_of[ff->slot[s].glyph] = FONT_NO_SLOT;
+            ff->stats.evictions++;
+        }
+        ff->slot[s].glyph = 0xffff;
+        ff->stats.misses++;
+
+        if (load_glyph(ff, g, s))
+            return NULL;
+
+        ff->slot[s].glyph = g;
+        ff->slot_of[g] = s;
+    }
+
+    if (s != ff->head)
+    {
+        lru_unlink(ff, s);
+        lru_push(ff, s);
+    }
+
+    *width = ff->widths[g] & GLYPH_WIDTH;
+    return ff->pool + s * ff->width_max * ff->pages;
+}
+
+int font_file_width(const font_info_t *fnt, uint32_t cp)
+{
+    const font_file_t *ff = fnt->file;
+    int g = find_glyph(ff, cp);
+
+    return g < 0 ? -1 : (ff->widths[g] & GLYPH_WIDTH);
+}
+
+uint32_t font_utf8_next(const char **s)
+{
+    const uint8_t *p = (const uint8_t *)*s;
+    uint32_t cp = p[0], min;
+    int n, i;
+
+    if (cp < 0x80)
+        n = 0, min = 0;
+    else if ((cp & 0xe0) == 0xc0)
+        n = 1, min = 0x80, cp &= 0x1f;
+    else if ((cp & 0xf0) == 0xe0)
+        n = 2, min = 0x800, cp &= 0x0f;
+    else if ((cp & 0xf8) == 0xf0)
+        n = 3, min = 0x10000, cp &= 0x07;
+    else
+        n = -1;
+
+    for (i = 1; i <= n; i++)
+    {
+        if ((p[i] & 0xc0) != 0x80)
+        {
+            n = -1;
+            break;
+        }
+        cp = (cp << 6) | (p[i] & 0x3f);
+    }
+
+    // Not UTF-8, a byte
+    if (n < 0 || cp < min || cp > 0x10ffff)
+    {
+        *s += 1;
+        return p[0];
+    }
+
+    *s += n + 1;
+    return cp;
+}
+
+void font_file_get_stats(const font_info_t *fnt, font_file_stats_t *st, int reset)
+{
+    font_file_t *ff = fnt->file;
+
+    *st = ff->stats;
+    if (reset)
+    {
+        ff->stats.hits = 0;
+        ff->stats.misses = 0;
+        ff->stats.evictions = 0;
+        ff->stats.read = 0;
+    }
+}
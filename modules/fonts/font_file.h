@@ -0,0 +1,142 @@
+/*
+ * bhgv, fonts loaded from files
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _EXTRAS_FONTS_FONT_FILE_H_
+#define _EXTRAS_FONTS_FONT_FILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fonts.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The fonts of font_face_t not built in, <name>.fnt
+#ifndef FONT_FILE_DIR
+#define FONT_FILE_DIR "/fonts/"
+#endif
+
+// Bytes of glyphs kept in RAM per font by default
+#ifndef FONT_CACHE_SIZE
+#define FONT_CACHE_SIZE 1024
+#endif
+
+#define FONT_FILE_MAGIC   "OFNT"
+#define FONT_FILE_VERSION 1
+
+#define FONT_HEIGHT_MAX 32
+#define FONT_WIDTH_MAX  32
+
+#define FONT_NO_SLOT 0xff
+
+/**
+ * A range of code points, glyphs glyph to glyph + count - 1
+ */
+typedef struct
+{
+    uint32_t first;
+    uint16_t count;
+    uint16_t glyph;
+} font_range_t;
+
+/**
+ * A slot of the glyph cache, in the LRU list
+ */
+typedef struct
+{
+    uint16_t glyph;
+    uint8_t prev;
+    uint8_t next;
+} font_slot_t;
+
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t read;          ///< bytes read from the file
+    uint16_t glyphs;
+    uint16_t ranges;
+    uint16_t slots;
+    uint16_t cache;         ///< bytes of the slots
+} font_file_stats_t;
+
+/**
+ * A font file (see tools/mkfont.py) and its glyph cache. The file stays
+ * open, the glyphs are read on their first use, unpacked in the page
+ * layout of the SSD1306 into the least recently used slot.
+ */
+typedef struct font_file
+{
+    FILE *f;
+    uint32_t table;         ///< offset of the glyphs in the file
+    uint32_t data;          ///< offset of their data
+    uint16_t nranges;
+    uint16_t nglyphs;
+    uint8_t width_max;
+    uint8_t pages;
+
+    const font_range_t *ranges;
+    uint8_t *widths;        ///< of each glyph
+    uint8_t *slot_of;       ///< slot of each glyph, or FONT_NO_SLOT
+
+    font_slot_t *slot;
+    uint8_t *pool;          ///< slots of width_max * pages bytes
+    uint8_t slots;
+    uint8_t head;           ///< most recently used
+    uint8_t tail;           ///< least
+
+    font_file_stats_t stats;
+    font_info_t info;       ///< the font drawn, info.file is this
+} font_file_t;
+
+/**
+ * Load a font file
+ * @param path Font file
+ * @param cache Bytes of glyphs kept in RAM, 0 for FONT_CACHE_SIZE
+ * @param err ENOENT, EINVAL (not a font file) or ENOMEM when it fails
+ * @return Font or NULL
+ */
+font_info_t *font_file_open(const char *path, size_t cache, int *err);
+
+/**
+ * Close a font file, the font can't be drawn then
+ */
+void font_file_close(font_info_t *fnt);
+
+/**
+ * Glyph of a code point, in the cache until the next glyphs
+ * @param fnt Font of a file
+ * @param cp Code point
+ * @param width Width of the glyph
+ * @return Pages of the glyph, width bytes each, or NULL
+ */
+const uint8_t *font_file_glyph(const font_info_t *fnt, uint32_t cp, uint8_t *width);
+
+/**
+ * Width of a code point, -1 if the font doesn't have it
+ */
+int font_file_width(const font_info_t *fnt, uint32_t cp);
+
+/**
+ * Next code point of an UTF-8 string. A byte that doesn't start a valid
+ * sequence is its own code point, as in ISO8859-1.
+ */
+uint32_t font_utf8_next(const char **s);
+
+void font_file_get_stats(const font_info_t *fnt, font_file_stats_t *st, int reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EXTRAS_FONTS_FONT_FILE_H_ */
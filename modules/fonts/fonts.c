@@ -6,119 +6,99 @@
  * @date: 8 dec. 2016
  *      Author: zaltora
  */
+#include <stdio.h>
+
 #include "fonts.h"
+#include "font_file.h"
 
-//#ifndef FONTS_GLCD_5X7
+/*
+ * A font set to 1 in defaults.mk is built in, to 2 it is a file of the
+ * file system (see tools/mkfont.py), loaded by font_get()
+ */
+#ifndef FONTS_GLCD_5X7
 #define FONTS_GLCD_5X7 1
+#endif
 
-#define FONTS_ROBOTO_8PT 1
-#define FONTS_ROBOTO_10PT 1
-#define FONTS_BITOCRA_4X7 1
-#define FONTS_BITOCRA_6X11 1
-#define FONTS_BITOCRA_7X13 1
-#define FONTS_TERMINUS_6X12_ISO8859_1 1
-#define FONTS_TERMINUS_8X14_ISO8859_1 1
-#define FONTS_TERMINUS_BOLD_8X14_ISO8859_1 1
-#define FONTS_TERMINUS_10X18_ISO8859_1 1
-#define FONTS_TERMINUS_BOLD_10X18_ISO8859_1 1
-#define FONTS_TERMINUS_11X22_ISO8859_1 1
-#define FONTS_TERMINUS_BOLD_11X22_ISO8859_1 1
-#define FONTS_TERMINUS_12X24_ISO8859_1 1
-#define FONTS_TERMINUS_BOLD_12X24_ISO8859_1 1
-#define FONTS_TERMINUS_14X28_ISO8859_1 1
-#define FONTS_TERMINUS_BOLD_14X28_ISO8859_1 1
-#define FONTS_TERMINUS_16X32_ISO8859_1 1
-#define FONTS_TERMINUS_BOLD_16X32_ISO8859_1 1
-#define FONTS_TERMINUS_6X12_KOI8_R 1
-#define FONTS_TERMINUS_8X14_KOI8_R 1
-#define FONTS_TERMINUS_BOLD_8X14_KOI8_R 1
-#define FONTS_TERMINUS_14X28_KOI8_R 1
-#define FONTS_TERMINUS_BOLD_14X28_KOI8_R 1
-#define FONTS_TERMINUS_16X32_KOI8_R 1
-//#define FONTS_TERMINUS_BOLD_16X32_KOI8_R
-
-//#endif
-
-#if FONTS_GLCD_5X7
+#if FONTS_GLCD_5X7 == 1
     #include "data/font_glcd_5x7.h"
 #endif
 
-#if FONTS_ROBOTO_8PT
+#if FONTS_ROBOTO_8PT == 1
     #include "data/font_roboto_8pt.h"
 #endif
-#if FONTS_ROBOTO_10PT
+#if FONTS_ROBOTO_10PT == 1
     #include "data/font_roboto_10pt.h"
 #endif
 
-#if FONTS_BITOCRA_4X7
+#if FONTS_BITOCRA_4X7 == 1
     #include "data/font_bitocra_4x7_ascii.h"
 #endif
-#if FONTS_BITOCRA_6X11
+#if FONTS_BITOCRA_6X11 == 1
     #include "data/font_bitocra_6x11_iso8859_1.h"
 #endif
-#if FONTS_BITOCRA_7X13
+#if FONTS_BITOCRA_7X13 == 1
     #include "data/font_bitocra_7x13_iso8859_1.h"
 #endif
 
-#if FONTS_TERMINUS_6X12_ISO8859_1
+#if FONTS_TERMINUS_6X12_ISO8859_1 == 1
     #include "data/font_terminus_6x12_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_8X14_ISO8859_1
+#if FONTS_TERMINUS_8X14_ISO8859_1 == 1
     #include "data/font_terminus_8x14_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_BOLD_8X14_ISO8859_1
+#if FONTS_TERMINUS_BOLD_8X14_ISO8859_1 == 1
     #include "data/font_terminus_bold_8x14_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_10X18_ISO8859_1
+#if FONTS_TERMINUS_10X18_ISO8859_1 == 1
     #include "data/font_terminus_10x18_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_BOLD_10X18_ISO8859_1
+#if FONTS_TERMINUS_BOLD_10X18_ISO8859_1 == 1
     #include "data/font_terminus_bold_10x18_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_11X22_ISO8859_1
+#if FONTS_TERMINUS_11X22_ISO8859_1 == 1
     #include "data/font_terminus_11x22_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_BOLD_11X22_ISO8859_1
+#if FONTS_TERMINUS_BOLD_11X22_ISO8859_1 == 1
     #include "data/font_terminus_bold_11x22_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_12X24_ISO8859_1
+#if FONTS_TERMINUS_12X24_ISO8859_1 == 1
     #include "data/font_terminus_12x24_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_BOLD_12X24_ISO8859_1
+#if FONTS_TERMINUS_BOLD_12X24_ISO8859_1 == 1
     #include "data/font_terminus_bold_12x24_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_14X28_ISO8859_1
+#if FONTS_TERMINUS_14X28_ISO8859_1 == 1
     #include "data/font_terminus_14x28_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_BOLD_14X28_ISO8859_1
+#if FONTS_TERMINUS_BOLD_14X28_ISO8859_1 == 1
     #include "data/font_terminus_bold_14x28_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_16X32_ISO8859_1
+#if FONTS_TERMINUS_16X32_ISO8859_1 == 1
     #include "data/font_terminus_16x32_iso8859_1.h"
 #endif
-#if FONTS_TERMINUS_BOLD_16X32_ISO8859_1
+#if FONTS_TERMINUS_BOLD_16X32_ISO8859_1 == 1
     #include "data/font_terminus_bold_16x32_iso8859_1.h"
 #endif
 
-#if FONTS_TERMINUS_6X12_KOI8_R
+#if FONTS_TERMINUS_6X12_KOI8_R == 1
     #include "data/font_terminus_6x12_koi8_r.h"
 #endif
-#if FONTS_TERMINUS_8X14_KOI8_R
+#if FONTS_TERMINUS_8X14_KOI8_R == 1
     #include "data/font_terminus_8x14_koi8_r.h"
 #endif
-#if FONTS_TERMINUS_BOLD_8X14_KOI8_R
+#if FONTS_TERMINUS_BOLD_8X14_KOI8_R == 1
     #include "data/font_terminus_bold_8x14_koi8_r.h"
 #endif
-#if FONTS_TERMINUS_14X28_KOI8_R
+#if FONTS_TERMINUS_14X28_KOI8_R == 1
     #include "data/font_terminus_14x28_koi8_r.h"
 #endif
-#if FONTS_TERMINUS_BOLD_14X28_KOI8_R
+#if FONTS_TERMINUS_BOLD_14X28_KOI8_R == 1
     #include "data/font_terminus_bold_14x28_koi8_r.h"
 #endif
-#if FONTS_TERMINUS_16X32_KOI8_R
+#if FONTS_TERMINUS_16X32_KOI8_R == 1
     #include "data/font_terminus_16x32_koi8_r.h"
 #endif
-#if FONTS_TERMINUS_BOLD_16X32_KOI8_R
+#if FONTS_TERMINUS_BOLD_16X32_KOI8_R == 1
     #include "data/font_terminus_bold_16x32_koi8_r.h"
 #endif
 
@@ -128,136 +108,136 @@
 
 const font_info_t *font_builtin_fonts[] =
 {
-#if FONTS_GLCD_5X7
+#if FONTS_GLCD_5X7 == 1
     [FONT_FACE_GLCD5x7] = &_fonts_glcd_5x7_info,
 #else
     [FONT_FACE_GLCD5x7] = NULL,
 #endif
 
-#if FONTS_ROBOTO_8PT
+#if FONTS_ROBOTO_8PT == 1
     [FONT_FACE_ROBOTO_8PT] = &_fonts_roboto_8pt_info,
 #else
     [FONT_FACE_ROBOTO_8PT] = NULL,
 #endif
-#if FONTS_ROBOTO_10PT
+#if FONTS_ROBOTO_10PT == 1
     [FONT_FACE_ROBOTO_10PT] = &_fonts_roboto_10pt_info,
 #else
     [FONT_FACE_ROBOTO_10PT] = NULL,
 #endif
 
-#if FONTS_BITOCRA_4X7
+#if FONTS_BITOCRA_4X7 == 1
     [FONT_FACE_BITOCRA_4X7] = &_fonts_bitocra_4x7_ascii_info,
 #else
     [FONT_FACE_BITOCRA_4X7] = NULL,
 #endif
-#if FONTS_BITOCRA_6X11
+#if FONTS_BITOCRA_6X11 == 1
     [FONT_FACE_BITOCRA_6X11] = &_fonts_bitocra_6x11_iso8859_1_info,
 #else
     [FONT_FACE_BITOCRA_6X11] = NULL,
 #endif
-#if FONTS_BITOCRA_7X13
+#if FONTS_BITOCRA_7X13 == 1
     [FONT_FACE_BITOCRA_7X13] = &_fonts_bitocra_7x13_iso8859_1_info,
 #else
     [FONT_FACE_BITOCRA_7X13] = NULL,
 #endif
 
-#if FONTS_TERMINUS_6X12_ISO8859_1
+#if FONTS_TERMINUS_6X12_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_6X12_ISO8859_1] = &_fonts_terminus_6x12_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_6X12_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_8X14_ISO8859_1
+#if FONTS_TERMINUS_8X14_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_8X14_ISO8859_1] = &_fonts_terminus_8x14_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_8X14_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_8X14_ISO8859_1
+#if FONTS_TERMINUS_BOLD_8X14_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_BOLD_8X14_ISO8859_1] = &_fonts_terminus_bold_8x14_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_8X14_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_10X18_ISO8859_1
+#if FONTS_TERMINUS_10X18_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_10X18_ISO8859_1] = &_fonts_terminus_10x18_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_10X18_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_10X18_ISO8859_1
+#if FONTS_TERMINUS_BOLD_10X18_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_BOLD_10X18_ISO8859_1] = &_fonts_terminus_bold_10x18_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_10X18_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_11X22_ISO8859_1
+#if FONTS_TERMINUS_11X22_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_11X22_ISO8859_1] = &_fonts_terminus_11x22_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_11X22_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_11X22_ISO8859_1
+#if FONTS_TERMINUS_BOLD_11X22_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_BOLD_11X22_ISO8859_1] = &_fonts_terminus_bold_11x22_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_11X22_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_12X24_ISO8859_1
+#if FONTS_TERMINUS_12X24_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_12X24_ISO8859_1] = &_fonts_terminus_12x24_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_12X24_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_12X24_ISO8859_1
+#if FONTS_TERMINUS_BOLD_12X24_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_BOLD_12X24_ISO8859_1] = &_fonts_terminus_bold_12x24_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_12X24_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_14X28_ISO8859_1
+#if FONTS_TERMINUS_14X28_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_14X28_ISO8859_1] = &_fonts_terminus_14x28_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_14X28_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_14X28_ISO8859_1
+#if FONTS_TERMINUS_BOLD_14X28_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_BOLD_14X28_ISO8859_1] = &_fonts_terminus_bold_14x28_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_14X28_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_16X32_ISO8859_1
+#if FONTS_TERMINUS_16X32_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_16X32_ISO8859_1] = &_fonts_terminus_16x32_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_16X32_ISO8859_1] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_16X32_ISO8859_1
+#if FONTS_TERMINUS_BOLD_16X32_ISO8859_1 == 1
     [FONT_FACE_TERMINUS_BOLD_16X32_ISO8859_1] = &_fonts_terminus_bold_16x32_iso8859_1_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_16X32_ISO8859_1] = NULL,
 #endif
 
-#if FONTS_TERMINUS_6X12_KOI8_R
+#if FONTS_TERMINUS_6X12_KOI8_R == 1
     [FONT_FACE_TERMINUS_6X12_KOI8_R] = &_fonts_terminus_6x12_koi8_r_info,
 #else
     [FONT_FACE_TERMINUS_6X12_KOI8_R] = NULL,
 #endif
-#if FONTS_TERMINUS_8X14_KOI8_R
+#if FONTS_TERMINUS_8X14_KOI8_R == 1
     [FONT_FACE_TERMINUS_8X14_KOI8_R] = &_fonts_terminus_8x14_koi8_r_info,
 #else
     [FONT_FACE_TERMINUS_8X14_KOI8_R] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_8X14_KOI8_R
+#if FONTS_TERMINUS_BOLD_8X14_KOI8_R == 1
     [FONT_FACE_TERMINUS_BOLD_8X14_KOI8_R] = &_fonts_terminus_bold_8x14_koi8_r_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_8X14_KOI8_R] = NULL,
 #endif
-#if FONTS_TERMINUS_14X28_KOI8_R
+#if FONTS_TERMINUS_14X28_KOI8_R == 1
     [FONT_FACE_TERMINUS_14X28_KOI8_R] = &_fonts_terminus_14x28_koi8_r_info,
 #else
     [FONT_FACE_TERMINUS_14X28_KOI8_R] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_14X28_KOI8_R
+#if FONTS_TERMINUS_BOLD_14X28_KOI8_R == 1
     [FONT_FACE_TERMINUS_BOLD_14X28_KOI8_R] = &_fonts_terminus_bold_14x28_koi8_r_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_14X28_KOI8_R] = NULL,
 #endif
-#if FONTS_TERMINUS_16X32_KOI8_R
+#if FONTS_TERMINUS_16X32_KOI8_R == 1
     [FONT_FACE_TERMINUS_16X32_KOI8_R] = &_fonts_terminus_16x32_koi8_r_info,
 #else
     [FONT_FACE_TERMINUS_16X32_KOI8_R] = NULL,
 #endif
-#if FONTS_TERMINUS_BOLD_16X32_KOI8_R
+#if FONTS_TERMINUS_BOLD_16X32_KOI8_R == 1
     [FONT_FACE_TERMINUS_BOLD_16X32_KOI8_R] = &_fonts_terminus_bold_16x32_koi8_r_info,
 #else
     [FONT_FACE_TERMINUS_BOLD_16X32_KOI8_R] = NULL,
@@ -266,6 +246,63 @@ const font_info_t *font_builtin_fonts[] =
 
 const size_t font_builtin_fonts_count = (sizeof(font_builtin_fonts) / sizeof(font_info_t *));
 
+const char *font_names[] =
+{
+    [FONT_FACE_GLCD5x7] = "glcd_5x7",
+
+    [FONT_FACE_ROBOTO_8PT] = "roboto_8pt",
+    [FONT_FACE_ROBOTO_10PT] = "roboto_10pt",
+
+    [FONT_FACE_BITOCRA_4X7] = "bitocra_4x7_ascii",
+    [FONT_FACE_BITOCRA_6X11] = "bitocra_6x11_iso8859_1",
+    [FONT_FACE_BITOCRA_7X13] = "bitocra_7x13_iso8859_1",
+
+    [FONT_FACE_TERMINUS_6X12_ISO8859_1] = "terminus_6x12_iso8859_1",
+    [FONT_FACE_TERMINUS_8X14_ISO8859_1] = "terminus_8x14_iso8859_1",
+    [FONT_FACE_TERMINUS_BOLD_8X14_ISO8859_1] = "terminus_bold_8x14_iso8859_1",
+    [FONT_FACE_TERMINUS_10X18_ISO8859_1] = "terminus_10x18_iso8859_1",
+    [FONT_FACE_TERMINUS_BOLD_10X18_ISO8859_1] = "terminus_bold_10x18_iso8859_1",
+    [FONT_FACE_TERMINUS_11X22_ISO8859_1] = "terminus_11x22_iso8859_1",
+    [FONT_FACE_TERMINUS_BOLD_11X22_ISO8859_1] = "terminus_bold_11x22_iso8859_1",
+    [FONT_FACE_TERMINUS_12X24_ISO8859_1] = "terminus_12x24_iso8859_1",
+    [FONT_FACE_TERMINUS_BOLD_12X24_ISO8859_1] = "terminus_bold_12x24_iso8859_1",
+    [FONT_FACE_TERMINUS_14X28_ISO8859_1] = "terminus_14x28_iso8859_1",
+    [FONT_FACE_TERMINUS_BOLD_14X28_ISO8859_1] = "terminus_bold_14x28_iso8859_1",
+    [FONT_FACE_TERMINUS_16X32_ISO8859_1] = "terminus_16x32_iso8859_1",
+    [FONT_FACE_TERMINUS_BOLD_16X32_ISO8859_1] = "terminus_bold_16x32_iso8859_1",
+
+    [FONT_FACE_TERMINUS_6X12_KOI8_R] = "terminus_6x12_koi8_r",
+    [FONT_FACE_TERMINUS_8X14_KOI8_R] = "terminus_8x14_koi8_r",
+    [FONT_FACE_TERMINUS_BOLD_8X14_KOI8_R] = "terminus_bold_8x14_koi8_r",
+    [FONT_FACE_TERMINUS_14X28_KOI8_R] = "terminus_14x28_koi8_r",
+    [FONT_FACE_TERMINUS_BOLD_14X28_KOI8_R] = "terminus_bold_14x28_koi8_r",
+    [FONT_FACE_TERMINUS_16X32_KOI8_R] = "terminus_16x32_koi8_r",
+    [FONT_FACE_TERMINUS_BOLD_16X32_KOI8_R] = "terminus_bold_16x32_koi8_r",
+};
+
+// The fonts loaded from their files, kept
+static font_info_t *font_files[sizeof(font_builtin_fonts) / sizeof(font_info_t *)];
+
+const font_info_t *font_get(font_face_t face)
+{
+    char path[64];
+    int err;
+
+    if (face >= font_builtin_fonts_count)
+        return NULL;
+
+    if (font_builtin_fonts[face])
+        return font_builtin_fonts[face];
+
+    if (font_files[face] == NULL)
+    {
+        snprintf(path, sizeof(path), FONT_FILE_DIR "%s.fnt", font_names[face]);
+        font_files[face] = font_file_open(path, 0, &err);
+    }
+
+    return font_files[face];
+}
+
 /////////////////////////////////////////////
 
 uint16_t font_measure_string(const font_info_t *fnt, const char *s)
@@ -273,6 +310,17 @@ uint16_t font_measure_string(const font_info_t *fnt, const char *s)
     if (!s || !fnt) return 0;
 
     uint16_t res = 0;
+    int w;
+
+    if (fnt->file)
+    {
+        while (*s)
+            if ((w = font_file_width(fnt, font_utf8_next(&s))) >= 0)
+                res += w + fnt->c;
+
+        return res > 0 ? res - fnt->c : 0;
+    }
+
     while (*s)
     {
         const font_char_desc_t *d = font_get_char_desc(fnt, *s);
@@ -58,6 +58,8 @@ typedef struct _font_char_desc
     uint16_t offset; ///< Offset of this character in bitmap
 } font_char_desc_t;
 
+struct font_file;
+
 /**
  * Font information
  */
@@ -69,6 +71,7 @@ typedef struct _font_info
     char char_end;                            ///< Last character
     const font_char_desc_t *char_descriptors; ///< descriptor for each character
     const uint8_t *bitmap;                    ///< Character bitmap
+    struct font_file *file;                   ///< Font loaded from a file, see font_file.h
 } font_info_t;
 
 /**
@@ -77,6 +80,18 @@ typedef struct _font_info
 extern const font_info_t *font_builtin_fonts[];
 extern const size_t font_builtin_fonts_count;
 
+/**
+ * Names of the fonts, a font not built in is loaded from FONT_FILE_DIR<name>.fnt
+ */
+extern const char *font_names[];
+
+/**
+ * Get a font, built in or loaded from its file on the first use
+ * @param face Font face
+ * @return Font information or NULL if the font is neither built in nor on the file system
+ */
+const font_info_t *font_get(font_face_t face);
+
 /**
  * Find character decriptor in font
  * @param fnt Poniter to font information struct
@@ -93,7 +108,7 @@ inline const font_char_desc_t *font_get_char_desc(const font_info_t *fnt, char c
 /**
  * Calculate width of string in pixels
  * @param fnt Poniter to font information struct
- * @param s String
+ * @param s String, UTF-8 for a font loaded from a file
  * @return String width
  */
 uint16_t font_measure_string(const font_info_t *fnt, const char *s);
@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# bhgv, font files for SPIFFS
+#
+# Copyright (C) 2017
+# Author: bhgv (http://github.com/bhgv)
+#
+# All rights reserved.
+#
+# Builds a font file read by fonts/font_file.c from a font header of
+# ../data or from a BDF font, for the code points of some UTF-8 ranges:
+#
+#   mkfont.py ../data/font_terminus_8x14_koi8_r.h -o terminus_8x14_koi8_r.fnt
+#   mkfont.py ter-u14n.bdf -r 0x20-0x7e -r 0x400-0x45f -o terminus_8x14_uni.fnt
+#
+# The characters of a header are mapped to Unicode by its charset (from the
+# name, or --charset). The file is little endian:
+#
+#   header  "OFNT", version, height, c, flags, ranges (16), glyphs (16),
+#           largest width, 3 bytes of 0
+#   ranges  first code point (32), count (16), first glyph (16)
+#   glyphs  offset in the data (16), size, width (bit 7: packed)
+#   data    the glyphs in the page layout of the SSD1306: pages of 8 rows,
+#           a byte per column, bit 0 at the top, packed as PackBits when
+#           it is smaller.
+
+import argparse
+import codecs
+import re
+import struct
+import sys
+
+MAGIC = b'OFNT'
+VERSION = 1
+HEIGHT_MAX = 32
+WIDTH_MAX = 32
+GLYPH_RLE = 0x80
+DATA_MAX = 0xffff
+
+
+class Glyph:
+    def __init__(self, code, width, rows):
+        self.code = code
+        self.width = width
+        self.rows = rows        # a list of height ints, bit width - 1 - i is column i
+
+
+def strip_comments(text):
+    text = re.sub(r'/\*.*?\*/', ' ', text, flags=re.S)
+    return re.sub(r'//[^\n]*', ' ', text)
+
+
+def c_value(s):
+    s = s.strip()
+    m = re.match(r"'(\\?.)'$", s)
+    if m:
+        return ord(codecs.decode(m.group(1), 'unicode_escape'))
+    return int(s, 0)
+
+
+def charset_of(name, charset):
+    if charset:
+        return charset
+    for cs in ('iso8859_1', 'koi8_r', 'ascii'):
+        if cs in name:
+            return {'iso8859_1': 'latin_1'}.get(cs, cs)
+    # glcd and roboto: the code of a character is its byte
+    return 'latin_1'
+
+
+def load_header(path, charset):
+    text = open(path, encoding='latin_1').read()
+    code = strip_comments(text)
+
+    def field(f):
+        m = re.search(r'\.' + f + r'\s*=\s*([^,}]+)', code)
+        if not m:
+            raise ValueError('%s: no .%s' % (path, f))
+        return c_value(m.group(1))
+
+    height, c = field('height'), field('c')
+    start, end = field('char_start'), field('char_end')
+
+    m = re.search(r'_descriptors\[\]\s*=\s*\{(.*?)\};', code, re.S)
+    desc = [(int(w, 0), int(o, 0)) for w, o in
+            re.findall(r'\{\s*(\w+)\s*,\s*(\w+)\s*\}', m.group(1))]
+
+    m = re.search(r'_bitmaps\[\]\s*=\s*\{(.*?)\};', code, re.S)
+    bitmap = [int(v, 0) for v in re.findall(r'0[xX][0-9a-fA-F]+|\d+', m.group(1))]
+
+    space = None
+    if end < start and len(desc) == start - c + 1:
+        # The roboto headers: their fields are shifted by one, c is the
+        # first character, char_start the last, char_end the width of the
+        # space, which has no glyph
+        c, start, end, space = 1, c, start, end
+
+    if len(desc) < end - start + 1:
+        raise ValueError('%s: %d characters, %d descriptors' % (path, end - start + 1, len(desc)))
+
+    cs = charset_of(path, charset)
+    glyphs = []
+    if space is not None:
+        glyphs.append(Glyph(0x20, space, [0] * height))
+
+    for i in range(end - start + 1):
+        width, offset = desc[i]
+        try:
+            cp = ord(bytes([start + i]).decode(cs))
+        except UnicodeDecodeError:
+            continue
+
+        bw = (width + 7) // 8
+        rows = []
+        for j in range(height):
+            v = 0
+            for b in range(bw):
+                v = (v << 8) | bitmap[offset + j * bw + b]
+            rows.append(v >> (bw * 8 - width))
+        glyphs.append(Glyph(cp, width, rows))
+
+    return height, c, glyphs
+
+
+def load_bdf(path, ranges):
+    height = None
+    glyphs = []
+    lines = iter(open(path, encoding='latin_1').read().splitlines())
+
+    for line in lines:
+        w = line.split()
+        if not w:
+            continue
+        if w[0] == 'FONTBOUNDINGBOX':
+            fw, fh, fx, fy = map(int, w[1:5])
+            height = fh
+        elif w[0] == 'STARTCHAR':
+            cp, width, bbx = None, None, None
+            for line in lines:
+                w = line.split() or ['']
+                if w[0] == 'ENCODING':
+                    cp = int(w[1])
+                elif w[0] == 'DWIDTH':
+                    width = int(w[1])
+                elif w[0] == 'BBX':
+                    bbx = list(map(int, w[1:5]))
+                elif w[0] == 'BITMAP':
+                    break
+            data = []
+            for line in lines:
+                if line.strip() == 'ENDCHAR':
+                    break
+                data.append(int(line, 16) >> (len(line.strip()) * 4 - bbx[0]) if bbx[0] else 0)
+
+            if cp is None or cp < 0 or not any(a <= cp <= b for a, b in ranges):
+                continue
+            if width is None:
+                width = bbx[0] + bbx[2]
+
+            # The box of the glyph in the box of the font
+            rows = [0] * fh
+            top = (fh + fy) - (bbx[1] + bbx[3])
+            for j, v in enumerate(data):
+                y = top + j
+                if 0 <= y < fh:
+                    shift = width - bbx[0] - bbx[2]
+                    rows[y] = (v << shift) if shift >= 0 else (v >> -shift)
+                    rows[y] &= (1 << width) - 1
+            glyphs.append(Glyph(cp, width, rows))
+
+    if height is None:
+        raise ValueError('%s: no FONTBOUNDINGBOX' % path)
+
+    return height, 0, glyphs
+
+
+def pages(g, height):
+    # Page p, then column i: bits 8p..8p+7 of column i, top first
+    out = bytearray()
+    for p in range((height + 7) // 8):
+        for i in range(g.width):
+            v = 0
+            for b in range(8):
+                y = p * 8 + b
+                if y < height and (g.rows[y] >> (g.width - 1 - i)) & 1:
+                    v |= 1 << b
+            out.append(v)
+    return bytes(out)
+
+
+def packbits(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        n = 1
+        while i + n < len(data) and n < 128 and data[i + n] == data[i]:
+            n += 1
+        if n > 1:
+            out += bytes([257 - n, data[i]])
+            i += n
+            continue
+
+        j = i + 1
+        while j < len(data) and j - i < 128 and not (j + 1 < len(data) and data[j] == data[j + 1]):
+            j += 1
+        out += bytes([j - i - 1]) + data[i:j]
+        i = j
+    return bytes(out)
+
+
+def build(height, c, glyphs, compress):
+    if not glyphs:
+        raise ValueError('no characters')
+    if height > HEIGHT_MAX:
+        raise ValueError('height %d, %d at most' % (height, HEIGHT_MAX))
+
+    glyphs = sorted({g.code: g for g in glyphs}.values(), key=lambda g: g.code)
+    widest = max(g.width for g in glyphs)
+    if widest > WIDTH_MAX:
+        raise ValueError('width %d, %d at most' % (widest, WIDTH_MAX))
+
+    ranges = []
+    for i, g in enumerate(glyphs):
+        if ranges and ranges[-1][0] + ranges[-1][1] == g.code and ranges[-1][1] < 0xffff:
+            ranges[-1][1] += 1
+        else:
+            ranges.append([g.code, 1, i])
+
+    table, data = bytearray(), bytearray()
+    for g in glyphs:
+        raw = pages(g, height)
+        packed = packbits(raw) if compress else raw
+        flags = GLYPH_RLE if len(packed) < len(raw) else 0
+        body = packed if flags else raw
+        table += struct.pack('<HBB', len(data), len(body), g.width | flags)
+        data += body
+
+    if len(data) > DATA_MAX:
+        raise ValueError('%d bytes of glyphs, %d at most' % (len(data), DATA_MAX))
+
+    head = MAGIC + struct.pack('<BBBBHHB3x', VERSION, height, c, 0, len(ranges), len(glyphs), widest)
+    return head + b''.join(struct.pack('<IHH', *r) for r in ranges) + table + data, ranges
+
+
+def parse_range(s):
+    a, _, b = s.partition('-')
+    return (int(a, 0), int(b or a, 0))
+
+
+def main(argv):
+    p = argparse.ArgumentParser(description='Font files for SPIFFS')
+    p.add_argument('font', help='font header of ../data, or BDF font')
+    p.add_argument('-o', '--output', required=True, help='font file')
+    p.add_argument('-r', '--range', action='append', type=parse_range, default=[],
+                   help='code points of a BDF font, first-last, all by default')
+    p.add_argument('-c', '--charset', help='charset of a header, from its name by default')
+    p.add_argument('--raw', action='store_true', help='glyphs not packed')
+    args = p.parse_args(argv)
+
+    if args.font.endswith('.bdf'):
+        height, c, glyphs = load_bdf(args.font, args.range or [(0, 0x10ffff)])
+    else:
+        height, c, glyphs = load_header(args.font, args.charset)
+
+    data, ranges = build(height, c, glyphs, not args.raw)
+    open(args.output, 'wb').write(data)
+
+    raw = sum(g.width * ((height + 7) // 8) for g in glyphs)
+    print('%s: %d glyphs in %d ranges, %d bytes (%d of bitmaps)' %
+          (args.output, len(glyphs), len(ranges), len(data), raw))
+
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,76 @@
+-- Decodes 10000 sensor records with the field accessors and with
+-- unpack_array, run on the board or with the host platform:
+--
+--   luaos -f bench.img -c dir    (dir holding this file as autorun.lua)
+--
+-- The records are a buffer of 100, decoded 100 times, as a board has no
+-- memory for 10000 record tables at once.
+
+local BATCH = 100
+local PASSES = 100
+local RECORDS = BATCH * PASSES
+local SIZE = 12
+
+-- id, flags, a 4 bit channel and a 12 bit reading, temperature (le),
+-- humidity and a 32 bit timestamp
+local sensor = data.layout{
+	id       = {0, 8},
+	flags    = {8, 8},
+	channel  = {16, 4},
+	reading  = {20, 12},
+	temp     = {32, 16, 'number', 'little'},
+	humidity = {48, 16},
+	time     = {64, 32},
+}
+
+local raw = {}
+for i = 0, BATCH * SIZE - 1 do
+	raw[i + 1] = (i * 37 + 11) % 256
+end
+
+local d = data.new(string.char(table.unpack(raw)))
+raw = nil
+
+local records = {}
+for i = 0, BATCH - 1 do
+	records[i + 1] = d:segment(i * SIZE, SIZE)
+	records[i + 1]:layout(sensor)
+end
+
+d:layout(sensor)
+
+local function report(name, start, sum)
+	local us = tmr.now_us() - start
+	if us <= 0 then us = 1 end
+
+	print(string.format("%-14s %8d us %10.0f records/s %10.0f bytes/s (sum %.0f)",
+		name, us, RECORDS * 1e6 / us, RECORDS * SIZE * 1e6 / us, sum))
+end
+
+-- One field at a time, the sum is float not to wrap the 32 bit integers
+local start = tmr.now_us()
+local sum = 0.0
+for pass = 1, PASSES do
+	for i = 1, BATCH do
+		local r = records[i]
+		sum = sum + r.id + r.flags + r.channel + r.reading + r.temp + r.humidity + r.time
+	end
+end
+report("fields", start, sum)
+
+-- Whole records in one call, into the same tables every pass
+local t = {}
+d:unpack_array(BATCH, SIZE, t)
+
+start = tmr.now_us()
+local sum2 = 0.0
+for pass = 1, PASSES do
+	local _, n = d:unpack_array(BATCH, SIZE, t)
+	for i = 1, n do
+		local r = t[i]
+		sum2 = sum2 + r.id + r.flags + r.channel + r.reading + r.temp + r.humidity + r.time
+	end
+end
+report("unpack_array", start, sum2)
+
+assert(sum == sum2)
@@ -64,25 +64,24 @@ check_limits(data_t *data, size_t offset, size_t length)
 		check_length(data, offset, length);
 }
 
-#define ENTRY_BYTE_OFFSET(data, entry) \
-	((BIT_TO_BYTE(entry->offset + 1) - 1) + data->offset)
+/* the bytes of a field, precomputed by layout_load(), within length bytes */
+inline static bool
+check_entry_limits(size_t length, layout_entry_t *entry)
+{
+	return entry->byte + entry->nbytes <= length;
+}
 
 inline static bool
 check_num_limits(data_t *data, layout_entry_t *entry)
 {
-	size_t offset = ENTRY_BYTE_OFFSET(data, entry);
-	size_t length = BIT_TO_BYTE(entry->length);
-
 	return entry->length <= LUA_INTEGER_BIT &&
-		check_limits(data, offset, length);
+		check_entry_limits(data->length, entry);
 }
 
 inline static bool
 check_str_limits(data_t *data, layout_entry_t *entry)
 {
-	size_t offset = entry->offset + data->offset;
-	size_t length = entry->length;
-	return check_limits(data, offset, length);
+	return check_entry_limits(data->length, entry);
 }
 
 inline static layout_entry_t *
@@ -135,28 +134,56 @@ new_data(lua_State *L, data_raw_t *raw, size_t offset, size_t length)
 	data->raw->ptr, ENTRY_BIT_OFFSET(data, entry), \
 	entry->length, entry->endian
 
-static int
-get_num(lua_State *L, data_t *data, layout_entry_t *entry)
+/* decodes a number field of the record at ptr, with the fast paths */
+static lua_Integer
+decode_num(const byte_t *ptr, layout_entry_t *entry)
 {
-	if (!check_num_limits(data, entry))
-		return 0;
-
-	/* assertion: LUA_INTEGER_BIT <= 64 */
-	lua_Integer value = binary_get_uint64(BINARY_PARMS(data, entry));
-	lua_pushinteger(L, value);
-	return 1;
+	const byte_t *p = ptr + entry->byte;
+	uint64_t value;
+	size_t i;
+
+	switch (entry->fast) {
+	case LAYOUT_FU8:
+		return p[0];
+	case LAYOUT_FU16BE:
+		return (uint16_t) (p[0] << 8 | p[1]);
+	case LAYOUT_FU16LE:
+		return (uint16_t) (p[1] << 8 | p[0]);
+	case LAYOUT_FU32BE:
+		return (lua_Integer) ((uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+			(uint32_t) p[2] << 8 | p[3]);
+	case LAYOUT_FU32LE:
+		return (lua_Integer) ((uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 |
+			(uint32_t) p[1] << 8 | p[0]);
+	case LAYOUT_FSHIFT:
+		for (value = 0, i = 0; i < entry->nbytes; i++)
+			value = value << BYTE_BIT | p[ i ];
+		return (lua_Integer) ((value >> entry->shift) & entry->mask);
+	default:
+		/* assertion: LUA_INTEGER_BIT <= 64 */
+		return (lua_Integer) binary_get_uint64((byte_t *) ptr,
+			entry->offset, entry->length, entry->endian);
+	}
 }
 
-inline static int
-get_str(lua_State *L, data_t *data, layout_entry_t *entry)
+/* pushes a field of the record at ptr, length bytes long */
+static int
+push_field(lua_State *L, const byte_t *ptr, size_t length, layout_entry_t *entry)
 {
-	if (!check_str_limits(data, entry))
+	if (!check_entry_limits(length, entry))
 		return 0;
 
-	const char *ptr = (const char *) data_get_ptr(data); 
-	const char *s = ptr + entry->offset;
-	lua_pushlstring(L, s, entry->length);
-	return 1;
+	switch (entry->type) {
+	case LAYOUT_TNUMBER:
+		if (entry->length > LUA_INTEGER_BIT)
+			return 0;
+		lua_pushinteger(L, decode_num(ptr, entry));
+		return 1;
+	case LAYOUT_TSTRING:
+		lua_pushlstring(L, (const char *) ptr + entry->offset, entry->length);
+		return 1;
+	}
+	return 0; /* unreached */
 }
 
 inline static void
@@ -240,6 +267,19 @@ data_apply_layout(lua_State *L, data_t *data, int layout_ix)
 	data->layout = luau_ref(L);
 }
 
+/*
+ * The compiled fields of the layout applied, NULL if there is none. It is
+ * looked up each time, a data.layout() of the table compiles it again.
+ */
+layout_t *
+data_get_compiled(lua_State *L, data_t *data)
+{
+	if (!luau_isvalidref(data->layout))
+		return NULL;
+
+	return layout_get_compiled(L, data->layout);
+}
+
 int
 data_get_field(lua_State *L, data_t *data, int key_ix)
 {
@@ -250,13 +290,73 @@ data_get_field(lua_State *L, data_t *data, int key_ix)
 	if (entry == NULL)
 		return 0;
 
-	switch (entry->type) {
-	case LAYOUT_TNUMBER:
-		return get_num(L, data, entry);
-	case LAYOUT_TSTRING:
-		return get_str(L, data, entry);
+	return push_field(L, (const byte_t *) data_get_ptr(data), data->length, entry);
+}
+
+/* table[ key ] = field, for every field of the record at ptr */
+static void
+unpack_record(lua_State *L, layout_t *layout, const byte_t *ptr, size_t length,
+	int keys_ix, int table_ix)
+{
+	size_t i;
+
+	for (i = 0; i < layout->count; i++) {
+		lua_rawgeti(L, keys_ix, i + 1);
+		if (!push_field(L, ptr, length, &layout->entries[ i ]))
+			lua_pushnil(L);
+		lua_rawset(L, table_ix);
 	}
-	return 0; /* unreached */
+}
+
+/*
+ * Decodes count records, stride bytes apart, into the tables
+ * table[ 1 ] .. table[ count ], reusing the ones that are there. Only the
+ * records that fit in the data object are decoded, the number of them
+ * is returned. A count of 0 decodes the fields of the data object itself
+ * into table. table_ix must be an absolute index.
+ */
+int
+data_unpack(lua_State *L, data_t *data, size_t count, size_t stride, int table_ix)
+{
+	layout_t *layout = data_get_compiled(L, data);
+	size_t i;
+
+	if (!check_raw_ptr(data) || layout == NULL)
+		return 0;
+
+	const byte_t *ptr = (const byte_t *) data_get_ptr(data);
+
+	luau_getref(L, data->layout);
+	lua_getfield(L, -1, LAYOUT_KEYS);
+	int keys_ix = lua_gettop(L);
+
+	if (count == 0) {
+		unpack_record(L, layout, ptr, data->length, keys_ix, table_ix);
+		lua_pop(L, 2);
+		return 1;
+	}
+
+	if (data->length < layout->size)
+		count = 0;
+	else if (stride > 0 && count > (data->length - layout->size) / stride + 1)
+		count = (data->length - layout->size) / stride + 1;
+
+	for (i = 0; i < count; i++) {
+		lua_rawgeti(L, table_ix, i + 1);
+		if (!lua_istable(L, -1)) {
+			lua_pop(L, 1);
+			lua_createtable(L, 0, layout->count);
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, table_ix, i + 1);
+		}
+
+		unpack_record(L, layout, ptr + i * stride, layout->size,
+			keys_ix, lua_gettop(L));
+		lua_pop(L, 1);
+	}
+
+	lua_pop(L, 2);
+	return count;
 }
 
 void
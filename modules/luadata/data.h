@@ -66,10 +66,14 @@ data_t * data_test(lua_State *, int);
 
 void data_apply_layout(lua_State *, data_t *, int);
 
+layout_t * data_get_compiled(lua_State *, data_t *);
+
 int data_get_field(lua_State *, data_t *, int);
 
 void data_set_field(lua_State *, data_t *, int, int);
 
+int data_unpack(lua_State *, data_t *, size_t, size_t, int);
+
 void * data_get_ptr(data_t *);
 
 #endif /* _DATA_H_ */
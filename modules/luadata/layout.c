@@ -25,11 +25,18 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  */
+#ifndef _KERNEL
+#include <string.h>
+#else
+#include <lib/libkern/libkern.h>
+#endif
+
 #include <lua.h>
 #include <lauxlib.h>
 
 #include "luautil.h"
 
+#include "binary.h"
 #include "layout.h"
 
 inline static layout_entry_t *
@@ -126,21 +133,56 @@ load_entry_named(lua_State *L, layout_entry_t *entry)
 	lua_pop(L, 1);
 }
 
+/* precomputes where the field is and how it is decoded */
+static void
+compile_entry(layout_entry_t *entry)
+{
+	entry->mask  = 0;
+	entry->shift = 0;
+
+	if (entry->type == LAYOUT_TSTRING) {
+		entry->byte   = entry->offset;
+		entry->nbytes = entry->length;
+		entry->fast   = LAYOUT_FSTRING;
+		return;
+	}
+
+	size_t last = entry->offset + entry->length - 1;
+	bool aligned = entry->offset % BYTE_BIT == 0;
+	bool little = entry->endian == LITTLE_ENDIAN;
+
+	entry->byte   = entry->offset / BYTE_BIT;
+	entry->nbytes = last / BYTE_BIT - entry->byte + 1;
+	entry->fast   = LAYOUT_FBITS;
+
+	if (aligned && entry->length == 8)
+		entry->fast = LAYOUT_FU8;
+	else if (aligned && entry->length == 16)
+		entry->fast = little ? LAYOUT_FU16LE : LAYOUT_FU16BE;
+	else if (aligned && entry->length == 32)
+		entry->fast = little ? LAYOUT_FU32LE : LAYOUT_FU32BE;
+	else if ((!little || entry->length <= BYTE_BIT) &&
+	    entry->nbytes <= sizeof(uint64_t)) {
+		entry->fast  = LAYOUT_FSHIFT;
+		entry->shift = BYTE_BIT - 1 - last % BYTE_BIT;
+		entry->mask  = UINT64_MAX >> (64 - entry->length);
+	}
+}
+
 static void
 load_entry(lua_State *L, layout_entry_t *entry)
 {
 	init_layout(entry);
 	load_entry_numbered(L, entry);
 	load_entry_named(L, entry);
+	if (entry->length != 0)
+		compile_entry(entry);
 }
 
 static void
 copy_entry(layout_entry_t *dst, layout_entry_t *src)
 {
-	dst->offset = src->offset;
-	dst->length = src->length;
-	dst->type   = src->type;
-	dst->endian = src->endian;
+	*dst = *src;
 }
 
 static int
@@ -156,13 +198,92 @@ new_entry(lua_State *L, layout_entry_t *entry)
 	return 1;
 }
 
+/*
+ * layout[ LAYOUT_COMPILED ] = the fields as a flat array, and
+ * layout[ LAYOUT_KEYS ][ i ] = the key of the field i, to decode a whole
+ * record without looking each key up
+ */
+static void
+compile_layout(lua_State *L, int index)
+{
+	layout_entry_t *entry;
+	layout_t *layout;
+	size_t count = 0, i = 0;
+
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		if (test_entry(L, -1) != NULL)
+			count++;
+		lua_pop(L, 1);
+	}
+
+	layout = (layout_t *) lua_newuserdata(L, sizeof(layout_t) +
+		(count > 0 ? count - 1 : 0) * sizeof(layout_entry_t));
+
+	luaL_getmetatable(L, LAYOUT_USERDATA);
+	lua_setmetatable(L, -2);
+
+	layout->count = count;
+	layout->size  = 0;
+
+	lua_createtable(L, count, 0);
+
+	lua_pushnil(L);
+	while (lua_next(L, index) != 0) {
+		if ((entry = test_entry(L, -1)) != NULL) {
+			size_t end = entry->byte + entry->nbytes;
+
+			copy_entry(&layout->entries[ i++ ], entry);
+			if (end > layout->size)
+				layout->size = end;
+
+			/* keys[ i ] = key */
+			lua_pushvalue(L, -2);
+			lua_rawseti(L, -4, i);
+		}
+		lua_pop(L, 1);
+	}
+
+	/* keys table is at -1, the layout userdata at -2 */
+	lua_setfield(L, index, LAYOUT_KEYS);
+	lua_setfield(L, index, LAYOUT_COMPILED);
+}
+
+/* the keys layout_load() sets in the layout table */
+static bool
+internal_key(lua_State *L, int index)
+{
+	const char *key;
+
+	if (lua_type(L, index) != LUA_TSTRING)
+		return false;
+
+	key = lua_tostring(L, index);
+	return strcmp(key, LAYOUT_STAMP) == 0 ||
+		strcmp(key, LAYOUT_COMPILED) == 0 ||
+		strcmp(key, LAYOUT_KEYS) == 0;
+}
+
 void
 layout_load(lua_State *L, int index)
 {
 	layout_entry_t entry;
 
+	if (index < 0)
+		index = lua_gettop(L) + index + 1;
+
 	lua_pushnil(L);  /* first key */
 	while (lua_next(L, index) != 0) {
+		/*
+		 * a layout loaded again keeps its entries and loads the fields
+		 * added or changed since, the stamp and the compiled fields
+		 * aren't entries
+		 */
+		if (internal_key(L, -2) || test_entry(L, -1) != NULL) {
+			lua_pop(L, 1);
+			continue;
+		}
+
 		/* uses 'key' (at index -2) and 'value' (at index -1) */
 		load_entry(L, &entry);
 		if (entry.length == 0)
@@ -177,6 +298,8 @@ layout_load(lua_State *L, int index)
 		lua_pop(L, 2);
 	}
 
+	compile_layout(L, index);
+
 	lua_pushboolean(L, true);
 	lua_setfield(L, index, LAYOUT_STAMP);
 }
@@ -198,3 +321,15 @@ end:
 	return entry;
 }
 
+layout_t *
+layout_get_compiled(lua_State *L, int layout_ix)
+{
+	layout_t *layout;
+
+	luau_getref(L, layout_ix);
+	lua_getfield(L, -1, LAYOUT_COMPILED);
+	layout = (layout_t *) luaL_testudata(L, -1, LAYOUT_USERDATA);
+	lua_pop(L, 2);
+
+	return layout;
+}
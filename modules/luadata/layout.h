@@ -40,8 +40,11 @@
 #include <lua.h>
 
 #define LAYOUT_ENTRY_USERDATA 	"data.layout.entry"
+#define LAYOUT_USERDATA 	"data.layout"
 
 #define LAYOUT_STAMP 		"__layout_stamp"
+#define LAYOUT_COMPILED		"__layout_compiled"
+#define LAYOUT_KEYS		"__layout_keys"
 
 #define LAYOUT_TYPE_DEFAULT	LAYOUT_TNUMBER
 #define LAYOUT_ENDIAN_DEFAULT	BIG_ENDIAN
@@ -51,15 +54,43 @@ typedef enum {
 	LAYOUT_TSTRING
 } layout_type_t;
 
+/* how a field is decoded, chosen when the layout is loaded */
+typedef enum {
+	LAYOUT_FBITS = 0,	/* bit by bit, binary_get_uint64() */
+	LAYOUT_FSHIFT,		/* big endian, at most 8 bytes: shift and mask */
+	LAYOUT_FU8,		/* byte aligned 8, 16 and 32 bit */
+	LAYOUT_FU16BE,
+	LAYOUT_FU16LE,
+	LAYOUT_FU32BE,
+	LAYOUT_FU32LE,
+	LAYOUT_FSTRING
+} layout_fast_t;
+
 typedef struct {
 	size_t        offset;
 	size_t        length;
 	layout_type_t type;
 	int           endian;
+
+	/* precomputed by layout_load() */
+	size_t        byte;	/* first byte */
+	size_t        nbytes;	/* bytes spanned */
+	uint64_t      mask;
+	uint8_t       shift;
+	layout_fast_t fast;
 } layout_entry_t;
 
+/* a loaded layout, as a flat array of its fields */
+typedef struct {
+	size_t         count;
+	size_t         size;	/* bytes spanned by all the fields */
+	layout_entry_t entries[1];
+} layout_t;
+
 void layout_load(lua_State *, int);
 
 layout_entry_t * layout_get_entry(lua_State *, int, int);
 
+layout_t * layout_get_compiled(lua_State *, int);
+
 #endif /* _LAYOUT_H_ */
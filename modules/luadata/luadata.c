@@ -172,6 +172,54 @@ apply_layout(lua_State *L)
 	return 1;
 }
 
+static int
+unpack_all(lua_State *L)
+{
+	data_t *data = lua_touserdata(L, 1);
+
+	if (lua_istable(L, 2))
+		lua_settop(L, 2);
+	else {
+		lua_settop(L, 1);
+		lua_newtable(L);
+	}
+
+	data_unpack(L, data, 0, 0, 2);
+
+	/* return the table */
+	return 1;
+}
+
+static int
+unpack_array(lua_State *L)
+{
+	data_t *data = lua_touserdata(L, 1);
+	size_t count = luau_tosize(L, 2);
+	size_t stride = 0;
+	layout_t *layout;
+
+	if (lua_isnumber(L, 3))
+		stride = luau_tosize(L, 3);
+	else if ((layout = data_get_compiled(L, data)) != NULL)
+		stride = layout->size;
+
+	luaL_argcheck(L, stride > 0, 3, "stride expected");
+
+	if (lua_istable(L, 4))
+		lua_settop(L, 4);
+	else {
+		lua_settop(L, 3);
+		lua_createtable(L, count, 0);
+	}
+
+	if (count > 0)
+		count = data_unpack(L, data, count, stride, 4);
+
+	/* return the table and the number of records */
+	luau_pushsize(L, count);
+	return 2;
+}
+
 static int
 __gc(lua_State *L)
 {
@@ -244,6 +292,8 @@ const LUA_REG_TYPE data_lib[ ] = {
 const LUA_REG_TYPE data_m[ ] = {
 	{ LSTRKEY( "layout" ),		LFUNCVAL( apply_layout ) },
 	{ LSTRKEY( "segment" ),		LFUNCVAL( new_segment ) },
+	{ LSTRKEY( "unpack_all" ),	LFUNCVAL( unpack_all ) },
+	{ LSTRKEY( "unpack_array" ),	LFUNCVAL( unpack_array ) },
 	{ LSTRKEY( "__index" ),		LFUNCVAL( __index ) },
 	{ LSTRKEY( "__newindex" ),	LFUNCVAL( __newindex ) },
 	{ LSTRKEY( "__gc" ), 		LFUNCVAL( __gc ) },
@@ -256,6 +306,10 @@ const LUA_REG_TYPE layout_entry_m[ ] = {
 	{ LNILKEY, LNILVAL }
 };
 
+const LUA_REG_TYPE layout_m[ ] = {
+	{ LNILKEY, LNILVAL }
+};
+
 int
 luaopen_data(lua_State *L)
 {
@@ -268,6 +322,9 @@ luaopen_data(lua_State *L)
 #endif
 	lua_pop(L, 1);
 
+	luaL_newmetatable(L, LAYOUT_USERDATA);
+	lua_pop(L, 1);
+
 	luaL_newmetatable(L, DATA_USERDATA);
 #if LUA_VERSION_NUM >= 502
 	luaL_setfuncs(L, data_m, 0);
@@ -282,6 +339,8 @@ luaopen_data(lua_State *L)
 	//luaL_newmetatable(L, LAYOUT_ENTRY_USERDATA);
 	luaL_newmetarotable(L, LAYOUT_ENTRY_USERDATA, layout_entry_m);
 	lua_pop(L, 1);
+	luaL_newmetarotable(L, LAYOUT_USERDATA, layout_m);
+	lua_pop(L, 1);
 	luaL_newmetarotable(L, DATA_USERDATA, data_m);
 
 	return 0;
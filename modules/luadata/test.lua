@@ -95,6 +95,60 @@ collectgarbage()
 -- check that d5 is still valid
 assert(d5.uint4 == 0xf)
 
+-- decode all the fields of a record at once
+r = data.new{0x12, 0x34, 0x56, 0x78, 0x9a}
+r:layout{
+	u8     = {0, 8},
+	u16le  = {8, 16, 'number', 'little'},
+	u32    = {0, 32},
+	nibble = {12, 4},
+	odd    = {4, 12},
+	str    = {3, 2, 'string'},
+	out    = {32, 16},
+}
+
+t = r:unpack_all()
+assert(t.u8 == 0x12 and t.u16le == 0x5634 and t.u32 == 0x12345678)
+assert(t.nibble == 0x4 and t.odd == 0x234 and t.str == '\x78\x9a')
+assert(t.out == nil)
+
+-- into a given table, fields out of bounds are cleared
+t.out = 1
+assert(r:unpack_all(t) == t and t.out == nil)
+
+-- decode an array of records, the stride defaults to the record size
+a = data.new{1, 0, 10, 2, 0, 20, 3, 0, 30, 4}
+a:layout{id = {0, 8}, value = {8, 16, 'number', 'little'}}
+
+t, n = a:unpack_array(5)
+assert(n == 3 and #t == 3)
+assert(t[1].id == 1 and t[1].value == 0x0a00)
+assert(t[3].id == 3 and t[3].value == 0x1e00)
+
+-- the record tables are reused
+r1 = t[1]
+t, n = a:unpack_array(2, 3, t)
+assert(n == 2 and t[1] == r1)
+
+-- a layout is compiled when it is loaded, the fields changed afterwards
+-- are used once data.layout() loads it again
+l2 = {id = {0, 8}}
+a:layout(l2)
+l2.value = {8, 16, 'number', 'little'}
+l2.id = {16, 8}
+t = a:unpack_all()
+assert(t.id == 1 and t.value == nil and a.value == nil)
+
+assert(data.layout(l2) == l2)
+t = a:unpack_all()
+assert(t.id == 10 and t.value == 0x0a00 and a.value == 0x0a00)
+assert(a:unpack_array(1)[1].id == 10)
+
+l2.value = nil
+data.layout(l2)
+t = a:unpack_all()
+assert(t.id == 10 and t.value == nil and a.value == nil)
+
 -- create a new data object with 2 bytes 
 d = data.new(2)
 d:layout(l)
@@ -212,7 +212,9 @@
  * TCP_QUEUE_OOSEQ==1: TCP will queue segments that arrive out of order.
  * Define to 0 if your device is low on memory.
  */
+#ifndef TCP_QUEUE_OOSEQ
 #define TCP_QUEUE_OOSEQ                 0
+#endif
 
 /*
  *     LWIP_EVENT_API==1: The user defines lwip_tcp_event() to receive all
@@ -220,7 +222,18 @@
  *     LWIP_CALLBACK_API==1: The PCB callback function is called directly
  *         for the event. This is the default.
 */
+#ifndef TCP_MSS
 #define TCP_MSS                         548 //536 //1460
+#endif
+
+/**
+ * TCP_SND_BUF: TCP sender buffer space (bytes).
+ * To achieve good performance, this should be at least 2 * TCP_MSS.
+ * (test/bench in the lwip tree measures other values)
+ */
+#ifndef TCP_SND_BUF
+#define TCP_SND_BUF                     (2 * TCP_MSS)
+#endif
 
 /**
  * TCP_MAXRTX: Maximum number of retransmissions of data segments.
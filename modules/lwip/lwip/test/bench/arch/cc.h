@@ -0,0 +1,41 @@
+/*
+ * Host (gcc, 32 or 64 bit little endian) port of lwIP for the benchmark.
+ */
+#ifndef __ARCH_CC_H__
+#define __ARCH_CC_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef BYTE_ORDER
+#define BYTE_ORDER LITTLE_ENDIAN
+#endif
+
+typedef uint8_t    u8_t;
+typedef int8_t     s8_t;
+typedef uint16_t   u16_t;
+typedef int16_t    s16_t;
+typedef uint32_t   u32_t;
+typedef int32_t    s32_t;
+
+typedef uintptr_t  mem_ptr_t;
+typedef int        sys_prot_t;
+
+#define X8_F  "02x"
+#define U16_F "u"
+#define S16_F "d"
+#define X16_F "x"
+#define U32_F "u"
+#define S32_F "d"
+#define X32_F "x"
+#define SZT_F "zu"
+
+#define PACK_STRUCT_STRUCT __attribute__( (packed) )
+
+#define LWIP_PLATFORM_DIAG(x) do { printf x; } while(0)
+#define LWIP_PLATFORM_ASSERT(x) do { printf("Assertion \"%s\" failed at line %d in %s\n", \
+                                            x, __LINE__, __FILE__); abort(); } while(0)
+
+#endif /* __ARCH_CC_H__ */
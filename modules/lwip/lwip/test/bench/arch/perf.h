@@ -0,0 +1,7 @@
+#ifndef __ARCH_PERF_H__
+#define __ARCH_PERF_H__
+
+#define PERF_START
+#define PERF_STOP(x)
+
+#endif /* __ARCH_PERF_H__ */
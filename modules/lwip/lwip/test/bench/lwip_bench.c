@@ -0,0 +1,759 @@
+/*
+ * Throughput benchmark of the firmware's lwIP options.
+ *
+ * Two netifs of one stack are joined by an in-memory link with a rate,
+ * a latency, a loss rate and a queue limit. One transfer runs from the
+ * device side to the peer side, the way the servers of the firmware send:
+ *
+ *  httpd  the file path of httpd: a GET, the two header writes, then the
+ *         file in OUT_BUF_LEN - 4 byte writes (Lua/modules/httpd)
+ *  styx   the read path of styx: Tread / Rread of MSGMAX - IOHDRSZ bytes,
+ *         one in flight, as an inferno client reads a file (libstyx)
+ *
+ * The clock is virtual, so a run is reproducible and latencies take no
+ * wall time. A run prints one line: the throughput, the RAM high-water
+ * of the device's side of the stack, the device's retransmitted
+ * segments and the packets lost on the link.
+ *
+ *   lwip_bench [-m httpd|styx] [-s bytes] [-r kbit/s] [-d ms] [-l loss %]
+ *              [-q packets] [-S seed] [-t s] [-H]
+ *
+ * The options under test are compile time, see the Makefile and sweep.sh.
+ * Both sides run the same build: the device only receives the requests,
+ * so TCP_QUEUE_OOSEQ acts on the peer receiving the file, and TCP_WND is
+ * the peer's window (a PC's, see lwipopts.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lwip/init.h"
+#include "lwip/netif.h"
+#include "lwip/ip.h"
+#include "lwip/tcp.h"
+#include "lwip/tcp_impl.h"
+#include "lwip/timers.h"
+#include "lwip/stats.h"
+
+/* as in Lua/modules/httpd/httpd.h and modules/styx/libstyx/styxserver.h */
+#define OUT_BUF_LEN     548
+#define MSGMAX          ((((128+128)*2)+3) & ~3)
+#define IOHDRSZ         24
+
+#define HTTPD_PORT      80
+#define STYX_PORT       6701
+
+#define TREAD_LEN       23    /* size[4] type[1] tag[2] fid[4] offset[8] count[4] */
+#define RREAD_HDR       11    /* size[4] type[1] tag[2] count[4] */
+#define STYX_TREAD      116
+#define STYX_RREAD      117
+
+#define STEP_US         1000  /* longest step of the clock */
+
+enum { MODE_HTTPD, MODE_STYX };
+enum { SIDE_DEV, SIDE_PEER };
+
+/* ---- parameters ---- */
+
+static int mode = MODE_HTTPD;
+static u32_t file_size = 64 * 1024;
+static u32_t rate_kbit = 20000;
+static u32_t delay_us = 2000;
+static double loss_pct = 0;
+static int queue_max = 64;
+static u32_t seed = 1;
+static u32_t limit_s = 600;
+
+/* ---- virtual clock ---- */
+
+static unsigned long long now_us;
+
+u32_t
+sys_now(void)
+{
+  return (u32_t)(now_us / 1000);
+}
+
+/* ---- heap accounting, per side (lwipopts.h maps mem_malloc here) ---- */
+
+static int side = SIDE_DEV;
+static size_t heap_cur[2], heap_peak[2];
+
+typedef union {
+  struct {
+    size_t size;
+    int side;
+  } h;
+  long double align;
+} heap_hdr;
+
+void *
+bench_malloc(size_t size)
+{
+  heap_hdr *m = malloc(sizeof(heap_hdr) + size);
+
+  if (m == NULL) {
+    return NULL;
+  }
+  m->h.size = size;
+  m->h.side = side;
+  heap_cur[side] += size;
+  if (heap_cur[side] > heap_peak[side]) {
+    heap_peak[side] = heap_cur[side];
+  }
+  return m + 1;
+}
+
+void *
+bench_calloc(size_t count, size_t size)
+{
+  void *m = bench_malloc(count * size);
+
+  if (m != NULL) {
+    memset(m, 0, count * size);
+  }
+  return m;
+}
+
+void
+bench_free(void *mem)
+{
+  heap_hdr *m;
+
+  if (mem == NULL) {
+    return;
+  }
+  m = (heap_hdr *)mem - 1;
+  heap_cur[m->h.side] -= m->h.size;
+  free(m);
+}
+
+/* ---- the link ---- */
+
+typedef struct pkt {
+  struct pkt *next;
+  unsigned long long at;    /* when it arrives */
+  u16_t len;
+  u8_t data[];
+} pkt_t;
+
+typedef struct {
+  struct netif *to;         /* netif it delivers to */
+  int to_side;
+  pkt_t *head, *tail;
+  int queued;
+  unsigned long long busy_until;
+  u32_t rnd;
+  u32_t snd_max;            /* highest sequence number sent + 1 */
+  int snd_max_set;
+  u32_t sent, lost, dropped, rexmit;
+} link_t;
+
+static struct netif dev_netif, peer_netif;
+static link_t to_dev, to_peer;
+
+static u32_t
+link_rand(link_t *l)
+{
+  /* xorshift32 */
+  l->rnd ^= l->rnd << 13;
+  l->rnd ^= l->rnd >> 17;
+  l->rnd ^= l->rnd << 5;
+  return l->rnd;
+}
+
+/* A data segment that starts below the highest one sent is a retransmit */
+static void
+link_count_rexmit(link_t *l, const u8_t *ip, u16_t len)
+{
+  const struct ip_hdr *iph = (const struct ip_hdr *)ip;
+  const struct tcp_hdr *tcph;
+  u16_t hl = IPH_HL(iph) * 4;
+  u32_t seq, dlen;
+
+  if (IPH_PROTO(iph) != IP_PROTO_TCP || len < hl + TCP_HLEN) {
+    return;
+  }
+  tcph = (const struct tcp_hdr *)(ip + hl);
+  seq = ntohl(tcph->seqno);
+  dlen = len - hl - TCPH_HDRLEN(tcph) * 4;
+  if (TCPH_FLAGS(tcph) & (TCP_SYN | TCP_FIN)) {
+    dlen++;
+  }
+  if (dlen == 0) {
+    return;
+  }
+  if (l->snd_max_set && TCP_SEQ_LT(seq, l->snd_max)) {
+    l->rexmit++;
+  }
+  if (!l->snd_max_set || TCP_SEQ_GT(seq + dlen, l->snd_max)) {
+    l->snd_max = seq + dlen;
+    l->snd_max_set = 1;
+  }
+}
+
+static err_t
+link_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+  link_t *l = netif->state;
+  unsigned long long start;
+  pkt_t *k;
+
+  LWIP_UNUSED_ARG(ipaddr);
+
+  if (l->queued >= queue_max) {
+    l->dropped++;
+    return ERR_OK;
+  }
+
+  k = malloc(sizeof(pkt_t) + p->tot_len);
+  if (k == NULL) {
+    return ERR_MEM;
+  }
+  k->next = NULL;
+  k->len = p->tot_len;
+  pbuf_copy_partial(p, k->data, p->tot_len, 0);
+
+  start = now_us > l->busy_until ? now_us : l->busy_until;
+  l->busy_until = start + (unsigned long long)k->len * 8000 / rate_kbit;
+  k->at = l->busy_until + delay_us;
+  l->sent++;
+
+  if (l == &to_peer) {
+    link_count_rexmit(l, k->data, k->len);
+  }
+
+  /* lost after it took its time on the link */
+  if (loss_pct > 0 && link_rand(l) < loss_pct / 100 * 4294967295.0) {
+    l->lost++;
+    free(k);
+    return ERR_OK;
+  }
+
+  if (l->tail != NULL) {
+    l->tail->next = k;
+  } else {
+    l->head = k;
+  }
+  l->tail = k;
+  l->queued++;
+  return ERR_OK;
+}
+
+/* Hands the packets due by now to the stack, as the wifi driver would */
+static void
+link_deliver(link_t *l)
+{
+  pkt_t *k;
+  struct pbuf *p;
+
+  while ((k = l->head) != NULL && k->at <= now_us) {
+    l->head = k->next;
+    if (l->head == NULL) {
+      l->tail = NULL;
+    }
+    l->queued--;
+
+    side = l->to_side;
+    p = pbuf_alloc(PBUF_RAW, k->len, PBUF_RAM);
+    if (p != NULL) {
+      pbuf_take(p, k->data, k->len);
+      ip_input(p, l->to);
+    }
+    free(k);
+  }
+}
+
+static err_t
+link_netif_init(struct netif *netif)
+{
+  netif->output = link_output;
+  netif->mtu = TCP_MSS + IP_HLEN + TCP_HLEN;
+  netif->name[0] = 'b';
+  netif->name[1] = netif == &dev_netif ? 'd' : 'p';
+  return ERR_OK;
+}
+
+/* ---- the file ---- */
+
+static u8_t
+file_byte(u32_t off)
+{
+  return (u8_t)(off ^ (off >> 8) ^ (off >> 16) ^ 0x5a);
+}
+
+static void
+put_le(u8_t *p, unsigned long long v, int n)
+{
+  while (n-- > 0) {
+    *p++ = (u8_t)v;
+    v >>= 8;
+  }
+}
+
+static unsigned long long
+get_le(const u8_t *p, int n)
+{
+  unsigned long long v = 0;
+
+  while (n-- > 0) {
+    v = (v << 8) | p[n];
+  }
+  return v;
+}
+
+static const char http_req[] = "GET /file.bin HTTP/1.1\r\nHost: luaos\r\n\r\n";
+static const char http_hdr[] =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-type: application/octet-stream\r\n";
+static char http_len[64];
+
+/* ---- device: the server ---- */
+
+static struct {
+  struct tcp_pcb *pcb;
+  u8_t rx[64];
+  int rx_len;
+  int req;                  /* a request to answer */
+  u32_t req_off, req_count;
+  u8_t w[OUT_BUF_LEN + RREAD_HDR];
+  int w_len, w_off;         /* the write in progress */
+  int step;                 /* httpd: header, length, file */
+  u32_t off;                /* httpd: next file byte */
+} dev;
+
+/* Next buffer the server hands to netconn_write / lwip_send */
+static int
+dev_next_write(void)
+{
+  u32_t i, n;
+
+  if (mode == MODE_HTTPD) {
+    if (!dev.req) {
+      return 0;
+    }
+    if (dev.step == 0) {
+      dev.w_len = sizeof(http_hdr) - 1;
+      memcpy(dev.w, http_hdr, dev.w_len);
+      dev.step++;
+    } else if (dev.step == 1) {
+      dev.w_len = strlen(http_len);
+      memcpy(dev.w, http_len, dev.w_len);
+      dev.step++;
+    } else if (dev.off < file_size) {
+      n = file_size - dev.off;
+      if (n > OUT_BUF_LEN - 4) {
+        n = OUT_BUF_LEN - 4;
+      }
+      for (i = 0; i < n; i++) {
+        dev.w[i] = file_byte(dev.off + i);
+      }
+      dev.off += n;
+      dev.w_len = n;
+    } else {
+      dev.req = 0;
+      return 0;
+    }
+  } else {
+    if (!dev.req) {
+      return 0;
+    }
+    n = dev.req_off < file_size ? file_size - dev.req_off : 0;
+    if (n > dev.req_count) {
+      n = dev.req_count;
+    }
+    put_le(dev.w, RREAD_HDR + n, 4);
+    dev.w[4] = STYX_RREAD;
+    put_le(dev.w + 5, 1, 2);
+    put_le(dev.w + 7, n, 4);
+    for (i = 0; i < n; i++) {
+      dev.w[RREAD_HDR + i] = file_byte(dev.req_off + i);
+    }
+    dev.w_len = RREAD_HDR + n;
+    dev.req = 0;
+  }
+  dev.w_off = 0;
+  return 1;
+}
+
+/* Queues as much as the send buffer takes, as do_writemore of netconn */
+static void
+dev_pump(void)
+{
+  struct tcp_pcb *pcb = dev.pcb;
+  u16_t avail;
+  u8_t flags;
+  int len;
+  err_t err;
+
+  side = SIDE_DEV;
+  while (pcb != NULL) {
+    if (dev.w_off == dev.w_len && !dev_next_write()) {
+      break;
+    }
+    avail = tcp_sndbuf(pcb);
+    if (avail == 0 || tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN) {
+      break;
+    }
+    len = dev.w_len - dev.w_off;
+    flags = TCP_WRITE_FLAG_COPY;
+    if (len > avail) {
+      len = avail;
+      flags |= TCP_WRITE_FLAG_MORE;
+    }
+    err = tcp_write(pcb, dev.w + dev.w_off, len, flags);
+    if (err == ERR_MEM) {
+      break;
+    }
+    if (err != ERR_OK) {
+      printf("tcp_write: %d\n", err);
+      exit(2);
+    }
+    dev.w_off += len;
+    tcp_output(pcb);
+  }
+}
+
+static err_t
+dev_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(len);
+  dev_pump();
+  return ERR_OK;
+}
+
+static err_t
+dev_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  int n;
+
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+
+  if (p == NULL) {
+    tcp_close(pcb);
+    dev.pcb = NULL;
+    return ERR_OK;
+  }
+
+  n = p->tot_len;
+  if (n > (int)sizeof(dev.rx) - dev.rx_len) {
+    n = sizeof(dev.rx) - dev.rx_len;
+  }
+  pbuf_copy_partial(p, dev.rx + dev.rx_len, n, 0);
+  dev.rx_len += n;
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+
+  if (mode == MODE_HTTPD) {
+    if (dev.rx_len >= 4 && memcmp(dev.rx + dev.rx_len - 4, "\r\n\r\n", 4) == 0) {
+      dev.rx_len = 0;
+      dev.req = 1;
+      dev.step = 0;
+      dev.off = 0;
+    }
+  } else if (dev.rx_len >= TREAD_LEN) {
+    /* one Tread in flight, as the client waits for each Rread */
+    dev.req_off = (u32_t)get_le(dev.rx + 11, 8);
+    dev.req_count = (u32_t)get_le(dev.rx + 19, 4);
+    dev.rx_len -= TREAD_LEN;
+    memmove(dev.rx, dev.rx + TREAD_LEN, dev.rx_len);
+    dev.req = 1;
+  }
+
+  dev_pump();
+  return ERR_OK;
+}
+
+static int aborted;
+
+static void
+dev_err(void *arg, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  dev.pcb = NULL;
+  aborted = 1;
+}
+
+static err_t
+dev_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct tcp_pcb *lpcb = arg;
+
+  LWIP_UNUSED_ARG(err);
+
+  tcp_accepted(lpcb);
+  dev.pcb = pcb;
+  tcp_recv(pcb, dev_recv);
+  tcp_sent(pcb, dev_sent);
+  tcp_err(pcb, dev_err);
+  return ERR_OK;
+}
+
+/* ---- peer: the browser or the inferno client ---- */
+
+static struct {
+  struct tcp_pcb *pcb;
+  u32_t got;                /* stream bytes */
+  u32_t data;               /* file bytes */
+  u32_t bad;                /* file bytes not as sent */
+  u8_t hdr[RREAD_HDR];
+  int hdr_len;
+  u32_t left;               /* of the Rread data */
+  int done;
+  unsigned long long done_us;
+} peer;
+
+static void
+peer_send(const void *buf, u16_t len)
+{
+  side = SIDE_PEER;
+  if (tcp_write(peer.pcb, buf, len, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+    tcp_output(peer.pcb);
+  }
+}
+
+static void
+peer_tread(u32_t off)
+{
+  u8_t m[TREAD_LEN];
+
+  put_le(m, TREAD_LEN, 4);
+  m[4] = STYX_TREAD;
+  put_le(m + 5, 1, 2);
+  put_le(m + 7, 1, 4);
+  put_le(m + 11, off, 8);
+  put_le(m + 19, MSGMAX - IOHDRSZ, 4);
+  peer_send(m, TREAD_LEN);
+}
+
+static void
+peer_file_byte(u8_t b)
+{
+  if (b != file_byte(peer.data)) {
+    peer.bad++;
+  }
+  peer.data++;
+  if (peer.data == file_size) {
+    peer.done = 1;
+    peer.done_us = now_us;
+  }
+}
+
+static void
+peer_byte(u8_t b)
+{
+  u32_t hdr_total = sizeof(http_hdr) - 1 + strlen(http_len);
+
+  peer.got++;
+  if (mode == MODE_HTTPD) {
+    if (peer.got > hdr_total) {
+      peer_file_byte(b);
+    }
+    return;
+  }
+
+  if (peer.hdr_len < RREAD_HDR) {
+    peer.hdr[peer.hdr_len++] = b;
+    if (peer.hdr_len == RREAD_HDR) {
+      peer.left = (u32_t)get_le(peer.hdr + 7, 4);
+    }
+    return;
+  }
+  peer_file_byte(b);
+  if (--peer.left == 0) {
+    peer.hdr_len = 0;
+    if (peer.data < file_size) {
+      peer_tread(peer.data);
+    }
+  }
+}
+
+static err_t
+peer_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct pbuf *q;
+  u16_t i;
+
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+
+  if (p == NULL) {
+    return ERR_OK;
+  }
+  for (q = p; q != NULL; q = q->next) {
+    for (i = 0; i < q->len; i++) {
+      peer_byte(((u8_t *)q->payload)[i]);
+    }
+  }
+  side = SIDE_PEER;
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static void
+peer_err(void *arg, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  peer.pcb = NULL;
+  aborted = 1;
+}
+
+static err_t
+peer_connected(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(err);
+
+  if (mode == MODE_HTTPD) {
+    peer_send(http_req, sizeof(http_req) - 1);
+  } else {
+    peer_tread(0);
+  }
+  return ERR_OK;
+}
+
+/* ---- main ---- */
+
+static void
+usage(void)
+{
+  fprintf(stderr,
+    "lwip_bench [-m httpd|styx] [-s bytes] [-r kbit/s] [-d ms] [-l loss %%]\n"
+    "           [-q packets] [-S seed] [-t s] [-H]\n");
+  exit(2);
+}
+
+static void
+print_header(void)
+{
+  printf("%-5s %4s %6s %5s %5s %6s %6s %9s %8s %6s %5s %5s %8s %s\n",
+    "mode", "mss", "sndbuf", "queue", "ooseq", "loss%", "delay",
+    "kB/s", "heap", "rexmit", "lost", "drop", "time_s", "status");
+}
+
+int
+main(int argc, char **argv)
+{
+  ip_addr_t dev_ip, peer_ip, mask, gw;
+  struct tcp_pcb *lpcb;
+  unsigned long long next;
+  const char *status;
+  double secs;
+  int c, header = 0;
+
+  while ((c = getopt(argc, argv, "m:s:r:d:l:q:S:t:H")) != -1) {
+    switch (c) {
+    case 'm':
+      if (strcmp(optarg, "httpd") == 0) {
+        mode = MODE_HTTPD;
+      } else if (strcmp(optarg, "styx") == 0) {
+        mode = MODE_STYX;
+      } else {
+        usage();
+      }
+      break;
+    case 's': file_size = strtoul(optarg, NULL, 0); break;
+    case 'r': rate_kbit = strtoul(optarg, NULL, 0); break;
+    case 'd': delay_us = (u32_t)(atof(optarg) * 1000); break;
+    case 'l': loss_pct = atof(optarg); break;
+    case 'q': queue_max = atoi(optarg); break;
+    case 'S': seed = strtoul(optarg, NULL, 0); break;
+    case 't': limit_s = strtoul(optarg, NULL, 0); break;
+    case 'H': header = 1; break;
+    default: usage();
+    }
+  }
+  if (file_size == 0 || rate_kbit == 0 || queue_max <= 0) {
+    usage();
+  }
+  if (header) {
+    print_header();
+  }
+
+  snprintf(http_len, sizeof(http_len), "Content-Length: %u\r\n\r\n", (unsigned)file_size);
+
+  lwip_init();
+
+  /*
+   * device 10.0.0.1 and peer 10.0.1.1: a packet leaves by the netif of
+   * its destination, so the link of a netif carries the packets to it
+   */
+  IP4_ADDR(&mask, 255, 255, 255, 0);
+  IP4_ADDR(&gw, 0, 0, 0, 0);
+  IP4_ADDR(&dev_ip, 10, 0, 0, 1);
+  IP4_ADDR(&peer_ip, 10, 0, 1, 1);
+
+  to_dev.to = &dev_netif;
+  to_dev.to_side = SIDE_DEV;
+  to_dev.rnd = seed * 2654435761u | 1;
+  to_peer.to = &peer_netif;
+  to_peer.to_side = SIDE_PEER;
+  to_peer.rnd = (seed + 1) * 2246822519u | 1;
+
+  netif_add(&dev_netif, &dev_ip, &mask, &gw, &to_dev, link_netif_init, ip_input);
+  netif_add(&peer_netif, &peer_ip, &mask, &gw, &to_peer, link_netif_init, ip_input);
+  netif_set_up(&dev_netif);
+  netif_set_up(&peer_netif);
+
+  side = SIDE_DEV;
+  lpcb = tcp_new();
+  tcp_bind(lpcb, &dev_ip, mode == MODE_HTTPD ? HTTPD_PORT : STYX_PORT);
+  lpcb = tcp_listen(lpcb);
+  tcp_arg(lpcb, lpcb);
+  tcp_accept(lpcb, dev_accept);
+
+  side = SIDE_PEER;
+  peer.pcb = tcp_new();
+  tcp_bind(peer.pcb, &peer_ip, 0);
+  tcp_recv(peer.pcb, peer_recv);
+  tcp_err(peer.pcb, peer_err);
+  tcp_connect(peer.pcb, &dev_ip, mode == MODE_HTTPD ? HTTPD_PORT : STYX_PORT, peer_connected);
+
+  /* the device's RAM from here on: the connection and its traffic */
+  heap_peak[SIDE_DEV] = heap_cur[SIDE_DEV];
+
+  while (!peer.done && !aborted && now_us < (unsigned long long)limit_s * 1000000) {
+    link_deliver(&to_dev);
+    link_deliver(&to_peer);
+    side = SIDE_DEV;
+    sys_check_timeouts();
+
+    /* to the next arrival, the timers run at least each STEP_US */
+    next = now_us + STEP_US;
+    if (to_dev.head != NULL && to_dev.head->at < next) {
+      next = to_dev.head->at;
+    }
+    if (to_peer.head != NULL && to_peer.head->at < next) {
+      next = to_peer.head->at;
+    }
+    now_us = next > now_us ? next : now_us + 1;
+  }
+
+  if (peer.done) {
+    status = peer.bad ? "corrupt" : "ok";
+  } else {
+    status = aborted ? "aborted" : "stalled";
+    peer.done_us = now_us;
+  }
+  secs = peer.done_us / 1e6;
+
+  printf("%-5s %4d %6d %5d %5d %6.2f %6.1f %9.1f %8u %6u %5u %5u %8.3f %s\n",
+    mode == MODE_HTTPD ? "httpd" : "styx",
+    TCP_MSS, TCP_SND_BUF, TCP_SND_QUEUELEN, TCP_QUEUE_OOSEQ,
+    loss_pct, delay_us / 1000.0,
+    secs > 0 ? peer.data / 1024.0 / secs : 0.0,
+    (unsigned)heap_peak[SIDE_DEV], to_peer.rexmit,
+    to_dev.lost + to_peer.lost, to_dev.dropped + to_peer.dropped,
+    secs, status);
+
+  return peer.done && !peer.bad ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+/*
+ * lwIP options of the throughput benchmark.
+ *
+ * These are the options of the firmware (modules/lwip/include/lwipopts.h),
+ * so the benchmark measures what runs on the device, made to run without
+ * an OS on the host. The ones under test (TCP_MSS, TCP_SND_BUF,
+ * TCP_QUEUE_OOSEQ) are given by the Makefile.
+ */
+#ifndef __BENCH_LWIPOPTS_H__
+#define __BENCH_LWIPOPTS_H__
+
+#include <stddef.h>
+
+#include "../../../include/lwipopts.h"
+
+/* No OS, no espressif glue: the bench calls the stack from one thread */
+#undef LWIP_ESP
+#undef ESP_RTOS
+#undef PBUF_RSV_FOR_WLAN
+#undef EBUF_LWIP
+
+#undef SYS_LIGHTWEIGHT_PROT
+#define SYS_LIGHTWEIGHT_PROT            0
+#define NO_SYS                          1
+#define LWIP_NETCONN                    0
+#define LWIP_SOCKET                     0
+
+#undef LWIP_SO_SNDTIMEO
+#undef LWIP_SO_RCVTIMEO
+#undef LWIP_SO_RCVBUF
+#define LWIP_SO_SNDTIMEO                0
+#define LWIP_SO_RCVTIMEO                0
+#define LWIP_SO_RCVBUF                  0
+
+/* Only TCP over IP between two netifs */
+#undef LWIP_DHCP
+#undef LWIP_DNS
+#define LWIP_DHCP                       0
+#define LWIP_DNS                        0
+#define LWIP_ARP                        0
+#define LWIP_ETHERNET                   0
+
+/* The peer is a PC: its receive window does not limit the device */
+#ifndef TCP_WND
+#define TCP_WND                         0xffff
+#endif
+
+/* The segments are mallocs (MEMP_MEM_MALLOC), not a fixed pool */
+#define MEMP_NUM_TCP_SEG                TCP_SND_QUEUELEN
+
+#define LWIP_STATS                      1
+#define TCP_STATS                       1
+
+/* Every allocation of the stack is counted for the RAM high-water */
+#define mem_malloc bench_malloc
+#define mem_calloc bench_calloc
+#define mem_free bench_free
+
+void *bench_malloc(size_t size);
+void *bench_calloc(size_t count, size_t size);
+void bench_free(void *mem);
+
+#endif /* __BENCH_LWIPOPTS_H__ */
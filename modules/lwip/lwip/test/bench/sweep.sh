@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# Runs lwip_bench over the combinations of the lwIP options and of the
+# link, one line each. The lists are overridable from the environment:
+#
+#   MSS="536 1460" LOSS="0 5" ./sweep.sh -s 262144 > sweep.txt
+#
+# The other arguments are passed to every run (see lwip_bench.c).
+
+cd "$(dirname "$0")"
+
+MSS=${MSS:-"536 548 1460"}
+SND_BUF=${SND_BUF:-"2 4 8"}
+OOSEQ=${OOSEQ:-"0 1"}
+MODES=${MODES:-"httpd styx"}
+LOSS=${LOSS:-"0 1 5"}
+DELAY=${DELAY:-"2 20"}
+SEEDS=${SEEDS:-"1"}
+
+header=-H
+for mss in $MSS; do
+  for snd in $SND_BUF; do
+    for ooseq in $OOSEQ; do
+      make -s MSS=$mss SND_BUF=$snd OOSEQ=$ooseq || exit 1
+      bin=build/lwip_bench_${mss}_${snd}_${ooseq}
+      for mode in $MODES; do
+        for loss in $LOSS; do
+          for delay in $DELAY; do
+            for seed in $SEEDS; do
+              $bin $header -m $mode -l $loss -d $delay -S $seed "$@"
+              header=
+            done
+          done
+        done
+      done
+    done
+  done
+done
+exit 0
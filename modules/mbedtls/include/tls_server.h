@@ -0,0 +1,90 @@
+/*
+ * bhgv, TLS listeners of the servers (httpd, styx)
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _TLS_SERVER_H_
+#define _TLS_SERVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A TLS listener authenticates its clients with a pre-shared key, so there
+ * is no certificate nor public key operation in the handshake. Sessions are
+ * kept in a bounded cache and in tickets, for a client to resume them in
+ * one round trip.
+ */
+
+// Default options of a listener
+#define TLS_DEF_CACHE_MAX        4      // sessions kept by id
+#define TLS_DEF_CACHE_TIMEOUT    3600   // seconds a session is kept
+#define TLS_DEF_TICKET_LIFETIME  3600   // seconds a ticket is valid
+#define TLS_DEF_TIMEOUT          5000   // ms to wait for the peer
+
+#define TLS_PSK_MAX_LEN          32
+
+// tls_read results besides the bytes read
+#define TLS_CLOSED   0
+#define TLS_ERROR   -1
+#define TLS_TIMEOUT -2
+
+typedef struct {
+	const char *identity;    // PSK identity the clients send
+	const unsigned char *psk;
+	size_t psk_len;          // at most TLS_PSK_MAX_LEN
+	int max_frag;            // largest record sent, 512 to 4096, 0 = MBEDTLS_SSL_MAX_CONTENT_LEN
+	int cache_max;           // 0 = no session cache
+	int cache_timeout;
+	int ticket_lifetime;     // 0 = no tickets
+	int timeout;
+} tls_opts_t;
+
+// Handshake counters and times, in us, of the full and resumed handshakes
+typedef struct {
+	uint32_t handshakes;
+	uint32_t resumed;
+	uint32_t failed;
+	uint32_t handshake_us;   // last full one
+	uint32_t resume_us;      // last resumed one
+	uint64_t handshake_total_us;
+	uint64_t resume_total_us;
+} tls_stats_t;
+
+/*
+ * Transport of a connection. send returns the bytes sent or < 0, recv the
+ * bytes received, 0 if the peer closed, TLS_TIMEOUT if nothing came in
+ * timeout ms or TLS_ERROR.
+ */
+typedef int (*tls_send_t)(void *ctx, const unsigned char *buf, size_t len);
+typedef int (*tls_recv_t)(void *ctx, unsigned char *buf, size_t len, uint32_t timeout);
+
+typedef struct tls_server tls_server_t;
+typedef struct tls_conn tls_conn_t;
+
+// Returns 0 or an mbedTLS error, see tls_strerror
+int tls_server_new(tls_server_t **srv, const tls_opts_t *opts);
+void tls_server_free(tls_server_t *srv);
+
+const tls_stats_t *tls_server_stats(tls_server_t *srv);
+void tls_strerror(int err, char *buf, size_t len);
+
+// Handshake with a client. Returns NULL if it failed or timed out.
+tls_conn_t *tls_accept(tls_server_t *srv, void *ctx, tls_send_t send, tls_recv_t recv);
+
+// Waits timeout ms for the peer, 0 = the timeout of the listener
+int tls_read(tls_conn_t *conn, void *buf, size_t len, uint32_t timeout);
+int tls_write(tls_conn_t *conn, const void *buf, size_t len);
+
+// Bytes already decrypted, that a read returns without waiting
+size_t tls_pending(tls_conn_t *conn);
+
+// Sends close notify and frees the connection, not its transport
+void tls_close(tls_conn_t *conn);
+
+#endif
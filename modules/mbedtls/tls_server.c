@@ -0,0 +1,413 @@
+/*
+ * bhgv, TLS listeners of the servers (httpd, styx)
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * PSK cipher suites only: an ECDHE handshake takes seconds at 80 MHz, a
+ * PSK one is a few hashes. A client that comes back presents its session
+ * id or ticket and skips the key exchange, so the handshake is one round
+ * trip. The servers are single tasks, so one connection at most is in
+ * handshake on a listener, the one the cache and ticket callbacks are for.
+ */
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/error.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+
+#include <sys/drivers/clock.h>
+
+#include "tls_server.h"
+
+struct tls_server {
+	mbedtls_ssl_config conf;
+	mbedtls_entropy_context entropy;
+	mbedtls_ctr_drbg_context drbg;
+#if defined(MBEDTLS_SSL_CACHE_C)
+	mbedtls_ssl_cache_context cache;
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+	mbedtls_ssl_ticket_context ticket;
+#endif
+	tls_conn_t *hs;        // connection in handshake
+	uint32_t timeout;
+	tls_stats_t stats;
+};
+
+struct tls_conn {
+	mbedtls_ssl_context ssl;
+	tls_server_t *srv;
+	void *ctx;
+	tls_send_t send;
+	tls_recv_t recv;
+	uint32_t timeout;      // of the handshake or of the current read
+	int resumed;
+};
+
+// Smallest record overhead first, CCM_8 has an 8 byte tag
+static const int psk_suites[] = {
+	MBEDTLS_TLS_PSK_WITH_AES_128_CCM_8,
+	MBEDTLS_TLS_PSK_WITH_AES_128_GCM_SHA256,
+	MBEDTLS_TLS_PSK_WITH_AES_128_CBC_SHA256,
+	0
+};
+
+static int conn_send(void *p, const unsigned char *buf, size_t len) {
+	tls_conn_t *conn = (tls_conn_t *)p;
+	int res;
+
+	res = conn->send(conn->ctx, buf, len);
+
+	return (res < 0) ? MBEDTLS_ERR_NET_SEND_FAILED : res;
+}
+
+/*
+ * The timeout of the config is ignored, the one of the connection is
+ * either the handshake timeout or the one the read was called with.
+ */
+static int conn_recv(void *p, unsigned char *buf, size_t len, uint32_t timeout) {
+	tls_conn_t *conn = (tls_conn_t *)p;
+	int res;
+
+	(void)timeout;
+
+	res = conn->recv(conn->ctx, buf, len, conn->timeout);
+	if (res == TLS_TIMEOUT) {
+		return MBEDTLS_ERR_SSL_TIMEOUT;
+	}
+
+	return (res < 0) ? MBEDTLS_ERR_NET_RECV_FAILED : res;
+}
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+static int cache_get(void *data, mbedtls_ssl_session *session) {
+	tls_server_t *srv = (tls_server_t *)data;
+
+	if (mbedtls_ssl_cache_get(&srv->cache, session)) {
+		return 1;
+	}
+
+	if (srv->hs) {
+		srv->hs->resumed = 1;
+	}
+
+	return 0;
+}
+
+static int cache_set(void *data, const mbedtls_ssl_session *session) {
+	tls_server_t *srv = (tls_server_t *)data;
+
+	return mbedtls_ssl_cache_set(&srv->cache, session);
+}
+#endif
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+static int ticket_write(void *data, const mbedtls_ssl_session *session,
+                        unsigned char *start, const unsigned char *end,
+                        size_t *tlen, uint32_t *lifetime) {
+	tls_server_t *srv = (tls_server_t *)data;
+
+	return mbedtls_ssl_ticket_write(&srv->ticket, session, start, end, tlen, lifetime);
+}
+
+static int ticket_parse(void *data, mbedtls_ssl_session *session,
+                        unsigned char *buf, size_t len) {
+	tls_server_t *srv = (tls_server_t *)data;
+	int res;
+
+	res = mbedtls_ssl_ticket_parse(&srv->ticket, session, buf, len);
+	if (!res && srv->hs) {
+		srv->hs->resumed = 1;
+	}
+
+	return res;
+}
+#endif
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+static unsigned char max_frag_code(int len) {
+	switch (len) {
+		case 512:  return MBEDTLS_SSL_MAX_FRAG_LEN_512;
+		case 1024: return MBEDTLS_SSL_MAX_FRAG_LEN_1024;
+		case 2048: return MBEDTLS_SSL_MAX_FRAG_LEN_2048;
+		case 4096: return MBEDTLS_SSL_MAX_FRAG_LEN_4096;
+		default:   return MBEDTLS_SSL_MAX_FRAG_LEN_INVALID;
+	}
+}
+#endif
+
+int tls_server_new(tls_server_t **psrv, const tls_opts_t *opts) {
+	static const char pers[] = "tls_server";
+	tls_server_t *srv;
+	int res;
+
+	*psrv = NULL;
+
+	if (!opts->identity || !opts->psk || !opts->psk_len || (opts->psk_len > TLS_PSK_MAX_LEN)) {
+		return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+	}
+
+	srv = calloc(1, sizeof(tls_server_t));
+	if (!srv) {
+		return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+	}
+
+	mbedtls_ssl_config_init(&srv->conf);
+	mbedtls_entropy_init(&srv->entropy);
+	mbedtls_ctr_drbg_init(&srv->drbg);
+#if defined(MBEDTLS_SSL_CACHE_C)
+	mbedtls_ssl_cache_init(&srv->cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+	mbedtls_ssl_ticket_init(&srv->ticket);
+#endif
+
+	srv->timeout = (opts->timeout > 0) ? opts->timeout : TLS_DEF_TIMEOUT;
+
+	res = mbedtls_ctr_drbg_seed(&srv->drbg, mbedtls_entropy_func, &srv->entropy,
+	                            (const unsigned char *)pers, sizeof(pers) - 1);
+	if (res) {
+		goto fail;
+	}
+
+	res = mbedtls_ssl_config_defaults(&srv->conf, MBEDTLS_SSL_IS_SERVER,
+	                                  MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+	if (res) {
+		goto fail;
+	}
+
+	mbedtls_ssl_conf_rng(&srv->conf, mbedtls_ctr_drbg_random, &srv->drbg);
+	mbedtls_ssl_conf_ciphersuites(&srv->conf, psk_suites);
+
+	res = mbedtls_ssl_conf_psk(&srv->conf, opts->psk, opts->psk_len,
+	                           (const unsigned char *)opts->identity, strlen(opts->identity));
+	if (res) {
+		goto fail;
+	}
+
+	// The buffers are MBEDTLS_SSL_MAX_CONTENT_LEN, this bounds the records sent
+	if (opts->max_frag) {
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+		res = mbedtls_ssl_conf_max_frag_len(&srv->conf, max_frag_code(opts->max_frag));
+#else
+		res = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+#endif
+		if (res) {
+			goto fail;
+		}
+	}
+
+	if (opts->cache_max > 0) {
+#if defined(MBEDTLS_SSL_CACHE_C)
+		mbedtls_ssl_cache_set_max_entries(&srv->cache, opts->cache_max);
+#if defined(MBEDTLS_HAVE_TIME)
+		mbedtls_ssl_cache_set_timeout(&srv->cache,
+			(opts->cache_timeout > 0) ? opts->cache_timeout : TLS_DEF_CACHE_TIMEOUT);
+#endif
+		mbedtls_ssl_conf_session_cache(&srv->conf, srv, cache_get, cache_set);
+#else
+		res = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+		goto fail;
+#endif
+	}
+
+	if (opts->ticket_lifetime > 0) {
+#if defined(MBEDTLS_SSL_TICKET_C)
+		res = mbedtls_ssl_ticket_setup(&srv->ticket, mbedtls_ctr_drbg_random, &srv->drbg,
+		                               MBEDTLS_CIPHER_AES_128_GCM, opts->ticket_lifetime);
+		if (res) {
+			goto fail;
+		}
+
+		mbedtls_ssl_conf_session_tickets_cb(&srv->conf, ticket_write, ticket_parse, srv);
+#else
+		res = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+		goto fail;
+#endif
+	}
+
+	*psrv = srv;
+
+	return 0;
+
+fail:
+	tls_server_free(srv);
+
+	return res;
+}
+
+void tls_server_free(tls_server_t *srv) {
+	if (!srv) {
+		return;
+	}
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+	mbedtls_ssl_ticket_free(&srv->ticket);
+#endif
+#if defined(MBEDTLS_SSL_CACHE_C)
+	mbedtls_ssl_cache_free(&srv->cache);
+#endif
+	mbedtls_ssl_config_free(&srv->conf);
+	mbedtls_ctr_drbg_free(&srv->drbg);
+	mbedtls_entropy_free(&srv->entropy);
+
+	free(srv);
+}
+
+const tls_stats_t *tls_server_stats(tls_server_t *srv) {
+	return &srv->stats;
+}
+
+void tls_strerror(int err, char *buf, size_t len) {
+#if defined(MBEDTLS_ERROR_C)
+	mbedtls_strerror(err, buf, len);
+#else
+	snprintf(buf, len, "TLS error -0x%04x", -err);
+#endif
+}
+
+tls_conn_t *tls_accept(tls_server_t *srv, void *ctx, tls_send_t send, tls_recv_t recv) {
+	tls_conn_t *conn;
+	uint64_t start;
+	uint32_t us;
+	int res;
+
+	conn = calloc(1, sizeof(tls_conn_t));
+	if (!conn) {
+		srv->stats.failed++;
+		return NULL;
+	}
+
+	mbedtls_ssl_init(&conn->ssl);
+
+	conn->srv = srv;
+	conn->ctx = ctx;
+	conn->send = send;
+	conn->recv = recv;
+	conn->timeout = srv->timeout;
+
+	// Allocates the in and out record buffers
+	res = mbedtls_ssl_setup(&conn->ssl, &srv->conf);
+	if (res) {
+		goto fail;
+	}
+
+	mbedtls_ssl_set_bio(&conn->ssl, conn, conn_send, NULL, conn_recv);
+
+	start = clock_monotonic_us();
+
+	srv->hs = conn;
+	do {
+		res = mbedtls_ssl_handshake(&conn->ssl);
+	} while ((res == MBEDTLS_ERR_SSL_WANT_READ) || (res == MBEDTLS_ERR_SSL_WANT_WRITE));
+	srv->hs = NULL;
+
+	us = clock_monotonic_us() - start;
+
+	if (res) {
+		goto fail;
+	}
+
+	if (conn->resumed) {
+		srv->stats.resumed++;
+		srv->stats.resume_us = us;
+		srv->stats.resume_total_us += us;
+	} else {
+		srv->stats.handshakes++;
+		srv->stats.handshake_us = us;
+		srv->stats.handshake_total_us += us;
+	}
+
+	return conn;
+
+fail:
+	srv->stats.failed++;
+
+	mbedtls_ssl_free(&conn->ssl);
+	free(conn);
+
+	return NULL;
+}
+
+int tls_read(tls_conn_t *conn, void *buf, size_t len, uint32_t timeout) {
+	int res;
+
+	conn->timeout = timeout ? timeout : conn->srv->timeout;
+
+	res = mbedtls_ssl_read(&conn->ssl, buf, len);
+	if (res > 0) {
+		return res;
+	}
+
+	switch (res) {
+		case 0:
+		case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
+		case MBEDTLS_ERR_SSL_CONN_EOF:
+			return TLS_CLOSED;
+
+		case MBEDTLS_ERR_SSL_TIMEOUT:
+		case MBEDTLS_ERR_SSL_WANT_READ:
+		case MBEDTLS_ERR_SSL_WANT_WRITE:
+			return TLS_TIMEOUT;
+
+		default:
+			return TLS_ERROR;
+	}
+}
+
+// mbedtls_ssl_write sends a record at most, of max_frag bytes
+int tls_write(tls_conn_t *conn, const void *buf, size_t len) {
+	const unsigned char *p = buf;
+	size_t left = len;
+	int res;
+
+	while (left > 0) {
+		res = mbedtls_ssl_write(&conn->ssl, p, left);
+		if ((res == MBEDTLS_ERR_SSL_WANT_WRITE) || (res == MBEDTLS_ERR_SSL_WANT_READ)) {
+			continue;
+		}
+
+		if (res < 0) {
+			return TLS_ERROR;
+		}
+
+		p += res;
+		left -= res;
+	}
+
+	return len;
+}
+
+size_t tls_pending(tls_conn_t *conn) {
+	return mbedtls_ssl_get_bytes_avail(&conn->ssl);
+}
+
+void tls_close(tls_conn_t *conn) {
+	if (!conn) {
+		return;
+	}
+
+	mbedtls_ssl_close_notify(&conn->ssl);
+	mbedtls_ssl_free(&conn->ssl);
+
+	free(conn);
+}
@@ -66,6 +66,7 @@ inline static uint32_t round_div(uint32_t x, uint32_t y)
 
 inline static void write_reg(unsigned char addr, uint8_t reg, uint8_t val)
 {
+	platform_i2c_lock(0);
 	uint8_t ot = i2c_master_set_delay_us(1);
 
 	platform_i2c_send_start(0);
@@ -77,6 +78,7 @@ inline static void write_reg(unsigned char addr, uint8_t reg, uint8_t val)
 	udelay(2);
 	
 	i2c_master_set_delay_us(ot);
+	platform_i2c_unlock(0);
  //   if (i2c_slave_write(dev->bus, dev->addr, &reg, &val, 1))
  //       debug("Could not write 0x%02x to 0x%02x, bus %u, addr = 0x%02x", reg, val, dev->bus, dev->addr);
 }
@@ -85,6 +87,7 @@ inline static uint8_t read_reg(unsigned char addr, uint8_t reg)
 {
     uint8_t res = 0;
     
+	platform_i2c_lock(0);
 	uint8_t ot = i2c_master_set_delay_us(1);
 
     platform_i2c_send_start(0);
@@ -99,6 +102,7 @@ inline static uint8_t read_reg(unsigned char addr, uint8_t reg)
 	udelay(2);
 	
 	i2c_master_set_delay_us(ot);
+	platform_i2c_unlock(0);
 //    if (i2c_slave_read(dev->bus, dev->addr, &reg, &res, 1))
 //        debug("Could not read from 0x%02x, bus %u, addr = 0x%02x", reg, dev->bus, dev->addr);
     return res;
@@ -106,7 +110,9 @@ inline static uint8_t read_reg(unsigned char addr, uint8_t reg)
 
 inline static void update_reg(unsigned char addr, uint8_t reg, uint8_t mask, uint8_t val)
 {
+    platform_i2c_lock(0);
     write_reg(addr, reg, (read_reg(addr, reg) & ~mask) | val);
+    platform_i2c_unlock(0);
 }
 
 void pca9685_init(unsigned char addr)
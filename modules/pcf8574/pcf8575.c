@@ -9,6 +9,7 @@ uint16_t pcf8575_port_read(unsigned char addr)
 {
     uint16_t res = 0;
 
+	platform_i2c_lock(0);
 	uint8_t od = i2c_master_set_delay_us(I2C_DEF_DELAY);
 //    platform_i2c_send_start(0);
 //	platform_i2c_send_address(0, addr, 0);
@@ -22,6 +23,7 @@ uint16_t pcf8575_port_read(unsigned char addr)
 	platform_i2c_send_stop(0);
 
 	i2c_master_set_delay_us(od);
+	platform_i2c_unlock(0);
 	
 	udelay(500);
 //    if (i2c_slave_read(dev->bus, dev->addr, NULL, &res, 1))
@@ -33,6 +35,7 @@ void pcf8575_port_write(const unsigned char addr, uint16_t val)
 {
 	old_val = val;
 
+	platform_i2c_lock(0);
 	uint8_t od = i2c_master_set_delay_us(I2C_DEF_DELAY);
 //	platform_i2c_send_start(0);
 //	platform_i2c_send_address(0, addr, 0);
@@ -51,6 +54,7 @@ void pcf8575_port_write(const unsigned char addr, uint16_t val)
 	platform_i2c_send_stop(0);
 
 	i2c_master_set_delay_us(od);
+	platform_i2c_unlock(0);
 
 	udelay(500);
 //    i2c_slave_write(dev->bus, dev->addr, NULL, &value, 1);
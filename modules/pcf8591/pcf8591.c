@@ -7,13 +7,12 @@
 #define PCF8591_CTRL_REG_READ 0x03
 
 
-uint8_t pcf8591_read(unsigned char addr, uint8_t ch)
+uint8_t pcf8591_read_all(unsigned char addr, uint8_t *res)
 {
-	ch = PCF8591_CTRL_REG_READ & ch;
-    uint8_t res[4]; 
     uint8_t reg = 0x40 | 4; 
 	uint8_t x=1;
 	
+	platform_i2c_lock(0);
 	uint8_t ot = i2c_master_set_delay_us(1);
 
 	while (x>0 && x<4){
@@ -32,7 +31,7 @@ uint8_t pcf8591_read(unsigned char addr, uint8_t ch)
 		res[3] = platform_i2c_recv_byte(0, 1);
 	    platform_i2c_send_stop(0);
 	    udelay(2);
-//	printf("adc ch(%d) = %d,  %d, %d, %d\n", ch, res[0], res[1], res[2], res[3]);
+//	printf("adc = %d,  %d, %d, %d\n", res[0], res[1], res[2], res[3]);
 
 		if( !(res[0]==255 && res[1]==255 && res[2]==255 && res[3]==255) )
 			x=0;
@@ -40,8 +39,18 @@ uint8_t pcf8591_read(unsigned char addr, uint8_t ch)
 			x++;
 	}
 	i2c_master_set_delay_us(ot);
+	platform_i2c_unlock(0);
+
+    return x == 0;
+}
+
+uint8_t pcf8591_read(unsigned char addr, uint8_t ch)
+{
+    uint8_t res[4]; 
+
+    pcf8591_read_all(addr, res);
 
-    return res[ch];
+    return res[PCF8591_CTRL_REG_READ & ch];
 }
 
 uint8_t pcf8591_write(unsigned char addr, uint8_t data)
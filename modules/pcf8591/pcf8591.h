@@ -21,6 +21,9 @@ extern "C"
 
 uint8_t pcf8591_read(unsigned char addr, uint8_t analog_pin);
 
+// The 4 inputs in one transaction, returns 0 if they all read 255 (no chip)
+uint8_t pcf8591_read_all(unsigned char addr, uint8_t *res);
+
 uint8_t pcf8591_write(unsigned char addr, uint8_t data);
 
 
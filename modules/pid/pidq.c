@@ -0,0 +1,559 @@
+/*
+ * bhgv, fixed point PID loops stepped by a timer
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * PID.c computes a loop per call in float, which is soft-float on the
+ * ESP8266. Here an hrtimer steps all the loops due at each tick in 16.16
+ * fixed point, with 64 bit products, inside its interrupt: the input of a
+ * loop is the last sample of its channel of the acquisition (or a value
+ * given by pidq_input()), its output goes to the state and, when it has a
+ * PWM channel, to a task that writes the PCA9685 out of the interrupt.
+ *
+ * The steps are those of pid_compute(): the integral is the sum of
+ * Ki * T * error, bounded by the output limits, the derivative is on the
+ * input. Then the derivative goes through a first order filter of time
+ * constant tf, and with antiwindup the integral doesn't grow while the
+ * output saturates in its direction. With tf = 0 and no antiwindup the
+ * outputs are those of pid_compute() (see platform/host/bench/pid_bench.c).
+ *
+ * The integral is kept with 24 fractional bits, Ki * T is small.
+ *
+ * Without KERNEL only the loops are built, the ticks come from
+ * pidq_tick().
+ */
+
+#ifdef KERNEL
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "pthread.h"
+#include "whitecat.h"
+
+#include <pca9685/pca9685.h>
+
+#include <sys/drivers/hrtimer.h>
+#endif
+
+#ifdef PLATFORM_ESP8266
+#include <xtensa_ops.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#include "sys/drivers/acq.h"
+
+#include "pidq.h"
+
+#ifndef IRAM
+#define IRAM
+#endif
+
+#ifndef CPU_HZ
+#define CPU_HZ 80000000L
+#endif
+
+#define I_SHIFT 8                   // Q24 of the integral
+#define Q16_MAX INT32_MAX
+#define Q16_MIN INT32_MIN
+
+typedef struct {
+	// Tuning
+	q16_t kp;
+	int32_t ki;                     // Ki * T, Q24
+	q16_t kd;                       // Kd / T
+	q16_t alpha;                    // T / (tf + T) of the derivative filter
+	q16_t omin;
+	q16_t omax;
+	volatile q16_t setpoint;
+	uint16_t period;                // ticks
+	int8_t input;
+	int8_t pwm;
+	uint8_t antiwindup;
+	pidq_config_t cfg;              // as given
+
+	// State
+	volatile uint8_t enabled;
+	uint8_t used;
+	uint16_t due;                   // ticks to the next step
+	volatile q16_t in;
+	volatile q16_t out;
+	int64_t iterm;                  // Q24
+	int64_t dterm;
+	q16_t lastin;
+	uint32_t runs;
+	uint32_t saturated;
+} pidq_loop_t;
+
+static pidq_loop_t loops[PIDQ_LOOPS];
+static int nloops = 0;
+static pidq_stats_t stats;
+
+static volatile uint32_t pwm_dirty; // bit n, the output of loop n changed
+
+static void sched_wake(int isr);
+
+#ifdef PLATFORM_ESP8266
+static inline uint32_t now(void) {
+	uint32_t cc;
+
+	RSR(cc, ccount);
+	return cc;
+}
+#else
+static inline uint32_t now(void) {
+	return 0;
+}
+#endif
+
+#ifdef KERNEL
+
+#define PIDQ_LOCK()   portENTER_CRITICAL()
+#define PIDQ_UNLOCK() portEXIT_CRITICAL()
+
+#define PWM_WRITE 0
+#define PWM_QUIT  1
+
+static hrtimer_t timer;
+static QueueHandle_t wake = NULL;
+static volatile uint8_t task = 0;
+
+static void sched_tick(void *arg) {
+	pidq_tick();
+}
+
+// The outputs with a PWM channel, out of the interrupt
+static void *pwm_task(void *arg) {
+	pidq_loop_t *l;
+	uint32_t dirty;
+	int32_t v;
+	uint8_t m;
+	int i;
+
+	for (;;) {
+		xQueueReceive(wake, &m, portMAX_DELAY);
+		if (m == PWM_QUIT) {
+			break;
+		}
+
+		PIDQ_LOCK();
+		dirty = pwm_dirty;
+		pwm_dirty = 0;
+		PIDQ_UNLOCK();
+
+		// The bus once for all the outputs, they wait behind the OLED,
+		// the keys, the sampler of acq or Lua
+		platform_i2c_lock(0);
+		while (dirty) {
+			i = __builtin_ctz(dirty);
+			dirty &= ~(1 << i);
+
+			l = &loops[i];
+			if (!l->used || (l->pwm < 0)) {
+				continue;
+			}
+
+			v = (l->out + Q16_ONE / 2) >> 16;
+			pca9685_set_pwm_value(PCA9685_ADDR_BASE, l->pwm, (v < 0) ? 0 : ((v > 4095) ? 4095 : v));
+			stats.pwm_writes++;
+		}
+		platform_i2c_unlock(0);
+	}
+
+	task = 0;
+	return NULL;
+}
+
+// When already queued, the task takes all the outputs
+static void IRAM sched_wake(int isr) {
+	portBASE_TYPE woken = pdFALSE;
+	uint8_t m = PWM_WRITE;
+
+	if (!isr) {
+		xQueueSend(wake, &m, 0);
+		return;
+	}
+
+	xQueueSendFromISR(wake, &m, &woken);
+	portEND_SWITCHING_ISR(woken);
+}
+
+static int sched_start(void) {
+	pthread_attr_t attr;
+	pthread_t id;
+
+	wake = xQueueCreate(1, sizeof(uint8_t));
+	if (!wake) {
+		return EAGAIN;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, pidStack);
+	pthread_attr_setinitialstate(&attr, PTHREAD_INITIAL_STATE_RUN);
+
+	task = 1;
+	if (pthread_create(&id, &attr, pwm_task, NULL)) {
+		task = 0;
+		vQueueDelete(wake);
+		wake = NULL;
+		return EAGAIN;
+	}
+
+	hrtimer_init(&timer, sched_tick, NULL);
+	if (hrtimer_start(&timer, PIDQ_TICK_US, PIDQ_TICK_US)) {
+		uint8_t m = PWM_QUIT;
+
+		xQueueSend(wake, &m, portMAX_DELAY);
+		while (task) {
+			vTaskDelay(1);
+		}
+		vQueueDelete(wake);
+		wake = NULL;
+		return EAGAIN;
+	}
+
+	return 0;
+}
+
+static void sched_stop(void) {
+	uint8_t m = PWM_QUIT;
+
+	if (!wake) {
+		return;
+	}
+
+	hrtimer_stop(&timer);
+
+	xQueueSend(wake, &m, portMAX_DELAY);
+	while (task) {
+		vTaskDelay(1);
+	}
+
+	vQueueDelete(wake);
+	wake = NULL;
+}
+
+#else
+
+#define PIDQ_LOCK()
+#define PIDQ_UNLOCK()
+
+static void sched_wake(int isr) {
+}
+
+static int sched_start(void) {
+	return 0;
+}
+
+static void sched_stop(void) {
+}
+
+#endif
+
+static inline int64_t clamp(int64_t v, int64_t min, int64_t max) {
+	return (v < min) ? min : ((v > max) ? max : v);
+}
+
+// A step of a loop, as pid_compute()
+static void IRAM step(pidq_loop_t *l, q16_t in) {
+	int64_t err = (int64_t)l->setpoint - in;
+	int64_t inc = ((int64_t)l->ki * err) >> 16;
+	int64_t imin = (int64_t)l->omin << I_SHIFT;
+	int64_t imax = (int64_t)l->omax << I_SHIFT;
+	int64_t p, d, i, out;
+
+	p = ((int64_t)l->kp * err) >> 16;
+
+	// On the input, filtered
+	d = -(((int64_t)l->kd * ((int64_t)in - l->lastin)) >> 16);
+	l->dterm += ((int64_t)l->alpha * (d - l->dterm)) >> 16;
+
+	i = clamp(l->iterm + inc, imin, imax);
+	out = p + (i >> I_SHIFT) + l->dterm;
+
+	// The integral doesn't push further into a limit
+	if (l->antiwindup && (((out > l->omax) && (inc > 0)) || ((out < l->omin) && (inc < 0)))) {
+		i = l->iterm;
+		out = p + (i >> I_SHIFT) + l->dterm;
+	}
+
+	if ((out >= l->omax) || (out <= l->omin)) {
+		l->saturated++;
+	}
+
+	l->iterm = i;
+	l->lastin = in;
+	l->out = clamp(out, l->omin, l->omax);
+	l->runs++;
+}
+
+void IRAM pidq_tick(void) {
+	uint32_t t0 = now(), dirty = 0, us;
+	pidq_loop_t *l;
+	q16_t prev;
+	int i, ran = 0, v;
+
+	stats.ticks++;
+
+	for (i = 0; i < PIDQ_LOOPS; i++) {
+		l = &loops[i];
+		if (!l->enabled || --l->due) {
+			continue;
+		}
+		l->due = l->period;
+
+		if (l->input >= 0) {
+			if ((v = acq_last(l->input)) < 0) {
+				continue;
+			}
+			l->in = v << 16;
+		}
+
+		prev = l->out;
+		step(l, l->in);
+		ran++;
+
+		if ((l->pwm >= 0) && (l->out != prev)) {
+			dirty |= 1 << i;
+		}
+	}
+
+	if (!ran) {
+		return;
+	}
+
+	stats.runs += ran;
+
+	if (dirty) {
+		pwm_dirty |= dirty;
+		sched_wake(1);
+	}
+
+	us = (now() - t0) / (CPU_HZ / 1000000);
+	stats.step_us = us;
+	if (us > stats.step_max) {
+		stats.step_max = us;
+	}
+}
+
+// The tuning of cfg in the fixed point of l
+static int tune(pidq_loop_t *l, const pidq_config_t *cfg) {
+	float t, sign;
+	int period;
+
+	period = (cfg->period_ms * 1000 + PIDQ_TICK_US / 2) / PIDQ_TICK_US;
+	if ((period < 1) || (period > 0xffff) ||
+		(cfg->kp < 0) || (cfg->ki < 0) || (cfg->kd < 0) || (cfg->tf < 0) ||
+		(cfg->min >= cfg->max) || (cfg->min < -32767) || (cfg->max > 32767) ||
+		(cfg->setpoint < -32767) || (cfg->setpoint > 32767) ||
+		(cfg->input >= ACQ_CHANNELS) || (cfg->pwm > 15)) {
+		return EINVAL;
+	}
+
+	t = period * (PIDQ_TICK_US / 1000000.0f);
+	sign = cfg->reverse ? -1 : 1;
+
+	if ((cfg->kp > 32767) || (cfg->kd / t > 32767) || (cfg->ki * t > 127)) {
+		return EINVAL;
+	}
+
+	PIDQ_LOCK();
+	l->kp = Q16(sign * cfg->kp);
+	l->ki = (int32_t)(sign * cfg->ki * t * (1 << 24) + sign * 0.5f);
+	l->kd = Q16(sign * cfg->kd / t);
+	l->alpha = Q16(t / (cfg->tf + t));
+	l->omin = Q16(cfg->min);
+	l->omax = Q16(cfg->max);
+	l->setpoint = Q16(cfg->setpoint);
+	l->period = period;
+	l->input = cfg->input;
+	l->pwm = cfg->pwm;
+	l->antiwindup = cfg->antiwindup;
+	l->cfg = *cfg;
+
+	// New limits, as pid_limits()
+	l->out = clamp(l->out, l->omin, l->omax);
+	l->iterm = clamp(l->iterm, (int64_t)l->omin << I_SHIFT, (int64_t)l->omax << I_SHIFT);
+	if (l->due > period) {
+		l->due = period;
+	}
+	PIDQ_UNLOCK();
+
+	return 0;
+}
+
+static pidq_loop_t *get_loop(int id) {
+	if ((id < 0) || (id >= PIDQ_LOOPS) || !loops[id].used) {
+		return NULL;
+	}
+
+	return &loops[id];
+}
+
+int pidq_add(const pidq_config_t *cfg, int *id) {
+	pidq_loop_t *l = NULL;
+	int i, res;
+
+	for (i = 0; i < PIDQ_LOOPS; i++) {
+		if (!loops[i].used) {
+			l = &loops[i];
+			break;
+		}
+	}
+	if (l == NULL) {
+		return EBUSY;
+	}
+
+	memset(l, 0, sizeof(pidq_loop_t));
+	l->due = 1;
+	if ((res = tune(l, cfg))) {
+		return res;
+	}
+	l->out = l->omin;
+
+	if (!nloops && (res = sched_start())) {
+		return res;
+	}
+
+	l->used = 1;
+	nloops++;
+	stats.loops++;
+
+	*id = i;
+	return 0;
+}
+
+int pidq_remove(int id) {
+	pidq_loop_t *l = get_loop(id);
+
+	if (l == NULL) {
+		return EINVAL;
+	}
+
+	PIDQ_LOCK();
+	l->enabled = 0;
+	l->used = 0;
+	PIDQ_UNLOCK();
+
+	if (!--nloops) {
+		sched_stop();
+	}
+
+	return 0;
+}
+
+int pidq_tune(int id, const pidq_config_t *cfg) {
+	pidq_loop_t *l = get_loop(id);
+
+	if (l == NULL) {
+		return EINVAL;
+	}
+
+	return tune(l, cfg);
+}
+
+int pidq_get_config(int id, pidq_config_t *cfg) {
+	pidq_loop_t *l = get_loop(id);
+
+	if (l == NULL) {
+		return EINVAL;
+	}
+
+	*cfg = l->cfg;
+	return 0;
+}
+
+int pidq_enable(int id, int on) {
+	pidq_loop_t *l = get_loop(id);
+	int v;
+
+	if (l == NULL) {
+		return EINVAL;
+	}
+
+	if (on && !l->enabled) {
+		if ((l->input >= 0) && ((v = acq_last(l->input)) >= 0)) {
+			l->in = v << 16;
+		}
+
+		// As pid_auto()
+		PIDQ_LOCK();
+		l->iterm = clamp((int64_t)l->out << I_SHIFT, (int64_t)l->omin << I_SHIFT, (int64_t)l->omax << I_SHIFT);
+		l->dterm = 0;
+		l->lastin = l->in;
+		l->due = l->period;
+		l->enabled = 1;
+		PIDQ_UNLOCK();
+	} else if (!on) {
+		l->enabled = 0;
+	}
+
+	return 0;
+}
+
+int pidq_input(int id, q16_t v) {
+	pidq_loop_t *l = get_loop(id);
+
+	if ((l == NULL) || (l->input >= 0)) {
+		return EINVAL;
+	}
+
+	l->in = v;
+	return 0;
+}
+
+int pidq_output(int id, q16_t v) {
+	pidq_loop_t *l = get_loop(id);
+
+	if ((l == NULL) || l->enabled) {
+		return EINVAL;
+	}
+
+	l->out = clamp(v, l->omin, l->omax);
+	if (l->pwm >= 0) {
+		PIDQ_LOCK();
+		pwm_dirty |= 1 << id;
+		PIDQ_UNLOCK();
+		sched_wake(0);
+	}
+
+	return 0;
+}
+
+int pidq_get_state(int id, pidq_state_t *st) {
+	pidq_loop_t *l = get_loop(id);
+
+	if (l == NULL) {
+		return EINVAL;
+	}
+
+	PIDQ_LOCK();
+	st->input = l->in;
+	st->output = l->out;
+	st->setpoint = l->setpoint;
+	st->iterm = clamp(l->iterm >> I_SHIFT, Q16_MIN, Q16_MAX);
+	st->dterm = clamp(l->dterm, Q16_MIN, Q16_MAX);
+	st->runs = l->runs;
+	st->saturated = l->saturated;
+	st->enabled = l->enabled;
+	PIDQ_UNLOCK();
+
+	return 0;
+}
+
+void pidq_get_stats(pidq_stats_t *st, int reset) {
+	PIDQ_LOCK();
+	*st = stats;
+	if (reset) {
+		stats.step_max = 0;
+	}
+	PIDQ_UNLOCK();
+}
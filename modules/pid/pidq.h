@@ -0,0 +1,106 @@
+/*
+ * bhgv, fixed point PID loops stepped by a timer
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _PIDQ_H_
+#define _PIDQ_H_
+
+#include <stdint.h>
+
+// Loops run at once
+#ifndef PIDQ_LOOPS
+#define PIDQ_LOOPS 8
+#endif
+
+// Tick of the scheduler, the periods of the loops are multiples of it
+#ifndef PIDQ_TICK_US
+#define PIDQ_TICK_US 1000
+#endif
+
+#define PIDQ_NO_INPUT -1
+#define PIDQ_NO_PWM   -1
+
+// 16.16 fixed point
+typedef int32_t q16_t;
+
+#define Q16_ONE        (1 << 16)
+#define Q16(f)         ((q16_t)((f) * 65536.0f + (((f) >= 0) ? 0.5f : -0.5f)))
+#define Q16_TO_F(q)    ((float)(q) / 65536.0f)
+
+/*
+ * A loop, as given by its user. The floats are only used to tune it, the
+ * loop is stepped in fixed point: the values must stay within +-32767.
+ */
+typedef struct {
+	float kp;
+	float ki;                   // 1/s
+	float kd;                   // s
+	float tf;                   // time constant of the derivative filter, s
+	float min;                  // output limits
+	float max;
+	float setpoint;
+	uint16_t period_ms;         // rounded to ticks
+	int8_t input;               // channel of sys/drivers/acq.c, or PIDQ_NO_INPUT
+	int8_t pwm;                 // PCA9685 channel, or PIDQ_NO_PWM
+	uint8_t reverse;            // the input goes down as the output goes up
+	uint8_t antiwindup;         // no integration while the output saturates
+} pidq_config_t;
+
+typedef struct {
+	q16_t input;
+	q16_t output;
+	q16_t setpoint;
+	q16_t iterm;
+	q16_t dterm;
+	uint32_t runs;
+	uint32_t saturated;         // steps with the output at a limit
+	uint8_t enabled;
+} pidq_state_t;
+
+typedef struct {
+	uint32_t loops;             // added
+	uint32_t ticks;
+	uint32_t runs;              // steps of the loops
+	uint32_t step_us;           // of the last tick with a step (board only)
+	uint32_t step_max;
+	uint32_t pwm_writes;
+} pidq_stats_t;
+
+/*
+ * Adds a loop, disabled, and starts the scheduler with the first one.
+ * Returns 0 and the id of the loop, EINVAL, EBUSY (no free loop) or
+ * EAGAIN (the scheduler can't start).
+ */
+int pidq_add(const pidq_config_t *cfg, int *id);
+
+// Removes a loop, the scheduler stops with the last one
+int pidq_remove(int id);
+
+// Tunes a loop again, the state is kept. Returns 0 or EINVAL.
+int pidq_tune(int id, const pidq_config_t *cfg);
+
+// The configuration of a loop, as last tuned
+int pidq_get_config(int id, pidq_config_t *cfg);
+
+// Starts stepping a loop from its current output and input (no bump), or
+// stops it, its output is then kept
+int pidq_enable(int id, int on);
+
+// Sets the input of a loop without acquisition channel, or its output when
+// disabled
+int pidq_input(int id, q16_t v);
+int pidq_output(int id, q16_t v);
+
+int pidq_get_state(int id, pidq_state_t *st);
+void pidq_get_stats(pidq_stats_t *st, int reset);
+
+// A tick of the scheduler, from the timer (or a test): steps the loops due
+void pidq_tick(void);
+
+#endif
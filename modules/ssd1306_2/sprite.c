@@ -0,0 +1,246 @@
+/*
+ * bhgv, sprite atlases of the oled
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "sprite.h"
+
+
+struct sprite_atlas {
+	char *name;
+	uint16_t n;
+	sprite_t *idx;
+
+	// pixels of all the sprites, from the file offset pix_off,
+	// NULL if they are read from the file at each draw
+	uint8_t *pix;
+	uint32_t pix_off;
+	uint32_t pix_len;
+
+	uint32_t used;
+};
+
+static struct sprite_atlas atlases[ SPRITE_CACHE_MAX ];
+static uint32_t cache_bytes = 0;
+static uint32_t use_cnt = 0;
+
+
+static uint32_t get_le(const uint8_t *p, int n){
+	uint32_t v = 0;
+
+	while(n-- > 0)
+		v = (v << 8) | p[n];
+	return v;
+}
+
+
+static void atlas_free(struct sprite_atlas *a){
+	if(a->pix != NULL){
+		free(a->pix);
+		cache_bytes -= a->pix_len;
+	}
+	free(a->idx);
+	free(a->name);
+	memset(a, 0, sizeof(struct sprite_atlas));
+}
+
+
+static struct sprite_atlas *atlas_lru(void){
+	struct sprite_atlas *lru = NULL;
+	int i;
+
+	for(i = 0; i < SPRITE_CACHE_MAX; i++){
+		if(atlases[i].name == NULL)
+			return &atlases[i];
+		if(lru == NULL || atlases[i].used < lru->used)
+			lru = &atlases[i];
+	}
+	atlas_free(lru);
+	return lru;
+}
+
+
+// Makes room for len bytes of pixels, dropping the pixels of the least used atlases
+static int cache_room(uint32_t len){
+	struct sprite_atlas *lru;
+	int i;
+
+	if(len > SPRITE_CACHE_BYTES)
+		return 0;
+
+	while(cache_bytes + len > SPRITE_CACHE_BYTES){
+		lru = NULL;
+		for(i = 0; i < SPRITE_CACHE_MAX; i++){
+			if(atlases[i].pix != NULL && (lru == NULL || atlases[i].used < lru->used))
+				lru = &atlases[i];
+		}
+		if(lru == NULL)
+			return 0;
+
+		free(lru->pix);
+		lru->pix = NULL;
+		cache_bytes -= lru->pix_len;
+	}
+	return 1;
+}
+
+
+static int atlas_load(struct sprite_atlas *a, const char *name){
+	uint8_t hdr[ SPRITE_ENTRY_LEN ];
+	uint32_t len, end, fsize;
+	FILE *f;
+	int i;
+
+	f = fopen(name, "r");
+	if(f == NULL)
+		return -ENOENT;
+
+	if(fread(hdr, 1, SPRITE_HDR_LEN, f) != SPRITE_HDR_LEN ||
+			memcmp(hdr, SPRITE_MAGIC, 4) != 0 || hdr[4] != SPRITE_VERSION)
+		goto bad;
+
+	a->n = get_le(hdr + 6, 2);
+	a->idx = malloc(a->n * sizeof(sprite_t));
+	if(a->n == 0 || a->idx == NULL)
+		goto bad;
+
+	fseek(f, 0, SEEK_END);
+	fsize = ftell(f);
+	fseek(f, SPRITE_HDR_LEN, SEEK_SET);
+
+	a->pix_off = fsize;
+	end = 0;
+	for(i = 0; i < a->n; i++){
+		if(fread(hdr, 1, SPRITE_ENTRY_LEN, f) != SPRITE_ENTRY_LEN)
+			goto bad;
+
+		a->idx[i].w = hdr[0];
+		a->idx[i].h = hdr[1];
+		a->idx[i].off = get_le(hdr + 4, 4);
+
+		len = a->idx[i].w * ((a->idx[i].h + 7) >> 3);
+		if(len == 0 || a->idx[i].off > fsize || len > fsize - a->idx[i].off)
+			goto bad;
+
+		if(a->idx[i].off < a->pix_off)
+			a->pix_off = a->idx[i].off;
+		if(a->idx[i].off + len > end)
+			end = a->idx[i].off + len;
+	}
+	a->pix_len = end - a->pix_off;
+
+	// small atlases stay in RAM, the others are read sprite by sprite
+	if(cache_room(a->pix_len)){
+		a->pix = malloc(a->pix_len);
+		if(a->pix != NULL){
+			fseek(f, a->pix_off, SEEK_SET);
+			if(fread(a->pix, 1, a->pix_len, f) != a->pix_len){
+				free(a->pix);
+				a->pix = NULL;
+				goto bad;
+			}
+			cache_bytes += a->pix_len;
+		}
+	}
+
+	a->name = strdup(name);
+	if(a->name == NULL)
+		goto bad;
+
+	fclose(f);
+	return 0;
+
+bad:
+	fclose(f);
+	atlas_free(a);
+	return -EINVAL;
+}
+
+
+sprite_atlas_t *sprite_atlas(const char *name){
+	struct sprite_atlas *a;
+	int i;
+
+	for(i = 0; i < SPRITE_CACHE_MAX; i++){
+		if(atlases[i].name != NULL && strcmp(atlases[i].name, name) == 0){
+			atlases[i].used = ++use_cnt;
+			return &atlases[i];
+		}
+	}
+
+	a = atlas_lru();
+	if(atlas_load(a, name) != 0)
+		return NULL;
+
+	a->used = ++use_cnt;
+	return a;
+}
+
+
+int sprite_count(sprite_atlas_t *a){
+	return a->n;
+}
+
+
+const sprite_t *sprite_get(sprite_atlas_t *a, int i){
+	if(i < 0 || i >= a->n)
+		return NULL;
+	return &a->idx[i];
+}
+
+
+int sprite_draw(sprite_atlas_t *a, int i, uint8_t *fb, int x, int y,
+                ssd1306_color_t fg, ssd1306_color_t bg){
+	const sprite_t *s = sprite_get(a, i);
+	uint8_t page[ 256 ];
+	FILE *f;
+	int p, h;
+
+	if(s == NULL)
+		return -EINVAL;
+
+	if(a->pix != NULL)
+		return ssd1306_draw_pages(0, fb, x, y, s->w, s->h, a->pix + s->off - a->pix_off, fg, bg);
+
+	// streamed: a page (8 rows) at a time
+	if(x + s->w <= 0 || y + s->h <= 0 || x >= 128 || y >= 64)
+		return 0;
+
+	f = fopen(a->name, "r");
+	if(f == NULL)
+		return -ENOENT;
+
+	fseek(f, s->off, SEEK_SET);
+	for(p = 0; p < s->h; p += 8){
+		if(fread(page, 1, s->w, f) != s->w){
+			fclose(f);
+			return -EIO;
+		}
+		h = s->h - p;
+		if(h > 8) h = 8;
+		ssd1306_draw_pages(0, fb, x, y + p, s->w, h, page, fg, bg);
+	}
+
+	fclose(f);
+	return 0;
+}
+
+
+void sprite_flush(void){
+	int i;
+
+	for(i = 0; i < SPRITE_CACHE_MAX; i++){
+		if(atlases[i].name != NULL)
+			atlas_free(&atlases[i]);
+	}
+}
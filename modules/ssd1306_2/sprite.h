@@ -0,0 +1,61 @@
+/*
+ * bhgv, sprite atlases of the oled
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _SSD1306_SPRITE_H_
+#define _SSD1306_SPRITE_H_
+
+#include <stdint.h>
+
+#include "ssd1306.h"
+
+/*
+ * An atlas file (.spr, made by tools/mkatlas from PBM or BMP pictures)
+ * holds the pictures in the layout of the SSD1306 RAM, so they are drawn
+ * a byte (8 rows of a column) at a time:
+ *
+ *   "OSPR", u8 version, u8 0, u16 count
+ *   count entries of u8 w, u8 h, u16 0, u32 offset of the pixels
+ *   the pixels: (h + 7) / 8 pages of w bytes, bit n of byte x of page p
+ *   is the pixel (x, p * 8 + n)
+ *
+ * Numbers are little endian.
+ */
+
+#define SPRITE_MAGIC        "OSPR"
+#define SPRITE_VERSION      1
+#define SPRITE_HDR_LEN      8
+#define SPRITE_ENTRY_LEN    8
+
+#define SPRITE_CACHE_MAX    4       // atlases kept open
+#define SPRITE_CACHE_BYTES  2048    // pixels kept in RAM, bigger atlases are read at each draw
+
+typedef struct {
+	uint8_t w, h;
+	uint32_t off;
+} sprite_t;
+
+typedef struct sprite_atlas sprite_atlas_t;
+
+// The atlas of a file, from the cache or loaded. NULL if it is not an atlas.
+sprite_atlas_t *sprite_atlas(const char *name);
+
+int sprite_count(sprite_atlas_t *a);
+
+// Sprite i (from 0) of the atlas, NULL if there is none
+const sprite_t *sprite_get(sprite_atlas_t *a, int i);
+
+// Draws sprite i into fb, not into the display. Non-zero if error occured.
+int sprite_draw(sprite_atlas_t *a, int i, uint8_t *fb, int x, int y,
+                ssd1306_color_t fg, ssd1306_color_t bg);
+
+// Forgets all the atlases
+void sprite_flush(void);
+
+#endif
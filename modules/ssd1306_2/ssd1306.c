@@ -7,7 +7,7 @@
  *
  * MIT Licensed as described in the file LICENSE
  *
- * @todo HW scrolling, sprites
+ * @todo HW scrolling
  */
 #include <stdio.h>
 //#if (SSD1306_SPI4_SUPPORT) || (SSD1306_SPI3_SUPPORT)
@@ -19,6 +19,8 @@
 
 #include <drivers/i2c-platform.h>
 
+#include <fonts/font_file.h>
+
 #include "ssd1306.h"
 
 #define SPI_BUS 0
@@ -93,6 +95,7 @@
 static int inline i2c_send(uint8_t addr, uint8_t reg, uint8_t* data, uint8_t len)
 {
 //	int i;
+	platform_i2c_lock(0);
 	uint8_t ot = i2c_master_set_delay_us(0);
 
 	platform_i2c_send_start(0);
@@ -109,6 +112,7 @@ static int inline i2c_send(uint8_t addr, uint8_t reg, uint8_t* data, uint8_t len
 	udelay(2);
 
 	i2c_master_set_delay_us(ot);
+	platform_i2c_unlock(0);
 	
     return 0; //i2c_slave_write(dev->i2c_dev.bus, dev->i2c_dev.addr , &reg, data, len);
 }
@@ -370,6 +374,24 @@ int ssd1306_load_frame_buffer(uint8_t addr, uint8_t buf[])
     return 0;
 }
 
+int ssd1306_load_pages(uint8_t addr, uint8_t buf[], uint8_t first, uint8_t last)
+{
+    uint16_t i;
+
+    if (last > 64 / 8 - 1)
+        last = 64 / 8 - 1;
+    if (first > last)
+        return 0;
+
+    ssd1306_set_column_addr(addr, 0, 128 - 1);
+    ssd1306_set_page_addr(addr, first, last);
+
+    for (i = first * 128; i < (last + 1) * 128; i += 16)
+        i2c_send(addr, 0x40, &buf[i], 16);
+
+    return 0;
+}
+
 int ssd1306_display_on(uint8_t addr, bool on)
 {
     return ssd1306_command(addr, on ? SSD1306_SET_DISPLAY_ON : SSD1306_SET_DISPLAY_OFF);
@@ -587,6 +609,77 @@ int ssd1306_load_xbm(uint8_t addr, int x, int y, int w, int h, uint8_t *xbm, uin
     return ssd1306_load_frame_buffer(addr, fb);
 }
 
+/* bits of a nibble in reverse order: the fb rows run bottom up */
+static const uint8_t rev_nibble[16] = {
+    0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+    0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf
+};
+
+static inline void blend_byte(uint8_t *d, uint8_t on, uint8_t off, ssd1306_color_t fg, ssd1306_color_t bg)
+{
+    switch (fg)
+    {
+    case OLED_COLOR_WHITE:  *d |= on; break;
+    case OLED_COLOR_BLACK:  *d &= ~on; break;
+    case OLED_COLOR_INVERT: *d ^= on; break;
+    default: break;
+    }
+    switch (bg)
+    {
+    case OLED_COLOR_WHITE:  *d |= off; break;
+    case OLED_COLOR_BLACK:  *d &= ~off; break;
+    case OLED_COLOR_INVERT: *d ^= off; break;
+    default: break;
+    }
+}
+
+/* one byte of pages - 8 rows for 1 column of picture, as in the display RAM.
+ * it lands on (at most) 2 bytes of fb, shifted by the row it starts at.
+ */
+int ssd1306_draw_pages(uint8_t addr, uint8_t *fb, int x, int y, int w, int h,
+                       const uint8_t *pages, ssd1306_color_t fg, ssd1306_color_t bg)
+{
+    int p, n, r, pg, sh, c, c0, c1;
+    uint8_t b, m, mr;
+    uint8_t *d0, *d1;
+
+    if (w <= 0 || h <= 0 || x + w <= 0 || y + h <= 0 || x >= 128 || y >= 64)
+        return 0;
+
+    c0 = x < 0 ? -x : 0;
+    c1 = x + w > 128 ? 128 - x : w;
+
+    for (p = 0; p < (h + 7) >> 3; p++) {
+        n = h - (p << 3);
+        if (n > 8) n = 8;
+        m = 0xff >> (8 - n);
+        mr = (rev_nibble[m & 15] << 4) | rev_nibble[m >> 4];
+
+        // fb row of bit 0 of the reversed byte, may be < 0
+        r = 56 - y - (p << 3);
+        pg = r >> 3;
+        sh = r & 7;
+        if (pg + 1 < 0 || pg > 7)
+            continue;
+
+        // The rows of fb the page lands in, if they are on the screen
+        d0 = pg >= 0 ? fb + pg * 128 : NULL;
+        d1 = sh && pg < 7 ? fb + (pg + 1) * 128 : NULL;
+
+        for (c = c0; c < c1; c++) {
+            b = pages[p * w + c];
+            b = ((rev_nibble[b & 15] << 4) | rev_nibble[b >> 4]) & mr;
+
+            if (d0)
+                blend_byte(d0 + 127 - x - c, b << sh, (mr & ~b) << sh, fg, bg);
+            if (d1)
+                blend_byte(d1 + 127 - x - c, b >> (8 - sh), (mr & ~b) >> (8 - sh), fg, bg);
+        }
+    }
+
+    return 0;
+}
+
 int ssd1306_draw_pixel(uint8_t addr, uint8_t *fb, int8_t x, int8_t y, ssd1306_color_t color)
 {
     uint16_t index;
@@ -1076,6 +1169,26 @@ int ssd1306_fill_triangle(uint8_t addr, uint8_t *fb, int16_t x0,
     return 0;
 }
 
+/* the glyphs of a font file are cached in the page layout already */
+static int draw_file_char(uint8_t addr, uint8_t *fb,
+    const font_info_t *font, uint8_t x, uint8_t y, uint32_t cp,
+    ssd1306_color_t foreground, ssd1306_color_t background)
+{
+    const uint8_t *pages;
+    uint8_t width;
+
+    if ((pages = font_file_glyph(font, cp, &width)) == NULL)
+        return 0;
+
+    if (background == OLED_COLOR_INVERT)
+        background = OLED_COLOR_TRANSPARENT;
+    ssd1306_draw_pages(addr, fb, x, y, width, font->height, pages, foreground, background);
+
+    if (x + width > 128 || y + font->height > 64)
+        return -ERANGE;
+    return width;
+}
+
 int ssd1306_draw_char(uint8_t addr, uint8_t *fb,
     const font_info_t *font, uint8_t x, uint8_t y, char c,
     ssd1306_color_t foreground, ssd1306_color_t background)
@@ -1088,6 +1201,9 @@ int ssd1306_draw_char(uint8_t addr, uint8_t *fb,
     if (font == NULL)
         return 0;
 
+    if (font->file)
+        return draw_file_char(addr, fb, font, x, y, (uint8_t)c, foreground, background);
+
     const font_char_desc_t *d = font_get_char_desc(font, c);
     if (d == NULL)
         return 0;
@@ -1133,6 +1249,21 @@ int ssd1306_draw_string(uint8_t addr, uint8_t *fb,
     if (font == NULL || str == NULL)
         return 0;
 
+    if (font->file)
+    {
+        const char *s = str;
+
+        while (*s)
+        {
+            if ((err = draw_file_char(addr, fb, font, x, y, font_utf8_next(&s), foreground, background)) < 0)
+                return err;
+            x += err;
+            if (*s)
+                x += font->c;
+        }
+        return x - t;
+    }
+
     while (*str)
     {
         if ((err = ssd1306_draw_char(addr, fb, font, x, y, *str, foreground, background)) < 0 )
@@ -140,6 +140,24 @@ int ssd1306_init(uint8_t addr);
  */
 int ssd1306_load_xbm(uint8_t addr, int x, int y, int w, int h, uint8_t *xbm, uint8_t *fb);
 
+/**
+ * Draw a picture stored in the display RAM layout into the framebuffer,
+ * without loading the framebuffer into the SSD1306 RAM.
+ * @param dev Pointer to device descriptor
+ * @param fb Pointer to framebuffer. Framebuffer size = width * height / 8
+ * @param x X coordinate of the top left corner, may be off the screen
+ * @param y Y coordinate of the top left corner, may be off the screen
+ * @param w Picture width
+ * @param h Picture height
+ * @param pages (h + 7) / 8 pages of w bytes, bit n of byte x of page p is
+ *     the pixel (x, p * 8 + n)
+ * @param fg Color of the set pixels
+ * @param bg Color of the clear pixels, OLED_COLOR_TRANSPARENT to keep the screen
+ * @return Non-zero if error occured
+ */
+int ssd1306_draw_pages(uint8_t addr, uint8_t *fb, int x, int y, int w, int h,
+                       const uint8_t *pages, ssd1306_color_t fg, ssd1306_color_t bg);
+
 /**
  * Load local framebuffer into the SSD1306 RAM.
  * @param dev Pointer to device descriptor
@@ -148,6 +166,16 @@ int ssd1306_load_xbm(uint8_t addr, int x, int y, int w, int h, uint8_t *xbm, uin
  */
 int ssd1306_load_frame_buffer(uint8_t addr, uint8_t buf[]);
 
+/**
+ * Load the pages first..last (8 rows each) of the local framebuffer into
+ * the SSD1306 RAM, the rest of the screen is kept.
+ * @param buf Pointer to framebuffer
+ * @param first First page, 0..7
+ * @param last Last page, 0..7
+ * @return Non-zero if error occured
+ */
+int ssd1306_load_pages(uint8_t addr, uint8_t buf[], uint8_t first, uint8_t last);
+
 /**
  * Clear SSD1306 RAM.
  * @param dev Pointer to device descriptor
@@ -485,7 +513,7 @@ int ssd1306_draw_char(uint8_t addr, uint8_t *fb, const font_info_t *font, uint8_
  * @param font Pointer to font info structure
  * @param x X position of character (top-left corner)
  * @param y Y position of character (top-left corner)
- * @param str The string to draw
+ * @param str The string to draw, UTF-8 with a font file
  * @param foreground Character color
  * @param background Background color
  * @return Width of the string  or negative value if error occured
@@ -0,0 +1,297 @@
+/*
+ * bhgv, makes the sprite atlases of the oled (see ../sprite.h) from PBM
+ * (P1, P4) and BMP (1, 4, 8, 24 and 32 bit, not compressed) pictures.
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ *
+ * cc -O2 -o mkatlas mkatlas.c
+ *
+ * mkatlas [-i] [-f WxH] atlas.spr picture ...
+ *
+ *   -i      inverts the following pictures
+ *   -f WxH  cuts the following pictures into frames of WxH, left to right
+ *           and top to bottom (an animation strip), -f 0x0 to stop cutting
+ *
+ * Sprites are numbered in the order of the pictures and frames, from 1 in
+ * oled.sprite(). The black pixels of a picture (PBM 1, dark BMP pixels)
+ * are the lit pixels of the oled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#define SPRITE_MAGIC        "OSPR"
+#define SPRITE_VERSION      1
+#define SPRITE_HDR_LEN      8
+#define SPRITE_ENTRY_LEN    8
+
+#define MAX_SPRITES         65535
+
+typedef struct {
+	int w, h;
+	uint8_t *px;    // w * h, 1 = lit
+} picture;
+
+typedef struct {
+	int w, h;
+	uint8_t *pages;
+	int len;
+} sprite;
+
+static sprite *sprites = NULL;
+static int n_sprites = 0;
+
+
+static void die(const char *msg, const char *name){
+	fprintf(stderr, "mkatlas: %s: %s\n", name, msg);
+	exit(1);
+}
+
+
+/* ---- PBM ---- */
+
+static int pbm_int(FILE *f){
+	int c, v = 0;
+
+	do{
+		c = fgetc(f);
+		if(c == '#'){
+			while(c != '\n' && c != EOF)
+				c = fgetc(f);
+		}
+	}while(isspace(c));
+
+	if(!isdigit(c))
+		return -1;
+	while(isdigit(c)){
+		v = v * 10 + c - '0';
+		c = fgetc(f);
+	}
+	return v;
+}
+
+static void read_pbm(FILE *f, const char *name, picture *pic){
+	int type, x, y, c;
+
+	fgetc(f);
+	type = fgetc(f);
+	pic->w = pbm_int(f);
+	pic->h = pbm_int(f);
+	if(pic->w <= 0 || pic->h <= 0)
+		die("bad PBM header", name);
+
+	pic->px = calloc(pic->w, pic->h);
+	for(y = 0; y < pic->h; y++){
+		if(type == '4'){
+			for(x = 0; x < pic->w; x += 8){
+				if((c = fgetc(f)) == EOF)
+					die("short PBM", name);
+				for(int b = 0; b < 8 && x + b < pic->w; b++)
+					pic->px[y * pic->w + x + b] = (c >> (7 - b)) & 1;
+			}
+		}else{
+			for(x = 0; x < pic->w; x++){
+				do{
+					c = fgetc(f);
+				}while(isspace(c));
+				if(c != '0' && c != '1')
+					die("short PBM", name);
+				pic->px[y * pic->w + x] = c == '1';
+			}
+		}
+	}
+}
+
+
+/* ---- BMP ---- */
+
+static uint32_t le(const uint8_t *p, int n){
+	uint32_t v = 0;
+
+	while(n-- > 0)
+		v = (v << 8) | p[n];
+	return v;
+}
+
+static void read_bmp(FILE *f, const char *name, picture *pic){
+	uint8_t hdr[54], pal[256 * 4], *row;
+	uint32_t data, bpp, comp, colors, stride;
+	int32_t h;
+	int x, y, ry, v;
+
+	rewind(f);
+	if(fread(hdr, 1, 54, f) != 54 || le(hdr + 14, 4) < 40)
+		die("bad BMP header", name);
+
+	data = le(hdr + 10, 4);
+	pic->w = (int32_t)le(hdr + 18, 4);
+	h = (int32_t)le(hdr + 22, 4);
+	bpp = le(hdr + 28, 2);
+	comp = le(hdr + 30, 4);
+	colors = le(hdr + 46, 4);
+
+	if(comp != 0 && !(comp == 3 && bpp == 32))
+		die("compressed BMP", name);
+	if(bpp != 1 && bpp != 4 && bpp != 8 && bpp != 24 && bpp != 32)
+		die("unsupported BMP depth", name);
+
+	pic->h = h < 0 ? -h : h;
+	if(pic->w <= 0 || pic->h == 0)
+		die("bad BMP size", name);
+
+	if(bpp <= 8){
+		if(colors == 0)
+			colors = 1 << bpp;
+		fseek(f, 14 + le(hdr + 14, 4), SEEK_SET);
+		if(colors > 256 || fread(pal, 4, colors, f) != colors)
+			die("bad BMP palette", name);
+	}
+
+	stride = ((pic->w * bpp + 31) / 32) * 4;
+	row = malloc(stride);
+	pic->px = calloc(pic->w, pic->h);
+
+	for(y = 0; y < pic->h; y++){
+		// rows are bottom up unless the height is negative
+		ry = h < 0 ? y : pic->h - 1 - y;
+		fseek(f, data + (long)ry * stride, SEEK_SET);
+		if(fread(row, 1, stride, f) != stride)
+			die("short BMP", name);
+
+		for(x = 0; x < pic->w; x++){
+			const uint8_t *c;
+			int i;
+
+			switch(bpp){
+			case 1:  i = (row[x >> 3] >> (7 - (x & 7))) & 1; c = pal + i * 4; break;
+			case 4:  i = (row[x >> 1] >> ((x & 1) ? 0 : 4)) & 15; c = pal + i * 4; break;
+			case 8:  c = pal + row[x] * 4; break;
+			case 24: c = row + x * 3; break;
+			default: c = row + x * 4; break;
+			}
+			// B, G, R: dark pixels are lit
+			v = (c[0] * 29 + c[1] * 150 + c[2] * 77) >> 8;
+			pic->px[y * pic->w + x] = v < 128;
+		}
+	}
+	free(row);
+}
+
+
+/* ---- atlas ---- */
+
+static void add_sprite(const picture *pic, int x0, int y0, int w, int h, int inv, const char *name){
+	sprite *s;
+	int x, y;
+
+	if(w > 255 || h > 255)
+		die("sprite bigger than 255x255", name);
+	if(n_sprites == MAX_SPRITES)
+		die("too many sprites", name);
+
+	sprites = realloc(sprites, (n_sprites + 1) * sizeof(sprite));
+	s = &sprites[n_sprites++];
+	s->w = w;
+	s->h = h;
+	s->len = w * ((h + 7) / 8);
+	s->pages = calloc(1, s->len);
+
+	for(y = 0; y < h; y++){
+		for(x = 0; x < w; x++){
+			if(pic->px[(y0 + y) * pic->w + x0 + x] ^ inv)
+				s->pages[(y >> 3) * w + x] |= 1 << (y & 7);
+		}
+	}
+}
+
+static void put_le(FILE *f, uint32_t v, int n){
+	while(n-- > 0){
+		fputc(v & 0xff, f);
+		v >>= 8;
+	}
+}
+
+int main(int argc, char **argv){
+	int i, x, y, inv = 0, fw = 0, fh = 0;
+	uint32_t off;
+	const char *out = NULL;
+	picture pic;
+	FILE *f;
+	char m[2];
+
+	for(i = 1; i < argc; i++){
+		if(strcmp(argv[i], "-i") == 0){
+			inv = 1;
+			continue;
+		}
+		if(strcmp(argv[i], "-f") == 0 && i + 1 < argc){
+			if(sscanf(argv[++i], "%dx%d", &fw, &fh) != 2 || fw < 0 || fh < 0)
+				die("frame size is WxH", argv[i]);
+			continue;
+		}
+		if(out == NULL){
+			out = argv[i];
+			continue;
+		}
+
+		f = fopen(argv[i], "rb");
+		if(f == NULL)
+			die("can't open", argv[i]);
+		if(fread(m, 1, 2, f) != 2)
+			die("empty file", argv[i]);
+		rewind(f);
+
+		if(m[0] == 'P' && (m[1] == '1' || m[1] == '4'))
+			read_pbm(f, argv[i], &pic);
+		else if(m[0] == 'B' && m[1] == 'M')
+			read_bmp(f, argv[i], &pic);
+		else
+			die("not a PBM (P1, P4) or BMP", argv[i]);
+		fclose(f);
+
+		if(fw == 0 || fh == 0){
+			add_sprite(&pic, 0, 0, pic.w, pic.h, inv, argv[i]);
+		}else{
+			for(y = 0; y + fh <= pic.h; y += fh)
+				for(x = 0; x + fw <= pic.w; x += fw)
+					add_sprite(&pic, x, y, fw, fh, inv, argv[i]);
+		}
+		free(pic.px);
+	}
+
+	if(out == NULL || n_sprites == 0){
+		fprintf(stderr, "mkatlas [-i] [-f WxH] atlas.spr picture ...\n");
+		return 1;
+	}
+
+	f = fopen(out, "wb");
+	if(f == NULL)
+		die("can't create", out);
+
+	fwrite(SPRITE_MAGIC, 1, 4, f);
+	fputc(SPRITE_VERSION, f);
+	fputc(0, f);
+	put_le(f, n_sprites, 2);
+
+	off = SPRITE_HDR_LEN + n_sprites * SPRITE_ENTRY_LEN;
+	for(i = 0; i < n_sprites; i++){
+		fputc(sprites[i].w, f);
+		fputc(sprites[i].h, f);
+		put_le(f, 0, 2);
+		put_le(f, off, 4);
+		off += sprites[i].len;
+	}
+	for(i = 0; i < n_sprites; i++)
+		fwrite(sprites[i].pages, 1, sprites[i].len, f);
+
+	fclose(f);
+	printf("%s: %d sprites, %u bytes\n", out, n_sprites, off);
+	return 0;
+}
@@ -49,6 +49,92 @@ static struct netbuf* nb_pool[NC_MAX];
 static int nc_pool_idx = 0;
 
 
+
+#if USE_TLS
+/*
+ * With a TLS listener (styxsettls) the clients have a TLS session over
+ * their socket, the 9P messages are read and written through it.
+ */
+typedef struct {
+	int fd;
+	tls_conn_t *tls;
+} TLSsock;
+
+static tls_server_t *tls_srv = NULL;
+static TLSsock tls_socks[NC_MAX];
+
+void
+styxsettls(tls_server_t *srv)
+{
+	tls_srv = srv;
+}
+
+static TLSsock*
+tls_find(int fd)
+{
+	int i;
+
+	for(i=0; i<NC_MAX; i++){
+		if(tls_socks[i].tls != NULL && tls_socks[i].fd == fd)
+			return &tls_socks[i];
+	}
+	return NULL;
+}
+
+static int
+tls_sock_send(void *ctx, const unsigned char *buf, size_t len)
+{
+	TLSsock *t = ctx;
+
+	return lwip_send(t->fd, buf, len, 0);
+}
+
+static int
+tls_sock_recv(void *ctx, unsigned char *buf, size_t len, uint32_t timeout)
+{
+	TLSsock *t = ctx;
+	struct timeval tv;
+	fd_set rfds;
+	int r;
+
+	FD_ZERO(&rfds);
+	FD_SET(t->fd, &rfds);
+	tv.tv_sec = timeout / 1000;
+	tv.tv_usec = (timeout % 1000) * 1000;
+
+	r = lwip_select(t->fd + 1, &rfds, NULL, NULL, timeout ? &tv : NULL);
+	if(r == 0)
+		return TLS_TIMEOUT;
+	if(r < 0)
+		return TLS_ERROR;
+
+	r = lwip_recv(t->fd, buf, len, 0);
+	return r < 0 ? TLS_ERROR : r;
+}
+
+static int
+tls_sock_accept(int fd)
+{
+	TLSsock *t = NULL;
+	int i;
+
+	for(i=0; i<NC_MAX; i++){
+		if(tls_socks[i].tls == NULL){
+			t = &tls_socks[i];
+			break;
+		}
+	}
+	if(t == NULL)
+		return -1;
+
+	t->fd = fd;
+	t->tls = tls_accept(tls_srv, t, tls_sock_send, tls_sock_recv);
+
+	return t->tls != NULL ? 0 : -1;
+}
+#endif
+
+
 int is_nc_pool_have_place(){
 DBG("%s: %d\n", __func__, __LINE__);
 	int i;
@@ -135,6 +221,13 @@ DBG("%s: %d\n", __func__, __LINE__);
 		nb_pool[i] = NULL;
 	}
 	nc_pool_idx = 0;
+
+#if USE_TLS
+	for(i=0; i<NC_MAX; i++){
+		tls_socks[i].fd = -1;
+		tls_socks[i].tls = NULL;
+	}
+#endif
 	
 	return 0;
 }
@@ -158,6 +251,15 @@ DBG("%s: %d\n", __func__, __LINE__);
 	}
 	del_from_nc_pool(fd);
 	*/
+#if USE_TLS
+	TLSsock *t = tls_find(fd);
+
+	if(t != NULL){
+		tls_close(t->tls);
+		t->tls = NULL;
+		t->fd = -1;
+	}
+#endif
 	lwip_close(fd);
 	
 }
@@ -243,6 +345,13 @@ DBG("%s: %d\n", __func__, __LINE__);
 		if(errno != EINTR)
 DBG("error in accept: %s\n", strerror(errno));
 	}
+#if USE_TLS
+	else if(tls_srv != NULL && tls_sock_accept(s) < 0){
+DBG("TLS handshake failed\n");
+		lwip_close(s);
+		s = -1;
+	}
+#endif
 	/*
 	if(!is_nc_pool_have_place()) return -1;
 
@@ -322,6 +431,14 @@ styxnewmsg(Styxserver *server, int s)
 	
 //	struct netbuf* nb = get_from_nb_pool(s);
 
+#if USE_TLS
+	/* decrypted already, select doesn't see it */
+	TLSsock *t = tls_find(s);
+
+	if(t != NULL && tls_pending(t->tls) > 0)
+		return 1;
+#endif
+
 	return /*(nb != NULL); */ FD_ISSET(s, &fs->r_infds) || FD_ISSET(s, &fs->r_excfds);
 }
 
@@ -402,6 +519,14 @@ DBG("%s: %d\n", __func__, __LINE__);
 		return 0;
 	}
 */
+#if USE_TLS
+	TLSsock *t = tls_find(fd);
+
+	if(t != NULL){
+		int r = tls_read(t->tls, buf, n, 0);
+		return r == TLS_CLOSED ? 0 : (r < 0 ? -1 : r);
+	}
+#endif
 	return lwip_recv(fd, buf, n, m);
 }
 
@@ -420,6 +545,12 @@ DBG("%s: %d fd=%d, buf=%x, l=%d\n", __func__, __LINE__, fd, buf, n);
 		return -1;
 	}
 */
+#if USE_TLS
+	TLSsock *t = tls_find(fd);
+
+	if(t != NULL)
+		return tls_write(t->tls, buf, n);
+#endif
 	int r = lwip_send(fd, buf, n, m);
 DBG("%s: %d fd = %d, ret = %d\n", __func__, __LINE__, fd, r);
 	return r; //lwip_send(fd, buf, n, m);
@@ -8,6 +8,13 @@
 //#define MSGMAX	((((8192+128)*2)+3) & ~3)
 #define MSGMAX	((((128+128)*2)+3) & ~3)
 
+#if USE_TLS
+#include "tls_server.h"
+
+/* clients accepted after this have a TLS session, nil for plain 9P */
+void styxsettls(tls_server_t *srv);
+#endif
+
 extern char Enomem[];	/* out of memory */
 extern char Eperm[];		/* permission denied */
 extern char Enodev[];	/* no free devices */
@@ -23,6 +23,10 @@
 
 #include "lstyx.h"
 
+#if USE_TLS
+#include "ltls.h"
+#endif
+
 
 
 
@@ -44,6 +48,12 @@ Styxserver *server = NULL;
 
 int is_styx_srv_run = 1;
 
+static int styx_port = 6701;
+
+#if USE_TLS
+static tls_server_t *styx_tls = NULL;
+#endif
+
 char* styx_cgi_reg = "styx_cgi";
 
 
@@ -525,7 +535,8 @@ LUA_API void* lua_tolfunction (lua_State *L, int idx) {
 
 int
 lstyx_add_file(lua_State* L){
-	int ln, i;
+	size_t ln;
+	int i;
 	int n = lua_gettop(L);
 	char *path = luaL_checklstring(L, 1, &ln);
 
@@ -605,7 +616,7 @@ DBG("%s: %d. type_nm = %s, l = %d\n", __func__, __LINE__, t_nm, t_ln);
 
 int
 lstyx_add_folder(lua_State* L){
-	int ln;
+	size_t ln;
 	char *path = luaL_checklstring(L, 1, &ln);
 
 	if(path == NULL || ln <= 0) return 0;
@@ -625,8 +636,40 @@ lstyx_stop(lua_State* L){
 	return 0;
 }
 	
+#if USE_TLS
+/* styx.tls{ identity = "id", psk = "key", ... } or styx.tls() for plain 9P */
+int
+lstyx_tls(lua_State* L){
+	tls_server_t *srv = NULL;
+	int port = 6701;
+
+	if(server != NULL)
+		return luaL_error(L, "styx is running");
+
+	if(!lua_isnoneornil(L, 1))
+		srv = ltls_new(L, 1, &port);
+
+	tls_server_free(styx_tls);
+	styx_tls = srv;
+	styx_port = port;
+
+	return 0;
+}
+
+int
+lstyx_tls_stats(lua_State* L){
+	if(styx_tls == NULL)
+		lua_pushnil(L);
+	else
+		ltls_push_stats(L, styx_tls);
+	return 1;
+}
+#endif
+
 int
 lstyx_loop(lua_State* L){
+	char port[8];
+
 	if(server != NULL){
 		free(server);
 	}
@@ -635,8 +678,12 @@ lstyx_loop(lua_State* L){
 	intL = L;
 	
 //	styxdebug();
-	
-	styxinit(server, &p9_root_ops, "6701", 0777, 0/*1*/);
+
+#if USE_TLS
+	styxsettls(styx_tls);
+#endif
+	snprintf(port, sizeof(port), "%d", styx_port);
+	styxinit(server, &p9_root_ops, port, 0777, 0/*1*/);
 	
 	myinit();
 
@@ -666,6 +713,10 @@ lstyx_loop(lua_State* L){
 const LUA_REG_TYPE styx_map[] = {
 		{ LSTRKEY( "loop" ),		LFUNCVAL( lstyx_loop ) },		
 		{ LSTRKEY( "stop" ),		LFUNCVAL( lstyx_stop ) },
+#if USE_TLS
+		{ LSTRKEY( "tls" ),			LFUNCVAL( lstyx_tls ) },
+		{ LSTRKEY( "tls_stats" ),	LFUNCVAL( lstyx_tls_stats ) },
+#endif
 		
 		{ LSTRKEY( "add_file" ),	LFUNCVAL( lstyx_add_file ) },
 		{ LSTRKEY( "add_dir" ),		LFUNCVAL( lstyx_add_folder ) },
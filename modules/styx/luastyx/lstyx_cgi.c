@@ -54,7 +54,8 @@ DBG("\n%s: %d\n%s\n\n", __func__, __LINE__, buf);
 //		lua_pushstring(intL, "Error!");
 	}
 
-	int m, l, j, i = lua_gettop(intL) - n;
+	size_t m, l;
+	int j, i = lua_gettop(intL) - n;
 
 	m = 0;
 	for(j = 0; j < i; j++){
@@ -62,7 +63,7 @@ DBG("\n%s: %d\n%s\n\n", __func__, __LINE__, buf);
 		m += l + 1;
 	}
 
-	char *tb = styxmalloc(l + 1);
+	char *tb = styxmalloc(m + 1);
 	tb[0] = '\0';
 	
 	m = 0;
@@ -163,7 +163,7 @@ call_virtual_foo(const TValue *foo, Qid *qid, char *buf, ulong *n, vlong off)
 DBG("%s: %d. i=%d, rn=%d, qid->my_buf = %x\n", __func__, __LINE__, i, rn, qid->my_buf);
 	l = 0;
 	for(i = ltop+1; i <= ltop + rn; i ++){
-		int il;
+		size_t il;
 //DBG("%s: %d. i=%d, vtype=%s, %s\n", __func__, __LINE__, i, 
 //								lua_typename(intL, lua_type(intL, i) ),
 //								lua_tostring(intL, i) );
@@ -181,7 +181,7 @@ DBG("%s: %d. i=%d, rn=%d, qid->my_buf = %x\n", __func__, __LINE__, i, rn, qid->m
 	qid->my_buf[ l ] = '\0';
 
 	for(i = ltop+1; i <= ltop + rn; i ++){
-		int il;
+		size_t il;
 		char *is;
 		is = lua_tolstring(intL, i, &il);
 	
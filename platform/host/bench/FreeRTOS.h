@@ -0,0 +1,58 @@
+/*
+ * bhgv, FreeRTOS of the benchmarks: what heap_4.c and delay.c need,
+ * the scheduler of delay.c is the one of clock_bench.c.
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <strings.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+// For the lwip/err.h of the host in the socket benchmark
+typedef int8_t s8_t;
+
+#define USE_CUSTOM_HEAP                     1
+
+// As the board, see FreeRTOS/Source/include/FreeRTOSConfig.h
+#ifndef configTOTAL_HEAP_SIZE
+#define configTOTAL_HEAP_SIZE               ((size_t)39 * 1024)
+#endif
+#define configAPPLICATION_ALLOCATED_HEAP    0
+#define configUSE_MALLOC_FAILED_HOOK        0
+#define configTICK_RATE_HZ                  100
+
+#define portBYTE_ALIGNMENT                  8
+#define portBYTE_ALIGNMENT_MASK             0x0007
+
+#define portTICK_PERIOD_US                  ((TickType_t)1000000 / configTICK_RATE_HZ)
+
+#define PRIVILEGED_FUNCTION
+#define configASSERT(x)
+#define mtCOVERAGE_TEST_MARKER()
+#define traceMALLOC(pvAddress, uiSize)
+#define traceFREE(pvAddress, uiSize)
+
+#define vTaskSuspendAll()
+#define xTaskResumeAll()                    pdFALSE
+#define pdFALSE                             0
+
+void *pvPortMalloc(size_t xSize);
+void vPortFree(void *pv);
+void *pvPortRealloc(void *pv, size_t size);
+size_t xPortGetFreeHeapSize(void);
+size_t xPortGetMinimumEverFreeHeapSize(void);
+size_t xPortGetLargestFreeBlockSize(void);
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * bhgv, host test and benchmark of the background acquisition
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Synthetic samples are given to acq_sample() of sys/drivers/acq.c as the
+ * sampler task gives them, and the blocks read back as adc.acq.read() and
+ * stats() do:
+ *
+ *   ramp     a ramp on the 5 channels, decim 1, read by 8
+ *   average  a noisy triangle on AIN0 and the ADC, average of 16, read by 32
+ *   last     the same, last of 16
+ *   overrun  a ring of 16 read by 12 every 40 blocks, the gaps are found
+ *   wrap     100000 blocks, past the 16 bits of the block numbers
+ *
+ * For each it checks the values, the minimum and the maximum of the
+ * blocks, their numbers and the overruns against the samples, then prints
+ * the time of a sample and of a block read.
+ *
+ *   acq_bench [-n samples] [-r runs]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sys/drivers/acq.h"
+
+typedef struct {
+	const char *name;
+	uint8_t channels;
+	uint8_t mode;
+	uint16_t decim;
+	uint16_t ring;
+	int batch;      // blocks read at once
+	int every;      // blocks made between two reads
+} test_t;
+
+static const test_t tests[] = {
+	{"ramp",    0x1f, ACQ_LAST,    1,  64,  8,  8},
+	{"average", 0x11, ACQ_AVERAGE, 16, 64,  32, 32},
+	{"last",    0x11, ACQ_LAST,    16, 64,  32, 32},
+	{"overrun", 0x01, ACQ_AVERAGE, 4,  16,  12, 40},
+	{"wrap",    0x01, ACQ_LAST,    1,  256, 64, 64},
+};
+
+#define N_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+static int fails = 0;
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static uint32_t rnd(uint32_t *s) {
+	*s = *s * 1103515245 + 12345;
+	return (*s >> 16) & 0x7fff;
+}
+
+static void check(const char *test, const char *what, double got, double want, double tol) {
+	if ((got < want - tol) || (got > want + tol)) {
+		printf("%-8s FAIL %s: %.3f, %.3f expected\n", test, what, got, want);
+		fails++;
+	}
+}
+
+// Sample i of channel ch, in the range of the channel
+static uint16_t value(int k, int ch, int i, uint32_t *seed) {
+	int full = (ch == ACQ_INT) ? 1023 : 255;
+	int v;
+
+	if (k == 0) {
+		return (i + ch * 7) % (full + 1);
+	}
+
+	// A triangle of 200 samples with +-3 of noise
+	v = (i % 200 < 100 ? i % 200 : 200 - i % 200) * full / 100;
+	v += (int)(rnd(seed) % 7) - 3;
+	return (v < 0) ? 0 : ((v > full) ? full : v);
+}
+
+// Gives n samples to test k, returns the time of a sample, in ns
+static double run(int k, int n, double *read_ns) {
+	const test_t *t = &tests[k];
+	acq_config_t cfg = {1000, t->decim, t->ring, t->mode, t->channels};
+	acq_chan_stats_t cs;
+	acq_stats_t st;
+	acq_block_t b[64];
+	uint16_t *hist[ACQ_CHANNELS], v[ACQ_CHANNELS];
+	uint32_t seed = 1, seq, next[ACQ_CHANNELS];
+	int blocks = n / t->decim;
+	int i, j, ch, r, nread[ACQ_CHANNELS], bad = 0, gaps = 0, lost = 0;
+	double tm, tr = 0, tsum;
+
+	if (acq_start(&cfg)) {
+		printf("%-8s FAIL acq_start\n", t->name);
+		fails++;
+		return -1;
+	}
+
+	for (ch = 0; ch < ACQ_CHANNELS; ch++) {
+		hist[ch] = malloc(n * sizeof(uint16_t));
+		nread[ch] = 0;
+		next[ch] = 0;
+	}
+
+	for (i = 0; i < n; i++) {
+		for (ch = 0; ch < ACQ_CHANNELS; ch++) {
+			v[ch] = hist[ch][i] = value(k, ch, i, &seed);
+		}
+
+		acq_sample(v);
+
+		if (((i + 1) % t->decim) || (((i + 1) / t->decim) % t->every)) {
+			continue;
+		}
+
+		for (ch = 0; ch < ACQ_CHANNELS; ch++) {
+			if (!(t->channels & (1 << ch))) {
+				continue;
+			}
+
+			// As adc.acq.read(ch, batch): what follows, then stops at a gap
+			tm = now_ms();
+			r = acq_read(ch, b, t->batch, &seq, 0);
+			tr += now_ms() - tm;
+
+			if ((r > 0) && (seq != next[ch])) {
+				gaps++;
+				lost += seq - next[ch];
+			}
+
+			for (j = 0; j < r; j++) {
+				const uint16_t *s = &hist[ch][(seq + j) * t->decim];
+				uint32_t sum = 0;
+				uint16_t mn = 0xffff, mx = 0;
+				int m;
+
+				for (m = 0; m < t->decim; m++) {
+					sum += s[m];
+					mn = (s[m] < mn) ? s[m] : mn;
+					mx = (s[m] > mx) ? s[m] : mx;
+				}
+
+				bad += b[j].min != mn;
+				bad += b[j].max != mx;
+				if (t->mode == ACQ_AVERAGE) {
+					bad += b[j].value != (sum + t->decim / 2) / t->decim;
+				} else {
+					bad += b[j].value != s[t->decim - 1];
+				}
+			}
+
+			nread[ch] += r;
+			if (r > 0) {
+				next[ch] = seq + r;
+			}
+
+			// A read after one ended at a gap must not skip it
+			if ((r > 0) && (r < t->batch) && (acq_read(ch, b, 1, &seq, 1) != 0)) {
+				bad++;
+			}
+		}
+	}
+
+	acq_get_stats(&st, 0);
+	check(t->name, "samples", st.samples, n, 0);
+	check(t->name, "blocks", bad, 0, 0);
+
+	for (ch = 0; ch < ACQ_CHANNELS; ch++) {
+		if (!(t->channels & (1 << ch))) {
+			check(t->name, "not sampled", acq_chan_stats(ch, &cs), -1, 0);
+			continue;
+		}
+
+		acq_chan_stats(ch, &cs);
+		check(t->name, "made", cs.blocks, blocks, 0);
+		check(t->name, "kept", nread[ch] + cs.pending + cs.overruns, blocks, 0);
+		check(t->name, "last", acq_last(ch), hist[ch][n - 1], 0);
+		check(t->name, "full", cs.full, (ch == ACQ_INT) ? 1023 : 255, 0);
+
+		if (k == 3) {
+			// 40 blocks made, 16 kept, 12 read each time
+			check(t->name, "overruns", cs.overruns, blocks - nread[ch] - cs.pending, 0);
+			check(t->name, "overruns > 0", cs.overruns > 0, 1, 0);
+		} else {
+			check(t->name, "overruns", cs.overruns, 0, 0);
+		}
+	}
+
+	if (k == 3) {
+		check(t->name, "gaps found", gaps > 0, 1, 0);
+		check(t->name, "lost in gaps", lost <= blocks, 1, 0);
+	} else {
+		check(t->name, "gaps", gaps, 0, 0);
+	}
+
+	acq_stop();
+	check(t->name, "stopped", acq_channels(), 0, 0);
+	check(t->name, "no read", acq_read(0, b, 1, &seq, 0), -1, 0);
+
+	// The sampler alone, on full rings as with no reader
+	acq_start(&cfg);
+	tm = now_ms();
+	for (i = 0; i < n; i++) {
+		for (ch = 0; ch < ACQ_CHANNELS; ch++) {
+			v[ch] = hist[ch][i];
+		}
+		acq_sample(v);
+	}
+	tsum = now_ms() - tm;
+	acq_stop();
+
+	for (ch = 0; ch < ACQ_CHANNELS; ch++) {
+		free(hist[ch]);
+	}
+
+	for (r = 0, ch = 0; ch < ACQ_CHANNELS; ch++) {
+		r += nread[ch];
+	}
+
+	*read_ns = r ? tr * 1000000.0 / r : 0;
+	return tsum * 1000000.0 / n;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n samples] [-r runs]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int samples = 200000, runs = 3;
+	int i, k, c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+			case 'n': samples = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if ((samples < 10000) || (runs < 1)) {
+		usage(argv[0]);
+	}
+
+	// The configurations
+	{
+		acq_config_t cfg = {1000, 1, 0, ACQ_LAST, 0x01};
+
+		cfg.rate = 0;
+		check("start", "bad rate", acq_start(&cfg) != 0, 1, 0);
+		cfg.rate = ACQ_RATE_MAX + 1;
+		check("start", "bad rate", acq_start(&cfg) != 0, 1, 0);
+		cfg.rate = 1000;
+		cfg.decim = 0;
+		check("start", "bad decim", acq_start(&cfg) != 0, 1, 0);
+		cfg.decim = 1;
+		cfg.channels = 1 << ACQ_CHANNELS;
+		check("start", "bad channel", acq_start(&cfg) != 0, 1, 0);
+		cfg.channels = 0x01;
+		cfg.ring = ACQ_RING_MAX + 1;
+		check("start", "bad ring", acq_start(&cfg) != 0, 1, 0);
+		cfg.ring = 0;
+		check("start", "start", acq_start(&cfg), 0, 0);
+		check("start", "no sample yet", acq_last(0), -1, 0);
+		acq_stop();
+	}
+
+	printf("%-8s %8s %10s %10s\n", "test", "samples", "sample ns", "read ns");
+
+	for (k = 0; k < N_TESTS; k++) {
+		double t, best = -1, rd, best_rd = 0;
+		int n = (k == 4) ? 100000 + samples % 1000 : samples;
+
+		for (i = 0; i < runs; i++) {
+			t = run(k, n, &rd);
+			if ((t >= 0) && ((best < 0) || (t < best))) {
+				best = t;
+				best_rd = rd;
+			}
+		}
+
+		printf("%-8s %8d %10.1f %10.1f\n", tests[k].name, n, best, best_rd);
+	}
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
@@ -0,0 +1,352 @@
+/*
+ * bhgv, host benchmark of the Lua allocators on the FreeRTOS heap
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Runs Lua workloads in a heap_4 heap of configTOTAL_HEAP_SIZE bytes (39 KB
+ * as the board) with each allocator:
+ *
+ *   copy     l_alloc on the former pvPortRealloc: allocate, copy, free
+ *   inplace  l_alloc on pvPortRealloc, which grows into the free block
+ *            that follows and gives back the tail of a shrunk block
+ *   pool     luaP_alloc (Lua/src/lpool.c) on pvPortRealloc
+ *
+ * For every workload and allocator it finds the biggest size N the
+ * workload runs with before "not enough memory", then runs them all with
+ * the same N and reports the time, the calls of the allocator, the blocks
+ * moved by a resize and the bytes copied, and the free heap, its largest
+ * block and their ratio once the workload is done and collected.
+ *
+ * Every run is a child process, so it starts on an empty heap.
+ *
+ *   alloc_bench [-w workload] [-a allocator] [-n N] [-r runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "FreeRTOS.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lpool.h"
+
+#define N_MAX       65536
+#define RUN_TIMEOUT 20      // seconds
+
+typedef struct {
+	const char *name;
+	const char *src;
+} workload_t;
+
+typedef struct {
+	const char *name;
+	lua_Alloc alloc;
+} allocator_t;
+
+typedef struct {
+	int ok;
+	double ms;
+	size_t calls;
+	size_t moves;
+	size_t copied;
+	size_t free;
+	size_t largest;
+	size_t min_free;
+} result_t;
+
+static size_t calls, moves, copied;
+
+// The compiler of the base library (luac.c), not used by the workloads
+int luac(const char *src, const char *dst) {
+	return -1;
+}
+
+static const workload_t workloads[] = {
+	// A live set of N small objects replaced at random, with a 1 KB
+	// string now and then, which needs a hole that big
+	{"objects",
+		"local live, seed = {}, 1\n"
+		"local function rnd(n) seed = (seed * 75 + 74) % 65537 return seed % n end\n"
+		"for i = 1, 20000 do\n"
+		"  local k, v = rnd(N) + 1, rnd(5)\n"
+		"  if v == 0 then live[k] = 's' .. i .. ('x'):rep(rnd(24))\n"
+		"  elseif v == 1 then live[k] = {i, i}\n"
+		"  elseif v == 2 then live[k] = {x = i, y = i}\n"
+		"  elseif v == 3 then local u = i live[k] = function() return u end\n"
+		"  else live[k] = nil end\n"
+		"  if i % 64 == 0 then local big = ('b'):rep(1024) end\n"
+		"end\n"},
+
+	// A text of N lines, with table.concat and with ..
+	{"strings",
+		"for r = 1, 4 do\n"
+		"  local t = {}\n"
+		"  for i = 1, N do t[#t + 1] = 'line ' .. i .. '\\n' end\n"
+		"  local s = table.concat(t)\n"
+		"  local u = ''\n"
+		"  for i = 1, N // 8 do u = u .. i end\n"
+		"  assert(#s > #u)\n"
+		"end\n"},
+
+	// Arrays and hashes grown to N entries, then half of the hash dropped
+	{"tables",
+		"for r = 1, 4 do\n"
+		"  local a, h, keep = {}, {}, {}\n"
+		"  for i = 1, N do a[i] = i h['k' .. i] = i end\n"
+		"  for i = 1, N, 2 do h['k' .. i] = nil end\n"
+		"  collectgarbage('step')\n"
+		"  for k in pairs(h) do keep[#keep + 1] = k end\n"
+		"end\n"},
+};
+
+#define N_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+
+static void count_move(void *ptr, void *nptr, size_t osize, size_t nsize) {
+	if (ptr && nptr && nptr != ptr) {
+		moves++;
+		copied += (osize < nsize) ? osize : nsize;
+	}
+}
+
+// pvPortRealloc before it worked in place
+static void *alloc_copy(void *ud, void *ptr, size_t osize, size_t nsize) {
+	void *nptr;
+
+	calls++;
+	if (nsize == 0) {
+		vPortFree(ptr);
+		return NULL;
+	}
+	if (ptr == NULL) {
+		return pvPortMalloc(nsize);
+	}
+
+	nptr = pvPortMalloc(nsize);
+	if (!nptr) {
+		// Lua takes it for granted that a shrink does not fail
+		return (nsize < osize) ? ptr : NULL;
+	}
+	memcpy(nptr, ptr, (osize < nsize) ? osize : nsize);
+	vPortFree(ptr);
+	count_move(ptr, nptr, osize, nsize);
+	return nptr;
+}
+
+static void *alloc_inplace(void *ud, void *ptr, size_t osize, size_t nsize) {
+	void *nptr;
+
+	calls++;
+	if (nsize == 0) {
+		vPortFree(ptr);
+		return NULL;
+	}
+
+	nptr = pvPortRealloc(ptr, nsize);
+	count_move(ptr, nptr, osize, nsize);
+	return nptr;
+}
+
+static void *alloc_pool(void *ud, void *ptr, size_t osize, size_t nsize) {
+	void *nptr;
+
+	calls++;
+	nptr = luaP_alloc(ud, ptr, osize, nsize);
+	if (nsize) {
+		count_move(ptr, nptr, osize, nsize);
+	}
+	return nptr;
+}
+
+static const allocator_t allocators[] = {
+	{"copy", alloc_copy},
+	{"inplace", alloc_inplace},
+	{"pool", alloc_pool},
+};
+
+#define N_ALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void run(const workload_t *w, const allocator_t *a, int n, result_t *r) {
+	lua_State *L;
+	double t;
+
+	memset(r, 0, sizeof(result_t));
+
+	L = lua_newstate(a->alloc, NULL);
+	if (!L) {
+		return;
+	}
+
+	luaL_requiref(L, "_G", luaopen_base, 1);
+	luaL_requiref(L, LUA_STRLIBNAME, luaopen_string, 1);
+	luaL_requiref(L, LUA_TABLIBNAME, luaopen_table, 1);
+	lua_settop(L, 0);
+
+	lua_pushinteger(L, n);
+	lua_setglobal(L, "N");
+
+	calls = moves = copied = 0;
+
+	t = now_ms();
+	r->ok = (luaL_loadstring(L, w->src) == LUA_OK) && (lua_pcall(L, 0, 0, 0) == LUA_OK);
+	r->ms = now_ms() - t;
+
+	r->calls = calls;
+	r->moves = moves;
+	r->copied = copied;
+
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	r->free = xPortGetFreeHeapSize();
+	r->largest = xPortGetLargestFreeBlockSize();
+	r->min_free = xPortGetMinimumEverFreeHeapSize();
+
+	lua_close(L);
+}
+
+// Runs in a child, the heap of the parent stays untouched
+static int run_child(const workload_t *w, const allocator_t *a, int n, result_t *r) {
+	static result_t *shared = NULL;
+	pid_t pid;
+	int status;
+
+	if (!shared) {
+		shared = mmap(NULL, sizeof(result_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (shared == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+	}
+
+	memset(shared, 0, sizeof(result_t));
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		// A run that hangs counts as failed
+		alarm(RUN_TIMEOUT);
+		run(w, a, n, shared);
+		_exit(0);
+	}
+
+	waitpid(pid, &status, 0);
+	*r = *shared;
+	return WIFEXITED(status) && r->ok;
+}
+
+static int capacity(const workload_t *w, const allocator_t *a) {
+	result_t r;
+	int lo = 0, hi = N_MAX, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (run_child(w, a, mid, &r)) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return lo;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-w workload] [-a allocator] [-n N] [-r runs]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *wname = NULL, *aname = NULL;
+	int cap[N_ALLOCATORS];
+	int i, j, k, c, n = 0, runs = 5;
+	result_t r, best;
+
+	while ((c = getopt(argc, argv, "w:a:n:r:")) != -1) {
+		switch (c) {
+			case 'w': wname = optarg; break;
+			case 'a': aname = optarg; break;
+			case 'n': n = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	printf("heap %u bytes, pools of %d bytes up to %d byte blocks\n\n",
+		(unsigned)configTOTAL_HEAP_SIZE, LUAI_POOLPAGE, LUAI_POOLMAX);
+	printf("%-8s %-8s %6s %6s %8s %8s %7s %9s %6s %7s %5s\n",
+		"workload", "alloc", "max N", "N", "ms", "calls", "moves", "copied", "free", "largest", "frag");
+
+	for (i = 0; i < N_WORKLOADS; i++) {
+		const workload_t *w = &workloads[i];
+		int wn = n;
+
+		if (wname && strcmp(wname, w->name)) {
+			continue;
+		}
+
+		// The sizes that fit, the runs are made with the smallest of them
+		for (j = 0; j < N_ALLOCATORS; j++) {
+			cap[j] = 0;
+			if (aname && strcmp(aname, allocators[j].name)) {
+				continue;
+			}
+			cap[j] = capacity(w, &allocators[j]);
+			if (!n && (!wn || cap[j] < wn)) {
+				wn = cap[j];
+			}
+		}
+
+		for (j = 0; j < N_ALLOCATORS; j++) {
+			const allocator_t *a = &allocators[j];
+
+			if (aname && strcmp(aname, a->name)) {
+				continue;
+			}
+
+			memset(&best, 0, sizeof(result_t));
+			for (k = 0; k < runs; k++) {
+				if (!run_child(w, a, wn, &r)) {
+					break;
+				}
+				if (!best.ok || r.ms < best.ms) {
+					best = r;
+				}
+			}
+
+			if (!best.ok) {
+				printf("%-8s %-8s %6d %6d %8s\n", w->name, a->name, cap[j], wn, "fails");
+				continue;
+			}
+
+			printf("%-8s %-8s %6d %6d %8.2f %8zu %7zu %9zu %6zu %7zu %4zu%%\n",
+				w->name, a->name, cap[j], wn, best.ms, best.calls, best.moves, best.copied,
+				best.free, best.largest,
+				(best.free && best.largest < best.free) ? 100 - best.largest * 100 / best.free : 0);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * bhgv, host test and benchmark of the GPIO edge capture
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Synthetic edge streams are given to capture_edge() of
+ * sys/drivers/capture.c as the ISR gives them, with the cycle counter of
+ * an 80 MHz CPU, and read back as pio.capture.read() and stats() do:
+ *
+ *   square  1 kHz, rising edges, +-1 us of jitter, read by 50
+ *   pwm     500 Hz at 25 %, both edges, read by 16
+ *   burst   1000 edges at 100 kHz in a ring of 64, read at the end
+ *   wrap    10 kHz across the wrap of the cycle counter
+ *   flow    a pulse counter from 20 to 400 Hz, counted and reset
+ *
+ * For each it checks the count, the lost edges, the intervals read and the
+ * figures against the stream, then prints the time of an edge in the ISR
+ * and of an edge read.
+ *
+ *   capture_bench [-n edges] [-r runs]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sys/drivers/capture.h"
+
+#define CC_PER_US 80
+#define PIN       4
+
+typedef struct {
+	const char *name;
+	int edges;      // CAPTURE_xxx
+	int ring;
+	int batch;      // edges read at once, 0 at the end only
+	uint32_t start; // cycle counter at the first edge
+} stream_t;
+
+static const stream_t streams[] = {
+	{"square", CAPTURE_RISING, 64,   50, 1000},
+	{"pwm",    CAPTURE_BOTH,   64,   16, 1000},
+	{"burst",  CAPTURE_RISING, 64,    0, 1000},
+	{"wrap",   CAPTURE_RISING, 256,  32, 0xffffffffu - 500 * CC_PER_US * 100},
+	{"flow",   CAPTURE_FALLING, 64,  64, 1000},
+};
+
+#define N_STREAMS (sizeof(streams) / sizeof(streams[0]))
+
+static int fails = 0;
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static uint32_t rnd(uint32_t *s) {
+	*s = *s * 1103515245 + 12345;
+	return (*s >> 16) & 0x7fff;
+}
+
+// The cycles from edge i to edge i + 1 of the stream, and the level after i
+static uint32_t next_edge(int k, int i, uint32_t *seed, int *level) {
+	switch (k) {
+		case 0: // 1 kHz +- 1 us
+			*level = 1;
+			return 1000 * CC_PER_US + (int)(rnd(seed) % 161) - 80;
+		case 1: // 500 Hz, 500 us high, 1500 us low
+			*level = (i & 1) == 0;
+			return (*level ? 500 : 1500) * CC_PER_US;
+		case 2: // 100 kHz
+			*level = 1;
+			return 10 * CC_PER_US;
+		case 3: // 10 kHz
+			*level = 1;
+			return 100 * CC_PER_US;
+		default: // 20 Hz to 400 Hz and back, each ms of period for 20 edges
+			*level = 0;
+			return (50 - ((i / 20) % 95 < 48 ? (i / 20) % 95 : 95 - (i / 20) % 95)) * 1000 * CC_PER_US;
+	}
+}
+
+static void check(const char *stream, const char *what, double got, double want, double tol) {
+	if ((got < want - tol) || (got > want + tol)) {
+		printf("%-7s FAIL %s: %.3f, %.3f expected\n", stream, what, got, want);
+		fails++;
+	}
+}
+
+// Gives n edges of stream k, returns the time of an edge in the ISR, in ns
+static double run(int k, int n, double *read_ns) {
+	const stream_t *s = &streams[k];
+	capture_t *c;
+	capture_stats_t st;
+	uint32_t *given, *ccs, dt[64], seed = 1, cc = s->start, prev = 0, count;
+	uint8_t lv[64];
+	double t, tr = 0, tsum = 0;
+	int i, j, r, level, nread = 0, bad = 0, lvl_bad = 0;
+	uint8_t *levels;
+
+	given = malloc(n * sizeof(uint32_t));
+	ccs = malloc(n * sizeof(uint32_t));
+	levels = malloc(n);
+
+	if (capture_start(PIN, s->edges, s->ring)) {
+		printf("%-7s FAIL capture_start\n", s->name);
+		fails++;
+		return -1;
+	}
+	c = capture_channel(PIN);
+	c->start = c->prev = s->start;
+
+	for (i = 0; i < n; i++) {
+		uint32_t d = next_edge(k, i, &seed, &level);
+
+		given[i] = cc - (i ? prev : s->start);
+		ccs[i] = cc;
+		levels[i] = level;
+		prev = cc;
+
+		capture_edge(c, cc, level);
+
+		cc += d;
+
+		if (s->batch && ((i + 1) % s->batch == 0)) {
+			t = now_ms();
+			r = capture_read(PIN, dt, lv, s->batch);
+			tr += now_ms() - t;
+			for (j = 0; j < r; j++, nread++) {
+				// the bit 0 of the counter holds the level
+				bad += (dt[j] > given[nread] + 1) || (dt[j] + 1 < given[nread]);
+				lvl_bad += lv[j] != levels[nread];
+			}
+		}
+	}
+
+	while ((r = capture_read(PIN, dt, lv, 64)) > 0) {
+		for (j = 0; j < r; j++, nread++) {
+			bad += (dt[j] > given[nread] + 1) || (dt[j] + 1 < given[nread]);
+			lvl_bad += lv[j] != levels[nread];
+		}
+	}
+
+	capture_stats(PIN, &st, 0);
+
+	check(s->name, "count", st.count, n, 0);
+	check(s->name, "intervals", bad, 0, 0);
+	check(s->name, "levels", lvl_bad, 0, 0);
+
+	switch (k) {
+		case 0:
+			check(s->name, "lost", st.lost, 0, 0);
+			check(s->name, "freq", st.freq_mhz / 1000.0, 1000, 0.05);
+			check(s->name, "period_min", st.period_min, 999, 0);
+			check(s->name, "period_max", st.period_max, 1001, 0);
+			break;
+		case 1:
+			check(s->name, "lost", st.lost, 0, 0);
+			check(s->name, "freq", st.freq_mhz / 1000.0, 500, 0.01);
+			check(s->name, "duty", st.duty, 250, 1);
+			break;
+		case 2:
+			check(s->name, "lost", st.lost, n - s->ring, 0);
+			check(s->name, "read", nread, s->ring, 0);
+			check(s->name, "freq", st.freq_mhz / 1000.0, 100000, 1);
+			break;
+		case 3:
+			check(s->name, "lost", st.lost, 0, 0);
+			check(s->name, "period", st.period, 100, 0);
+			check(s->name, "period_max", st.period_max, 100, 0);
+			break;
+		default:
+			check(s->name, "period_min", st.period_min, 3000, 0);
+			check(s->name, "period_max", st.period_max, 50000, 0);
+			capture_count(PIN, &count, 1);
+			check(s->name, "count", count, n, 0);
+			capture_count(PIN, &count, 0);
+			check(s->name, "count after reset", count, 0, 0);
+			break;
+	}
+
+	capture_stats(PIN, &st, 1);
+	capture_stats(PIN, &st, 0);
+	check(s->name, "periods after reset", st.periods, 0, 0);
+
+	capture_stop(PIN);
+	check(s->name, "stopped", capture_channel(PIN) != NULL, 0, 0);
+
+	// The ISR alone, on a full ring as with no reader
+	capture_start(PIN, s->edges, s->ring);
+	c = capture_channel(PIN);
+	t = now_ms();
+	for (i = 0; i < n; i++) {
+		capture_edge(c, ccs[i], levels[i]);
+	}
+	tsum = now_ms() - t;
+	capture_stop(PIN);
+
+	free(given);
+	free(ccs);
+	free(levels);
+
+	*read_ns = nread ? tr * 1000000.0 / nread : 0;
+	return tsum * 1000000.0 / n;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n edges] [-r runs]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int edges = 20000, runs = 3;
+	int i, k, c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+			case 'n': edges = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if ((edges < 1000) || (runs < 1)) {
+		usage(argv[0]);
+	}
+
+	// The pin and the channels
+	check("start", "bad pin", capture_start(16, CAPTURE_RISING, 0) != 0, 1, 0);
+	check("start", "bad size", capture_start(PIN, CAPTURE_RISING, CAPTURE_RING_MAX + 1) != 0, 1, 0);
+	for (i = 0; i < CAPTURE_MAX; i++) {
+		check("start", "channel", capture_start(i, CAPTURE_BOTH, 8), 0, 0);
+	}
+	check("start", "no channel", capture_start(CAPTURE_MAX, CAPTURE_BOTH, 8) != 0, 1, 0);
+	for (i = 0; i < CAPTURE_MAX; i++) {
+		capture_stop(i);
+	}
+
+	printf("%-7s %8s %10s %10s\n", "stream", "edges", "isr ns", "read ns");
+
+	for (k = 0; k < N_STREAMS; k++) {
+		double t, best = -1, rd, best_rd = 0;
+
+		for (i = 0; i < runs; i++) {
+			t = run(k, edges, &rd);
+			if ((t >= 0) && ((best < 0) || (t < best))) {
+				best = t;
+				best_rd = rd;
+			}
+		}
+
+		printf("%-7s %8d %10.1f %10.1f\n", streams[k].name, edges, best, best_rd);
+	}
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
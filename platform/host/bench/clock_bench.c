@@ -0,0 +1,293 @@
+/*
+ * bhgv, host test of the microsecond clock and of the delays
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The clock_us_from() of sys/drivers/clock.c and the delays of
+ * sys/platform/esp8266/delay.c, on a simulated CPU: the cycle counter is
+ * 32 bits and wraps every 53.7 s at 80 MHz, the tick hook runs late and
+ * vTaskDelay() wakes the task on a tick, or later when another task keeps
+ * the CPU.
+ *
+ *   from      clock_us_from() across the wraparound of the cycle counter
+ *             and with a late tick hook
+ *   clock     the clock doesn't go backwards and is at most the hook
+ *             latency behind
+ *   spin      delays in an ISR or before the scheduler runs, that spin
+ *   block     delays of up to 3 s in a task, that block in vTaskDelay()
+ *   preempt   the same, the task woken up to 3 ticks late, often past the
+ *             end of the delay
+ *
+ * A delay doesn't end before its time, less the clock latency, and not
+ * after its time more than the latency, the spin granularity and, when
+ * preempted, the time the task was kept from running.
+ *
+ *   clock_bench [-n delays] [-s seed]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "sys/delay.h"
+#include "sys/drivers/clock.h"
+
+#define US_PER_TICK     (1000000 / configTICK_RATE_HZ)
+#define CCOUNT_PER_US   (CPU_HZ / 1000000)
+
+#include "sys/drivers/clock_us.inc"
+
+#define CCOUNT_PER_TICK ((uint64_t)US_PER_TICK * CCOUNT_PER_US)
+
+// Of the tick hook after the tick, in cycles
+#define LATENCY_MAX     800
+
+// Cycles of a turn of the spin loop
+#define SPIN_STEP       160
+
+// A task of higher priority keeps the CPU up to that many ticks
+#define PREEMPT_MAX     3
+
+// Delays end that early or late at most, in us
+#define EARLY_US        (LATENCY_MAX / CCOUNT_PER_US + 1)
+#define LATE_US         (EARLY_US + SPIN_STEP / CCOUNT_PER_US + 1)
+
+int bench_in_isr = 0;
+
+static BaseType_t scheduler = taskSCHEDULER_RUNNING;
+static int preempt = 0;
+
+static uint64_t cycles;             // Since boot, the counter is its low 32 bits
+static uint64_t last_us;            // Last clock_monotonic_us()
+static uint64_t end_us;             // Of the delay running
+static uint64_t max_ticks;          // vTaskDelay() of more is a bug
+static uint64_t late_cycles;        // Kept from running by preemption
+static uint32_t seed = 1;
+
+// For the summary of the test
+static uint64_t spun_cycles, total_cycles;
+static unsigned int blocks, wakes_past_end;
+
+static int fails = 0;
+
+static uint32_t rnd(uint32_t *s) {
+	*s = *s * 1103515245 + 12345;
+	return (*s >> 16) & 0x7fff;
+}
+
+static void check(const char *test, const char *what, int64_t got, int64_t min, int64_t max) {
+	if ((got < min) || (got > max)) {
+		printf("%-8s FAIL %s: %lld, %lld .. %lld expected\n", test, what,
+			(long long)got, (long long)min, (long long)max);
+		fails++;
+	}
+}
+
+// Latency of the hook of tick k, the same each time it's asked
+static uint32_t latency(uint64_t k) {
+	uint32_t s = (uint32_t)k ^ 0x5bd1e995;
+
+	rnd(&s);
+	return rnd(&s) % (LATENCY_MAX + 1);
+}
+
+// The last tick whose hook has run
+static uint64_t ticks_seen(void) {
+	uint64_t k = cycles / CCOUNT_PER_TICK;
+
+	while ((k > 0) && (k * CCOUNT_PER_TICK + latency(k) > cycles)) {
+		k--;
+	}
+
+	return k;
+}
+
+unsigned int _read_core_timer(void) {
+	cycles += SPIN_STEP;
+	spun_cycles += SPIN_STEP;
+	return (uint32_t)cycles;
+}
+
+// As clock.c does, the tick count and the cycle counter taken by the hook
+uint64_t clock_monotonic_us(void) {
+	uint64_t k = ticks_seen();
+	uint32_t tick_ccount = (uint32_t)(k * CCOUNT_PER_TICK + latency(k));
+	uint64_t us = clock_us_from(k, tick_ccount, (uint32_t)cycles);
+
+	check("clock", "backwards", us, last_us, INT64_MAX);
+	check("clock", "behind", cycles / CCOUNT_PER_US - us, 0, EARLY_US);
+
+	last_us = us;
+	return us;
+}
+
+BaseType_t xTaskGetSchedulerState(void) {
+	return scheduler;
+}
+
+// Wakes on the tick xTicksToDelay after this one, as FreeRTOS
+void vTaskDelay(const TickType_t xTicksToDelay) {
+	uint64_t k = ticks_seen() + xTicksToDelay;
+	uint64_t late = 0;
+
+	// Asked on a wrapped end - now, the task would sleep for days
+	if ((xTicksToDelay == 0) || (xTicksToDelay > max_ticks)) {
+		printf("%-8s FAIL vTaskDelay(%u) in a delay of %llu ticks at most\n", "block",
+			(unsigned int)xTicksToDelay, (unsigned long long)max_ticks);
+		exit(1);
+	}
+
+	if (preempt && (rnd(&seed) % 4 == 0)) {
+		late = rnd(&seed) * (PREEMPT_MAX * CCOUNT_PER_TICK) / 0x7fff;
+	}
+
+	cycles = k * CCOUNT_PER_TICK + latency(k) + late;
+	late_cycles += late;
+	blocks++;
+
+	if (cycles / CCOUNT_PER_US > end_us + EARLY_US) {
+		wakes_past_end++;
+	}
+}
+
+static void from(void) {
+	const uint64_t t = 1234567;
+
+	check("from", "at the tick", clock_us_from(t, 0x12345678, 0x12345678), t * US_PER_TICK, t * US_PER_TICK);
+	check("from", "wrap", clock_us_from(t, 0xffffff00, 0x00000100), t * US_PER_TICK + 6, t * US_PER_TICK + 6);
+	check("from", "wrap to 0", clock_us_from(t, 0xffffffb0, 0), t * US_PER_TICK + 1, t * US_PER_TICK + 1);
+	check("from", "last us", clock_us_from(t, 0xfffff000, (uint32_t)(0xfffff000 + CCOUNT_PER_TICK - 1)),
+		(t + 1) * US_PER_TICK - 1, (t + 1) * US_PER_TICK - 1);
+	check("from", "late hook", clock_us_from(t, 0, 3 * CCOUNT_PER_TICK),
+		(t + 1) * US_PER_TICK - 1, (t + 1) * US_PER_TICK - 1);
+	check("from", "late hook, wrap", clock_us_from(t, 0xfff00000, (uint32_t)(0xfff00000 + 2 * CCOUNT_PER_TICK)),
+		(t + 1) * US_PER_TICK - 1, (t + 1) * US_PER_TICK - 1);
+}
+
+// Reads the clock across some wraparounds of the cycle counter
+static void monotonic(void) {
+	uint64_t end;
+
+	cycles = ((uint64_t)1 << 32) - 5 * CCOUNT_PER_TICK;
+	last_us = 0;
+	end = cycles + ((uint64_t)3 << 32);
+
+	while (cycles < end) {
+		clock_monotonic_us();
+		cycles += rnd(&seed) * 8;
+	}
+}
+
+static uint64_t rnd64(uint64_t max) {
+	uint64_t r = ((uint64_t)rnd(&seed) << 30) | ((uint64_t)rnd(&seed) << 15) | rnd(&seed);
+
+	return r % (max + 1);
+}
+
+// One delay of usec from now, with delay() when it is whole ms
+static void one(const char *test, uint64_t usec) {
+	uint64_t start = cycles, elapsed, late;
+
+	last_us = 0;
+	end_us = clock_monotonic_us() + usec;
+	max_ticks = usec / US_PER_TICK;
+	late_cycles = 0;
+
+	if ((usec % 1000 == 0) && (usec <= UINT32_MAX)) {
+		delay(usec / 1000);
+	} else {
+		udelay(usec);
+	}
+
+	elapsed = (cycles - start) / CCOUNT_PER_US;
+	late = late_cycles / CCOUNT_PER_US;
+
+	check(test, "elapsed us", elapsed, (int64_t)usec - EARLY_US, usec + LATE_US + late);
+	total_cycles += cycles - start;
+}
+
+static void summary(const char *test, int n) {
+	printf("%-8s %8d %10.1f%% %10u %10u\n", test, n, 100.0 * spun_cycles / total_cycles,
+		blocks, wakes_past_end);
+	spun_cycles = total_cycles = 0;
+	blocks = wakes_past_end = 0;
+}
+
+static void spin(int n) {
+	static const uint64_t fixed[] = {0, 1, 2, 999, US_PER_TICK - 1, US_PER_TICK, 1000000, 2500000};
+	int i;
+
+	bench_in_isr = 1;
+	for (i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+		one("spin", fixed[i]);
+	}
+	bench_in_isr = 0;
+
+	scheduler = taskSCHEDULER_NOT_STARTED;
+	for (i = 0; i < n; i++) {
+		one("spin", rnd64(3 * US_PER_TICK));
+	}
+	scheduler = taskSCHEDULER_RUNNING;
+
+	check("spin", "vTaskDelay calls", blocks, 0, 0);
+	summary("spin", n + sizeof(fixed) / sizeof(fixed[0]));
+}
+
+// Delays from anywhere in the first years of the board
+static void block(const char *test, int n) {
+	int i;
+
+	preempt = (test[0] == 'p');
+	for (i = 0; i < n; i++) {
+		cycles = rnd64((uint64_t)1 << 52);
+		one(test, rnd64(3000000));
+	}
+	preempt = 0;
+
+	if (test[0] == 'p') {
+		check(test, "wakes past the end", wakes_past_end, 1, n);
+	}
+
+	summary(test, n);
+}
+
+int main(int argc, char *argv[]) {
+	int n = 10000;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+			case 'n': n = atoi(optarg); break;
+			case 's': seed = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n delays] [-s seed]\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	if (n < 100) {
+		fprintf(stderr, "usage: %s [-n delays] [-s seed]\n", argv[0]);
+		exit(1);
+	}
+
+	from();
+	monotonic();
+
+	printf("%-8s %8s %11s %10s %10s\n", "test", "delays", "spun", "blocks", "past end");
+	spin(n / 10);
+	block("block", n);
+	block("preempt", n);
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * bhgv, host test and benchmark of the piece table of the editor
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * sys/edit.c without its screen: a file of 1 MB is opened, edited at random
+ * by insert() and erase() and the text checked against a flat copy, then
+ * saved and reopened:
+ *
+ *   edit      random inserts (and typing, that extends the last piece)
+ *             and erases all over the file
+ *   save      the saved file is the text, the editor starts over from it
+ *   spiffs    rename() fails on an existing file as on SPIFFS, the original
+ *             is moved aside while the new copy takes its name
+ *   fail      the renames fail, or the one of the new copy after the
+ *             original was moved aside: the file on disk is the one saved
+ *             before and the editor still has all the text
+ *
+ *   edit_bench [-n edits] [-s seed]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// edit.c as on the board, not as the Linux console editor it came from
+#undef __linux__
+
+#define CONSOLE_UART 1
+
+int uart_read(int unit, char *c, int timeout);
+
+#include "sys/edit.c"
+
+#define FILE_SIZE       (1024 * 1024)
+#define FILE_NAME       "build/edit/big.txt"
+
+static unsigned char *ref;          // The text as it should be
+static int reflen, refsize;
+
+static unsigned char *buf;          // Text read back
+
+static uint32_t seed = 1;
+
+// rename() of the test, see __wrap_rename
+static int spiffs = 0;
+static int rename_calls;
+static unsigned int rename_fail;    // Calls that fail, a bit each
+
+static int fails = 0;
+
+int __real_rename(const char *oldpath, const char *newpath);
+
+int __wrap_rename(const char *oldpath, const char *newpath) {
+	int call = rename_calls++;
+
+	if ((call < 32) && (rename_fail & (1u << call))) {
+		errno = EIO;
+		return -1;
+	}
+
+	if (spiffs && (access(newpath, F_OK) == 0)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	return __real_rename(oldpath, newpath);
+}
+
+int uart_read(int unit, char *c, int timeout) {
+	return 0;
+}
+
+void console_size(int *rows, int *cols) {
+	*rows = 24;
+	*cols = 80;
+}
+
+static uint32_t rnd(uint32_t *s) {
+	*s = *s * 1103515245 + 12345;
+	return (*s >> 16) & 0x7fff;
+}
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void check(const char *test, const char *what, int ok) {
+	if (!ok) {
+		printf("%-8s FAIL %s\n", test, what);
+		fails++;
+	}
+}
+
+// The whole text of the editor is ref
+static int same_text(struct editor *ed) {
+	int pos, n;
+
+	if (ed->length != reflen) {
+		return 0;
+	}
+
+	for (pos = 0; pos < reflen; pos += n) {
+		n = copy(ed, buf, pos, 4096);
+		if ((n <= 0) || memcmp(buf, ref + pos, n)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+// The file is data
+static int same_file(const char *name, const unsigned char *data, int len) {
+	FILE *f = fopen(name, "rb");
+	int pos = 0, n;
+
+	if (!f) {
+		return 0;
+	}
+
+	while ((n = fread(buf, 1, 4096, f)) > 0) {
+		if ((pos + n > len) || memcmp(buf, data + pos, n)) {
+			break;
+		}
+		pos += n;
+	}
+	fclose(f);
+
+	return (n == 0) && (pos == len);
+}
+
+static int exists(const char *name) {
+	return access(name, F_OK) == 0;
+}
+
+static void make_file(void) {
+	FILE *f;
+	int n;
+
+	reflen = 0;
+	while (reflen < FILE_SIZE) {
+		n = snprintf((char *)ref + reflen, refsize - reflen, "line %d of the file, some text %u\n",
+			reflen, rnd(&seed));
+		reflen += n;
+	}
+
+	mkdir("build/edit", 0755);
+	f = fopen(FILE_NAME, "wb");
+	fwrite(ref, 1, reflen, f);
+	fclose(f);
+}
+
+// Random edits, with the same on ref
+static void edits(struct editor *ed, const char *test, int n) {
+	unsigned char text[64];
+	int typed = -1;
+	int i, k, pos, len;
+
+	for (i = 0; i < n; i++) {
+		switch (rnd(&seed) % 4) {
+			case 0:
+				// Typing after the last insert
+				if (typed < 0) {
+					typed = rnd(&seed) * (reflen + 1) / 0x8000;
+				}
+				pos = typed;
+				len = 1;
+				text[0] = 'a' + rnd(&seed) % 26;
+				break;
+
+			case 1: case 2:
+				pos = rnd(&seed) * (reflen + 1) / 0x8000;
+				len = 1 + rnd(&seed) % 16;
+				for (k = 0; k < len; k++) {
+					text[k] = 'A' + rnd(&seed) % 26;
+				}
+				break;
+
+			default:
+				pos = rnd(&seed) * reflen / 0x8000;
+				len = 1 + rnd(&seed) % 64;
+				if (len > reflen - pos) {
+					len = reflen - pos;
+				}
+
+				erase(ed, pos, len);
+				memmove(ref + pos, ref + pos + len, reflen - pos - len);
+				reflen -= len;
+				typed = -1;
+				continue;
+		}
+
+		insert(ed, pos, text, len);
+		memmove(ref + pos + len, ref + pos, reflen - pos);
+		memcpy(ref + pos, text, len);
+		reflen += len;
+		typed = pos + len;
+
+		// Around the edit
+		pos = (pos > 32) ? pos - 32 : 0;
+		k = copy(ed, buf, pos, 128);
+		if ((k != ((reflen - pos < 128) ? reflen - pos : 128)) || memcmp(buf, ref + pos, k)) {
+			check(test, "text around the edit", 0);
+			return;
+		}
+	}
+
+	check(test, "length", ed->length == reflen);
+	check(test, "text", same_text(ed));
+}
+
+static void save(struct editor *ed, const char *test, int ok) {
+	rename_calls = 0;
+	check(test, ok ? "save" : "save fails", (save_file(ed) == 0) == ok);
+	rename_fail = 0;
+
+	check(test, "no ~~ file", !exists(FILE_NAME "~~"));
+	if (ok) {
+		check(test, "saved file", same_file(FILE_NAME, ref, reflen));
+		check(test, "no ~ file", !exists(FILE_NAME "~"));
+		check(test, "reopened", (ed->npieces == 1) && (ed->addlen == 0) && !ed->dirty);
+	}
+	check(test, "text after save", same_text(ed));
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n edits] [-s seed]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	struct env env;
+	struct editor *ed;
+	unsigned char *saved;
+	int savedlen;
+	double t0, t_edit, t_save;
+	int n = 20000;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+			case 'n': n = atoi(optarg); break;
+			case 's': seed = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if (n < 1) {
+		usage(argv[0]);
+	}
+
+	refsize = FILE_SIZE + 64 * 1024 + 16 * n;
+	ref = malloc(refsize);
+	saved = malloc(refsize);
+	buf = malloc(4096);
+	make_file();
+
+	memset(&env, 0, sizeof(env));
+	env.cols = 80;
+	env.lines = 24;
+	ed = create_editor(&env);
+	check("open", "load", load_file(ed, FILE_NAME) == 0);
+	check("open", "length", ed->length == reflen);
+
+	t0 = now_ms();
+	edits(ed, "edit", n);
+	t_edit = now_ms() - t0;
+
+	printf("%-8s %8s %8s %8s %10s\n", "test", "edits", "pieces", "added", "ms");
+	printf("%-8s %8d %8d %8d %10.1f\n", "edit", n, ed->npieces, ed->addlen, t_edit);
+
+	t0 = now_ms();
+	save(ed, "save", 1);
+	t_save = now_ms() - t0;
+	printf("%-8s %8s %8d %8d %10.1f\n", "save", "", ed->npieces, ed->addlen, t_save);
+
+	spiffs = 1;
+	edits(ed, "spiffs", n / 10);
+	save(ed, "spiffs", 1);
+
+	// Keep the saved text, the file must stay so
+	memcpy(saved, ref, reflen);
+	savedlen = reflen;
+
+	// No rename works
+	spiffs = 0;
+	edits(ed, "fail", n / 10);
+	rename_fail = ~0;
+	save(ed, "fail", 0);
+
+	check("fail", "file of the last save", same_file(FILE_NAME, saved, savedlen));
+
+	// SPIFFS, the original moved aside but the new copy not renamed
+	spiffs = 1;
+	rename_fail = 1 << 2;
+	save(ed, "fail", 0);
+	check("fail", "file of the last save", same_file(FILE_NAME, saved, savedlen));
+
+	save(ed, "fail", 1);
+
+	delete_editor(ed);
+	unlink(FILE_NAME);
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
@@ -0,0 +1,391 @@
+/*
+ * bhgv, host test and benchmark of the font files
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The font files of modules/fonts/tools/mkfont.py, read by
+ * modules/fonts/font_file.c, against the fonts built in:
+ *
+ *   glyphs    every character of every font built in, from its file made
+ *             with --charset latin_1 (code point = byte): same width, same
+ *             pixels in the page layout
+ *   measure   font_measure_string() of both
+ *   lru       a cache of 4 slots: its hits, misses and evictions
+ *   utf8      font_utf8_next() on valid, invalid and overlong sequences
+ *   koi8      font_get() loads TERMINUS_8X14_KOI8_R from its file (built
+ *             with FONTS_...=2), U+0416 is the byte 0xF6 of the header
+ *   roboto    the space the roboto headers lack
+ *   open      missing and truncated files
+ *
+ * Then the glyphs per second from the cache and from the file, and the
+ * sizes of the fonts built in and of their files.
+ *
+ *   font_bench [-n glyphs] [-r runs]
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modules/fonts/fonts.h"
+#include "modules/fonts/font_file.h"
+
+// The reference of the font of a file, not built in by the Makefile
+#include "modules/fonts/data/font_terminus_8x14_koi8_r.h"
+
+// The files with code point = byte, see the Makefile
+#define BYTES_DIR FONT_FILE_DIR "bytes/"
+
+static int fails = 0;
+static volatile uint32_t sink;
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void check(const char *test, const char *what, double got, double want, double tol) {
+	if ((got < want - tol) || (got > want + tol)) {
+		printf("%-8s FAIL %s: %.4f, %.4f expected\n", test, what, got, want);
+		fails++;
+	}
+}
+
+static long file_size(const char *path) {
+	FILE *f = fopen(path, "rb");
+	long n;
+
+	if (f == NULL)
+		return -1;
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	fclose(f);
+	return n;
+}
+
+static font_info_t *open_bytes(int face, size_t cache) {
+	char path[128];
+	int err;
+
+	snprintf(path, sizeof(path), BYTES_DIR "%s.fnt", font_names[face]);
+	return font_file_open(path, cache, &err);
+}
+
+// Pixels of the character c of a font built in that differ from the glyph
+static int diff_glyph(const font_info_t *ref, uint8_t c, const uint8_t *pages, uint8_t width) {
+	const font_char_desc_t *d = ref->char_descriptors + (c - (uint8_t)ref->char_start);
+	const uint8_t *bitmap = ref->bitmap + d->offset;
+	int bw = (d->width + 7) / 8;
+	int i, j, a, b, n = 0;
+
+	if (width != d->width)
+		return -1;
+
+	for (j = 0; j < ref->height; j++) {
+		for (i = 0; i < d->width; i++) {
+			a = (bitmap[bw * j + i / 8] >> (7 - (i & 7))) & 1;
+			b = (pages[(j >> 3) * width + i] >> (j & 7)) & 1;
+			n += a != b;
+		}
+	}
+	return n;
+}
+
+static void glyphs() {
+	const font_info_t *ref;
+	const uint8_t *pages;
+	font_info_t *fnt;
+	uint8_t width;
+	int face, c, bad, chars;
+
+	for (face = 0; face < font_builtin_fonts_count; face++) {
+		ref = font_builtin_fonts[face];
+		// the roboto headers are shifted by a field, see mkfont.py
+		if (ref == NULL || face == FONT_FACE_ROBOTO_10PT)
+			continue;
+
+		if ((fnt = open_bytes(face, 0)) == NULL) {
+			check(font_names[face], "open", 0, 1, 0);
+			continue;
+		}
+		check(font_names[face], "height", fnt->height, ref->height, 0);
+		check(font_names[face], "c", fnt->c, ref->c, 0);
+
+		bad = chars = 0;
+		for (c = (uint8_t)ref->char_start; c <= (uint8_t)ref->char_end; c++) {
+			pages = font_file_glyph(fnt, c, &width);
+			bad += pages == NULL || diff_glyph(ref, c, pages, width) != 0;
+			chars++;
+		}
+		check(font_names[face], "glyphs", bad, 0, 0);
+
+		check(font_names[face], "measure",
+			font_measure_string(fnt, "The quick brown fox, 0123456789!"),
+			font_measure_string(ref, "The quick brown fox, 0123456789!"), 0);
+
+		printf("%-30s %4d chars %s\n", font_names[face], chars, bad ? "differ" : "same");
+		font_file_close(fnt);
+	}
+}
+
+static void lru() {
+	font_file_stats_t st;
+	const uint8_t *pages;
+	const font_info_t *ref = font_builtin_fonts[FONT_FACE_TERMINUS_16X32_ISO8859_1];
+	font_info_t *fnt = open_bytes(FONT_FACE_TERMINUS_16X32_ISO8859_1, 4 * 16 * 4);
+	const char *s = "ABCDAEAB";
+	uint8_t width;
+
+	if (fnt == NULL) {
+		check("lru", "open", 0, 1, 0);
+		return;
+	}
+
+	font_file_get_stats(fnt, &st, 1);
+	check("lru", "slots", st.slots, 4, 0);
+
+	// A B C D: misses, A: hit, E: B out, A: hit, B: C out
+	for (; *s; s++) {
+		pages = font_file_glyph(fnt, *s, &width);
+		check("lru", "glyph", pages && diff_glyph(ref, *s, pages, width) == 0, 1, 0);
+	}
+
+	font_file_get_stats(fnt, &st, 1);
+	check("lru", "hits", st.hits, 2, 0);
+	check("lru", "misses", st.misses, 6, 0);
+	check("lru", "evictions", st.evictions, 2, 0);
+
+	// D is in, C is not
+	font_file_glyph(fnt, 'D', &width);
+	font_file_glyph(fnt, 'C', &width);
+	font_file_get_stats(fnt, &st, 0);
+	check("lru", "D hit", st.hits, 1, 0);
+	check("lru", "C miss", st.misses, 1, 0);
+
+	font_file_close(fnt);
+}
+
+static void utf8() {
+	static const struct {
+		const char *s;
+		uint32_t cp[4];
+	} t[] = {
+		{"A",                {'A'}},
+		{"\xc3\xa9",         {0xe9}},
+		{"\xd0\x96",         {0x416}},
+		{"\xe2\x82\xac",     {0x20ac}},
+		{"\xf0\x9f\x98\x80", {0x1f600}},
+		{"\xc3(",            {0xc3, '('}},          // not continued
+		{"\xc0\x80",         {0xc0, 0x80}},         // overlong
+		{"\xe9t\xe9",        {0xe9, 't', 0xe9}},    // Latin-1
+		{"\xf4\x90\x80\x80", {0xf4, 0x90, 0x80, 0x80}}, // > U+10FFFF
+	};
+	const char *s;
+	int i, k, bad;
+
+	for (i = 0; i < sizeof(t) / sizeof(t[0]); i++) {
+		s = t[i].s;
+		bad = 0;
+		for (k = 0; *s; k++)
+			bad += k >= 4 || font_utf8_next(&s) != t[i].cp[k];
+		bad += k < 4 && t[i].cp[k] != 0;
+		check("utf8", t[i].s, bad, 0, 0);
+	}
+}
+
+static void koi8() {
+	const font_info_t *ref = &_fonts_terminus_8x14_koi8_r_info;
+	const font_info_t *fnt = font_get(FONT_FACE_TERMINUS_8X14_KOI8_R);
+	const uint8_t *pages;
+	uint8_t width;
+
+	if (fnt == NULL || fnt->file == NULL) {
+		check("koi8", "file", 0, 1, 0);
+		return;
+	}
+	check("koi8", "kept", font_get(FONT_FACE_TERMINUS_8X14_KOI8_R) == fnt, 1, 0);
+
+	pages = font_file_glyph(fnt, 0x416, &width);
+	check("koi8", "U+0416", pages && diff_glyph(ref, 0xf6, pages, width) == 0, 1, 0);
+	pages = font_file_glyph(fnt, 0x44f, &width);
+	check("koi8", "U+044F", pages && diff_glyph(ref, 0xd1, pages, width) == 0, 1, 0);
+	pages = font_file_glyph(fnt, 'A', &width);
+	check("koi8", "A", pages && diff_glyph(ref, 'A', pages, width) == 0, 1, 0);
+
+	check("koi8", "U+4E00", font_file_glyph(fnt, 0x4e00, &width) == NULL, 1, 0);
+	check("koi8", "width U+4E00", font_file_width(fnt, 0x4e00), -1, 0);
+
+	// Жук
+	check("koi8", "measure", font_measure_string(fnt, "\xd0\x96\xd1\x83\xd0\xba"),
+		font_measure_string(ref, "\xf6\xd5\xcb"), 0);
+}
+
+static void roboto() {
+	const font_info_t *fnt = font_get(FONT_FACE_ROBOTO_8PT);
+
+	if (fnt == NULL || fnt->file == NULL) {
+		check("roboto", "file", 0, 1, 0);
+		return;
+	}
+	check("roboto", "space", font_file_width(fnt, ' ') > 0, 1, 0);
+	check("roboto", "A", font_file_width(fnt, 'A') > 0, 1, 0);
+	check("roboto", "~", font_file_width(fnt, '~') > 0, 1, 0);
+}
+
+static void open_files() {
+	char path[128], buf[256];
+	FILE *f;
+	size_t n;
+	int err;
+
+	check("open", "missing", font_file_open(FONT_FILE_DIR "none.fnt", 0, &err) == NULL, 1, 0);
+	check("open", "ENOENT", err, ENOENT, 0);
+
+	// The header and a part of the ranges
+	snprintf(path, sizeof(path), BYTES_DIR "%s.fnt", font_names[FONT_FACE_GLCD5x7]);
+	if ((f = fopen(path, "rb")) == NULL) {
+		check("open", "glcd", 0, 1, 0);
+		return;
+	}
+	n = fread(buf, 1, 20, f);
+	fclose(f);
+
+	f = fopen(FONT_FILE_DIR "short.fnt", "wb");
+	fwrite(buf, 1, n, f);
+	fclose(f);
+	check("open", "short", font_file_open(FONT_FILE_DIR "short.fnt", 0, &err) == NULL, 1, 0);
+	check("open", "EINVAL", err, EINVAL, 0);
+
+	buf[4] = FONT_FILE_VERSION + 1;
+	f = fopen(FONT_FILE_DIR "short.fnt", "wb");
+	fwrite(buf, 1, n, f);
+	fclose(f);
+	check("open", "version", font_file_open(FONT_FILE_DIR "short.fnt", 0, &err) == NULL, 1, 0);
+	unlink(FONT_FILE_DIR "short.fnt");
+}
+
+// Glyphs per second of the text, from a cache holding all of it or not
+static double bench(int n, size_t cache, uint32_t *misses) {
+	static const char text[] = "Lorem ipsum dolor sit amet, consectetur adipiscing elit 0123456789";
+	font_info_t *fnt = open_bytes(FONT_FACE_TERMINUS_16X32_ISO8859_1, cache);
+	font_file_stats_t st;
+	const uint8_t *pages;
+	uint32_t sum = 0;
+	uint8_t width;
+	double tm;
+	int i;
+
+	if (fnt == NULL)
+		return 0;
+
+	tm = now_ms();
+	for (i = 0; i < n; i++) {
+		pages = font_file_glyph(fnt, (uint8_t)text[i % (sizeof(text) - 1)], &width);
+		sum += pages[0];
+	}
+	tm = now_ms() - tm;
+
+	font_file_get_stats(fnt, &st, 0);
+	*misses = st.misses;
+	sink = sum;
+	font_file_close(fnt);
+	return n / tm * 1000;
+}
+
+static void sizes() {
+	const font_info_t *ref;
+	font_info_t *fnt;
+	font_file_stats_t st;
+	char path[128];
+	long builtin = 0, files = 0, sz;
+	int face, c, n;
+
+	printf("%-30s %8s %8s %8s\n", "font", "built in", "file", "RAM");
+	for (face = 0; face < font_builtin_fonts_count; face++) {
+		ref = font_builtin_fonts[face];
+		if (face == FONT_FACE_TERMINUS_8X14_KOI8_R)
+			ref = &_fonts_terminus_8x14_koi8_r_info;
+		if (ref == NULL || face == FONT_FACE_ROBOTO_8PT || face == FONT_FACE_ROBOTO_10PT)
+			continue;
+
+		// the bitmaps and the descriptors
+		n = 0;
+		for (c = (uint8_t)ref->char_start; c <= (uint8_t)ref->char_end; c++) {
+			const font_char_desc_t *d = ref->char_descriptors + (c - (uint8_t)ref->char_start);
+			n += (d->width + 7) / 8 * ref->height + sizeof(*d);
+		}
+
+		snprintf(path, sizeof(path), FONT_FILE_DIR "%s.fnt", font_names[face]);
+		sz = file_size(path);
+		fnt = font_file_open(path, 0, &c);
+		if (fnt == NULL)
+			continue;
+		font_file_get_stats(fnt, &st, 0);
+		printf("%-30s %8d %8ld %8d\n", font_names[face], n, sz,
+			(int)(sizeof(font_file_t) + st.ranges * sizeof(font_range_t) +
+			st.slots * sizeof(font_slot_t) + 2 * st.glyphs + st.cache));
+		font_file_close(fnt);
+
+		builtin += n;
+		files += sz;
+	}
+	printf("%-30s %8ld %8ld\n", "total", builtin, files);
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n glyphs] [-r runs]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int n = 1000000, runs = 3;
+	double hit, miss, best_hit = 0, best_miss = 0;
+	uint32_t hit_misses, miss_misses;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+			case 'n': n = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if ((n < 10000) || (runs < 1)) {
+		usage(argv[0]);
+	}
+
+	glyphs();
+	lru();
+	utf8();
+	koi8();
+	roboto();
+	open_files();
+
+	for (i = 0; i < runs; i++) {
+		hit = bench(n, 0, &hit_misses);
+		miss = bench(n / 10, 4 * 16 * 4, &miss_misses);
+		best_hit = (hit > best_hit) ? hit : best_hit;
+		best_miss = (miss > best_miss) ? miss : best_miss;
+	}
+
+	sizes();
+
+	printf("%-8s %12.0f glyphs/s, %u misses\n", "cache", best_hit, hit_misses);
+	printf("%-8s %12.0f glyphs/s, %u misses\n", "file", best_miss, miss_misses);
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
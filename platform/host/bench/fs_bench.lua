@@ -0,0 +1,108 @@
+-- bhgv, SPIFFS read throughput with and without read-ahead
+--
+-- Copyright (C) 2017
+-- Author: bhgv (http://github.com/bhgv)
+--
+-- All rights reserved.
+--
+-- Writes files of 4 KB and 64 KB, then reads them back in chunks like
+-- httpd and styx do, for some read-ahead sizes (fs.config), checks what
+-- is read and prints the MB/s and the counters of fs.stats(). Runs on the
+-- board (copy it to spiffs_image) or on the host platform:
+--
+--   make -C platform/host/bench fs
+--
+-- On the host the flash is an image file in the page cache, the MB/s show
+-- the cost of the layers above it only.
+
+local sizes = {4096, 65536}
+local readaheads = {0, 1024, 4096}
+local chunks = {64, 512, 4096}
+local min_us = 500000       -- read for at least that long
+
+local fails = 0
+
+local function check(what, ok)
+    if not ok then
+        print("FAIL " .. what)
+        fails = fails + 1
+    end
+end
+
+-- Block i of a file, 256 bytes that differ from one block to the other.
+-- The files are made and checked a block at a time, 64 KB don't fit in
+-- the heap of the board.
+local function block(i)
+    return string.rep(string.char(i % 251), 255) .. "\n"
+end
+
+local function expected(pos, len)
+    local t = {}
+    for i = pos // 256, (pos + len - 1) // 256 do
+        t[#t + 1] = block(i)
+    end
+    local s = table.concat(t)
+    return s:sub(pos % 256 + 1, pos % 256 + len)
+end
+
+local function write_file(name, size)
+    local f = io.open(name, "wb")
+    for i = 0, size // 256 - 1 do
+        f:write(block(i))
+    end
+    f:close()
+end
+
+-- The bytes read, and if they are those written
+local function read_file(name, chunk, verify)
+    local f = io.open(name, "rb")
+    local pos, ok = 0, true
+    while true do
+        local s = f:read(chunk)
+        if not s then break end
+        if verify and s ~= expected(pos, #s) then ok = false end
+        pos = pos + #s
+    end
+    f:close()
+    return pos, ok
+end
+
+local conf = fs.stats().readahead
+
+print(string.format("%8s %6s %6s %8s %8s %8s", "file", "ra", "chunk", "MB/s", "ra_hits", "ra_miss"))
+for _, size in ipairs(sizes) do
+    local name = "/fsb_" .. size .. ".bin"
+    write_file(name, size)
+
+    for _, ra in ipairs(readaheads) do
+        fs.config(ra)
+        for _, chunk in ipairs(chunks) do
+            local n, ok = read_file(name, chunk, true)
+            check(name .. " ra " .. ra .. " chunk " .. chunk, n == size and ok)
+
+            fs.resetstats()
+            n = 0
+            local t0 = tmr.now_us()
+            repeat
+                n = n + read_file(name, chunk)
+            until tmr.now_us() - t0 >= min_us
+            local us = tmr.now_us() - t0
+            local st = fs.stats()
+
+            print(string.format("%8d %6d %6d %8.2f %8d %8d", size, st.readahead, chunk,
+                n / us, st.ra_hits, st.ra_misses))
+        end
+    end
+
+    os.rm(name)
+end
+
+-- The size is clamped
+fs.config(1000000)
+check("readahead clamped", fs.stats().readahead == 65535)
+fs.config(1)
+check("readahead a page", fs.stats().readahead == 256)
+check("negative readahead", not pcall(fs.config, -1))
+fs.config(conf)
+
+print(fails == 0 and "all checks passed" or fails .. " checks failed")
@@ -0,0 +1,271 @@
+/*
+ * bhgv, host benchmark of the JSON encoder and decoder of the sjson module
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * A status object of about 4 KB, a table of sensors, is made JSON with
+ * Lua/modules/sjson.c and as the CGI pages did it:
+ *
+ *   concat  a string built with .., member by member
+ *   tconcat the members in a table, then table.concat()
+ *   encode  sjson.encode(status)
+ *   read    e:read(512) until nil, as a CGI page returns it
+ *   sink    sjson.encode(status, sink, {chunk = 512})
+ *   decode  sjson.decode(text)
+ *   frames  d:write() of the text in frames of 128 bytes
+ *
+ * and prints the time of one, the bytes it allocates and the most memory
+ * it holds at once, without collections.
+ *
+ *   json_bench [-m mode] [-s sensors] [-n iterations] [-r runs]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+typedef struct {
+	const char *name;
+	const char *body;
+} json_mode_t;
+
+static const json_mode_t modes[] = {
+	{"concat",  "n = n + #concat(status)"},
+	{"tconcat", "n = n + #tconcat(status)"},
+	{"encode",  "n = n + #sjson.encode(status)"},
+	{"read",    "local e = sjson.encoder(status) "
+	            "while true do local c = e:read(512) if not c then break end n = n + #c end"},
+	{"sink",    "n = n + sjson.encode(status, sink, opts)"},
+	{"decode",  "n = n + #sjson.decode(text).sensors"},
+	{"frames",  "local d = sjson.decoder() local r "
+	            "for i = 1, #frames do r = d:write(frames[i]) end n = n + #r.sensors"},
+};
+
+#define N_MODES (sizeof(modes) / sizeof(modes[0]))
+
+static const char *setup =
+	"status = {uptime = 123456, heap = 23456, ssid = 'home', rssi = -67, sensors = {}}\n"
+	"for i = 1, SENSORS do\n"
+	"  status.sensors[i] = {id = i, name = 'sensor' .. i, value = i * 1.5, unit = 'C', ok = (i % 7) ~= 0}\n"
+	"end\n"
+	"function concat(t)\n"
+	"  local s = '{\"uptime\":' .. t.uptime .. ',\"heap\":' .. t.heap .. ',\"ssid\":\"' .. t.ssid ..\n"
+	"    '\",\"rssi\":' .. t.rssi .. ',\"sensors\":['\n"
+	"  for i, v in ipairs(t.sensors) do\n"
+	"    if i > 1 then s = s .. ',' end\n"
+	"    s = s .. '{\"id\":' .. v.id .. ',\"name\":\"' .. v.name .. '\",\"value\":' .. v.value ..\n"
+	"      ',\"unit\":\"' .. v.unit .. '\",\"ok\":' .. tostring(v.ok) .. '}'\n"
+	"  end\n"
+	"  return s .. ']}'\n"
+	"end\n"
+	"function tconcat(t)\n"
+	"  local p = {'{\"uptime\":', t.uptime, ',\"heap\":', t.heap, ',\"ssid\":\"', t.ssid,\n"
+	"    '\",\"rssi\":', t.rssi, ',\"sensors\":['}\n"
+	"  for i, v in ipairs(t.sensors) do\n"
+	"    if i > 1 then p[#p + 1] = ',' end\n"
+	"    p[#p + 1] = '{\"id\":' .. v.id .. ',\"name\":\"' .. v.name .. '\",\"value\":' .. v.value ..\n"
+	"      ',\"unit\":\"' .. v.unit .. '\",\"ok\":' .. tostring(v.ok) .. '}'\n"
+	"  end\n"
+	"  p[#p + 1] = ']}'\n"
+	"  return table.concat(p)\n"
+	"end\n"
+	"text = sjson.encode(status)\n"
+	"frames = {}\n"
+	"for i = 1, #text, 128 do frames[#frames + 1] = text:sub(i, i + 127) end\n"
+	"sink = function(c) end\n"
+	"opts = {chunk = 512}\n"
+	"return #text\n";
+
+static const char *loop =
+	"return function(times)\n"
+	"  local n = 0\n"
+	"  for k = 1, times do %s end\n"
+	"  return n\n"
+	"end\n";
+
+// Memory of the Lua state
+static size_t mem_live, mem_peak, mem_alloc;
+
+static void *l_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+	if (ptr == NULL) {
+		osize = 0;
+	}
+
+	if (nsize == 0) {
+		free(ptr);
+		mem_live -= osize;
+		return NULL;
+	}
+
+	ptr = realloc(ptr, nsize);
+	if (ptr) {
+		mem_live += nsize - osize;
+		if (nsize > osize) {
+			mem_alloc += nsize - osize;
+		}
+		if (mem_live > mem_peak) {
+			mem_peak = mem_live;
+		}
+	}
+
+	return ptr;
+}
+
+// The compiler of the base library (luac.c), not used here
+int luac(const char *src, const char *dst) {
+	return -1;
+}
+
+int luaopen_sjson(lua_State *L);
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int call(lua_State *L, int times, long *n) {
+	lua_pushvalue(L, -1);
+	lua_pushinteger(L, times);
+	if (lua_pcall(L, 1, 1, 0) != LUA_OK) {
+		return -1;
+	}
+
+	*n = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+	return 0;
+}
+
+// Runs the mode, returns the time of one in us or < 0 on error
+static double run(int mode, int sensors, int times, long *text, long *n, size_t *alloc, size_t *peak) {
+	char src[1024];
+	lua_State *L;
+	double t = -1;
+
+	mem_live = mem_peak = mem_alloc = 0;
+
+	L = lua_newstate(l_alloc, NULL);
+	luaL_requiref(L, "_G", luaopen_base, 1);
+	luaL_requiref(L, "string", luaopen_string, 1);
+	luaL_requiref(L, "table", luaopen_table, 1);
+	luaL_requiref(L, "sjson", luaopen_sjson, 1);
+	lua_settop(L, 0);
+
+	lua_pushinteger(L, sensors);
+	lua_setglobal(L, "SENSORS");
+
+	snprintf(src, sizeof(src), loop, modes[mode].body);
+
+	if ((luaL_loadstring(L, setup) != LUA_OK) || (lua_pcall(L, 0, 1, 0) != LUA_OK)) {
+		goto fail;
+	}
+	*text = lua_tointeger(L, -1);
+	lua_pop(L, 1);
+
+	if ((luaL_loadstring(L, src) != LUA_OK) || (lua_pcall(L, 0, 1, 0) != LUA_OK)) {
+		goto fail;
+	}
+
+	// One, without collections
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	lua_gc(L, LUA_GCSTOP, 0);
+	mem_peak = mem_live;
+	*peak = mem_live;
+	if (call(L, 1, n) < 0) {
+		goto fail;
+	}
+	*peak = mem_peak - *peak;
+	lua_gc(L, LUA_GCRESTART, 0);
+
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	mem_alloc = 0;
+	t = now_ms();
+	if (call(L, times, n) < 0) {
+		goto fail;
+	}
+	t = (now_ms() - t) * 1000.0 / times;
+	*alloc = mem_alloc / times;
+	*n /= times;
+
+	lua_close(L);
+	return t;
+
+fail:
+	fprintf(stderr, "%s: %s\n", modes[mode].name, lua_tostring(L, -1));
+	lua_close(L);
+	return -1;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-m mode] [-s sensors] [-n iterations] [-r runs]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *mname = NULL;
+	int sensors = 64, times = 2000, runs = 3;
+	int i, k, c;
+
+	while ((c = getopt(argc, argv, "m:s:n:r:")) != -1) {
+		switch (c) {
+			case 'm': mname = optarg; break;
+			case 's': sensors = atoi(optarg); break;
+			case 'n': times = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if ((sensors < 1) || (times < 1)) {
+		usage(argv[0]);
+	}
+
+	printf("%-8s %8s %9s %8s %10s %9s\n",
+		"mode", "json", "us", "MB/s", "alloc", "peak");
+
+	for (i = 0; i < N_MODES; i++) {
+		double t, best = -1;
+		size_t alloc = 0, peak = 0, balloc = 0, bpeak = 0;
+		long text = 0, n = 0;
+
+		if (mname && strcmp(mname, modes[i].name)) {
+			continue;
+		}
+
+		for (k = 0; k < runs; k++) {
+			t = run(i, sensors, times, &text, &n, &alloc, &peak);
+			if (t < 0) {
+				break;
+			}
+			if ((best < 0) || (t < best)) {
+				best = t;
+				balloc = alloc;
+				bpeak = peak;
+			}
+		}
+
+		if (best < 0) {
+			printf("%-8s %8s\n", modes[i].name, "fails");
+			continue;
+		}
+
+		printf("%-8s %8ld %9.1f %8.2f %10zu %9zu\n",
+			modes[i].name, text, best, text / best, balloc, bpeak);
+	}
+
+	return 0;
+}
@@ -0,0 +1,495 @@
+/*
+ * bhgv, host test and benchmark of the motion planner of the steppers
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * G-code is replayed into sys/drivers/motion.c as the stepper module does:
+ * the lines are queued while there is room, and the step events of
+ * motion_next() are taken on an 80 MHz cycle counter, as the FRC1 callback
+ * does, while the queue is full. The programs are
+ *
+ *   square  a square of 20 mm at 3000 mm/min, corners of 90 degrees
+ *   circle  a circle of 360 lines, 1 degree each
+ *   raster  rows of short cuts with the moves of Z between them, as the
+ *           picture plugin of pc-studio makes them
+ *   tiny    a line of 2000 pieces of 0.05 mm
+ *   reverse back and forth on the same line
+ *   file    the G-code of -f file
+ *
+ * For each it checks from the step events that the speed along the path
+ * never goes over the feed, that the acceleration stays within the limit
+ * of the lines, that the machine ends at the target and how often it
+ * stops. It prints the time of the moves, the top speed and the time the
+ * planner takes for a line and the generator for a step.
+ *
+ *   motion_bench [-f file.gcode] [-r runs]
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sys/drivers/motion.h"
+
+#define CPU_HZ  80000000.0
+#define RAPID   1e9
+
+// The machine: X and Y on belts, Z on a screw
+static const motion_config_t machine = {
+	.axes = 3,
+	.step_pin = {4, 5, 12},
+	.dir_pin = {13, 14, 15},
+	.pulse_us = 2,
+	.steps_per_mm = {80, 80, 400},
+	.rate = {100, 100, 10},
+	.accel = {500, 500, 100},
+	.junction = 0.02,
+};
+
+typedef struct {
+	const char *name;
+	int stops;          // the most expected, -1 for any
+} program_t;
+
+static const program_t programs[] = {
+	{"square",  1},
+	{"circle",  1},
+	{"raster",  -1},
+	{"tiny",    1},
+	{"reverse", 6},
+	{"file",    -1},
+};
+
+#define N_PROGRAMS (sizeof(programs) / sizeof(programs[0]))
+
+// A line in the queue, as the bench sees it
+typedef struct {
+	uint32_t n;
+	float mm;
+	float feed;
+	float accel;
+} line_t;
+
+#define LINES 1024
+
+// Steps the acceleration is measured over, the rates are whole steps/s
+#define WINDOW 8
+
+typedef struct {
+	line_t q[LINES];
+	int head, tail;
+	uint32_t done;      // steps of the line at tail
+
+	double t;           // s
+	double w_v[WINDOW]; // speed, time and limit of the last steps
+	double w_t[WINDOW];
+	double w_a[WINDOW];
+	uint32_t w_n;
+	double v_max;
+	double a_ratio;     // the highest acceleration / the limit
+	double over;        // the highest speed / the feed
+	int bad;
+	uint32_t steps;
+	int lines;
+} replay_t;
+
+static int fails = 0;
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void check(const char *prog, const char *what, double got, double want, double tol) {
+	if ((got < want - tol) || (got > want + tol)) {
+		printf("%-7s FAIL %s: %.3f, %.3f expected\n", prog, what, got, want);
+		fails++;
+	}
+}
+
+static char *append(char *p, const char *fmt, double x, double y, double z, double f) {
+	return p + sprintf(p, fmt, x, y, z, f);
+}
+
+// The G-code of a program, NULL if there is no file
+static char *program(int k, const char *file) {
+	char *g = malloc(1024 * 1024), *p = g;
+	int i, j;
+
+	p += sprintf(p, "G21 G90 (mm, absolute)\nM3 S1000\n");
+
+	switch (k) {
+		case 0:
+			p += sprintf(p, "G1 F3000\n");
+			for (i = 0; i < 2; i++) {
+				p += sprintf(p, "G1 X20 Y0\nG1 X20 Y20\nG1 X0 Y20\nG1 X0 Y0 ; back\n");
+			}
+			break;
+
+		case 1:
+			p += sprintf(p, "G0 X10 Y0\n");
+			for (i = 1; i <= 360; i++) {
+				p = append(p, "G1 X%.4f Y%.4f Z%.0f F%.0f\n",
+					10 * cos(i * M_PI / 180), 10 * sin(i * M_PI / 180), 0, 3000);
+			}
+			break;
+
+		case 2:
+			p += sprintf(p, "G0 Z5\n");
+			for (i = 0; i < 10; i++) {
+				p = append(p, "G0 X%.1f Y%.1f Z%.1f F%.0f\n", 1.0, 20 - i * 0.5, 5, 0);
+				p += sprintf(p, "G1 Z-1 F300\n");
+				for (j = 1; j <= 40; j++) {
+					p = append(p, "G1 X%.2f Y%.2f Z%.0f F%.0f\n",
+						(i & 1) ? 41.0 - j : 1.0 + j, 20 - i * 0.5, -1, 1200);
+				}
+				p += sprintf(p, "G0 Z5\n");
+			}
+			p += sprintf(p, "G0 X0 Y0\nG0 Z0\n");
+			break;
+
+		case 3:
+			for (i = 1; i <= 2000; i++) {
+				p = append(p, "G1 X%.2f Y%.2f Z%.0f F%.0f\n", i * 0.05, i * 0.025, 0, 3000);
+			}
+			break;
+
+		case 4:
+			for (i = 0; i < 3; i++) {
+				p += sprintf(p, "G1 X10 F3000\nG1 X0\n");
+			}
+			break;
+
+		default: {
+			FILE *f;
+			size_t n;
+
+			if (!file || !(f = fopen(file, "r"))) {
+				free(g);
+				return NULL;
+			}
+
+			n = fread(g, 1, 1024 * 1024 - 1, f);
+			g[n] = 0;
+			fclose(f);
+			return g;
+		}
+	}
+
+	p += sprintf(p, "M5\nM2\n");
+	return g;
+}
+
+// The line in the queue of the bench, with the limits the planner sees
+static void push(replay_t *r, const float *from, const float *to, float feed) {
+	line_t *l = &r->q[r->head % LINES];
+	float d, mm = 0, accel = 0, u;
+	int32_t s, n = 0;
+	int i;
+
+	for (i = 0; i < machine.axes; i++) {
+		s = lroundf(to[i] * machine.steps_per_mm[i]) - lroundf(from[i] * machine.steps_per_mm[i]);
+		if (abs(s) > n) {
+			n = abs(s);
+		}
+		d = s / machine.steps_per_mm[i];
+		mm += d * d;
+	}
+	mm = sqrtf(mm);
+
+	for (i = 0; i < machine.axes; i++) {
+		s = lroundf(to[i] * machine.steps_per_mm[i]) - lroundf(from[i] * machine.steps_per_mm[i]);
+		u = fabsf(s / machine.steps_per_mm[i]) / mm;
+		if ((u > 1e-6f) && (feed * u > machine.rate[i])) {
+			feed = machine.rate[i] / u;
+		}
+		if ((u > 1e-6f) && (!accel || (machine.accel[i] / u < accel))) {
+			accel = machine.accel[i] / u;
+		}
+	}
+
+	l->n = n;
+	l->mm = mm;
+	l->feed = feed;
+	l->accel = accel;
+	r->head++;
+}
+
+// Takes the step events until a line is done, or all if all
+static void run_steps(replay_t *r, int all, int checks) {
+	motion_event_t ev;
+	line_t *l;
+	double v, a, t, limit;
+	int i;
+
+	while (motion_next(&ev)) {
+		l = &r->q[r->tail % LINES];
+
+		r->t += ev.dt / CPU_HZ;
+		r->steps++;
+
+		if (checks) {
+			v = CPU_HZ / ev.dt * l->mm / l->n;
+
+			if (v > r->v_max) {
+				r->v_max = v;
+			}
+			if (v / l->feed > r->over) {
+				r->over = v / l->feed;
+			}
+
+			// From the middle of the step WINDOW steps before
+			t = r->t - ev.dt / CPU_HZ / 2;
+			limit = l->accel;
+			for (i = 0; i < WINDOW; i++) {
+				if ((i < r->w_n) && (r->w_a[i] > limit)) {
+					limit = r->w_a[i];
+				}
+			}
+
+			if (r->w_n >= WINDOW) {
+				i = r->w_n % WINDOW;
+				a = fabs(v - r->w_v[i]) / (t - r->w_t[i]);
+				if (a / limit > r->a_ratio) {
+					r->a_ratio = a / limit;
+				}
+			}
+
+			i = r->w_n++ % WINDOW;
+			r->w_v[i] = v;
+			r->w_t[i] = t;
+			r->w_a[i] = l->accel;
+		}
+
+		if (++r->done == l->n) {
+			r->tail++;
+			r->done = 0;
+			if (!all) {
+				return;
+			}
+		}
+	}
+
+	// At rest
+	r->w_n = 0;
+}
+
+// G0 / G1 X Y Z F, G20 / G21, G90 / G91, the rest is skipped
+static void replay(replay_t *r, const char *g, double *plan_ms, double *step_ms, int checks) {
+	float pos[MOTION_AXES] = {0}, last[MOTION_AXES] = {0}, to[MOTION_AXES];
+	float feed = 1000 / 60.0, scale = 1, f;
+	int absolute = 1, motion = -1, move, res, i;
+	const char *p = g;
+	char *e, c;
+	double x, t;
+	motion_stats_t st;
+
+	while (*p) {
+		memcpy(to, pos, sizeof(to));
+		move = 0;
+
+		while (*p && (*p != '\n')) {
+			c = *p & ~0x20;
+
+			if ((*p == ';') || (*p == '%')) {
+				while (*p && (*p != '\n')) {
+					p++;
+				}
+				break;
+			}
+
+			if (*p == '(') {
+				while (*p && (*p != ')') && (*p != '\n')) {
+					p++;
+				}
+				if (*p == ')') {
+					p++;
+				}
+				continue;
+			}
+
+			if ((c < 'A') || (c > 'Z')) {
+				p++;
+				continue;
+			}
+
+			x = strtod(p + 1, &e);
+			if (e == p + 1) {
+				p++;
+				continue;
+			}
+			p = e;
+
+			switch (c) {
+				case 'G':
+					if ((x == 0) || (x == 1)) {
+						motion = (int)x;
+					} else if (x == 20) {
+						scale = 25.4;
+					} else if (x == 21) {
+						scale = 1;
+					} else if (x == 90) {
+						absolute = 1;
+					} else if (x == 91) {
+						absolute = 0;
+					}
+					break;
+
+				case 'X': case 'Y': case 'Z':
+					i = c - 'X';
+					to[i] = absolute ? x * scale : pos[i] + x * scale;
+					move = 1;
+					break;
+
+				case 'F':
+					if (x > 0) {
+						feed = x * scale / 60;
+					}
+					break;
+			}
+		}
+
+		if (*p == '\n') {
+			p++;
+		}
+
+		if (!move || (motion < 0)) {
+			continue;
+		}
+
+		f = (motion == 0) ? RAPID : feed;
+
+		motion_get_stats(&st);
+		i = st.queued;
+
+		for (;;) {
+			t = now_ms();
+			res = motion_line(to, f);
+			*plan_ms += now_ms() - t;
+
+			if (res != EAGAIN) {
+				break;
+			}
+
+			t = now_ms();
+			run_steps(r, 0, checks);
+			*step_ms += now_ms() - t;
+		}
+
+		motion_get_stats(&st);
+		if (st.queued != i) {
+			push(r, last, to, f);
+			memcpy(last, to, sizeof(last));
+			r->lines++;
+		}
+
+		memcpy(pos, to, sizeof(pos));
+	}
+
+	motion_start();
+	t = now_ms();
+	run_steps(r, 1, checks);
+	*step_ms += now_ms() - t;
+
+	// Where it should be
+	if (checks) {
+		float at[MOTION_AXES];
+
+		motion_position(at);
+		for (i = 0; i < machine.axes; i++) {
+			r->bad += fabsf(at[i] - pos[i]) > 0.5f / machine.steps_per_mm[i];
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *file = NULL;
+	int runs = 3, i, k, c;
+
+	while ((c = getopt(argc, argv, "f:r:")) != -1) {
+		switch (c) {
+			case 'f': file = optarg; break;
+			case 'r': runs = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-f file.gcode] [-r runs]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if (runs < 1) {
+		runs = 1;
+	}
+
+	printf("%-7s %6s %8s %8s %8s %6s %6s %9s %9s\n",
+		"program", "lines", "steps", "time s", "v mm/s", "stops", "a/lim", "plan us", "step ns");
+
+	for (k = 0; k < N_PROGRAMS; k++) {
+		const program_t *pr = &programs[k];
+		motion_stats_t st;
+		replay_t *r;
+		double plan, step, best_plan = -1, best_step = -1;
+		char *g;
+
+		if (!(g = program(k, file))) {
+			continue;
+		}
+
+		r = calloc(1, sizeof(replay_t));
+
+		check(pr->name, "setup", motion_setup(&machine), 0, 0);
+		plan = step = 0;
+		replay(r, g, &plan, &step, 1);
+		motion_get_stats(&st);
+
+		check(pr->name, "position", r->bad, 0, 0);
+		check(pr->name, "lines", st.blocks, r->lines, 0);
+		check(pr->name, "over the feed", r->over > 1.001, 0, 0);
+		check(pr->name, "over the acceleration", r->a_ratio > 1.05, 0, 0);
+		check(pr->name, "over the rate", st.rate_max > MOTION_RATE_MAX, 0, 0);
+		if (pr->stops >= 0) {
+			check(pr->name, "stops", st.stops > pr->stops, 0, 0);
+		}
+
+		// The time alone, without the checks
+		for (i = 0; i < runs; i++) {
+			replay_t *q = calloc(1, sizeof(replay_t));
+
+			motion_setup(&machine);
+			plan = step = 0;
+			replay(q, g, &plan, &step, 0);
+
+			if ((best_plan < 0) || (plan < best_plan)) {
+				best_plan = plan;
+			}
+			if ((best_step < 0) || (step < best_step)) {
+				best_step = step;
+			}
+
+			free(q);
+		}
+
+		printf("%-7s %6d %8u %8.3f %8.2f %6u %6.3f %9.2f %9.1f\n",
+			pr->name, r->lines, r->steps, r->t, r->v_max, st.stops, r->a_ratio,
+			best_plan * 1000 / (r->lines ? r->lines : 1),
+			best_step * 1000000 / (r->steps ? r->steps : 1));
+
+		free(r);
+		free(g);
+	}
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
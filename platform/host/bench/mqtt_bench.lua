@@ -0,0 +1,125 @@
+-- bhgv, the mqtt client against a broker stand-in
+--
+-- Copyright (C) 2017
+-- Author: bhgv (http://github.com/bhgv)
+--
+-- All rights reserved.
+--
+-- Runs the client of Lua/modules/mqtt.c against mqtt_broker.c on the
+-- loopback: a refused CONNACK, a burst of publishes of mixed QoS through
+-- the QoS 1 window and the batched writes, an echo through a
+-- subscription, the keepalive pings, a lost connection, the DUP resend of
+-- an unacknowledged publish by the next connect, and the collection of a
+-- connected client. Prints the counters of the burst. On the host
+-- platform, where make starts the broker:
+--
+--   make -C platform/host/bench mqtt
+
+local host = "127.0.0.1"
+local port = 18830          -- the -p of mqtt_broker, refuses on port + 1
+local burst = 1000
+local inflight = 8          -- MQTT_INFLIGHT of mqtt.c
+
+local fails = 0
+
+local function check(what, ok)
+    if not ok then
+        print("FAIL " .. what)
+        fails = fails + 1
+    end
+end
+
+-- What the broker saw of the connection of c
+local function broker_stats(c)
+    c:publish("$bench/stats", "")
+    local topic, payload = c:recv(2000)
+    local t = {}
+    for k, v in string.gmatch(payload or "", "(%w+)=(%d+)") do
+        t[k] = tonumber(v)
+    end
+    return t
+end
+
+-- Refused, and no broker at all
+local c = mqtt.client("bench", 1)
+local err, code = c:connect(host, port + 1)
+check("refused connack", err == mqtt.ERR_REFUSED and code == 5)
+check("no broker", c:connect(host, port + 9) ~= mqtt.ERR_OK)
+check("publish before connect", select(2, c:publish("a", "b")) == mqtt.ERR_CLOSED)
+
+check("connect", c:connect(host, port) == mqtt.ERR_OK)
+check("subscribe", c:subscribe("echo", 1) ~= nil)
+
+-- A burst, the publishes over the window or the queue wait for a flush
+local payload = string.rep("x", 40)
+local qos1, full = 0, 0
+local t0 = tmr.now_us()
+for i = 1, burst do
+    local id, e = c:publish("tele/t", payload, i % 2)
+    while not id do
+        check("burst error", e == mqtt.ERR_OVERFLOW)
+        full = full + 1
+        c:flush(1000)
+        id, e = c:publish("tele/t", payload, i % 2)
+    end
+    qos1 = qos1 + i % 2
+end
+check("burst flushed", c:flush(5000))
+local us = tmr.now_us() - t0
+
+local s = c:stats()
+local b = broker_stats(c)
+print(string.format("%d publishes in %d writes, the broker read them in %d, %.0f ms",
+    s.published, s.writes, b.reads or 0, us / 1000))
+print(string.format("window %d of %d, latency %d us (max %d), queue waits %d",
+    s.max_inflight, inflight, s.latency, s.latency_max, full))
+
+check("all published", s.published == burst)
+check("all acked", s.acked == qos1 and s.inflight == 0)
+check("window used", s.max_inflight > 1 and s.max_inflight <= inflight)
+check("writes batched", s.writes * 4 < s.published)
+check("broker got all", b.publishes == burst + 1)
+
+-- Echo, and nothing more
+c:publish("echo", "hello", 1)
+local topic, msg, e = c:recv(2000)
+check("echo", topic == "echo" and msg == "hello" and e == mqtt.ERR_OK)
+check("recv timeout", select(3, c:recv(100)) == mqtt.ERR_TIMEDOUT)
+
+-- Keepalive of 1 s, the task pings while the script sleeps
+local pings = s.pings
+tmr.delayms(3500)
+s = c:stats()
+check("pings sent", s.pings - pings >= 2)
+check("still connected", s.connected)
+check("broker got pings", broker_stats(c).pings >= 2)
+
+-- noack is not acknowledged until it's sent again, bye closes
+c:publish("noack", "x", 1)
+c:publish("bye", "x")
+check("lost", select(3, c:recv(3000)) == mqtt.ERR_CLOSED)
+check("publish when lost", select(2, c:publish("a", "b")) == mqtt.ERR_CLOSED)
+check("unacked kept", c:stats().inflight == 1)
+
+check("reconnect", c:connect(host, port) == mqtt.ERR_OK)
+check("resent flushed", c:flush(2000) and c:stats().inflight == 0)
+check("resent with dup", broker_stats(c).dup == 1)
+
+c:close()
+tmr.delayms(200)
+check("closed", not c:stats().connected)
+
+-- A connected client left to the GC ends its task and frees itself
+local function leave()
+    local l = mqtt.client("left")
+    check("connect left", l:connect(host, port) == mqtt.ERR_OK)
+    for i = 1, 5 do
+        l:publish("a/b", "v" .. i, 1)
+    end
+end
+leave()
+collectgarbage("collect")
+collectgarbage("collect")
+tmr.delayms(200)
+
+print(fails == 0 and "all checks passed" or fails .. " checks failed")
@@ -0,0 +1,329 @@
+/*
+ * bhgv, MQTT broker stand-in of the mqtt client benchmark
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Just enough of an MQTT 3.1.1 broker for mqtt_bench.lua to run the
+ * client of Lua/modules/mqtt.c against, on the loopback:
+ *
+ *   port      CONNACK, PUBACK, SUBACK, UNSUBACK and PINGRESP, a publish
+ *             echoed to the connection when it subscribed to its topic
+ *   port + 1  the CONNACK refuses the connection (not authorized, 5)
+ *
+ * with a few topics that do what the bench needs of a broker:
+ *
+ *   noack         a QoS 1 publish is acknowledged only when it's a DUP
+ *   bye           the broker closes the connection
+ *   $bench/stats  answered with a publish of what the broker saw of the
+ *                 connection: "reads=%d publishes=%d dup=%d pings=%d"
+ *
+ * One thread per connection. Runs until killed, with -d in the background
+ * once it listens, its pid printed:
+ *
+ *   mqtt_broker [-d] [-p port]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#define BUF_SIZE 65536
+
+#define STATS_TOPIC "$bench/stats"
+
+typedef struct {
+	int fd;
+	int refuse;
+	int subs;               // Bit 0: subscribed to echo
+	int reads;
+	int publishes;
+	int dup;
+	int pings;
+} conn_t;
+
+static void send_all(int fd, const uint8_t *p, size_t n) {
+	ssize_t w;
+
+	while (n > 0) {
+		if ((w = send(fd, p, n, MSG_NOSIGNAL)) <= 0) {
+			return;
+		}
+		p += w;
+		n -= w;
+	}
+}
+
+// A QoS 0 publish of payload on topic
+static void publish(int fd, const uint8_t *topic, size_t tlen, const uint8_t *payload, size_t len) {
+	uint8_t *p = malloc(tlen + len + 7);
+	size_t rem = 2 + tlen + len, n = 0;
+
+	p[n++] = 0x30;
+	do {
+		p[n] = rem & 0x7f;
+		rem >>= 7;
+		p[n++] |= rem ? 0x80 : 0;
+	} while (rem);
+
+	p[n++] = tlen >> 8;
+	p[n++] = tlen & 0xff;
+	memcpy(p + n, topic, tlen);
+	memcpy(p + n + tlen, payload, len);
+
+	send_all(fd, p, n + tlen + len);
+	free(p);
+}
+
+static int is_topic(const uint8_t *t, size_t tlen, const char *name) {
+	return (tlen == strlen(name)) && !memcmp(t, name, tlen);
+}
+
+// Handles a packet, returns 0 to close the connection
+static int packet(conn_t *c, uint8_t h, const uint8_t *b, size_t len) {
+	uint8_t ack[5];
+	char stats[128];
+	size_t tlen, o;
+	int qos;
+
+	switch (h >> 4) {
+		case 1:  // CONNECT
+			ack[0] = 0x20;
+			ack[1] = 2;
+			ack[2] = 0;
+			ack[3] = c->refuse ? 5 : 0;
+			send_all(c->fd, ack, 4);
+			return !c->refuse;
+
+		case 3:  // PUBLISH
+			if (len < 2) {
+				return 0;
+			}
+
+			tlen = (b[0] << 8) | b[1];
+			qos = (h >> 1) & 3;
+			o = 2 + tlen + (qos ? 2 : 0);
+			if (o > len) {
+				return 0;
+			}
+
+			c->publishes++;
+			if (h & 8) {
+				c->dup++;
+			}
+
+			if (qos && (!is_topic(b + 2, tlen, "noack") || (h & 8))) {
+				ack[0] = 0x40;
+				ack[1] = 2;
+				ack[2] = b[2 + tlen];
+				ack[3] = b[3 + tlen];
+				send_all(c->fd, ack, 4);
+			}
+
+			if (is_topic(b + 2, tlen, "bye")) {
+				return 0;
+			}
+
+			if (is_topic(b + 2, tlen, STATS_TOPIC)) {
+				snprintf(stats, sizeof(stats), "reads=%d publishes=%d dup=%d pings=%d",
+					c->reads, c->publishes, c->dup, c->pings);
+				publish(c->fd, b + 2, tlen, (uint8_t *)stats, strlen(stats));
+			} else if ((c->subs & 1) && is_topic(b + 2, tlen, "echo")) {
+				publish(c->fd, b + 2, tlen, b + o, len - o);
+			}
+			return 1;
+
+		case 8:  // SUBSCRIBE, one topic
+			if (len < 5) {
+				return 0;
+			}
+
+			tlen = (b[2] << 8) | b[3];
+			if (is_topic(b + 4, tlen, "echo")) {
+				c->subs |= 1;
+			}
+
+			ack[0] = 0x90;
+			ack[1] = 3;
+			ack[2] = b[0];
+			ack[3] = b[1];
+			ack[4] = (4 + tlen < len) ? b[4 + tlen] : 0;
+			send_all(c->fd, ack, 5);
+			return 1;
+
+		case 10: // UNSUBSCRIBE
+			if (len < 4) {
+				return 0;
+			}
+
+			tlen = (b[2] << 8) | b[3];
+			if (is_topic(b + 4, tlen, "echo")) {
+				c->subs &= ~1;
+			}
+
+			ack[0] = 0xb0;
+			ack[1] = 2;
+			ack[2] = b[0];
+			ack[3] = b[1];
+			send_all(c->fd, ack, 4);
+			return 1;
+
+		case 12: // PINGREQ
+			c->pings++;
+			ack[0] = 0xd0;
+			ack[1] = 0;
+			send_all(c->fd, ack, 2);
+			return 1;
+
+		case 14: // DISCONNECT
+			return 0;
+	}
+
+	return 1;
+}
+
+static void *serve(void *arg) {
+	conn_t *c = (conn_t *)arg;
+	uint8_t *buf = malloc(BUF_SIZE);
+	size_t len = 0, rem, hlen, total;
+	int shift, open = 1;
+	ssize_t n;
+
+	while (open && ((n = recv(c->fd, buf + len, BUF_SIZE - len, 0)) > 0)) {
+		c->reads++;
+		len += n;
+
+		while (open) {
+			rem = 0;
+			shift = 0;
+			for (hlen = 1; (hlen < len) && (hlen <= 4); hlen++) {
+				rem |= (size_t)(buf[hlen] & 0x7f) << shift;
+				shift += 7;
+				if (!(buf[hlen] & 0x80)) {
+					break;
+				}
+			}
+
+			if ((hlen > 4) || (hlen + 1 + rem > BUF_SIZE)) {
+				open = 0;
+				break;
+			}
+
+			total = hlen + 1 + rem;
+			if ((hlen >= len) || (len < total)) {
+				break;
+			}
+
+			open = packet(c, buf[0], buf + hlen + 1, rem);
+
+			memmove(buf, buf + total, len - total);
+			len -= total;
+		}
+	}
+
+	close(c->fd);
+	free(buf);
+	free(c);
+	return NULL;
+}
+
+static int listen_on(int port) {
+	struct sockaddr_in addr;
+	int fd, on = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) || (listen(fd, 8) < 0)) {
+		perror("mqtt_broker");
+		exit(1);
+	}
+
+	return fd;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-d] [-p port]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int port = 18830, background = 0;
+	int lfd[2], i, c;
+	pid_t pid;
+	pthread_t th;
+	fd_set rfds;
+	conn_t *conn;
+
+	while ((c = getopt(argc, argv, "dp:")) != -1) {
+		switch (c) {
+			case 'd': background = 1; break;
+			case 'p': port = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	lfd[0] = listen_on(port);
+	lfd[1] = listen_on(port + 1);
+
+	// The clients can connect once the parent is gone
+	if (background) {
+		if ((pid = fork()) < 0) {
+			perror("mqtt_broker");
+			return 1;
+		}
+
+		if (pid > 0) {
+			printf("%d\n", (int)pid);
+			return 0;
+		}
+
+		fclose(stdout);
+	}
+
+	for (;;) {
+		FD_ZERO(&rfds);
+		FD_SET(lfd[0], &rfds);
+		FD_SET(lfd[1], &rfds);
+
+		if (select(((lfd[0] > lfd[1]) ? lfd[0] : lfd[1]) + 1, &rfds, NULL, NULL, NULL) < 0) {
+			continue;
+		}
+
+		for (i = 0; i < 2; i++) {
+			if (!FD_ISSET(lfd[i], &rfds)) {
+				continue;
+			}
+
+			conn = calloc(1, sizeof(conn_t));
+			conn->refuse = i;
+			if ((conn->fd = accept(lfd[i], NULL, NULL)) < 0) {
+				free(conn);
+				continue;
+			}
+
+			pthread_create(&th, NULL, serve, conn);
+			pthread_detach(th);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+/*
+ * bhgv, host benchmark of the line protocol reads of the sock module
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * A thread sends records over a loopback TCP connection, in 4 KB writes,
+ * to a Lua loop that reads them one by one with Lua/modules/sock.c:
+ *
+ *   legacy  the former "*l" read of sock.recv(), with the socket type
+ *           asked and a recv() for every byte
+ *   line    s:recv("*l")
+ *   delim   s:recv("*d", "\r\n")
+ *   prefix  s:recv("*p"), after a 2 byte length
+ *
+ * and prints the time, the throughput and the recv() calls of the reads.
+ *
+ *   net_bench [-m mode] [-n records] [-l length] [-r runs] [-p port]
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lwip/sockets.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+
+#include "sock.h"
+
+#define CHUNK 4096
+
+typedef struct {
+	const char *name;
+	const char *read;
+} read_mode_t;
+
+typedef struct {
+	int port;
+	int mode;
+	int records;
+	int len;
+} writer_t;
+
+static const read_mode_t modes[] = {
+	{"legacy", "local fd = c:fd() read = function() return legacy_recv(fd) end"},
+	{"line",   "read = function() return c:recv('*l') end"},
+	{"delim",  "read = function() return c:recv('*d', '\\r\\n') end"},
+	{"prefix", "read = function() return c:recv('*p') end"},
+};
+
+#define N_MODES (sizeof(modes) / sizeof(modes[0]))
+
+static const char *reader =
+	"local srv = sock.socket(0)\n"
+	"local c, ip, err = srv:accept(PORT)\n"
+	"assert(c, 'accept failed')\n"
+	"local read\n"
+	"%s\n"
+	"local n, bytes = 0, 0\n"
+	"while true do\n"
+	"  local r, e = read()\n"
+	"  if e ~= 0 then break end\n"
+	"  n = n + 1\n"
+	"  bytes = bytes + #r\n"
+	"end\n"
+	"c:close()\n"
+	"srv:close()\n"
+	"return n, bytes\n";
+
+static volatile size_t recv_calls;
+
+ssize_t __real_recv(int fd, void *buf, size_t len, int flags);
+
+ssize_t __wrap_recv(int fd, void *buf, size_t len, int flags) {
+	recv_calls++;
+	return __real_recv(fd, buf, len, flags);
+}
+
+// The compiler of the base library (luac.c), not used here
+int luac(const char *src, const char *dst) {
+	return -1;
+}
+
+// What sock.c needs from the platform, there are no green threads
+int host_bind(int s, const struct sockaddr *name, socklen_t namelen) {
+	int on = 1;
+
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	return bind(s, name, namelen);
+}
+
+int thread_is_green(lua_State *L) {
+	return 0;
+}
+
+int thread_yield_wait(lua_State *L, int type, void *src, uint64_t timeout_us, lua_KContext ctx, lua_KFunction k) {
+	return luaL_error(L, "no green threads");
+}
+
+uint64_t clock_monotonic_us(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int luaopen_sock(lua_State *L);
+
+// Lua: line, err = legacy_recv(fd)
+// The "*l" read of net.c before the receive buffer. At the end of the
+// stream it returned ERR_OK, here ERR_CLOSED to stop the loop.
+static int legacy_recv(lua_State *L) {
+	int sock = luaL_checkinteger(L, 1);
+	socklen_t length = sizeof(int);
+	int type, n, received = 0;
+	luaL_Buffer b;
+	char c;
+
+	luaL_buffinit(L, &b);
+
+	if (getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &length) < 0) {
+		luaL_pushresult(&b);
+		lua_pushinteger(L, NET_ERR_OTHER);
+		return 2;
+	}
+
+	while (((n = recv(sock, &c, 1, 0)) > 0) && (received < BUFSIZ)) {
+		luaL_addchar(&b, c);
+		received++;
+
+		if (c == '\n') break;
+	}
+
+	luaL_pushresult(&b);
+	lua_pushinteger(L, (received == 0) ? NET_ERR_CLOSED : NET_ERR_OK);
+	return 2;
+}
+
+static int record(int mode, int len, char *p) {
+	int i, payload = len;
+
+	if (mode == 3) {
+		payload = len - 2;
+		*p++ = payload >> 8;
+		*p++ = payload & 0xff;
+	}
+
+	for (i = 0; i < payload; i++) {
+		p[i] = 'a' + i % 26;
+	}
+
+	if (mode == 2) {
+		p[payload - 2] = '\r';
+		p[payload - 1] = '\n';
+	} else if (mode != 3) {
+		p[payload - 1] = '\n';
+	}
+
+	return len;
+}
+
+static void *writer(void *arg) {
+	writer_t *w = (writer_t *)arg;
+	struct sockaddr_in addr;
+	char *buf = malloc(CHUNK + w->len);
+	int fd, i, n = 0, try;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(w->port);
+
+	// Until the Lua side listens
+	for (try = 0; try < 1000; try++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+		usleep(1000);
+	}
+
+	if (fd >= 0) {
+		for (i = 0; i < w->records; i++) {
+			n += record(w->mode, w->len, buf + n);
+			if ((n >= CHUNK) || (i == w->records - 1)) {
+				if (send(fd, buf, n, 0) != n) {
+					break;
+				}
+				n = 0;
+			}
+		}
+
+		close(fd);
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Runs the reader of the mode, returns the time in ms or < 0 on error
+static double run(int mode, int records, int len, int port, size_t *calls, long *got, long *bytes) {
+	char src[1024];
+	pthread_t th;
+	writer_t w = {port, mode, records, len};
+	lua_State *L;
+	double t = -1;
+
+	L = luaL_newstate();
+	luaL_requiref(L, "_G", luaopen_base, 1);
+	luaL_requiref(L, "sock", luaopen_sock, 1);
+	lua_settop(L, 0);
+
+	lua_pushinteger(L, port);
+	lua_setglobal(L, "PORT");
+	lua_register(L, "legacy_recv", legacy_recv);
+
+	snprintf(src, sizeof(src), reader, modes[mode].read);
+
+	pthread_create(&th, NULL, writer, &w);
+
+	recv_calls = 0;
+	t = now_ms();
+	if ((luaL_loadstring(L, src) == LUA_OK) && (lua_pcall(L, 0, 2, 0) == LUA_OK)) {
+		t = now_ms() - t;
+		*got = lua_tointeger(L, -2);
+		*bytes = lua_tointeger(L, -1);
+	} else {
+		fprintf(stderr, "%s: %s\n", modes[mode].name, lua_tostring(L, -1));
+		t = -1;
+	}
+	*calls = recv_calls;
+
+	pthread_join(th, NULL);
+	lua_close(L);
+
+	return t;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-m mode] [-n records] [-l length] [-r runs] [-p port]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *mname = NULL;
+	int records = 20000, len = 64, runs = 3, port = 47200;
+	int i, k, c;
+
+	while ((c = getopt(argc, argv, "m:n:l:r:p:")) != -1) {
+		switch (c) {
+			case 'm': mname = optarg; break;
+			case 'n': records = atoi(optarg); break;
+			case 'l': len = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			case 'p': port = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if ((len < 4) || (len > 1024) || (records < 1)) {
+		usage(argv[0]);
+	}
+
+	printf("%d records of %d bytes, receive buffer %d to %d bytes\n\n",
+		records, len, NET_RBUF_SIZE, NET_RBUF_MAX);
+	printf("%-8s %8s %9s %8s %8s %9s %9s\n",
+		"mode", "records", "bytes", "ms", "MB/s", "krec/s", "recv");
+
+	for (i = 0; i < N_MODES; i++) {
+		double t, best = -1;
+		size_t calls = 0, bcalls = 0;
+		long got = 0, bytes = 0;
+
+		if (mname && strcmp(mname, modes[i].name)) {
+			continue;
+		}
+
+		for (k = 0; k < runs; k++) {
+			t = run(i, records, len, port++, &calls, &got, &bytes);
+			if (t < 0) {
+				break;
+			}
+			if ((best < 0) || (t < best)) {
+				best = t;
+				bcalls = calls;
+			}
+		}
+
+		if (best < 0) {
+			printf("%-8s %8s\n", modes[i].name, "fails");
+			continue;
+		}
+
+		printf("%-8s %8ld %9ld %8.2f %8.2f %9.1f %9zu\n",
+			modes[i].name, got, bytes, best,
+			bytes / 1048576.0 / (best / 1000.0), got / best, bcalls);
+	}
+
+	return 0;
+}
@@ -0,0 +1,426 @@
+/*
+ * bhgv, host test and benchmark of the fixed point PID loops
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The loops of modules/pid/pidq.c are stepped by pidq_tick() as the timer
+ * does, against the float pid_compute() of modules/pid/PID.c:
+ *
+ *   same      PID.c runs a first order plant, the fixed point loops see the
+ *             same inputs, with the gains of tests[]: their outputs must
+ *             stay within the tolerance of the float ones
+ *   period    loops of 1, 3 and 10 ticks are stepped when due
+ *   settle    a loop on its own plant reaches the setpoint
+ *   windup    a step saturating the output, the overshoot is smaller with
+ *             antiwindup
+ *   filter    a noisy input, the derivative moves less with tf
+ *   acq       the input of a loop is the last sample of its channel
+ *
+ * Then the steps per second of PIDQ_LOOPS loops, in float and fixed point.
+ * On the host the float is in hardware, on the ESP8266 it is soft-float.
+ *
+ *   pid_bench [-n steps] [-r runs]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modules/pid/PID.h"
+#include "modules/pid/pidq.h"
+
+#include "sys/drivers/acq.h"
+
+typedef struct {
+	const char *name;
+	float kp, ki, kd;
+	float min, max;
+	uint16_t period;    // ms
+	uint8_t reverse;
+} test_t;
+
+static const test_t tests[] = {
+	{"p",       4,    0,    0,    0,     4095, 1,   0},
+	{"pi",      2,    20,   0,    0,     4095, 1,   0},
+	{"pid",     3,    8,    0.02, 0,     4095, 10,  0},
+	{"reverse", 1.5,  4,    0.01, -100,  100,  5,   1},
+	{"slow",    0.5,  0.2,  2,    -1000, 1000, 100, 0},
+};
+
+#define N_TESTS (sizeof(tests) / sizeof(tests[0]))
+
+// Of the output range
+#define TOLERANCE 1e-4
+
+static int fails = 0;
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static uint32_t rnd(uint32_t *s) {
+	*s = *s * 1103515245 + 12345;
+	return (*s >> 16) & 0x7fff;
+}
+
+static void check(const char *test, const char *what, double got, double want, double tol) {
+	if ((got < want - tol) || (got > want + tol)) {
+		printf("%-8s FAIL %s: %.4f, %.4f expected\n", test, what, got, want);
+		fails++;
+	}
+}
+
+static pidq_config_t config(const test_t *t, float setpoint) {
+	pidq_config_t cfg;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.kp = t->kp;
+	cfg.ki = t->ki;
+	cfg.kd = t->kd;
+	cfg.min = t->min;
+	cfg.max = t->max;
+	cfg.setpoint = setpoint;
+	cfg.period_ms = t->period;
+	cfg.input = PIDQ_NO_INPUT;
+	cfg.pwm = PIDQ_NO_PWM;
+	cfg.reverse = t->reverse;
+
+	return cfg;
+}
+
+// A first order plant, the output of a reverse loop lowers it
+static float plant(float y, float u, float gain, float a) {
+	return y + (gain * u - y) * a;
+}
+
+// The steps of test k on both, returns the largest difference of outputs
+static double same(int k, int steps) {
+	const test_t *t = &tests[k];
+	pidq_config_t cfg = config(t, 0);
+	struct pid_controller ctl;
+	pidq_state_t st;
+	float in = 0, out = t->min, sp = 0, gain = t->reverse ? -1 : 1;
+	double diff = 0, d;
+	uint32_t seed = 7;
+	int i, j, id;
+
+	pid_create(&ctl, &in, &out, &sp, t->kp, t->ki, t->kd, 0);
+	pid_sample(&ctl, t->period);
+	pid_limits(&ctl, t->min, t->max);
+	pid_direction(&ctl, t->reverse ? E_PID_REVERSE : E_PID_DIRECT);
+	pid_tune(&ctl, t->kp, t->ki, t->kd);
+	pid_auto(&ctl);
+
+	check(t->name, "add", pidq_add(&cfg, &id), 0, 0);
+	pidq_input(id, 0);
+	pidq_enable(id, 1);
+
+	for (i = 0; i < steps; i++) {
+		// Setpoints over the range, and through the limits
+		if (i % 500 == 0) {
+			sp = t->min + (t->max - t->min) * (rnd(&seed) % 1200 / 1000.0f - 0.1f);
+			sp = roundf(sp * 16) / 16;
+			cfg.setpoint = sp;
+			pidq_tune(id, &cfg);
+		}
+
+		pid_compute(&ctl, 0);
+		pidq_input(id, Q16(in));
+		for (j = 0; j < t->period; j++) {
+			pidq_tick();
+		}
+
+		pidq_get_state(id, &st);
+		d = fabs(Q16_TO_F(st.output) - out) / (t->max - t->min);
+		if (d > diff) {
+			diff = d;
+		}
+
+		in = plant(in, out, gain, 0.05f);
+		in = roundf(in * 256) / 256;
+	}
+
+	check(t->name, "outputs", diff, 0, TOLERANCE);
+	check(t->name, "runs", st.runs, steps, 0);
+
+	pidq_remove(id);
+	return diff;
+}
+
+// Loops of 1, 3 and 10 ticks
+static void periods(void) {
+	const test_t *t = &tests[0];
+	pidq_config_t cfg = config(t, 100);
+	pidq_state_t st;
+	int p[3] = {1, 3, 10}, id[3], i;
+
+	for (i = 0; i < 3; i++) {
+		cfg.period_ms = p[i];
+		pidq_add(&cfg, &id[i]);
+		pidq_enable(id[i], 1);
+	}
+
+	for (i = 0; i < 300; i++) {
+		pidq_tick();
+	}
+
+	for (i = 0; i < 3; i++) {
+		pidq_get_state(id[i], &st);
+		check("period", "runs", st.runs, 300 / p[i], 0);
+		pidq_remove(id[i]);
+	}
+}
+
+// Returns the overshoot of a step from 0 to 80% of the range
+static double step_response(const test_t *t, int antiwindup, float tf, double *err) {
+	pidq_config_t cfg = config(t, 0.8f * t->max);
+	pidq_state_t st;
+	float y = 0;
+	double over = 0;
+	int i, id;
+
+	cfg.antiwindup = antiwindup;
+	cfg.tf = tf;
+	pidq_add(&cfg, &id);
+	pidq_input(id, 0);
+	pidq_enable(id, 1);
+
+	for (i = 0; i < 20000; i++) {
+		pidq_tick();
+		pidq_get_state(id, &st);
+
+		// A slow plant of gain 2, the first steps saturate the output
+		y = plant(y, Q16_TO_F(st.output), 2, 0.002f);
+		pidq_input(id, Q16(y));
+
+		if (y - cfg.setpoint > over) {
+			over = y - cfg.setpoint;
+		}
+	}
+
+	*err = fabs(y - cfg.setpoint) / cfg.setpoint;
+	pidq_remove(id);
+	return over / cfg.setpoint;
+}
+
+static void windup(void) {
+	test_t t = {"windup", 4, 8, 0, 0, 4095, 1, 0};
+	double with, without, err;
+
+	without = step_response(&t, 0, 0, &err);
+	check("settle", "error", err, 0, 0.01);
+	with = step_response(&t, 1, 0, &err);
+	check("settle", "error antiwindup", err, 0, 0.01);
+
+	check("windup", "overshoot > 0", without > 0.01, 1, 0);
+	check("windup", "less overshoot", with < without / 2, 1, 0);
+	printf("%-8s overshoot %.1f%%, %.1f%% with antiwindup\n", "windup", without * 100, with * 100);
+}
+
+// The spread of the derivative on a noisy input
+static double dspread(float tf) {
+	test_t t = {"filter", 0, 0, 0.05, -4000, 4000, 1, 0};
+	pidq_config_t cfg = config(&t, 0);
+	pidq_state_t st;
+	uint32_t seed = 3;
+	double sum = 0;
+	int i, id;
+
+	cfg.tf = tf;
+	pidq_add(&cfg, &id);
+	pidq_input(id, 0);
+	pidq_enable(id, 1);
+
+	for (i = 0; i < 10000; i++) {
+		pidq_input(id, Q16(100 + (int)(rnd(&seed) % 11) - 5));
+		pidq_tick();
+		pidq_get_state(id, &st);
+		if (i > 100) {
+			sum += fabs(Q16_TO_F(st.dterm));
+		}
+	}
+
+	pidq_remove(id);
+	return sum / (10000 - 101);
+}
+
+static void filter(void) {
+	double raw = dspread(0), filtered = dspread(0.05f);
+
+	check("filter", "smaller", filtered < raw / 5, 1, 0);
+	printf("%-8s derivative %.2f, %.2f with tf 50 ms\n", "filter", raw, filtered);
+}
+
+// The input from the acquisition
+static void acq(void) {
+	acq_config_t ac = {1000, 1, 0, ACQ_LAST, 0x02};
+	test_t t = {"acq", 2, 0, 0, 0, 1000, 1, 0};
+	pidq_config_t cfg = config(&t, 200);
+	pidq_state_t st;
+	uint16_t v[ACQ_CHANNELS] = {0, 150, 0, 0, 0};
+	int id;
+
+	cfg.input = 1;
+	pidq_add(&cfg, &id);
+	pidq_enable(id, 1);
+
+	// Not sampled, not stepped
+	pidq_tick();
+	pidq_get_state(id, &st);
+	check("acq", "no sample", st.runs, 0, 0);
+	check("acq", "no input", pidq_input(id, 0) != 0, 1, 0);
+
+	acq_start(&ac);
+	acq_sample(v);
+	pidq_tick();
+	pidq_get_state(id, &st);
+	check("acq", "input", Q16_TO_F(st.input), 150, 0);
+	check("acq", "output", Q16_TO_F(st.output), 100, 0);
+
+	acq_stop();
+	pidq_remove(id);
+}
+
+// The configurations
+static void configs(void) {
+	test_t t = {"config", 1, 1, 0, 0, 100, 10, 0};
+	pidq_config_t cfg = config(&t, 0);
+	int id[PIDQ_LOOPS], i, extra;
+
+	cfg.min = 100;
+	check("config", "min >= max", pidq_add(&cfg, &id[0]) != 0, 1, 0);
+	cfg.min = 0;
+	cfg.kp = -1;
+	check("config", "gain < 0", pidq_add(&cfg, &id[0]) != 0, 1, 0);
+	cfg.kp = 1;
+	cfg.period_ms = 0;
+	check("config", "period", pidq_add(&cfg, &id[0]) != 0, 1, 0);
+	cfg.period_ms = 10;
+	cfg.input = ACQ_CHANNELS;
+	check("config", "input", pidq_add(&cfg, &id[0]) != 0, 1, 0);
+	cfg.input = PIDQ_NO_INPUT;
+	cfg.max = 40000;
+	check("config", "range", pidq_add(&cfg, &id[0]) != 0, 1, 0);
+	cfg.max = 100;
+
+	for (i = 0; i < PIDQ_LOOPS; i++) {
+		check("config", "add", pidq_add(&cfg, &id[i]), 0, 0);
+	}
+	check("config", "full", pidq_add(&cfg, &extra) != 0, 1, 0);
+
+	check("config", "output", pidq_output(id[0], Q16(150)), 0, 0);
+	pidq_enable(id[0], 1);
+	check("config", "enabled output", pidq_output(id[0], 0) != 0, 1, 0);
+
+	for (i = 0; i < PIDQ_LOOPS; i++) {
+		check("config", "remove", pidq_remove(id[i]), 0, 0);
+	}
+	check("config", "removed", pidq_remove(id[0]) != 0, 1, 0);
+}
+
+// Steps per second of PIDQ_LOOPS loops stepped at each tick
+static void bench(int steps, double *flt, double *fix) {
+	const test_t *t = &tests[2];
+	struct pid_controller ctl[PIDQ_LOOPS];
+	pidq_config_t cfg = config(t, 1000);
+	float in[PIDQ_LOOPS], out[PIDQ_LOOPS], sp = 1000;
+	int i, j, id[PIDQ_LOOPS];
+	volatile float sink = 0;
+	double tm;
+
+	for (j = 0; j < PIDQ_LOOPS; j++) {
+		in[j] = j;
+		out[j] = 0;
+		pid_create(&ctl[j], &in[j], &out[j], &sp, t->kp, t->ki, t->kd, 0);
+		pid_limits(&ctl[j], t->min, t->max);
+		pid_auto(&ctl[j]);
+
+		cfg.period_ms = 1;
+		pidq_add(&cfg, &id[j]);
+		pidq_input(id[j], Q16(j));
+		pidq_enable(id[j], 1);
+	}
+
+	tm = now_ms();
+	for (i = 0; i < steps; i++) {
+		for (j = 0; j < PIDQ_LOOPS; j++) {
+			in[j] = (i + j) & 0x3ff;
+			pid_compute(&ctl[j], 0);
+		}
+	}
+	sink = out[0];
+	*flt = (double)steps * PIDQ_LOOPS / (now_ms() - tm) * 1000;
+
+	tm = now_ms();
+	for (i = 0; i < steps; i++) {
+		for (j = 0; j < PIDQ_LOOPS; j++) {
+			pidq_input(id[j], ((i + j) & 0x3ff) << 16);
+		}
+		pidq_tick();
+	}
+	*fix = (double)steps * PIDQ_LOOPS / (now_ms() - tm) * 1000;
+
+	for (j = 0; j < PIDQ_LOOPS; j++) {
+		pidq_remove(id[j]);
+	}
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-n steps] [-r runs]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int steps = 1000000, runs = 3;
+	double flt, fix, best_flt = 0, best_fix = 0;
+	int i, k, c;
+
+	while ((c = getopt(argc, argv, "n:r:")) != -1) {
+		switch (c) {
+			case 'n': steps = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if ((steps < 10000) || (runs < 1)) {
+		usage(argv[0]);
+	}
+
+	configs();
+
+	printf("%-8s %8s %12s\n", "test", "steps", "max diff");
+	for (k = 0; k < N_TESTS; k++) {
+		printf("%-8s %8d %12.2e\n", tests[k].name, 20000, same(k, 20000));
+	}
+
+	periods();
+	windup();
+	filter();
+	acq();
+
+	for (i = 0; i < runs; i++) {
+		bench(steps, &flt, &fix);
+		best_flt = (flt > best_flt) ? flt : best_flt;
+		best_fix = (fix > best_fix) ? fix : best_fix;
+	}
+
+	printf("%-8s %12.0f loop steps/s\n", "float", best_flt);
+	printf("%-8s %12.0f loop steps/s\n", "q16", best_fix);
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
@@ -0,0 +1,15 @@
+/* sysparam.c takes a mutex, the benchmarks have a single task */
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "FreeRTOS.h"
+
+typedef void *xSemaphoreHandle;
+
+#define portMAX_DELAY                       ((TickType_t)0xffffffff)
+
+#define xSemaphoreCreateMutex()             ((xSemaphoreHandle)1)
+#define xSemaphoreTake(s, t)                ((void)(s), 1)
+#define xSemaphoreGive(s)                   ((void)(s), 1)
+
+#endif
@@ -0,0 +1,108 @@
+-- bhgv, smoke run of the host platform
+--
+-- Copyright (C) 2017
+-- Author: bhgv (http://github.com/bhgv)
+--
+-- All rights reserved.
+--
+-- A short pass over what luaos runs of the firmware: the rotable modules,
+-- the GC of objects with a rotable metatable, files on SPIFFS read at any
+-- offset, JSON, and pthread and green threads started and stopped. Meant
+-- to catch a host platform that no longer starts or crashes, not to
+-- measure anything:
+--
+--   make -C platform/host/bench smoke
+
+local fails = 0
+
+local function check(what, ok)
+    if not ok then
+        print("FAIL " .. what)
+        fails = fails + 1
+    end
+end
+
+-- The modules, as rotables
+for _, name in ipairs({"string", "table", "math", "io", "os", "coroutine",
+                       "fs", "tmr", "thread", "sjson", "pack", "httpd", "styx"}) do
+    check("module " .. name, _G[name] ~= nil)
+end
+check("string metatable", type(getmetatable("")) == "rotable")
+
+-- File handles and strings have a rotable metatable, the GC must leave it
+-- alone
+local lines = {}
+for i = 0, 99 do
+    lines[#lines + 1] = string.format("%04d", i) .. string.rep(string.char(65 + i % 26), 27)
+end
+local data = table.concat(lines)
+
+local f = io.open("/smoke.bin", "wb")
+check("file metatable", type(getmetatable(f)) == "rotable")
+for _, line in ipairs(lines) do
+    f:write(line)
+end
+f:close()
+
+for round = 1, 20 do
+    local t = setmetatable({}, {__mode = "v"})
+    for i = 1, 20 do
+        t[i] = io.open("/smoke.bin", "rb")
+        t[i]:close()
+    end
+    t = nil
+    collectgarbage("collect")
+end
+
+-- Reads at odd offsets and lengths, esp_spiffs_read aligns them
+f = io.open("/smoke.bin", "rb")
+check("file size", f:seek("end") == #data)
+for _, pos in ipairs({0, 1, 3, 31, 1001, 3099}) do
+    f:seek("set", pos)
+    check("read at " .. pos, f:read(7) == data:sub(pos + 1, pos + 7))
+end
+f:close()
+os.rm("/smoke.bin")
+
+-- JSON
+local s = sjson.encode({a = 1, b = {1, 2, "x"}})
+local t = sjson.decode(s)
+check("json", t.a == 1 and t.b[3] == "x")
+
+-- A pthread
+local ran = 0
+thread.start(function() ran = ran + 1 end)
+thread.sleepms(100)
+check("pthread ran", ran == 1)
+
+-- Green threads, stopped by another thread and by themselves
+thread.mode("green")
+local ids = {}
+local n = 0
+for i = 1, 4 do
+    ids[i] = thread.start(function()
+        while true do
+            n = n + 1
+            thread.sleepms(10)
+        end
+    end)
+end
+local last
+last = thread.start(function()
+    thread.sleepms(20)
+    thread.stop(last)
+    thread.sleepms(10)
+    ran = 0
+end)
+thread.sleepms(100)
+for i = 1, 4 do
+    thread.stop(ids[i])
+end
+thread.mode("pthread")
+thread.sleepms(300)
+
+check("green threads ran", n > 4)
+check("green thread stopped itself", ran == 1)
+check("green threads freed", thread.list("*n") == 0)
+
+print(fails == 0 and "all checks passed" or fails .. " checks failed")
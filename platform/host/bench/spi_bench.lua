@@ -0,0 +1,38 @@
+-- bhgv, SPI transfer throughput from Lua
+--
+-- Copyright (C) 2017
+-- Author: bhgv (http://github.com/bhgv)
+--
+-- All rights reserved.
+--
+-- Prints the bytes/s of spi.send, spi.transfer (a string, and a data
+-- object received in place) and spi.frames, for transfers of 16, 256 and
+-- 4096 bytes on the HSPI bus. Runs on the board only (copy it to
+-- spiffs_image), the host platform has no SPI module.
+
+local sizes = {16, 256, 4096}
+local min_us = 1000000      -- transfer for at least that long
+
+local SPI_8BIT = 1
+
+-- Bytes/s of f(), that moves n bytes
+local function rate(n, f)
+    local c, t0 = 0, tmr.now_us()
+    while tmr.now_us() - t0 < min_us do
+        f()
+        c = c + n
+    end
+    return c / ((tmr.now_us() - t0) / 1e6)
+end
+
+print(string.format("%6s %10s %10s %10s %10s", "bytes", "send", "transfer", "in place", "frames"))
+for _, n in ipairs(sizes) do
+    local s = string.rep("x", n)
+    local out, inb = data.new(s), data.new(n)
+
+    print(string.format("%6d %10.0f %10.0f %10.0f %10.0f", n,
+        rate(n, function() spi.send(SPI_8BIT, s) end),
+        rate(n, function() spi.transfer(SPI_8BIT, s) end),
+        rate(n, function() spi.transfer(SPI_8BIT, out, inb) end),
+        rate(n, function() spi.frames(SPI_8BIT, out, math.min(n, 64), inb) end)))
+end
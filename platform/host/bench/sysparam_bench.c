@@ -0,0 +1,310 @@
+/*
+ * bhgv, host test and benchmark of the sysparam key index
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * modules/core/sysparam.c on a flash in RAM, with the write rules of the
+ * board's flash (an erase sets a sector to 0xff, a write only clears bits)
+ * and counters of the flash operations. The sets and gets are checked
+ * against a model of the keys, with the FNV-1a index and with the flash
+ * scan used when the index can't be allocated:
+ *
+ *   fill      a few hundred keys, then all of them got back
+ *   update    random sets, deletes and gets, until the region has been
+ *             compacted many times, the model checked after each
+ *   init      sysparam_init() again, the index built from the flash, and
+ *             the keys listed by the iterator
+ *
+ * Then the flash reads and the time of a get, with and without the index.
+ *
+ *   sysparam_bench [-k keys] [-n ops] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sysparam.h>
+#include <espressif/spi_flash.h>
+
+// The area, 2 regions of 4 sectors, after 4 sectors of something else
+#define SECTOR          4096
+#define AREA_SECTOR     4
+#define AREA_SECTORS    8
+#define FLASH_SECTORS   (AREA_SECTOR + AREA_SECTORS + 4)
+
+#define MAX_KEYS        1000
+#define MAX_VALUE       48
+
+typedef struct {
+	char key[16];
+	char value[MAX_VALUE + 1];
+	int set;
+} model_t;
+
+sdk_flashchip_t sdk_flashchip = {
+	.chip_size = FLASH_SECTORS * SECTOR,
+	.sector_size = SECTOR,
+};
+
+static uint8_t flash[FLASH_SECTORS * SECTOR];
+static unsigned int reads, writes, erases;
+
+static model_t model[MAX_KEYS];
+static int keys = 300;
+static uint32_t seed = 1;
+static int no_index = 0;
+
+static int fails = 0;
+
+// calloc of sysparam.c, fails when the scan is tested, see the Makefile
+void *bench_calloc(size_t n, size_t size) {
+	void *p;
+
+	if (no_index || !(p = malloc(n * size))) {
+		return NULL;
+	}
+
+	return memset(p, 0, n * size);
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_erase_sector(uint16_t sec) {
+	if (sec >= FLASH_SECTORS) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	memset(flash + sec * SECTOR, 0xff, SECTOR);
+	erases++;
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_write(uint32_t des_addr, uint32_t *src, uint32_t size) {
+	const uint8_t *s = (const uint8_t *)src;
+	uint32_t i;
+
+	if ((des_addr & 3) || (des_addr + size > sizeof(flash))) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	for (i = 0; i < size; i++) {
+		flash[des_addr + i] &= s[i];
+	}
+	writes++;
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_read(uint32_t src_addr, uint32_t *des, uint32_t size) {
+	if ((src_addr & 3) || (src_addr + size > sizeof(flash))) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	memcpy(des, flash + src_addr, size);
+	reads++;
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+static uint32_t rnd(uint32_t *s) {
+	*s = *s * 1103515245 + 12345;
+	return (*s >> 16) & 0x7fff;
+}
+
+static double now_ms() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void check(const char *test, const char *what, const char *key, int ok) {
+	if (!ok) {
+		printf("%-8s FAIL %s %s\n", test, what, key);
+		fails++;
+	}
+}
+
+static void set(const char *test, model_t *m, int len) {
+	int i;
+
+	for (i = 0; i < len; i++) {
+		m->value[i] = 'a' + rnd(&seed) % 26;
+	}
+	m->value[len] = 0;
+	m->set = 1;
+
+	check(test, "set", m->key, sysparam_set_string(m->key, m->value) == SYSPARAM_OK);
+}
+
+// Not found if the key has no value
+static void del(const char *test, model_t *m) {
+	check(test, "delete", m->key, sysparam_set_data(m->key, NULL, 0, false) == (m->set ? SYSPARAM_OK : SYSPARAM_NOTFOUND));
+	m->set = 0;
+}
+
+static void get(const char *test, model_t *m) {
+	sysparam_status_t status;
+	char *value = NULL;
+
+	status = sysparam_get_string(m->key, &value);
+	if (m->set) {
+		check(test, "get", m->key, (status == SYSPARAM_OK) && value && !strcmp(value, m->value));
+	} else {
+		check(test, "get deleted", m->key, status == SYSPARAM_NOTFOUND);
+	}
+
+	free(value);
+}
+
+static void get_all(const char *test) {
+	int i;
+
+	for (i = 0; i < keys; i++) {
+		get(test, &model[i]);
+	}
+}
+
+static void init(const char *test) {
+	check(test, "init", "", sysparam_init(AREA_SECTOR * SECTOR, 0) == SYSPARAM_OK);
+}
+
+static void fill(const char *test) {
+	int i;
+
+	memset(flash, 0xff, sizeof(flash));
+	memset(model, 0, sizeof(model));
+
+	check(test, "create area", "", sysparam_create_area(AREA_SECTOR * SECTOR, AREA_SECTORS, true) == SYSPARAM_OK);
+	init(test);
+
+	for (i = 0; i < keys; i++) {
+		snprintf(model[i].key, sizeof(model[i].key), "key.%d", i * 7919 % 100000);
+		set(test, &model[i], 1 + rnd(&seed) % 8);
+	}
+
+	get_all(test);
+}
+
+// Random sets, deletes and gets, returns the compactions done
+static int update(const char *test, int ops) {
+	model_t *m;
+	unsigned int e = erases;
+	int i;
+
+	for (i = 0; i < ops; i++) {
+		m = &model[rnd(&seed) % keys];
+
+		switch (rnd(&seed) % 8) {
+			case 0:
+				del(test, m);
+				break;
+			case 1: case 2: case 3:
+				set(test, m, 1 + rnd(&seed) % MAX_VALUE);
+				break;
+			default:
+				get(test, m);
+				break;
+		}
+	}
+
+	get_all(test);
+
+	return (erases - e) / (AREA_SECTORS / 2);
+}
+
+// The iterator lists the keys that have a value, each once
+static void iter(const char *test) {
+	sysparam_iter_t it;
+	int found = 0, set = 0, i;
+
+	check(test, "iter start", "", sysparam_iter_start(&it) == SYSPARAM_OK);
+	while (sysparam_iter_next(&it) == SYSPARAM_OK) {
+		for (i = 0; i < keys; i++) {
+			if (!strcmp(it.key, model[i].key)) {
+				break;
+			}
+		}
+
+		check(test, "iter key", it.key, (i < keys) && model[i].set);
+		found++;
+	}
+	sysparam_iter_end(&it);
+
+	for (i = 0; i < keys; i++) {
+		set += model[i].set;
+	}
+
+	check(test, "iter count", "", found == set);
+}
+
+// Flash reads and us per get of all the keys
+static void bench(const char *name, int runs) {
+	unsigned int r = reads;
+	double t0 = now_ms();
+	int i, k;
+
+	for (i = 0; i < runs; i++) {
+		for (k = 0; k < keys; k++) {
+			get("bench", &model[k]);
+		}
+	}
+
+	printf("%-8s %8d %12.1f %12.2f\n", name, keys, (double)(reads - r) / (runs * keys),
+		(now_ms() - t0) * 1000.0 / (runs * keys));
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-k keys] [-n ops] [-s seed]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	int ops = 20000;
+	int c;
+
+	while ((c = getopt(argc, argv, "k:n:s:")) != -1) {
+		switch (c) {
+			case 'k': keys = atoi(optarg); break;
+			case 'n': ops = atoi(optarg); break;
+			case 's': seed = atoi(optarg); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if ((keys < 1) || (keys > MAX_KEYS) || (ops < 0)) {
+		usage(argv[0]);
+	}
+
+	printf("%-8s %8s %12s %12s\n", "index", "keys", "compactions", "erases");
+	for (no_index = 0; no_index < 2; no_index++) {
+		const char *name = no_index ? "scan" : "fnv1a";
+
+		erases = 0;
+		fill(name);
+		c = update(name, ops);
+		init(name);
+		get_all(name);
+		iter(name);
+
+		check(name, "compacted", "", c > 0);
+		printf("%-8s %8d %12d %12u\n", name, keys, c, erases);
+	}
+
+	printf("%-8s %8s %12s %12s\n", "index", "keys", "reads/get", "us/get");
+	for (no_index = 0; no_index < 2; no_index++) {
+		fill("bench");
+		bench(no_index ? "scan" : "fnv1a", 20);
+	}
+
+	printf(fails ? "%d checks failed\n" : "all checks passed\n", fails);
+	return fails != 0;
+}
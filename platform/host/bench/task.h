@@ -0,0 +1,17 @@
+/* heap_4.c includes task.h for vTaskSuspendAll(), see FreeRTOS.h */
+#include "FreeRTOS.h"
+
+/* and delay.c for the scheduler, see clock_bench.c */
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#define taskSCHEDULER_NOT_STARTED           1
+#define taskSCHEDULER_RUNNING               2
+
+extern int bench_in_isr;
+#define portIN_ISR()                        (bench_in_isr)
+
+void vTaskDelay(const TickType_t xTicksToDelay);
+BaseType_t xTaskGetSchedulerState(void);
+
+#endif
@@ -0,0 +1,76 @@
+-- bhgv, Lua callbacks of the high resolution timers
+--
+-- Copyright (C) 2017
+-- Author: bhgv (http://github.com/bhgv)
+--
+-- All rights reserved.
+--
+-- Checks that the expiration of a detached callback, still queued, is not
+-- run as the one of the callback attached next in its slot, then prints
+-- how late tmr.dispatch runs the callbacks of a periodic timer. Runs on
+-- the board (copy it to spiffs_image) or on the host platform:
+--
+--   make -C platform/host/bench tmr
+
+local timers = 8            -- TMR_LUA_TIMERS of tmr.c
+local period = 2000         -- us
+local min_us = 500000       -- run the periodic timer for at least that long
+
+local fails = 0
+
+local function check(what, ok)
+    if not ok then
+        print("FAIL " .. what)
+        fails = fails + 1
+    end
+end
+
+-- Expires now, and is detached before tmr.dispatch
+local function expired(ran)
+    local id = tmr.attach(100, function() ran.old = ran.old + 1 end)
+    tmr.delayus(20000)
+    tmr.detach(id)
+    return id
+end
+
+-- A free slot is taken
+local ran = {old = 0, new = 0}
+expired(ran)
+local id = tmr.attach(1000000, function() ran.new = ran.new + 1 end)
+check("dispatch, free slot", tmr.dispatch() == 0)
+check("old callback, free slot", ran.old == 0)
+check("new callback, free slot", ran.new == 0)
+tmr.detach(id)
+
+-- The only free slot is the one of the detached callback
+ran = {old = 0, new = 0}
+local busy = {}
+for i = 1, timers - 1 do
+    busy[i] = tmr.attach(1000000, function() end)
+end
+local old = expired(ran)
+id = tmr.attach(1000000, function() ran.new = ran.new + 1 end)
+check("slot reused", id == old)
+check("dispatch, reused slot", tmr.dispatch() == 0)
+check("old callback, reused slot", ran.old == 0)
+check("new callback, reused slot", ran.new == 0)
+tmr.detach(id)
+for i = 1, timers - 1 do
+    tmr.detach(busy[i])
+end
+
+-- Late and missed expirations of a periodic timer
+local runs = 0
+id = tmr.attach(period, function() runs = runs + 1 end, period)
+local t0 = tmr.now_us()
+repeat
+    tmr.dispatch()
+until tmr.now_us() - t0 >= min_us
+local st = tmr.stats(id)
+tmr.detach(id)
+
+print(string.format("%8s %8s %8s %8s %8s", "period", "runs", "late_avg", "late_max", "missed"))
+print(string.format("%8d %8d %8d %8d %8d", period, runs, st.late_avg, st.late_max, st.missed))
+check("periodic runs", runs > 0 and runs + st.missed <= st.runs)
+
+print(fails == 0 and "all checks passed" or fails .. " checks failed")
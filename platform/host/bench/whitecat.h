@@ -0,0 +1,17 @@
+/*
+ * bhgv, configuration of the socket benchmark: the Lua/modules/sock.c of
+ * the firmware on the sockets of the host.
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef WHITECAT_H
+#define WHITECAT_H
+
+#define LUA_USE_NET 1
+
+#endif
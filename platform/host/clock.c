@@ -0,0 +1,64 @@
+/*
+ * bhgv, clock and delays of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#include "FreeRTOS.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sys/delay.h>
+#include <sys/drivers/clock.h>
+
+// Shorter delays are spinned, the sleep latency of the host is about this
+#define SPIN_US 100
+
+uint64_t clock_monotonic_us(void) {
+	static struct timespec boot = {0, 0};
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	// First call is from the single threaded start up (main)
+	if (!boot.tv_sec && !boot.tv_nsec) {
+		boot = now;
+	}
+
+	return (uint64_t)(now.tv_sec - boot.tv_sec) * 1000000 +
+	       (now.tv_nsec - boot.tv_nsec) / 1000;
+}
+
+/*
+ * Wait usec microseconds. As on the board (sys/platform/esp8266/delay.c),
+ * other threads can run during long delays, and short ones are spinned.
+ */
+static void delay_us(uint64_t usec) {
+	struct timespec ts;
+	uint64_t end;
+
+	if (usec < SPIN_US) {
+		end = clock_monotonic_us() + usec;
+		while (clock_monotonic_us() < end);
+		return;
+	}
+
+	ts.tv_sec = usec / 1000000;
+	ts.tv_nsec = (usec % 1000000) * 1000;
+
+	while (nanosleep(&ts, &ts) && (errno == EINTR));
+}
+
+void delay(unsigned int msec) {
+	delay_us((uint64_t)msec * 1000);
+}
+
+void udelay(unsigned int usec) {
+	delay_us(usec);
+}
@@ -0,0 +1,120 @@
+/*
+ * bhgv, SPI flash of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The flash is an image file mapped in memory, so it survives runs and can
+ * be made or inspected with mkspiffs. A new image is created erased. Writes
+ * can only clear bits, like on the real flash, so a missing erase in the
+ * SPIFFS layer shows up the same way.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "spi_flash.h"
+
+#include "host.h"
+
+static uint8_t *flash = NULL;
+static uint32_t flash_size = 0;
+
+int host_flash_open(const char *path, uint32_t size) {
+	struct stat sb;
+	int fd, created = 0;
+
+	fd = open(path, O_RDWR);
+	if (fd < 0) {
+		fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (fd < 0) {
+			return -1;
+		}
+
+		if (ftruncate(fd, size) < 0) {
+			close(fd);
+			return -1;
+		}
+
+		created = 1;
+	}
+
+	if (fstat(fd, &sb) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	// An existing image has its own size
+	flash_size = sb.st_size;
+
+	flash = mmap(NULL, flash_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (flash == MAP_FAILED) {
+		flash = NULL;
+		return -1;
+	}
+
+	if (created) {
+		memset(flash, 0xff, flash_size);
+	}
+
+	return created;
+}
+
+void host_flash_close() {
+	if (flash) {
+		msync(flash, flash_size, MS_SYNC);
+		munmap(flash, flash_size);
+		flash = NULL;
+	}
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_erase_sector(uint16_t sec) {
+	uint32_t addr = (uint32_t)sec * SPI_FLASH_SEC_SIZE;
+
+	if (!flash || (addr + SPI_FLASH_SEC_SIZE > flash_size)) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	memset(flash + addr, 0xff, SPI_FLASH_SEC_SIZE);
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_write(uint32_t des_addr, uint32_t *src, uint32_t size) {
+	uint8_t *s = (uint8_t *)src;
+	uint8_t *d;
+
+	if (!flash || (des_addr + size > flash_size) || (des_addr + size < des_addr)) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	d = flash + des_addr;
+	while (size--) {
+		*d++ &= *s++;
+	}
+
+	return SPI_FLASH_RESULT_OK;
+}
+
+sdk_SpiFlashOpResult sdk_spi_flash_read(uint32_t src_addr, uint32_t *des, uint32_t size) {
+	if (!flash || (src_addr + size > flash_size) || (src_addr + size < src_addr)) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+
+	memcpy(des, flash + src_addr, size);
+
+	return SPI_FLASH_RESULT_OK;
+}
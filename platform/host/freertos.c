@@ -0,0 +1,417 @@
+/*
+ * bhgv, FreeRTOS API of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Tasks are detached pthreads and queues are a ring buffer protected by a
+ * mutex, with a condition variable for each side. Semaphores are queues of
+ * 0 sized items, as in FreeRTOS, except the recursive mutex, which keeps
+ * its owner and nesting count.
+ *
+ * Timeouts are in ticks of portTICK_PERIOD_MS, measured on CLOCK_MONOTONIC.
+ */
+
+#define HOST_PTHREAD_NATIVE
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+
+#include "host.h"
+
+struct host_task {
+	pthread_t thread;
+	TaskFunction_t func;
+	void *args;
+};
+
+struct host_queue {
+	pthread_mutex_t mtx;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+
+	UBaseType_t length;
+	UBaseType_t item_size;
+	UBaseType_t count;
+	UBaseType_t head;
+	uint8_t *items;
+
+	// Recursive mutex
+	pthread_t owner;
+	UBaseType_t nesting;
+};
+
+pthread_mutex_t host_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static struct timespec boot_time;
+static pthread_once_t boot_once = PTHREAD_ONCE_INIT;
+
+// Set in the hrtimer thread, see portIN_ISR
+__thread int host_in_isr = 0;
+
+// Lua state of the running thread, and of the first one (the Lua thread)
+static __thread lua_State *task_L = NULL;
+static lua_State *gL = NULL;
+
+static __thread struct host_task *current_task = NULL;
+
+static void boot_init() {
+	clock_gettime(CLOCK_MONOTONIC, &boot_time);
+}
+
+void host_deadline(struct timespec *ts, uint64_t ms) {
+	clock_gettime(CLOCK_MONOTONIC, ts);
+
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+static void cond_init(pthread_cond_t *cond) {
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+// Wait on cond until the deadline, portMAX_DELAY waits forever
+static int cond_wait(pthread_cond_t *cond, pthread_mutex_t *mtx, TickType_t ticks, struct timespec *deadline) {
+	if (ticks == portMAX_DELAY) {
+		return pthread_cond_wait(cond, mtx);
+	}
+
+	return pthread_cond_timedwait(cond, mtx, deadline);
+}
+
+void vPortEnterCritical(void) {
+	pthread_mutex_lock(&host_critical);
+}
+
+void vPortExitCritical(void) {
+	pthread_mutex_unlock(&host_critical);
+}
+
+TickType_t xTaskGetTickCount(void) {
+	struct timespec now;
+
+	pthread_once(&boot_once, boot_init);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (TickType_t)(((uint64_t)(now.tv_sec - boot_time.tv_sec) * 1000 +
+	                     (now.tv_nsec - boot_time.tv_nsec) / 1000000) / portTICK_PERIOD_MS);
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+	struct timespec ts;
+
+	if (xTicksToDelay == 0) {
+		sched_yield();
+		return;
+	}
+
+	ts.tv_sec = (xTicksToDelay * portTICK_PERIOD_MS) / 1000;
+	ts.tv_nsec = ((xTicksToDelay * portTICK_PERIOD_MS) % 1000) * 1000000;
+
+	while (nanosleep(&ts, &ts) && (errno == EINTR));
+}
+
+void vTaskYield(void) {
+	sched_yield();
+}
+
+static void *task_start(void *arg) {
+	struct host_task *task = (struct host_task *)arg;
+
+	current_task = task;
+	task->func(task->args);
+
+	return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char *pcName,
+                       uint16_t usStackDepth, void *pvParameters,
+                       UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask) {
+	struct host_task *task;
+	pthread_attr_t attr;
+	size_t stack = (size_t)usStackDepth * 4;
+	int res;
+
+	task = (struct host_task *)calloc(1, sizeof(struct host_task));
+	if (!task) {
+		return pdFAIL;
+	}
+
+	task->func = pvTaskCode;
+	task->args = pvParameters;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, (stack < HOST_STACK_MIN) ? HOST_STACK_MIN : stack);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	res = pthread_create(&task->thread, &attr, task_start, task);
+	pthread_attr_destroy(&attr);
+
+	if (res) {
+		free(task);
+		return pdFAIL;
+	}
+
+	if (pxCreatedTask) {
+		*pxCreatedTask = task;
+	}
+
+	return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTask) {
+	if (!xTask) {
+		xTask = current_task;
+	}
+
+	if (xTask == current_task) {
+		// The task struct is freed by the thread itself
+		free(xTask);
+		current_task = NULL;
+		pthread_exit(NULL);
+	}
+
+	if (xTask) {
+		pthread_cancel(xTask->thread);
+		free(xTask);
+	}
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+	return current_task;
+}
+
+// WHITECAT BEGIN
+void uxSetLuaState(lua_State *L) {
+	task_L = L;
+
+	// If this is the first thread (Lua thread) store
+	// state in global state
+	if (gL == NULL) {
+		gL = L;
+	}
+}
+
+lua_State *pvGetLuaState() {
+	return task_L ? task_L : gL;
+}
+// WHITECAT END
+
+static QueueHandle_t queue_new(UBaseType_t length, UBaseType_t item_size) {
+	struct host_queue *q;
+
+	q = (struct host_queue *)calloc(1, sizeof(struct host_queue));
+	if (!q) {
+		return NULL;
+	}
+
+	if (item_size) {
+		q->items = (uint8_t *)malloc(length * item_size);
+		if (!q->items) {
+			free(q);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&q->mtx, NULL);
+	cond_init(&q->not_empty);
+	cond_init(&q->not_full);
+
+	q->length = length;
+	q->item_size = item_size;
+
+	return q;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+	return queue_new(uxQueueLength, uxItemSize);
+}
+
+void vQueueDelete(QueueHandle_t xQueue) {
+	if (!xQueue) {
+		return;
+	}
+
+	pthread_cond_destroy(&xQueue->not_full);
+	pthread_cond_destroy(&xQueue->not_empty);
+	pthread_mutex_destroy(&xQueue->mtx);
+
+	free(xQueue->items);
+	free(xQueue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait) {
+	struct timespec deadline;
+
+	if (xTicksToWait != portMAX_DELAY) {
+		host_deadline(&deadline, (uint64_t)xTicksToWait * portTICK_PERIOD_MS);
+	}
+
+	pthread_mutex_lock(&xQueue->mtx);
+
+	while (xQueue->count == xQueue->length) {
+		if (!xTicksToWait || cond_wait(&xQueue->not_full, &xQueue->mtx, xTicksToWait, &deadline)) {
+			pthread_mutex_unlock(&xQueue->mtx);
+			return errQUEUE_FULL;
+		}
+	}
+
+	if (xQueue->item_size) {
+		UBaseType_t tail = (xQueue->head + xQueue->count) % xQueue->length;
+
+		memcpy(xQueue->items + tail * xQueue->item_size, pvItemToQueue, xQueue->item_size);
+	}
+
+	xQueue->count++;
+
+	pthread_cond_signal(&xQueue->not_empty);
+	pthread_mutex_unlock(&xQueue->mtx);
+
+	return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken) {
+	if (pxHigherPriorityTaskWoken) {
+		*pxHigherPriorityTaskWoken = pdFALSE;
+	}
+
+	return xQueueSend(xQueue, pvItemToQueue, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait) {
+	struct timespec deadline;
+
+	if (xTicksToWait != portMAX_DELAY) {
+		host_deadline(&deadline, (uint64_t)xTicksToWait * portTICK_PERIOD_MS);
+	}
+
+	pthread_mutex_lock(&xQueue->mtx);
+
+	while (xQueue->count == 0) {
+		if (!xTicksToWait || cond_wait(&xQueue->not_empty, &xQueue->mtx, xTicksToWait, &deadline)) {
+			pthread_mutex_unlock(&xQueue->mtx);
+			return errQUEUE_EMPTY;
+		}
+	}
+
+	if (xQueue->item_size) {
+		memcpy(pvBuffer, xQueue->items + xQueue->head * xQueue->item_size, xQueue->item_size);
+	}
+
+	xQueue->head = (xQueue->head + 1) % xQueue->length;
+	xQueue->count--;
+
+	pthread_cond_signal(&xQueue->not_full);
+	pthread_mutex_unlock(&xQueue->mtx);
+
+	return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue) {
+	pthread_mutex_lock(&xQueue->mtx);
+
+	xQueue->head = 0;
+	xQueue->count = 0;
+
+	pthread_cond_broadcast(&xQueue->not_full);
+	pthread_mutex_unlock(&xQueue->mtx);
+
+	return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+	UBaseType_t count;
+
+	pthread_mutex_lock(&xQueue->mtx);
+	count = xQueue->count;
+	pthread_mutex_unlock(&xQueue->mtx);
+
+	return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount) {
+	QueueHandle_t q = queue_new(uxMaxCount, 0);
+
+	if (q) {
+		q->count = uxInitialCount;
+	}
+
+	return q;
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+	return queue_new(1, 0);
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t xMutex, TickType_t xTicksToWait) {
+	struct timespec deadline;
+	pthread_t self = pthread_self();
+
+	if (xTicksToWait != portMAX_DELAY) {
+		host_deadline(&deadline, (uint64_t)xTicksToWait * portTICK_PERIOD_MS);
+	}
+
+	pthread_mutex_lock(&xMutex->mtx);
+
+	if (xMutex->nesting && pthread_equal(xMutex->owner, self)) {
+		xMutex->nesting++;
+		pthread_mutex_unlock(&xMutex->mtx);
+		return pdPASS;
+	}
+
+	while (xMutex->nesting) {
+		if (!xTicksToWait || cond_wait(&xMutex->not_full, &xMutex->mtx, xTicksToWait, &deadline)) {
+			pthread_mutex_unlock(&xMutex->mtx);
+			return pdFAIL;
+		}
+	}
+
+	xMutex->owner = self;
+	xMutex->nesting = 1;
+
+	pthread_mutex_unlock(&xMutex->mtx);
+
+	return pdPASS;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t xMutex) {
+	BaseType_t res = pdFAIL;
+
+	pthread_mutex_lock(&xMutex->mtx);
+
+	if (xMutex->nesting && pthread_equal(xMutex->owner, pthread_self())) {
+		if (--xMutex->nesting == 0) {
+			pthread_cond_signal(&xMutex->not_full);
+		}
+
+		res = pdPASS;
+	}
+
+	pthread_mutex_unlock(&xMutex->mtx);
+
+	return res;
+}
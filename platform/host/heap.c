@@ -0,0 +1,199 @@
+/*
+ * bhgv, heap of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The firmware heap functions are wrapped (-Wl,--wrap=malloc ...) like on
+ * the board (sys/syscalls/newlib.c), so the host runs with a heap of the
+ * same size: allocations over the limit fail, and as on the board a full
+ * Lua garbage collection is run before giving up.
+ *
+ * The size of a block is taken from the libc allocator, so there is no block
+ * header and blocks allocated inside libc (strdup, getcwd ...) can be freed
+ * by the firmware. The used count is signed, as those blocks are released
+ * without being reserved.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "lua.h"
+
+#include "host.h"
+
+extern void luaC_fullgc (lua_State *L, int isemergency);
+
+extern void *__real_malloc(size_t bytes);
+extern void *__real_calloc(size_t n, size_t bytes);
+extern void *__real_realloc(void *ptr, size_t bytes);
+extern void __real_free(void *ptr);
+
+size_t host_heap_size = HOST_HEAP_SIZE;
+
+static long heap_used = 0;
+static long heap_max_used = 0;
+
+static void heap_update_max(long used) {
+	long max = __atomic_load_n(&heap_max_used, __ATOMIC_RELAXED);
+
+	while ((used > max) && !__atomic_compare_exchange_n(&heap_max_used, &max, used, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static int heap_reserve(size_t bytes) {
+	long used = __atomic_add_fetch(&heap_used, bytes, __ATOMIC_RELAXED);
+
+	if (used > (long)host_heap_size) {
+		__atomic_sub_fetch(&heap_used, bytes, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	heap_update_max(used);
+
+	return 1;
+}
+
+static void heap_release(size_t bytes) {
+	__atomic_sub_fetch(&heap_used, bytes, __ATOMIC_RELAXED);
+}
+
+static void heap_collect() {
+	lua_State *L = pvGetLuaState();
+
+	if (L) {
+		lua_lock(L);
+		luaC_fullgc(L, 1);
+		lua_unlock(L);
+	}
+}
+
+static void *heap_malloc(size_t bytes) {
+	void *ptr = __real_malloc(bytes);
+
+	if (ptr && !heap_reserve(malloc_usable_size(ptr))) {
+		__real_free(ptr);
+		ptr = NULL;
+	}
+
+	return ptr;
+}
+
+static void *heap_calloc(size_t n, size_t bytes) {
+	void *ptr = __real_calloc(n, bytes);
+
+	if (ptr && !heap_reserve(malloc_usable_size(ptr))) {
+		__real_free(ptr);
+		ptr = NULL;
+	}
+
+	return ptr;
+}
+
+static void *heap_realloc(void *ptr, size_t bytes) {
+	size_t old = ptr ? malloc_usable_size(ptr) : 0;
+	size_t grow = (bytes > old) ? (bytes - old) : 0;
+	void *nptr;
+
+	// Reserve the growth first, a failed realloc keeps the block
+	if (grow && !heap_reserve(grow)) {
+		return NULL;
+	}
+
+	nptr = __real_realloc(ptr, bytes);
+	heap_release(grow);
+	if (!nptr) {
+		return NULL;
+	}
+
+	// Account the real size, the slack of the allocator can go over the limit
+	heap_release(old);
+	heap_update_max(__atomic_add_fetch(&heap_used, malloc_usable_size(nptr), __ATOMIC_RELAXED));
+
+	return nptr;
+}
+
+// If memory cannot be allocated, launch Lua garbage collector and
+// try again with the hope that then more memory will be available
+void *__wrap_malloc(size_t bytes) {
+	void *ptr = heap_malloc(bytes);
+
+	if (!ptr) {
+		heap_collect();
+		ptr = heap_malloc(bytes);
+	}
+
+	return ptr;
+}
+
+void *__wrap_calloc(size_t n, size_t bytes) {
+	void *ptr = heap_calloc(n, bytes);
+
+	if (!ptr) {
+		heap_collect();
+		ptr = heap_calloc(n, bytes);
+	}
+
+	return ptr;
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr) {
+		heap_release(malloc_usable_size(ptr));
+		__real_free(ptr);
+	}
+}
+
+void *__wrap_realloc(void *ptr, size_t bytes) {
+	void *nptr;
+
+	if (bytes == 0) {
+		__wrap_free(ptr);
+		return NULL;
+	}
+
+	nptr = heap_realloc(ptr, bytes);
+	if (!nptr) {
+		heap_collect();
+		nptr = heap_realloc(ptr, bytes);
+	}
+
+	return nptr;
+}
+
+void *pvPortMalloc(size_t xWantedSize) {
+	return __wrap_malloc(xWantedSize);
+}
+
+void vPortFree(void *pv) {
+	__wrap_free(pv);
+}
+
+size_t xPortGetFreeHeapSize(void) {
+	long used = __atomic_load_n(&heap_used, __ATOMIC_RELAXED);
+
+	if (used < 0) {
+		used = 0;
+	}
+
+	return (used < (long)host_heap_size) ? (host_heap_size - used) : 0;
+}
+
+size_t xPortGetMinimumEverFreeHeapSize(void) {
+	long max = __atomic_load_n(&heap_max_used, __ATOMIC_RELAXED);
+
+	return (max < (long)host_heap_size) ? (host_heap_size - max) : 0;
+}
+
+// The libc heap is not the one of the board, its blocks are only counted,
+// so the free bytes are in one piece
+size_t xPortGetLargestFreeBlockSize(void) {
+	return xPortGetFreeHeapSize();
+}
@@ -0,0 +1,58 @@
+/*
+ * bhgv, host platform internals
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Heap size, bigger than the board's as pointers are 64 bit (see -m)
+#ifndef HOST_HEAP_SIZE
+#define HOST_HEAP_SIZE (512 * 1024)
+#endif
+
+// Minimum stack of a thread. The board sizes are for a 32 bit CPU without
+// libc buffers on the stack, so they are too small here.
+#ifndef HOST_STACK_MIN
+#define HOST_STACK_MIN (256 * 1024)
+#endif
+
+// Flash image size, as the board's 4 MB flash (see -f)
+#ifndef HOST_FLASH_SIZE
+#define HOST_FLASH_SIZE (4 * 1024 * 1024)
+#endif
+
+extern size_t host_heap_size;
+
+// Added to the listening ports, to run without root (see -p)
+extern int host_port_offset;
+
+// Critical sections are this recursive mutex. The hrtimer callbacks, the
+// "interrupts" of the host, run with it held.
+extern pthread_mutex_t host_critical;
+
+// Returns 1 if a new, erased, image was created
+int host_flash_open(const char *path, uint32_t size);
+void host_flash_close();
+
+// Mount SPIFFS, formatting the flash if there is no file system on it
+int host_vfs_mount();
+void host_vfs_unmount();
+
+// Absolute CLOCK_MONOTONIC time, ms milliseconds from now
+void host_deadline(struct timespec *ts, uint64_t ms);
+
+// Terminal of the console in raw mode, restored at exit
+void host_console_init();
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * bhgv, high resolution software timers of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Same API and resolution as the FRC1 timer wheel of the board
+ * (sys/drivers/hrtimer.c), on a timer thread, but the fast callback of the
+ * step generator. The pending timers are in a list sorted by expiration,
+ * and the thread sleeps until the first one.
+ *
+ * The callbacks run with the critical section lock held, so as on the
+ * board they never run inside a critical section of another thread.
+ */
+
+#define HOST_PTHREAD_NATIVE
+
+#include "FreeRTOS.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <sys/drivers/clock.h>
+#include <sys/drivers/hrtimer.h>
+
+#include "host.h"
+
+LIST_HEAD(hrtimer_list, hrtimer);
+
+static struct hrtimer_list timers = LIST_HEAD_INITIALIZER(timers);
+static pthread_cond_t timers_cond;
+static pthread_t timers_thread;
+static int inited = 0;
+
+static uint32_t count = 0;
+static uint32_t irqs = 0;
+static uint32_t runs = 0;
+static uint32_t late_max = 0;
+static uint64_t late_sum = 0;
+
+static inline uint32_t now_ticks() {
+	return (uint32_t)(clock_monotonic_us() / HRTIMER_RES_US);
+}
+
+static void internal_add(hrtimer_t *t) {
+	hrtimer_t *c, *last = NULL;
+
+	LIST_FOREACH(c, &timers, entry) {
+		if ((int32_t)(c->expires - t->expires) > 0) {
+			break;
+		}
+
+		last = c;
+	}
+
+	if (c) {
+		LIST_INSERT_BEFORE(c, t, entry);
+	} else if (last) {
+		LIST_INSERT_AFTER(last, t, entry);
+	} else {
+		LIST_INSERT_HEAD(&timers, t, entry);
+	}
+
+	t->pending = 1;
+	count++;
+}
+
+static void internal_del(hrtimer_t *t) {
+	LIST_REMOVE(t, entry);
+
+	t->pending = 0;
+	count--;
+}
+
+static void *hrtimer_task(void *arg) {
+	struct timespec deadline;
+	hrtimer_t *t;
+	uint32_t now, late;
+	int32_t wait;
+
+	// This thread is the interrupt context
+	host_in_isr = 1;
+
+	pthread_mutex_lock(&host_critical);
+
+	for(;;) {
+		t = LIST_FIRST(&timers);
+		if (!t) {
+			pthread_cond_wait(&timers_cond, &host_critical);
+			continue;
+		}
+
+		now = now_ticks();
+		wait = (int32_t)(t->expires - now);
+		if (wait > 0) {
+			host_deadline(&deadline, 0);
+			deadline.tv_sec += ((uint64_t)wait * HRTIMER_RES_US) / 1000000;
+			deadline.tv_nsec += (((uint64_t)wait * HRTIMER_RES_US) % 1000000) * 1000;
+			if (deadline.tv_nsec >= 1000000000) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+
+			pthread_cond_timedwait(&timers_cond, &host_critical, &deadline);
+			continue;
+		}
+
+		irqs++;
+
+		// Run all the expired timers
+		while ((t = LIST_FIRST(&timers)) && ((int32_t)(now - t->expires) >= 0)) {
+			internal_del(t);
+
+			late = (now - t->expires) * HRTIMER_RES_US;
+
+			t->runs++;
+			t->late_sum += late;
+			if (late > t->late_max) {
+				t->late_max = late;
+			}
+
+			runs++;
+			late_sum += late;
+			if (late > late_max) {
+				late_max = late;
+			}
+
+			if (t->period) {
+				t->expires += t->period;
+				if ((int32_t)(now - t->expires) > 0) {
+					// Overrun, skip the missed periods
+					t->expires = now + t->period;
+				}
+
+				internal_add(t);
+			}
+
+			t->cb(t->arg);
+		}
+	}
+
+	return NULL;
+}
+
+static int hrtimer_setup() {
+	pthread_condattr_t cattr;
+	pthread_attr_t attr;
+	int res;
+
+	if (inited) {
+		return 0;
+	}
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&timers_cond, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, HOST_STACK_MIN);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	res = pthread_create(&timers_thread, &attr, hrtimer_task, NULL);
+	pthread_attr_destroy(&attr);
+	if (res) {
+		pthread_cond_destroy(&timers_cond);
+		return res;
+	}
+
+	inited = 1;
+
+	return 0;
+}
+
+void hrtimer_init(hrtimer_t *t, hrtimer_cb_t cb, void *arg) {
+	memset(t, 0, sizeof(hrtimer_t));
+
+	t->cb = cb;
+	t->arg = arg;
+}
+
+int hrtimer_start(hrtimer_t *t, uint32_t us, uint32_t period_us) {
+	int res;
+
+	pthread_mutex_lock(&host_critical);
+
+	if ((res = hrtimer_setup())) {
+		pthread_mutex_unlock(&host_critical);
+		return res;
+	}
+
+	if (t->pending) {
+		internal_del(t);
+	}
+
+	// Never run early
+	t->expires = now_ticks() + (us + HRTIMER_RES_US - 1) / HRTIMER_RES_US;
+	t->period = (period_us + HRTIMER_RES_US - 1) / HRTIMER_RES_US;
+
+	internal_add(t);
+
+	pthread_cond_signal(&timers_cond);
+	pthread_mutex_unlock(&host_critical);
+
+	return 0;
+}
+
+void hrtimer_stop(hrtimer_t *t) {
+	pthread_mutex_lock(&host_critical);
+
+	if (t->pending) {
+		internal_del(t);
+	}
+
+	t->period = 0;
+
+	pthread_mutex_unlock(&host_critical);
+}
+
+int hrtimer_pending(hrtimer_t *t) {
+	return t->pending;
+}
+
+void hrtimer_get_stats(hrtimer_stats_t *st) {
+	pthread_mutex_lock(&host_critical);
+
+	st->timers = count;
+	st->irqs = irqs;
+	st->runs = runs;
+	st->late_max = late_max;
+	st->late_avg = runs ? late_sum / runs : 0;
+
+	pthread_mutex_unlock(&host_critical);
+}
+
+void hrtimer_reset_stats() {
+	pthread_mutex_lock(&host_critical);
+
+	irqs = 0;
+	runs = 0;
+	late_max = 0;
+	late_sum = 0;
+
+	pthread_mutex_unlock(&host_critical);
+}
@@ -0,0 +1,61 @@
+/*
+ * bhgv, I2C of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * An empty bus: no device acknowledges its address, so the drivers take
+ * their "no device" paths, and reads return an idle (high) bus.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <sys/drivers/i2c-platform.h>
+
+// The Lua threads are pthreads without a task
+#define I2C_SELF() ((uintptr_t)pthread_self())
+
+#include <sys/drivers/i2c_lock.inc>
+
+static uint8_t dly_us = 2;
+
+uint8_t i2c_master_set_delay_us(uint8_t us) {
+	uint8_t ous = dly_us;
+
+	dly_us = us;
+
+	return ous;
+}
+
+uint32_t platform_i2c_setup(unsigned id, uint8_t sda, uint8_t scl, uint32_t speed) {
+	i2c_lock_init();
+
+	return speed;
+}
+
+void platform_i2c_send_start(unsigned id) {
+	i2c_lock_start(id);
+}
+
+void platform_i2c_send_stop(unsigned id) {
+	i2c_lock_stop(id);
+}
+
+int platform_i2c_send_address(unsigned id, uint16_t address, int direction) {
+	// Not acknowledged
+	return 0;
+}
+
+int platform_i2c_send_byte(unsigned id, uint8_t data) {
+	return 0;
+}
+
+int platform_i2c_recv_byte(unsigned id, int ack) {
+	return 0xff;
+}
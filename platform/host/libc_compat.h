@@ -0,0 +1,25 @@
+/*
+ * bhgv, newlib functions missing in the host libc
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * Included in every file (see Makefile), as newlib declares them in its
+ * standard headers. They are in stubs.c.
+ *
+ */
+
+#ifndef _LIBC_COMPAT_H_
+#define _LIBC_COMPAT_H_
+
+#include <features.h>
+#include <stddef.h>
+
+#if !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#endif
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * bhgv, main program of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Usage: luaos [-f image] [-c dir] [-p offset] [-m heap]
+ *
+ *   -f image   flash image file, created erased and formatted if missing
+ *              (default flash.img)
+ *   -c dir     copy the files of a host directory into SPIFFS first
+ *   -p offset  added to the listening ports, so httpd on 80 can run
+ *              without root on 80 + offset
+ *   -m heap    heap size in bytes (default HOST_HEAP_SIZE)
+ *
+ * Then starts the Lua interpreter in a thread, as the board does in
+ * user_init (main/main.c).
+ */
+
+#define HOST_PTHREAD_NATIVE
+
+#include "FreeRTOS.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <sys/drivers/clock.h>
+
+#include "host.h"
+
+extern void _console_init();
+
+int luaos_main(void);
+
+static const char *copy_root;
+
+static int copy_file(const char *src, const char *dst) {
+	char buf[1024];
+	FILE *fp;
+	ssize_t len;
+	int fd;
+
+	// open is not wrapped, so it is the host file
+	fd = open(src, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	fp = fopen(dst, "w");
+	if (!fp) {
+		close(fd);
+		return -1;
+	}
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		if (fwrite(buf, 1, len, fp) != (size_t)len) {
+			len = -1;
+			break;
+		}
+	}
+
+	fclose(fp);
+	close(fd);
+
+	return len < 0 ? -1 : 0;
+}
+
+static int copy_entry(const char *path, const struct stat *sb, int type, struct FTW *ftw) {
+	char dst[PATH_MAX];
+
+	if (ftw->level == 0) {
+		return 0;
+	}
+
+	snprintf(dst, sizeof(dst), "/%s", path + strlen(copy_root) + 1);
+
+	if (type == FTW_D) {
+		if (mkdir(dst, 0755) < 0 && errno != EEXIST) {
+			fprintf(stderr, "luaos: can't create %s: %s\n", dst, strerror(errno));
+			return -1;
+		}
+	} else if (type == FTW_F) {
+		if (copy_file(path, dst) < 0) {
+			fprintf(stderr, "luaos: can't copy %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int copy_dir(const char *dir) {
+	char root[PATH_MAX];
+	size_t len;
+
+	// Without trailing slashes, to strip it from the paths
+	strncpy(root, dir, sizeof(root) - 1);
+	root[sizeof(root) - 1] = 0;
+
+	len = strlen(root);
+	while (len > 1 && root[len - 1] == '/') {
+		root[--len] = 0;
+	}
+
+	copy_root = root;
+
+	return nftw(root, copy_entry, 16, FTW_PHYS);
+}
+
+static void *lua_start(void *arg) {
+	exit(luaos_main());
+
+	return NULL;
+}
+
+static void usage(const char *prog) {
+	fprintf(stderr, "usage: %s [-f image] [-c dir] [-p offset] [-m heap]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+	const char *image = "flash.img";
+	const char *dir = NULL;
+	pthread_t thread;
+	int opt, res;
+
+	// Boot time of the monotonic clock
+	clock_monotonic_us();
+
+	while ((opt = getopt(argc, argv, "f:c:p:m:h")) != -1) {
+		switch (opt) {
+			case 'f': image = optarg; break;
+			case 'c': dir = optarg; break;
+			case 'p': host_port_offset = atoi(optarg); break;
+			case 'm': host_heap_size = strtoul(optarg, NULL, 0); break;
+			default: usage(argv[0]);
+		}
+	}
+
+	if (optind != argc) {
+		usage(argv[0]);
+	}
+
+	res = host_flash_open(image, HOST_FLASH_SIZE);
+	if (res < 0) {
+		fprintf(stderr, "luaos: can't open %s: %s\n", image, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	atexit(host_flash_close);
+
+	if (res) {
+		printf("luaos: created %s\n", image);
+	}
+
+	if (host_vfs_mount() < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (dir && (copy_dir(dir) < 0)) {
+		return EXIT_FAILURE;
+	}
+
+	_console_init();
+	host_console_init();
+
+	// The default stack of the host, the interpreter thread is the deepest
+	res = pthread_create(&thread, NULL, lua_start, NULL);
+	if (res) {
+		fprintf(stderr, "luaos: cannot start lua: %s\n", strerror(res));
+		return EXIT_FAILURE;
+	}
+
+	pthread_exit(NULL);
+}
@@ -0,0 +1,140 @@
+/*
+ * bhgv, mbedTLS functions used by the firmware on the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Only the websocket handshake of httpd needs mbedTLS, for a SHA-1 digest
+ * in base64, so those two are here instead of the whole library.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block(uint32_t h[5], const unsigned char *p) {
+	uint32_t w[80], a, b, c, d, e, f, k, t;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+		       ((uint32_t)p[4 * i + 2] << 8) | (uint32_t)p[4 * i + 3];
+	}
+
+	for (; i < 80; i++) {
+		w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+
+	a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+	for (i = 0; i < 80; i++) {
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+
+		t = ROL(a, 5) + f + e + k + w[i];
+		e = d; d = c; c = ROL(b, 30); b = a; a = t;
+	}
+
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+}
+
+void mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20]) {
+	uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+	unsigned char last[128];
+	uint64_t bits = (uint64_t)ilen * 8;
+	size_t rest, pad;
+	int i;
+
+	for (; ilen >= 64; ilen -= 64, input += 64) {
+		sha1_block(h, input);
+	}
+
+	// Last bytes, 0x80, zeros and the length in bits, in one or two blocks
+	rest = ilen;
+	memcpy(last, input, rest);
+	last[rest++] = 0x80;
+	pad = (rest <= 56) ? 64 : 128;
+	memset(last + rest, 0, pad - rest);
+
+	for (i = 0; i < 8; i++) {
+		last[pad - 1 - i] = bits >> (8 * i);
+	}
+
+	sha1_block(h, last);
+	if (pad == 128) {
+		sha1_block(h, last + 64);
+	}
+
+	for (i = 0; i < 20; i++) {
+		output[i] = h[i / 4] >> (24 - 8 * (i % 4));
+	}
+}
+
+static const unsigned char base64_enc_map[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                          const unsigned char *src, size_t slen) {
+	size_t i, n;
+	uint32_t v;
+	unsigned char *p = dst;
+
+	if (slen == 0) {
+		*olen = 0;
+		return 0;
+	}
+
+	// Encoded length with the trailing 0, as mbedTLS reports it
+	n = (slen + 2) / 3 * 4 + 1;
+
+	if ((dst == NULL) || (dlen < n)) {
+		*olen = n;
+		return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+	}
+
+	for (i = 0; i + 3 <= slen; i += 3) {
+		v = ((uint32_t)src[i] << 16) | ((uint32_t)src[i + 1] << 8) | src[i + 2];
+
+		*p++ = base64_enc_map[(v >> 18) & 0x3f];
+		*p++ = base64_enc_map[(v >> 12) & 0x3f];
+		*p++ = base64_enc_map[(v >> 6) & 0x3f];
+		*p++ = base64_enc_map[v & 0x3f];
+	}
+
+	if (i < slen) {
+		v = (uint32_t)src[i] << 16;
+		if (i + 1 < slen) {
+			v |= (uint32_t)src[i + 1] << 8;
+		}
+
+		*p++ = base64_enc_map[(v >> 18) & 0x3f];
+		*p++ = base64_enc_map[(v >> 12) & 0x3f];
+		*p++ = (i + 1 < slen) ? base64_enc_map[(v >> 6) & 0x3f] : '=';
+		*p++ = '=';
+	}
+
+	*olen = p - dst;
+	*p = 0;
+
+	return 0;
+}
@@ -0,0 +1,364 @@
+/*
+ * bhgv, lwIP netconn API of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The netconn calls used by httpd, on POSIX TCP sockets. As in lwIP, a 0
+ * timeout blocks forever, accept and recv honour recv_timeout and a
+ * netbuf holds what arrived at once, at most recv_bufsize bytes.
+ */
+
+#include "FreeRTOS.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/api.h"
+#include "lwip/sockets.h"
+
+#include "host.h"
+
+// Default receive size of a netbuf, the TCP MSS of the board
+#define NETBUF_DEF_SIZE 1460
+
+const ip_addr_t ip_addr_any = {0};
+
+int host_port_offset = 0;
+
+static err_t errno_to_err(int err) {
+	switch (err) {
+		case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+		case EWOULDBLOCK:
+#endif
+			return ERR_WOULDBLOCK;
+		case ETIMEDOUT:    return ERR_TIMEOUT;
+		case ENOMEM:
+		case ENOBUFS:      return ERR_MEM;
+		case EADDRINUSE:   return ERR_USE;
+		case EISCONN:      return ERR_ISCONN;
+		case ECONNABORTED: return ERR_ABRT;
+		case ECONNRESET:
+		case EPIPE:        return ERR_RST;
+		case ENOTCONN:     return ERR_CONN;
+		case EINVAL:
+		case EBADF:        return ERR_ARG;
+		default:           return ERR_IF;
+	}
+}
+
+/*
+ * Wait for the socket to be ready for events. Returns ERR_OK when it is,
+ * ERR_WOULDBLOCK for a non blocking netconn, or ERR_TIMEOUT.
+ */
+static err_t netconn_wait(struct netconn *conn, short events, int timeout) {
+	struct pollfd pfd;
+	int res;
+
+	if (netconn_is_nonblocking(conn)) {
+		timeout = 0;
+	} else if (timeout <= 0) {
+		timeout = -1;
+	}
+
+	pfd.fd = conn->fd;
+	pfd.events = events;
+
+	while (((res = poll(&pfd, 1, timeout)) < 0) && (errno == EINTR));
+
+	if (res < 0) {
+		return errno_to_err(errno);
+	}
+
+	if (res == 0) {
+		return netconn_is_nonblocking(conn) ? ERR_WOULDBLOCK : ERR_TIMEOUT;
+	}
+
+	return ERR_OK;
+}
+
+static void netconn_addrs(struct netconn *conn) {
+	struct sockaddr_in sin;
+	socklen_t len;
+
+	len = sizeof(sin);
+	if (!getsockname(conn->fd, (struct sockaddr *)&sin, &len)) {
+		conn->tcp.local_ip.addr = sin.sin_addr.s_addr;
+		conn->tcp.local_port = ntohs(sin.sin_port);
+	}
+
+	len = sizeof(sin);
+	if (!getpeername(conn->fd, (struct sockaddr *)&sin, &len)) {
+		conn->tcp.remote_ip.addr = sin.sin_addr.s_addr;
+		conn->tcp.remote_port = ntohs(sin.sin_port);
+	}
+}
+
+static struct netconn *netconn_alloc(int fd) {
+	struct netconn *conn;
+
+	conn = calloc(1, sizeof(struct netconn));
+	if (!conn) {
+		return NULL;
+	}
+
+	conn->type = NETCONN_TCP;
+	conn->fd = fd;
+	conn->pcb.tcp = &conn->tcp;
+	conn->recv_bufsize = NETBUF_DEF_SIZE;
+
+	return conn;
+}
+
+int host_bind(int s, const struct sockaddr *name, socklen_t namelen) {
+	struct sockaddr_in sin;
+
+	if (host_port_offset && name && (name->sa_family == AF_INET) && (namelen >= sizeof(sin))) {
+		memcpy(&sin, name, sizeof(sin));
+		sin.sin_port = htons(ntohs(sin.sin_port) + host_port_offset);
+
+		return bind(s, (struct sockaddr *)&sin, sizeof(sin));
+	}
+
+	return bind(s, name, namelen);
+}
+
+struct netconn *netconn_new(enum netconn_type t) {
+	struct netconn *conn;
+	int fd;
+
+	if (t != NETCONN_TCP) {
+		return NULL;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	conn = netconn_alloc(fd);
+	if (!conn) {
+		close(fd);
+	}
+
+	return conn;
+}
+
+err_t netconn_delete(struct netconn *conn) {
+	if (!conn) {
+		return ERR_OK;
+	}
+
+	if (conn->fd >= 0) {
+		close(conn->fd);
+	}
+
+	free(conn);
+
+	return ERR_OK;
+}
+
+err_t netconn_bind(struct netconn *conn, ip_addr_t *addr, u16_t port) {
+	struct sockaddr_in sin;
+	int opt = 1;
+
+	if (!conn) {
+		return ERR_ARG;
+	}
+
+	// SOF_REUSEADDR is set on the pcb before the bind
+	if (ip_get_option(conn->pcb.tcp, SOF_REUSEADDR)) {
+		setsockopt(conn->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = addr ? addr->addr : INADDR_ANY;
+	sin.sin_port = htons(port);
+
+	if (host_bind(conn->fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		return errno_to_err(errno);
+	}
+
+	netconn_addrs(conn);
+
+	return ERR_OK;
+}
+
+err_t netconn_listen(struct netconn *conn) {
+	if (!conn) {
+		return ERR_ARG;
+	}
+
+	if (listen(conn->fd, SOMAXCONN) < 0) {
+		return errno_to_err(errno);
+	}
+
+	return ERR_OK;
+}
+
+err_t netconn_accept(struct netconn *conn, struct netconn **new_conn) {
+	struct netconn *nc;
+	err_t err;
+	int fd;
+
+	*new_conn = NULL;
+
+	if (!conn) {
+		return ERR_ARG;
+	}
+
+	if ((err = netconn_wait(conn, POLLIN, conn->recv_timeout)) != ERR_OK) {
+		return err;
+	}
+
+	fd = accept(conn->fd, NULL, NULL);
+	if (fd < 0) {
+		return errno_to_err(errno);
+	}
+
+	nc = netconn_alloc(fd);
+	if (!nc) {
+		close(fd);
+		return ERR_MEM;
+	}
+
+	netconn_addrs(nc);
+
+	*new_conn = nc;
+
+	return ERR_OK;
+}
+
+err_t netconn_recv(struct netconn *conn, struct netbuf **new_buf) {
+	struct netbuf *buf;
+	ssize_t len;
+	size_t size;
+	err_t err;
+
+	*new_buf = NULL;
+
+	if (!conn) {
+		return ERR_ARG;
+	}
+
+	if ((err = netconn_wait(conn, POLLIN, conn->recv_timeout)) != ERR_OK) {
+		return err;
+	}
+
+	// A netbuf length is 16 bit
+	size = conn->recv_bufsize > 0 ? conn->recv_bufsize : NETBUF_DEF_SIZE;
+	if (size > 0xffff) {
+		size = 0xffff;
+	}
+
+	buf = malloc(sizeof(struct netbuf) + size);
+	if (!buf) {
+		return ERR_MEM;
+	}
+
+	buf->data = buf + 1;
+
+	while (((len = recv(conn->fd, buf->data, size, 0)) < 0) && (errno == EINTR));
+
+	if (len <= 0) {
+		free(buf);
+
+		return len ? errno_to_err(errno) : ERR_CLSD;
+	}
+
+	buf->len = len;
+	*new_buf = buf;
+
+	return ERR_OK;
+}
+
+err_t netconn_write(struct netconn *conn, const void *dataptr, size_t size, u8_t apiflags) {
+	const char *p = dataptr;
+	ssize_t len;
+	err_t err;
+
+	if (!conn || (!dataptr && size)) {
+		return ERR_ARG;
+	}
+
+	while (size) {
+		if ((err = netconn_wait(conn, POLLOUT, conn->send_timeout)) != ERR_OK) {
+			return err;
+		}
+
+		len = send(conn->fd, p, size, MSG_NOSIGNAL | ((apiflags & NETCONN_MORE) ? MSG_MORE : 0));
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return errno_to_err(errno);
+		}
+
+		p += len;
+		size -= len;
+	}
+
+	return ERR_OK;
+}
+
+err_t netconn_close(struct netconn *conn) {
+	if (!conn) {
+		return ERR_ARG;
+	}
+
+	shutdown(conn->fd, SHUT_RDWR);
+
+	return ERR_OK;
+}
+
+err_t netbuf_data(struct netbuf *buf, void **dataptr, u16_t *len) {
+	if (!buf) {
+		return ERR_BUF;
+	}
+
+	*dataptr = buf->data;
+	*len = buf->len;
+
+	return ERR_OK;
+}
+
+void netbuf_delete(struct netbuf *buf) {
+	free(buf);
+}
+
+static const char *err_strerr[] = {
+	"Ok.",                    /* ERR_OK          0  */
+	"Out of memory error.",   /* ERR_MEM        -1  */
+	"Buffer error.",          /* ERR_BUF        -2  */
+	"Timeout.",               /* ERR_TIMEOUT    -3  */
+	"Routing problem.",       /* ERR_RTE        -4  */
+	"Operation in progress.", /* ERR_INPROGRESS -5  */
+	"Illegal value.",         /* ERR_VAL        -6  */
+	"Operation would block.", /* ERR_WOULDBLOCK -7  */
+	"Address in use.",        /* ERR_USE        -8  */
+	"Already connected.",     /* ERR_ISCONN     -9  */
+	"Connection aborted.",    /* ERR_ABRT       -10 */
+	"Connection reset.",      /* ERR_RST        -11 */
+	"Connection closed.",     /* ERR_CLSD       -12 */
+	"Not connected.",         /* ERR_CONN       -13 */
+	"Illegal argument.",      /* ERR_ARG        -14 */
+	"Low-level netif error.", /* ERR_IF         -15 */
+};
+
+const char *lwip_strerr(err_t err) {
+	if ((err > 0) || (-err >= (int)(sizeof(err_strerr) / sizeof(err_strerr[0])))) {
+		return "Unknown error.";
+	}
+
+	return err_strerr[-err];
+}
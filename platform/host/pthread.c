@@ -0,0 +1,404 @@
+/*
+ * bhgv, pthread extensions of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The firmware pthreads (pthread/pthread.c) can be created suspended, and
+ * suspended, resumed and stopped from other threads, as they are FreeRTOS
+ * tasks. Here they are system pthreads:
+ *
+ * - A thread is suspended by sending it SIGUSR1, the handler waits in
+ *   sigsuspend for SIGUSR2, sent on resume. SIGUSR2 is blocked out of
+ *   sigsuspend, so a resume can't be lost.
+ *
+ * - A thread is stopped with pthread_cancel. As with vTaskDelete it doesn't
+ *   run the cleanup routines. It's stopped in the next cancellation point
+ *   (thread.sleep, a blocking queue or socket, a suspension), a busy loop
+ *   without any of them is never stopped.
+ *
+ * The thread structure is always released by the thread itself, when it
+ * ends or is cancelled, _pthread_free only takes it out of the list.
+ *
+ * As on the board, the thread start function gets the lthread as argument
+ * and returns an int status, the error is printed if it's not LUA_OK.
+ */
+
+#define HOST_PTHREAD_NATIVE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include "thread.h"
+
+#include "host.h"
+
+#define SIG_SUSPEND SIGUSR1
+#define SIG_RESUME  SIGUSR2
+
+struct host_pthread_clean {
+	void (*clean)(void *);
+	void *args;
+	struct host_pthread_clean *next;
+};
+
+struct host_pthread {
+	pthread_t thread;
+	void *(*start_routine)(void *);
+	void *args;
+	int initial_state;
+	volatile sig_atomic_t suspended;
+	struct host_pthread_clean *clean_list;
+	struct host_pthread *next;
+};
+
+static pthread_mutex_t thread_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct host_pthread *thread_list = NULL;
+static pthread_once_t signal_once = PTHREAD_ONCE_INIT;
+
+static __thread struct host_pthread *self = NULL;
+
+static void suspend_wait(struct host_pthread *thread) {
+	sigset_t mask;
+
+	pthread_sigmask(SIG_BLOCK, NULL, &mask);
+	sigdelset(&mask, SIG_RESUME);
+
+	while (thread->suspended) {
+		sigsuspend(&mask);
+	}
+}
+
+static void suspend_handler(int sig) {
+	int err = errno;
+
+	if (self) {
+		suspend_wait(self);
+	}
+
+	errno = err;
+}
+
+static void resume_handler(int sig) {
+}
+
+static void signal_init() {
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sigaddset(&sa.sa_mask, SIG_RESUME);
+	sa.sa_handler = suspend_handler;
+	sigaction(SIG_SUSPEND, &sa, NULL);
+
+	sa.sa_handler = resume_handler;
+	sigaction(SIG_RESUME, &sa, NULL);
+}
+
+static struct host_pthread *thread_get(pthread_t id) {
+	struct host_pthread *thread;
+
+	for (thread = thread_list; thread; thread = thread->next) {
+		if (pthread_equal(thread->thread, id)) {
+			break;
+		}
+	}
+
+	return thread;
+}
+
+static void thread_remove(struct host_pthread *thread) {
+	struct host_pthread **prev;
+
+	for (prev = &thread_list; *prev; prev = &(*prev)->next) {
+		if (*prev == thread) {
+			*prev = thread->next;
+			break;
+		}
+	}
+}
+
+static void thread_destroy(struct host_pthread *thread) {
+	struct host_pthread_clean *clean;
+
+	while ((clean = thread->clean_list)) {
+		thread->clean_list = clean->next;
+		free(clean);
+	}
+
+	free(thread);
+}
+
+static void thread_release(struct host_pthread *thread) {
+	pthread_mutex_lock(&thread_mtx);
+	thread_remove(thread);
+	pthread_mutex_unlock(&thread_mtx);
+
+	self = NULL;
+	thread_destroy(thread);
+}
+
+// Cancellation handler, the thread was stopped
+static void thread_cancelled(void *arg) {
+	thread_release((struct host_pthread *)arg);
+}
+
+static void *thread_start(void *arg) {
+	struct host_pthread *thread = (struct host_pthread *)arg;
+	struct host_pthread_clean *clean;
+	int *status;
+
+	self = thread;
+
+	pthread_cleanup_push(thread_cancelled, thread);
+
+	// Wait until the creator has stored the id, and set the Lua context
+	pthread_mutex_lock(&thread_mtx);
+	pthread_mutex_unlock(&thread_mtx);
+
+	if (thread->args) {
+		uxSetLuaState(((struct lthread *)thread->args)->L);
+	}
+
+	if (thread->initial_state == PTHREAD_INITIAL_STATE_SUSPEND) {
+		suspend_wait(thread);
+	}
+
+	// Call start function
+	status = thread->start_routine(thread->args);
+	if (status) {
+		if (*status != LUA_OK) {
+			struct lthread *lthread = (struct lthread *)thread->args;
+
+			const char *msg = lua_tostring(lthread->L, -1);
+			lua_writestringerror("%s\n", msg);
+			lua_pop(lthread->L, 1);
+		}
+
+		free(status);
+	}
+
+	pthread_cleanup_pop(0);
+
+	// Execute clean list, and free thread structures
+	for (clean = thread->clean_list; clean; clean = clean->next) {
+		if (clean->clean) {
+			(*clean->clean)(clean->args);
+			free(clean->args);
+		}
+	}
+
+	thread_release(thread);
+
+	return NULL;
+}
+
+int host_pthread_attr_init(host_pthread_attr_t *attr) {
+	attr->initial_state = PTHREAD_INITIAL_STATE_RUN;
+
+	return pthread_attr_init(&attr->attr);
+}
+
+int host_pthread_attr_destroy(host_pthread_attr_t *attr) {
+	return pthread_attr_destroy(&attr->attr);
+}
+
+int host_pthread_attr_setstacksize(host_pthread_attr_t *attr, size_t stacksize) {
+	if (stacksize < HOST_STACK_MIN) {
+		stacksize = HOST_STACK_MIN;
+	}
+
+	return pthread_attr_setstacksize(&attr->attr, stacksize);
+}
+
+int host_pthread_attr_setdetachstate(host_pthread_attr_t *attr, int detachstate) {
+	return pthread_attr_setdetachstate(&attr->attr, detachstate);
+}
+
+int host_pthread_attr_setinitialstate(host_pthread_attr_t *attr, int initial_state) {
+	if ((initial_state != PTHREAD_INITIAL_STATE_RUN) && (initial_state != PTHREAD_INITIAL_STATE_SUSPEND)) {
+		return EINVAL;
+	}
+
+	attr->initial_state = initial_state;
+
+	return 0;
+}
+
+int host_pthread_create(pthread_t *id, const host_pthread_attr_t *attr,
+                        void *(*start_routine) (void *), void *args) {
+	struct host_pthread *thread;
+	pthread_attr_t tattr;
+	sigset_t mask, omask;
+	int res;
+
+	pthread_once(&signal_once, signal_init);
+
+	thread = (struct host_pthread *)calloc(1, sizeof(struct host_pthread));
+	if (!thread) {
+		return EAGAIN;
+	}
+
+	thread->start_routine = start_routine;
+	thread->args = args;
+	thread->initial_state = attr ? attr->initial_state : PTHREAD_INITIAL_STATE_RUN;
+	thread->suspended = (thread->initial_state == PTHREAD_INITIAL_STATE_SUSPEND);
+
+	// Threads are always detached, they are released on exit or stop
+	if (attr) {
+		tattr = attr->attr;
+	} else {
+		pthread_attr_init(&tattr);
+		pthread_attr_setstacksize(&tattr, HOST_STACK_MIN);
+	}
+
+	pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
+
+	// The new thread inherits the mask, resume is only taken in sigsuspend
+	sigemptyset(&mask);
+	sigaddset(&mask, SIG_RESUME);
+	pthread_sigmask(SIG_BLOCK, &mask, &omask);
+
+	pthread_mutex_lock(&thread_mtx);
+
+	res = pthread_create(&thread->thread, &tattr, thread_start, thread);
+	if (res) {
+		pthread_mutex_unlock(&thread_mtx);
+		pthread_sigmask(SIG_SETMASK, &omask, NULL);
+		free(thread);
+		return res;
+	}
+
+	thread->next = thread_list;
+	thread_list = thread;
+	*id = thread->thread;
+
+	pthread_mutex_unlock(&thread_mtx);
+	pthread_sigmask(SIG_SETMASK, &omask, NULL);
+
+	if (!attr) {
+		pthread_attr_destroy(&tattr);
+	}
+
+	return 0;
+}
+
+void host_pthread_cleanup_push(void (*routine)(void *), void *arg) {
+	struct host_pthread_clean *clean;
+
+	if (!self) {
+		return;
+	}
+
+	clean = (struct host_pthread_clean *)malloc(sizeof(struct host_pthread_clean));
+	if (!clean) {
+		return;
+	}
+
+	clean->clean = routine;
+	clean->args = arg;
+	clean->next = self->clean_list;
+	self->clean_list = clean;
+}
+
+int _pthread_stop(pthread_t id) {
+	struct host_pthread *thread;
+	int res = 0;
+
+	pthread_mutex_lock(&thread_mtx);
+
+	thread = thread_get(id);
+	if (thread) {
+		res = pthread_cancel(id);
+	} else {
+		res = ESRCH;
+	}
+
+	pthread_mutex_unlock(&thread_mtx);
+
+	if (res) {
+		errno = res;
+	}
+
+	return res;
+}
+
+int _pthread_suspend(pthread_t id) {
+	struct host_pthread *thread;
+	int res = 0;
+
+	pthread_mutex_lock(&thread_mtx);
+
+	thread = thread_get(id);
+	if (thread) {
+		thread->suspended = 1;
+		res = pthread_kill(id, SIG_SUSPEND);
+	} else {
+		res = ESRCH;
+	}
+
+	pthread_mutex_unlock(&thread_mtx);
+
+	if (res) {
+		errno = res;
+	}
+
+	return res;
+}
+
+int _pthread_resume(pthread_t id) {
+	struct host_pthread *thread;
+	int res = 0;
+
+	pthread_mutex_lock(&thread_mtx);
+
+	thread = thread_get(id);
+	if (thread) {
+		thread->suspended = 0;
+		res = pthread_kill(id, SIG_RESUME);
+	} else {
+		res = ESRCH;
+	}
+
+	pthread_mutex_unlock(&thread_mtx);
+
+	if (res) {
+		errno = res;
+	}
+
+	return res;
+}
+
+int _pthread_free(pthread_t id) {
+	struct host_pthread *thread;
+
+	pthread_mutex_lock(&thread_mtx);
+
+	thread = thread_get(id);
+	if (thread) {
+		thread_remove(thread);
+	}
+
+	pthread_mutex_unlock(&thread_mtx);
+
+	if (!thread) {
+		errno = ESRCH;
+		return ESRCH;
+	}
+
+	return 0;
+}
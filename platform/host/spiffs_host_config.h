@@ -0,0 +1,50 @@
+/*
+ * bhgv, SPIFFS configuration of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * The SPIFFS core is taken from mkspiffs, but must use the firmware
+ * configuration to have the same flash layout. This header is forced in
+ * front of every source, so the mkspiffs spiffs_config.h, that has
+ * the same include guard, is skipped.
+ *
+ */
+
+// Threads run in parallel on the host, so the API calls are serialized,
+// with a recursive lock as the VFS also holds it across calls (see vfs.c)
+void host_spiffs_lock();
+void host_spiffs_unlock();
+
+#define SPIFFS_LOCK(fs)        host_spiffs_lock()
+#define SPIFFS_UNLOCK(fs)      host_spiffs_unlock()
+
+#include <sys/spiffs/spiffs_config.h>
+
+// Print formats the newer core uses in its debug output
+#ifndef _SPIPRIi
+#define _SPIPRIi   "%d"
+#endif
+#ifndef _SPIPRIad
+#define _SPIPRIad  "%08x"
+#endif
+#ifndef _SPIPRIbl
+#define _SPIPRIbl  "%04x"
+#endif
+#ifndef _SPIPRIpg
+#define _SPIPRIpg  "%04x"
+#endif
+#ifndef _SPIPRIsp
+#define _SPIPRIsp  "%04x"
+#endif
+#ifndef _SPIPRIfd
+#define _SPIPRIfd  "%d"
+#endif
+#ifndef _SPIPRIid
+#define _SPIPRIid  "%04x"
+#endif
+#ifndef _SPIPRIfl
+#define _SPIPRIfl  "%02x"
+#endif
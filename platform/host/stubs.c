@@ -0,0 +1,125 @@
+/*
+ * bhgv, stubbed peripherals and SDK functions of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#include "FreeRTOS.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include <sys/drivers/clock.h>
+#include <sys/drivers/cpu.h>
+
+#include "espressif/esp_common.h"
+
+#include "host.h"
+
+// In the RTC memory of the board, there is no reboot here
+uint32_t boot_count = 0;
+
+/*
+ * CPU
+ */
+void cpu_init() {
+}
+
+int cpu_revission() {
+	return 0;
+}
+
+void cpu_model(char *buffer) {
+	strcpy(buffer, "host");
+}
+
+void cpu_reset() {
+	exit(0);
+}
+
+// Power on
+int cpu_reset_reason() {
+	return 0;
+}
+
+// There are no pins, only names for the resource listing
+const char *cpu_pin_name(unsigned int pin) {
+	static const char *pin_names[16] = {
+		"GPIO0", "GPIO1", "GPIO2", "GPIO3", "GPIO4", "GPIO5", "GPIO6", "GPIO7",
+		"GPIO8", "GPIO9", "GPIO10", "GPIO11", "GPIO12", "GPIO13", "GPIO14", "GPIO15",
+	};
+
+	return (pin < 16) ? pin_names[pin] : "";
+}
+
+/*
+ * SDK
+ */
+uint8_t sdk_wifi_station_get_connect_status(void) {
+	return STATION_GOT_IP;
+}
+
+void sdk_sta_status_set(int status) {
+}
+
+uint32_t sdk_system_get_time(void) {
+	return (uint32_t)clock_monotonic_us();
+}
+
+uint16_t sdk_system_adc_read(void) {
+	return 0;
+}
+
+void sdk_wdt_feed(void) {
+}
+
+/*
+ * syslog, the mask and options are the libc ones
+ */
+int getlogmask() {
+	return setlogmask(0);
+}
+
+int getlogstat() {
+	return 0;
+}
+
+/*
+ * The editor works on file descriptors, which are not in the VFS
+ */
+int edit_main(int argc, char *argv[]) {
+	printf("edit: not available on the host platform\n");
+
+	return 0;
+}
+
+#if !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size) {
+	size_t len = strlen(src);
+
+	if (size) {
+		size_t n = (len >= size) ? size - 1 : len;
+
+		memcpy(dst, src, n);
+		dst[n] = 0;
+	}
+
+	return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size) {
+	size_t dlen = strnlen(dst, size);
+
+	if (dlen == size) {
+		return size + strlen(src);
+	}
+
+	return dlen + strlcpy(dst + dlen, src, size - dlen);
+}
+#endif
@@ -0,0 +1,171 @@
+/*
+ * bhgv, console UART of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The console UART is the terminal: stdin and stdout, with the terminal
+ * in raw mode so keys arrive one by one, as from the board. Output goes
+ * after what is buffered in stdout, to keep the order of printf and the
+ * direct writes of the console driver. Other units are not connected.
+ */
+
+#include "FreeRTOS.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <sys/drivers/uart.h>
+
+#include "host.h"
+
+static struct termios saved_tio;
+static struct termios console_tio;
+static int is_tty = 0;
+
+static pthread_mutex_t ll_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static void console_restore() {
+	if (is_tty) {
+		tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_tio);
+	}
+}
+
+void host_console_init() {
+	if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_tio) < 0) {
+		return;
+	}
+
+	// No line editing and echo, linenoise does them. Ctrl-C still stops.
+	console_tio = saved_tio;
+	console_tio.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+	console_tio.c_iflag &= ~(ICRNL | IXON);
+	console_tio.c_cc[VMIN] = 1;
+	console_tio.c_cc[VTIME] = 0;
+
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &console_tio) < 0) {
+		return;
+	}
+
+	is_tty = 1;
+	atexit(console_restore);
+}
+
+void uart_init(u8_t unit, u32_t brg, u32_t mode, u32_t qs) {
+}
+
+void uart_init_interrupts(u8_t unit) {
+}
+
+void uart_write(u8_t unit, char byte) {
+	if (unit != CONSOLE_UART) {
+		return;
+	}
+
+	fflush(stdout);
+	while ((write(STDOUT_FILENO, &byte, 1) < 0) && (errno == EINTR));
+}
+
+void uart_writes(u8_t unit, char *s) {
+	size_t len = strlen(s);
+	ssize_t res;
+
+	if (unit != CONSOLE_UART) {
+		return;
+	}
+
+	fflush(stdout);
+	while (len) {
+		res = write(STDOUT_FILENO, s, len);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			break;
+		}
+
+		s += res;
+		len -= res;
+	}
+}
+
+/*
+ * Read a byte, waiting up to timeout milliseconds. Returns 1 if a byte
+ * was read.
+ */
+u8_t uart_read(u8_t unit, char *c, u32_t timeout) {
+	struct pollfd pfd;
+	int res;
+
+	if (unit != CONSOLE_UART) {
+		return 0;
+	}
+
+	pfd.fd = STDIN_FILENO;
+	pfd.events = POLLIN;
+
+	while (((res = poll(&pfd, 1, timeout)) < 0) && (errno == EINTR));
+
+	if (res <= 0) {
+		return 0;
+	}
+
+	while (((res = read(STDIN_FILENO, c, 1)) < 0) && (errno == EINTR));
+
+	return res == 1;
+}
+
+// Discard the pending input
+void uart_consume(u8_t unit) {
+	char c;
+
+	if (unit != CONSOLE_UART) {
+		return;
+	}
+
+	while (uart_read(unit, &c, 0));
+}
+
+// There is no second UART to swap the console to
+void uart0_swap() {
+}
+
+void uart0_default() {
+}
+
+void uart_ll_lock(int unit) {
+	pthread_mutex_lock(&ll_mtx);
+}
+
+void uart_ll_unlock(int unit) {
+	pthread_mutex_unlock(&ll_mtx);
+}
+
+// Fully raw terminal for the binary transfers, console mode after them
+void uart_ll_set_raw(int raw) {
+	struct termios tio;
+
+	if (!is_tty) {
+		return;
+	}
+
+	if (raw) {
+		tio = console_tio;
+		cfmakeraw(&tio);
+		tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+	} else {
+		tcsetattr(STDIN_FILENO, TCSANOW, &console_tio);
+	}
+}
@@ -0,0 +1,1080 @@
+/*
+ * bhgv, file system of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The file I/O of the firmware (stdio, stat, directories, cwd) is wrapped
+ * with -Wl,--wrap and goes to SPIFFS on the flash image, as on the board
+ * where sys/syscalls/spiffs_ops.c is under the newlib VFS. The code below
+ * follows spiffs_ops.c, so the host sees the same behaviour and costs:
+ *
+ * - Directories are "path/." entries.
+ * - Read only files have a read-ahead buffer of spiffs_ra_size bytes.
+ * - FILE streams have the newlib buffer size (BUFSIZ is 1024 there).
+ *
+ * Paths are made absolute with a VFS working directory, the process one
+ * is left alone.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+
+#include <spiffs.h>
+#include <spiffs_nucleus.h>
+#include <esp_spiffs.h>
+
+#include "FreeRTOS.h"
+
+#include "host.h"
+
+#define NAME_MAX_LEN (SPIFFS_OBJ_NAME_LEN - 1)
+
+// FILE buffer size of newlib
+#define VFS_BUFSIZ   1024
+
+#if !defined(min)
+#define min(A,B) ( (A) < (B) ? (A):(B))
+#endif
+
+spiffs fs;
+
+static pthread_mutex_t spiffs_mtx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static u8_t *my_spiffs_work_buf;
+static u8_t *my_spiffs_fds;
+static u8_t *my_spiffs_cache;
+
+// Mount time tunables, from config.mk, and the read-ahead, see
+// spiffs_set_readahead
+static const int spiffs_cache_pages = SPIFFS_CACHE_PAGES;
+static const int spiffs_max_fds = SPIFFS_MAX_FDS;
+static int spiffs_ra_size = SPIFFS_READ_AHEAD;
+
+// Read-ahead statistics
+static u32_t spiffs_ra_hits;
+static u32_t spiffs_ra_misses;
+static u32_t spiffs_ra_bytes;
+
+static char vfs_cwd[SPIFFS_OBJ_NAME_LEN] = "/";
+
+// Same as spiffs_fp_t of spiffs_ops.c
+typedef struct {
+	spiffs_file fh;
+	s32_t pos;
+	s32_t hw_pos;
+	s32_t ra_pos;
+	u16_t ra_len;
+	u16_t ra_size;
+	u8_t ra_buf[];
+} spiffs_fp_t;
+
+struct host_dir {
+	spiffs_DIR d;
+	char path[SPIFFS_OBJ_NAME_LEN];
+	struct dirent ent;
+};
+
+void host_spiffs_lock() {
+	pthread_mutex_lock(&spiffs_mtx);
+}
+
+void host_spiffs_unlock() {
+	pthread_mutex_unlock(&spiffs_mtx);
+}
+
+static int spiffs_result(int res) {
+	switch (res) {
+		case SPIFFS_OK:
+		case SPIFFS_ERR_END_OF_OBJECT:
+			return 0;
+
+		case SPIFFS_ERR_NOT_FOUND:
+		case SPIFFS_ERR_CONFLICTING_NAME:
+			return ENOENT;
+
+		case SPIFFS_ERR_NOT_WRITABLE:
+		case SPIFFS_ERR_NOT_READABLE:
+			return EACCES;
+
+		case SPIFFS_ERR_FILE_EXISTS:
+			return EEXIST;
+
+		case SPIFFS_ERR_FULL:
+			return ENOSPC;
+
+		case SPIFFS_ERR_OUT_OF_FILE_DESCS:
+			return ENFILE;
+
+		default:
+			return EIO;
+	}
+}
+
+/*
+ * Make path absolute and remove the ".", ".." and empty components. The
+ * result has no trailing /, except the root.
+ */
+static int vfs_path(const char *path, char *out) {
+	char tmp[SPIFFS_OBJ_NAME_LEN * 2];
+	char *c, *next, *o;
+
+	if (!path || !*path) {
+		return ENOENT;
+	}
+
+	if (*path == '/') {
+		if (strlen(path) >= sizeof(tmp)) {
+			return ENAMETOOLONG;
+		}
+
+		strcpy(tmp, path);
+	} else {
+		if (strlen(vfs_cwd) + strlen(path) + 2 > sizeof(tmp)) {
+			return ENAMETOOLONG;
+		}
+
+		strcpy(tmp, vfs_cwd);
+		strcat(tmp, "/");
+		strcat(tmp, path);
+	}
+
+	o = out;
+	*o = '\0';
+
+	for (c = tmp; c; c = next) {
+		while (*c == '/') {
+			c++;
+		}
+
+		next = strchr(c, '/');
+		if (next) {
+			*next++ = '\0';
+		}
+
+		if (!*c || !strcmp(c, ".")) {
+			continue;
+		}
+
+		if (!strcmp(c, "..")) {
+			// Remove the last component
+			while ((o > out) && (*--o != '/'));
+			*o = '\0';
+			continue;
+		}
+
+		if ((o - out) + strlen(c) + 1 > NAME_MAX_LEN) {
+			return ENAMETOOLONG;
+		}
+
+		*o++ = '/';
+		strcpy(o, c);
+		o += strlen(c);
+	}
+
+	if (o == out) {
+		strcpy(out, "/");
+	}
+
+	return 0;
+}
+
+// Determine if path correspond to a directory entry
+int is_dir(const char *path) {
+	spiffs_DIR d;
+	char npath[SPIFFS_OBJ_NAME_LEN + 2];
+	int res = 0;
+
+	struct spiffs_dirent e;
+
+	if (!strcmp(path, "/")) {
+		return 1;
+	}
+
+	// Add /. to path
+	strlcpy(npath, path, sizeof(npath) - 2);
+	strcat(npath, "/.");
+
+	host_spiffs_lock();
+
+	SPIFFS_opendir(&fs, "/", &d);
+	while (SPIFFS_readdir(&d, &e)) {
+		if (strncmp(npath, (const char *)e.name, strlen(npath)) == 0) {
+			res = 1;
+			break;
+		}
+	}
+
+	SPIFFS_closedir(&d);
+
+	host_spiffs_unlock();
+
+	return res;
+}
+
+// Number of entries under the directory path
+static int dir_entries(const char *path) {
+	spiffs_DIR d;
+	struct spiffs_dirent e;
+	int len = strlen(path);
+	int files = 0;
+
+	host_spiffs_lock();
+
+	SPIFFS_opendir(&fs, "/", &d);
+	while (SPIFFS_readdir(&d, &e)) {
+		if (!strncmp(path, (const char *)e.name, len) && (e.name[len] == '/') &&
+		    strcmp((const char *)e.name + len, "/.")) {
+			files++;
+		}
+	}
+
+	SPIFFS_closedir(&d);
+
+	host_spiffs_unlock();
+
+	return files;
+}
+
+/*
+ * Streams
+ */
+
+// Move the SPIFFS descriptor to the logical position, if needed
+static int spiffs_sync_pos(spiffs_fp_t *FP) {
+	s32_t res;
+
+	if (FP->hw_pos == FP->pos) {
+		return 0;
+	}
+
+	res = SPIFFS_lseek(&fs, FP->fh, FP->pos, SPIFFS_SEEK_SET);
+	if (res < 0) {
+		return spiffs_result(fs.err_code);
+	}
+
+	FP->hw_pos = res;
+
+	return 0;
+}
+
+static ssize_t vfs_read(void *cookie, char *buf, size_t size) {
+	spiffs_fp_t *FP = (spiffs_fp_t *)cookie;
+	size_t done = 0;
+	size_t len;
+	int res;
+
+	host_spiffs_lock();
+
+	while (done < size) {
+		// Serve from the read-ahead buffer
+		if (FP->ra_len && (FP->pos >= FP->ra_pos) && (FP->pos < FP->ra_pos + FP->ra_len)) {
+			len = min(size - done, FP->ra_pos + FP->ra_len - FP->pos);
+
+			memcpy(buf + done, FP->ra_buf + (FP->pos - FP->ra_pos), len);
+
+			FP->pos += len;
+			done += len;
+			spiffs_ra_hits++;
+
+			continue;
+		}
+
+		if ((res = spiffs_sync_pos(FP))) {
+			goto error;
+		}
+
+		// Big requests, or no read-ahead buffer, go directly to SPIFFS
+		if (size - done >= FP->ra_size) {
+			res = SPIFFS_read(&fs, FP->fh, buf + done, size - done);
+			if (res < 0) {
+				if ((res = spiffs_result(fs.err_code))) {
+					goto error;
+				}
+
+				// EOF
+				break;
+			}
+
+			FP->pos += res;
+			FP->hw_pos = FP->pos;
+			done += res;
+
+			break;
+		}
+
+		// Refill the read-ahead buffer
+		spiffs_ra_misses++;
+
+		FP->ra_len = 0;
+		FP->ra_pos = FP->pos;
+
+		res = SPIFFS_read(&fs, FP->fh, FP->ra_buf, FP->ra_size);
+		if (res < 0) {
+			if ((res = spiffs_result(fs.err_code))) {
+				goto error;
+			}
+
+			res = 0;
+		}
+
+		FP->hw_pos += res;
+		FP->ra_len = res;
+		spiffs_ra_bytes += res;
+
+		if (res == 0) {
+			// EOF
+			break;
+		}
+	}
+
+	host_spiffs_unlock();
+
+	return done;
+
+error:
+	host_spiffs_unlock();
+
+	errno = res;
+	return -1;
+}
+
+static ssize_t vfs_write(void *cookie, const char *buf, size_t size) {
+	spiffs_fp_t *FP = (spiffs_fp_t *)cookie;
+	int res;
+
+	host_spiffs_lock();
+
+	if ((res = spiffs_sync_pos(FP))) {
+		host_spiffs_unlock();
+		errno = res;
+		return -1;
+	}
+
+	// Data read ahead is not valid anymore
+	FP->ra_len = 0;
+
+	res = SPIFFS_write(&fs, FP->fh, (void *)buf, size);
+	if (res < 0) {
+		res = spiffs_result(fs.err_code);
+		host_spiffs_unlock();
+		errno = res;
+		return -1;
+	}
+
+	FP->pos += res;
+	FP->hw_pos = FP->pos;
+
+	host_spiffs_unlock();
+
+	return res;
+}
+
+static int vfs_seek(void *cookie, off64_t *offset, int where) {
+	spiffs_fp_t *FP = (spiffs_fp_t *)cookie;
+	int whence = SPIFFS_SEEK_SET;
+	s32_t off = *offset;
+	s32_t res;
+
+	switch (where) {
+		case SEEK_SET: whence = SPIFFS_SEEK_SET; break;
+		case SEEK_CUR: whence = SPIFFS_SEEK_SET; off += FP->pos; break;
+		case SEEK_END: whence = SPIFFS_SEEK_END; break;
+		default:
+			errno = EINVAL;
+			return -1;
+	}
+
+	// Seeks inside the read-ahead buffer don't touch the flash
+	if ((whence == SPIFFS_SEEK_SET) && FP->ra_len &&
+	    (off >= FP->ra_pos) && (off < FP->ra_pos + FP->ra_len)) {
+		FP->pos = off;
+		*offset = off;
+
+		return 0;
+	}
+
+	host_spiffs_lock();
+
+	res = SPIFFS_lseek(&fs, FP->fh, off, whence);
+	if (res < 0) {
+		res = spiffs_result(fs.err_code);
+		host_spiffs_unlock();
+		errno = res;
+		return -1;
+	}
+
+	FP->pos = res;
+	FP->hw_pos = res;
+
+	host_spiffs_unlock();
+
+	*offset = res;
+
+	return 0;
+}
+
+static int vfs_close(void *cookie) {
+	spiffs_fp_t *FP = (spiffs_fp_t *)cookie;
+	int res = 0;
+
+	host_spiffs_lock();
+
+	if (SPIFFS_close(&fs, FP->fh) < 0) {
+		res = spiffs_result(fs.err_code);
+	}
+
+	host_spiffs_unlock();
+
+	free(FP);
+
+	if (res) {
+		errno = res;
+		return -1;
+	}
+
+	return 0;
+}
+
+static const cookie_io_functions_t vfs_io = {
+	.read = vfs_read,
+	.write = vfs_write,
+	.seek = vfs_seek,
+	.close = vfs_close,
+};
+
+static spiffs_flags vfs_mode(const char *mode) {
+	spiffs_flags flags;
+	int plus = (strchr(mode, '+') != NULL);
+
+	switch (*mode) {
+		case 'r':
+			flags = plus ? SPIFFS_RDWR : SPIFFS_RDONLY;
+			break;
+
+		case 'w':
+			flags = (plus ? SPIFFS_RDWR : SPIFFS_WRONLY) | SPIFFS_CREAT | SPIFFS_TRUNC;
+			break;
+
+		case 'a':
+			flags = (plus ? SPIFFS_RDWR : SPIFFS_WRONLY) | SPIFFS_CREAT | SPIFFS_APPEND;
+			break;
+
+		default:
+			return 0;
+	}
+
+	if (strchr(mode, 'x')) {
+		flags |= SPIFFS_EXCL;
+	}
+
+	return flags;
+}
+
+FILE *__wrap_fopen(const char *path, const char *mode) {
+	char npath[SPIFFS_OBJ_NAME_LEN];
+	spiffs_fp_t *FP;
+	spiffs_flags flags;
+	FILE *f;
+	int ra_size = 0;
+	int res;
+
+	if ((res = vfs_path(path, npath))) {
+		errno = res;
+		return NULL;
+	}
+
+	if (!(flags = vfs_mode(mode))) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (is_dir(npath)) {
+		errno = EISDIR;
+		return NULL;
+	}
+
+	// Read-ahead only makes sense for files opened read only, writes
+	// would invalidate the buffer all the time
+	if (flags == SPIFFS_RDONLY) {
+		ra_size = spiffs_ra_size;
+	}
+
+	// Create a FIL structure, with room for the read-ahead buffer and for
+	// the FILE buffer (glibc ignores the size of setvbuf without a buffer)
+	FP = (spiffs_fp_t *)malloc(sizeof(spiffs_fp_t) + ra_size + VFS_BUFSIZ);
+	if (!FP && ra_size) {
+		ra_size = 0;
+		FP = (spiffs_fp_t *)malloc(sizeof(spiffs_fp_t) + VFS_BUFSIZ);
+	}
+
+	if (!FP) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	FP->pos = 0;
+	FP->hw_pos = 0;
+	FP->ra_pos = 0;
+	FP->ra_len = 0;
+	FP->ra_size = ra_size;
+
+	host_spiffs_lock();
+
+	FP->fh = SPIFFS_open(&fs, npath, flags, 0);
+	if (FP->fh < 0) {
+		res = spiffs_result(fs.err_code);
+		host_spiffs_unlock();
+		free(FP);
+		errno = res;
+		return NULL;
+	}
+
+	// SPIFFS appends on each write, but the position starts at 0
+	if (flags & SPIFFS_APPEND) {
+		res = SPIFFS_lseek(&fs, FP->fh, 0, SPIFFS_SEEK_END);
+		if (res > 0) {
+			FP->pos = FP->hw_pos = res;
+		}
+	}
+
+	host_spiffs_unlock();
+
+	f = fopencookie(FP, mode, vfs_io);
+	if (!f) {
+		vfs_close(FP);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	setvbuf(f, (char *)FP->ra_buf + ra_size, _IOFBF, VFS_BUFSIZ);
+
+	return f;
+}
+
+FILE *__wrap_freopen(const char *path, const char *mode, FILE *stream) {
+	// Only the mode changes, there is no text mode
+	if (!path) {
+		return stream;
+	}
+
+	fclose(stream);
+
+	return __wrap_fopen(path, mode);
+}
+
+/*
+ * Files and directories
+ */
+
+int __wrap_stat(const char *path, struct stat *sb) {
+	char npath[SPIFFS_OBJ_NAME_LEN];
+	spiffs_stat st;
+	int res;
+
+	if ((res = vfs_path(path, npath))) {
+		errno = res;
+		return -1;
+	}
+
+	memset(sb, 0, sizeof(struct stat));
+	sb->st_blksize = SPIFFS_LOG_PAGE_SIZE;
+
+	// First test if it's a directory entry
+	if (is_dir(npath)) {
+		sb->st_mode = S_IFDIR;
+		return 0;
+	}
+
+	host_spiffs_lock();
+	res = SPIFFS_stat(&fs, npath, &st);
+	if (res < 0) {
+		res = spiffs_result(fs.err_code);
+	}
+	host_spiffs_unlock();
+
+	if (res) {
+		errno = res;
+		return -1;
+	}
+
+	sb->st_mode = S_IFREG;
+	sb->st_size = st.size;
+
+	return 0;
+}
+
+int __wrap_mkdir(const char *path, mode_t mode) {
+	char npath[SPIFFS_OBJ_NAME_LEN + 2];
+	spiffs_file fd;
+	int res;
+
+	if ((res = vfs_path(path, npath))) {
+		errno = res;
+		return -1;
+	}
+
+	if (is_dir(npath)) {
+		errno = EEXIST;
+		return -1;
+	}
+
+	// Add /. to path
+	strcat(npath, "/.");
+
+	host_spiffs_lock();
+
+	fd = SPIFFS_open(&fs, npath, SPIFFS_CREAT, 0);
+	if ((fd < 0) || (SPIFFS_close(&fs, fd) < 0)) {
+		res = spiffs_result(fs.err_code);
+	}
+
+	host_spiffs_unlock();
+
+	if (res) {
+		errno = res;
+		return -1;
+	}
+
+	return 0;
+}
+
+int __wrap_rmdir(const char *path) {
+	char npath[SPIFFS_OBJ_NAME_LEN + 2];
+	int res = 0;
+
+	if ((res = vfs_path(path, npath))) {
+		errno = res;
+		return -1;
+	}
+
+	if (!strcmp(npath, "/")) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	if (!is_dir(npath)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	if (dir_entries(npath) > 0) {
+		errno = ENOTEMPTY;
+		return -1;
+	}
+
+	strcat(npath, "/.");
+
+	host_spiffs_lock();
+	if (SPIFFS_remove(&fs, npath) < 0) {
+		res = spiffs_result(fs.err_code);
+	}
+	host_spiffs_unlock();
+
+	if (res) {
+		errno = res;
+		return -1;
+	}
+
+	return 0;
+}
+
+int __wrap_unlink(const char *path) {
+	char npath[SPIFFS_OBJ_NAME_LEN];
+	int res = 0;
+
+	if ((res = vfs_path(path, npath))) {
+		errno = res;
+		return -1;
+	}
+
+	if (is_dir(npath)) {
+		errno = EISDIR;
+		return -1;
+	}
+
+	host_spiffs_lock();
+	if (SPIFFS_remove(&fs, npath) < 0) {
+		res = spiffs_result(fs.err_code);
+	}
+	host_spiffs_unlock();
+
+	if (res) {
+		errno = res;
+		return -1;
+	}
+
+	return 0;
+}
+
+int __wrap_remove(const char *path) {
+	char npath[SPIFFS_OBJ_NAME_LEN];
+	int res;
+
+	if ((res = vfs_path(path, npath))) {
+		errno = res;
+		return -1;
+	}
+
+	if (is_dir(npath)) {
+		return __wrap_rmdir(npath);
+	}
+
+	return __wrap_unlink(npath);
+}
+
+int __wrap_rename(const char *src, const char *dst) {
+	char spath[SPIFFS_OBJ_NAME_LEN];
+	char dpath[SPIFFS_OBJ_NAME_LEN];
+	char npath[SPIFFS_OBJ_NAME_LEN * 2];
+	struct spiffs_dirent e;
+	spiffs_DIR d;
+	int src_dir, dst_dir;
+	int len, res = 0;
+
+	if ((res = vfs_path(src, spath)) || (res = vfs_path(dst, dpath))) {
+		errno = res;
+		return -1;
+	}
+
+	src_dir = is_dir(spath);
+	dst_dir = is_dir(dpath);
+
+	// Sanity checks
+	if (!src_dir && dst_dir) {
+		errno = EISDIR;
+		return -1;
+	}
+
+	host_spiffs_lock();
+
+	if (!src_dir) {
+		if (SPIFFS_rename(&fs, spath, dpath) < 0) {
+			res = spiffs_result(fs.err_code);
+		}
+
+		host_spiffs_unlock();
+
+		if (res) {
+			errno = res;
+			return -1;
+		}
+
+		return 0;
+	}
+
+	// We need to rename all tree. Renamed entries are appended to the
+	// end of the directory, so restart the scan after each one.
+	len = strlen(spath);
+
+again:
+	SPIFFS_opendir(&fs, "/", &d);
+	while (SPIFFS_readdir(&d, &e)) {
+		if (!strncmp(spath, (const char *)e.name, len) && (e.name[len] == '/')) {
+			if (strlen(dpath) + strlen((const char *)e.name + len) > NAME_MAX_LEN) {
+				res = ENAMETOOLONG;
+				break;
+			}
+
+			strcpy(npath, dpath);
+			strcat(npath, (const char *)e.name + len);
+
+			if (SPIFFS_rename(&fs, (const char *)e.name, npath) < 0) {
+				res = spiffs_result(fs.err_code);
+				break;
+			}
+
+			SPIFFS_closedir(&d);
+			goto again;
+		}
+	}
+	SPIFFS_closedir(&d);
+
+	host_spiffs_unlock();
+
+	if (res) {
+		errno = res;
+		return -1;
+	}
+
+	return 0;
+}
+
+int __wrap_chdir(const char *path) {
+	char npath[SPIFFS_OBJ_NAME_LEN];
+	int res;
+
+	if ((res = vfs_path(path, npath))) {
+		errno = res;
+		return -1;
+	}
+
+	if (!is_dir(npath)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	strcpy(vfs_cwd, npath);
+
+	return 0;
+}
+
+char *__wrap_getcwd(char *buf, size_t size) {
+	if (!buf) {
+		return strdup(vfs_cwd);
+	}
+
+	if (size < strlen(vfs_cwd) + 1) {
+		errno = ERANGE;
+		return NULL;
+	}
+
+	strcpy(buf, vfs_cwd);
+
+	return buf;
+}
+
+DIR *__wrap_opendir(const char *path) {
+	struct host_dir *dir;
+	int res;
+
+	dir = (struct host_dir *)calloc(1, sizeof(struct host_dir));
+	if (!dir) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if ((res = vfs_path(path, dir->path))) {
+		free(dir);
+		errno = res;
+		return NULL;
+	}
+
+	if (!is_dir(dir->path)) {
+		free(dir);
+		errno = ENOENT;
+		return NULL;
+	}
+
+	host_spiffs_lock();
+	if (!SPIFFS_opendir(&fs, "/", &dir->d)) {
+		res = spiffs_result(fs.err_code);
+	}
+	host_spiffs_unlock();
+
+	if (res) {
+		free(dir);
+		errno = res;
+		return NULL;
+	}
+
+	return dir;
+}
+
+struct dirent *__wrap_readdir(DIR *dir) {
+	struct dirent *ent = &dir->ent;
+	struct spiffs_dirent e;
+	int plen = strlen(dir->path);
+	char *fn;
+	int len;
+
+	if (plen == 1) {
+		// Root
+		plen = 0;
+	}
+
+	host_spiffs_lock();
+
+	for(;;) {
+		if (!SPIFFS_readdir(&dir->d, &e)) {
+			ent = NULL;
+			break;
+		}
+
+		// Get name and length
+		fn = (char *)e.name;
+		len = strlen(fn);
+
+		// Get entry type and size
+		ent->d_type = DT_REG;
+		ent->d_fsize = e.size;
+
+		if ((len >= 2) && (fn[len - 1] == '.') && (fn[len - 2] == '/')) {
+			ent->d_type = DT_DIR;
+			ent->d_fsize = 0;
+
+			fn[len - 2] = '\0';
+			len -= 2;
+		}
+
+		// Skip entries not belonged to path
+		if ((len <= plen) || strncmp(fn, dir->path, plen) || (fn[plen] != '/')) {
+			continue;
+		}
+
+		fn += plen + 1;
+
+		// Skip subdirectories
+		if (!*fn || strchr(fn, '/')) {
+			continue;
+		}
+
+		ent->d_reclen = ent->d_fsize;
+		ent->d_namlen = strlen(fn);
+
+		strlcpy(ent->d_name, fn, sizeof(ent->d_name));
+
+		break;
+	}
+
+	host_spiffs_unlock();
+
+	return ent;
+}
+
+int __wrap_closedir(DIR *dir) {
+	host_spiffs_lock();
+	SPIFFS_closedir(&dir->d);
+	host_spiffs_unlock();
+
+	free(dir);
+
+	return 0;
+}
+
+/*
+ * Mount
+ */
+
+int host_vfs_mount() {
+	spiffs_config cfg;
+	int res = 0;
+	int retries = 0;
+
+	cfg.phys_addr        = SPIFFS_BASE_ADDR;
+	cfg.phys_size        = SPIFFS_SIZE;
+	cfg.phys_erase_block = SPIFFS_ERASE_SIZE;
+	cfg.log_page_size    = SPIFFS_LOG_PAGE_SIZE;
+	cfg.log_block_size   = SPIFFS_LOG_BLOCK_SIZE;
+
+	cfg.hal_read_f = esp_spiffs_read;
+	cfg.hal_write_f = esp_spiffs_write;
+	cfg.hal_erase_f = esp_spiffs_erase;
+
+	my_spiffs_work_buf = malloc(cfg.log_page_size * 2);
+	if (!my_spiffs_work_buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	int fds_len = sizeof(spiffs_fd) * spiffs_max_fds;
+	my_spiffs_fds = malloc(fds_len);
+	if (!my_spiffs_fds) {
+		free(my_spiffs_work_buf);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	int cache_len = (sizeof(spiffs_cache) +
+	                 spiffs_cache_pages * (sizeof(spiffs_cache_page) + cfg.log_page_size));
+	my_spiffs_cache = malloc(cache_len);
+	if (!my_spiffs_cache) {
+		free(my_spiffs_work_buf);
+		free(my_spiffs_fds);
+		errno = ENOMEM;
+		return -1;
+	}
+
+retry:
+	if (retries > 2) {
+		fprintf(stderr, "spiffs can't mount file system\n");
+		return -1;
+	}
+
+	res = SPIFFS_mount(
+		&fs, &cfg, my_spiffs_work_buf, my_spiffs_fds,
+		fds_len, my_spiffs_cache, cache_len, NULL
+	);
+
+	if (res < 0) {
+		if (fs.err_code == SPIFFS_ERR_NOT_A_FS) {
+			fprintf(stderr, "spiffs no file system detect, formating\n");
+			SPIFFS_unmount(&fs);
+			res = SPIFFS_format(&fs);
+			if (res < 0) {
+				fprintf(stderr, "spiffs format error\n");
+				return -1;
+			}
+
+			retries++;
+			goto retry;
+		}
+
+		return -1;
+	}
+
+	return 0;
+}
+
+void host_vfs_unmount() {
+	host_spiffs_lock();
+	SPIFFS_unmount(&fs);
+	host_spiffs_unlock();
+}
+
+void spiffs_set_readahead(int ra_size) {
+	if (ra_size < 0) {
+		ra_size = 0;
+	}
+
+	// Read-ahead buffers smaller than a page are useless
+	if (ra_size && (ra_size < SPIFFS_LOG_PAGE_SIZE)) {
+		ra_size = SPIFFS_LOG_PAGE_SIZE;
+	}
+
+	if (ra_size > SPIFFS_READ_AHEAD_MAX) {
+		ra_size = SPIFFS_READ_AHEAD_MAX;
+	}
+
+	spiffs_ra_size = ra_size;
+}
+
+void spiffs_get_stats(esp_spiffs_stats_t *st) {
+#if SPIFFS_CACHE_STATS
+	st->cache_hits = fs.cache_hits;
+	st->cache_misses = fs.cache_misses;
+#else
+	st->cache_hits = 0;
+	st->cache_misses = 0;
+#endif
+	st->ra_hits = spiffs_ra_hits;
+	st->ra_misses = spiffs_ra_misses;
+	st->ra_bytes = spiffs_ra_bytes;
+	st->cache_pages = spiffs_cache_pages;
+	st->max_fds = spiffs_max_fds;
+	st->ra_size = spiffs_ra_size;
+}
+
+void spiffs_reset_stats() {
+#if SPIFFS_CACHE_STATS
+	fs.cache_hits = 0;
+	fs.cache_misses = 0;
+#endif
+	spiffs_ra_hits = 0;
+	spiffs_ra_misses = 0;
+	spiffs_ra_bytes = 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * bhgv, background acquisition of the analog inputs
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * An hrtimer wakes the sampler task at the rate of the acquisition. The
+ * task reads the 4 inputs of the PCF8591 in one I2C transaction and the
+ * ADC of the ESP8266, then acq_sample() folds each channel into the block
+ * being filled: decim samples, with their minimum, maximum and last value
+ * or average. A full block goes to the ring of its channel, which the
+ * readers (adc.acq, the websocket, the CGI scripts) empty in bulk. The
+ * sampler never waits for them: when a ring is full a block is counted as
+ * an overrun, not kept, and when the task is still busy at the next period
+ * the period is counted as missed.
+ *
+ * The inputs are not read in the timer interrupt: a transaction of the
+ * expander takes about 150 us and the bus is used by the tasks.
+ *
+ * Without KERNEL only the channels are built, the samples come from
+ * acq_sample() (see platform/host/bench/acq_bench.c).
+ */
+
+#ifdef KERNEL
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+
+#include "pthread.h"
+#include "whitecat.h"
+
+#include "espressif/esp_common.h"
+
+#include <pcf8591/pcf8591.h>
+
+#include <sys/drivers/clock.h>
+#include <sys/drivers/hrtimer.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acq.h"
+
+// The block is written before head
+#define barrier() __asm__ __volatile__("" ::: "memory")
+
+#define ACQ_EXP_MASK ((1 << ACQ_INT) - 1)
+
+static acq_channel_t channels[ACQ_CHANNELS];
+static volatile uint8_t active;     // channels sampled
+
+static acq_config_t config;
+static uint16_t fill;               // samples in the blocks being filled
+static acq_stats_t stats;
+
+#ifdef KERNEL
+
+#define ACQ_LOCK()   portENTER_CRITICAL()
+#define ACQ_UNLOCK() portEXIT_CRITICAL()
+
+#define ACQ_TICK 0
+#define ACQ_QUIT 1
+
+static hrtimer_t timer;
+static QueueHandle_t wake = NULL;   // ACQ_xxx, one at a time
+static volatile uint8_t task = 0;
+
+static void sampler_tick(void *arg) {
+	portBASE_TYPE woken = pdFALSE;
+	uint8_t m = ACQ_TICK;
+
+	if (xQueueSendFromISR(wake, &m, &woken) != pdTRUE) {
+		stats.missed++;
+	}
+
+	portEND_SWITCHING_ISR(woken);
+}
+
+static void *sampler_task(void *arg) {
+	uint16_t v[ACQ_CHANNELS];
+	uint8_t res[4];
+	uint64_t t;
+	uint32_t us;
+	uint8_t m;
+	int i;
+
+	memset(v, 0, sizeof(v));
+
+	for (;;) {
+		xQueueReceive(wake, &m, portMAX_DELAY);
+		if (m == ACQ_QUIT) {
+			break;
+		}
+
+		t = clock_monotonic_us();
+
+		// Waits for the bus while the OLED, the keys or Lua hold it, that's
+		// in sample_us
+		if (active & ACQ_EXP_MASK) {
+			pcf8591_read_all(PCF8591_DEFAULT_ADDRESS, res);
+			for (i = 0; i < 4; i++) {
+				v[i] = res[i];
+			}
+		}
+		if (active & (1 << ACQ_INT)) {
+			v[ACQ_INT] = sdk_system_adc_read();
+		}
+
+		acq_sample(v);
+
+		us = clock_monotonic_us() - t;
+		stats.sample_us = us;
+		if (us > stats.sample_max) {
+			stats.sample_max = us;
+		}
+	}
+
+	task = 0;
+	return NULL;
+}
+
+static int sampler_start(void) {
+	pthread_attr_t attr;
+	pthread_t id;
+	uint32_t period = 1000000 / config.rate;
+
+	wake = xQueueCreate(1, sizeof(uint8_t));
+	if (!wake) {
+		return EAGAIN;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, acqStack);
+	pthread_attr_setinitialstate(&attr, PTHREAD_INITIAL_STATE_RUN);
+
+	task = 1;
+	if (pthread_create(&id, &attr, sampler_task, NULL)) {
+		task = 0;
+		vQueueDelete(wake);
+		wake = NULL;
+		return EAGAIN;
+	}
+
+	hrtimer_init(&timer, sampler_tick, NULL);
+	if (hrtimer_start(&timer, period, period)) {
+		uint8_t m = ACQ_QUIT;
+
+		xQueueSend(wake, &m, portMAX_DELAY);
+		while (task) {
+			vTaskDelay(1);
+		}
+		vQueueDelete(wake);
+		wake = NULL;
+		return EAGAIN;
+	}
+
+	return 0;
+}
+
+static void sampler_stop(void) {
+	uint8_t m = ACQ_QUIT;
+
+	if (!wake) {
+		return;
+	}
+
+	hrtimer_stop(&timer);
+
+	// After the tick it may have queued
+	xQueueSend(wake, &m, portMAX_DELAY);
+	while (task) {
+		vTaskDelay(1);
+	}
+
+	vQueueDelete(wake);
+	wake = NULL;
+}
+
+#else
+
+#define ACQ_LOCK()
+#define ACQ_UNLOCK()
+
+static int sampler_start(void) {
+	return 0;
+}
+
+static void sampler_stop(void) {
+}
+
+#endif
+
+void acq_sample(const uint16_t *v) {
+	uint32_t mask = active;
+	acq_channel_t *c;
+	acq_block_t *b;
+	uint16_t head, x;
+	int ch, done;
+
+	if (!mask) {
+		return;
+	}
+
+	stats.samples++;
+	done = ++fill >= config.decim;
+
+	while (mask) {
+		ch = __builtin_ctz(mask);
+		mask &= ~(1 << ch);
+
+		c = &channels[ch];
+		x = v[ch];
+		c->last = x;
+
+		if (fill == 1) {
+			c->sum = x;
+			c->min = c->max = x;
+		} else {
+			c->sum += x;
+			if (x < c->min) {
+				c->min = x;
+			}
+			if (x > c->max) {
+				c->max = x;
+			}
+		}
+
+		if (!done) {
+			continue;
+		}
+
+		head = c->head;
+		if ((uint16_t)(head - c->tail) > c->mask) {
+			c->overruns++;
+		} else {
+			b = &c->ring[head & c->mask];
+			if (config.mode == ACQ_AVERAGE) {
+				b->value = (c->sum + fill / 2) / fill;
+			} else {
+				b->value = x;
+			}
+			b->min = c->min;
+			b->max = c->max;
+			b->seq = c->blocks;
+			barrier();
+			c->head = head + 1;
+		}
+		c->blocks++;
+	}
+
+	if (done) {
+		fill = 0;
+	}
+}
+
+int acq_start(const acq_config_t *cfg) {
+	acq_block_t *ring[ACQ_CHANNELS];
+	int i, n, size = cfg->ring;
+
+	if ((cfg->rate < 1) || (cfg->rate > ACQ_RATE_MAX) ||
+		(cfg->decim < 1) || (cfg->decim > ACQ_DECIM_MAX) ||
+		(cfg->mode > ACQ_AVERAGE) || (size > ACQ_RING_MAX) ||
+		!cfg->channels || (cfg->channels >= (1 << ACQ_CHANNELS))) {
+		return EINVAL;
+	}
+
+	acq_stop();
+
+	if (size == 0) {
+		size = ACQ_RING;
+	}
+	for (n = 2; n < size; n <<= 1);
+
+	memset(ring, 0, sizeof(ring));
+	for (i = 0; i < ACQ_CHANNELS; i++) {
+		if (!(cfg->channels & (1 << i))) {
+			continue;
+		}
+
+		ring[i] = malloc(n * sizeof(acq_block_t));
+		if (ring[i] == NULL) {
+			while (i--) {
+				free(ring[i]);
+			}
+			return ENOMEM;
+		}
+	}
+
+	memset(channels, 0, sizeof(channels));
+	for (i = 0; i < ACQ_CHANNELS; i++) {
+		channels[i].ring = ring[i];
+		channels[i].mask = n - 1;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	config = *cfg;
+	config.ring = n;
+	fill = 0;
+	active = cfg->channels;
+
+	if ((i = sampler_start())) {
+		acq_stop();
+	}
+
+	return i;
+}
+
+void acq_stop(void) {
+	acq_block_t *ring;
+	int i;
+
+	sampler_stop();
+
+	active = 0;
+	for (i = 0; i < ACQ_CHANNELS; i++) {
+		ring = channels[i].ring;
+		channels[i].ring = NULL;
+		free(ring);
+	}
+}
+
+int acq_channels(void) {
+	return active;
+}
+
+int acq_read(int ch, acq_block_t *b, int max, uint32_t *seq, int follow) {
+	acq_channel_t *c;
+	uint16_t tail, head;
+	uint32_t next;
+	int n = 0;
+
+	if ((ch < 0) || (ch >= ACQ_CHANNELS) || !(active & (1 << ch))) {
+		return -1;
+	}
+
+	c = &channels[ch];
+	tail = c->tail;
+	head = c->head;
+	barrier();
+
+	next = c->seq;
+	while ((tail != head) && (n < max)) {
+		acq_block_t *e = &c->ring[tail & c->mask];
+
+		// The blocks lost before the first one are skipped, a gap after
+		// it ends the read
+		if ((n == 0) && !follow) {
+			next += (uint16_t)(e->seq - (uint16_t)next);
+		} else if (e->seq != (uint16_t)next) {
+			break;
+		}
+
+		b[n++] = *e;
+		tail++;
+		next++;
+	}
+
+	*seq = next - n;
+
+	barrier();
+	c->tail = tail;
+	c->seq = next;
+
+	return n;
+}
+
+int acq_last(int ch) {
+	if ((ch < 0) || (ch >= ACQ_CHANNELS) || !(active & (1 << ch)) || !stats.samples) {
+		return -1;
+	}
+
+	return channels[ch].last;
+}
+
+void acq_get_stats(acq_stats_t *st, int reset) {
+	ACQ_LOCK();
+	*st = stats;
+	if (reset) {
+		stats.missed = 0;
+		stats.sample_max = 0;
+	}
+	ACQ_UNLOCK();
+
+	st->rate = config.rate;
+	st->decim = config.decim;
+	st->running = active != 0;
+}
+
+int acq_chan_stats(int ch, acq_chan_stats_t *st) {
+	acq_channel_t *c;
+
+	if ((ch < 0) || (ch >= ACQ_CHANNELS) || !(active & (1 << ch))) {
+		return -1;
+	}
+
+	c = &channels[ch];
+
+	ACQ_LOCK();
+	st->blocks = c->blocks;
+	st->overruns = c->overruns;
+	st->pending = (uint16_t)(c->head - c->tail);
+	st->seq = c->seq;
+	st->last = c->last;
+	ACQ_UNLOCK();
+
+	st->full = (ch == ACQ_INT) ? 1023 : 255;
+
+	return 0;
+}
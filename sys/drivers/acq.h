@@ -0,0 +1,130 @@
+/*
+ * bhgv, background acquisition of the analog inputs
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _ACQ_H_
+#define _ACQ_H_
+
+#include <stdint.h>
+
+// Channels: AIN0..AIN3 of the PCF8591, then the ADC of the ESP8266
+#define ACQ_CHANNELS 5
+#define ACQ_INT      4
+
+// Samples per second of all the channels, a sample of the expander is an
+// I2C transaction of about 150 us
+#ifndef ACQ_RATE_MAX
+#define ACQ_RATE_MAX 2000
+#endif
+
+// Blocks kept in the ring of a channel by default, a power of 2
+#ifndef ACQ_RING
+#define ACQ_RING 32
+#endif
+
+#define ACQ_RING_MAX  1024
+#define ACQ_DECIM_MAX 10000
+
+// Value of a block of decim samples: the last one, or their average. The
+// minimum and the maximum are kept with both.
+#define ACQ_LAST    0
+#define ACQ_AVERAGE 1
+
+typedef struct {
+	uint32_t rate;      // samples per second
+	uint16_t decim;     // samples per block
+	uint16_t ring;      // blocks per channel, 0 for ACQ_RING
+	uint8_t mode;       // ACQ_xxx
+	uint8_t channels;   // bit n, channel n is sampled
+} acq_config_t;
+
+// A block, in the units of the converter (0..255, 0..1023 for ACQ_INT)
+typedef struct {
+	uint16_t value;
+	uint16_t min;
+	uint16_t max;
+	uint16_t seq;       // low bits of the block number since the start
+} acq_block_t;
+
+/*
+ * A channel. The sampler is the only writer of head, of the block being
+ * filled and of the counts, the reader the only writer of tail and seq,
+ * so the ring needs no lock.
+ */
+typedef struct {
+	acq_block_t *ring;
+	uint16_t mask;              // size of the ring - 1
+	volatile uint16_t head;     // next block written by the sampler
+	volatile uint16_t tail;     // next block read
+	uint32_t seq;               // number of the block at tail
+
+	// By the sampler
+	volatile uint16_t last;     // last sample
+	volatile uint32_t blocks;   // blocks made
+	volatile uint32_t overruns; // blocks, the ring was full
+	uint32_t sum;               // of the block being filled
+	uint16_t min;
+	uint16_t max;
+} acq_channel_t;
+
+typedef struct {
+	uint32_t rate;
+	uint32_t decim;
+	uint32_t samples;           // taken
+	uint32_t missed;            // periods the sampler was still busy
+	uint32_t sample_us;         // time of the last sample, board only
+	uint32_t sample_max;        // longest one
+	uint8_t running;
+} acq_stats_t;
+
+// Figures of a channel
+typedef struct {
+	uint32_t blocks;
+	uint32_t overruns;
+	uint32_t pending;           // blocks in the ring
+	uint32_t seq;               // of the next block read
+	uint16_t last;
+	uint16_t full;              // value at full scale
+} acq_chan_stats_t;
+
+/*
+ * Starts the sampling of the channels of cfg, each into a ring of blocks
+ * (rounded up to a power of 2). A running acquisition is stopped first.
+ * Returns 0, EINVAL, ENOMEM or EAGAIN (the sampler can't start).
+ */
+int acq_start(const acq_config_t *cfg);
+
+// Stops the sampling and frees the rings
+void acq_stop(void);
+
+// The channels sampled, 0 when stopped
+int acq_channels(void);
+
+/*
+ * Moves up to max blocks of a channel out of its ring, no more than the
+ * ones that follow each other: a read stops before a gap of the blocks
+ * lost to an overrun. seq is the number of the first block. With follow,
+ * the first block must follow the last one read, else nothing is read.
+ * Returns the count, < 0 if the channel isn't sampled.
+ */
+int acq_read(int ch, acq_block_t *b, int max, uint32_t *seq, int follow);
+
+// The last sample of a channel, < 0 if it isn't sampled
+int acq_last(int ch);
+
+void acq_get_stats(acq_stats_t *st, int reset);
+
+// Returns 0, < 0 if the channel isn't sampled
+int acq_chan_stats(int ch, acq_chan_stats_t *st);
+
+// Records a sample of all the channels, from the sampler (or a test).
+// v[n] is the value of channel n.
+void acq_sample(const uint16_t *v);
+
+#endif
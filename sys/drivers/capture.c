@@ -0,0 +1,354 @@
+/*
+ * bhgv, timestamped capture of the edges of GPIO pins
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * A hook of platform_gpio_intr_dispatcher() reads the cycle counter once
+ * per interrupt and records the edge of each captured pin into the ring of
+ * its channel, with the count, the periods and the time at each level. The
+ * reader takes the edges out of the ring or the figures, the ISR never
+ * waits for it: when the ring is full an edge is counted, not kept.
+ *
+ * Without PLATFORM_ESP8266 only the channels are built, the edges come from
+ * capture_edge() (see platform/host/bench/capture_bench.c).
+ */
+
+#ifdef PLATFORM_ESP8266
+#include "FreeRTOS.h"
+
+#include <esp/gpio.h>
+#include <esp/interrupts.h>
+#include <xtensa_ops.h>
+
+#include "i2c-platform.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+#ifndef IRAM
+#define IRAM
+#endif
+
+#ifndef CPU_HZ
+#define CPU_HZ 80000000L
+#endif
+
+#define CC_PER_US (CPU_HZ / 1000000)
+
+// The entry is written before head
+#define barrier() __asm__ __volatile__("" ::: "memory")
+
+static capture_t channels[CAPTURE_MAX];
+
+// The channels of the pins, for the ISR
+static capture_t *by_pin[16];
+static uint32_t pins;
+
+#ifdef PLATFORM_ESP8266
+
+#define CAPTURE_LOCK()   _xt_isr_mask(1 << INUM_GPIO)
+#define CAPTURE_UNLOCK() _xt_isr_unmask(1 << INUM_GPIO)
+
+static inline uint32_t now(void) {
+	uint32_t cc;
+
+	RSR(cc, ccount);
+	return cc;
+}
+
+static uint32_t IRAM capture_isr(uint32_t status) {
+	uint32_t cc, in, bits;
+	capture_t *c;
+	int j;
+
+	RSR(cc, ccount);
+	in = GPIO.IN;
+
+	bits = status & pins;
+	status &= ~bits;
+
+	while (bits) {
+		j = __builtin_ctz(bits);
+		bits &= ~BIT(j);
+
+		c = by_pin[j];
+		if (c->edges == CAPTURE_BOTH) {
+			capture_edge(c, cc, (in >> j) & 1);
+		} else {
+			capture_edge(c, cc, c->edges == CAPTURE_RISING);
+		}
+	}
+
+	return status;
+}
+
+// The pin may be hooked by another driver (the keys of the gui)
+static int hw_start(capture_t *c) {
+	static const uint8_t types[4] = {
+		GPIO_INTTYPE_NONE, GPIO_INTTYPE_EDGE_POS,
+		GPIO_INTTYPE_EDGE_NEG, GPIO_INTTYPE_EDGE_ANY
+	};
+
+	if (!platform_gpio_register_intr_hook(pins, capture_isr)) {
+		return EBUSY;
+	}
+
+	gpio_enable(c->pin, GPIO_INPUT);
+	platform_gpio_intr_init(c->pin, types[c->edges]);
+	return 0;
+}
+
+static void hw_stop(capture_t *c) {
+	platform_gpio_intr_init(c->pin, GPIO_INTTYPE_NONE);
+	if (pins) {
+		platform_gpio_register_intr_hook(pins, capture_isr);
+	} else {
+		platform_gpio_unregister_intr_hook(capture_isr);
+	}
+}
+
+#else
+
+#define CAPTURE_LOCK()
+#define CAPTURE_UNLOCK()
+
+static inline uint32_t now(void) {
+	return 0;
+}
+
+static int hw_start(capture_t *c) {
+	return 0;
+}
+
+static void hw_stop(capture_t *c) {
+}
+
+#endif
+
+void IRAM capture_edge(capture_t *c, uint32_t cc, int level) {
+	uint16_t head = c->head;
+	uint32_t d;
+
+	level = level ? 1 : 0;
+
+	if ((uint16_t)(head - c->tail) > c->mask) {
+		c->lost++;
+	} else {
+		c->ring[head & c->mask] = (cc & ~1) | level;
+		barrier();
+		c->head = head + 1;
+	}
+	c->count++;
+
+	// The period, from the last edge of this kind
+	if (c->seen & (1 << level)) {
+		d = cc - c->last[level];
+		c->periods++;
+		c->period_sum += d;
+		if (d < c->period_min) {
+			c->period_min = d;
+		}
+		if (d > c->period_max) {
+			c->period_max = d;
+		}
+	}
+
+	// The time at the level before, both edges are needed for it
+	if ((c->edges == CAPTURE_BOTH) && c->seen) {
+		c->level_sum[c->level] += cc - c->at;
+	}
+
+	c->last[level] = cc;
+	c->seen |= 1 << level;
+	c->at = cc;
+	c->level = level;
+}
+
+capture_t *capture_channel(int pin) {
+	if ((pin < 0) || (pin > 15)) {
+		return NULL;
+	}
+
+	return by_pin[pin];
+}
+
+int capture_start(int pin, int edges, int size) {
+	capture_t *c = NULL;
+	uint32_t *ring;
+	int i, n;
+
+	if ((pin < 0) || (pin > 15) || (edges < CAPTURE_RISING) || (edges > CAPTURE_BOTH) ||
+		(size < 0) || (size > CAPTURE_RING_MAX)) {
+		return EINVAL;
+	}
+
+	if (size == 0) {
+		size = CAPTURE_RING;
+	}
+	for (n = 2; n < size; n <<= 1);
+
+	capture_stop(pin);
+
+	for (i = 0; i < CAPTURE_MAX; i++) {
+		if (channels[i].ring == NULL) {
+			c = &channels[i];
+			break;
+		}
+	}
+	if (c == NULL) {
+		return EBUSY;
+	}
+
+	ring = malloc(n * sizeof(uint32_t));
+	if (ring == NULL) {
+		return ENOMEM;
+	}
+
+	memset(c, 0, sizeof(capture_t));
+	c->ring = ring;
+	c->mask = n - 1;
+	c->pin = pin;
+	c->edges = edges;
+	c->period_min = UINT32_MAX;
+	c->start = c->prev = now();
+
+	CAPTURE_LOCK();
+	by_pin[pin] = c;
+	pins |= 1 << pin;
+	CAPTURE_UNLOCK();
+
+	if ((i = hw_start(c))) {
+		CAPTURE_LOCK();
+		by_pin[pin] = NULL;
+		pins &= ~(1 << pin);
+		c->ring = NULL;
+		CAPTURE_UNLOCK();
+		free(ring);
+	}
+
+	return i;
+}
+
+void capture_stop(int pin) {
+	capture_t *c = capture_channel(pin);
+	uint32_t *ring;
+
+	if (c == NULL) {
+		return;
+	}
+
+	CAPTURE_LOCK();
+	by_pin[pin] = NULL;
+	pins &= ~(1 << pin);
+	ring = c->ring;
+	c->ring = NULL;
+	CAPTURE_UNLOCK();
+
+	hw_stop(c);
+	free(ring);
+}
+
+int capture_read(int pin, uint32_t *dt, uint8_t *lv, int max) {
+	capture_t *c = capture_channel(pin);
+	uint16_t tail, head;
+	uint32_t e;
+	int n = 0;
+
+	if (c == NULL) {
+		return -1;
+	}
+
+	tail = c->tail;
+	head = c->head;
+	barrier();
+
+	while ((tail != head) && (n < max)) {
+		e = c->ring[tail & c->mask];
+		tail++;
+
+		dt[n] = (e & ~1) - (c->prev & ~1);
+		lv[n] = e & 1;
+		c->prev = e;
+		n++;
+	}
+
+	barrier();
+	c->tail = tail;
+
+	return n;
+}
+
+int capture_stats(int pin, capture_stats_t *st, int reset) {
+	capture_t *c = capture_channel(pin);
+	uint32_t periods, pmin, pmax;
+	uint64_t psum, lsum[2];
+
+	if (c == NULL) {
+		return -1;
+	}
+
+	CAPTURE_LOCK();
+	st->count = c->count;
+	st->lost = c->lost;
+	st->pending = (uint16_t)(c->head - c->tail);
+	periods = c->periods;
+	pmin = c->period_min;
+	pmax = c->period_max;
+	psum = c->period_sum;
+	lsum[0] = c->level_sum[0];
+	lsum[1] = c->level_sum[1];
+	if (reset) {
+		c->periods = 0;
+		c->period_min = UINT32_MAX;
+		c->period_max = 0;
+		c->period_sum = 0;
+		c->level_sum[0] = c->level_sum[1] = 0;
+	}
+	CAPTURE_UNLOCK();
+
+	st->periods = periods;
+	if (periods) {
+		st->period = psum / periods / CC_PER_US;
+		st->period_min = pmin / CC_PER_US;
+		st->period_max = pmax / CC_PER_US;
+		st->freq_mhz = psum ? (uint64_t)periods * CPU_HZ * 1000 / psum : 0;
+	} else {
+		st->period = st->period_min = st->period_max = 0;
+		st->freq_mhz = 0;
+	}
+
+	if ((c->edges == CAPTURE_BOTH) && (lsum[0] + lsum[1])) {
+		st->duty = lsum[1] * 1000 / (lsum[0] + lsum[1]);
+	} else {
+		st->duty = -1;
+	}
+
+	return 0;
+}
+
+int capture_count(int pin, uint32_t *count, int reset) {
+	capture_t *c = capture_channel(pin);
+
+	if (c == NULL) {
+		return -1;
+	}
+
+	CAPTURE_LOCK();
+	*count = c->count;
+	if (reset) {
+		c->count = 0;
+	}
+	CAPTURE_UNLOCK();
+
+	return 0;
+}
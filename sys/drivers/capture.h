@@ -0,0 +1,108 @@
+/*
+ * bhgv, timestamped capture of the edges of GPIO pins
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+
+// Channels, pins captured at once
+#ifndef CAPTURE_MAX
+#define CAPTURE_MAX 4
+#endif
+
+// Edges kept in the ring of a channel by default, a power of 2
+#ifndef CAPTURE_RING
+#define CAPTURE_RING 64
+#endif
+
+#define CAPTURE_RING_MAX 1024
+
+// Edges captured
+#define CAPTURE_RISING  1
+#define CAPTURE_FALLING 2
+#define CAPTURE_BOTH    (CAPTURE_RISING | CAPTURE_FALLING)
+
+/*
+ * A channel. The ISR is the only writer of head and of the figures, the
+ * reader the only writer of tail, so the ring needs no lock. An entry is
+ * the cycle counter at the edge with the level after it in bit 0.
+ */
+typedef struct {
+	uint32_t *ring;
+	uint16_t mask;              // size of the ring - 1
+	volatile uint16_t head;     // next entry written by the ISR
+	volatile uint16_t tail;     // next entry read
+	uint8_t pin;
+	uint8_t edges;              // CAPTURE_xxx
+	uint8_t seen;               // bit n, last[n] is set
+
+	uint32_t start;             // cycle counter at the start
+	uint32_t prev;              // cycle counter at the last edge read
+
+	// By the ISR
+	volatile uint32_t count;    // edges
+	volatile uint32_t lost;     // edges, the ring was full
+	uint32_t last[2];           // cycle counter at the last falling / rising edge
+	uint32_t at;                // at the last edge
+	uint8_t level;              // after the last edge
+
+	// Since the start or the last reset of the figures
+	uint32_t periods;           // between two edges of a kind
+	uint32_t period_min;
+	uint32_t period_max;
+	uint64_t period_sum;
+	uint64_t level_sum[2];      // time low and high, with both edges
+} capture_t;
+
+// Figures of a channel, the times in microseconds
+typedef struct {
+	uint32_t count;
+	uint32_t lost;
+	uint32_t pending;           // edges in the ring
+	uint32_t periods;
+	uint32_t period;            // average
+	uint32_t period_min;
+	uint32_t period_max;
+	uint32_t freq_mhz;          // 1 / period, in millihertz
+	int32_t duty;               // high time in 1/1000, -1 without both edges
+} capture_stats_t;
+
+/*
+ * Starts the capture of the edges of a pin (0..15) in a ring of size
+ * entries (rounded up to a power of 2, CAPTURE_RING if 0). A channel of
+ * the pin is restarted. Returns 0, EINVAL, EBUSY (no free channel) or
+ * ENOMEM.
+ */
+int capture_start(int pin, int edges, int size);
+
+// Stops the capture of a pin
+void capture_stop(int pin);
+
+// Moves up to max edges of the pin out of its ring: dt[i] is the time in
+// cycles since the edge before (the start for the first), lv[i] the level
+// after it. Returns the count, < 0 if the pin isn't captured.
+int capture_read(int pin, uint32_t *dt, uint8_t *lv, int max);
+
+// The figures of the pin, then resets the periods and the duty if reset.
+// Returns 0, < 0 if the pin isn't captured.
+int capture_stats(int pin, capture_stats_t *st, int reset);
+
+// The count of edges of the pin, then sets it to 0 if reset
+int capture_count(int pin, uint32_t *count, int reset);
+
+// Records an edge, from the ISR (or a test): cc is the cycle counter at
+// the edge and level the level of the pin after it.
+void capture_edge(capture_t *c, uint32_t cc, int level);
+
+// The channel of a pin, NULL if the pin isn't captured
+capture_t *capture_channel(int pin);
+
+#endif
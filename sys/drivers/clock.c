@@ -34,6 +34,8 @@
 
 #include <sys/time.h>
 #include <sys/mutex.h>
+#include <sys/delay.h>
+#include <sys/drivers/clock.h>
 /*
 #define TM_YEAR_BASE    1900
 #define EPOCH_YEAR      1970
@@ -53,10 +55,13 @@
 
 struct mtx clock_mtx;
 
-static volatile uint64_t tticks = 0;    // Number of ticks (1 tick = configTICK_RATE_HZ)
-static volatile uint64_t tdelta = 0;    // Delta tincs from last 1000 ms
-static volatile uint32_t tseconds = 0;  // Seconds counter (from boot)
-static volatile unsigned long long tuseconds = 0; // Seconds counter (from boot)
+#define US_PER_TICK     (1000000 / configTICK_RATE_HZ)
+#define CCOUNT_PER_US   (CPU_HZ / 1000000)
+
+static volatile uint64_t tticks = 0;      // Number of ticks (1 tick = configTICK_RATE_HZ)
+static volatile uint32_t tseq = 0;        // Incremented on each tick, for lock-free readers
+static volatile uint32_t tccount = 0;     // CPU cycle counter value at last tick
+static volatile uint32_t tseconds = 0;    // EPOCH seconds at boot
 
 #if LED_ACT
 unsigned int activity = 0;
@@ -68,34 +73,41 @@ void _clock_init(void) {
     tseconds = BUILD_TIME;
 }
 
+// Called from the tick hook, in interrupt context, so it can't take locks.
+// Readers detect a concurrent tick by comparing tseq before and after.
 void newTick(void) {
-    mtx_lock(&clock_mtx);
-    
+    tccount = _read_core_timer();
+
     // Increment internal high tick counter
-    // This is every 1 ms
     tticks++;
+    tseq++;
 
-    // Increment usecs
-    tuseconds = tuseconds + configTICK_RATE_HZ;
-
-    // Increment delta ticks
-    tdelta++;
-    if (tdelta == configTICK_RATE_HZ) {
-        // 1 second since last second
-        tdelta = 0;
-        tuseconds = 0;
-
-        tseconds++;
-        
-		#if LED_ACT
-        	if (activity <= 0) {
-            	activity = 0;
-            //	gpio_pin_inv(LED_ACT);
-        	}
-		#endif
+#if LED_ACT
+    // Once a second
+    if ((tticks % configTICK_RATE_HZ) == 0) {
+        if (activity <= 0) {
+            activity = 0;
+        //	gpio_pin_inv(LED_ACT);
+        }
     }
+#endif
+}
 
-    mtx_unlock(&clock_mtx);
+// clock_us_from(), also built by platform/host/bench/clock_bench.c
+#include "clock_us.inc"
+
+uint64_t IRAM clock_monotonic_us(void) {
+    uint64_t t;
+    uint32_t seq, tick_ccount, ccount;
+
+    do {
+        seq = tseq;
+        t = tticks;
+        tick_ccount = tccount;
+        ccount = _read_core_timer();
+    } while (seq != tseq);
+
+    return clock_us_from(t, tick_ccount, ccount);
 }
 
 // Sets current EPOCH time, based on epoch time value
@@ -114,29 +126,33 @@ void newTick(void) {
 int _gettimeofday_r(struct timeval *tv , struct timezone *tz) {
     UNUSED_ARG(tz);
 
-    mtx_lock(&clock_mtx);
-    tv->tv_sec = (uint32_t)(tseconds);
-    tv->tv_usec = tuseconds;
-    mtx_unlock(&clock_mtx);
+    uint64_t us = clock_monotonic_us();
+
+    tv->tv_sec = (uint32_t)(tseconds + us / 1000000);
+    tv->tv_usec = us % 1000000;
     
     return 0;
  }
 
  long long IRAM ticks() {
-     return tticks;
+    uint64_t t;
+    uint32_t seq;
+
+    do {
+        seq = tseq;
+        t = tticks;
+    } while (seq != tseq);
+
+    return t;
  }
 
 time_t time(time_t *t) {
-    mtx_lock(&clock_mtx);
-
-    time_t current = (tseconds);
+    time_t current = tseconds + ticks() / configTICK_RATE_HZ;
     
     if (t) {
         *t = current;
     }
 
-    mtx_unlock(&clock_mtx);
-
     return (current);
 }
 
@@ -31,6 +31,7 @@
 #define	CLOCK_H
 
 #include <sys/types.h>
+#include <stdint.h>
 
 //
 //void     set_time_ymdhms(u16_t year, u8_t month, u8_t day, u8_t hours, u8_t minutes, u8_t seconds);
@@ -41,5 +42,8 @@
 //uint32_t get_time();
 //void     newTick(void);
 
+// Microseconds since boot. Lock-free, can be called from any context.
+uint64_t clock_monotonic_us(void);
+
 #endif	/* CLOCK_H */
 
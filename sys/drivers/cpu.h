@@ -1,4 +1,7 @@
 
 #ifdef PLATFORM_ESP8266
 #include <sys/drivers/esp8266/cpu.h>
+#endif
+#ifdef PLATFORM_HOST
+#include <sys/drivers/host/cpu.h>
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+/*
+ * bhgv, cpu driver of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _HOST_CPU_H_
+#define _HOST_CPU_H_
+
+void cpu_init();
+int cpu_revission();
+void cpu_model(char *buffer);
+void cpu_reset();
+int cpu_reset_reason();
+const char *cpu_pin_name(unsigned int pin);
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ * bhgv, console UART of the host platform
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ * There is a single UART, the terminal the program runs in: writes go to
+ * stdout and reads come from stdin, whatever the unit is. Timeouts are in
+ * milliseconds, like on the board (see platform/host/uart.c).
+ *
+ */
+
+#ifndef _HOST_UART_H_
+#define _HOST_UART_H_
+
+#include "FreeRTOS.h"
+
+#include <stdint.h>
+
+void     uart_init(u8_t unit, u32_t brg, u32_t mode, u32_t qs);
+void     uart_init_interrupts(u8_t unit);
+void     uart_write(u8_t unit, char byte);
+void     uart_writes(u8_t unit, char *s);
+u8_t     uart_read(u8_t unit, char *c, u32_t timeout);
+void     uart_consume(u8_t unit);
+void     uart0_swap();
+void     uart0_default();
+
+// Raw mode of the terminal, for the binary transfers of io.receive / send
+void uart_ll_lock(int unit);
+void uart_ll_unlock(int unit);
+void uart_ll_set_raw(int raw);
+
+#endif
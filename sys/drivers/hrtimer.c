@@ -0,0 +1,519 @@
+/*
+ * bhgv, high resolution software timers on the FRC1 hardware timer
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * Many one-shot and periodic timers are multiplexed onto FRC1 with a
+ * hierarchical timer wheel (as the classic BSD / Linux callout wheel):
+ * timers expiring in the next TVR_SIZE ticks are in tv1, indexed by the low
+ * bits of the expiration, the farther ones are in the tvn levels and are
+ * cascaded down when tv1 wraps around.
+ *
+ * FRC1 isn't run periodically, it's programmed as a one-shot for the next
+ * non-empty tv1 slot (or the next tv1 wrap around, if only the upper levels
+ * have timers), and is stopped when there are no timers. Time is measured
+ * with the CPU cycle counter, so the wheel keeps in sync whatever the
+ * interrupt latency is.
+ *
+ * FRC1 also serves one fast callback, due at a cycle counter value rather
+ * than on a tick, for the step generator: the FRC1 is programmed for the
+ * nearest of the wheel and the fast callback, which is run on time to the
+ * cycle if the interrupt comes less than CC_MIN early.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp/timer.h>
+#include <esp/interrupts.h>
+
+#include <sys/delay.h>
+
+#include "hrtimer.h"
+
+#define TVR_BITS  8
+#define TVN_BITS  6
+#define TVN_LEVELS 3
+#define TVR_SIZE  (1 << TVR_BITS)
+#define TVN_SIZE  (1 << TVN_BITS)
+#define TVR_MASK  (TVR_SIZE - 1)
+#define TVN_MASK  (TVN_SIZE - 1)
+#define MAX_TVAL  ((1UL << (TVR_BITS + TVN_LEVELS * TVN_BITS)) - 1)
+
+// CPU cycles per wheel tick
+#define CC_PER_US   (CPU_HZ / 1000000)
+#define CC_PER_TICK (CC_PER_US * HRTIMER_RES_US)
+
+// FRC1 runs at 80 MHz / 16, so one count each 16 CPU cycles at 80 MHz
+#define CC_PER_FRC  (CPU_HZ / 5000000)
+
+// Minimum FRC1 timeout, in CPU cycles
+#define CC_MIN      (CC_PER_US * 5)
+
+// Maximum FRC1 timeout, in CPU cycles
+#define CC_MAX      (TIMER_FRC1_MAX_LOAD * CC_PER_FRC)
+
+LIST_HEAD(hrtimer_list, hrtimer);
+
+typedef struct {
+	struct hrtimer_list tv1[TVR_SIZE];
+	struct hrtimer_list tvn[TVN_LEVELS][TVN_SIZE];
+	uint32_t tv1_map[TVR_SIZE / 32];  // non-empty tv1 slots
+
+	uint32_t jiffies;    // next tick to process
+	uint32_t last_cc;    // cycle counter value when jiffies is due
+	uint32_t count;      // pending timers
+	uint32_t tv1_count;  // pending timers in tv1
+	uint8_t  armed;      // FRC1 is running
+	uint8_t  in_isr;     // the wheel is being processed
+
+	hrtimer_fast_cb_t fast;
+	uint32_t fast_cc;    // cycle counter value when fast is due
+
+	uint32_t irqs;
+	uint32_t runs;
+	uint32_t late_max;
+	uint32_t late_sum;
+} hrtimer_wheel_t;
+
+static hrtimer_wheel_t *wheel = NULL;
+
+static void hrtimer_isr(void);
+
+static int wheel_init() {
+	int i, j;
+
+	if (wheel) {
+		return 0;
+	}
+
+	// The wheel is allocated on first use, so it costs nothing if no
+	// timer is used
+	if (portIN_ISR()) {
+		return EPERM;
+	}
+
+	hrtimer_wheel_t *w = calloc(1, sizeof(hrtimer_wheel_t));
+	if (!w) {
+		return ENOMEM;
+	}
+
+	for(i = 0; i < TVR_SIZE; i++) {
+		LIST_INIT(&w->tv1[i]);
+	}
+
+	for(j = 0; j < TVN_LEVELS; j++) {
+		for(i = 0; i < TVN_SIZE; i++) {
+			LIST_INIT(&w->tvn[j][i]);
+		}
+	}
+
+	timer_set_interrupts(FRC1, false);
+	timer_set_run(FRC1, false);
+	timer_set_divider(FRC1, TIMER_CLKDIV_16);
+	timer_set_reload(FRC1, false);
+	_xt_isr_attach(INUM_TIMER_FRC1, hrtimer_isr);
+
+	wheel = w;
+
+	timer_set_interrupts(FRC1, true);
+
+	return 0;
+}
+
+static inline void tv1_set(uint32_t idx) {
+	wheel->tv1_map[idx >> 5] |= (1 << (idx & 31));
+}
+
+static inline void tv1_clr(uint32_t idx) {
+	wheel->tv1_map[idx >> 5] &= ~(1 << (idx & 31));
+}
+
+// Next non-empty tv1 slot in [from, TVR_SIZE), or TVR_SIZE if none
+static uint32_t tv1_next(uint32_t from) {
+	uint32_t w = from >> 5;
+	uint32_t bits = wheel->tv1_map[w] & (0xffffffff << (from & 31));
+
+	for(;;) {
+		if (bits) {
+			return (w << 5) + __builtin_ctz(bits);
+		}
+
+		if (++w >= TVR_SIZE / 32) {
+			return TVR_SIZE;
+		}
+
+		bits = wheel->tv1_map[w];
+	}
+}
+
+static void internal_add(hrtimer_t *t) {
+	uint32_t expires = t->expires;
+	uint32_t idx = expires - wheel->jiffies;
+	struct hrtimer_list *vec;
+	int i;
+
+	if (((int32_t)idx < 0) || (idx < TVR_SIZE)) {
+		// Timers already due run on next tick processed
+		i = ((int32_t)idx < 0) ? (wheel->jiffies & TVR_MASK) : (expires & TVR_MASK);
+		vec = &wheel->tv1[i];
+		tv1_set(i);
+		wheel->tv1_count++;
+		t->slot = i;
+	} else {
+		// Timers farther than the wheel span are placed at its end, and
+		// are moved again when cascaded, as t->expires is not changed
+		if (idx > MAX_TVAL) {
+			expires = wheel->jiffies + MAX_TVAL;
+			idx = MAX_TVAL;
+		}
+
+		for(i = 0; i < TVN_LEVELS - 1; i++) {
+			if (idx < (1UL << (TVR_BITS + (i + 1) * TVN_BITS))) {
+				break;
+			}
+		}
+
+		vec = &wheel->tvn[i][(expires >> (TVR_BITS + i * TVN_BITS)) & TVN_MASK];
+		t->slot = -1;
+	}
+
+	LIST_INSERT_HEAD(vec, t, entry);
+	t->pending = 1;
+	wheel->count++;
+}
+
+static void internal_del(hrtimer_t *t) {
+	LIST_REMOVE(t, entry);
+	t->pending = 0;
+	wheel->count--;
+
+	if (t->slot >= 0) {
+		wheel->tv1_count--;
+		if (LIST_EMPTY(&wheel->tv1[t->slot])) {
+			tv1_clr(t->slot);
+		}
+	}
+}
+
+// Move the timers of a tvn slot to the lower levels
+static int cascade(int level, int index) {
+	struct hrtimer_list *vec = &wheel->tvn[level][index];
+	hrtimer_t *t;
+
+	while ((t = LIST_FIRST(vec))) {
+		LIST_REMOVE(t, entry);
+		wheel->count--;
+		internal_add(t);
+	}
+
+	return index;
+}
+
+#define INDEX(N) ((wheel->jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+
+// Process tick wheel->jiffies
+static void run_tick() {
+	struct hrtimer_list work;
+	hrtimer_t *t;
+	uint32_t index = wheel->jiffies & TVR_MASK;
+	uint32_t late;
+
+	if (!index && !cascade(0, INDEX(0)) && !cascade(1, INDEX(1))) {
+		cascade(2, INDEX(2));
+	}
+
+	wheel->jiffies++;
+
+	if (LIST_EMPTY(&wheel->tv1[index])) {
+		return;
+	}
+
+	// Detach the slot, so that periodic timers re-added now land in a
+	// later slot
+	LIST_INIT(&work);
+	while ((t = LIST_FIRST(&wheel->tv1[index]))) {
+		LIST_REMOVE(t, entry);
+		LIST_INSERT_HEAD(&work, t, entry);
+	}
+	tv1_clr(index);
+
+	while ((t = LIST_FIRST(&work))) {
+		LIST_REMOVE(t, entry);
+		t->pending = 0;
+		wheel->count--;
+		wheel->tv1_count--;
+
+		late = (_read_core_timer() - wheel->last_cc) / CC_PER_US;
+
+		t->runs++;
+		t->late_sum += late;
+		if (late > t->late_max) {
+			t->late_max = late;
+		}
+
+		wheel->runs++;
+		wheel->late_sum += late;
+		if (late > wheel->late_max) {
+			wheel->late_max = late;
+		}
+
+		if (t->period) {
+			t->expires += t->period;
+			internal_add(t);
+		}
+
+		t->cb(t->arg);
+	}
+}
+
+// Program FRC1 for the next tick that needs work, or the fast callback
+static void wheel_arm() {
+	uint32_t cur, next, ahead, now;
+	int32_t remain = CC_MAX, fast;
+
+	if (!wheel->count && !wheel->fast) {
+		timer_set_run(FRC1, false);
+		wheel->armed = 0;
+		return;
+	}
+
+	now = _read_core_timer();
+
+	if (wheel->count) {
+		cur = wheel->jiffies & TVR_MASK;
+		next = tv1_next(cur);
+		if (next < TVR_SIZE) {
+			ahead = next - cur;
+		} else {
+			// Only upper levels, or tv1 slots after the wrap around
+			ahead = TVR_SIZE - cur;
+		}
+
+		remain = (int32_t)(wheel->last_cc + ahead * CC_PER_TICK - now);
+	}
+
+	if (wheel->fast) {
+		fast = (int32_t)(wheel->fast_cc - now);
+		if (fast < remain) {
+			remain = fast;
+		}
+	}
+
+	if (remain < CC_MIN) {
+		remain = CC_MIN;
+	} else if (remain > CC_MAX) {
+		remain = CC_MAX;
+	}
+
+	timer_set_load(FRC1, remain / CC_PER_FRC);
+	timer_set_run(FRC1, true);
+	wheel->armed = 1;
+}
+
+static void IRAM hrtimer_isr(void) {
+	uint32_t now, due, next, skip;
+
+	wheel->irqs++;
+	wheel->in_isr = 1;
+
+	timer_set_run(FRC1, false);
+
+	now = _read_core_timer();
+	while (wheel->count && ((int32_t)(now - wheel->last_cc) >= 0)) {
+		// Number of ticks due, including the current one
+		due = (now - wheel->last_cc) / CC_PER_TICK + 1;
+
+		// Skip empty tv1 slots, up to the next wrap around
+		next = wheel->jiffies & TVR_MASK;
+		if (next) {
+			skip = tv1_next(next) - next;
+			if (skip > due) {
+				skip = due;
+			}
+
+			if (skip) {
+				wheel->jiffies += skip;
+				wheel->last_cc += skip * CC_PER_TICK;
+				continue;
+			}
+		}
+
+		run_tick();
+		wheel->last_cc += CC_PER_TICK;
+
+		now = _read_core_timer();
+	}
+
+	wheel->in_isr = 0;
+
+	// The fast callback, waiting for its cycle when it's a little early
+	while (wheel->fast && ((int32_t)(_read_core_timer() + CC_MIN - wheel->fast_cc) >= 0)) {
+		while ((int32_t)(_read_core_timer() - wheel->fast_cc) < 0);
+
+		if ((next = wheel->fast())) {
+			wheel->fast_cc += next;
+		} else {
+			wheel->fast = NULL;
+		}
+	}
+
+	wheel_arm();
+}
+
+void hrtimer_init(hrtimer_t *t, hrtimer_cb_t cb, void *arg) {
+	memset(t, 0, sizeof(hrtimer_t));
+
+	t->cb = cb;
+	t->arg = arg;
+}
+
+int hrtimer_start(hrtimer_t *t, uint32_t us, uint32_t period_us) {
+	uint32_t ps, now;
+	int64_t d;
+	int res;
+
+	if ((res = wheel_init())) {
+		return res;
+	}
+
+	ps = _xt_disable_interrupts();
+
+	if (t->pending) {
+		internal_del(t);
+	}
+
+	now = _read_core_timer();
+	if (!wheel->count && !wheel->in_isr) {
+		// The wheel is stopped, restart its time base
+		wheel->last_cc = now;
+	}
+
+	// Expire at the first tick due at or after now + us, so that timers
+	// never run early
+	d = (int32_t)(now - wheel->last_cc) + (int64_t)us * CC_PER_US;
+	if (d <= 0) {
+		t->expires = wheel->jiffies;
+	} else {
+		t->expires = wheel->jiffies + (uint32_t)((d + CC_PER_TICK - 1) / CC_PER_TICK);
+	}
+
+	t->period = (period_us + HRTIMER_RES_US - 1) / HRTIMER_RES_US;
+
+	internal_add(t);
+
+	// The ISR will re-arm at exit
+	if (!wheel->in_isr) {
+		wheel_arm();
+	}
+
+	_xt_restore_interrupts(ps);
+
+	return 0;
+}
+
+void hrtimer_stop(hrtimer_t *t) {
+	uint32_t ps;
+
+	if (!wheel) {
+		return;
+	}
+
+	ps = _xt_disable_interrupts();
+
+	if (t->pending) {
+		internal_del(t);
+
+		if (!wheel->in_isr && !wheel->count) {
+			wheel_arm();
+		}
+	}
+
+	t->period = 0;
+
+	_xt_restore_interrupts(ps);
+}
+
+int hrtimer_fast_start(hrtimer_fast_cb_t cb, uint32_t cycles) {
+	uint32_t ps;
+	int res;
+
+	if ((res = wheel_init())) {
+		return res;
+	}
+
+	ps = _xt_disable_interrupts();
+
+	if (wheel->fast && (wheel->fast != cb)) {
+		_xt_restore_interrupts(ps);
+		return EBUSY;
+	}
+
+	wheel->fast = cb;
+	wheel->fast_cc = _read_core_timer() + cycles;
+
+	if (!wheel->in_isr) {
+		wheel_arm();
+	}
+
+	_xt_restore_interrupts(ps);
+
+	return 0;
+}
+
+void hrtimer_fast_stop(hrtimer_fast_cb_t cb) {
+	uint32_t ps;
+
+	if (!wheel) {
+		return;
+	}
+
+	ps = _xt_disable_interrupts();
+
+	if (wheel->fast == cb) {
+		wheel->fast = NULL;
+		if (!wheel->in_isr) {
+			wheel_arm();
+		}
+	}
+
+	_xt_restore_interrupts(ps);
+}
+
+int hrtimer_pending(hrtimer_t *t) {
+	return t->pending;
+}
+
+void hrtimer_get_stats(hrtimer_stats_t *st) {
+	if (!wheel) {
+		memset(st, 0, sizeof(hrtimer_stats_t));
+		return;
+	}
+
+	st->timers = wheel->count;
+	st->irqs = wheel->irqs;
+	st->runs = wheel->runs;
+	st->late_max = wheel->late_max;
+	st->late_avg = wheel->runs ? wheel->late_sum / wheel->runs : 0;
+}
+
+void hrtimer_reset_stats() {
+	if (!wheel) {
+		return;
+	}
+
+	wheel->irqs = 0;
+	wheel->runs = 0;
+	wheel->late_max = 0;
+	wheel->late_sum = 0;
+}
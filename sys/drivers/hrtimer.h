@@ -0,0 +1,78 @@
+/*
+ * bhgv, high resolution software timers on the FRC1 hardware timer
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _HRTIMER_H_
+#define _HRTIMER_H_
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+// Resolution of the timer wheel in microseconds
+#ifndef HRTIMER_RES_US
+#define HRTIMER_RES_US 50
+#endif
+
+// Callback of a timer. It runs inside the FRC1 interrupt, so it must be
+// short, can't block and can only use the FromISR FreeRTOS API.
+typedef void (*hrtimer_cb_t)(void *arg);
+
+typedef struct hrtimer {
+	LIST_ENTRY(hrtimer) entry;
+	uint32_t expires;       // expiration, in wheel ticks
+	uint32_t period;        // period in wheel ticks, 0 for one-shot timers
+	hrtimer_cb_t cb;
+	void *arg;
+	int16_t slot;           // tv1 slot, -1 if in the upper levels
+	uint8_t pending;        // linked into the wheel
+
+	// Statistics, late is the delay from the programmed expiration to the
+	// callback, in microseconds
+	uint32_t runs;
+	uint32_t late_max;
+	uint32_t late_sum;
+} hrtimer_t;
+
+typedef struct {
+	uint32_t timers;        // pending timers
+	uint32_t irqs;          // FRC1 interrupts
+	uint32_t runs;          // callbacks run
+	uint32_t late_max;      // max lateness, in microseconds
+	uint32_t late_avg;      // average lateness, in microseconds
+} hrtimer_stats_t;
+
+void hrtimer_init(hrtimer_t *t, hrtimer_cb_t cb, void *arg);
+
+// Start (or restart) a timer that expires in us microseconds and then,
+// if period_us is not 0, every period_us microseconds. Can be called from
+// any context, including timer callbacks.
+int hrtimer_start(hrtimer_t *t, uint32_t us, uint32_t period_us);
+
+// Stop a timer. Can be called from any context.
+void hrtimer_stop(hrtimer_t *t);
+
+int hrtimer_pending(hrtimer_t *t);
+
+/*
+ * A callback finer than the wheel on the same FRC1, for one user at a time
+ * (the step generator of sys/drivers/motion.c). It runs when the cycle
+ * counter reaches its due time, which it moves on by the cycles it returns,
+ * or returns 0 to stop. Same constraints as the timer callbacks. Only on
+ * the board.
+ */
+typedef uint32_t (*hrtimer_fast_cb_t)(void);
+
+// Runs cb in cycles CPU cycles, EBUSY if another fast callback runs
+int hrtimer_fast_start(hrtimer_fast_cb_t cb, uint32_t cycles);
+void hrtimer_fast_stop(hrtimer_fast_cb_t cb);
+
+void hrtimer_get_stats(hrtimer_stats_t *st);
+void hrtimer_reset_stats();
+
+#endif
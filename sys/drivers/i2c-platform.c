@@ -12,6 +12,9 @@
 //#include "driver/sigma_delta.h"
 //#include "pin_map.h"
 
+#include "FreeRTOS.h"
+#include "task.h"
+
 #include "sys/drivers/cpu.h"
 #include "sys/drivers/gpio.h"
 //#include "sys/drivers/platform/esp8266/gpio.h"
@@ -21,23 +24,23 @@
 
 #undef GPIO_INTERRUPT_ENABLE
 
-#ifdef GPIO_INTERRUPT_ENABLE
-//static task_handle_t gpio_task_handle;
+// Hooks of the GPIO interrupt, see platform_gpio_register_intr_hook()
+#define GPIO_HOOK_MAX 4
 
-#ifdef GPIO_INTERRUPT_HOOK_ENABLE
 struct gpio_hook_entry {
   platform_hook_function func;
   uint32_t               bits;
 };
 struct gpio_hook {
-  struct gpio_hook_entry *entry;
-  uint32_t                all_bits;
-  uint32_t                count;
+  struct gpio_hook_entry entry[GPIO_HOOK_MAX];
+  uint32_t               all_bits;
+  uint32_t               count;
 };
 
 static struct gpio_hook platform_gpio_hook;
-#endif
-#endif
+
+// The gpioNN_interrupt_handler()s, see esp_gpio_interrupts.c
+extern void (* const gpio_interrupt_handlers[16])(void);
 
 /*
 int platform_init()
@@ -198,151 +201,97 @@ int platform_gpio_read( unsigned pin )
 }
 #endif
 
-#ifdef GPIO_INTERRUPT_ENABLE
-#if 0
-static void ICACHE_RAM_ATTR platform_gpio_intr_dispatcher (void *dummy){
-  uint32 j=0;
-  uint32 gpio_status = GPIO_REG_READ(GPIO_STATUS_ADDRESS);
-  uint32 now = system_get_time();
-  UNUSED(dummy);
+// ****************************************************************************
+// GPIO interrupts
+
+/*
+ * The GPIO ISR. The hooks see the status first, and each returns the bits
+ * left for the others; what remains goes to the gpioNN_interrupt_handler()
+ * of the pin, as with the default handler of esp_gpio_interrupts.c.
+ */
+void IRAM platform_gpio_intr_dispatcher(void)
+{
+  uint32_t gpio_status = GPIO.STATUS;
+  uint32_t j;
+
+  GPIO.STATUS_CLEAR = gpio_status;
 
-#ifdef GPIO_INTERRUPT_HOOK_ENABLE
   if (gpio_status & platform_gpio_hook.all_bits) {
     for (j = 0; j < platform_gpio_hook.count; j++) {
-       if (gpio_status & platform_gpio_hook.entry[j].bits)
-         gpio_status = (platform_gpio_hook.entry[j].func)(gpio_status);
+      if (gpio_status & platform_gpio_hook.entry[j].bits)
+        gpio_status = (platform_gpio_hook.entry[j].func)(gpio_status);
     }
   }
-#endif
-  /*
-   * gpio_status is a bit map where bit 0 is set if unmapped gpio pin 0 (pin3) has
-   * triggered the ISR. bit 1 if unmapped gpio pin 1 (pin10=U0TXD), etc.  Since this
-   * is the ISR, it makes sense to optimize this by doing a fast scan of the status
-   * and reverse mapping any set bits.
-   */
-   for (j = 0; gpio_status>0; j++, gpio_status >>= 1) {
-    if (gpio_status&1) {
-      int i = pin_num_inv[j];
-      if (pin_int_type[i]) {
-        //disable interrupt
-        gpio_pin_intr_state_set(GPIO_ID_PIN(j), GPIO_PIN_INTR_DISABLE);
-        //clear interrupt status
-        GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, BIT(j));
-        uint32 level = 0x1 & GPIO_INPUT_GET(GPIO_ID_PIN(j));
-	task_post_high (gpio_task_handle, (now << 8) + (i<<1) + level);
-	// We re-enable the interrupt when we execute the callback
-      }
-    }
+
+  while (gpio_status) {
+    j = __builtin_ctz(gpio_status);
+    gpio_status &= ~BIT(j);
+    if (FIELD2VAL(GPIO_CONF_INTTYPE, GPIO.CONF[j]))
+      gpio_interrupt_handlers[j]();
   }
 }
 
-void platform_gpio_init( task_handle_t gpio_task )
-{
-  gpio_task_handle = gpio_task;
+// gpio_set_interrupt() attaches gpio_interrupt_handler(), this replaces the
+// weak one
+void gpio_interrupt_handler(void) __attribute__((alias("platform_gpio_intr_dispatcher")));
 
-  ETS_GPIO_INTR_ATTACH(platform_gpio_intr_dispatcher, NULL);
-}
-
-#ifdef GPIO_INTERRUPT_HOOK_ENABLE
 /*
  * Register an ISR hook to be called from the GPIO ISR for a given GPIO bitmask.
- * This routine is only called a few times so has been optimised for size and
- * the unregister is a special case when the bits are 0.
+ * The unregister is the special case when the bits are 0.
  *
  * Each hook function can only be registered once. If it is re-registered
  * then the hooked bits are just updated to the new value.
  */
 int platform_gpio_register_intr_hook(uint32_t bits, platform_hook_function hook)
 {
-  struct gpio_hook nh, oh = platform_gpio_hook;
-  int i, j;
+  struct gpio_hook *h = &platform_gpio_hook;
+  uint32_t others;
+  int i;
 
   if (!hook) {
     // Cannot register or unregister null hook
     return 0;
   }
 
-  int delete_slot = -1;
-
-  // If hook already registered, just update the bits
-  for (i=0; i<oh.count; i++) {
-    if (hook == oh.entry[i].func) {
-      if (!bits) {
-	// Unregister if move to zero bits
-	delete_slot = i;
-	break;
-      }
-      if (bits & (oh.all_bits & ~oh.entry[i].bits)) {
-	// Attempt to hook an already hooked bit
-	return 0;
-      }
-      // Update the hooked bits (in the right order)
-      uint32_t old_bits = oh.entry[i].bits;
-      *(volatile uint32_t *) &oh.entry[i].bits = bits;
-      *(volatile uint32_t *) &oh.all_bits = (oh.all_bits & ~old_bits) | bits;
-      return 1;
-    }
+  for (i = 0; i < h->count; i++) {
+    if (hook == h->entry[i].func)
+      break;
   }
 
-  // This must be the register new hook / delete old hook
-  
-  if (delete_slot < 0) {
-    if (bits & oh.all_bits) {
-      return 0;   // Attempt to hook already hooked bits
-    }
-    nh.count = oh.count + 1;    // register a new hook
-  } else {
-    nh.count = oh.count - 1;    // unregister an old hook
-  }
+  others = h->all_bits & ~((i < h->count) ? h->entry[i].bits : 0);
 
-  // These return NULL if the count = 0 so only error check if > 0)
-  nh.entry = c_malloc( nh.count * sizeof(*(nh.entry)) );
-  if (nh.count && !(nh.entry)) {
-    return 0;  // Allocation failure
+  if (bits & others) {
+    return 0;   // Attempt to hook already hooked bits
   }
-
-  for (i=0, j=0; i<oh.count; i++) {
-    // Don't copy if this is the entry to delete
-    if (i != delete_slot) {
-      nh.entry[j++]   = oh.entry[i];
-    }
+  if ((i == h->count) && (!bits || (h->count == GPIO_HOOK_MAX))) {
+    return 0;
   }
 
-  if (delete_slot < 0) { // for a register add the hook to the tail and set the all bits
-    nh.entry[j].bits  = bits;
-    nh.entry[j].func  = hook;
-    nh.all_bits = oh.all_bits | bits;
-  } else {    // for an unregister clear the matching all bits
-    nh.all_bits = oh.all_bits & (~oh.entry[delete_slot].bits);
+  _xt_isr_mask(1 << INUM_GPIO);
+  if (!bits) {
+    h->entry[i] = h->entry[--h->count];
+  } else {
+    h->entry[i].func = hook;
+    h->entry[i].bits = bits;
+    if (i == h->count)
+      h->count++;
   }
+  h->all_bits = others | bits;
+  _xt_isr_unmask(1 << INUM_GPIO);
 
-  ETS_GPIO_INTR_DISABLE();
-  // This is a structure copy, so interrupts need to be disabled
-  platform_gpio_hook = nh;
-  ETS_GPIO_INTR_ENABLE();
-
-  c_free(oh.entry);
   return 1;
 }
-#endif // GPIO_INTERRUPT_HOOK_ENABLE
 
 /*
- * Initialise GPIO interrupt mode. Optionally in RAM because interrupts are disabled
+ * Sets the interrupt type of a pin (GPIO_INTTYPE_xxx), and attaches the ISR
  */
-void NO_INTR_CODE platform_gpio_intr_init( unsigned pin, GPIO_INT_TYPE type )
+void platform_gpio_intr_init( unsigned pin, unsigned type )
 {
-  if (platform_gpio_exists(pin)) {
-    ETS_GPIO_INTR_DISABLE();
-    //clear interrupt status
-    GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, BIT(pin_num[pin]));
-    pin_int_type[pin] = type;
-    //enable interrupt
-    gpio_pin_intr_state_set(GPIO_ID_PIN(pin_num[pin]), type);
-    ETS_GPIO_INTR_ENABLE();
+  if (pin < 16) {
+    GPIO.STATUS_CLEAR = BIT(pin);
+    gpio_set_interrupt(pin, type);
   }
 }
-#endif
-#endif
 
 // **************************************************************************************
 // PWMs
@@ -543,7 +492,16 @@ void ICACHE_RAM_ATTR platform_sigma_delta_set_target( uint8_t target )
 // *****************************************************************************
 // I2C platform interface
 
+#define I2C_SELF() ((uintptr_t)xTaskGetCurrentTaskHandle())
+
+// platform_i2c_lock() / platform_i2c_unlock(), also built by
+// platform/host/i2c.c
+#include "i2c_lock.inc"
+
 uint32_t platform_i2c_setup( unsigned id, uint8_t sda, uint8_t scl, uint32_t speed ){
+  i2c_lock_init();
+  platform_i2c_lock(id);
+
 //  if (sda >= NUM_GPIO || scl >= NUM_GPIO)
 //    return 0;
     
@@ -595,15 +553,19 @@ uint32_t platform_i2c_setup( unsigned id, uint8_t sda, uint8_t scl, uint32_t spe
 //  platform_gpio_mode(scl, PLATFORM_GPIO_INPUT, PLATFORM_GPIO_PULLUP);    // disable gpio interrupt first
 
   i2c_master_gpio_init(sda, scl);
+
+  platform_i2c_unlock(id);
   return PLATFORM_I2C_SPEED_SLOW;
 }
 
 void platform_i2c_send_start( unsigned id ){
+  i2c_lock_start(id);
   i2c_master_start();
 }
 
 void platform_i2c_send_stop( unsigned id ){
   i2c_master_stop();
+  i2c_lock_stop(id);
 }
 
 int platform_i2c_send_address( unsigned id, uint16_t address, int direction ){
@@ -46,14 +46,13 @@ int platform_gpio_mode( unsigned pin, unsigned mode, unsigned pull );
 int platform_gpio_write( unsigned pin, unsigned level );
 int platform_gpio_read( unsigned pin );
 
-// Note that these functions will not be compiled in unless GPIO_INTERRUPT_ENABLE and
-// GPIO_INTERRUPT_HOOK_ENABLE are defined.
-#if 0
+// Hooks of the GPIO interrupt: a hook gets the status bits of the pins that
+// fired and returns those left for the other hooks and the pin handlers.
 int platform_gpio_register_intr_hook(uint32_t gpio_bits, platform_hook_function hook);
 #define platform_gpio_unregister_intr_hook(hook) \
   platform_gpio_register_intr_hook(0, hook);
-void platform_gpio_intr_init( unsigned pin, GPIO_INT_TYPE type );
-#endif
+void platform_gpio_intr_init( unsigned pin, unsigned type );
+void platform_gpio_intr_dispatcher(void);
 //void platform_gpio_init( task_handle_t gpio_task );
 // *****************************************************************************
 // Timer subsection
@@ -261,6 +260,11 @@ int platform_i2c_send_address( unsigned id, uint16_t address, int direction );
 int platform_i2c_send_byte( unsigned id, uint8_t data );
 int platform_i2c_recv_byte( unsigned id, int ack );
 
+// The bus is held from a start to its stop. A driver holds it over all of
+// an operation with these, they nest for the task that holds it.
+void platform_i2c_lock( unsigned id );
+void platform_i2c_unlock( unsigned id );
+
 // *****************************************************************************
 // Ethernet specific functions
 
@@ -0,0 +1,615 @@
+/*
+ * bhgv, motion planner and step generator of the stepper motors
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+/*
+ * The planner queues lines with the limits of speed and acceleration of
+ * their axes, and plans the speeds of the queue again at each line, as
+ * grbl does: the speed at a junction is limited by the angle of the lines
+ * (the junction deviation), a backward pass lowers the entry speeds so that
+ * the last line ends at rest, a forward pass so that each line can reach
+ * the entry of the next one. Then each line gets a trapezoid of step rates,
+ * accelerating, cruising and decelerating, so that a path of short lines
+ * stops only where it has to.
+ *
+ * The step generator is a fast callback of the FRC1 timer (hrtimer.c): at
+ * each step event it pulses the step pins of the axes, Bresenham style
+ * from the axis with the most steps, and computes the time to the next one
+ * from the trapezoid with integers only: v^2 = v0^2 + a(2n + 1) halfway
+ * into step n.
+ *
+ * The line being stepped is busy and never planned again, nor the entry of
+ * the line after it. The planner works on copies of the speeds and commits
+ * them line by line with the interrupts off; if the generator took a line
+ * meanwhile, the queue is planned again from there.
+ *
+ * Without PLATFORM_ESP8266 nothing is stepped, the events come from
+ * motion_next() (see platform/host/bench/motion_bench.c).
+ */
+
+#ifdef PLATFORM_ESP8266
+#include "FreeRTOS.h"
+
+#include <esp/gpio.h>
+#include <esp/interrupts.h>
+#include <xtensa_ops.h>
+
+#include "hrtimer.h"
+#endif
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "motion.h"
+
+#ifndef IRAM
+#define IRAM
+#endif
+
+#ifndef CPU_HZ
+#define CPU_HZ 80000000L
+#endif
+
+#define CC_PER_US (CPU_HZ / 1000000)
+
+#define QUEUE_MASK (MOTION_QUEUE - 1)
+
+#define barrier() __asm__ __volatile__("" ::: "memory")
+
+static motion_config_t conf;
+static uint8_t configured = 0;
+
+// head is written by the planner, tail by the generator
+static motion_block_t queue[MOTION_QUEUE];
+static volatile uint8_t head = 0, tail = 0;
+
+// The planner, at the end of the last line queued
+static int32_t planned[MOTION_AXES];
+static float prev_unit[MOTION_AXES];
+static float prev_nominal;
+
+// The generator
+static motion_block_t *cur = NULL;
+static uint32_t cur_n;
+static int32_t counter[MOTION_AXES];
+static volatile int32_t position[MOTION_AXES];
+static volatile uint8_t running = 0;
+
+static motion_stats_t stats;
+
+#ifdef PLATFORM_ESP8266
+
+#define MOTION_LOCK(ps)   ps = _xt_disable_interrupts()
+#define MOTION_UNLOCK(ps) _xt_restore_interrupts(ps)
+
+static motion_event_t due_ev;
+static uint32_t due_cc;
+static uint32_t step_mask[MOTION_AXES];
+static uint32_t dir_mask[MOTION_AXES];
+static uint32_t dir_out;
+
+static inline uint32_t now(void) {
+	uint32_t cc;
+
+	RSR(cc, ccount);
+	return cc;
+}
+
+static inline void IRAM wait_us(uint32_t us) {
+	uint32_t from = now();
+
+	while ((now() - from) < us * CC_PER_US);
+}
+
+// Steps the event due, then gets the next one
+static uint32_t IRAM motion_isr(void) {
+	uint32_t late, set = 0, clr = 0, bits = 0;
+	int i;
+
+	late = (now() - due_cc) / CC_PER_US;
+	if (late > stats.late_max) {
+		stats.late_max = late;
+	}
+
+	if (due_ev.dir != dir_out) {
+		for (i = 0; i < conf.axes; i++) {
+			if (due_ev.dir & BIT(i)) {
+				set |= dir_mask[i];
+			} else {
+				clr |= dir_mask[i];
+			}
+		}
+
+		GPIO.OUT_SET = set;
+		GPIO.OUT_CLEAR = clr;
+		dir_out = due_ev.dir;
+		wait_us(conf.pulse_us);
+	}
+
+	for (i = 0; i < conf.axes; i++) {
+		if (due_ev.axes & BIT(i)) {
+			bits |= step_mask[i];
+		}
+	}
+
+	GPIO.OUT_SET = bits;
+	wait_us(conf.pulse_us);
+	GPIO.OUT_CLEAR = bits;
+
+	if (!motion_next(&due_ev)) {
+		return 0;
+	}
+
+	due_cc += due_ev.dt;
+	return due_ev.dt;
+}
+
+static void hw_setup(void) {
+	int i;
+
+	dir_out = 0xffffffff;
+
+	for (i = 0; i < conf.axes; i++) {
+		step_mask[i] = dir_mask[i] = 0;
+
+		if (conf.step_pin[i] != MOTION_NO_PIN) {
+			step_mask[i] = BIT(conf.step_pin[i]);
+			gpio_enable(conf.step_pin[i], GPIO_OUTPUT);
+			gpio_write(conf.step_pin[i], 0);
+		}
+
+		if (conf.dir_pin[i] != MOTION_NO_PIN) {
+			dir_mask[i] = BIT(conf.dir_pin[i]);
+			gpio_enable(conf.dir_pin[i], GPIO_OUTPUT);
+		}
+	}
+}
+
+// With the interrupts off
+static int hw_start(void) {
+	if (!motion_next(&due_ev)) {
+		return 0;
+	}
+
+	due_cc = now() + due_ev.dt;
+	return hrtimer_fast_start(motion_isr, due_ev.dt);
+}
+
+static void hw_stop(void) {
+	hrtimer_fast_stop(motion_isr);
+}
+
+#else
+
+#define MOTION_LOCK(ps)   ps = 0
+#define MOTION_UNLOCK(ps) (void)ps
+
+static inline uint32_t now(void) {
+	return 0;
+}
+
+static void hw_setup(void) {
+}
+
+static int hw_start(void) {
+	return 0;
+}
+
+static void hw_stop(void) {
+}
+
+#endif
+
+static uint32_t IRAM isqrt(uint32_t x) {
+	uint32_t r = 0, b = 1UL << 30;
+
+	while (b > x) {
+		b >>= 2;
+	}
+
+	while (b) {
+		if (x >= r + b) {
+			x -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+
+	return r;
+}
+
+// The trapezoid of b from entry to exit (mm/s) into t
+static void trapezoid(const motion_block_t *b, float entry, float exit, motion_block_t *t) {
+	float f = b->step_count / b->mm;
+	float vi = entry * f, vn = b->nominal_speed * f, vf = exit * f;
+	float a = b->accel * f;
+	int32_t n = b->step_count, accel, decel;
+
+	if (a > (float)MOTION_RATE_MAX * MOTION_RATE_MAX) {
+		a = (float)MOTION_RATE_MAX * MOTION_RATE_MAX;
+	}
+
+	accel = (int32_t)ceilf((vn * vn - vi * vi) / (2 * a));
+	decel = (int32_t)ceilf((vn * vn - vf * vf) / (2 * a));
+
+	if (accel < 0) {
+		accel = 0;
+	}
+	if (decel < 0) {
+		decel = 0;
+	}
+
+	if (accel + decel > n) {
+		// No cruise, the speeds meet where they can
+		accel = (int32_t)lroundf((2 * a * n + vf * vf - vi * vi) / (4 * a));
+		if (accel < 0) {
+			accel = 0;
+		} else if (accel > n) {
+			accel = n;
+		}
+		decel = n - accel;
+	}
+
+	t->initial_rate = (uint32_t)lroundf(vi);
+	t->nominal_rate = (uint32_t)lroundf(vn);
+	t->final_rate = (uint32_t)lroundf(vf);
+	t->accel_st = (uint32_t)lroundf(a);
+	t->accel_until = accel;
+	t->decel_after = n - decel;
+
+	if (t->nominal_rate < 1) {
+		t->nominal_rate = 1;
+	}
+	if (t->accel_st < 1) {
+		t->accel_st = 1;
+	}
+}
+
+static void recalculate(void) {
+	float entry[MOTION_QUEUE + 1], v;
+	motion_block_t *b, t;
+	uint8_t first, count;
+	uint32_t ps;
+	int k;
+
+again:
+	MOTION_LOCK(ps);
+	first = tail;
+	if (queue[first & QUEUE_MASK].busy) {
+		first++;
+	}
+	count = head - first;
+	MOTION_UNLOCK(ps);
+
+	if (!count) {
+		return;
+	}
+
+	// The entry of the first line is set: at rest, or the exit of the
+	// line being stepped
+	entry[0] = queue[first & QUEUE_MASK].entry_speed;
+	entry[count] = 0;
+
+	// Backward, each line can slow down to the next one
+	for (k = count - 1; k > 0; k--) {
+		b = &queue[(first + k) & QUEUE_MASK];
+		v = sqrtf(entry[k + 1] * entry[k + 1] + 2 * b->accel * b->mm);
+		entry[k] = (v < b->max_entry_speed) ? v : b->max_entry_speed;
+	}
+
+	// Forward, each line can speed up to the next one
+	for (k = 0; k < count - 1; k++) {
+		b = &queue[(first + k) & QUEUE_MASK];
+		v = sqrtf(entry[k] * entry[k] + 2 * b->accel * b->mm);
+		if (v < entry[k + 1]) {
+			entry[k + 1] = v;
+		}
+	}
+
+	for (k = 0; k < count; k++) {
+		b = &queue[(first + k) & QUEUE_MASK];
+		trapezoid(b, entry[k], entry[k + 1], &t);
+
+		MOTION_LOCK(ps);
+		if (b->busy) {
+			MOTION_UNLOCK(ps);
+			goto again;
+		}
+
+		b->entry_speed = entry[k];
+		b->initial_rate = t.initial_rate;
+		b->nominal_rate = t.nominal_rate;
+		b->final_rate = t.final_rate;
+		b->accel_st = t.accel_st;
+		b->accel_until = t.accel_until;
+		b->decel_after = t.decel_after;
+		MOTION_UNLOCK(ps);
+	}
+}
+
+int motion_setup(const motion_config_t *cfg) {
+	int i;
+
+	if ((cfg->axes < 1) || (cfg->axes > MOTION_AXES) || (cfg->junction < 0)) {
+		return EINVAL;
+	}
+
+	for (i = 0; i < cfg->axes; i++) {
+		if ((cfg->steps_per_mm[i] == 0) || (cfg->rate[i] <= 0) || (cfg->accel[i] <= 0) ||
+			((cfg->step_pin[i] > 15) && (cfg->step_pin[i] != MOTION_NO_PIN)) ||
+			((cfg->dir_pin[i] > 15) && (cfg->dir_pin[i] != MOTION_NO_PIN))) {
+			return EINVAL;
+		}
+	}
+
+	motion_stop();
+
+	memcpy(&conf, cfg, sizeof(motion_config_t));
+	memset((void *)position, 0, sizeof(position));
+	memset(planned, 0, sizeof(planned));
+	memset(&stats, 0, sizeof(stats));
+
+	hw_setup();
+	configured = 1;
+
+	return 0;
+}
+
+int motion_line(const float *target, float feed) {
+	motion_block_t *b;
+	int32_t steps[MOTION_AXES], to[MOTION_AXES], s;
+	float unit[MOTION_AXES], d, mm = 0, nominal = feed, accel = 0;
+	float cos_theta, sin_half, vj;
+	uint32_t n = 0, t0 = now();
+	int i;
+
+	if (!configured || !(feed > 0)) {
+		return EINVAL;
+	}
+
+	if ((uint8_t)(head - tail) >= MOTION_QUEUE) {
+		motion_start();
+		return EAGAIN;
+	}
+
+	memset(steps, 0, sizeof(steps));
+	for (i = 0; i < conf.axes; i++) {
+		to[i] = lroundf(target[i] * conf.steps_per_mm[i]);
+		steps[i] = to[i] - planned[i];
+		s = abs(steps[i]);
+		if (s > n) {
+			n = s;
+		}
+
+		d = steps[i] / conf.steps_per_mm[i];
+		unit[i] = d;
+		mm += d * d;
+	}
+
+	if (!n) {
+		return 0;
+	}
+
+	mm = sqrtf(mm);
+
+	// The limits of the axes along the line
+	for (i = 0; i < conf.axes; i++) {
+		unit[i] /= mm;
+		d = fabsf(unit[i]);
+		if (d > 1e-6f) {
+			if (nominal * d > conf.rate[i]) {
+				nominal = conf.rate[i] / d;
+			}
+			if (!accel || (conf.accel[i] / d < accel)) {
+				accel = conf.accel[i] / d;
+			}
+		}
+	}
+
+	if (nominal * n / mm > MOTION_RATE_MAX) {
+		nominal = (float)MOTION_RATE_MAX * mm / n;
+	}
+
+	b = &queue[head & QUEUE_MASK];
+	memset(b, 0, sizeof(motion_block_t));
+
+	for (i = 0; i < conf.axes; i++) {
+		b->steps[i] = steps[i];
+		if (steps[i] < 0) {
+			b->dir |= 1 << i;
+		}
+	}
+
+	b->step_count = n;
+	b->mm = mm;
+	b->nominal_speed = nominal;
+	b->accel = accel;
+
+	// The junction with the line before, if it's still in the queue
+	if (head != tail) {
+		cos_theta = 0;
+		for (i = 0; i < conf.axes; i++) {
+			cos_theta -= prev_unit[i] * unit[i];
+		}
+
+		if (cos_theta > 0.999999f) {
+			// Back on the same line
+			vj = 0;
+		} else if (cos_theta < -0.999999f) {
+			// Straight on
+			vj = nominal;
+		} else {
+			sin_half = sqrtf(0.5f * (1 - cos_theta));
+			vj = sqrtf(accel * conf.junction * sin_half / (1 - sin_half));
+		}
+
+		if (vj > nominal) {
+			vj = nominal;
+		}
+		if (vj > prev_nominal) {
+			vj = prev_nominal;
+		}
+
+		b->max_entry_speed = vj;
+	}
+
+	trapezoid(b, 0, 0, b);
+
+	barrier();
+	head++;
+
+	memcpy(planned, to, sizeof(planned));
+	memcpy(prev_unit, unit, sizeof(prev_unit));
+	prev_nominal = nominal;
+	stats.queued++;
+
+	recalculate();
+
+	stats.plan_us = (now() - t0) / CC_PER_US;
+
+	if ((uint8_t)(head - tail) >= MOTION_QUEUE) {
+		motion_start();
+	}
+
+	return 0;
+}
+
+void motion_start(void) {
+	uint32_t ps;
+
+	MOTION_LOCK(ps);
+	if (!running && (head != tail)) {
+		running = 1;
+		if (hw_start()) {
+			running = 0;
+		}
+	}
+	MOTION_UNLOCK(ps);
+}
+
+void motion_stop(void) {
+	uint32_t ps;
+
+	MOTION_LOCK(ps);
+	hw_stop();
+	running = 0;
+	if (cur) {
+		cur->busy = 0;
+		cur = NULL;
+	}
+	tail = head;
+	memcpy(planned, (void *)position, sizeof(planned));
+	MOTION_UNLOCK(ps);
+}
+
+int motion_busy(void) {
+	return running || (head != tail);
+}
+
+void motion_position(float *mm) {
+	int i;
+
+	for (i = 0; i < MOTION_AXES; i++) {
+		mm[i] = (configured && (i < conf.axes)) ? position[i] / conf.steps_per_mm[i] : 0;
+	}
+}
+
+int motion_set_position(const float *mm) {
+	int i;
+
+	if (!configured) {
+		return EINVAL;
+	}
+
+	if (motion_busy()) {
+		return EBUSY;
+	}
+
+	for (i = 0; i < conf.axes; i++) {
+		planned[i] = position[i] = lroundf(mm[i] * conf.steps_per_mm[i]);
+	}
+
+	return 0;
+}
+
+void motion_get_stats(motion_stats_t *st) {
+	memcpy(st, &stats, sizeof(motion_stats_t));
+	st->pending = (uint8_t)(head - tail);
+	st->running = running;
+}
+
+int IRAM motion_next(motion_event_t *ev) {
+	motion_block_t *b = cur;
+	uint32_t v, r;
+	int i;
+
+	if (b == NULL) {
+		if (tail == head) {
+			running = 0;
+			return 0;
+		}
+
+		b = cur = &queue[tail & QUEUE_MASK];
+		b->busy = 1;
+		cur_n = 0;
+		for (i = 0; i < conf.axes; i++) {
+			counter[i] = -(int32_t)(b->step_count >> 1);
+		}
+
+		if (!b->initial_rate) {
+			stats.stops++;
+		}
+	}
+
+	// The rate halfway into the step
+	if (cur_n < b->accel_until) {
+		v = isqrt(b->initial_rate * b->initial_rate + b->accel_st * (2 * cur_n + 1));
+	} else if (cur_n >= b->decel_after) {
+		r = b->step_count - cur_n;
+		v = isqrt(b->final_rate * b->final_rate + b->accel_st * (2 * r - 1));
+	} else {
+		v = b->nominal_rate;
+	}
+
+	if (v > b->nominal_rate) {
+		v = b->nominal_rate;
+	}
+	if (v > stats.rate_max) {
+		stats.rate_max = v;
+	}
+
+	ev->dt = CPU_HZ / v;
+	ev->dir = b->dir;
+	ev->axes = 0;
+
+	for (i = 0; i < conf.axes; i++) {
+		counter[i] += abs(b->steps[i]);
+		if (counter[i] > 0) {
+			counter[i] -= b->step_count;
+			ev->axes |= 1 << i;
+			position[i] += (b->steps[i] < 0) ? -1 : 1;
+		}
+	}
+
+	stats.steps++;
+
+	if (++cur_n == b->step_count) {
+		b->busy = 0;
+		cur = NULL;
+		barrier();
+		tail++;
+		stats.blocks++;
+	}
+
+	return 1;
+}
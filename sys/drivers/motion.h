@@ -0,0 +1,125 @@
+/*
+ * bhgv, motion planner and step generator of the stepper motors
+ *
+ * Copyright (C) 2017
+ * Author: bhgv (http://github.com/bhgv)
+ *
+ * All rights reserved.
+ *
+ */
+
+#ifndef _MOTION_H_
+#define _MOTION_H_
+
+#include <stdint.h>
+
+// Axes moved together
+#ifndef MOTION_AXES
+#define MOTION_AXES 3
+#endif
+
+// Lines planned ahead, a power of 2
+#ifndef MOTION_QUEUE
+#define MOTION_QUEUE 16
+#endif
+
+// Steps per second of an axis, the step generator can't do more
+#ifndef MOTION_RATE_MAX
+#define MOTION_RATE_MAX 20000
+#endif
+
+#define MOTION_NO_PIN 0xff
+
+typedef struct {
+	uint8_t axes;                       // axes used, the first ones
+	uint8_t step_pin[MOTION_AXES];
+	uint8_t dir_pin[MOTION_AXES];
+	uint8_t pulse_us;                   // step pulse and direction setup time
+	float steps_per_mm[MOTION_AXES];    // < 0 reverses the direction pin
+	float rate[MOTION_AXES];            // max speed, mm/s
+	float accel[MOTION_AXES];           // max acceleration, mm/s^2
+	float junction;                     // junction deviation, mm
+} motion_config_t;
+
+/*
+ * A line, as planned. The speeds are along the line, in mm/s, the rates of
+ * the trapezoid in steps per second of the axis with the most steps, which
+ * steps at each step event.
+ */
+typedef struct {
+	int32_t steps[MOTION_AXES];         // signed
+	uint32_t step_count;                // steps of the main axis
+	float mm;
+	float nominal_speed;
+	float accel;                        // mm/s^2
+	float max_entry_speed;              // at the junction with the line before
+	float entry_speed;
+
+	// The trapezoid, for the step generator
+	uint32_t initial_rate;
+	uint32_t nominal_rate;
+	uint32_t final_rate;
+	uint32_t accel_st;                  // steps/s^2
+	uint32_t accel_until;               // steps accelerating
+	uint32_t decel_after;               // steps before the deceleration
+	uint8_t dir;                        // bit n, axis n goes backwards
+	volatile uint8_t busy;              // being stepped
+} motion_block_t;
+
+// A step event: the axes that step together, their directions and the time
+// since the event before in CPU cycles
+typedef struct {
+	uint32_t axes;
+	uint32_t dir;
+	uint32_t dt;
+} motion_event_t;
+
+typedef struct {
+	uint32_t queued;                    // lines queued
+	uint32_t blocks;                    // lines stepped
+	uint32_t stops;                     // lines started at rest
+	uint32_t steps;                     // step events
+	uint32_t pending;                   // lines in the queue
+	uint32_t rate_max;                  // steps/s
+	uint32_t late_max;                  // of a step, us (board only)
+	uint32_t plan_us;                   // time of the last motion_line()
+	uint8_t running;
+} motion_stats_t;
+
+/*
+ * Sets the axes up and stops: the queue is flushed, the position is 0.
+ * Returns 0 or EINVAL.
+ */
+int motion_setup(const motion_config_t *cfg);
+
+/*
+ * Queues a line to target (mm, MOTION_AXES values) at the feed speed
+ * (mm/s) and plans the queue again. Returns 0, EAGAIN if the queue is full,
+ * or EINVAL. A line shorter than a step is dropped.
+ */
+int motion_line(const float *target, float feed);
+
+// Steps the queue. It also starts when full.
+void motion_start(void);
+
+// Stops at once, the queue is flushed and the position is the one stepped
+void motion_stop(void);
+
+// Lines queued or being stepped
+int motion_busy(void);
+
+// The position stepped, in mm
+void motion_position(float *mm);
+
+// Sets the position of the axes without moving, when not busy
+int motion_set_position(const float *mm);
+
+void motion_get_stats(motion_stats_t *st);
+
+/*
+ * The next step event, from the step generator (or a test). Returns 0 when
+ * the queue is empty and then stops.
+ */
+int motion_next(motion_event_t *ev);
+
+#endif
@@ -1,4 +1,7 @@
 
 #ifdef PLATFORM_ESP8266
 #include <sys/drivers/esp8266/uart.h>
+#endif
+#ifdef PLATFORM_HOST
+#include <sys/drivers/host/uart.h>
 #endif
\ No newline at end of file
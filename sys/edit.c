@@ -60,6 +60,10 @@ int linux_console = 0;
 
 #define MINEXTEND      512 //32768
 #define LINEBUF_EXTRA  32
+#define MINPIECES      16
+#define PAGESIZE       512
+#define PAGES          4
+#define OUTBUFSIZE     2048
 
 #ifndef TABSIZE
 #define TABSIZE        8
@@ -139,18 +143,32 @@ int linux_console = 0;
 //
 // Editor data block
 //
-// Structure of split buffer:
+// The text is kept in a piece table. The original file is left on disk and
+// read through a small page cache, text inserted while editing is appended
+// to the add buffer. The document is the concatenation of the pieces:
 //
-//    +------------------+------------------+------------------+
-//    | text before gap  |        gap       |  text after gap  |
-//    +------------------+------------------+------------------+
-//    ^                  ^                  ^                  ^     
-//    |                  |                  |                  |
-//  start               gap                rest               end
+//    +-------------+--------+----------------------+
+//    | orig 0-1199 | add 0-4| orig 1210-30000      |   pieces
+//    +-------------+--------+----------------------+
+//
+// so only the edited spans are held in memory, whatever the file size.
 //
 
 struct env;
 
+struct piece {
+  int offset;              // Offset in the original file or add buffer
+  int len;                 // Length of piece
+  int add;                 // Piece is in the add buffer
+};
+
+struct page {
+  int offset;              // File offset of page, or -1 if unused
+  int len;                 // Valid bytes in page
+  int age;                 // Last use, for replacement
+  unsigned char *data;
+};
+
 struct undo {
   int pos;                 // Editor position
   int erased;              // Size of erased contents
@@ -162,10 +180,23 @@ struct undo {
 };
 
 struct editor {
-  unsigned char *start;      // Start of text buffer
-  unsigned char *gap;        // Start of gap
-  unsigned char *rest;       // End of gap
-  unsigned char *end;        // End of text buffer
+  struct piece *pieces;      // Piece table
+  int npieces;               // Number of pieces in use
+  int maxpieces;             // Allocated size of piece table
+  int length;                // Text length
+
+  unsigned char *addbuf;     // Text added while editing
+  int addlen;                // Used size of add buffer
+  int addsize;               // Allocated size of add buffer
+
+  int fd;                    // Original file, or -1 for none
+  struct page pages[PAGES];  // Page cache for the original file
+  struct page *lastpage;     // Page used by the last lookup
+  int pageclock;             // Page use counter
+  unsigned char *pagebuf;    // Memory for the page cache
+
+  int lastpiece;             // Piece found by the last lookup
+  int lastpiecepos;          // Text position of that piece
 
   int toppos;                // Text position for current top screen line
   int topline;               // Line number for top of screen
@@ -212,9 +243,12 @@ struct env {
 
 
 
+void outflush();
+
 #undef getchar
 int getchar(){
 	char ch;
+	outflush();
 	while (!uart_read(CONSOLE_UART, (char *)&ch, 2000)) ;
 	return ch;
 }
@@ -256,6 +290,7 @@ void reset_undo(struct editor *ed) {
 struct editor *create_editor(struct env *env) {
   struct editor *ed = (struct editor *) malloc(sizeof(struct editor));
   memset(ed, 0, sizeof(struct editor));
+  ed->fd = -1;
   if (env->current) {
     ed->next = env->current->next;
     ed->prev = env->current;
@@ -269,6 +304,20 @@ struct editor *create_editor(struct env *env) {
   return ed;
 }
 
+void close_text(struct editor *ed) {
+  if (ed->fd >= 0) close(ed->fd);
+  ed->fd = -1;
+  if (ed->pagebuf) free(ed->pagebuf);
+  ed->pagebuf = NULL;
+  ed->lastpage = NULL;
+  if (ed->addbuf) free(ed->addbuf);
+  ed->addbuf = NULL;
+  ed->addlen = ed->addsize = 0;
+  ed->npieces = 0;
+  ed->length = 0;
+  ed->lastpiece = ed->lastpiecepos = 0;
+}
+
 void delete_editor(struct editor *ed) {
   if (ed->next == ed) {
     ed->env->current = NULL;
@@ -277,7 +326,8 @@ void delete_editor(struct editor *ed) {
   }
   ed->next->prev = ed->prev;
   ed->prev->next = ed->next;
-  if (ed->start) free(ed->start);
+  close_text(ed);
+  if (ed->pieces) free(ed->pieces);
   clear_undo(ed);
   free(ed);
 }
@@ -305,181 +355,309 @@ int new_file(struct editor *ed, char *filename) {
   }
   ed->permissions = 0644;
 
-  ed->start = (unsigned char *) malloc(MINEXTEND);
-  if (!ed->start) return -1;
-#ifdef DEBUG
-  memset(ed->start, 0, MINEXTEND);
-#endif
+  ed->pieces = (struct piece *) malloc(MINPIECES * sizeof(struct piece));
+  if (!ed->pieces) return -1;
+  ed->maxpieces = MINPIECES;
 
-  ed->gap = ed->start;
-  ed->rest = ed->end = ed->gap + MINEXTEND;
   ed->anchor = -1;
   
   return 0;
 }
 
-int load_file(struct editor *ed, char *filename) {
+int open_text(struct editor *ed) {
   struct stat statbuf;
-  int length;
-  int f;
+  int i;
 
-  if (!realpath(filename, ed->filename)) return -1;
-    
-  f = open(ed->filename, O_RDONLY);
-  if (f < 0) return -1;
+  close_text(ed);
 
-  if (fstat(f, &statbuf) < 0) goto err;
-  length = statbuf.st_size;
+  ed->fd = open(ed->filename, O_RDONLY);
+  if (ed->fd < 0) return -1;
+
+  if (fstat(ed->fd, &statbuf) < 0) goto err;
   ed->permissions = statbuf.st_mode & 0777;
 
-  ed->start = (unsigned char *) malloc(length + MINEXTEND);
-  if (!ed->start) goto err;
-#ifdef DEBUG
-  memset(ed->start, 0, length + MINEXTEND);
-#endif
-  if (read(f, ed->start, length) != length) goto err;
+  if (!ed->pieces) {
+    ed->pieces = (struct piece *) malloc(MINPIECES * sizeof(struct piece));
+    if (!ed->pieces) goto err;
+    ed->maxpieces = MINPIECES;
+  }
 
-  ed->gap = ed->start + length;
-  ed->rest = ed->end = ed->gap + MINEXTEND;
-  ed->anchor = -1;
+  ed->pagebuf = (unsigned char *) malloc(PAGES * PAGESIZE);
+  if (!ed->pagebuf) goto err;
+  for (i = 0; i < PAGES; i++) {
+    ed->pages[i].offset = -1;
+    ed->pages[i].len = 0;
+    ed->pages[i].age = 0;
+    ed->pages[i].data = ed->pagebuf + i * PAGESIZE;
+  }
+
+  ed->length = statbuf.st_size;
+  if (ed->length > 0) {
+    ed->pieces[0].offset = 0;
+    ed->pieces[0].len = ed->length;
+    ed->pieces[0].add = 0;
+    ed->npieces = 1;
+  }
 
-  close(f);
   return 0;
 
 err:
-  close(f);
-  if (ed->start) {
-    free(ed->start);
-    ed->start = NULL;
-  }
+  close_text(ed);
   return -1;
 }
 
-int save_file(struct editor *ed) {
-  int f;
+int load_file(struct editor *ed, char *filename) {
+  if (!realpath(filename, ed->filename)) return -1;
+  if (open_text(ed) < 0) return -1;
+  ed->anchor = -1;
+  return 0;
+}
 
-  f = open(ed->filename, O_CREAT | O_TRUNC | O_WRONLY, ed->permissions);
-  if (f < 0) return -1;
+//
+// Get a pointer to the original file contents at offset. Returns the number
+// of bytes available from there in the cached page, or 0 on error.
+//
 
-  if (write(f, ed->start, ed->gap - ed->start) != ed->gap - ed->start) goto err;
-  if (write(f, ed->rest, ed->end - ed->rest) != ed->end - ed->rest) goto err;
+int file_ptr(struct editor *ed, int offset, unsigned char **ptr) {
+  struct page *pg = ed->lastpage;
+  struct page *victim;
+  int base, n, i;
+
+  base = offset - offset % PAGESIZE;
+  if (!pg || pg->offset != base) {
+    victim = pg = ed->pages;
+    for (i = 0; i < PAGES; i++, pg++) {
+      if (pg->offset == base) break;
+      if (pg->age < victim->age) victim = pg;
+    }
+    if (i == PAGES) {
+      pg = victim;
+      pg->offset = -1;
+      if (lseek(ed->fd, base, SEEK_SET) < 0) return 0;
+      n = read(ed->fd, pg->data, PAGESIZE);
+      if (n <= 0) return 0;
+      pg->offset = base;
+      pg->len = n;
+    }
+    pg->age = ++ed->pageclock;
+    ed->lastpage = pg;
+  }
+
+  if (offset - base >= pg->len) return 0;
+  *ptr = pg->data + (offset - base);
+  return pg->len - (offset - base);
+}
+
+int write_text(struct editor *ed, int f) {
+  struct piece *pc;
+  unsigned char *p;
+  int i, offset, left, n;
+
+  for (i = 0; i < ed->npieces; i++) {
+    pc = &ed->pieces[i];
+    if (pc->add) {
+      if (write(f, ed->addbuf + pc->offset, pc->len) != pc->len) return -1;
+      continue;
+    }
+    offset = pc->offset;
+    left = pc->len;
+    while (left > 0) {
+      n = file_ptr(ed, offset, &p);
+      if (n <= 0) return -1;
+      if (n > left) n = left;
+      if (write(f, p, n) != n) return -1;
+      offset += n;
+      left -= n;
+    }
+  }
+  return 0;
+}
 
+int save_file(struct editor *ed) {
+  char *tmpname = NULL;
+  char *oldname = NULL;
+  int moved = 0;
+  int f, len, rc;
+
+  if (ed->fd >= 0) {
+    // The original file is still being read from, so write a new copy
+    // next to it and swap it in when done
+    len = strlen(ed->filename);
+    tmpname = malloc(2 * (len + 3));
+    if (!tmpname) return -1;
+    oldname = tmpname + len + 3;
+    sprintf(tmpname, "%s~", ed->filename);
+    sprintf(oldname, "%s~~", ed->filename);
+  }
+
+  f = open(tmpname ? tmpname : ed->filename, O_CREAT | O_TRUNC | O_WRONLY, ed->permissions);
+  if (f < 0) goto err;
+  if (write_text(ed, f) < 0) goto err;
   close(f);
+  f = -1;
+
+  if (tmpname && rename(tmpname, ed->filename) < 0) {
+    // Some file systems (SPIFFS) can't rename over an existing file. The
+    // original is moved aside, still open, until the new copy has its name,
+    // and moved back if that fails. Then the text is left in the ~ file.
+    unlink(oldname);
+    if (rename(ed->filename, oldname) < 0) goto err;
+    moved = 1;
+    if (rename(tmpname, ed->filename) < 0) {
+      rename(oldname, ed->filename);
+      goto err;
+    }
+  }
+
+  // Start over from the saved file, which frees the add buffer
+  rc = open_text(ed);
+  if (moved) unlink(oldname);
+  if (tmpname) free(tmpname);
+  if (rc < 0) return -1;
+
   ed->dirty = 0;
   clear_undo(ed);
   return 0;
 
 err:
-  close(f);
+  if (f >= 0) close(f);
+  if (tmpname) free(tmpname);
   return -1;
 }
 
 int text_length(struct editor *ed) {
-  return (ed->gap - ed->start) + (ed->end - ed->rest);
+  return ed->length;
 }
 
-unsigned char *text_ptr(struct editor *ed, int pos) {
-  unsigned char *p = ed->start + pos;
-  if (p >= ed->gap) p += (ed->rest - ed->gap);
-  return p;
-}
-
-void move_gap(struct editor *ed, int pos, int minsize) {
-  int gapsize = ed->rest - ed->gap;
-  unsigned char *p = text_ptr(ed, pos);
-  if (minsize < 0) minsize = 0;
+//
+// Find the piece containing pos, starting from the piece found by the last
+// lookup so sequential access is cheap. Returns npieces at the end of text.
+//
 
-  if (minsize <= gapsize) {
-    if (p != ed->rest) {
-      if (p < ed->gap) {
-        memmove(p + gapsize, p, ed->gap - p);
-      } else {
-        memmove(ed->gap, ed->rest, p - ed->rest);
-      }
-      ed->gap = ed->start + pos;
-      ed->rest = ed->gap + gapsize;
-    }
-  } else {
-    int newsize;
-    unsigned char *start;
-    unsigned char *gap;
-    unsigned char *rest;
-    unsigned char *end;
-
-    if (gapsize + MINEXTEND > minsize) minsize = gapsize + MINEXTEND;
-    newsize = (ed->end - ed->start) - gapsize + minsize;
-    start = (unsigned char *) malloc(newsize); // TODO check for out of memory
-    gap = start + pos;
-    rest = gap + minsize;
-    end = start + newsize;
-
-    if (p < ed->gap) {
-      memcpy(start, ed->start, pos);
-      memcpy(rest, p, ed->gap - p);
-      memcpy(end - (ed->end - ed->rest), ed->rest, ed->end - ed->rest);
-    } else {
-      memcpy(start, ed->start, ed->gap - ed->start);
-      memcpy(start + (ed->gap - ed->start), ed->rest, p - ed->rest);
-      memcpy(rest, p, ed->end - p);
-    }
+int find_piece(struct editor *ed, int pos, int *start) {
+  int i = ed->lastpiece;
+  int p = ed->lastpiecepos;
 
-    free(ed->start);
-    ed->start = start;
-    ed->gap = gap;
-    ed->rest = rest;
-    ed->end = end;
+  if (i >= ed->npieces || pos < p / 2) {
+    i = p = 0;
+  }
+  while (i > 0 && pos < p) {
+    i--;
+    p -= ed->pieces[i].len;
+  }
+  while (i < ed->npieces && pos >= p + ed->pieces[i].len) {
+    p += ed->pieces[i].len;
+    i++;
   }
 
-#ifdef DEBUG
-  memset(ed->gap, 0, ed->rest - ed->gap);
-#endif
-}
-
-void close_gap(struct editor *ed) {
-  int len = text_length(ed);
-  move_gap(ed, len, 1);
-  ed->start[len] = 0;
+  if (i < ed->npieces) {
+    ed->lastpiece = i;
+    ed->lastpiecepos = p;
+  }
+  *start = p;
+  return i;
 }
 
 int get(struct editor *ed, int pos) {
-  unsigned char *p = text_ptr(ed, pos);
-  if (p >= ed->end) return -1;
+  struct piece *pc;
+  unsigned char *p;
+  int start;
+
+  if (pos < 0 || pos >= ed->length) return -1;
+  pc = &ed->pieces[find_piece(ed, pos, &start)];
+  if (pc->add) return ed->addbuf[pc->offset + pos - start];
+  if (!file_ptr(ed, pc->offset + pos - start, &p)) return -1;
   return *p;
 }
 
-int compare(struct editor *ed, unsigned char *buf, int pos, int len) {
+int copy(struct editor *ed, unsigned char *buf, int pos, int len) {
+  struct piece *pc;
   unsigned char *bufptr = buf;
-  unsigned char *p = ed->start + pos;
-  if (p >= ed->gap) p += (ed->rest - ed->gap);
+  unsigned char *p;
+  int i, start, n;
+
+  if (pos < 0) return 0;
+  if (len > ed->length - pos) len = ed->length - pos;
+  i = find_piece(ed, pos, &start);
+  while (len > 0 && i < ed->npieces) {
+    pc = &ed->pieces[i];
+    if (pc->add) {
+      p = ed->addbuf + pc->offset + pos - start;
+      n = pc->len - (pos - start);
+    } else {
+      n = file_ptr(ed, pc->offset + pos - start, &p);
+      if (n <= 0) break;
+      if (n > pc->len - (pos - start)) n = pc->len - (pos - start);
+    }
+    if (n > len) n = len;
+    memcpy(bufptr, p, n);
+    bufptr += n;
+    pos += n;
+    len -= n;
+    if (pos == start + pc->len) {
+      start += pc->len;
+      i++;
+    }
+  }
 
-  while (len > 0) {
-    if (p == ed->end) return 0;
-    if (*bufptr++ != *p) return 0;
-    len--;
-    if (++p == ed->gap) p = ed->rest;
+  return bufptr - buf;
+}
+
+int compare(struct editor *ed, unsigned char *buf, int pos, int len) {
+  int i;
+
+  if (pos < 0 || pos + len > ed->length) return 0;
+  for (i = 0; i < len; i++) {
+    if (get(ed, pos + i) != buf[i]) return 0;
   }
 
   return 1;
 }
 
-int copy(struct editor *ed, unsigned char *buf, int pos, int len) {
-  unsigned char *bufptr = buf;
-  unsigned char *p = ed->start + pos;
-  if (p >= ed->gap) p += (ed->rest - ed->gap);
+//
+// Split the piece containing pos so that a piece starts at pos, and return
+// its index. The piece table must have room for one more piece.
+//
 
-  while (len > 0) {
-    if (p == ed->end) break;
-    *bufptr++ = *p;
-    len--;
-    if (++p == ed->gap) p = ed->rest;
-  }
+int split_piece(struct editor *ed, int pos) {
+  struct piece *pc;
+  int i, start;
 
-  return bufptr - buf;
+  i = find_piece(ed, pos, &start);
+  if (i == ed->npieces || pos == start) return i;
+
+  pc = &ed->pieces[i];
+  memmove(pc + 2, pc + 1, (ed->npieces - i - 1) * sizeof(struct piece));
+  pc[1] = pc[0];
+  pc[0].len = pos - start;
+  pc[1].offset += pos - start;
+  pc[1].len -= pos - start;
+  ed->npieces++;
+
+  return i + 1;
 }
 
-void replace(struct editor *ed, int pos, int len, unsigned char *buf, int bufsize, int doundo) {
-  unsigned char *p;
+int replace(struct editor *ed, int pos, int len, unsigned char *buf, int bufsize, int doundo) {
   struct undo *undo;
+  struct piece *pc;
+  int first, last;
+
+  // Make room for the new text and pieces first, so running out of memory
+  // leaves the text untouched
+  if (ed->addlen + bufsize > ed->addsize) {
+    int newsize = ed->addsize + (bufsize > MINEXTEND ? bufsize : MINEXTEND);
+    unsigned char *addbuf = (unsigned char *) realloc(ed->addbuf, newsize);
+    if (!addbuf) return -1;
+    ed->addbuf = addbuf;
+    ed->addsize = newsize;
+  }
+  if (ed->npieces + 3 > ed->maxpieces) {
+    int newmax = ed->maxpieces ? ed->maxpieces * 2 : MINPIECES;
+    struct piece *pieces = (struct piece *) realloc(ed->pieces, newmax * sizeof(struct piece));
+    if (!pieces) return -1;
+    ed->pieces = pieces;
+    ed->maxpieces = newmax;
+  }
 
   // Store undo information
   if (doundo) {
@@ -526,22 +704,34 @@ void replace(struct editor *ed, int pos, int len, unsigned char *buf, int bufsiz
     }
   }
 
-  p = ed->start + pos;
-  if (bufsize == 0 && p <= ed->gap && p + len >= ed->gap) {
-    // Handle deletions at the edges of the gap
-    ed->rest += len - (ed->gap - p);
-    ed->gap = p;
-  } else {
-    // Move the gap
-    move_gap(ed, pos + len, bufsize - len);
+  // Remove the pieces of the replaced text
+  first = split_piece(ed, pos);
+  last = split_piece(ed, pos + len);
+  memmove(&ed->pieces[first], &ed->pieces[last], (ed->npieces - last) * sizeof(struct piece));
+  ed->npieces -= last - first;
 
-    // Replace contents
-    memcpy(ed->start + pos, buf, bufsize);
-    ed->gap = ed->start + pos + bufsize;
+  // Add the new text, extending the previous piece when typing
+  if (bufsize > 0) {
+    pc = &ed->pieces[first];
+    if (first > 0 && pc[-1].add && pc[-1].offset + pc[-1].len == ed->addlen) {
+      pc[-1].len += bufsize;
+    } else {
+      memmove(pc + 1, pc, (ed->npieces - first) * sizeof(struct piece));
+      pc->offset = ed->addlen;
+      pc->len = bufsize;
+      pc->add = 1;
+      ed->npieces++;
+    }
+    memcpy(ed->addbuf + ed->addlen, buf, bufsize);
+    ed->addlen += bufsize;
   }
 
+  ed->length += bufsize - len;
+  ed->lastpiece = ed->lastpiecepos = 0;
+
   // Mark buffer as dirty
   ed->dirty = 1;
+  return 0;
 }
 
 void insert(struct editor *ed, int pos, unsigned char *buf, int bufsize) {
@@ -603,18 +793,18 @@ int prev_line(struct editor *ed, int pos) {
 }
 
 int column(struct editor *ed, int linepos, int col) {
-  unsigned char *p = text_ptr(ed, linepos);
+  int pos = linepos;
   int c = 0;
   while (col > 0) {
-    if (p == ed->end) break;
-    if (*p == '\t') {
+    int ch = get(ed, pos++);
+    if (ch < 0) break;
+    if (ch == '\t') {
       int spaces = TABSIZE - c % TABSIZE;
       c += spaces;
     } else {
       c++;
     }
     col--;
-    if (++p == ed->gap) p = ed->rest;
   }
   return c;
 }
@@ -757,16 +947,48 @@ void get_console_size(struct env *env) {
   env->linebuf = realloc(env->linebuf, env->cols + LINEBUF_EXTRA);
 }
 
-void outch(char c) {
-  putchar(c);
+//
+// Screen output is collected in outbuffer and written in one go by
+// outflush(), instead of a write per character or escape sequence.
+//
+
+static unsigned char *outbuffer;
+static int outlen;
+
+void outflush() {
+  if (outlen > 0) fwrite(outbuffer, 1, outlen, stdout);
+  outlen = 0;
+  fflush(stdout);
 }
 
 void outbuf(unsigned char *buf, int len) {
-  fwrite(buf, 1, len, stdout);
+  int n;
+
+  if (!outbuffer) {
+    fwrite(buf, 1, len, stdout);
+    return;
+  }
+
+  while (len > 0) {
+    if (outlen == OUTBUFSIZE) {
+      fwrite(outbuffer, 1, outlen, stdout);
+      outlen = 0;
+    }
+    n = OUTBUFSIZE - outlen;
+    if (n > len) n = len;
+    memcpy(outbuffer + outlen, buf, n);
+    outlen += n;
+    buf += n;
+    len -= n;
+  }
+}
+
+void outch(char c) {
+  outbuf((unsigned char *) &c, 1);
 }
 
 void outstr(char *str) {
-  fputs(str, stdout);
+  outbuf((unsigned char *) str, strlen(str));
 }
 
 void clear_screen() {
@@ -998,7 +1220,7 @@ int prompt(struct editor *ed, char *msg, int selection) {
   }
 
   for (;;) {
-    fflush(stdout);
+    outflush();
     ch = getkey();
     if (ch == KEY_ESC) {
       return 0;
@@ -1027,14 +1249,16 @@ int ask() {
 //
 
 void display_message(struct editor *ed, char *fmt, ...) {
+  char msg[256];
   va_list args;
 
   va_start(args, fmt);
   gotoxy(0, ed->env->lines);
   outstr(STATUS_COLOR);
-  vprintf(fmt, args);
+  vsnprintf(msg, sizeof(msg), fmt, args);
+  outstr(msg);
   outstr(CLREOL TEXT_COLOR);
-  fflush(stdout);
+  outflush();
   va_end(args);
 }
 
@@ -1058,7 +1282,6 @@ void edit_display_line(struct editor *ed, int pos, int fullline) {
   int margin = ed->margin;
   int maxcol = ed->env->cols + margin;
   unsigned char *bufptr = ed->env->linebuf;
-  unsigned char *p = text_ptr(ed, pos);
   int selstart, selend, ch;
   char *s;
 
@@ -1074,9 +1297,8 @@ void edit_display_line(struct editor *ed, int pos, int fullline) {
       }
     }
 
-    if (p == ed->end) break;
-    ch = *p;
-    if (ch == '\r' || ch == '\n') break;
+    ch = get(ed, pos);
+    if (ch < 0 || ch == '\r' || ch == '\n') break;
 
     if (ch == '\t') {
       int spaces = TABSIZE - col % TABSIZE;
@@ -1098,7 +1320,6 @@ void edit_display_line(struct editor *ed, int pos, int fullline) {
       col++;
     }
 
-    if (++p == ed->gap) p = ed->rest;
     pos++;
   }
 
@@ -1792,12 +2013,15 @@ void find_text(struct editor *ed, int next) {
   if (!ed->env->search) return;
   slen = strlen(ed->env->search);
   if (slen > 0) {
-    unsigned char *match;
-    
-    close_gap(ed);
-    match = strstr(ed->start + ed->linepos + ed->col, ed->env->search);
-    if (match != NULL) {
-      int pos = match - ed->start;
+    unsigned char *search = ed->env->search;
+    int pos = ed->linepos + ed->col;
+    int last = text_length(ed) - slen;
+
+    while (pos <= last) {
+      if (get(ed, pos) == search[0] && compare(ed, search, pos, slen)) break;
+      pos++;
+    }
+    if (pos <= last) {
       ed->anchor = pos;
       moveto(ed, pos + slen, 1);
     } else {
@@ -1941,7 +2165,7 @@ void help(struct editor *ed) {
   outstr("Shift+<tab>  Unindent selection\r\n");
   outstr("\r\n(*) Extends selection if combined with Shift");
   outstr("\r\nPress any key to continue...");
-  fflush(stdout);
+  outflush();
 
   getkey();
   draw_screen(ed);
@@ -1972,7 +2196,7 @@ void edit(struct editor *ed) {
     }
 
     position_cursor(ed);
-    fflush(stdout);
+    outflush();
     key = getkey();
 
     if (key >= ' ' && key <= 0x7F) {
@@ -2104,11 +2328,11 @@ int edit_main(int argc, char *argv[]) {
   }
 #endif
 
-int buff_size = 8192;
-//setvbuf(stdout, NULL, 0, 1024); //8192);
-while (setvbuf(stdout, NULL, _IOFBF, buff_size) != 0) {
-	buff_size = buff_size - 256;
-}
+  // Screen updates are batched in outbuffer, so stdout itself doesn't need
+  // a buffer
+  setvbuf(stdout, NULL, _IONBF, 0);
+  outbuffer = (unsigned char *) malloc(OUTBUFSIZE);
+  outlen = 0;
 
 #ifdef __linux__
   tcgetattr(0, &orig_tio);
@@ -2138,6 +2362,9 @@ while (setvbuf(stdout, NULL, _IOFBF, buff_size) != 0) {
 
   gotoxy(0, env.lines + 1);
   outstr(RESET_COLOR CLREOL);
+  outflush();
+  if (outbuffer) free(outbuffer);
+  outbuffer = NULL;
 #ifdef __linux__
   tcsetattr(0, TCSANOW, &orig_tio);   
 #endif
@@ -28,19 +28,64 @@
  */
 
 #include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdint.h>
 
 #include <sys/delay.h>
- 
-void delay(unsigned int msec) {
+#include <sys/drivers/clock.h>
+
+// Spin on the core timer, for delays shorter than a tick
+static void spin_us(unsigned int usec) {
     unsigned int tWait, tStart;
-    tWait = (CPU_HZ / (1000 * (CPU_HZ / CORE_TIMER_HZ))) * msec;
+    tWait = (CPU_HZ / (1000000 * (CPU_HZ / CORE_TIMER_HZ))) * usec;
     tStart = _read_core_timer();
     while((_read_core_timer() - tStart) < tWait);
 }
 
+// The scheduler can only be used from a task, with the scheduler running
+static int can_block() {
+    return !portIN_ISR() && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+}
+
+/*
+ * Wait usec microseconds. Whole ticks are waited with vTaskDelay, so other
+ * tasks can run, and only the sub-tick remainder is spinned. vTaskDelay(n)
+ * returns before n full tick periods have elapsed, so the loop ends spinning
+ * less than a tick. A task of higher priority can still keep this one from
+ * running past end, now > end is checked before end - now, that is unsigned.
+ */
+static void delay_us(uint64_t usec) {
+    uint64_t now, end;
+
+    if ((usec < portTICK_PERIOD_US) || !can_block()) {
+        // Keep the cycle count of each spin in 32 bits
+        while (usec > 1000000) {
+            spin_us(1000000);
+            usec -= 1000000;
+        }
+
+        spin_us(usec);
+        return;
+    }
+
+    now = clock_monotonic_us();
+    end = now + usec;
+
+    while ((now < end) && (end - now >= portTICK_PERIOD_US)) {
+        vTaskDelay((end - now) / portTICK_PERIOD_US);
+        now = clock_monotonic_us();
+    }
+
+    if (end > now) {
+        spin_us(end - now);
+    }
+}
+
+void delay(unsigned int msec) {
+    delay_us((uint64_t)msec * 1000);
+}
+
 void udelay(unsigned int usec) {
-    unsigned int tWait, tStart;
-    tWait = (CPU_HZ / (1000000 * (CPU_HZ / CORE_TIMER_HZ))) * usec;
-    tStart = _read_core_timer();
-    while((_read_core_timer() - tStart) < tWait);
-}
\ No newline at end of file
+    delay_us(usec);
+}
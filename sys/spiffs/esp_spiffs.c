@@ -96,7 +96,7 @@ s32_t esp_spiffs_read(u32_t addr, u32_t size, u8_t *dst) {
 		    return SPIFFS_ERR_INTERNAL;
 		}
 
-		abuff = (u8_t *)(((ptrdiff_t)buff + 3) & (u32_t)(-4));
+		abuff = (u8_t *)(((ptrdiff_t)buff + 3) & -4);
 
 //usleep(10);
 		if (sdk_spi_flash_read(aaddr, (void *)abuff, asize) != 0) {
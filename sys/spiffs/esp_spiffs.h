@@ -50,6 +50,36 @@ void esp_spiffs_deinit();
 int32_t esp_spiffs_mount();
 
 
+/**
+ * SPIFFS cache and read-ahead statistics.
+ */
+typedef struct {
+    u32_t cache_hits;   // SPIFFS page cache hits
+    u32_t cache_misses; // SPIFFS page cache misses
+    u32_t ra_hits;      // reads served from a read-ahead buffer
+    u32_t ra_misses;    // read-ahead buffer refills
+    u32_t ra_bytes;     // bytes read into read-ahead buffers
+    u16_t cache_pages;  // pages in the page cache
+    u16_t max_fds;      // SPIFFS file descriptors
+    u16_t ra_size;      // read-ahead buffer size per descriptor
+} esp_spiffs_stats_t;
+
+// Largest read-ahead buffer, its length is a u16_t
+#define SPIFFS_READ_AHEAD_MAX 0xffff
+
+/**
+ * Set the read-ahead size of the files opened from now on, 0 disables it.
+ * It is rounded up to a page and down to SPIFFS_READ_AHEAD_MAX.
+ *
+ * The cache pages and the descriptors are set at build time only
+ * (SPIFFS_CACHE_PAGES and SPIFFS_MAX_FDS of config.mk), the file system is
+ * mounted once at boot.
+ */
+void spiffs_set_readahead(int ra_size);
+
+void spiffs_get_stats(esp_spiffs_stats_t *st);
+void spiffs_reset_stats();
+
 s32_t esp_spiffs_read(u32_t addr, u32_t size, u8_t *dst);
 s32_t esp_spiffs_write(u32_t addr, u32_t size, u8_t *src);
 s32_t esp_spiffs_erase(u32_t addr, u32_t size);
@@ -62,12 +62,28 @@ typedef unsigned char u8_t;
 #define SPIFFS_CACHE_WR                 1
 #endif
 
-// Enable/disable statistics on caching. Debug/test purpose only.
+// Enable/disable statistics on caching. Exposed to Lua by fs.stats().
 #ifndef  SPIFFS_CACHE_STATS
-#define SPIFFS_CACHE_STATS              0
+#define SPIFFS_CACHE_STATS              1
 #endif
 #endif
 
+// Number of pages in the cache allocated at mount time
+#ifndef SPIFFS_CACHE_PAGES
+#define SPIFFS_CACHE_PAGES              5
+#endif
+
+// Number of file descriptors allocated at mount time
+#ifndef SPIFFS_MAX_FDS
+#define SPIFFS_MAX_FDS                  5
+#endif
+
+// Size of the private read-ahead buffer of each file opened read only.
+// Set to 0 to disable read-ahead.
+#ifndef SPIFFS_READ_AHEAD
+#define SPIFFS_READ_AHEAD               1024
+#endif
+
 // Always check header of each accessed page to ensure consistent state.
 // If enabled it will increase number of reads, will increase flash.
 #ifndef SPIFFS_PAGE_CHECK
@@ -30,3 +30,9 @@
 #include <sys/status.h>
 
 uint32_t LuaOS_status[] = {0};
+
+// External definitions of the inline functions, for calls the compiler
+// doesn't inline (-O0 / -Os builds)
+extern inline void status_set(u16_t flag);
+extern inline void status_clear(u16_t flag);
+extern inline int status_get(u16_t flag);
@@ -79,6 +79,35 @@ static u8_t *my_spiffs_work_buf;
 static u8_t *my_spiffs_fds;
 static u8_t *my_spiffs_cache;
 
+// Mount time tunables, from config.mk, and the read-ahead, see
+// spiffs_set_readahead
+static const int spiffs_cache_pages = SPIFFS_CACHE_PAGES;
+static const int spiffs_max_fds = SPIFFS_MAX_FDS;
+static int spiffs_ra_size = SPIFFS_READ_AHEAD;
+
+// Read-ahead statistics
+static u32_t spiffs_ra_hits;
+static u32_t spiffs_ra_misses;
+static u32_t spiffs_ra_bytes;
+
+/*
+ * Per descriptor state stored in fp->f_fs. The SPIFFS handle must be the
+ * first member, because other operations access it as a spiffs_file.
+ *
+ * pos is the logical file position seen by the caller, hw_pos the position
+ * of the SPIFFS descriptor. They differ when data has been read ahead into
+ * ra_buf, that holds ra_len bytes of the file starting at ra_pos.
+ */
+typedef struct {
+    spiffs_file fh;
+    s32_t pos;
+    s32_t hw_pos;
+    s32_t ra_pos;
+    u16_t ra_len;
+    u16_t ra_size;
+    u8_t ra_buf[];
+} spiffs_fp_t;
+
 /*
 void _spiffs_lock( spiffs *fs){
 //	xSemaphoreTakeRecursive(spiffsMux, portMAX_DELAY);
@@ -325,8 +354,9 @@ int spiffs_result(int res) {
 
 int spiffs_open_op(struct file *fp, int flags) {
     spiffs_flags mode = 0;
-    spiffs_file *FP;
+    spiffs_fp_t *FP;
     char *path = fp->f_path;
+    int ra_size = 0;
     int result = 0;
 	
     // Calculate open mode
@@ -348,11 +378,29 @@ int spiffs_open_op(struct file *fp, int flags) {
     if (flags & O_TRUNC)
         mode |= SPIFFS_TRUNC;
     
-    // Create a FIL structure
-    FP = (spiffs_file *)malloc(sizeof(spiffs_file));
+    // Read-ahead only makes sense for files opened read only, writes
+    // would invalidate the buffer all the time
+    if (mode == SPIFFS_RDONLY) {
+        ra_size = spiffs_ra_size;
+    }
+
+    // Create a FIL structure, with room for the read-ahead buffer
+    FP = (spiffs_fp_t *)malloc(sizeof(spiffs_fp_t) + ra_size);
+    if (!FP && ra_size) {
+        ra_size = 0;
+        FP = (spiffs_fp_t *)malloc(sizeof(spiffs_fp_t));
+    }
+
     if (!FP) {
         return ENOMEM;
     }
+
+    FP->fh = -1;
+    FP->pos = 0;
+    FP->hw_pos = 0;
+    FP->ra_pos = 0;
+    FP->ra_len = 0;
+    FP->ra_size = ra_size;
     
     // Store FIL into file
     fp->f_fs = FP;
@@ -368,8 +416,8 @@ int spiffs_open_op(struct file *fp, int flags) {
     }
     
     // Open file
-    *FP = SPIFFS_open(&fs, path, mode, 0); 
-    if (*FP < 0) {
+    FP->fh = SPIFFS_open(&fs, path, mode, 0); 
+    if (FP->fh < 0) {
         result = spiffs_result(fs.err_code);
     }
     
@@ -400,31 +448,121 @@ int spiffs_close_op(struct file *fp) {
     return result;
 }
 
+// Move the SPIFFS descriptor to the logical position, if needed
+static int spiffs_sync_pos(spiffs_fp_t *FP) {
+    s32_t res;
+
+    if (FP->hw_pos == FP->pos) {
+        return 0;
+    }
+
+    res = SPIFFS_lseek(&fs, FP->fh, FP->pos, SPIFFS_SEEK_SET);
+    if (res < 0) {
+        return spiffs_result(fs.err_code);
+    }
+
+    FP->hw_pos = res;
+
+    return 0;
+}
+
 int spiffs_read_op(struct file *fp, struct uio *uio, struct ucred *cred) {
-    int res;
+    spiffs_fp_t *FP = (spiffs_fp_t *)fp->f_fs;
     char *buf = uio->uio_iov->iov_base;
     unsigned int size = uio->uio_iov->iov_len;
+    unsigned int done = 0;
+    unsigned int len;
+    int res;
 
-   res = SPIFFS_read(&fs, *(spiffs_file *)fp->f_fs, buf, size); 
-    if (res >= 0) {
-        uio->uio_resid = uio->uio_resid - res;
-        res = 0;
-    } else {
-        res = spiffs_result(fs.err_code);
+    while (done < size) {
+        // Serve from the read-ahead buffer
+        if (FP->ra_len && (FP->pos >= FP->ra_pos) && (FP->pos < FP->ra_pos + FP->ra_len)) {
+            len = min(size - done, FP->ra_pos + FP->ra_len - FP->pos);
+
+            memcpy(buf + done, FP->ra_buf + (FP->pos - FP->ra_pos), len);
+
+            FP->pos += len;
+            done += len;
+            spiffs_ra_hits++;
+
+            continue;
+        }
+
+        if ((res = spiffs_sync_pos(FP))) {
+            return res;
+        }
+
+        // Big requests, or no read-ahead buffer, go directly to SPIFFS
+        if (size - done >= FP->ra_size) {
+            res = SPIFFS_read(&fs, FP->fh, buf + done, size - done);
+            if (res < 0) {
+                res = spiffs_result(fs.err_code);
+                if (res) {
+                    return res;
+                }
+
+                // EOF
+                break;
+            }
+
+            FP->pos += res;
+            FP->hw_pos = FP->pos;
+            done += res;
+
+            break;
+        }
+
+        // Refill the read-ahead buffer
+        spiffs_ra_misses++;
+
+        FP->ra_len = 0;
+        FP->ra_pos = FP->pos;
+
+        res = SPIFFS_read(&fs, FP->fh, FP->ra_buf, FP->ra_size);
+        if (res < 0) {
+            res = spiffs_result(fs.err_code);
+            if (res) {
+                return res;
+            }
+
+            res = 0;
+        }
+
+        FP->hw_pos += res;
+        FP->ra_len = res;
+        spiffs_ra_bytes += res;
+
+        if (res == 0) {
+            // EOF
+            break;
+        }
     }
 
-    return res;
+    uio->uio_resid = uio->uio_resid - done;
+
+    return 0;
 }
 
 int spiffs_write_op(struct file *fp, struct uio *uio, struct ucred *cred) {
+    spiffs_fp_t *FP = (spiffs_fp_t *)fp->f_fs;
     int res;
     char *buf = uio->uio_iov->iov_base;
     unsigned int size = uio->uio_iov->iov_len;
 
-    res = SPIFFS_write(&fs, *(spiffs_file *)fp->f_fs, buf, size);
+    if ((res = spiffs_sync_pos(FP))) {
+        return res;
+    }
+
+    // Data read ahead is not valid anymore
+    FP->ra_len = 0;
+
+    res = SPIFFS_write(&fs, FP->fh, buf, size);
     if (res >= 0) {
         uio->uio_resid = uio->uio_resid - res;
-        
+
+        FP->pos += res;
+        FP->hw_pos = FP->pos;
+
         res = 0;
     } else {
         res = spiffs_result(fs.err_code);
@@ -461,6 +599,7 @@ int spiffs_stat_op(struct file *fp, struct stat *sb) {
 }
 
 off_t spiffs_seek_op(struct file *fp, off_t offset, int where) {
+    spiffs_fp_t *FP = (spiffs_fp_t *)fp->f_fs;
     int whence = SPIFFS_SEEK_CUR;
     int res;
     
@@ -469,10 +608,28 @@ off_t spiffs_seek_op(struct file *fp, off_t offset, int where) {
         case SEEK_CUR: whence = SPIFFS_SEEK_CUR;break;
         case SEEK_END: whence = SPIFFS_SEEK_END;break;
     }
-    
-    res = SPIFFS_lseek(&fs, *(spiffs_file *)fp->f_fs, offset, whence);
+
+    // SPIFFS only knows its own position, that can be ahead of the
+    // logical one
+    if (whence == SPIFFS_SEEK_CUR) {
+        offset += FP->pos;
+        whence = SPIFFS_SEEK_SET;
+    }
+
+    // Seeks inside the read-ahead buffer don't touch the flash
+    if ((whence == SPIFFS_SEEK_SET) && FP->ra_len &&
+        (offset >= FP->ra_pos) && (offset < FP->ra_pos + FP->ra_len)) {
+        FP->pos = offset;
+
+        return offset;
+    }
+
+    res = SPIFFS_lseek(&fs, FP->fh, offset, whence);
     if (res < 0) {
         res = spiffs_result(fs.err_code);
+    } else {
+        FP->pos = res;
+        FP->hw_pos = res;
     }
     
     return res;
@@ -810,7 +967,7 @@ printf("spiffs_mount 0x%X 0x%X\n", SPIFFS_BASE_ADDR, SPIFFS_SIZE);
         return -1;
     }
     
-    int fds_len = sizeof(spiffs_fd) * 5;
+    int fds_len = sizeof(spiffs_fd) * spiffs_max_fds;
     my_spiffs_fds = malloc(fds_len);
     if (!my_spiffs_fds) {
         free(my_spiffs_work_buf);
@@ -818,7 +975,8 @@ printf("spiffs_mount 0x%X 0x%X\n", SPIFFS_BASE_ADDR, SPIFFS_SIZE);
         return -1;                
     }
     
-    int cache_len = cfg.log_page_size * 5;
+    int cache_len = (sizeof(spiffs_cache) +
+                     spiffs_cache_pages * (sizeof(spiffs_cache_page) + cfg.log_page_size));
     my_spiffs_cache = malloc(cache_len);
     if (!my_spiffs_cache) {
         free(my_spiffs_work_buf);
@@ -859,12 +1017,57 @@ retry:
         }
     }
     
-    syslog(LOG_INFO, "spiffs%d mounted", unit);
+    syslog(LOG_INFO, "spiffs%d mounted, %d cache pages, %d fds, %d bytes read-ahead",
+           unit, spiffs_cache_pages, spiffs_max_fds, spiffs_ra_size
+    );
 #endif
 
     return 1;
 }
 
+void spiffs_set_readahead(int ra_size) {
+    if (ra_size < 0) {
+        ra_size = 0;
+    }
+
+    // Read-ahead buffers smaller than a page are useless
+    if (ra_size && (ra_size < SPIFFS_LOG_PAGE_SIZE)) {
+        ra_size = SPIFFS_LOG_PAGE_SIZE;
+    }
+
+    if (ra_size > SPIFFS_READ_AHEAD_MAX) {
+        ra_size = SPIFFS_READ_AHEAD_MAX;
+    }
+
+    spiffs_ra_size = ra_size;
+}
+
+void spiffs_get_stats(esp_spiffs_stats_t *st) {
+#if SPIFFS_CACHE_STATS
+    st->cache_hits = fs.cache_hits;
+    st->cache_misses = fs.cache_misses;
+#else
+    st->cache_hits = 0;
+    st->cache_misses = 0;
+#endif
+    st->ra_hits = spiffs_ra_hits;
+    st->ra_misses = spiffs_ra_misses;
+    st->ra_bytes = spiffs_ra_bytes;
+    st->cache_pages = spiffs_cache_pages;
+    st->max_fds = spiffs_max_fds;
+    st->ra_size = spiffs_ra_size;
+}
+
+void spiffs_reset_stats() {
+#if SPIFFS_CACHE_STATS
+    fs.cache_hits = 0;
+    fs.cache_misses = 0;
+#endif
+    spiffs_ra_hits = 0;
+    spiffs_ra_misses = 0;
+    spiffs_ra_bytes = 0;
+}
+
 int spiffs_init() {
 	_spiffs_lock_init(/*&fs*/);
 	